@@ -0,0 +1,293 @@
+// Offline asset cooker: turns everything under the assets directory into the
+// files the runtime loads directly. OBJ meshes become welded .mesh files,
+// images become block compressed .dds files with their full mip chain and
+// existing .dds files are copied. A manifest maps every source path to its
+// cooked file, inputs whose content hash did not change are skipped.
+//
+// Usage: cooker [-f] [-j threads] [assets dir] [output dir]
+//   -f  cook everything even if the manifest says it is up to date
+//   -j  number of worker threads, defaults to one per hardware thread
+//
+// Run it from the directory that contains assets/, the default output is
+// cooked/. Outside of Visual Studio it builds with any C++17 compiler:
+//   g++ -std=c++17 -O2 -Ishadows cooker/main.cpp shadows/AssetManifest.cpp
+//       shadows/MeshFile.cpp shadows/TextureBuilder.cpp shadows/ImageDecoder.cpp shadows/DDSLoader.cpp
+//       shadows/MappedFile.cpp shadows/MipGenerator.cpp shadows/BlockCompressor.cpp shadows/JobSystem.cpp
+//       shadows/objloader.cpp shadows/stb_image.cpp shadows/Math.cpp -lpthread -o cooker
+
+#include "AssetManifest.h"
+#include "MeshFile.h"
+#include "TextureBuilder.h"
+#include "MappedFile.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Bump when the output of a cook step changes so that everything is cooked again
+#define COOKER_VERSION 1
+
+enum class CookKind
+{
+	Mesh = 0,
+	Texture = 1,
+	Copy = 2,
+};
+
+struct CookItem
+{
+	// path on disk and the normalized manifest key, they differ in case and separators
+	std::string Input;
+	std::string Source;
+	std::string Cooked;
+	CookKind Kind;
+	uint64_t Hash;
+	bool UpToDate;
+	bool Succeeded;
+	double Millis;
+};
+
+static double CookerNowMillis()
+{
+	using namespace std::chrono;
+	return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static bool CookerKindFromExtension(std::string extension, CookKind* kind)
+{
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+	if (extension == ".obj")
+	{
+		*kind = CookKind::Mesh;
+		return true;
+	}
+	if (extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".tga" || extension == ".bmp")
+	{
+		*kind = CookKind::Texture;
+		return true;
+	}
+	if (extension == ".dds")
+	{
+		*kind = CookKind::Copy;
+		return true;
+	}
+	return false;
+}
+
+static const char* CookerExtension(CookKind kind)
+{
+	return kind == CookKind::Mesh ? ".mesh" : ".dds";
+}
+
+static bool CookMesh(const CookItem& item)
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	if (!MeshFileLoadObj(item.Input.c_str(), &vertices, &indices))
+	{
+		return false;
+	}
+	MeshFileWeld(&vertices, &indices);
+	return MeshFileWrite(item.Cooked.c_str(), vertices, indices);
+}
+
+static bool CookTexture(const CookItem& item, JobSystem* jobs)
+{
+	TextureImage image;
+	if (!TextureBuildFromFile(item.Input.c_str(), TextureTypeFromFilename(item.Input.c_str()), jobs, &image))
+	{
+		return false;
+	}
+	return TextureWriteDDS(item.Cooked.c_str(), image);
+}
+
+static bool CookCopy(const CookItem& item)
+{
+	MappedFile source;
+	if (!source.Open(item.Input.c_str()))
+	{
+		return false;
+	}
+	FILE* f = AssetOpenFile(item.Cooked.c_str(), "wb");
+	if (!f)
+	{
+		return false;
+	}
+	const bool written = fwrite(source.GetData(), source.GetSize(), 1, f) == 1;
+	return fclose(f) == 0 && written;
+}
+
+static void CookerPrintUsage(void)
+{
+	printf("Usage: cooker [-f] [-j threads] [assets dir] [output dir]\n");
+}
+
+int main(int argc, char** argv)
+{
+	const double start = CookerNowMillis();
+
+	bool force = false;
+	uint32_t numThreads = 0;
+	std::vector<std::string> dirs;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-f") == 0)
+		{
+			force = true;
+		}
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+		{
+			numThreads = (uint32_t)atoi(argv[++i]);
+		}
+		else if (argv[i][0] == '-')
+		{
+			CookerPrintUsage();
+			return 1;
+		}
+		else
+		{
+			dirs.emplace_back(argv[i]);
+		}
+	}
+	if (dirs.size() > 2)
+	{
+		CookerPrintUsage();
+		return 1;
+	}
+	const std::string assetsDir = dirs.size() > 0 ? dirs[0] : "assets";
+	const std::string outputDir = dirs.size() > 1 ? dirs[1] : "cooked";
+	const std::string manifestPath = outputDir + "/" + ASSET_MANIFEST_FILENAME;
+
+	namespace fs = std::filesystem;
+	std::error_code error;
+	if (!fs::is_directory(assetsDir, error))
+	{
+		fprintf(stderr, "ERROR: %s is not a directory\n", assetsDir.c_str());
+		return 1;
+	}
+
+	AssetManifest previous;
+	if (!force)
+	{
+		previous.Load(manifestPath.c_str());
+	}
+
+	// collect inputs, the output directory is skipped in case it lives inside the assets
+	const fs::path outputPath = fs::weakly_canonical(outputDir, error);
+	std::vector<CookItem> items;
+	for (fs::recursive_directory_iterator it(assetsDir, error), end; it != end; it.increment(error))
+	{
+		if (it->is_directory() && fs::weakly_canonical(it->path(), error) == outputPath)
+		{
+			it.disable_recursion_pending();
+			continue;
+		}
+
+		CookItem item = {};
+		if (!it->is_regular_file() || !CookerKindFromExtension(it->path().extension().string(), &item.Kind))
+		{
+			continue;
+		}
+
+		item.Input = it->path().generic_string();
+		item.Source = AssetNormalizePath(item.Input.c_str());
+		fs::path cooked = fs::path(outputDir) / item.Source;
+		cooked.replace_extension(CookerExtension(item.Kind));
+		item.Cooked = cooked.generic_string();
+
+		const uint32_t versions[] = { COOKER_VERSION, (uint32_t)item.Kind, MESH_FILE_VERSION };
+		if (!AssetHashFile(item.Input.c_str(), &item.Hash, AssetHashBytes(versions, sizeof(versions))))
+		{
+			fprintf(stderr, "ERROR: Failed to read %s\n", item.Input.c_str());
+			return 1;
+		}
+
+		const AssetManifestEntry* entry = previous.Find(item.Source.c_str());
+		item.UpToDate = entry && entry->Hash == item.Hash && entry->Cooked == item.Cooked && fs::exists(item.Cooked, error);
+		if (!item.UpToDate)
+		{
+			fs::create_directories(cooked.parent_path(), error);
+		}
+		items.emplace_back(item);
+	}
+	std::sort(items.begin(), items.end(), [](const CookItem& a, const CookItem& b) { return a.Source < b.Source; });
+
+	std::vector<uint32_t> pending;
+	for (uint32_t i = 0; i < (uint32_t)items.size(); ++i)
+	{
+		if (!items[i].UpToDate)
+		{
+			pending.emplace_back(i);
+		}
+	}
+
+	// one item per job, big textures additionally split their mips and blocks across workers
+	JobSystem jobs;
+	jobs.Init(numThreads);
+	jobs.ParallelFor((uint32_t)pending.size(), 1, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				CookItem& item = items[pending[i]];
+				const double itemStart = CookerNowMillis();
+				switch (item.Kind)
+				{
+				case CookKind::Mesh:
+					item.Succeeded = CookMesh(item);
+					break;
+				case CookKind::Texture:
+					item.Succeeded = CookTexture(item, &jobs);
+					break;
+				default:
+					item.Succeeded = CookCopy(item);
+					break;
+				}
+				item.Millis = CookerNowMillis() - itemStart;
+			}
+		});
+
+	AssetManifest manifest;
+	uint32_t numFailed = 0;
+	for (const CookItem& item : items)
+	{
+		if (item.UpToDate || item.Succeeded)
+		{
+			AssetManifestEntry entry;
+			entry.Source = item.Source;
+			entry.Cooked = item.Cooked;
+			entry.Hash = item.Hash;
+			manifest.Set(entry);
+		}
+		if (item.UpToDate)
+		{
+			continue;
+		}
+		if (item.Succeeded)
+		{
+			printf("  %s -> %s (%.2f ms)\n", item.Source.c_str(), item.Cooked.c_str(), item.Millis);
+		}
+		else
+		{
+			fprintf(stderr, "ERROR: Failed to cook %s\n", item.Source.c_str());
+			++numFailed;
+		}
+	}
+
+	fs::create_directories(outputDir, error);
+	if (!manifest.Save(manifestPath.c_str()))
+	{
+		fprintf(stderr, "ERROR: Failed to write %s\n", manifestPath.c_str());
+		return 1;
+	}
+
+	printf("Cooked %u, skipped %u unchanged, failed %u in %.2f ms on %u threads\n",
+		(uint32_t)pending.size() - numFailed, (uint32_t)(items.size() - pending.size()), numFailed,
+		CookerNowMillis() - start, jobs.GetNumThreads() + 1);
+	return numFailed ? 1 : 0;
+}
@@ -2,76 +2,46 @@
 
 #include <d3d11.h>
 #include <wrl/client.h>
-#include <vector>
+#include <memory>
 
 #include "Math.h"
-#include "objloader.h"
 #include "LightHelper.h"
+#include "MeshRegistry.h"
+#include "TextureLoader.h"
 
 #define ACTOR_NUM_TEXTURES 4
 
-enum class TextureType
-{
-	Diffuse = 0,
-	Specular = 1,
-	Gloss = 2,
-	Normal = 3,
-};
-
-struct Vertex
-{
-	Vec3D Position;
-	Vec3D Normal;
-	Vec2D TexCoords;
-};
-
 class Actor
 {
 public:
 	Actor();
-	Actor(const Actor& actor);
-	Actor& operator=(const Actor& actor);
-	Actor(Actor&& actor) noexcept;
-	Actor& operator=(Actor&& actor) noexcept;
-	Actor(Mesh* mesh);
+	// Copies share the mesh and the textures
+	Actor(const Actor& actor) = default;
+	Actor& operator=(const Actor& actor) = default;
+	Actor(Actor&& actor) noexcept = default;
+	Actor& operator=(Actor&& actor) noexcept = default;
+	explicit Actor(std::shared_ptr<const MeshData> mesh);
 	~Actor();
 
-	void LoadModel(const char* filename);
+	void SetMesh(std::shared_ptr<const MeshData> mesh) { m_Mesh = std::move(mesh); }
+	const std::shared_ptr<const MeshData>& GetMesh() const { return m_Mesh; }
 
-	void CreateVertexBuffer(ID3D11Device* device);
-	void CreateIndexBuffer(ID3D11Device* device);
+	void SetTexture(TextureType type, ID3D11ShaderResourceView* srv);
 
-	void Translate(const Vec3D offset);
-	void Rotate(const float pitch, const float yaw, const float roll);
-	void Scale(const float s);
-
-	void LoadTexture(const char* filename,
-		enum TextureType type,
-		ID3D11Device* device,
-		ID3D11DeviceContext* context);
-
-	void SetMaterial(const Material* material);
-
-	Mat4X4 GetWorld() const { return m_World; }
-	Material GetMaterial() const { return m_Material; }
-	ID3D11Buffer* GetIndexBuffer() const { return m_IndexBuffer.Get(); }
-	ID3D11Buffer* GetVertexBuffer() const { return m_VertexBuffer.Get(); }
-	uint32_t GetNumIndices() const { return m_Indices.size(); }
-	ID3D11ShaderResourceView** GetShaderResources() const;
+	const AABB& GetLocalBounds() const { return m_Mesh->LocalBounds; }
+	ID3D11Buffer* GetIndexBuffer() const { return m_Mesh->Pool->GetIndexBuffer(m_Mesh->Geometry.Page); }
+	ID3D11Buffer* GetVertexBuffer() const { return m_Mesh->Pool->GetVertexBuffer(m_Mesh->Geometry.Page); }
+	const MeshAllocation& GetGeometry() const { return m_Mesh->Geometry; }
+	uint32_t GetNumIndices() const { return m_Mesh->Geometry.NumIndices; }
+	uint32_t GetStartIndex() const { return m_Mesh->Geometry.StartIndex; }
+	uint32_t GetBaseVertex() const { return m_Mesh->Geometry.BaseVertex; }
+	void GetShaderResources(ID3D11ShaderResourceView* shaderResources[ACTOR_NUM_TEXTURES]) const;
 
 
 private:
-	void Swap(Actor& actor);
-	void LoadMesh(Mesh* mesh);
-
-	Microsoft::WRL::ComPtr<ID3D11Buffer> m_IndexBuffer;
-	Microsoft::WRL::ComPtr<ID3D11Buffer> m_VertexBuffer;
-	std::vector<Vertex> m_Vertices;
-	std::vector<uint32_t> m_Indices;
-	Mat4X4 m_World;
+	std::shared_ptr<const MeshData> m_Mesh;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_DiffuseTexture;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_SpecularTexture;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_GlossTexture;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_NormalTexture;
-	Material m_Material;
 };
\ No newline at end of file
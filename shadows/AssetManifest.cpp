@@ -0,0 +1,234 @@
+#include "AssetManifest.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <vector>
+
+#define ASSET_HASH_PRIME 0x100000001b3ull
+
+uint64_t AssetHashBytes(const void* data, size_t size, uint64_t seed)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= ASSET_HASH_PRIME;
+	}
+	return hash;
+}
+
+bool AssetHashFile(const char* filename, uint64_t* hash, uint64_t seed)
+{
+	MappedFile file;
+	if (!file.Open(filename))
+	{
+		return false;
+	}
+	*hash = AssetHashBytes(file.GetData(), file.GetSize(), seed);
+	return true;
+}
+
+std::string AssetNormalizePath(const char* path)
+{
+	std::vector<std::string> segments;
+	std::string segment;
+	for (const char* c = path; ; ++c)
+	{
+		if (*c == '/' || *c == '\\' || *c == '\0')
+		{
+			if (segment == "..")
+			{
+				if (!segments.empty() && segments.back() != "..")
+					segments.pop_back();
+				else
+					segments.emplace_back(segment);
+			}
+			else if (!segment.empty() && segment != ".")
+			{
+				segments.emplace_back(segment);
+			}
+			segment.clear();
+			if (*c == '\0')
+				break;
+		}
+		else
+		{
+			segment += (char)tolower((unsigned char)*c);
+		}
+	}
+
+	std::string normalized;
+	for (const std::string& s : segments)
+	{
+		if (!normalized.empty())
+			normalized += '/';
+		normalized += s;
+	}
+	return normalized;
+}
+
+FILE* AssetOpenFile(const char* filename, const char* mode)
+{
+	FILE* f = nullptr;
+#ifdef _WIN32
+	fopen_s(&f, filename, mode);
+#else
+	f = fopen(filename, mode);
+#endif
+	return f;
+}
+
+AssetManifest::AssetManifest()
+{
+}
+
+AssetManifest::~AssetManifest()
+{
+}
+
+bool AssetManifest::Load(const char* filename)
+{
+	m_Entries.clear();
+
+	MappedFile file;
+	if (!file.Open(filename))
+	{
+		return false;
+	}
+
+	const char* text = (const char*)file.GetData();
+	const char* end = text + file.GetSize();
+	while (text < end)
+	{
+		const char* lineEnd = std::find(text, end, '\n');
+		std::string line(text, lineEnd);
+		text = lineEnd < end ? lineEnd + 1 : end;
+
+		if (!line.empty() && line.back() == '\r')
+		{
+			line.pop_back();
+		}
+		if (line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		const size_t first = line.find(' ');
+		const size_t second = first == std::string::npos ? std::string::npos : line.find(' ', first + 1);
+		if (second == std::string::npos)
+		{
+			m_Entries.clear();
+			return false;
+		}
+
+		AssetManifestEntry entry;
+		entry.Source = line.substr(0, first);
+		entry.Hash = strtoull(line.substr(first + 1, second - first - 1).c_str(), nullptr, 16);
+		entry.Cooked = line.substr(second + 1);
+		Set(entry);
+	}
+	return true;
+}
+
+bool AssetManifest::Save(const char* filename) const
+{
+	FILE* f = AssetOpenFile(filename, "w");
+	if (!f)
+	{
+		return false;
+	}
+
+	// sorted so that recooking produces the same file
+	std::vector<const AssetManifestEntry*> entries;
+	entries.reserve(m_Entries.size());
+	for (const auto& entry : m_Entries)
+	{
+		entries.emplace_back(&entry.second);
+	}
+	std::sort(entries.begin(), entries.end(),
+		[](const AssetManifestEntry* a, const AssetManifestEntry* b) { return a->Source < b->Source; });
+
+	fprintf(f, "# source hash cooked\n");
+	for (const AssetManifestEntry* entry : entries)
+	{
+		fprintf(f, "%s %016llx %s\n", entry->Source.c_str(), (unsigned long long)entry->Hash, entry->Cooked.c_str());
+	}
+	return fclose(f) == 0;
+}
+
+void AssetManifest::Set(const AssetManifestEntry& entry)
+{
+	AssetManifestEntry normalized = entry;
+	normalized.Source = AssetNormalizePath(entry.Source.c_str());
+	m_Entries[normalized.Source] = normalized;
+}
+
+const AssetManifestEntry* AssetManifest::Find(const char* source) const
+{
+	auto it = m_Entries.find(AssetNormalizePath(source));
+	return it == m_Entries.end() ? nullptr : &it->second;
+}
+
+const char* AssetManifest::Resolve(const char* source) const
+{
+	const AssetManifestEntry* entry = Find(source);
+	return entry ? entry->Cooked.c_str() : nullptr;
+}
+
+#ifdef ASSET_MANIFEST_TEST
+#include <string.h>
+
+void AssetManifestTest(void)
+{
+	assert(AssetNormalizePath("assets\\Meshes\\Cube.obj") == "assets/meshes/cube.obj");
+	assert(AssetNormalizePath("./assets//meshes/../meshes/cube.obj") == "assets/meshes/cube.obj");
+	assert(AssetNormalizePath("../cube.obj") == "../cube.obj");
+
+	// FNV-1a reference values, chaining equals hashing the concatenation
+	assert(AssetHashBytes("", 0) == ASSET_HASH_SEED);
+	assert(AssetHashBytes("a", 1) == 0xaf63dc4c8601ec8cull);
+	assert(AssetHashBytes("bar", 3, AssetHashBytes("foo", 3)) == AssetHashBytes("foobar", 6));
+
+	AssetManifest manifest;
+	AssetManifestEntry entry;
+	entry.Source = "assets/meshes/Cube.obj";
+	entry.Cooked = "cooked/assets/meshes/cube.mesh";
+	entry.Hash = 0x0123456789abcdefull;
+	manifest.Set(entry);
+	entry.Source = "assets/textures/chess.jpg";
+	entry.Cooked = "cooked/assets/textures/chess.dds";
+	entry.Hash = 0xfedcba9876543210ull;
+	manifest.Set(entry);
+
+	assert(manifest.GetNumEntries() == 2);
+	assert(strcmp(manifest.Resolve(".\\assets\\meshes\\cube.obj"), "cooked/assets/meshes/cube.mesh") == 0);
+	assert(manifest.Resolve("assets/meshes/sphere.obj") == nullptr);
+
+	const char* filename = "asset_manifest_test.txt";
+	assert(manifest.Save(filename));
+
+	AssetManifest loaded;
+	assert(loaded.Load(filename));
+	assert(loaded.GetNumEntries() == 2);
+	const AssetManifestEntry* found = loaded.Find("assets/textures/chess.jpg");
+	assert(found && found->Hash == 0xfedcba9876543210ull && found->Cooked == "cooked/assets/textures/chess.dds");
+	assert(loaded.Find("assets/meshes/cube.obj")->Hash == 0x0123456789abcdefull);
+
+	// same content hashes the same through the file path
+	uint64_t hash = 0;
+	assert(AssetHashFile(filename, &hash));
+	{
+		MappedFile file;
+		assert(file.Open(filename));
+		assert(hash == AssetHashBytes(file.GetData(), file.GetSize()));
+	}
+	remove(filename);
+
+	assert(!loaded.Load(filename) && loaded.GetNumEntries() == 0);
+	assert(!AssetHashFile(filename, &hash));
+}
+#endif
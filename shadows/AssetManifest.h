@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+
+// Written by the cooker next to the cooked files, lists for every source
+// asset the runtime ready file that replaces it
+#define ASSET_MANIFEST_FILENAME "manifest.txt"
+
+struct AssetManifestEntry
+{
+	AssetManifestEntry() : Hash{0} {}
+	// normalized path of the source asset, the lookup key
+	std::string Source;
+	std::string Cooked;
+	// hash of the source contents and cooker version the cooked file was made from
+	uint64_t Hash;
+};
+
+// Text file with one "source hash cooked" line per asset, paths must not contain spaces
+class AssetManifest
+{
+public:
+	AssetManifest();
+	~AssetManifest();
+
+	bool Load(const char* filename);
+	bool Save(const char* filename) const;
+
+	void Set(const AssetManifestEntry& entry);
+	const AssetManifestEntry* Find(const char* source) const;
+	// Cooked path of source or null if it was never cooked
+	const char* Resolve(const char* source) const;
+
+	uint32_t GetNumEntries() const { return (uint32_t)m_Entries.size(); }
+
+private:
+	std::unordered_map<std::string, AssetManifestEntry> m_Entries;
+};
+
+// FNV-1a, seed chains several buffers into one hash
+#define ASSET_HASH_SEED 0xcbf29ce484222325ull
+uint64_t AssetHashBytes(const void* data, size_t size, uint64_t seed = ASSET_HASH_SEED);
+bool AssetHashFile(const char* filename, uint64_t* hash, uint64_t seed = ASSET_HASH_SEED);
+
+// Lower case, forward slashes, "." and ".." segments resolved
+std::string AssetNormalizePath(const char* path);
+// fopen that keeps MSVC secure CRT checks quiet, returns null on failure
+FILE* AssetOpenFile(const char* filename, const char* mode);
+
+#ifdef ASSET_MANIFEST_TEST
+void AssetManifestTest(void);
+#endif
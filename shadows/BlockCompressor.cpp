@@ -0,0 +1,1043 @@
+#include "BlockCompressor.h"
+#include "JobSystem.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#define BC_POWER_ITERATIONS 8
+#define BC_REFINE_ITERATIONS 2
+#define BC_ROW_BATCH 4
+#define BC4_SEARCH_RADIUS 2
+
+static const uint32_t BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static int32_t BCRound(float v, int32_t minValue, int32_t maxValue)
+{
+	const int32_t r = (int32_t)floorf(v + 0.5f);
+	return r < minValue ? minValue : (r > maxValue ? maxValue : r);
+}
+
+// Mean and dominant direction of count points with dims channels
+static void BCPrincipalAxis(const float points[][4], uint32_t count, uint32_t dims, float mean[4], float axis[4])
+{
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		mean[c] = 0.0f;
+		axis[c] = 0.0f;
+	}
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		for (uint32_t c = 0; c < dims; ++c)
+			mean[c] += points[i][c];
+	}
+	for (uint32_t c = 0; c < dims; ++c)
+	{
+		mean[c] /= (float)count;
+	}
+
+	float cov[4][4] = {};
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		for (uint32_t r = 0; r < dims; ++r)
+		{
+			for (uint32_t c = 0; c < dims; ++c)
+				cov[r][c] += (points[i][r] - mean[r]) * (points[i][c] - mean[c]);
+		}
+	}
+
+	// power iteration, starting from the channel with the largest variance
+	uint32_t largest = 0;
+	for (uint32_t c = 1; c < dims; ++c)
+	{
+		if (cov[c][c] > cov[largest][largest])
+			largest = c;
+	}
+	if (cov[largest][largest] <= 0.0f)
+	{
+		return;
+	}
+
+	float v[4] = {};
+	for (uint32_t c = 0; c < dims; ++c)
+	{
+		v[c] = cov[largest][c];
+	}
+	for (uint32_t it = 0; it < BC_POWER_ITERATIONS; ++it)
+	{
+		float next[4] = {};
+		float maxAbs = 0.0f;
+		for (uint32_t r = 0; r < dims; ++r)
+		{
+			for (uint32_t c = 0; c < dims; ++c)
+				next[r] += cov[r][c] * v[c];
+			maxAbs = fmaxf(maxAbs, fabsf(next[r]));
+		}
+		if (maxAbs == 0.0f)
+			break;
+		for (uint32_t c = 0; c < dims; ++c)
+			v[c] = next[c] / maxAbs;
+	}
+
+	float length = 0.0f;
+	for (uint32_t c = 0; c < dims; ++c)
+	{
+		length += v[c] * v[c];
+	}
+	length = sqrtf(length);
+	for (uint32_t c = 0; c < dims && length > 0.0f; ++c)
+	{
+		axis[c] = v[c] / length;
+	}
+}
+
+// Endpoints along the principal axis, or the bounding box corners when fast
+static void BCFindEndpoints(const float points[][4], uint32_t count, uint32_t dims, BCQuality quality, float e0[4], float e1[4])
+{
+	if (quality == BCQuality::Fast)
+	{
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			e0[c] = 255.0f;
+			e1[c] = 0.0f;
+		}
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			for (uint32_t c = 0; c < dims; ++c)
+			{
+				e0[c] = fminf(e0[c], points[i][c]);
+				e1[c] = fmaxf(e1[c], points[i][c]);
+			}
+		}
+		// inset by half an interpolation step, the extremes are rarely hit exactly
+		for (uint32_t c = 0; c < dims; ++c)
+		{
+			const float inset = (e1[c] - e0[c]) / 16.0f;
+			e0[c] += inset;
+			e1[c] -= inset;
+		}
+		return;
+	}
+
+	float mean[4];
+	float axis[4];
+	BCPrincipalAxis(points, count, dims, mean, axis);
+
+	float minT = 0.0f;
+	float maxT = 0.0f;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		float t = 0.0f;
+		for (uint32_t c = 0; c < dims; ++c)
+			t += (points[i][c] - mean[c]) * axis[c];
+		minT = fminf(minT, t);
+		maxT = fmaxf(maxT, t);
+	}
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		e0[c] = fminf(fmaxf(mean[c] + axis[c] * minT, 0.0f), 255.0f);
+		e1[c] = fminf(fmaxf(mean[c] + axis[c] * maxT, 0.0f), 255.0f);
+	}
+}
+
+// Least squares endpoints for fixed interpolation weights, weights[i] is the share of e1
+static bool BCSolveEndpoints(const float points[][4], const float* weights, uint32_t count, uint32_t dims, float e0[4], float e1[4])
+{
+	float aa = 0.0f;
+	float ab = 0.0f;
+	float bb = 0.0f;
+	float ax[4] = {};
+	float bx[4] = {};
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const float b = weights[i];
+		const float a = 1.0f - b;
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (uint32_t c = 0; c < dims; ++c)
+		{
+			ax[c] += a * points[i][c];
+			bx[c] += b * points[i][c];
+		}
+	}
+
+	const float det = aa * bb - ab * ab;
+	if (fabsf(det) < 1e-6f)
+	{
+		return false;
+	}
+	for (uint32_t c = 0; c < dims; ++c)
+	{
+		e0[c] = fminf(fmaxf((ax[c] * bb - bx[c] * ab) / det, 0.0f), 255.0f);
+		e1[c] = fminf(fmaxf((bx[c] * aa - ax[c] * ab) / det, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+// ---- BC1 color block
+
+static uint16_t BCPack565(const float color[4])
+{
+	return (uint16_t)((BCRound(color[0] * 31.0f / 255.0f, 0, 31) << 11) |
+		(BCRound(color[1] * 63.0f / 255.0f, 0, 63) << 5) |
+		BCRound(color[2] * 31.0f / 255.0f, 0, 31));
+}
+
+static void BCUnpack565(uint16_t packed, int32_t color[3])
+{
+	const int32_t r = (packed >> 11) & 31;
+	const int32_t g = (packed >> 5) & 63;
+	const int32_t b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+static void BCColorPalette(uint16_t c0, uint16_t c1, bool fourColors, int32_t palette[4][3])
+{
+	BCUnpack565(c0, palette[0]);
+	BCUnpack565(c1, palette[1]);
+	for (uint32_t c = 0; c < 3; ++c)
+	{
+		if (fourColors)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+static uint32_t BCColorIndices(const float points[][4], uint16_t c0, uint16_t c1, uint8_t indices[BC_BLOCK_TEXELS])
+{
+	int32_t palette[4][3];
+	BCColorPalette(c0, c1, true, palette);
+
+	uint32_t totalError = 0;
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+	{
+		uint32_t bestError = UINT32_MAX;
+		for (uint8_t p = 0; p < 4; ++p)
+		{
+			uint32_t error = 0;
+			for (uint32_t c = 0; c < 3; ++c)
+			{
+				const int32_t d = (int32_t)points[i][c] - palette[p][c];
+				error += (uint32_t)(d * d);
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				indices[i] = p;
+			}
+		}
+		totalError += bestError;
+	}
+	return totalError;
+}
+
+static void BCCompressColorBlock(const uint8_t texels[BC_BLOCK_TEXELS * 4], BCQuality quality, uint8_t* block)
+{
+	float points[BC_BLOCK_TEXELS][4];
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+	{
+		for (uint32_t c = 0; c < 4; ++c)
+			points[i][c] = (float)texels[i * 4 + c];
+	}
+
+	float e0[4];
+	float e1[4];
+	BCFindEndpoints(points, BC_BLOCK_TEXELS, 3, quality, e0, e1);
+
+	uint16_t c0 = BCPack565(e1);
+	uint16_t c1 = BCPack565(e0);
+	uint8_t indices[BC_BLOCK_TEXELS];
+	uint32_t error = BCColorIndices(points, c0, c1, indices);
+
+	if (quality == BCQuality::High)
+	{
+		static const float paletteWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+		for (uint32_t it = 0; it < BC_REFINE_ITERATIONS; ++it)
+		{
+			float weights[BC_BLOCK_TEXELS];
+			for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+				weights[i] = paletteWeights[indices[i]];
+			if (!BCSolveEndpoints(points, weights, BC_BLOCK_TEXELS, 3, e0, e1))
+				break;
+
+			const uint16_t r0 = BCPack565(e0);
+			const uint16_t r1 = BCPack565(e1);
+			uint8_t refined[BC_BLOCK_TEXELS];
+			const uint32_t refinedError = BCColorIndices(points, r0, r1, refined);
+			if (refinedError >= error)
+				break;
+			c0 = r0;
+			c1 = r1;
+			error = refinedError;
+			memcpy(indices, refined, sizeof(indices));
+		}
+	}
+
+	// four color mode needs c0 > c1, swapping the endpoints mirrors the indices
+	static const uint8_t swapped[4] = { 1, 0, 3, 2 };
+	if (c0 < c1)
+	{
+		const uint16_t tmp = c0;
+		c0 = c1;
+		c1 = tmp;
+		for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+			indices[i] = swapped[indices[i]];
+	}
+	else if (c0 == c1)
+	{
+		memset(indices, 0, sizeof(indices));
+	}
+
+	uint32_t bits = 0;
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+	{
+		bits |= (uint32_t)indices[i] << (2 * i);
+	}
+	block[0] = (uint8_t)(c0 & 0xff);
+	block[1] = (uint8_t)(c0 >> 8);
+	block[2] = (uint8_t)(c1 & 0xff);
+	block[3] = (uint8_t)(c1 >> 8);
+	memcpy(block + 4, &bits, sizeof(bits));
+}
+
+static void BCDecompressColorBlock(const uint8_t* block, bool forceFourColors, uint8_t texels[BC_BLOCK_TEXELS * 4])
+{
+	const uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+	const uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+	const bool fourColors = forceFourColors || c0 > c1;
+	int32_t palette[4][3];
+	BCColorPalette(c0, c1, fourColors, palette);
+
+	uint32_t bits = 0;
+	memcpy(&bits, block + 4, sizeof(bits));
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+	{
+		const uint32_t index = (bits >> (2 * i)) & 3;
+		texels[i * 4 + 0] = (uint8_t)palette[index][0];
+		texels[i * 4 + 1] = (uint8_t)palette[index][1];
+		texels[i * 4 + 2] = (uint8_t)palette[index][2];
+		texels[i * 4 + 3] = (!fourColors && index == 3) ? 0 : 255;
+	}
+}
+
+// ---- BC4 single channel block
+
+static void BCAlphaPalette(uint8_t r0, uint8_t r1, int32_t palette[8])
+{
+	palette[0] = r0;
+	palette[1] = r1;
+	if (r0 > r1)
+	{
+		for (int32_t i = 2; i < 8; ++i)
+			palette[i] = ((8 - i) * r0 + (i - 1) * r1 + 3) / 7;
+	}
+	else
+	{
+		for (int32_t i = 2; i < 6; ++i)
+			palette[i] = ((6 - i) * r0 + (i - 1) * r1 + 2) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static uint32_t BCAlphaIndices(const uint8_t values[BC_BLOCK_TEXELS], uint8_t r0, uint8_t r1, uint8_t indices[BC_BLOCK_TEXELS])
+{
+	int32_t palette[8];
+	BCAlphaPalette(r0, r1, palette);
+
+	uint32_t totalError = 0;
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+	{
+		uint32_t bestError = UINT32_MAX;
+		for (uint8_t p = 0; p < 8; ++p)
+		{
+			const int32_t d = (int32_t)values[i] - palette[p];
+			if ((uint32_t)(d * d) < bestError)
+			{
+				bestError = (uint32_t)(d * d);
+				indices[i] = p;
+			}
+		}
+		totalError += bestError;
+	}
+	return totalError;
+}
+
+static void BCCompressAlphaBlock(const uint8_t texels[BC_BLOCK_TEXELS * 4], uint32_t channel, BCQuality quality, uint8_t* block)
+{
+	uint8_t values[BC_BLOCK_TEXELS];
+	uint8_t minValue = 255;
+	uint8_t maxValue = 0;
+	// range without the 0 and 255 that the six value mode has for free
+	uint8_t minInner = 255;
+	uint8_t maxInner = 0;
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+	{
+		values[i] = texels[i * 4 + channel];
+		minValue = values[i] < minValue ? values[i] : minValue;
+		maxValue = values[i] > maxValue ? values[i] : maxValue;
+		if (values[i] != 0 && values[i] != 255)
+		{
+			minInner = values[i] < minInner ? values[i] : minInner;
+			maxInner = values[i] > maxInner ? values[i] : maxInner;
+		}
+	}
+
+	uint8_t r0 = maxValue;
+	uint8_t r1 = minValue;
+	uint8_t indices[BC_BLOCK_TEXELS];
+	uint32_t error = BCAlphaIndices(values, r0, r1, indices);
+
+	if (quality != BCQuality::Fast && minInner <= maxInner)
+	{
+		uint8_t sixIndices[BC_BLOCK_TEXELS];
+		const uint32_t sixError = BCAlphaIndices(values, minInner, maxInner, sixIndices);
+		if (sixError < error)
+		{
+			r0 = minInner;
+			r1 = maxInner;
+			error = sixError;
+			memcpy(indices, sixIndices, sizeof(indices));
+		}
+	}
+
+	// small search around the eight value endpoints
+	if (quality == BCQuality::High && maxValue > minValue && error > 0)
+	{
+		for (int32_t d0 = -BC4_SEARCH_RADIUS; d0 <= BC4_SEARCH_RADIUS; ++d0)
+		{
+			for (int32_t d1 = -BC4_SEARCH_RADIUS; d1 <= BC4_SEARCH_RADIUS; ++d1)
+			{
+				const int32_t s0 = (int32_t)maxValue + d0;
+				const int32_t s1 = (int32_t)minValue + d1;
+				if (s0 > 255 || s1 < 0 || s0 <= s1)
+					continue;
+				uint8_t candidate[BC_BLOCK_TEXELS];
+				const uint32_t candidateError = BCAlphaIndices(values, (uint8_t)s0, (uint8_t)s1, candidate);
+				if (candidateError < error)
+				{
+					r0 = (uint8_t)s0;
+					r1 = (uint8_t)s1;
+					error = candidateError;
+					memcpy(indices, candidate, sizeof(indices));
+				}
+			}
+		}
+	}
+
+	uint64_t bits = 0;
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+	{
+		bits |= (uint64_t)indices[i] << (3 * i);
+	}
+	block[0] = r0;
+	block[1] = r1;
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		block[2 + i] = (uint8_t)(bits >> (8 * i));
+	}
+}
+
+static void BCDecompressAlphaBlock(const uint8_t* block, uint32_t channel, uint8_t texels[BC_BLOCK_TEXELS * 4])
+{
+	int32_t palette[8];
+	BCAlphaPalette(block[0], block[1], palette);
+
+	uint64_t bits = 0;
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		bits |= (uint64_t)block[2 + i] << (8 * i);
+	}
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+	{
+		texels[i * 4 + channel] = (uint8_t)palette[(bits >> (3 * i)) & 7];
+	}
+}
+
+// ---- BC7 mode 6: one subset, RGBA 7.7.7.7 endpoints with a p-bit each, 4 bit indices
+
+struct BCBitStream
+{
+	uint8_t* Data;
+	uint32_t Pos;
+
+	void Write(uint32_t value, uint32_t numBits)
+	{
+		for (uint32_t i = 0; i < numBits; ++i, ++Pos)
+		{
+			if ((value >> i) & 1)
+				Data[Pos >> 3] |= (uint8_t)(1 << (Pos & 7));
+		}
+	}
+
+	uint32_t Read(uint32_t numBits)
+	{
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < numBits; ++i, ++Pos)
+		{
+			value |= (uint32_t)((Data[Pos >> 3] >> (Pos & 7)) & 1) << i;
+		}
+		return value;
+	}
+};
+
+static void BC7Quantize(const float endpoint[4], uint32_t pbit, int32_t quantized[4])
+{
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		quantized[c] = BCRound((endpoint[c] - (float)pbit) / 2.0f, 0, 127);
+	}
+}
+
+static uint32_t BC7Indices(const float points[][4],
+	const int32_t q0[4], uint32_t p0,
+	const int32_t q1[4], uint32_t p1,
+	uint8_t indices[BC_BLOCK_TEXELS])
+{
+	int32_t palette[16][4];
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		const int32_t a = (q0[c] << 1) | (int32_t)p0;
+		const int32_t b = (q1[c] << 1) | (int32_t)p1;
+		for (uint32_t i = 0; i < 16; ++i)
+			palette[i][c] = ((64 - (int32_t)BC7_WEIGHTS4[i]) * a + (int32_t)BC7_WEIGHTS4[i] * b + 32) >> 6;
+	}
+
+	uint32_t totalError = 0;
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+	{
+		uint32_t bestError = UINT32_MAX;
+		for (uint8_t p = 0; p < 16; ++p)
+		{
+			uint32_t error = 0;
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				const int32_t d = (int32_t)points[i][c] - palette[p][c];
+				error += (uint32_t)(d * d);
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				indices[i] = p;
+			}
+		}
+		totalError += bestError;
+	}
+	return totalError;
+}
+
+struct BC7Candidate
+{
+	int32_t Q0[4];
+	int32_t Q1[4];
+	uint32_t P0;
+	uint32_t P1;
+	uint8_t Indices[BC_BLOCK_TEXELS];
+	uint32_t Error;
+};
+
+static void BC7Evaluate(const float points[][4], const float e0[4], const float e1[4], BCQuality quality, BC7Candidate* best)
+{
+	for (uint32_t p0 = 0; p0 < 2; ++p0)
+	{
+		for (uint32_t p1 = 0; p1 < 2; ++p1)
+		{
+			BC7Candidate candidate = {};
+			candidate.P0 = p0;
+			candidate.P1 = p1;
+			BC7Quantize(e0, p0, candidate.Q0);
+			BC7Quantize(e1, p1, candidate.Q1);
+
+			// below High only the p-bits matching the endpoint parity best are tried
+			if (quality != BCQuality::High)
+			{
+				float error0[2] = {};
+				float error1[2] = {};
+				for (uint32_t p = 0; p < 2; ++p)
+				{
+					int32_t q[4];
+					BC7Quantize(e0, p, q);
+					for (uint32_t c = 0; c < 4; ++c)
+						error0[p] += fabsf((float)((q[c] << 1) | (int32_t)p) - e0[c]);
+					BC7Quantize(e1, p, q);
+					for (uint32_t c = 0; c < 4; ++c)
+						error1[p] += fabsf((float)((q[c] << 1) | (int32_t)p) - e1[c]);
+				}
+				if (p0 != (error0[1] < error0[0] ? 1u : 0u) || p1 != (error1[1] < error1[0] ? 1u : 0u))
+					continue;
+			}
+
+			candidate.Error = BC7Indices(points, candidate.Q0, p0, candidate.Q1, p1, candidate.Indices);
+			if (candidate.Error < best->Error)
+			{
+				*best = candidate;
+			}
+		}
+	}
+}
+
+static void BCCompressBC7Block(const uint8_t texels[BC_BLOCK_TEXELS * 4], BCQuality quality, uint8_t* block)
+{
+	float points[BC_BLOCK_TEXELS][4];
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+	{
+		for (uint32_t c = 0; c < 4; ++c)
+			points[i][c] = (float)texels[i * 4 + c];
+	}
+
+	float e0[4];
+	float e1[4];
+	BCFindEndpoints(points, BC_BLOCK_TEXELS, 4, quality, e0, e1);
+
+	BC7Candidate best = {};
+	best.Error = UINT32_MAX;
+	BC7Evaluate(points, e0, e1, quality, &best);
+
+	if (quality == BCQuality::High)
+	{
+		for (uint32_t it = 0; it < BC_REFINE_ITERATIONS && best.Error > 0; ++it)
+		{
+			float weights[BC_BLOCK_TEXELS];
+			for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+				weights[i] = (float)BC7_WEIGHTS4[best.Indices[i]] / 64.0f;
+			if (!BCSolveEndpoints(points, weights, BC_BLOCK_TEXELS, 4, e0, e1))
+				break;
+			const uint32_t previous = best.Error;
+			BC7Evaluate(points, e0, e1, quality, &best);
+			if (best.Error >= previous)
+				break;
+		}
+	}
+
+	// the anchor texel stores only 3 index bits, its MSB must be 0
+	if (best.Indices[0] & 8)
+	{
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			const int32_t tmp = best.Q0[c];
+			best.Q0[c] = best.Q1[c];
+			best.Q1[c] = tmp;
+		}
+		const uint32_t tmp = best.P0;
+		best.P0 = best.P1;
+		best.P1 = tmp;
+		for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+			best.Indices[i] = (uint8_t)(15 - best.Indices[i]);
+	}
+
+	memset(block, 0, 16);
+	BCBitStream stream = { block, 0 };
+	stream.Write(1 << 6, 7);
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		stream.Write((uint32_t)best.Q0[c], 7);
+		stream.Write((uint32_t)best.Q1[c], 7);
+	}
+	stream.Write(best.P0, 1);
+	stream.Write(best.P1, 1);
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+	{
+		stream.Write(best.Indices[i], i == 0 ? 3 : 4);
+	}
+	assert(stream.Pos == 128);
+}
+
+static void BCDecompressBC7Block(const uint8_t* block, uint8_t texels[BC_BLOCK_TEXELS * 4])
+{
+	BCBitStream stream = { (uint8_t*)block, 0 };
+	if (stream.Read(7) != (1 << 6))
+	{
+		// other modes are never written by the encoder, decode them as magenta
+		for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+		{
+			texels[i * 4 + 0] = 255;
+			texels[i * 4 + 1] = 0;
+			texels[i * 4 + 2] = 255;
+			texels[i * 4 + 3] = 255;
+		}
+		return;
+	}
+
+	int32_t q0[4];
+	int32_t q1[4];
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		q0[c] = (int32_t)stream.Read(7);
+		q1[c] = (int32_t)stream.Read(7);
+	}
+	const int32_t p0 = (int32_t)stream.Read(1);
+	const int32_t p1 = (int32_t)stream.Read(1);
+
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+	{
+		const int32_t w = (int32_t)BC7_WEIGHTS4[stream.Read(i == 0 ? 3 : 4)];
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			const int32_t a = (q0[c] << 1) | p0;
+			const int32_t b = (q1[c] << 1) | p1;
+			texels[i * 4 + c] = (uint8_t)(((64 - w) * a + w * b + 32) >> 6);
+		}
+	}
+}
+
+// ---- public interface
+
+uint32_t BCBlockBytes(BCFormat format)
+{
+	return (format == BCFormat::BC1 || format == BCFormat::BC4) ? 8 : 16;
+}
+
+uint32_t BCRowPitch(BCFormat format, uint32_t width)
+{
+	return (width + BC_BLOCK_SIZE - 1) / BC_BLOCK_SIZE * BCBlockBytes(format);
+}
+
+size_t BCSurfaceSize(BCFormat format, uint32_t width, uint32_t height)
+{
+	return (size_t)BCRowPitch(format, width) * ((height + BC_BLOCK_SIZE - 1) / BC_BLOCK_SIZE);
+}
+
+void BCCompressBlock(BCFormat format, BCQuality quality, const uint8_t texels[BC_BLOCK_TEXELS * 4], uint8_t* block)
+{
+	switch (format)
+	{
+	case BCFormat::BC1:
+		BCCompressColorBlock(texels, quality, block);
+		break;
+	case BCFormat::BC3:
+		BCCompressAlphaBlock(texels, 3, quality, block);
+		BCCompressColorBlock(texels, quality, block + 8);
+		break;
+	case BCFormat::BC4:
+		BCCompressAlphaBlock(texels, 0, quality, block);
+		break;
+	case BCFormat::BC5:
+		BCCompressAlphaBlock(texels, 0, quality, block);
+		BCCompressAlphaBlock(texels, 1, quality, block + 8);
+		break;
+	case BCFormat::BC7:
+		BCCompressBC7Block(texels, quality, block);
+		break;
+	default:
+		assert(false && "Unknown block format");
+		break;
+	}
+}
+
+void BCDecompressBlock(BCFormat format, const uint8_t* block, uint8_t texels[BC_BLOCK_TEXELS * 4])
+{
+	switch (format)
+	{
+	case BCFormat::BC1:
+		BCDecompressColorBlock(block, false, texels);
+		break;
+	case BCFormat::BC3:
+		BCDecompressColorBlock(block + 8, true, texels);
+		BCDecompressAlphaBlock(block, 3, texels);
+		break;
+	case BCFormat::BC4:
+		for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+		{
+			texels[i * 4 + 1] = 0;
+			texels[i * 4 + 2] = 0;
+			texels[i * 4 + 3] = 255;
+		}
+		BCDecompressAlphaBlock(block, 0, texels);
+		break;
+	case BCFormat::BC5:
+		for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+		{
+			texels[i * 4 + 2] = 0;
+			texels[i * 4 + 3] = 255;
+		}
+		BCDecompressAlphaBlock(block, 0, texels);
+		BCDecompressAlphaBlock(block + 8, 1, texels);
+		break;
+	case BCFormat::BC7:
+		BCDecompressBC7Block(block, texels);
+		break;
+	default:
+		assert(false && "Unknown block format");
+		break;
+	}
+}
+
+void BCCompressImage(const uint8_t* rgba,
+	uint32_t width,
+	uint32_t height,
+	BCFormat format,
+	BCQuality quality,
+	JobSystem* jobs,
+	uint8_t* blocks)
+{
+	const uint32_t blocksWide = (width + BC_BLOCK_SIZE - 1) / BC_BLOCK_SIZE;
+	const uint32_t blocksHigh = (height + BC_BLOCK_SIZE - 1) / BC_BLOCK_SIZE;
+	const uint32_t blockBytes = BCBlockBytes(format);
+
+	auto compressRows = [=](uint32_t begin, uint32_t end)
+		{
+			uint8_t texels[BC_BLOCK_TEXELS * 4];
+			for (uint32_t by = begin; by < end; ++by)
+			{
+				for (uint32_t bx = 0; bx < blocksWide; ++bx)
+				{
+					for (uint32_t y = 0; y < BC_BLOCK_SIZE; ++y)
+					{
+						const uint32_t sy = by * BC_BLOCK_SIZE + y < height ? by * BC_BLOCK_SIZE + y : height - 1;
+						for (uint32_t x = 0; x < BC_BLOCK_SIZE; ++x)
+						{
+							const uint32_t sx = bx * BC_BLOCK_SIZE + x < width ? bx * BC_BLOCK_SIZE + x : width - 1;
+							memcpy(&texels[(y * BC_BLOCK_SIZE + x) * 4], &rgba[((size_t)sy * width + sx) * 4], 4);
+						}
+					}
+					BCCompressBlock(format, quality, texels, &blocks[((size_t)by * blocksWide + bx) * blockBytes]);
+				}
+			}
+		};
+
+	if (jobs)
+	{
+		jobs->ParallelFor(blocksHigh, BC_ROW_BATCH, compressRows);
+	}
+	else
+	{
+		compressRows(0, blocksHigh);
+	}
+}
+
+void BCDecompressImage(const uint8_t* blocks, uint32_t width, uint32_t height, BCFormat format, uint8_t* rgba)
+{
+	const uint32_t blocksWide = (width + BC_BLOCK_SIZE - 1) / BC_BLOCK_SIZE;
+	const uint32_t blocksHigh = (height + BC_BLOCK_SIZE - 1) / BC_BLOCK_SIZE;
+	const uint32_t blockBytes = BCBlockBytes(format);
+	uint8_t texels[BC_BLOCK_TEXELS * 4];
+
+	for (uint32_t by = 0; by < blocksHigh; ++by)
+	{
+		for (uint32_t bx = 0; bx < blocksWide; ++bx)
+		{
+			BCDecompressBlock(format, &blocks[((size_t)by * blocksWide + bx) * blockBytes], texels);
+			for (uint32_t y = 0; y < BC_BLOCK_SIZE && by * BC_BLOCK_SIZE + y < height; ++y)
+			{
+				for (uint32_t x = 0; x < BC_BLOCK_SIZE && bx * BC_BLOCK_SIZE + x < width; ++x)
+				{
+					const size_t dst = ((size_t)(by * BC_BLOCK_SIZE + y) * width + bx * BC_BLOCK_SIZE + x) * 4;
+					memcpy(&rgba[dst], &texels[(y * BC_BLOCK_SIZE + x) * 4], 4);
+				}
+			}
+		}
+	}
+}
+
+float BCComputePSNR(const uint8_t* lhs, const uint8_t* rhs, uint32_t numPixels, uint32_t channelMask)
+{
+	double sum = 0.0;
+	uint32_t numValues = 0;
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		if (!(channelMask & (1u << c)))
+			continue;
+		for (uint32_t i = 0; i < numPixels; ++i)
+		{
+			const double d = (double)lhs[i * 4 + c] - (double)rhs[i * 4 + c];
+			sum += d * d;
+		}
+		numValues += numPixels;
+	}
+
+	if (numValues == 0 || sum == 0.0)
+	{
+		return BC_PSNR_LOSSLESS;
+	}
+	const double mse = sum / (double)numValues;
+	return (float)(10.0 * log10(255.0 * 255.0 / mse));
+}
+
+#ifdef BLOCK_COMPRESSOR_TEST
+#include <vector>
+
+static void TestBlockCompressorSizes(void)
+{
+	assert(BCBlockBytes(BCFormat::BC1) == 8 && BCBlockBytes(BCFormat::BC4) == 8);
+	assert(BCBlockBytes(BCFormat::BC3) == 16 && BCBlockBytes(BCFormat::BC5) == 16 && BCBlockBytes(BCFormat::BC7) == 16);
+	assert(BCRowPitch(BCFormat::BC1, 5) == 16);
+	assert(BCSurfaceSize(BCFormat::BC7, 1024, 449) == 256 * 113 * 16);
+	assert(BCSurfaceSize(BCFormat::BC4, 1, 1) == 8);
+}
+
+static void TestBlockCompressorExact(void)
+{
+	// colors every format can represent exactly
+	uint8_t texels[BC_BLOCK_TEXELS * 4];
+	uint8_t decoded[BC_BLOCK_TEXELS * 4];
+	uint8_t block[16];
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS; ++i)
+	{
+		const bool dark = (i & 1) != 0;
+		texels[i * 4 + 0] = dark ? 0 : 255;
+		texels[i * 4 + 1] = dark ? 0 : 255;
+		texels[i * 4 + 2] = dark ? 0 : 255;
+		texels[i * 4 + 3] = dark ? 17 : 230;
+	}
+
+	const BCFormat formats[] = { BCFormat::BC1, BCFormat::BC3, BCFormat::BC4, BCFormat::BC5, BCFormat::BC7 };
+	const uint32_t masks[] = { BC_CHANNEL_RGB, BC_CHANNEL_RGBA, BC_CHANNEL_R, BC_CHANNEL_R | BC_CHANNEL_G, BC_CHANNEL_RGB };
+	for (uint32_t f = 0; f < _countof(formats); ++f)
+	{
+		BCCompressBlock(formats[f], BCQuality::Normal, texels, block);
+		BCDecompressBlock(formats[f], block, decoded);
+		assert(BCComputePSNR(texels, decoded, BC_BLOCK_TEXELS, masks[f]) == BC_PSNR_LOSSLESS);
+	}
+
+	// a flat odd valued color survives the BC7 p-bits
+	for (uint32_t i = 0; i < BC_BLOCK_TEXELS * 4; ++i)
+	{
+		texels[i] = (uint8_t)(101 + (i & 3) * 2);
+	}
+	BCCompressBlock(BCFormat::BC7, BCQuality::Normal, texels, block);
+	BCDecompressBlock(BCFormat::BC7, block, decoded);
+	assert(memcmp(texels, decoded, sizeof(texels)) == 0);
+}
+
+static void TestBlockCompressorImage(void)
+{
+	// smooth gradients with mild noise and a partial block column and row
+	const uint32_t width = 67;
+	const uint32_t height = 45;
+	std::vector<uint8_t> image(width * height * 4);
+	uint32_t seed = 3;
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			const int32_t noise = (int32_t)(seed >> 29) - 4;
+			uint8_t* pixel = &image[(y * width + x) * 4];
+			pixel[0] = (uint8_t)BCRound((float)(x * 255 / width + noise), 0, 255);
+			pixel[1] = (uint8_t)BCRound((float)(y * 255 / height + noise), 0, 255);
+			pixel[2] = (uint8_t)BCRound((float)((x + y) * 255 / (width + height)), 0, 255);
+			pixel[3] = 255;
+		}
+	}
+
+	JobSystem jobs;
+	jobs.Init(4);
+
+	const BCFormat formats[] = { BCFormat::BC1, BCFormat::BC3, BCFormat::BC4, BCFormat::BC5, BCFormat::BC7 };
+	const uint32_t masks[] = { BC_CHANNEL_RGB, BC_CHANNEL_RGBA, BC_CHANNEL_R, BC_CHANNEL_R | BC_CHANNEL_G, BC_CHANNEL_RGBA };
+	const float minPSNR[] = { 34.0f, 34.0f, 45.0f, 45.0f, 38.0f };
+	std::vector<uint8_t> decoded(image.size());
+	for (uint32_t f = 0; f < _countof(formats); ++f)
+	{
+		const size_t size = BCSurfaceSize(formats[f], width, height);
+		std::vector<uint8_t> serial(size);
+		std::vector<uint8_t> parallel(size);
+
+		float previousPSNR = 0.0f;
+		const BCQuality qualities[] = { BCQuality::Fast, BCQuality::Normal, BCQuality::High };
+		for (BCQuality quality : qualities)
+		{
+			BCCompressImage(&image[0], width, height, formats[f], quality, nullptr, &serial[0]);
+			BCCompressImage(&image[0], width, height, formats[f], quality, &jobs, &parallel[0]);
+			assert(serial == parallel);
+
+			BCDecompressImage(&serial[0], width, height, formats[f], &decoded[0]);
+			const float psnr = BCComputePSNR(&image[0], &decoded[0], width * height, masks[f]);
+			assert(psnr >= minPSNR[f]);
+			// better presets may only lose a little to rounding
+			assert(psnr >= previousPSNR - 0.1f);
+			previousPSNR = psnr;
+		}
+	}
+}
+
+void BlockCompressorTest(void)
+{
+	TestBlockCompressorSizes();
+	TestBlockCompressorExact();
+	TestBlockCompressorImage();
+}
+#endif
+
+#ifdef BLOCK_COMPRESSOR_BENCHMARK
+#include "Utils.h"
+#include "stb_image.h"
+
+#include <chrono>
+#include <vector>
+
+void BlockCompressorBenchmark(const char* const* filenames, uint32_t numFiles, JobSystem* jobs)
+{
+	size_t totalRaw = 0;
+	size_t totalCompressed = 0;
+	double totalMegapixels = 0.0;
+	double totalSeconds = 0.0;
+
+	for (uint32_t i = 0; i < numFiles; ++i)
+	{
+		int width = 0;
+		int height = 0;
+		int channelsInFile = 0;
+		unsigned char* pixels = stbi_load(filenames[i], &width, &height, &channelsInFile, 4);
+		if (!pixels)
+		{
+			UtilsDebugPrint("ERROR: Failed to load texture from %s\n", filenames[i]);
+			continue;
+		}
+
+		// same choice as the texture loader makes from the texture type
+		BCFormat format = BCFormat::BC7;
+		uint32_t mask = BC_CHANNEL_RGB;
+		const char* name = "BC7";
+		if (strstr(filenames[i], "normal"))
+		{
+			format = BCFormat::BC5;
+			mask = BC_CHANNEL_R | BC_CHANNEL_G;
+			name = "BC5";
+		}
+		else if (strstr(filenames[i], "gloss") || strstr(filenames[i], "reflection"))
+		{
+			format = BCFormat::BC4;
+			mask = BC_CHANNEL_R;
+			name = "BC4";
+		}
+
+		const size_t size = BCSurfaceSize(format, width, height);
+		std::vector<uint8_t> blocks(size);
+		std::vector<uint8_t> decoded((size_t)width * height * 4);
+
+		const auto start = std::chrono::steady_clock::now();
+		BCCompressImage(pixels, width, height, format, BCQuality::Normal, jobs, &blocks[0]);
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		BCDecompressImage(&blocks[0], width, height, format, &decoded[0]);
+		const float psnr = BCComputePSNR(pixels, &decoded[0], width * height, mask);
+		const double megapixels = (double)width * height / 1000000.0;
+
+		UtilsDebugPrint("%s: %dx%d %s %.1f MP/s, PSNR %.2f dB, %u KB -> %u KB\n",
+			filenames[i], width, height, name, megapixels / seconds, psnr,
+			(uint32_t)((size_t)width * height * 4 / 1024), (uint32_t)(size / 1024));
+
+		totalRaw += (size_t)width * height * 4;
+		totalCompressed += size;
+		totalMegapixels += megapixels;
+		totalSeconds += seconds;
+		stbi_image_free(pixels);
+	}
+
+	UtilsDebugPrint("Block compression: %.1f MP/s on %u workers, %.2f MB -> %.2f MB (%.1fx smaller)\n",
+		totalMegapixels / totalSeconds, jobs ? jobs->GetNumThreads() : 0,
+		(double)totalRaw / (1024.0 * 1024.0), (double)totalCompressed / (1024.0 * 1024.0),
+		totalCompressed ? (double)totalRaw / (double)totalCompressed : 0.0);
+}
+#endif
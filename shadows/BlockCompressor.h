@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#define BC_BLOCK_SIZE 4
+#define BC_BLOCK_TEXELS 16
+#define BC_CHANNEL_R 0x1
+#define BC_CHANNEL_G 0x2
+#define BC_CHANNEL_B 0x4
+#define BC_CHANNEL_A 0x8
+#define BC_CHANNEL_RGB (BC_CHANNEL_R | BC_CHANNEL_G | BC_CHANNEL_B)
+#define BC_CHANNEL_RGBA (BC_CHANNEL_RGB | BC_CHANNEL_A)
+// Reported by BCComputePSNR for identical images
+#define BC_PSNR_LOSSLESS 100.0f
+
+class JobSystem;
+
+enum class BCFormat
+{
+	// RGB, 4 bpp
+	BC1 = 0,
+	// RGB + BC4 alpha, 8 bpp
+	BC3 = 1,
+	// single channel from R, 4 bpp
+	BC4 = 2,
+	// two channels from R and G, 8 bpp
+	BC5 = 3,
+	// RGBA, 8 bpp, the encoder only emits mode 6
+	BC7 = 4,
+};
+
+enum class BCQuality
+{
+	// bounding box endpoints
+	Fast = 0,
+	// principal axis endpoints
+	Normal = 1,
+	// principal axis plus least squares refinement and wider endpoint search
+	High = 2,
+};
+
+uint32_t BCBlockBytes(BCFormat format);
+// Bytes of one row of blocks and of the whole surface, partial blocks round up
+uint32_t BCRowPitch(BCFormat format, uint32_t width);
+size_t BCSurfaceSize(BCFormat format, uint32_t width, uint32_t height);
+
+// texels are 16 RGBA8 values in row order
+void BCCompressBlock(BCFormat format, BCQuality quality, const uint8_t texels[BC_BLOCK_TEXELS * 4], uint8_t* block);
+void BCDecompressBlock(BCFormat format, const uint8_t* block, uint8_t texels[BC_BLOCK_TEXELS * 4]);
+
+// RGBA8 image to tightly packed blocks, edge texels are repeated to fill
+// partial blocks. Rows of blocks are split across jobs when jobs is not null.
+void BCCompressImage(const uint8_t* rgba,
+	uint32_t width,
+	uint32_t height,
+	BCFormat format,
+	BCQuality quality,
+	JobSystem* jobs,
+	uint8_t* blocks);
+void BCDecompressImage(const uint8_t* blocks, uint32_t width, uint32_t height, BCFormat format, uint8_t* rgba);
+
+// Peak signal to noise ratio in dB over the channels in channelMask
+float BCComputePSNR(const uint8_t* lhs, const uint8_t* rhs, uint32_t numPixels, uint32_t channelMask);
+
+#ifdef BLOCK_COMPRESSOR_TEST
+void BlockCompressorTest(void);
+#endif
+
+#ifdef BLOCK_COMPRESSOR_BENCHMARK
+// Encodes every file with the format its name suggests and prints rate, PSNR and size
+void BlockCompressorBenchmark(const char* const* filenames, uint32_t numFiles, JobSystem* jobs);
+#endif
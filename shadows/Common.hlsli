@@ -1,5 +1,15 @@
 #include "LightingHelper.hlsli"
 
+// Matches SHADOW_MAP_NUM_CASCADES
+#define NUM_CASCADES 4
+// Match GAME_NUM_SHADOWED_POINT_LIGHTS and GAME_NUM_SHADOWED_SPOT_LIGHTS
+#define NUM_SHADOWED_POINT_LIGHTS 4
+#define NUM_SHADOWED_SPOT_LIGHTS 2
+// Matches SHADOW_ATLAS_NUM_CUBE_FACES
+#define NUM_CUBE_FACES 6
+// the faces of every shadowed point light, then one per shadowed spot light
+#define NUM_SHADOW_FACES (NUM_SHADOWED_POINT_LIGHTS * NUM_CUBE_FACES + NUM_SHADOWED_SPOT_LIGHTS)
+
 struct VSIn
 {
 	float3 Pos : POSITION;
@@ -13,6 +23,15 @@ struct VSOut
 	float3 NormalW : NORMAL;
 	float2 TexCoords : TEXCOORDS;
 	float3 PosW : POSITION;
+	nointerpolation uint MaterialIdx : MATERIAL;
+};
+
+// Where a face of a point light or a spot light has its shadow in the atlas
+struct ShadowSlot
+{
+	float4x4 ViewProj;
+	// uv offset of the slot in xy and its size in zw, a size of 0 while the face has no shadow drawn
+	float4 Rect;
 };
 
 cbuffer PerObjectConstants : register(b0)
@@ -26,18 +45,155 @@ cbuffer PerFrameConstants : register(b1)
 	float4x4 view;
 	float4x4 proj;
 	float3 cameraPosW;
+	// world to the clip space of each cascade of the directional light's shadow map
+	float4x4 shadowViewProj[NUM_CASCADES];
+	// view space depth where each cascade ends
+	float4 cascadeEnds;
+	// tiles along x and y, depth slices and the side of a tile in pixels
+	uint4 clusterGrid;
+	// log(view depth) * x + y is the depth slice of a cluster
+	float4 clusterDepth;
+	ShadowSlot lightShadows[NUM_SHADOW_FACES];
 };
 
 cbuffer PerSceneConstants : register(b2)
 {
-	PointLight pointLights[4];
 	DirectionalLight dirLight;
-	SpotLight spotLights[2];
+};
+
+#define MAX_MATERIALS 16
+
+#define TEXTURE_DIFFUSE 0
+#define TEXTURE_SPECULAR 1
+#define TEXTURE_GLOSS 2
+#define TEXTURE_NORMAL 3
+
+// Where the textures of a material are inside the bound arrays, one entry per texture slot
+struct MaterialTextures
+{
+	float4 ScaleOffset[4];
+	float4 Slice;
+	float4 MaxLevel;
+};
+
+cbuffer PerMaterialConstants : register(b3)
+{
+	Material materials[MAX_MATERIALS];
+	MaterialTextures materialTextures[MAX_MATERIALS];
 };
 
 sampler defaultSampler : register(s0);
+SamplerComparisonState shadowSampler : register(s1);
 
-Texture2D<float4> diffuseTexture	: register(t0);
-Texture2D<float4> specularTexture	: register(t1);
-Texture2D<float4> glossTexture		: register(t2);
-Texture2D<float4> normalTexture		: register(t3);
\ No newline at end of file
+Texture2DArray<float4> diffuseTexture	: register(t0);
+Texture2DArray<float4> specularTexture	: register(t1);
+Texture2DArray<float4> glossTexture		: register(t2);
+Texture2DArray<float4> normalTexture	: register(t3);
+Texture2DArray<float> shadowMap			: register(t4);
+Texture2DArray<float> shadowAtlas		: register(t5);
+StructuredBuffer<PointLight> pointLights	: register(t6);
+StructuredBuffer<SpotLight> spotLights		: register(t7);
+// offset into lightIndices in x, then the number of point lights and of spot lights of the cluster
+StructuredBuffer<uint4> lightClusters		: register(t8);
+StructuredBuffer<uint> lightIndices			: register(t9);
+
+// Atlas rects repeat by wrapping uv into the rect. The gradients come from the
+// unwrapped coordinates so frac() does not spike them at the rect edges, and
+// they shrink past MaxLevel where the page no longer holds the texture.
+// Whole slices have an identity transform and go down the same path.
+float4 SampleMaterialTexture(Texture2DArray<float4> tex, uint materialIdx, uint slot, float2 uv)
+{
+	const MaterialTextures textures = materialTextures[materialIdx];
+	const float4 scaleOffset = textures.ScaleOffset[slot];
+	const float2 scaledUV = uv * scaleOffset.xy;
+	const float lod = tex.CalculateLevelOfDetail(defaultSampler, scaledUV);
+	const float gradientScale = exp2(min(0.0f, textures.MaxLevel[slot] - lod));
+	const float3 location = float3(frac(uv) * scaleOffset.xy + scaleOffset.zw, textures.Slice[slot]);
+	return tex.SampleGrad(defaultSampler, location, ddx(scaledUV) * gradientScale, ddy(scaledUV) * gradientScale);
+}
+
+// 1 where the directional light reaches posW, 0 in shadow, bilinear PCF in between.
+// The cascade is picked by view depth, points past the last one or outside
+// their cascade's map stay lit.
+float SampleShadow(float3 posW)
+{
+	const float depth = mul(view, float4(posW, 1.0f)).z;
+	const uint cascade = (uint)dot(float4(depth > cascadeEnds), 1.0f);
+	if (cascade >= NUM_CASCADES)
+	{
+		return 1.0f;
+	}
+	const float4 posL = mul(shadowViewProj[cascade], float4(posW, 1.0f));
+	const float3 ndc = posL.xyz / posL.w;
+	if (ndc.z > 1.0f)
+	{
+		return 1.0f;
+	}
+	const float2 uv = ndc.xy * float2(0.5f, -0.5f) + 0.5f;
+	return shadowMap.SampleCmpLevelZero(shadowSampler, float3(uv, cascade), ndc.z);
+}
+
+// Cluster of the pixel at posW, the same one LightCuller computes
+uint4 FindLightCluster(float2 pixel, float3 posW)
+{
+	const float depth = mul(view, float4(posW, 1.0f)).z;
+	const uint slice = min((uint)max(log(depth) * clusterDepth.x + clusterDepth.y, 0.0f), clusterGrid.z - 1);
+	const uint2 tile = min((uint2)pixel / clusterGrid.w, clusterGrid.xy - 1);
+	return lightClusters[(slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x];
+}
+
+// Like SampleShadow for a face of the atlas. Points outside the face stay lit.
+float SampleAtlasShadow(uint face, float3 posW)
+{
+	const ShadowSlot slot = lightShadows[face];
+	if (slot.Rect.z == 0.0f)
+	{
+		return 1.0f;
+	}
+	const float4 posL = mul(slot.ViewProj, float4(posW, 1.0f));
+	const float3 ndc = posL.xyz / posL.w;
+	if (posL.w <= 0.0f || ndc.z > 1.0f || any(abs(ndc.xy) > 1.0f))
+	{
+		return 1.0f;
+	}
+	// the 2x2 footprint of the comparison stays inside the slot, its neighbours belong to other lights
+	float width, height, elements;
+	shadowAtlas.GetDimensions(width, height, elements);
+	const float2 inset = 0.5f / (slot.Rect.zw * width);
+	const float2 uv = clamp(ndc.xy * float2(0.5f, -0.5f) + 0.5f, inset, 1.0f - inset);
+	return shadowAtlas.SampleCmpLevelZero(shadowSampler, float3(slot.Rect.xy + uv * slot.Rect.zw, 0.0f), ndc.z);
+}
+
+// The face is the major axis of the direction from the light, in the order +X, -X, +Y, -Y, +Z, -Z
+float SamplePointShadow(uint light, float3 posW)
+{
+	if (light >= NUM_SHADOWED_POINT_LIGHTS)
+	{
+		return 1.0f;
+	}
+	const float3 toPos = posW - pointLights[light].Position;
+	const float3 size = abs(toPos);
+	uint face = 0;
+	if (size.y > size.x && size.y >= size.z)
+	{
+		face = toPos.y < 0.0f ? 3 : 2;
+	}
+	else if (size.z > size.x)
+	{
+		face = toPos.z < 0.0f ? 5 : 4;
+	}
+	else
+	{
+		face = toPos.x < 0.0f ? 1 : 0;
+	}
+	return SampleAtlasShadow(light * NUM_CUBE_FACES + face, posW);
+}
+
+float SampleSpotShadow(uint light, float3 posW)
+{
+	if (light >= NUM_SHADOWED_SPOT_LIGHTS)
+	{
+		return 1.0f;
+	}
+	return SampleAtlasShadow(NUM_SHADOWED_POINT_LIGHTS * NUM_CUBE_FACES + light, posW);
+}
@@ -0,0 +1,699 @@
+#include "DDSLoader.h"
+
+#include <assert.h>
+#include <string.h>
+
+static_assert(sizeof(DDSPixelFormat) == 32, "DDS pixel format must match the file layout");
+static_assert(sizeof(DDSHeader) == 124, "DDS header must match the file layout");
+static_assert(sizeof(DDSHeaderDX10) == 20, "DDS DX10 header must match the file layout");
+
+// legacy D3DFORMAT codes stored in FourCC by old float writers
+#define DDS_D3DFMT_A16B16G16R16 36
+#define DDS_D3DFMT_R16F 111
+#define DDS_D3DFMT_G16R16F 112
+#define DDS_D3DFMT_A16B16G16R16F 113
+#define DDS_D3DFMT_R32F 114
+#define DDS_D3DFMT_G32R32F 115
+#define DDS_D3DFMT_A32B32G32R32F 116
+
+static bool DDSHasMasks(const DDSPixelFormat& pf, uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+{
+	return pf.RBitMask == r && pf.GBitMask == g && pf.BBitMask == b && pf.ABitMask == a;
+}
+
+// Maps pre-DX10 pixel formats, the same subset D3DX and DirectXTex write out
+static uint32_t DDSLegacyFormat(const DDSPixelFormat& pf)
+{
+	if (pf.Flags & DDPF_FOURCC)
+	{
+		switch (pf.FourCC)
+		{
+		case DDS_FOURCC('D', 'X', 'T', '1'):
+			return DDS_FORMAT_BC1_UNORM;
+		case DDS_FOURCC('D', 'X', 'T', '2'):
+		case DDS_FOURCC('D', 'X', 'T', '3'):
+			return DDS_FORMAT_BC2_UNORM;
+		case DDS_FOURCC('D', 'X', 'T', '4'):
+		case DDS_FOURCC('D', 'X', 'T', '5'):
+			return DDS_FORMAT_BC3_UNORM;
+		case DDS_FOURCC('A', 'T', 'I', '1'):
+		case DDS_FOURCC('B', 'C', '4', 'U'):
+			return DDS_FORMAT_BC4_UNORM;
+		case DDS_FOURCC('B', 'C', '4', 'S'):
+			return DDS_FORMAT_BC4_SNORM;
+		case DDS_FOURCC('A', 'T', 'I', '2'):
+		case DDS_FOURCC('B', 'C', '5', 'U'):
+			return DDS_FORMAT_BC5_UNORM;
+		case DDS_FOURCC('B', 'C', '5', 'S'):
+			return DDS_FORMAT_BC5_SNORM;
+		case DDS_D3DFMT_A16B16G16R16:
+			return DDS_FORMAT_R16G16B16A16_UNORM;
+		case DDS_D3DFMT_R16F:
+			return DDS_FORMAT_R16_FLOAT;
+		case DDS_D3DFMT_G16R16F:
+			return DDS_FORMAT_R16G16_FLOAT;
+		case DDS_D3DFMT_A16B16G16R16F:
+			return DDS_FORMAT_R16G16B16A16_FLOAT;
+		case DDS_D3DFMT_R32F:
+			return DDS_FORMAT_R32_FLOAT;
+		case DDS_D3DFMT_G32R32F:
+			return DDS_FORMAT_R32G32_FLOAT;
+		case DDS_D3DFMT_A32B32G32R32F:
+			return DDS_FORMAT_R32G32B32A32_FLOAT;
+		default:
+			return DDS_FORMAT_UNKNOWN;
+		}
+	}
+
+	if (pf.Flags & DDPF_RGB)
+	{
+		switch (pf.RGBBitCount)
+		{
+		case 32:
+			if (DDSHasMasks(pf, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000))
+				return DDS_FORMAT_R8G8B8A8_UNORM;
+			if (DDSHasMasks(pf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000))
+				return DDS_FORMAT_B8G8R8A8_UNORM;
+			if (DDSHasMasks(pf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0))
+				return DDS_FORMAT_B8G8R8X8_UNORM;
+			if (DDSHasMasks(pf, 0x000003ff, 0x000ffc00, 0x3ff00000, 0xc0000000))
+				return DDS_FORMAT_R10G10B10A2_UNORM;
+			if (DDSHasMasks(pf, 0x0000ffff, 0xffff0000, 0, 0))
+				return DDS_FORMAT_R16G16_UNORM;
+			break;
+		case 16:
+			if (DDSHasMasks(pf, 0xf800, 0x07e0, 0x001f, 0))
+				return DDS_FORMAT_B5G6R5_UNORM;
+			if (DDSHasMasks(pf, 0x7c00, 0x03e0, 0x001f, 0x8000))
+				return DDS_FORMAT_B5G5R5A1_UNORM;
+			if (DDSHasMasks(pf, 0x0f00, 0x00f0, 0x000f, 0xf000))
+				return DDS_FORMAT_B4G4R4A4_UNORM;
+			break;
+		}
+		return DDS_FORMAT_UNKNOWN;
+	}
+
+	if (pf.Flags & DDPF_LUMINANCE)
+	{
+		if (pf.RGBBitCount == 8 && pf.RBitMask == 0xff)
+			return DDS_FORMAT_R8_UNORM;
+		if (pf.RGBBitCount == 16 && pf.RBitMask == 0xffff)
+			return DDS_FORMAT_R16_UNORM;
+		if (pf.RGBBitCount == 16 && pf.RBitMask == 0xff && pf.ABitMask == 0xff00)
+			return DDS_FORMAT_R8G8_UNORM;
+		return DDS_FORMAT_UNKNOWN;
+	}
+
+	if ((pf.Flags & DDPF_ALPHA) && pf.RGBBitCount == 8)
+	{
+		return DDS_FORMAT_A8_UNORM;
+	}
+	return DDS_FORMAT_UNKNOWN;
+}
+
+uint32_t DDSBitsPerPixel(uint32_t format)
+{
+	switch (format)
+	{
+	case DDS_FORMAT_R32G32B32A32_FLOAT:
+		return 128;
+	case DDS_FORMAT_R16G16B16A16_FLOAT:
+	case DDS_FORMAT_R16G16B16A16_UNORM:
+	case DDS_FORMAT_R32G32_FLOAT:
+		return 64;
+	case DDS_FORMAT_R10G10B10A2_UNORM:
+	case DDS_FORMAT_R11G11B10_FLOAT:
+	case DDS_FORMAT_R8G8B8A8_UNORM:
+	case DDS_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DDS_FORMAT_R16G16_FLOAT:
+	case DDS_FORMAT_R16G16_UNORM:
+	case DDS_FORMAT_R32_FLOAT:
+	case DDS_FORMAT_B8G8R8A8_UNORM:
+	case DDS_FORMAT_B8G8R8X8_UNORM:
+	case DDS_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DDS_FORMAT_B8G8R8X8_UNORM_SRGB:
+		return 32;
+	case DDS_FORMAT_R8G8_UNORM:
+	case DDS_FORMAT_R16_FLOAT:
+	case DDS_FORMAT_R16_UNORM:
+	case DDS_FORMAT_B5G6R5_UNORM:
+	case DDS_FORMAT_B5G5R5A1_UNORM:
+	case DDS_FORMAT_B4G4R4A4_UNORM:
+		return 16;
+	case DDS_FORMAT_R8_UNORM:
+	case DDS_FORMAT_A8_UNORM:
+	case DDS_FORMAT_BC2_UNORM:
+	case DDS_FORMAT_BC2_UNORM_SRGB:
+	case DDS_FORMAT_BC3_UNORM:
+	case DDS_FORMAT_BC3_UNORM_SRGB:
+	case DDS_FORMAT_BC5_UNORM:
+	case DDS_FORMAT_BC5_SNORM:
+	case DDS_FORMAT_BC6H_UF16:
+	case DDS_FORMAT_BC6H_SF16:
+	case DDS_FORMAT_BC7_UNORM:
+	case DDS_FORMAT_BC7_UNORM_SRGB:
+		return 8;
+	case DDS_FORMAT_BC1_UNORM:
+	case DDS_FORMAT_BC1_UNORM_SRGB:
+	case DDS_FORMAT_BC4_UNORM:
+	case DDS_FORMAT_BC4_SNORM:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+bool DDSIsBlockCompressed(uint32_t format)
+{
+	return (format >= DDS_FORMAT_BC1_UNORM && format <= DDS_FORMAT_BC5_SNORM) ||
+		(format >= DDS_FORMAT_BC6H_UF16 && format <= DDS_FORMAT_BC7_UNORM_SRGB);
+}
+
+uint64_t DDSRowPitch(uint32_t format, uint32_t width)
+{
+	if (DDSIsBlockCompressed(format))
+	{
+		// 16 texels per block
+		const uint32_t blocks = (width + 3) / 4;
+		return (uint64_t)(blocks ? blocks : 1) * DDSBitsPerPixel(format) * 2;
+	}
+	return ((uint64_t)width * DDSBitsPerPixel(format) + 7) / 8;
+}
+
+uint32_t DDSNumRows(uint32_t format, uint32_t height)
+{
+	if (DDSIsBlockCompressed(format))
+	{
+		const uint32_t blocks = (height + 3) / 4;
+		return blocks ? blocks : 1;
+	}
+	return height;
+}
+
+static uint32_t DDSMaxLevels(uint32_t width, uint32_t height, uint32_t depth)
+{
+	uint32_t size = width > height ? width : height;
+	size = size > depth ? size : depth;
+	uint32_t levels = 1;
+	while (size > 1)
+	{
+		size >>= 1;
+		++levels;
+	}
+	return levels;
+}
+
+DDSStatus DDSParse(const uint8_t* data, size_t size, DDSImage* image)
+{
+	*image = DDSImage();
+
+	uint32_t magic = 0;
+	DDSHeader header = {};
+	if (size < sizeof(magic) + sizeof(header))
+	{
+		return DDSStatus::NotDDS;
+	}
+	memcpy(&magic, data, sizeof(magic));
+	memcpy(&header, data + sizeof(magic), sizeof(header));
+	if (magic != DDS_MAGIC || header.Size != sizeof(DDSHeader) || header.PixelFormat.Size != sizeof(DDSPixelFormat))
+	{
+		return DDSStatus::NotDDS;
+	}
+	uint64_t offset = sizeof(magic) + sizeof(header);
+
+	image->Width = header.Width;
+	image->Height = header.Height;
+	image->Depth = 1;
+	image->ArraySize = 1;
+	// some writers leave DDSD_MIPMAPCOUNT out but still fill the count
+	image->NumLevels = header.MipMapCount ? header.MipMapCount : 1;
+
+	if ((header.PixelFormat.Flags & DDPF_FOURCC) && header.PixelFormat.FourCC == DDS_FOURCC('D', 'X', '1', '0'))
+	{
+		DDSHeaderDX10 dx10 = {};
+		if (size < offset + sizeof(dx10))
+		{
+			return DDSStatus::Truncated;
+		}
+		memcpy(&dx10, data + offset, sizeof(dx10));
+		offset += sizeof(dx10);
+
+		// bounded before the cube faces multiply it and before the subresource table is sized by it
+		if (dx10.ArraySize > DDS_MAX_ARRAY_SIZE)
+		{
+			return DDSStatus::BadHeader;
+		}
+		image->Format = dx10.Format;
+		image->ArraySize = dx10.ArraySize;
+		switch (dx10.ResourceDimension)
+		{
+		case (uint32_t)DDSDimension::Texture1D:
+			image->Dimension = DDSDimension::Texture1D;
+			image->Height = 1;
+			break;
+		case (uint32_t)DDSDimension::Texture2D:
+			image->Dimension = DDSDimension::Texture2D;
+			if (dx10.MiscFlag & DDS_RESOURCE_MISC_TEXTURECUBE)
+			{
+				image->IsCubemap = true;
+				image->ArraySize *= 6;
+			}
+			break;
+		case (uint32_t)DDSDimension::Texture3D:
+			image->Dimension = DDSDimension::Texture3D;
+			image->Depth = header.Depth;
+			if (!(header.Flags & DDSD_DEPTH) || image->ArraySize != 1)
+			{
+				return DDSStatus::BadHeader;
+			}
+			break;
+		default:
+			return DDSStatus::BadHeader;
+		}
+	}
+	else
+	{
+		image->Format = DDSLegacyFormat(header.PixelFormat);
+		if (header.Caps2 & DDSCAPS2_VOLUME)
+		{
+			image->Dimension = DDSDimension::Texture3D;
+			image->Depth = header.Depth;
+		}
+		else if (header.Caps2 & DDSCAPS2_CUBEMAP)
+		{
+			// D3D has no cubemaps with missing faces
+			if ((header.Caps2 & DDSCAPS2_CUBEMAP_ALLFACES) != DDSCAPS2_CUBEMAP_ALLFACES)
+			{
+				return DDSStatus::UnsupportedFormat;
+			}
+			image->IsCubemap = true;
+			image->ArraySize = 6;
+		}
+	}
+
+	if (DDSBitsPerPixel(image->Format) == 0)
+	{
+		return DDSStatus::UnsupportedFormat;
+	}
+	// bounded so that no pitch can wrap, D3D would refuse anything bigger anyway
+	const uint32_t maxDimension = image->Dimension == DDSDimension::Texture3D ? DDS_MAX_VOLUME_DIMENSION : DDS_MAX_DIMENSION;
+	if (image->Width == 0 || image->Height == 0 || image->Depth == 0 || image->ArraySize == 0 ||
+		image->Width > maxDimension || image->Height > maxDimension || image->Depth > maxDimension ||
+		image->ArraySize > DDS_MAX_ARRAY_SIZE ||
+		(image->IsCubemap && image->Width != image->Height) ||
+		image->NumLevels > DDS_MAX_LEVELS ||
+		image->NumLevels > DDSMaxLevels(image->Width, image->Height, image->Depth))
+	{
+		return DDSStatus::BadHeader;
+	}
+
+	// every slice stores its full mip chain before the next slice starts
+	image->Subresources.reserve(image->ArraySize * image->NumLevels);
+	for (uint32_t slice = 0; slice < image->ArraySize; ++slice)
+	{
+		for (uint32_t level = 0; level < image->NumLevels; ++level)
+		{
+			DDSSubresource subresource = {};
+			subresource.Width = image->Width >> level ? image->Width >> level : 1;
+			subresource.Height = image->Height >> level ? image->Height >> level : 1;
+			subresource.Depth = image->Depth >> level ? image->Depth >> level : 1;
+
+			const uint64_t rowPitch = DDSRowPitch(image->Format, subresource.Width);
+			const uint64_t slicePitch = rowPitch * DDSNumRows(image->Format, subresource.Height);
+			if (slicePitch > UINT32_MAX)
+			{
+				return DDSStatus::BadHeader;
+			}
+			const uint64_t levelBytes = slicePitch * subresource.Depth;
+			if (offset + levelBytes > size)
+			{
+				image->Subresources.clear();
+				return DDSStatus::Truncated;
+			}
+
+			subresource.Data = data + offset;
+			subresource.RowPitch = (uint32_t)rowPitch;
+			subresource.SlicePitch = (uint32_t)slicePitch;
+			image->Subresources.emplace_back(subresource);
+			offset += levelBytes;
+		}
+	}
+	return DDSStatus::Ok;
+}
+
+void DDSWriteHeader(uint32_t format, uint32_t width, uint32_t height, uint32_t numLevels, uint32_t arraySize,
+	bool cubemap, uint8_t out[DDS_DX10_HEADER_SIZE])
+{
+	const uint32_t magic = DDS_MAGIC;
+
+	DDSHeader header = {};
+	header.Size = sizeof(DDSHeader);
+	header.Flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT;
+	header.Width = width;
+	header.Height = height;
+	header.MipMapCount = numLevels;
+	header.PixelFormat.Size = sizeof(DDSPixelFormat);
+	header.PixelFormat.Flags = DDPF_FOURCC;
+	header.PixelFormat.FourCC = DDS_FOURCC('D', 'X', '1', '0');
+	header.Caps = DDSCAPS_TEXTURE;
+	if (DDSIsBlockCompressed(format))
+	{
+		header.Flags |= DDSD_LINEARSIZE;
+		header.PitchOrLinearSize = (uint32_t)(DDSRowPitch(format, width) * DDSNumRows(format, height));
+	}
+	else
+	{
+		header.Flags |= DDSD_PITCH;
+		header.PitchOrLinearSize = (uint32_t)DDSRowPitch(format, width);
+	}
+	if (numLevels > 1)
+	{
+		header.Caps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+	}
+	if (cubemap)
+	{
+		header.Caps |= DDSCAPS_COMPLEX;
+		header.Caps2 = DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_ALLFACES;
+	}
+
+	DDSHeaderDX10 dx10 = {};
+	dx10.Format = format;
+	dx10.ResourceDimension = (uint32_t)DDSDimension::Texture2D;
+	dx10.MiscFlag = cubemap ? DDS_RESOURCE_MISC_TEXTURECUBE : 0;
+	dx10.ArraySize = cubemap ? arraySize / 6 : arraySize;
+
+	memcpy(out, &magic, sizeof(magic));
+	memcpy(out + sizeof(magic), &header, sizeof(header));
+	memcpy(out + sizeof(magic) + sizeof(header), &dx10, sizeof(dx10));
+}
+
+const char* DDSStatusString(DDSStatus status)
+{
+	switch (status)
+	{
+	case DDSStatus::Ok:
+		return "ok";
+	case DDSStatus::NotDDS:
+		return "not a DDS file";
+	case DDSStatus::BadHeader:
+		return "invalid header";
+	case DDSStatus::UnsupportedFormat:
+		return "unsupported format";
+	case DDSStatus::Truncated:
+		return "file is truncated";
+	default:
+		return "unknown error";
+	}
+}
+
+#ifdef DDS_LOADER_TEST
+#include "MappedFile.h"
+
+static DDSHeader DDSTestHeader(uint32_t width, uint32_t height, uint32_t numLevels)
+{
+	DDSHeader header = {};
+	header.Size = sizeof(DDSHeader);
+	header.Flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT;
+	header.Width = width;
+	header.Height = height;
+	header.MipMapCount = numLevels;
+	header.PixelFormat.Size = sizeof(DDSPixelFormat);
+	header.Caps = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+	return header;
+}
+
+static std::vector<uint8_t> DDSTestFile(const DDSHeader& header, const DDSHeaderDX10* dx10, size_t dataBytes)
+{
+	const uint32_t magic = DDS_MAGIC;
+	std::vector<uint8_t> file(sizeof(magic) + sizeof(header) + (dx10 ? sizeof(*dx10) : 0) + dataBytes);
+	memcpy(&file[0], &magic, sizeof(magic));
+	memcpy(&file[sizeof(magic)], &header, sizeof(header));
+	if (dx10)
+	{
+		memcpy(&file[sizeof(magic) + sizeof(header)], dx10, sizeof(*dx10));
+	}
+	return file;
+}
+
+static void TestDDSLegacyRGBA(void)
+{
+	// 64x32 BGRA with the full chain down to 1x1
+	DDSHeader header = DDSTestHeader(64, 32, 7);
+	header.PixelFormat.Flags = DDPF_RGB | DDPF_ALPHAPIXELS;
+	header.PixelFormat.RGBBitCount = 32;
+	header.PixelFormat.RBitMask = 0x00ff0000;
+	header.PixelFormat.GBitMask = 0x0000ff00;
+	header.PixelFormat.BBitMask = 0x000000ff;
+	header.PixelFormat.ABitMask = 0xff000000;
+
+	size_t dataBytes = 0;
+	for (uint32_t level = 0; level < 7; ++level)
+	{
+		const uint32_t width = 64 >> level;
+		const uint32_t height = 32 >> level ? 32 >> level : 1;
+		dataBytes += width * height * 4;
+	}
+	std::vector<uint8_t> file = DDSTestFile(header, nullptr, dataBytes);
+
+	DDSImage image;
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::Ok);
+	assert(image.Format == DDS_FORMAT_B8G8R8A8_UNORM);
+	assert(image.Dimension == DDSDimension::Texture2D && !image.IsCubemap);
+	assert(image.Width == 64 && image.Height == 32 && image.NumLevels == 7 && image.ArraySize == 1);
+	assert(image.Subresources.size() == 7);
+
+	// levels are back to back right after the header, no texel was copied
+	const uint8_t* expected = file.data() + sizeof(uint32_t) + sizeof(DDSHeader);
+	for (uint32_t level = 0; level < 7; ++level)
+	{
+		const DDSSubresource& subresource = image.GetSubresource(0, level);
+		assert(subresource.Data == expected);
+		assert(subresource.RowPitch == subresource.Width * 4);
+		assert(subresource.SlicePitch == subresource.RowPitch * subresource.Height);
+		expected += subresource.SlicePitch;
+	}
+	assert(image.Subresources[6].Width == 1 && image.Subresources[6].Height == 1);
+	assert(expected == file.data() + file.size());
+
+	// one byte short
+	assert(DDSParse(file.data(), file.size() - 1, &image) == DDSStatus::Truncated);
+	assert(image.Subresources.empty());
+
+	// more levels than 64x32 can have
+	header.MipMapCount = 8;
+	file = DDSTestFile(header, nullptr, dataBytes + 4);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::BadHeader);
+
+	// no mip count means a single level
+	header.MipMapCount = 0;
+	header.Flags &= ~DDSD_MIPMAPCOUNT;
+	file = DDSTestFile(header, nullptr, 64 * 32 * 4);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::Ok && image.NumLevels == 1);
+
+	file[0] = 'X';
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::NotDDS);
+	assert(DDSParse(file.data(), 16, &image) == DDSStatus::NotDDS);
+}
+
+static void TestDDSLegacyFourCC(void)
+{
+	// DXT5 with a size that is not a multiple of the block size
+	DDSHeader header = DDSTestHeader(6, 6, 3);
+	header.PixelFormat.Flags = DDPF_FOURCC;
+	header.PixelFormat.FourCC = DDS_FOURCC('D', 'X', 'T', '5');
+	std::vector<uint8_t> file = DDSTestFile(header, nullptr, 4 * 16 + 16 + 16);
+
+	DDSImage image;
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::Ok);
+	assert(image.Format == DDS_FORMAT_BC3_UNORM);
+	assert(image.Subresources[0].RowPitch == 32 && image.Subresources[0].SlicePitch == 64);
+	// 3x3 and 1x1 still take a whole block
+	assert(image.Subresources[1].RowPitch == 16 && image.Subresources[1].SlicePitch == 16);
+	assert(image.Subresources[2].RowPitch == 16 && image.Subresources[2].SlicePitch == 16);
+
+	header.PixelFormat.FourCC = DDS_FOURCC('Y', 'U', 'Y', '2');
+	file = DDSTestFile(header, nullptr, 4 * 16 + 16 + 16);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::UnsupportedFormat);
+
+	// cubemaps with missing faces cannot be created
+	header = DDSTestHeader(4, 4, 1);
+	header.PixelFormat.Flags = DDPF_FOURCC;
+	header.PixelFormat.FourCC = DDS_FOURCC('D', 'X', 'T', '1');
+	header.Caps2 = DDSCAPS2_CUBEMAP | 0x0400 | 0x0800;
+	file = DDSTestFile(header, nullptr, 6 * 8);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::UnsupportedFormat);
+
+	header.Caps2 = DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_ALLFACES;
+	file = DDSTestFile(header, nullptr, 6 * 8);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::Ok);
+	assert(image.IsCubemap && image.ArraySize == 6 && image.Subresources.size() == 6);
+	assert(image.Subresources[5].Data == file.data() + file.size() - 8);
+}
+
+static void TestDDSCubemapArray(void)
+{
+	// two BC1 cubes of 8x8 with three levels, 32 + 8 + 8 bytes per face
+	DDSHeader header = DDSTestHeader(8, 8, 3);
+	header.PixelFormat.Flags = DDPF_FOURCC;
+	header.PixelFormat.FourCC = DDS_FOURCC('D', 'X', '1', '0');
+	DDSHeaderDX10 dx10 = {};
+	dx10.Format = DDS_FORMAT_BC1_UNORM;
+	dx10.ResourceDimension = (uint32_t)DDSDimension::Texture2D;
+	dx10.MiscFlag = DDS_RESOURCE_MISC_TEXTURECUBE;
+	dx10.ArraySize = 2;
+
+	const size_t faceBytes = 32 + 8 + 8;
+	std::vector<uint8_t> file = DDSTestFile(header, &dx10, 12 * faceBytes);
+
+	DDSImage image;
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::Ok);
+	assert(image.IsCubemap && image.ArraySize == 12 && image.NumLevels == 3);
+	assert(image.Subresources.size() == 36);
+
+	const uint8_t* base = file.data() + sizeof(uint32_t) + sizeof(DDSHeader) + sizeof(DDSHeaderDX10);
+	assert(image.GetSubresource(0, 0).Data == base);
+	assert(image.GetSubresource(7, 1).Data == base + 7 * faceBytes + 32);
+	assert(image.GetSubresource(11, 2).Data == base + 11 * faceBytes + 40);
+	assert(image.GetSubresource(7, 1).RowPitch == 8 && image.GetSubresource(7, 0).RowPitch == 16);
+
+	// short by one face
+	file.resize(file.size() - faceBytes);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::Truncated);
+
+	// cube faces must be square
+	header.Width = 16;
+	file = DDSTestFile(header, &dx10, 24 * faceBytes);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::BadHeader);
+}
+
+static void TestDDSArrayAndVolume(void)
+{
+	DDSHeader header = DDSTestHeader(16, 16, 1);
+	header.PixelFormat.Flags = DDPF_FOURCC;
+	header.PixelFormat.FourCC = DDS_FOURCC('D', 'X', '1', '0');
+	DDSHeaderDX10 dx10 = {};
+	dx10.Format = DDS_FORMAT_BC7_UNORM;
+	dx10.ResourceDimension = (uint32_t)DDSDimension::Texture2D;
+	dx10.ArraySize = 3;
+
+	std::vector<uint8_t> file = DDSTestFile(header, &dx10, 3 * 256);
+	DDSImage image;
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::Ok);
+	assert(!image.IsCubemap && image.ArraySize == 3 && image.Subresources.size() == 3);
+	assert(image.GetSubresource(2, 0).Data - image.GetSubresource(1, 0).Data == 256);
+	assert(image.GetSubresource(2, 0).RowPitch == 64);
+
+	dx10.ArraySize = 0;
+	file = DDSTestFile(header, &dx10, 256);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::BadHeader);
+
+	// huge arrays are rejected before anything is sized by them, as plain arrays and as cubes
+	dx10.ArraySize = 0x7fffffff;
+	file = DDSTestFile(header, &dx10, 256);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::BadHeader);
+	dx10.ArraySize = DDS_MAX_ARRAY_SIZE / 6 + 1;
+	dx10.MiscFlag = DDS_RESOURCE_MISC_TEXTURECUBE;
+	file = DDSTestFile(header, &dx10, 256);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::BadHeader);
+	dx10.MiscFlag = 0;
+
+	// within the limit, a short file is truncated rather than rejected
+	dx10.ArraySize = DDS_MAX_ARRAY_SIZE;
+	file = DDSTestFile(header, &dx10, 256);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::Truncated);
+	dx10.ArraySize = 1;
+
+	// a row of 0x20000000 RGBA32F texels is 8 GB and used to wrap to a pitch of 0
+	DDSHeader wide = DDSTestHeader(0x20000000, 1, 1);
+	wide.PixelFormat = header.PixelFormat;
+	dx10.Format = DDS_FORMAT_R32G32B32A32_FLOAT;
+	file = DDSTestFile(wide, &dx10, 256);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::BadHeader);
+	assert(DDSRowPitch(DDS_FORMAT_R32G32B32A32_FLOAT, 0x20000000) == 0x20000000ull * 16);
+	wide = DDSTestHeader(DDS_MAX_DIMENSION + 1, 4, 1);
+	wide.PixelFormat = header.PixelFormat;
+	dx10.Format = DDS_FORMAT_BC7_UNORM;
+	file = DDSTestFile(wide, &dx10, 256);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::BadHeader);
+
+	dx10.ArraySize = 1;
+	dx10.Format = 1234;
+	file = DDSTestFile(header, &dx10, 256);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::UnsupportedFormat);
+
+	// missing DX10 header
+	file = DDSTestFile(header, nullptr, 0);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::Truncated);
+
+	// RGBA 4x4x4 volume, depth halves with every level too
+	header = DDSTestHeader(4, 4, 2);
+	header.Flags |= DDSD_DEPTH;
+	header.Depth = 4;
+	header.Caps2 = DDSCAPS2_VOLUME;
+	header.PixelFormat.Flags = DDPF_RGB | DDPF_ALPHAPIXELS;
+	header.PixelFormat.RGBBitCount = 32;
+	header.PixelFormat.RBitMask = 0x000000ff;
+	header.PixelFormat.GBitMask = 0x0000ff00;
+	header.PixelFormat.BBitMask = 0x00ff0000;
+	header.PixelFormat.ABitMask = 0xff000000;
+	file = DDSTestFile(header, nullptr, 4 * 4 * 4 * 4 + 2 * 2 * 2 * 4);
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::Ok);
+	assert(image.Dimension == DDSDimension::Texture3D && image.Format == DDS_FORMAT_R8G8B8A8_UNORM);
+	assert(image.Subresources[0].SlicePitch == 64 && image.Subresources[0].Depth == 4);
+	assert(image.Subresources[1].SlicePitch == 16 && image.Subresources[1].Depth == 2);
+	assert(image.Subresources[1].Data - image.Subresources[0].Data == 256);
+}
+
+static void TestDDSWriteHeader(void)
+{
+	// BC5 12x8 array of 2 with the full chain
+	const uint32_t levelBytes[] = { 3 * 2 * 16, 2 * 1 * 16, 1 * 16, 1 * 16 };
+	const size_t sliceBytes = levelBytes[0] + levelBytes[1] + levelBytes[2] + levelBytes[3];
+	std::vector<uint8_t> file(DDS_DX10_HEADER_SIZE + 2 * sliceBytes);
+	DDSWriteHeader(DDS_FORMAT_BC5_UNORM, 12, 8, 4, 2, false, file.data());
+
+	DDSImage image;
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::Ok);
+	assert(image.Format == DDS_FORMAT_BC5_UNORM && image.Width == 12 && image.Height == 8);
+	assert(image.NumLevels == 4 && image.ArraySize == 2 && !image.IsCubemap);
+	assert(image.GetSubresource(1, 0).Data == file.data() + DDS_DX10_HEADER_SIZE + sliceBytes);
+	assert(image.GetSubresource(1, 3).Data + levelBytes[3] == file.data() + file.size());
+
+	// cube faces are counted in arraySize but stored as cubes in the header
+	file.assign(DDS_DX10_HEADER_SIZE + 6 * 4, 0);
+	DDSWriteHeader(DDS_FORMAT_R8G8B8A8_UNORM, 1, 1, 1, 6, true, file.data());
+	assert(DDSParse(file.data(), file.size(), &image) == DDSStatus::Ok);
+	assert(image.IsCubemap && image.ArraySize == 6 && image.Subresources.size() == 6);
+}
+
+static void TestDDSAssetFile(const char* filename, uint32_t size, uint32_t numLevels)
+{
+	MappedFile file;
+	assert(file.Open(filename));
+
+	DDSImage image;
+	assert(DDSParse(file.GetData(), file.GetSize(), &image) == DDSStatus::Ok);
+	assert(image.Format == DDS_FORMAT_B8G8R8A8_UNORM);
+	assert(image.Width == size && image.Height == size && image.NumLevels == numLevels);
+	assert(image.Subresources.size() == numLevels);
+
+	const DDSSubresource& last = image.Subresources.back();
+	assert(last.Width == 1 && last.Height == 1);
+	assert(last.Data + last.SlicePitch == file.GetData() + file.GetSize());
+}
+
+void DDSLoaderTest(void)
+{
+	TestDDSLegacyRGBA();
+	TestDDSLegacyFourCC();
+	TestDDSCubemapArray();
+	TestDDSArrayAndVolume();
+	TestDDSWriteHeader();
+	TestDDSAssetFile("assets/textures/snow.dds", 512, 10);
+	TestDDSAssetFile("assets/textures/flare0.dds", 64, 7);
+
+	MappedFile missing;
+	assert(!missing.Open("assets/textures/missing.dds"));
+	assert(missing.GetData() == nullptr && missing.GetSize() == 0);
+}
+#endif
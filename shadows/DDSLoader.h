@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Parses DDS containers straight out of memory (usually a MappedFile) without
+// touching the texels. The result only points into the source bytes, which
+// must outlive it. Nothing here depends on D3D so it is testable anywhere.
+
+#define DDS_MAGIC 0x20534444 // "DDS "
+#define DDS_MAX_LEVELS 16
+// D3D11_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION, cubemaps count six slices per cube
+#define DDS_MAX_ARRAY_SIZE 2048
+// D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION, which 1D textures and cubemaps share, and D3D11_REQ_TEXTURE3D_U_V_OR_W_DIMENSION
+#define DDS_MAX_DIMENSION 16384
+#define DDS_MAX_VOLUME_DIMENSION 2048
+
+// DDSHeader::Flags
+#define DDSD_CAPS 0x1
+#define DDSD_HEIGHT 0x2
+#define DDSD_WIDTH 0x4
+#define DDSD_PITCH 0x8
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+#define DDSD_DEPTH 0x800000
+
+// DDSPixelFormat::Flags
+#define DDPF_ALPHAPIXELS 0x1
+#define DDPF_ALPHA 0x2
+#define DDPF_FOURCC 0x4
+#define DDPF_RGB 0x40
+#define DDPF_LUMINANCE 0x20000
+
+// DDSHeader::Caps and Caps2
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+#define DDSCAPS2_CUBEMAP 0x200
+#define DDSCAPS2_CUBEMAP_ALLFACES 0xfc00
+#define DDSCAPS2_VOLUME 0x200000
+
+// DDSHeaderDX10::MiscFlag
+#define DDS_RESOURCE_MISC_TEXTURECUBE 0x4
+
+#define DDS_FOURCC(a, b, c, d) ((uint32_t)(uint8_t)(a) | ((uint32_t)(uint8_t)(b) << 8) | ((uint32_t)(uint8_t)(c) << 16) | ((uint32_t)(uint8_t)(d) << 24))
+
+struct DDSPixelFormat
+{
+	uint32_t Size;
+	uint32_t Flags;
+	uint32_t FourCC;
+	uint32_t RGBBitCount;
+	uint32_t RBitMask;
+	uint32_t GBitMask;
+	uint32_t BBitMask;
+	uint32_t ABitMask;
+};
+
+// Follows the magic number
+struct DDSHeader
+{
+	uint32_t Size;
+	uint32_t Flags;
+	uint32_t Height;
+	uint32_t Width;
+	uint32_t PitchOrLinearSize;
+	uint32_t Depth;
+	uint32_t MipMapCount;
+	uint32_t Reserved1[11];
+	DDSPixelFormat PixelFormat;
+	uint32_t Caps;
+	uint32_t Caps2;
+	uint32_t Caps3;
+	uint32_t Caps4;
+	uint32_t Reserved2;
+};
+
+// Follows DDSHeader when the pixel format FourCC is "DX10"
+struct DDSHeaderDX10
+{
+	uint32_t Format;
+	uint32_t ResourceDimension;
+	uint32_t MiscFlag;
+	uint32_t ArraySize;
+	uint32_t MiscFlags2;
+};
+
+// Values of DXGI_FORMAT the parser knows the layout of, spelled out so this
+// header builds without the Windows SDK
+enum DDSFormat : uint32_t
+{
+	DDS_FORMAT_UNKNOWN = 0,
+	DDS_FORMAT_R32G32B32A32_FLOAT = 2,
+	DDS_FORMAT_R16G16B16A16_FLOAT = 10,
+	DDS_FORMAT_R16G16B16A16_UNORM = 11,
+	DDS_FORMAT_R32G32_FLOAT = 16,
+	DDS_FORMAT_R10G10B10A2_UNORM = 24,
+	DDS_FORMAT_R11G11B10_FLOAT = 26,
+	DDS_FORMAT_R8G8B8A8_UNORM = 28,
+	DDS_FORMAT_R8G8B8A8_UNORM_SRGB = 29,
+	DDS_FORMAT_R16G16_FLOAT = 34,
+	DDS_FORMAT_R16G16_UNORM = 35,
+	DDS_FORMAT_R32_FLOAT = 41,
+	DDS_FORMAT_R8G8_UNORM = 49,
+	DDS_FORMAT_R16_FLOAT = 54,
+	DDS_FORMAT_R16_UNORM = 56,
+	DDS_FORMAT_R8_UNORM = 61,
+	DDS_FORMAT_A8_UNORM = 65,
+	DDS_FORMAT_BC1_UNORM = 71,
+	DDS_FORMAT_BC1_UNORM_SRGB = 72,
+	DDS_FORMAT_BC2_UNORM = 74,
+	DDS_FORMAT_BC2_UNORM_SRGB = 75,
+	DDS_FORMAT_BC3_UNORM = 77,
+	DDS_FORMAT_BC3_UNORM_SRGB = 78,
+	DDS_FORMAT_BC4_UNORM = 80,
+	DDS_FORMAT_BC4_SNORM = 81,
+	DDS_FORMAT_BC5_UNORM = 83,
+	DDS_FORMAT_BC5_SNORM = 84,
+	DDS_FORMAT_B5G6R5_UNORM = 85,
+	DDS_FORMAT_B5G5R5A1_UNORM = 86,
+	DDS_FORMAT_B8G8R8A8_UNORM = 87,
+	DDS_FORMAT_B8G8R8X8_UNORM = 88,
+	DDS_FORMAT_B8G8R8A8_UNORM_SRGB = 91,
+	DDS_FORMAT_B8G8R8X8_UNORM_SRGB = 93,
+	DDS_FORMAT_BC6H_UF16 = 95,
+	DDS_FORMAT_BC6H_SF16 = 96,
+	DDS_FORMAT_BC7_UNORM = 98,
+	DDS_FORMAT_BC7_UNORM_SRGB = 99,
+	DDS_FORMAT_B4G4R4A4_UNORM = 115,
+};
+
+// Values of D3D11_RESOURCE_DIMENSION
+enum class DDSDimension : uint32_t
+{
+	Texture1D = 2,
+	Texture2D = 3,
+	Texture3D = 4,
+};
+
+enum class DDSStatus
+{
+	Ok = 0,
+	// magic number or header size do not match
+	NotDDS = 1,
+	// zero or inconsistent sizes, too many mips, non square cubemap...
+	BadHeader = 2,
+	UnsupportedFormat = 3,
+	// the file is shorter than its header says
+	Truncated = 4,
+};
+
+// One mip level of one array slice, pitches as D3D11_SUBRESOURCE_DATA expects them
+struct DDSSubresource
+{
+	const uint8_t* Data;
+	uint32_t RowPitch;
+	uint32_t SlicePitch;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t Depth;
+};
+
+struct DDSImage
+{
+	DDSImage() : Format{DDS_FORMAT_UNKNOWN}, Dimension{DDSDimension::Texture2D}, Width{0}, Height{0}, Depth{0},
+		NumLevels{0}, ArraySize{0}, IsCubemap{false} {}
+
+	const DDSSubresource& GetSubresource(uint32_t slice, uint32_t level) const { return Subresources[slice * NumLevels + level]; }
+
+	uint32_t Format;
+	DDSDimension Dimension;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t Depth;
+	uint32_t NumLevels;
+	// counts every face of a cubemap, 6 per cube
+	uint32_t ArraySize;
+	bool IsCubemap;
+	// slice major, the same order as D3D11CalcSubresource
+	std::vector<DDSSubresource> Subresources;
+};
+
+DDSStatus DDSParse(const uint8_t* data, size_t size, DDSImage* image);
+// Writes magic, header and DX10 header of a 2D texture, the texels follow in
+// DDSParse order. arraySize counts every face of a cubemap.
+#define DDS_DX10_HEADER_SIZE (sizeof(uint32_t) + sizeof(DDSHeader) + sizeof(DDSHeaderDX10))
+void DDSWriteHeader(uint32_t format, uint32_t width, uint32_t height, uint32_t numLevels, uint32_t arraySize,
+	bool cubemap, uint8_t out[DDS_DX10_HEADER_SIZE]);
+const char* DDSStatusString(DDSStatus status);
+
+// 0 for formats the parser does not know
+uint32_t DDSBitsPerPixel(uint32_t format);
+bool DDSIsBlockCompressed(uint32_t format);
+// Row pitch and rows of a level, block compressed rows are 4 texels high. The pitch
+// is 64 bit, it fits 32 bits for every image DDSParse accepts
+uint64_t DDSRowPitch(uint32_t format, uint32_t width);
+uint32_t DDSNumRows(uint32_t format, uint32_t height);
+
+#ifdef DDS_LOADER_TEST
+void DDSLoaderTest(void);
+#endif
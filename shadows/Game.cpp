@@ -3,8 +3,14 @@
 #include "Math.h"
 #include "Camera.h"
 #include "MeshGenerator.h"
+#include "DDSLoader.h"
+#include "ImageDecoder.h"
 
-static void GameUpdateConstantBuffer(ID3D11DeviceContext* context,
+#include <algorithm>
+#include <chrono>
+
+// Replaces the contents of a D3D11_USAGE_DYNAMIC buffer, constant, vertex or structured
+static void GameUpdateDynamicBuffer(ID3D11DeviceContext* context,
 	size_t bufferSize,
 	void* data,
 	ID3D11Buffer* dest)
@@ -17,7 +23,7 @@ static void GameUpdateConstantBuffer(ID3D11DeviceContext* context,
 		0,
 		&mapped)))
 	{
-		UtilsFatalError("ERROR: Failed to map constant buffer\n");
+		UtilsFatalError("ERROR: Failed to map dynamic buffer\n");
 	}
 	memcpy(mapped.pData, data, bufferSize);
 	context->Unmap((ID3D11Resource*)dest, 0);
@@ -39,6 +45,35 @@ static void GameCreateConstantBuffer(ID3D11Device* device,
 	}
 }
 
+// Buffer of count elements of stride bytes the pixel shader reads as a StructuredBuffer.
+// Dynamic ones are mapped by the CPU, default ones get their data through the upload rings.
+static void GameCreateStructuredBuffer(ID3D11Device* device,
+	D3D11_USAGE usage,
+	uint32_t stride,
+	uint32_t count,
+	const void* data,
+	ID3D11Buffer** buffer,
+	ID3D11ShaderResourceView** srv)
+{
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.ByteWidth = stride * count;
+	bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	bufferDesc.CPUAccessFlags = usage == D3D11_USAGE_DYNAMIC ? D3D11_CPU_ACCESS_WRITE : 0;
+	bufferDesc.Usage = usage;
+	bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	bufferDesc.StructureByteStride = stride;
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = data;
+	HR(device->CreateBuffer(&bufferDesc, data ? &initialData : NULL, buffer))
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.FirstElement = 0;
+	srvDesc.Buffer.NumElements = count;
+	HR(device->CreateShaderResourceView(*buffer, &srvDesc, srv))
+}
+
 static void GameCreatePixelShader(const char* filepath, ID3D11Device* device, ID3D11PixelShader** ps)
 {
 	unsigned int bufferSize = 0;
@@ -52,45 +87,67 @@ static void GameCreatePixelShader(const char* filepath, ID3D11Device* device, ID
 	free(bytes);
 }
 
-static void GameCreateInputLayout(ID3D11Device* device, ID3D11InputLayout** il, unsigned char* bytes, size_t bufferSize)
+static const D3D11_INPUT_ELEMENT_DESC GAME_INPUT_ELEMENT_DESC[] = {
+		{
+			"POSITION",
+			0,
+			DXGI_FORMAT_R32G32B32_FLOAT,
+			0,
+			0,
+			D3D11_INPUT_PER_VERTEX_DATA,
+			0
+		},
+		{
+			"NORMAL",
+			0,
+			DXGI_FORMAT_R32G32B32_FLOAT,
+			0,
+			sizeof(float) * 3,
+			D3D11_INPUT_PER_VERTEX_DATA,
+			0,
+		},
+		{
+			"TEXCOORDS",
+			0,
+			DXGI_FORMAT_R32G32_FLOAT,
+			0,
+			sizeof(float) * 3 * 2,
+			D3D11_INPUT_PER_VERTEX_DATA,
+			0
+		}
+};
+
+// Per-vertex elements of GAME_INPUT_ELEMENT_DESC followed by InstanceData from the second slot
+static const D3D11_INPUT_ELEMENT_DESC GAME_INSTANCED_INPUT_ELEMENT_DESC[] = {
+		GAME_INPUT_ELEMENT_DESC[0],
+		GAME_INPUT_ELEMENT_DESC[1],
+		GAME_INPUT_ELEMENT_DESC[2],
+		{ "WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, sizeof(float) * 4 * 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, sizeof(float) * 4 * 1, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, sizeof(float) * 4 * 2, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "WORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, sizeof(float) * 4 * 3, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+		{ "MATERIAL", 0, DXGI_FORMAT_R32_UINT, 1, sizeof(float) * 4 * 4, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+};
+
+static void GameCreateInputLayout(ID3D11Device* device,
+	ID3D11InputLayout** il,
+	unsigned char* bytes,
+	size_t bufferSize,
+	const D3D11_INPUT_ELEMENT_DESC* inputElementDesc,
+	uint32_t numElements)
 {
-	const D3D11_INPUT_ELEMENT_DESC inputElementDesc[] = {
-			{
-				"POSITION",
-				0,
-				DXGI_FORMAT_R32G32B32_FLOAT,
-				0,
-				0,
-				D3D11_INPUT_PER_VERTEX_DATA,
-				0
-			},
-			{
-				"NORMAL",
-				0,
-				DXGI_FORMAT_R32G32B32_FLOAT,
-				0,
-				sizeof(float) * 3,
-				D3D11_INPUT_PER_VERTEX_DATA,
-				0,
-			},
-			{
-				"TEXCOORDS",
-				0,
-				DXGI_FORMAT_R32G32_FLOAT,
-				0,
-				sizeof(float) * 3 * 2,
-				D3D11_INPUT_PER_VERTEX_DATA,
-				0
-			}
-	};
-
-	if (FAILED(device->CreateInputLayout(inputElementDesc, sizeof(inputElementDesc) / sizeof(*inputElementDesc), bytes, bufferSize, il)))
+	if (FAILED(device->CreateInputLayout(inputElementDesc, numElements, bytes, bufferSize, il)))
 	{
 		UtilsFatalError("Failed to create input layout");
 	}
 }
 
-static void GameCreateVertexShader(const char* filepath, ID3D11Device* device, ID3D11VertexShader** vs, ID3D11InputLayout** il)
+static void GameCreateVertexShader(const char* filepath,
+	ID3D11Device* device,
+	ID3D11VertexShader** vs,
+	ID3D11InputLayout** il,
+	const D3D11_INPUT_ELEMENT_DESC* inputElementDesc,
+	uint32_t numElements)
 {
 	unsigned int bufferSize = 0;
 	unsigned char* bytes = UtilsReadData(filepath, &bufferSize);
@@ -99,10 +156,26 @@ static void GameCreateVertexShader(const char* filepath, ID3D11Device* device, I
 	{
 		UTILS_FATAL_ERROR("Failed to create vertex shader from %s", filepath);
 	}
-	GameCreateInputLayout(device, il, bytes, bufferSize);
+	// shaders without vertex input have no layout
+	if (il)
+	{
+		GameCreateInputLayout(device, il, bytes, bufferSize, inputElementDesc, numElements);
+	}
 	free(bytes);
 }
 
+// FNV-1a, used to build batching keys out of resource pointers
+static uint64_t GameHashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
 static void GameCreateVertexBuffer(const void* vertexData, const uint32_t numVertices, ID3D11Device* device, ID3D11Buffer** vb)
 {
 	D3D11_SUBRESOURCE_DATA subresourceData = {};
@@ -139,6 +212,65 @@ static void GameCreateIndexBuffer(const void* indexData, const uint32_t numIndic
 	}
 }
 
+void Game::CreateInstanceBuffer(uint32_t capacity)
+{
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.ByteWidth = sizeof(InstanceData) * capacity;
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+
+	HR(m_DR->GetDevice()->CreateBuffer(&bufferDesc, NULL, m_InstanceBuffer.ReleaseAndGetAddressOf()))
+	m_InstanceBufferCapacity = capacity;
+}
+
+// Whole slices of the first array, the layout of textures that are not packed
+MaterialTextures::MaterialTextures()
+{
+	for (uint32_t slot = 0; slot < ACTOR_NUM_TEXTURES; ++slot)
+	{
+		ScaleOffset[slot][0] = 1.0f;
+		ScaleOffset[slot][1] = 1.0f;
+		ScaleOffset[slot][2] = 0.0f;
+		ScaleOffset[slot][3] = 0.0f;
+		Slice[slot] = 0.0f;
+		MaxLevel[slot] = (float)TEXTURE_STREAMER_MAX_LEVELS;
+	}
+}
+
+uint32_t Game::RegisterMaterial(const Material& material, const MaterialTextures& textures)
+{
+	for (uint32_t i = 0; i < m_Materials.size(); ++i)
+	{
+		if (memcmp(&m_Materials[i], &material, sizeof(Material)) == 0 &&
+			memcmp(&m_MaterialTextures[i], &textures, sizeof(MaterialTextures)) == 0)
+		{
+			return i;
+		}
+	}
+
+	if (m_Materials.size() >= GAME_MAX_MATERIALS)
+	{
+		UTILS_FATAL_ERROR("Material limit of %d is reached", GAME_MAX_MATERIALS);
+	}
+	m_PerMaterialData.materials[m_Materials.size()] = material;
+	m_PerMaterialData.textures[m_Materials.size()] = textures;
+	m_Materials.emplace_back(material);
+	m_MaterialTextures.emplace_back(textures);
+	return (uint32_t)m_Materials.size() - 1;
+}
+
+static Mat4X4 GameComposeWorld(float scale, const Vec3D& rotation, const Vec3D& offset)
+{
+	const Vec3D scales = { scale, scale, scale };
+	const Mat4X4 scaleMat = MathMat4X4ScaleFromVec3D(&scales);
+	const Mat4X4 rotMat = MathMat4X4RotateFromVec3D(&rotation);
+	const Mat4X4 offsetMat = MathMat4X4TranslateFromVec3D(&offset);
+	Mat4X4 world = MathMat4X4MultMat4X4ByMat4X4(&scaleMat, &rotMat);
+	world = MathMat4X4MultMat4X4ByMat4X4(&world, &offsetMat);
+	return world;
+}
+
 void Game::CreateDefaultSampler()
 {
 	D3D11_SAMPLER_DESC samplerDesc = {};
@@ -168,7 +300,8 @@ void Game::InitPerSceneConstants()
 		{4.0f, 1.5f, -4.0f},
 	};
 
-	for (uint32_t i = 0; i < 4; ++i)
+	m_Lights.Clear();
+	for (uint32_t i = 0; i < _countof(positions); ++i)
 	{
 		pl.Position = positions[i];
 		pl.Ambient = ColorFromRGBA(0.3f, 0.3f, 0.3f, 1.0f);
@@ -176,7 +309,20 @@ void Game::InitPerSceneConstants()
 		pl.Specular = ColorFromRGBA(0.2f, 0.2f, 0.2f, 1.0f);
 		pl.Att = MathVec3DFromXYZ(1.0f, 0.09f, 0.032f);
 		pl.Range = 5.0f;
-		m_PerSceneData.pointLights[i] = pl;
+		m_Lights.AddPointLight(pl);
+	}
+
+	// dim colored lights close to the floor, each reaches only a few clusters
+	for (uint32_t i = 0; i < GAME_NUM_SCATTERED_LIGHTS; ++i)
+	{
+		pl.Position = MathVec3DFromXYZ(MathRandom(-4.5f, 4.5f), GAME_SCATTERED_LIGHTS_HEIGHT, MathRandom(-4.5f, 4.5f));
+		pl.Ambient = ColorFromRGBA(0.0f, 0.0f, 0.0f, 1.0f);
+		pl.Diffuse = ColorFromRGBA(MathRandom(0.0f, 0.4f), MathRandom(0.0f, 0.4f), MathRandom(0.0f, 0.4f), 1.0f);
+		pl.Specular = ColorFromRGBA(0.1f, 0.1f, 0.1f, 1.0f);
+		pl.Att = MathVec3DFromXYZ(1.0f, 0.7f, 1.8f);
+		pl.Range = 1.5f;
+		const uint32_t index = m_Lights.AddPointLight(pl);
+		m_FirstScatteredLight = i == 0 ? index : m_FirstScatteredLight;
 	}
 
 	DirectionalLight dirLight = {};
@@ -194,18 +340,70 @@ void Game::InitPerSceneConstants()
 	spotLight.Specular = ColorFromRGBA(1.0f, 1.0f, 1.0f, 1.0f);
 	spotLight.Att = MathVec3DFromXYZ(1.0f, 0.09f, 0.032f);
 	spotLight.Range = 5.0f;
-	m_PerSceneData.spotLights[0] = spotLight;
+	spotLight.Spot = 8.0f;
+	m_Lights.AddSpotLight(spotLight);
 }
 
+#if defined(TEXTURE_LOADER_BENCHMARK) || defined(BLOCK_COMPRESSOR_BENCHMARK)
+static const char* GAME_BENCHMARK_TEXTURES[] = {
+	"assets/textures/bricks_diffuse.jpg",
+	"assets/textures/bricks_gloss.jpg",
+	"assets/textures/bricks_normal.png",
+	"assets/textures/bricks_reflection.jpg",
+	"assets/textures/chess.jpg",
+	"assets/textures/cliff_diffuse.jpg",
+	"assets/textures/cliff_gloss.jpg",
+	"assets/textures/cliff_normal.jpg",
+	"assets/textures/cliff_reflection.jpg",
+	"assets/textures/drywall_diffuse.jpg",
+	"assets/textures/drywall_gloss.jpg",
+	"assets/textures/drywall_normal.png",
+	"assets/textures/drywall_reflection.jpg",
+	"assets/textures/marble_diffuse.jpg",
+	"assets/textures/marble_gloss.jpg",
+	"assets/textures/marble_normal.png",
+	"assets/textures/marble_reflection.jpg",
+};
+#endif
+
+#ifdef TEXTURE_LOADER_BENCHMARK
+static const char* GAME_BENCHMARK_DDS_TEXTURES[] = {
+	"assets/textures/snow.dds",
+	"assets/textures/flare0.dds",
+};
+#endif
+
 Game::Game():
-	m_Camera{ {0.0f, 0.0f, -5.0f} }
+	m_Timer{},
+	m_Camera{ {0.0f, 0.0f, -5.0f} },
+	m_PropsNode{TRANSFORM_INVALID_NODE},
+	m_PropsAngle{0.0f},
+	m_ShadowRedraw{},
+	m_NumShadowCasters{UINT32_MAX},
+	m_ShadowStatsMillis{GAME_SHADOW_STATS_INTERVAL_MILLIS},
+	m_InvalidateAtlasShadows{false},
+	m_LightBufferCapacities{},
+	m_FirstScatteredLight{0},
+	m_LightsTime{0.0f},
+	m_LightIndexCapacity{0},
+	m_InstanceBufferCapacity{0},
+	m_NumDrawCallsSaved{0},
+	m_NumTextureBinds{0}
 {
-	memset(this, 0, sizeof(Game));
 	m_DR = std::make_unique<DeviceResources>();
 }
 
 Game::~Game()
 {
+	for (TextureHandle handle : m_TextureHandles)
+	{
+		m_TextureCache.Release(handle);
+	}
+
+	// totals of the whole run, the passes only print their own per frame line
+	m_ShadowCache.PrintStats();
+	m_ShadowAtlas.PrintStats();
+	m_Lights.PrintStats();
 }
 
 void Game::Clear()
@@ -226,6 +424,8 @@ void Game::Clear()
 
 void Game::Update()
 {
+	m_Textures.Update(GAME_MAX_TEXTURE_UPLOADS_PER_FRAME);
+
 	m_Camera.UpdatePos(m_Timer.DeltaMillis);
 	m_Camera.ProcessMouse(m_Timer.DeltaMillis);
 
@@ -233,10 +433,27 @@ void Game::Update()
 	const float height = (float)m_DR->GetBackBufferHeight();
 	
 	m_PerFrameData.view = m_Camera.GetViewMat();
-	m_PerFrameData.proj = MathMat4X4PerspectiveFov(MathToRadians(45.0f), width / height, 0.1f, 100.0f);;
+	m_PerFrameData.proj = MathMat4X4PerspectiveFov(MathToRadians(GAME_FOV_DEGREES), width / height, GAME_NEAR_Z, GAME_FAR_Z);
 	m_PerFrameData.cameraPosW = m_Camera.GetPos();
 
-	GameUpdateConstantBuffer(m_DR->GetDeviceContext(), sizeof(PerFrameConstants), &m_PerFrameData, m_PerFrameCB.Get());
+	UpdateTransforms();
+	AnimateLights();
+	m_Scene.UpdateBounds();
+	const Mat4X4 viewProj = MathMat4X4MultMat4X4ByMat4X4(&m_PerFrameData.view, &m_PerFrameData.proj);
+	const Frustum frustum = MathFrustumFromMat4X4(&viewProj);
+	m_VisibleEntities.clear();
+	m_Scene.Cull(frustum, &m_VisibleEntities);
+	UpdateShadowView();
+	UpdateAtlasShadows(frustum);
+	UpdateLightClusters();
+
+	GameUpdateDynamicBuffer(m_DR->GetDeviceContext(), sizeof(PerFrameConstants), &m_PerFrameData, m_PerFrameCB.Get());
+
+	RequestTextureLevels();
+	m_Textures.UpdateStreaming();
+	UploadLights();
+	// records the copies of everything queued above before the frame draws
+	m_Uploads.Update();
 
 	// update directional light
 	//static float elapsedTime = 0.0f;
@@ -247,43 +464,490 @@ void Game::Update()
 
 	//m_PerSceneData.spotLights[0].Position = m_Camera.CameraPos;
 	//m_PerSceneData.spotLights[0].Direction = m_Camera.FocusPoint;
-	//GameUpdateConstantBuffer(m_DR->GetDeviceContext(), sizeof(PerSceneConstants), &m_PerSceneData, m_PerSceneCB);
+	//GameUpdateDynamicBuffer(m_DR->GetDeviceContext(), sizeof(PerSceneConstants), &m_PerSceneData, m_PerSceneCB);
 }
 
-void Game::Render()
+void Game::UpdateTransforms()
 {
+	// spin the props around the scene center through their group node
+	m_PropsAngle += GAME_PROPS_SPIN_SPEED * (float)m_Timer.DeltaMillis / 1000.0f;
+	m_Transforms.SetLocal(m_PropsNode, MathMat4X4RotateY(m_PropsAngle));
+	m_Transforms.Update(&m_Jobs);
 
-	//m_ShadowMap.Bind(m_DR->GetDeviceContext());
-	//{
-	//	m_Renderer.BindVertexShader(m_VS.Get());
-	//	m_Renderer.BindPixelShader(nullptr);
-	//	m_Renderer.BindConstantBuffer(BindTargets::VertexShader, m_PerFrameCB.Get(), 1);
-	//	m_Renderer.BindConstantBuffer(BindTargets::VertexShader, m_PerSceneCB.Get(), 2);
-
-	//	for (size_t i = 0; i < m_Actors.size(); ++i)
-	//	{
-	//		const Actor& actor = m_Actors[i];
-	//		m_PerObjectData.world = actor.GetWorld();
-	//		m_PerObjectData.material = actor.GetMaterial();
-	//		GameUpdateConstantBuffer(m_DR->GetDeviceContext(),
-	//			sizeof(PerObjectConstants),
-	//			&m_PerObjectData,
-	//			m_PerObjectCB.Get());
-	//		m_Renderer.BindConstantBuffer(BindTargets::VertexShader, m_PerObjectCB.Get(), 0);
-	//		m_Renderer.BindConstantBuffer(BindTargets::PixelShader, m_PerObjectCB.Get(), 0);
-
-	//		m_Renderer.DrawIndexed(actor.GetIndexBuffer(), actor.GetVertexBuffer(),
-	//			sizeof(Vertex),
-	//			actor.GetNumIndices(),
-	//			0,
-	//			0);
-	//	}
-	//}
+	for (const TransformBinding& binding : m_TransformBindings)
+	{
+		if (m_Transforms.WasUpdated(binding.Node))
+		{
+			m_Scene.SetWorld(binding.Entity, m_Transforms.GetWorld(binding.Node));
+			// the static shadow layers still show it where it was
+			if (!m_DynamicEntities[m_Scene.GetDenseIndex(binding.Entity)])
+			{
+				m_ShadowCache.Invalidate();
+				m_InvalidateAtlasShadows = true;
+			}
+		}
+	}
+}
+
+// Every visible entity asks for the mips its screen size needs, entities of the same model share the textures
+void Game::RequestTextureLevels()
+{
+	const std::vector<AABB>& bounds = m_Scene.GetWorldBounds();
+	const std::vector<uint32_t>& meshIds = m_Scene.GetMeshIds();
+	const Vec3D eye = m_Camera.GetPos();
+	const float fov = MathToRadians(GAME_FOV_DEGREES);
+	const uint32_t screenHeight = m_DR->GetBackBufferHeight();
+
+	for (uint32_t entity : m_VisibleEntities)
+	{
+		const uint32_t meshId = meshIds[entity];
+		if (meshId >= m_ModelTextureStreams.size())
+		{
+			continue;
+		}
+		for (uint32_t stream : m_ModelTextureStreams[meshId])
+		{
+			float priority = 0.0f;
+			const float level = TextureStreamerComputeLevel(bounds[entity], eye, fov, screenHeight, m_Textures.GetStreamedSize(stream), &priority);
+			m_Textures.RequestLevel(stream, level, priority);
+		}
+	}
+}
+
+// The camera range up to GAME_SHADOW_DISTANCE is split into cascades, each
+// refitted every frame around its slice of the view frustum. Casters are the
+// entities that can throw a shadow into a slice, the depth range then shrinks
+// to the visible receivers in the cascade and the casters in front of them.
+// The shadow cache decides what of each cascade has to be drawn again.
+void Game::UpdateShadowView()
+{
+	const float width = (float)m_DR->GetBackBufferWidth();
+	const float height = (float)m_DR->GetBackBufferHeight();
+	const float fov = MathToRadians(GAME_FOV_DEGREES);
+	const float shadowDistance = fminf(GAME_SHADOW_DISTANCE, GAME_FAR_Z);
+	ShadowViewComputeSplits(GAME_NEAR_Z, shadowDistance, SHADOW_MAP_NUM_CASCADES, SHADOW_VIEW_DEFAULT_SPLIT_LAMBDA,
+		m_PerFrameData.cascadeEnds);
+
+	m_ShadowCache.BeginFrame();
+#if !GAME_CACHE_SHADOWS
+	m_ShadowCache.Invalidate();
+#endif
+
+	const std::vector<AABB>& bounds = m_Scene.GetWorldBounds();
+	const AABB casters = ShadowViewBounds(bounds.data(), nullptr, m_Scene.GetNumEntities());
+	float sliceBegin = GAME_NEAR_Z;
+	for (uint32_t cascade = 0; cascade < SHADOW_MAP_NUM_CASCADES; ++cascade)
+	{
+		Vec3D corners[8];
+		ShadowViewFrustumCorners(m_PerFrameData.view, fov, width / height, sliceBegin, m_PerFrameData.cascadeEnds[cascade], corners);
+		sliceBegin = m_PerFrameData.cascadeEnds[cascade];
+
+		m_ShadowViews[cascade] = ShadowViewFitCascade(m_PerSceneData.dirLight.Direction, corners, GAME_SHADOW_MAP_SIZE, casters);
+		std::vector<uint32_t>& cascadeCasters = m_ShadowCasters[cascade];
+		cascadeCasters.clear();
+		m_Scene.Cull(m_ShadowViews[cascade].CasterFrustum, &cascadeCasters);
+		const uint32_t numCasters = ShadowViewFitDepth(&m_ShadowViews[cascade], bounds.data(),
+			m_VisibleEntities.data(), (uint32_t)m_VisibleEntities.size(),
+			cascadeCasters.data(), (uint32_t)cascadeCasters.size());
+		cascadeCasters.resize(numCasters);
+
+		// a cached view that still holds this frame's depth range replaces the fitted one
+		ShadowView& view = m_ShadowViews[cascade];
+		m_ShadowRedraw[cascade] = m_ShadowCache.BeginCascade(cascade, &view);
+		if (m_ShadowRedraw[cascade])
+		{
+			// the layer is kept for later frames, so it takes every static caster of the view and not only those of the visible receivers
+			std::vector<uint32_t>& staticCasters = m_StaticShadowCasters[cascade];
+			staticCasters.clear();
+			m_Scene.Cull(view.CasterFrustum, &staticCasters);
+			staticCasters.erase(std::remove_if(staticCasters.begin(), staticCasters.end(),
+				[this](uint32_t entityIdx) { return m_DynamicEntities[entityIdx] != 0; }), staticCasters.end());
+		}
+		m_DynamicShadowCasters[cascade].clear();
+		m_DynamicShadowRects[cascade].clear();
+		for (const uint32_t entityIdx : cascadeCasters)
+		{
+			if (!m_DynamicEntities[entityIdx])
+			{
+				continue;
+			}
+			const ShadowRect rect = m_ShadowCache.AddDynamic(cascade, bounds[entityIdx]);
+			if (!ShadowRectIsEmpty(rect))
+			{
+				m_DynamicShadowCasters[cascade].push_back(entityIdx);
+				m_DynamicShadowRects[cascade].push_back(rect);
+			}
+		}
+		m_ShadowCache.EndCascade(cascade);
+		m_PerFrameData.shadowViewProj[cascade] = view.ViewProj;
+	}
+}
+
+// Half angle at which the falloff of a spot light drops below a hundredth, as a field of view for its shadow
+static float GameSpotShadowFov(float spot)
+{
+	const float maxFov = MathToRadians(120.0f);
+	const float fov = 2.0f * LightCullerSpotAngle(spot);
+	return fov < maxFov ? fov : maxFov;
+}
+
+// Index into lightShadows of the per frame constants, the faces of the point lights come before the spot lights
+static uint32_t GameShadowFaceIndex(uint32_t light, uint32_t face)
+{
+	return light < GAME_NUM_SHADOWED_POINT_LIGHTS ? light * SHADOW_ATLAS_NUM_CUBE_FACES + face :
+		GAME_NUM_SHADOWED_POINT_LIGHTS * SHADOW_ATLAS_NUM_CUBE_FACES + light - GAME_NUM_SHADOWED_POINT_LIGHTS;
+}
+
+static bool GameAABBsOverlap(const AABB& lhs, const AABB& rhs)
+{
+	return lhs.Min.X <= rhs.Max.X && rhs.Min.X <= lhs.Max.X &&
+		lhs.Min.Y <= rhs.Max.Y && rhs.Min.Y <= lhs.Max.Y &&
+		lhs.Min.Z <= rhs.Max.Z && rhs.Min.Z <= lhs.Max.Z;
+}
+
+// Point and spot lights get slots of the shadow atlas after how much of the
+// screen their range covers, a point light one for each face of its cube. A
+// light is drawn again when a moving entity is in its range; the atlas only
+// draws a budget of faces per frame and picks the most urgent ones.
+void Game::UpdateAtlasShadows(const Frustum& frustum)
+{
+	const Vec3D eye = m_Camera.GetPos();
+	const float fov = MathToRadians(GAME_FOV_DEGREES);
+	const uint32_t screenHeight = m_DR->GetBackBufferHeight();
+	const std::vector<AABB>& bounds = m_Scene.GetWorldBounds();
+	const std::vector<PointLight>& pointLights = m_Lights.GetPointLights();
+	const std::vector<SpotLight>& spotLights = m_Lights.GetSpotLights();
+
+	ShadowAtlasLight lights[GAME_NUM_SHADOW_LIGHTS] = {};
+	float importance[GAME_NUM_SHADOW_LIGHTS] = {};
+	for (uint32_t light = 0; light < GAME_NUM_SHADOW_LIGHTS; ++light)
+	{
+		const bool isPoint = light < GAME_NUM_SHADOWED_POINT_LIGHTS;
+		lights[light].NumFaces = isPoint ? SHADOW_ATLAS_NUM_CUBE_FACES : 1;
+		// a scene with fewer lights leaves their slots empty
+		const uint32_t sceneLight = isPoint ? light : light - GAME_NUM_SHADOWED_POINT_LIGHTS;
+		if (sceneLight >= (isPoint ? pointLights.size() : spotLights.size()))
+		{
+			continue;
+		}
+		const SpotLight* spot = isPoint ? nullptr : &spotLights[sceneLight];
+		const Vec3D position = isPoint ? pointLights[light].Position : spot->Position;
+		const float range = isPoint ? pointLights[light].Range : spot->Range;
+
+		lights[light].Changed = m_InvalidateAtlasShadows;
+		const Vec3D extents = { range, range, range };
+		const AABB reach = { MathVec3DSubtraction(&position, &extents), MathVec3DAddition(&position, &extents) };
+		for (uint32_t entityIdx = 0; entityIdx < m_Scene.GetNumEntities() && !lights[light].Changed; ++entityIdx)
+		{
+			lights[light].Changed = m_DynamicEntities[entityIdx] && GameAABBsOverlap(reach, bounds[entityIdx]);
+		}
+		importance[light] = ShadowAtlasLightImportance(position, range, eye, frustum, fov, screenHeight);
+
+		for (uint32_t face = 0; face < lights[light].NumFaces; ++face)
+		{
+			const uint32_t index = GameShadowFaceIndex(light, face);
+			const float zFar = fmaxf(range, 2.0f * GAME_LIGHT_SHADOW_NEAR_Z);
+			m_AtlasShadowViews[index] = isPoint ?
+				ShadowViewFitPerspective(position, ShadowViewCubeFaceDirection(face), MathToRadians(90.0f), GAME_LIGHT_SHADOW_NEAR_Z, zFar) :
+				ShadowViewFitPerspective(position, spot->Direction, GameSpotShadowFov(spot->Spot), GAME_LIGHT_SHADOW_NEAR_Z, zFar);
+		}
+	}
+	m_InvalidateAtlasShadows = false;
+	m_ShadowAtlas.Update(lights, importance, GAME_NUM_SHADOW_LIGHTS);
+
+	for (uint32_t light = 0; light < GAME_NUM_SHADOW_LIGHTS; ++light)
+	{
+		for (uint32_t face = 0; face < lights[light].NumFaces; ++face)
+		{
+			const uint32_t index = GameShadowFaceIndex(light, face);
+			ShadowSlot& dest = m_PerFrameData.lightShadows[index];
+			dest.viewProj = m_AtlasShadowViews[index].ViewProj;
+			ShadowAtlasSlot slot = {};
+			// a face without a shadow drawn gets a zero size and stays lit
+			const bool ready = m_ShadowAtlas.GetSlot(light, face, &slot);
+			dest.rect[0] = (float)slot.X / GAME_SHADOW_ATLAS_SIZE;
+			dest.rect[1] = (float)slot.Y / GAME_SHADOW_ATLAS_SIZE;
+			dest.rect[2] = ready ? (float)slot.Size / GAME_SHADOW_ATLAS_SIZE : 0.0f;
+			dest.rect[3] = dest.rect[2];
+		}
+	}
+}
+
+// Some of the scattered lights bob over the floor, only they go up to the light buffer every frame
+void Game::AnimateLights()
+{
+	m_LightsTime += (float)m_Timer.DeltaMillis / 1000.0f;
+	const std::vector<PointLight>& pointLights = m_Lights.GetPointLights();
+	for (uint32_t i = 0; i < GAME_NUM_SCATTERED_LIGHTS; i += GAME_BOBBING_LIGHTS_STRIDE)
+	{
+		const uint32_t index = m_FirstScatteredLight + i;
+		if (index >= pointLights.size())
+		{
+			break;
+		}
+		PointLight light = pointLights[index];
+		light.Position.Y = GAME_SCATTERED_LIGHTS_HEIGHT + GAME_BOBBING_LIGHTS_AMPLITUDE * sinf(m_LightsTime + (float)i);
+		m_Lights.SetPointLight(index, light);
+	}
+}
+
+// The lights that changed go through the upload rings. A light buffer that
+// ran out of room is created again at the new capacity and filled in full.
+void Game::UploadLights()
+{
+	bool resized[LightStoreNumArrays] = {};
+	for (uint32_t array = 0; array < LightStoreNumArrays; ++array)
+	{
+		const uint32_t capacity = m_Lights.GetCapacity((LightStoreArray)array);
+		if (capacity == m_LightBufferCapacities[array])
+		{
+			continue;
+		}
+		const bool isPoint = array == LightStorePoint;
+		Microsoft::WRL::ComPtr<ID3D11Buffer>& buffer = isPoint ? m_PointLightBuffer : m_SpotLightBuffer;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>& srv = isPoint ? m_PointLightSRV : m_SpotLightSRV;
+		GameCreateStructuredBuffer(m_DR->GetDevice(), D3D11_USAGE_DEFAULT, isPoint ? sizeof(PointLight) : sizeof(SpotLight), capacity, nullptr,
+			buffer.ReleaseAndGetAddressOf(), srv.ReleaseAndGetAddressOf());
+		m_LightBufferCapacities[array] = capacity;
+		resized[array] = true;
+	}
+
+	m_Lights.CollectUploads(resized, &m_LightUploads);
+	for (const LightStoreUpload& upload : m_LightUploads)
+	{
+		ID3D11Buffer* buffer = upload.Array == LightStorePoint ? m_PointLightBuffer.Get() : m_SpotLightBuffer.Get();
+		m_Uploads.UploadBuffer(buffer, upload.Offset, upload.Data, upload.Size);
+	}
+}
+
+void Game::CreateLightIndexBuffer(uint32_t capacity)
+{
+	GameCreateStructuredBuffer(m_DR->GetDevice(), D3D11_USAGE_DYNAMIC, sizeof(uint32_t), capacity, nullptr,
+		m_LightIndexBuffer.ReleaseAndGetAddressOf(), m_LightIndexSRV.ReleaseAndGetAddressOf());
+	m_LightIndexCapacity = capacity;
+}
+
+// Bins the point and spot lights into the clusters of the view. The pixel
+// shader finds its cluster from the grid in the per frame constants and only
+// walks the lights listed for it.
+void Game::UpdateLightClusters()
+{
+	const std::vector<PointLight>& pointLights = m_Lights.GetPointLights();
+	const std::vector<SpotLight>& spotLights = m_Lights.GetSpotLights();
+	m_LightCuller.Cull(m_PerFrameData.view, pointLights.data(), (uint32_t)pointLights.size(),
+		spotLights.data(), (uint32_t)spotLights.size());
+	m_PerFrameData.clusterGrid[0] = m_LightCuller.GetNumTilesX();
+	m_PerFrameData.clusterGrid[1] = m_LightCuller.GetNumTilesY();
+	m_PerFrameData.clusterGrid[2] = LIGHT_CULLER_NUM_SLICES;
+	m_PerFrameData.clusterGrid[3] = LIGHT_CULLER_TILE_SIZE;
+	m_PerFrameData.clusterDepth[0] = m_LightCuller.GetDepthScale();
+	m_PerFrameData.clusterDepth[1] = m_LightCuller.GetDepthBias();
+
+	const std::vector<LightCluster>& clusters = m_LightCuller.GetClusters();
+	const std::vector<uint32_t>& indices = m_LightCuller.GetIndices();
+	if (indices.size() > m_LightIndexCapacity)
+	{
+		uint32_t capacity = m_LightIndexCapacity;
+		while (capacity < indices.size())
+		{
+			capacity *= 2;
+		}
+		CreateLightIndexBuffer(capacity);
+	}
+	GameUpdateDynamicBuffer(m_DR->GetDeviceContext(), sizeof(LightCluster) * clusters.size(), (void*)clusters.data(),
+		m_LightClusterBuffer.Get());
+	GameUpdateDynamicBuffer(m_DR->GetDeviceContext(), sizeof(uint32_t) * indices.size(), (void*)indices.data(),
+		m_LightIndexBuffer.Get());
+}
+
+static void GameSetScissor(ID3D11DeviceContext* ctx, const ShadowRect& rect)
+{
+	const D3D11_RECT scissor = { (LONG)rect.MinX, (LONG)rect.MinY, (LONG)rect.MaxX, (LONG)rect.MaxY };
+	ctx->RSSetScissorRects(1, &scissor);
+}
+
+// Depth only pass of the casters into every cascade. A redrawn static layer
+// is copied over the live map whole, otherwise only the dirty rects are
+// restored from it. The dynamic casters are then drawn into the dirty rects.
+void Game::RenderShadowMap()
+{
+	ID3D11DeviceContext* ctx = m_DR->GetDeviceContext();
+
+	m_Renderer.SetRasterizerState(m_ShadowMap.GetRasterizerState());
+	m_Renderer.BindConstantBuffer(BindTargets::VertexShader, m_ShadowPassCB.Get(), 0);
+	m_Renderer.BindShaderResource(BindTargets::PixelShader, nullptr, SHADOW_MAP_SRV_SLOT);
+
+	uint32_t numCasters = 0;
+	for (uint32_t cascade = 0; cascade < SHADOW_MAP_NUM_CASCADES; ++cascade)
+	{
+		const std::vector<ShadowRect>& dirtyRects = m_ShadowCache.GetDirtyRects(cascade);
+		numCasters += (uint32_t)m_ShadowCasters[cascade].size();
+		if (dirtyRects.empty())
+		{
+			m_ShadowCache.CountDraws((uint32_t)m_ShadowCasters[cascade].size(), 0);
+			continue;
+		}
+		GameUpdateDynamicBuffer(ctx, sizeof(Mat4X4), &m_ShadowViews[cascade].ViewProj, m_ShadowPassCB.Get());
+
+		uint32_t numDrawn = 0;
+		if (m_ShadowRedraw[cascade])
+		{
+			m_ShadowMap.BindStatic(ctx, cascade);
+			GameSetScissor(ctx, dirtyRects[0]);
+			numDrawn += DrawShadowCasters(m_StaticShadowCasters[cascade]);
+			ctx->OMSetRenderTargets(0, 0, nullptr);
+			m_ShadowMap.CopyStaticToLive(ctx, cascade);
+		}
+
+		m_ShadowMap.BindLive(ctx, cascade);
+		const std::vector<uint32_t>& dynamicCasters = m_DynamicShadowCasters[cascade];
+		const std::vector<ShadowRect>& dynamicRects = m_DynamicShadowRects[cascade];
+		for (const ShadowRect& rect : dirtyRects)
+		{
+			GameSetScissor(ctx, rect);
+			if (!m_ShadowRedraw[cascade])
+			{
+				RestoreShadowRect(cascade);
+			}
+			m_RectShadowCasters.clear();
+			for (size_t i = 0; i < dynamicCasters.size(); ++i)
+			{
+				if (ShadowRectsOverlap(dynamicRects[i], rect))
+				{
+					m_RectShadowCasters.push_back(dynamicCasters[i]);
+				}
+			}
+			numDrawn += DrawShadowCasters(m_RectShadowCasters);
+		}
+		m_ShadowCache.CountDraws((uint32_t)m_ShadowCasters[cascade].size(), numDrawn);
+	}
+
+	m_ShadowStatsMillis += m_Timer.DeltaMillis;
+	if (m_NumShadowCasters != numCasters && m_ShadowStatsMillis >= GAME_SHADOW_STATS_INTERVAL_MILLIS)
+	{
+		m_NumShadowCasters = numCasters;
+		m_ShadowStatsMillis = 0.0;
+		UtilsDebugPrint("Shadows: %u casters of %u entities in %u cascades, %u drawn and %u skipped this frame\n",
+			m_NumShadowCasters,
+			m_Scene.GetNumEntities(),
+			SHADOW_MAP_NUM_CASCADES,
+			m_ShadowCache.GetNumDrawn(),
+			m_ShadowCache.GetNumSkipped());
+	}
+
+	m_Renderer.SetRasterizerState(m_DR->GetRasterizerState());
+}
+
+// Instances are batched by mesh alone since materials do not matter here, returns the number of casters drawn
+uint32_t Game::DrawShadowCasters(const std::vector<uint32_t>& casters)
+{
+	const std::vector<Mat4X4>& worlds = m_Scene.GetWorlds();
+	const std::vector<uint32_t>& meshIds = m_Scene.GetMeshIds();
+
+	m_ShadowBatcher.Begin();
+	for (const uint32_t entityIdx : casters)
+	{
+		const MeshAllocation& geometry = m_Models[meshIds[entityIdx]].GetGeometry();
+		if (!geometry.IsValid())
+		{
+			continue;
+		}
+		const uint64_t meshKey = ((uint64_t)geometry.Page << 32) | geometry.StartIndex;
+		m_ShadowBatcher.Add(meshKey, 0, 0, worlds[entityIdx]);
+	}
+	m_ShadowBatcher.Build();
+
+	const std::vector<InstanceData>& instances = m_ShadowBatcher.GetInstances();
+	if (instances.empty())
+	{
+		return 0;
+	}
+	UploadInstances(instances);
+
+	m_Renderer.SetInputLayout(m_ShadowInputLayout.Get());
+	m_Renderer.BindVertexShader(m_ShadowVS.Get());
+	m_Renderer.BindPixelShader(nullptr);
+	m_Renderer.BindShaderResource(BindTargets::PixelShader, nullptr, SHADOW_MAP_STATIC_SRV_SLOT);
+
+	for (const InstanceBatch& batch : m_ShadowBatcher.GetBatches())
+	{
+		const Actor& actor = m_Models[meshIds[casters[batch.ItemIdx]]];
+		m_Renderer.DrawIndexedInstanced(actor.GetIndexBuffer(), actor.GetVertexBuffer(),
+			sizeof(Vertex),
+			m_InstanceBuffer.Get(),
+			sizeof(InstanceData),
+			actor.GetNumIndices(),
+			batch.NumInstances,
+			actor.GetStartIndex(),
+			actor.GetBaseVertex(),
+			batch.FirstInstance);
+	}
+	return m_ShadowBatcher.GetNumItems();
+}
+
+// Copies the static layer into the live map inside the current scissor rect
+void Game::RestoreShadowRect(uint32_t cascade)
+{
+	ID3D11DeviceContext* ctx = m_DR->GetDeviceContext();
+
+	m_Renderer.SetInputLayout(nullptr);
+	m_Renderer.BindVertexShader(m_ShadowRestoreVS.Get());
+	m_Renderer.BindPixelShader(m_ShadowRestorePS.Get());
+	m_Renderer.BindShaderResource(BindTargets::PixelShader, m_ShadowMap.GetStaticShaderResourceView(cascade), SHADOW_MAP_STATIC_SRV_SLOT);
+	ctx->OMSetDepthStencilState(m_ShadowMap.GetRestoreDepthState(), 0);
+	m_Renderer.Draw(3);
+	ctx->OMSetDepthStencilState(nullptr, 0);
+}
+
+// Every face the atlas picked this frame is cleared inside its slot and its
+// casters are drawn into it, depth only like the cascades
+void Game::RenderAtlasShadows()
+{
+	const std::vector<ShadowAtlasRender>& renders = m_ShadowAtlas.GetRenders();
+	if (renders.empty())
+	{
+		return;
+	}
+	ID3D11DeviceContext* ctx = m_DR->GetDeviceContext();
+
+	m_Renderer.SetRasterizerState(m_ShadowMap.GetRasterizerState());
+	m_Renderer.BindConstantBuffer(BindTargets::VertexShader, m_ShadowPassCB.Get(), 0);
+	m_Renderer.BindShaderResource(BindTargets::PixelShader, nullptr, SHADOW_MAP_ATLAS_SRV_SLOT);
+
+	for (const ShadowAtlasRender& render : renders)
+	{
+		const ShadowAtlasSlot& slot = render.Slot;
+		m_ShadowMap.BindAtlasSlot(ctx, slot.X, slot.Y, slot.Size);
+		const ShadowRect rect = { slot.X, slot.Y, slot.X + slot.Size, slot.Y + slot.Size };
+		GameSetScissor(ctx, rect);
+
+		m_Renderer.SetInputLayout(nullptr);
+		m_Renderer.BindVertexShader(m_ShadowRestoreVS.Get());
+		m_Renderer.BindPixelShader(nullptr);
+		ctx->OMSetDepthStencilState(m_ShadowMap.GetRestoreDepthState(), 0);
+		m_Renderer.Draw(3);
+		ctx->OMSetDepthStencilState(nullptr, 0);
+
+		ShadowView& view = m_AtlasShadowViews[GameShadowFaceIndex(render.Light, render.Face)];
+		GameUpdateDynamicBuffer(ctx, sizeof(Mat4X4), &view.ViewProj, m_ShadowPassCB.Get());
+		m_AtlasShadowCasters.clear();
+		m_Scene.Cull(view.CasterFrustum, &m_AtlasShadowCasters);
+		DrawShadowCasters(m_AtlasShadowCasters);
+	}
+
+	m_Renderer.SetRasterizerState(m_DR->GetRasterizerState());
+}
+
+void Game::Render()
+{
+	RenderShadowMap();
+	RenderAtlasShadows();
 
 	m_Renderer.Clear();
 
 	m_Renderer.BindPixelShader(m_PhongPS.Get());
-	m_Renderer.BindVertexShader(m_VS.Get());
+	m_Renderer.BindVertexShader(m_InstancedVS.Get());
+	m_Renderer.SetInputLayout(m_InstancedInputLayout.Get());
 	
 	m_Renderer.BindConstantBuffer(BindTargets::VertexShader, m_PerFrameCB.Get(), 1);
 	m_Renderer.BindConstantBuffer(BindTargets::PixelShader, m_PerFrameCB.Get(), 1);
@@ -291,25 +955,15 @@ void Game::Render()
 	m_Renderer.BindConstantBuffer(BindTargets::VertexShader, m_PerSceneCB.Get(), 2);
 	m_Renderer.BindConstantBuffer(BindTargets::PixelShader, m_PerSceneCB.Get(), 2);
 
-	for (size_t i = 0; i < m_Actors.size(); ++i)
-	{
-		const Actor& actor = m_Actors[i];
-		m_Renderer.BindShaderResources(BindTargets::PixelShader, actor.GetShaderResources(), ACTOR_NUM_TEXTURES);
-		m_PerObjectData.world = actor.GetWorld();
-		m_PerObjectData.material = actor.GetMaterial();
-		GameUpdateConstantBuffer(m_DR->GetDeviceContext(),
-			sizeof(PerObjectConstants),
-			&m_PerObjectData,
-			m_PerObjectCB.Get());
-		m_Renderer.BindConstantBuffer(BindTargets::VertexShader, m_PerObjectCB.Get(), 0);
-		m_Renderer.BindConstantBuffer(BindTargets::PixelShader, m_PerObjectCB.Get(), 0);
+	m_Renderer.BindConstantBuffer(BindTargets::PixelShader, m_PerMaterialCB.Get(), 3);
+	m_Renderer.BindShaderResource(BindTargets::PixelShader, m_ShadowMap.GetShaderResourceView(), SHADOW_MAP_SRV_SLOT);
+	m_Renderer.BindShaderResource(BindTargets::PixelShader, m_ShadowMap.GetAtlasShaderResourceView(), SHADOW_MAP_ATLAS_SRV_SLOT);
+	m_Renderer.BindShaderResource(BindTargets::PixelShader, m_PointLightSRV.Get(), GAME_POINT_LIGHTS_SRV_SLOT);
+	m_Renderer.BindShaderResource(BindTargets::PixelShader, m_SpotLightSRV.Get(), GAME_SPOT_LIGHTS_SRV_SLOT);
+	m_Renderer.BindShaderResource(BindTargets::PixelShader, m_LightClusterSRV.Get(), GAME_LIGHT_CLUSTERS_SRV_SLOT);
+	m_Renderer.BindShaderResource(BindTargets::PixelShader, m_LightIndexSRV.Get(), GAME_LIGHT_INDICES_SRV_SLOT);
 
-		m_Renderer.DrawIndexed(actor.GetIndexBuffer(), actor.GetVertexBuffer(),
-			sizeof(Vertex),
-			actor.GetNumIndices(),
-			0,
-			0);
-	}
+	RenderActorsInstanced();
 	
 	//// Light properties
 	//for (uint32_t i = 0; i < _countof(m_PerSceneData.pointLights); ++i)
@@ -318,7 +972,7 @@ void Game::Render()
 	//	Mat4X4 world = MathMat4X4ScaleFromVec3D(&scale);
 	//	Mat4X4 translate = MathMat4X4TranslateFromVec3D(&m_PerSceneData.pointLights[i].Position);
 	//	m_PerObjectData.world = MathMat4X4MultMat4X4ByMat4X4(&world, &translate);
-	//	GameUpdateConstantBuffer(m_DR->GetDeviceContext(),
+	//	GameUpdateDynamicBuffer(m_DR->GetDeviceContext(),
 	//		sizeof(PerObjectConstants),
 	//		&m_PerObjectData,
 	//		m_PerObjectCB);
@@ -337,6 +991,94 @@ void Game::Render()
 	m_Renderer.Present();
 }
 
+// Both passes share the instance buffer, each discards what the previous one wrote
+void Game::UploadInstances(const std::vector<InstanceData>& instances)
+{
+	if (instances.size() > m_InstanceBufferCapacity)
+	{
+		uint32_t capacity = m_InstanceBufferCapacity;
+		while (capacity < instances.size())
+		{
+			capacity *= 2;
+		}
+		CreateInstanceBuffer(capacity);
+	}
+
+	GameUpdateDynamicBuffer(m_DR->GetDeviceContext(),
+		sizeof(InstanceData) * instances.size(),
+		(void*)instances.data(),
+		m_InstanceBuffer.Get());
+}
+
+void Game::RenderActorsInstanced()
+{
+	const std::vector<Mat4X4>& worlds = m_Scene.GetWorlds();
+	const std::vector<uint32_t>& meshIds = m_Scene.GetMeshIds();
+	const std::vector<uint32_t>& materialIds = m_Scene.GetMaterialIds();
+
+	m_Batcher.Begin();
+	for (const uint32_t entityIdx : m_VisibleEntities)
+	{
+		const Actor& model = m_Models[meshIds[entityIdx]];
+		ID3D11ShaderResourceView* srvs[ACTOR_NUM_TEXTURES] = {};
+		model.GetShaderResources(srvs);
+
+		const MeshAllocation& geometry = model.GetGeometry();
+		if (!geometry.IsValid())
+		{
+			continue;
+		}
+		const uint64_t meshKey = ((uint64_t)geometry.Page << 32) | geometry.StartIndex;
+		// material constants are fetched per instance, only textures split batches
+		const uint64_t materialKey = GameHashBytes(srvs, sizeof(srvs));
+		m_Batcher.Add(meshKey, materialKey, materialIds[entityIdx], worlds[entityIdx]);
+	}
+	m_Batcher.Build();
+
+	const std::vector<InstanceData>& instances = m_Batcher.GetInstances();
+	if (instances.empty())
+	{
+		return;
+	}
+	UploadInstances(instances);
+
+	for (const InstanceBatch& batch : m_Batcher.GetBatches())
+	{
+		const Actor& actor = m_Models[meshIds[m_VisibleEntities[batch.ItemIdx]]];
+		ID3D11ShaderResourceView* srvs[ACTOR_NUM_TEXTURES] = {};
+		actor.GetShaderResources(srvs);
+		m_Renderer.BindShaderResources(BindTargets::PixelShader, srvs, ACTOR_NUM_TEXTURES);
+
+		m_Renderer.DrawIndexedInstanced(actor.GetIndexBuffer(), actor.GetVertexBuffer(),
+			sizeof(Vertex),
+			m_InstanceBuffer.Get(),
+			sizeof(InstanceData),
+			actor.GetNumIndices(),
+			batch.NumInstances,
+			actor.GetStartIndex(),
+			actor.GetBaseVertex(),
+			batch.FirstInstance);
+	}
+
+	if (m_NumDrawCallsSaved != m_Batcher.GetNumDrawCallsSaved())
+	{
+		m_NumDrawCallsSaved = m_Batcher.GetNumDrawCallsSaved();
+		UtilsDebugPrint("Instancing: %u of %u entities visible in %u draw calls, %u draw calls saved\n",
+			m_Batcher.GetNumItems(),
+			m_Scene.GetNumEntities(),
+			(uint32_t)m_Batcher.GetBatches().size(),
+			m_NumDrawCallsSaved);
+	}
+
+	if (m_NumTextureBinds != m_Renderer.GetNumShaderResourceBinds())
+	{
+		m_NumTextureBinds = m_Renderer.GetNumShaderResourceBinds();
+		UtilsDebugPrint("Texture binds: %u for %u draw calls\n",
+			m_NumTextureBinds,
+			(uint32_t)m_Batcher.GetBatches().size());
+	}
+}
+
 void Game::Tick()
 {
 	TimerTick(&m_Timer);
@@ -344,6 +1086,83 @@ void Game::Tick()
 	Render();
 }
 
+// Cooked file of a source asset, the cooker has to run before the game
+const char* Game::ResolveAsset(const char* source) const
+{
+	const char* cooked = m_Assets.Resolve(source);
+	if (!cooked)
+	{
+		UTILS_FATAL_ERROR("Asset %s is not cooked, run the cooker", source);
+	}
+	return cooked;
+}
+
+// The model renders with a placeholder until the decoded texture is uploaded,
+// textures the cache already holds are set right away. Streamed textures are
+// set again whenever their mips change, models sharing a file share its stream.
+void Game::LoadModelTexture(uint32_t modelIdx, const char* filename, TextureType type)
+{
+	m_Models[modelIdx].SetTexture(type, m_Textures.GetPlaceholder(type));
+	const TextureHandle handle = m_TextureCache.Acquire(filename, type, [this, modelIdx, type](ID3D11ShaderResourceView* srv, size_t)
+		{
+			m_Models[modelIdx].SetTexture(type, srv);
+		});
+	m_TextureHandles.emplace_back(handle);
+
+	const uint32_t stream = m_TextureCache.GetStream(handle);
+	if (stream != TEXTURE_LOADER_NOT_STREAMED)
+	{
+		if (m_ModelTextureStreams.size() <= modelIdx)
+		{
+			m_ModelTextureStreams.resize(modelIdx + 1);
+		}
+		m_ModelTextureStreams[modelIdx].emplace_back(stream);
+	}
+}
+
+// Packed textures are bound right away and placed through the material,
+// the others load as usual and keep the identity layout
+void Game::SetModelTextures(uint32_t modelIdx, const char* const* filenames, const TexturePackerPlacement* placements,
+	MaterialTextures* textures)
+{
+	for (uint32_t slot = 0; slot < ACTOR_NUM_TEXTURES; ++slot)
+	{
+		if (!filenames[slot])
+		{
+			continue;
+		}
+
+		const TextureType type = (TextureType)slot;
+		if (!placements || placements[slot].Array == TEXTURE_PACKER_UNPACKED)
+		{
+			LoadModelTexture(modelIdx, filenames[slot], type);
+			continue;
+		}
+
+		const TexturePackerPlacement& placement = placements[slot];
+		m_Models[modelIdx].SetTexture(type, m_Textures.GetPackedView(placement.Array));
+		TexturePackerUVTransform(placement, m_Textures.GetPackedArray(placement.Array), textures->ScaleOffset[slot]);
+		textures->Slice[slot] = (float)placement.Slice;
+		textures->MaxLevel[slot] = (float)placement.MaxLevel;
+	}
+}
+
+void Game::CreateBoundEntity(uint32_t meshId, uint32_t materialId, uint32_t parentNode, const Mat4X4& local)
+{
+	const uint32_t node = m_Transforms.AddNode(parentNode, local);
+	TransformBinding binding = {};
+	binding.Entity = m_Scene.CreateEntity(meshId, materialId, m_Models[meshId].GetLocalBounds(), local);
+	binding.Node = node;
+	m_TransformBindings.emplace_back(binding);
+
+	const uint32_t entityIdx = m_Scene.GetDenseIndex(binding.Entity);
+	if (entityIdx >= m_DynamicEntities.size())
+	{
+		m_DynamicEntities.resize(entityIdx + 1, 0);
+	}
+	m_DynamicEntities[entityIdx] = parentNode != TRANSFORM_INVALID_NODE ? 1 : 0;
+}
+
 void Game::CreateActors()
 {
 	const char* models[] = {
@@ -407,66 +1226,301 @@ void Game::CreateActors()
 		{0.628281f, 0.555802f, 0.366065f, 0.4f}
 	};
 
+	// one set of texture slots per model in TextureType order, the plane only has a diffuse map
+	std::vector<const char*> textures;
 	for (size_t i = 0; i < _countof(models); ++i)
 	{
-		Actor actor = Actor();
-		actor.LoadModel(models[i]);
-		actor.CreateIndexBuffer(m_DR->GetDevice());
-		actor.CreateVertexBuffer(m_DR->GetDevice());
-		actor.Scale(scales[i]);
-		actor.Rotate(rotations[i].X, rotations[i].Y, rotations[i].Z);
-		actor.Translate(offsets[i]);
-		actor.LoadTexture(diffuseTextures[i], TextureType::Diffuse, m_DR->GetDevice(), m_DR->GetDeviceContext());
-		actor.LoadTexture(specularTextures[i], TextureType::Specular, m_DR->GetDevice(), m_DR->GetDeviceContext());
-		actor.LoadTexture(glossTextures[i], TextureType::Gloss, m_DR->GetDevice(), m_DR->GetDeviceContext());
-		actor.LoadTexture(normalTextures[i], TextureType::Normal, m_DR->GetDevice(), m_DR->GetDeviceContext());
-		actor.SetMaterial(&material);
-
-		m_Actors.emplace_back(actor);
+		m_Models.emplace_back(Actor(m_Meshes.Load(ResolveAsset(models[i]), GAME_MESH_FLAGS)));
+		textures.emplace_back(ResolveAsset(diffuseTextures[i]));
+		textures.emplace_back(ResolveAsset(specularTextures[i]));
+		textures.emplace_back(ResolveAsset(glossTextures[i]));
+		textures.emplace_back(ResolveAsset(normalTextures[i]));
 	}
 
+	const uint32_t planeId = (uint32_t)m_Models.size();
 	{
 		const Vec3D origin = { 0.0f, 0.0f, 0.0f };
 		struct Mesh* mesh = MGGeneratePlane(&origin, 10.0f, 10.0f);
-		Actor plane = Actor(mesh);
+		m_Models.emplace_back(Actor(m_Meshes.Create("generated/plane", mesh, GAME_MESH_FLAGS)));
 		MeshFree(mesh);
-		plane.CreateIndexBuffer(m_DR->GetDevice());
-		plane.CreateVertexBuffer(m_DR->GetDevice());
+		textures.emplace_back(ResolveAsset("assets/textures/chess.jpg"));
+		textures.insert(textures.end(), ACTOR_NUM_TEXTURES - 1, nullptr);
+	}
+
+	// every model gets a material of its own, they differ in where their textures are packed
+	std::vector<TexturePackerPlacement> placements;
+#if GAME_PACK_TEXTURES
+	// a file named by several models is packed once, under the key the cache would share it by
+	std::vector<uint64_t> textureKeys(textures.size(), 0);
+	for (size_t i = 0; i < textures.size(); ++i)
+	{
+		if (textures[i])
+		{
+			textureKeys[i] = m_TextureCache.ComputeKey(textures[i], (TextureType)(i % ACTOR_NUM_TEXTURES));
+		}
+	}
+	m_Textures.LoadPacked(textures.data(), textureKeys.data(), (uint32_t)textures.size(), &placements);
+#endif
+	std::vector<uint32_t> materialIds;
+	for (uint32_t meshId = 0; meshId < m_Models.size(); ++meshId)
+	{
+		const size_t first = (size_t)meshId * ACTOR_NUM_TEXTURES;
+		MaterialTextures layout;
+		SetModelTextures(meshId, &textures[first], placements.empty() ? nullptr : &placements[first], &layout);
+		materialIds.emplace_back(RegisterMaterial(material, layout));
+	}
+
+	for (uint32_t i = 0; i < _countof(models); ++i)
+	{
+		CreateBoundEntity(i, materialIds[i], TRANSFORM_INVALID_NODE, GameComposeWorld(scales[i], rotations[i], offsets[i]));
+	}
+
+	{
 		const Vec3D offset = { 0.0f, -1.0f, 0.0f };
-		plane.Translate(offset);
-		plane.LoadTexture("assets/textures/chess.jpg", TextureType::Diffuse, m_DR->GetDevice(), m_DR->GetDeviceContext());
-		plane.SetMaterial(&material);
-		m_Actors.emplace_back(plane);
+		CreateBoundEntity(planeId, materialIds[planeId], TRANSFORM_INVALID_NODE, MathMat4X4TranslateFromVec3D(&offset));
+	}
+
+	// scatter small cubes over the plane, they share the cube model
+	// so they end up in a single instanced draw
+	{
+		const uint32_t cubeId = 1;
+		const uint32_t materialId = materialIds[cubeId];
+		const Mat4X4 identity = MathMat4X4Identity();
+		m_PropsNode = m_Transforms.AddNode(TRANSFORM_INVALID_NODE, identity);
+		for (uint32_t i = 0; i < GAME_NUM_PROPS; ++i)
+		{
+			const Vec3D rotation = { 0.0f, MathRandom(0.0f, MathToRadians(90.0f)), 0.0f };
+			const Vec3D offset = { MathRandom(-4.5f, 4.5f), -0.75f, MathRandom(-4.5f, 4.5f) };
+			CreateBoundEntity(cubeId, materialId, m_PropsNode, GameComposeWorld(0.25f, rotation, offset));
+		}
 	}
 }
 
+#ifdef LIGHTMAP_BAKER_BENCHMARK
+// Bakes the actors that never move under the directional and point lights,
+// the spot light follows the camera and is left out
+void Game::BakeLightmaps()
+{
+	std::vector<LightmapBakerInstance> instances;
+	const std::vector<uint32_t>& meshIds = m_Scene.GetMeshIds();
+	for (uint32_t entityIdx = 0; entityIdx < m_Scene.GetNumEntities(); ++entityIdx)
+	{
+		const MeshData& mesh = *m_Models[meshIds[entityIdx]].GetMesh();
+		if (m_DynamicEntities[entityIdx] || !mesh.HasCpuData())
+		{
+			continue;
+		}
+		LightmapBakerInstance instance = {};
+		instance.Vertices = mesh.Vertices.data();
+		instance.NumVertices = (uint32_t)mesh.Vertices.size();
+		instance.Indices = mesh.Indices.data();
+		instance.NumIndices = (uint32_t)mesh.Indices.size();
+		instance.World = m_Scene.GetWorlds()[entityIdx];
+		instances.push_back(instance);
+	}
+
+	LightmapBakerLights lights = {};
+	lights.DirLights = &m_PerSceneData.dirLight;
+	lights.NumDirLights = 1;
+	lights.PointLights = m_Lights.GetPointLights().data();
+	lights.NumPointLights = (uint32_t)m_Lights.GetPointLights().size();
+	LightmapBakerBenchmark(instances.data(), (uint32_t)instances.size(), lights, GAME_LIGHTMAP_TEXELS_PER_UNIT, &m_Jobs, GAME_LIGHTMAP_FILE);
+}
+#endif
+
 void Game::Initialize(HWND hWnd, uint32_t width, uint32_t height)
 {
 #ifdef MATH_TEST
 	MathTest();
 #endif
+#ifdef INSTANCE_BATCHER_TEST
+	InstanceBatcherTest();
+#endif
+#ifdef RANGE_ALLOCATOR_TEST
+	RangeAllocatorTest();
+#endif
+#ifdef SCENE_TEST
+	SceneTest();
+#endif
+#ifdef JOB_SYSTEM_TEST
+	JobSystemTest();
+#endif
+#ifdef TRANSFORM_HIERARCHY_TEST
+	TransformHierarchyTest();
+#endif
+#ifdef MESH_REGISTRY_TEST
+	MeshRegistryTest();
+#endif
+#ifdef MIP_GENERATOR_TEST
+	MipGeneratorTest();
+#endif
+#ifdef BLOCK_COMPRESSOR_TEST
+	BlockCompressorTest();
+#endif
+#ifdef DDS_LOADER_TEST
+	DDSLoaderTest();
+#endif
+#ifdef ASSET_MANIFEST_TEST
+	AssetManifestTest();
+#endif
+#ifdef MESH_FILE_TEST
+	MeshFileTest();
+#endif
+#ifdef TEXTURE_CACHE_TEST
+	TextureCacheTest();
+#endif
+#ifdef TEXTURE_STREAMER_TEST
+	TextureStreamerTest();
+#endif
+#ifdef TEXTURE_PACKER_TEST
+	TexturePackerTest();
+#endif
+#ifdef IMAGE_DECODER_TEST
+	ImageDecoderTest();
+#endif
+#ifdef UPLOAD_SCHEDULER_TEST
+	UploadSchedulerTest();
+#endif
+#ifdef UPLOAD_MANAGER_TEST
+	UploadManagerTest();
+#endif
+#ifdef SHADOW_VIEW_TEST
+	ShadowViewTest();
+#endif
+#ifdef SHADOW_CACHE_TEST
+	ShadowCacheTest();
+#endif
+#ifdef SHADOW_ATLAS_TEST
+	ShadowAtlasTest();
+#endif
+#ifdef LIGHT_CULLER_TEST
+	LightCullerTest();
+#endif
+#ifdef LIGHT_BVH_TEST
+	LightBVHTest();
+#endif
+#ifdef LIGHT_STORE_TEST
+	LightStoreTest();
+#endif
+#ifdef LIGHTING_REFERENCE_TEST
+	LightingReferenceTest();
+#endif
+#ifdef TRIANGLE_BVH_TEST
+	TriangleBVHTest();
+#endif
+#ifdef LIGHTMAP_BAKER_TEST
+	LightmapBakerTest();
+#endif
+	const auto startupBegin = std::chrono::steady_clock::now();
 	m_DR->SetWindow(hWnd, width, height);
 	m_DR->CreateDeviceResources();
 	m_DR->CreateWindowSizeDependentResources();
 	TimerInitialize(&m_Timer);
 	Mouse::Get().SetWindowDimensions(m_DR->GetBackBufferWidth(), m_DR->GetBackBufferHeight());
-	m_ShadowMap.InitResources(m_DR->GetDevice(), 2048, 2048);
+	m_ShadowMap.InitResources(m_DR->GetDevice(), GAME_SHADOW_MAP_SIZE, GAME_SHADOW_MAP_SIZE);
+	m_ShadowCache.Init(SHADOW_MAP_NUM_CASCADES, GAME_SHADOW_MAP_SIZE);
+	m_ShadowMap.InitAtlas(m_DR->GetDevice(), GAME_SHADOW_ATLAS_SIZE);
+	m_ShadowAtlas.Init(GAME_SHADOW_ATLAS_SIZE, GAME_SHADOW_ATLAS_MIN_SLOT, GAME_SHADOW_ATLAS_MAX_SLOT, GAME_SHADOW_ATLAS_FACE_BUDGET);
+	m_LightCuller.Init(m_DR->GetBackBufferWidth(), m_DR->GetBackBufferHeight(), MathToRadians(GAME_FOV_DEGREES), GAME_NEAR_Z, GAME_FAR_Z);
+	m_GeometryPool.Init(m_DR->GetDevice(), sizeof(Vertex));
+	m_Uploads.Init(m_DR->GetDevice(), m_DR->GetDeviceContext(), GAME_UPLOAD_BUDGET);
+	m_Meshes.Init(&m_GeometryPool, &m_Uploads);
+	m_Jobs.Init();
+	m_Textures.Init(&m_Jobs, m_DR->GetDevice(), m_DR->GetDeviceContext(), &m_Uploads);
+	m_Textures.GetStreamer()->Init(GAME_TEXTURE_STREAMING_BUDGET, GAME_MAX_STREAMED_LEVELS_PER_FRAME);
+	TextureCacheStreamFunction stream = nullptr;
+#if GAME_STREAM_TEXTURES
+	stream = [this](const char* filename, TextureType type, TextureLoadedCallback onChanged)
+		{
+			return m_Textures.LoadStreamed(filename, type, std::move(onChanged));
+		};
+#endif
+	m_TextureCache.Init([this](const char* filename, TextureType type, TextureLoadedCallback onLoaded)
+		{
+			m_Textures.Load(filename, type, std::move(onLoaded));
+		}, GAME_TEXTURE_BUDGET, std::move(stream));
+#ifdef TEXTURE_LOADER_BENCHMARK
+	TextureLoaderBenchmark(GAME_BENCHMARK_TEXTURES, _countof(GAME_BENCHMARK_TEXTURES), &m_Jobs);
+	TextureLoaderDDSBenchmark(GAME_BENCHMARK_TEXTURES, _countof(GAME_BENCHMARK_TEXTURES),
+		GAME_BENCHMARK_DDS_TEXTURES, _countof(GAME_BENCHMARK_DDS_TEXTURES), &m_Jobs);
+#endif
+#ifdef MIP_GENERATOR_BENCHMARK
+	MipGeneratorBenchmark(&m_Jobs);
+#endif
+#ifdef BLOCK_COMPRESSOR_BENCHMARK
+	BlockCompressorBenchmark(GAME_BENCHMARK_TEXTURES, _countof(GAME_BENCHMARK_TEXTURES), &m_Jobs);
+#endif
+#ifdef IMAGE_DECODER_BENCHMARK
+	ImageDecoderBenchmark(&m_Jobs);
+#endif
+#ifdef SHADOW_VIEW_BENCHMARK
+	ShadowViewBenchmark();
+#endif
+#ifdef SHADOW_ATLAS_BENCHMARK
+	ShadowAtlasBenchmark();
+#endif
+#ifdef RANGE_ALLOCATOR_BENCHMARK
+	RangeAllocatorBenchmark();
+#endif
+#ifdef SCENE_BENCHMARK
+	SceneBenchmark();
+#endif
+#ifdef TRANSFORM_HIERARCHY_BENCHMARK
+	TransformHierarchyBenchmark(&m_Jobs);
+#endif
+#ifdef LIGHT_CULLER_BENCHMARK
+	LightCullerBenchmark();
+#endif
+#ifdef LIGHT_BVH_BENCHMARK
+	LightBVHBenchmark();
+#endif
+#ifdef LIGHTING_REFERENCE_BENCHMARK
+	LightingReferenceBenchmark();
+#endif
+
+	if (!m_Assets.Load(GAME_ASSET_MANIFEST))
+	{
+		UTILS_FATAL_ERROR("Failed to load %s, run the cooker", GAME_ASSET_MANIFEST);
+	}
 
 	// init actors
 	CreateActors();
+	// the scene geometry is in place before the first frame
+	m_Uploads.Flush();
+	m_GeometryPool.PrintStats();
+	m_Meshes.PrintStats();
+	m_Uploads.PrintStats();
 	InitPerSceneConstants();
+#ifdef LIGHTMAP_BAKER_BENCHMARK
+	BakeLightmaps();
+#endif
 
 	ID3D11Device* device = m_DR->GetDevice();
 
 	GameCreatePixelShader("PixelShader.cso", (ID3D11Device*)device, m_PS.ReleaseAndGetAddressOf());
 	GameCreatePixelShader("PhongPS.cso", (ID3D11Device*)device, m_PhongPS.ReleaseAndGetAddressOf());
 	GameCreatePixelShader("LightPS.cso", (ID3D11Device*)device, m_LightPS.ReleaseAndGetAddressOf());
-	GameCreateVertexShader("VertexShader.cso", (ID3D11Device*)device, m_VS.ReleaseAndGetAddressOf(), m_InputLayout.ReleaseAndGetAddressOf());
+	GameCreateVertexShader("VertexShader.cso", (ID3D11Device*)device, m_VS.ReleaseAndGetAddressOf(), m_InputLayout.ReleaseAndGetAddressOf(),
+		GAME_INPUT_ELEMENT_DESC, _countof(GAME_INPUT_ELEMENT_DESC));
+	GameCreateVertexShader("InstancedVS.cso", (ID3D11Device*)device, m_InstancedVS.ReleaseAndGetAddressOf(), m_InstancedInputLayout.ReleaseAndGetAddressOf(),
+		GAME_INSTANCED_INPUT_ELEMENT_DESC, _countof(GAME_INSTANCED_INPUT_ELEMENT_DESC));
+	GameCreateVertexShader("ShadowVS.cso", (ID3D11Device*)device, m_ShadowVS.ReleaseAndGetAddressOf(), m_ShadowInputLayout.ReleaseAndGetAddressOf(),
+		GAME_INSTANCED_INPUT_ELEMENT_DESC, _countof(GAME_INSTANCED_INPUT_ELEMENT_DESC));
+	GameCreateVertexShader("ShadowRestoreVS.cso", (ID3D11Device*)device, m_ShadowRestoreVS.ReleaseAndGetAddressOf(), nullptr, nullptr, 0);
+	GameCreatePixelShader("ShadowRestorePS.cso", (ID3D11Device*)device, m_ShadowRestorePS.ReleaseAndGetAddressOf());
 
 	GameCreateConstantBuffer(m_DR->GetDevice(), sizeof(PerSceneConstants), &m_PerSceneCB);
 	GameCreateConstantBuffer(m_DR->GetDevice(), sizeof(PerObjectConstants), &m_PerObjectCB);
 	GameCreateConstantBuffer(m_DR->GetDevice(), sizeof(PerFrameConstants), &m_PerFrameCB);
-	GameUpdateConstantBuffer(m_DR->GetDeviceContext(), sizeof(PerSceneConstants), &m_PerSceneData, m_PerSceneCB.Get());
+	GameCreateConstantBuffer(m_DR->GetDevice(), sizeof(PerMaterialConstants), &m_PerMaterialCB);
+	GameCreateConstantBuffer(m_DR->GetDevice(), sizeof(Mat4X4), &m_ShadowPassCB);
+	GameUpdateDynamicBuffer(m_DR->GetDeviceContext(), sizeof(PerSceneConstants), &m_PerSceneData, m_PerSceneCB.Get());
+	GameCreateStructuredBuffer(m_DR->GetDevice(), D3D11_USAGE_DYNAMIC, sizeof(LightCluster), (uint32_t)m_LightCuller.GetClusters().size(), nullptr,
+		m_LightClusterBuffer.ReleaseAndGetAddressOf(), m_LightClusterSRV.ReleaseAndGetAddressOf());
+	CreateLightIndexBuffer(GAME_MIN_LIGHT_INDEX_CAPACITY);
+
+	GameUpdateDynamicBuffer(m_DR->GetDeviceContext(), sizeof(PerMaterialConstants), &m_PerMaterialData, m_PerMaterialCB.Get());
+	CreateInstanceBuffer(GAME_MIN_INSTANCE_CAPACITY);
 
 	CreateDefaultSampler();
 
@@ -475,6 +1529,11 @@ void Game::Initialize(HWND hWnd, uint32_t width, uint32_t height)
 	m_Renderer.SetRasterizerState(m_DR->GetRasterizerState());
 	m_Renderer.SetInputLayout(m_InputLayout.Get());
 	m_Renderer.SetSamplerState(m_DefaultSampler.Get());
+	m_Renderer.SetSamplerState(m_ShadowMap.GetComparisonSampler(), SHADOW_MAP_SAMPLER_SLOT);
+
+	// textures keep streaming in after this, TextureLoader reports when they are done
+	const std::chrono::duration<double, std::milli> startup = std::chrono::steady_clock::now() - startupBegin;
+	UtilsDebugPrint("Startup: %.2f ms\n", startup.count());
 }
 
 void Game::GetDefaultSize(uint32_t* width, uint32_t* height)
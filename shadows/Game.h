@@ -11,6 +11,24 @@
 #include "Actor.h"
 #include "LightHelper.h"
 #include "ShadowMap.h"
+#include "ShadowView.h"
+#include "ShadowCache.h"
+#include "ShadowAtlas.h"
+#include "LightCuller.h"
+#include "LightBVH.h"
+#include "LightStore.h"
+#include "LightingReference.h"
+#include "LightmapBaker.h"
+#include "InstanceBatcher.h"
+#include "UploadManager.h"
+#include "GeometryPool.h"
+#include "MeshRegistry.h"
+#include "Scene.h"
+#include "JobSystem.h"
+#include "TransformHierarchy.h"
+#include "TextureLoader.h"
+#include "TextureCache.h"
+#include "AssetManifest.h"
 
 #include <vector>
 #include <memory>
@@ -18,14 +36,87 @@
 
 #define MODEL_PULL 10
 #define TEXTURE_PULL 4
+#define GAME_MAX_MATERIALS 16
+#define GAME_NUM_PROPS 32
+#define GAME_MIN_INSTANCE_CAPACITY 64
+#define GAME_PROPS_SPIN_SPEED 0.1f
+#define GAME_MAX_TEXTURE_UPLOADS_PER_FRAME 4
+// bytes copied out of the staging rings per frame, the rest waits for the next one
+#define GAME_UPLOAD_BUDGET (32ull * 1024 * 1024)
+// textures nobody uses are kept around until this much is resident
+#define GAME_TEXTURE_BUDGET (256ull * 1024 * 1024)
+// model textures load their small mips first and stream finer ones as they get closer
+#define GAME_STREAM_TEXTURES 1
+#define GAME_TEXTURE_STREAMING_BUDGET (64ull * 1024 * 1024)
+#define GAME_MAX_STREAMED_LEVELS_PER_FRAME 2
+#define GAME_FOV_DEGREES 45.0f
+#define GAME_NEAR_Z 0.1f
+#define GAME_FAR_Z 100.0f
+#define GAME_SHADOW_MAP_SIZE 2048
+// the cascades cover the camera range up to here, further away nothing is shadowed
+#define GAME_SHADOW_DISTANCE 50.0f
+// static casters are drawn into the shadow maps only when a cascade's view changes, moving ones into dirty rects
+#define GAME_CACHE_SHADOWS 1
+// the caster count changes with every camera move, its line prints at most this often
+#define GAME_SHADOW_STATS_INTERVAL_MILLIS 1000.0
+// The first point and spot lights of the scene cast shadows. Match NUM_SHADOWED_POINT_LIGHTS and NUM_SHADOWED_SPOT_LIGHTS in Common.hlsli
+#define GAME_NUM_SHADOWED_POINT_LIGHTS 4
+#define GAME_NUM_SHADOWED_SPOT_LIGHTS 2
+#define GAME_NUM_SHADOW_LIGHTS (GAME_NUM_SHADOWED_POINT_LIGHTS + GAME_NUM_SHADOWED_SPOT_LIGHTS)
+// the faces of every shadowed point light, then one per shadowed spot light
+#define GAME_NUM_SHADOW_FACES (GAME_NUM_SHADOWED_POINT_LIGHTS * SHADOW_ATLAS_NUM_CUBE_FACES + GAME_NUM_SHADOWED_SPOT_LIGHTS)
+// small unshadowed point lights spread over the floor, the pixel shader only walks the ones of its cluster
+#define GAME_NUM_SCATTERED_LIGHTS 64
+#define GAME_SCATTERED_LIGHTS_HEIGHT -0.5f
+// every this many scattered lights one bobs up and down
+#define GAME_BOBBING_LIGHTS_STRIDE 4
+#define GAME_BOBBING_LIGHTS_AMPLITUDE 0.25f
+#define GAME_MIN_LIGHT_INDEX_CAPACITY 4096
+// Match the registers of pointLights, spotLights, lightClusters and lightIndices in Common.hlsli
+#define GAME_POINT_LIGHTS_SRV_SLOT 6
+#define GAME_SPOT_LIGHTS_SRV_SLOT 7
+#define GAME_LIGHT_CLUSTERS_SRV_SLOT 8
+#define GAME_LIGHT_INDICES_SRV_SLOT 9
+// point and spot lights draw their shadows into slots of this atlas, sized after how much of the screen they cover
+#define GAME_SHADOW_ATLAS_SIZE 4096
+#define GAME_SHADOW_ATLAS_MIN_SLOT 64
+#define GAME_SHADOW_ATLAS_MAX_SLOT 1024
+// faces drawn into the atlas per frame, the others keep their last shadow or wait for their first one
+#define GAME_SHADOW_ATLAS_FACE_BUDGET 8
+#define GAME_LIGHT_SHADOW_NEAR_Z 0.05f
+// model textures that share format and size become slices of one array, small ones go to atlas pages
+#define GAME_PACK_TEXTURES 1
+// written by the cooker, the runtime only loads the files it lists
+#define GAME_ASSET_MANIFEST "cooked/" ASSET_MANIFEST_FILENAME
+#define GAME_LIGHTMAP_TEXELS_PER_UNIT 16.0f
+#define GAME_LIGHTMAP_FILE "cooked/lightmap.dds"
+#ifdef LIGHTMAP_BAKER_BENCHMARK
+// the baker reads the meshes of the static actors after they are uploaded
+#define GAME_MESH_FLAGS MESH_REGISTRY_RETAIN_CPU_DATA
+#else
+#define GAME_MESH_FLAGS 0
+#endif
+
+// Mirrors ShadowSlot in Common.hlsli
+struct ShadowSlot
+{
+	ShadowSlot() : viewProj{}, rect{} {}
+	Mat4X4 viewProj;
+	float rect[4];
+};
 
 struct PerFrameConstants
 {
-	PerFrameConstants() : view{}, proj{}, cameraPosW{}, pad{0} {}
+	PerFrameConstants() : view{}, proj{}, cameraPosW{}, pad{0}, shadowViewProj{}, cascadeEnds{}, clusterGrid{}, clusterDepth{}, lightShadows{} {}
 	Mat4X4 view;
 	Mat4X4 proj;
 	Vec3D cameraPosW;
 	float pad;
+	Mat4X4 shadowViewProj[SHADOW_MAP_NUM_CASCADES];
+	float cascadeEnds[SHADOW_MAP_NUM_CASCADES];
+	uint32_t clusterGrid[4];
+	float clusterDepth[4];
+	ShadowSlot lightShadows[GAME_NUM_SHADOW_FACES];
 };
 
 struct PerObjectConstants
@@ -37,10 +128,31 @@ struct PerObjectConstants
 
 struct PerSceneConstants
 {
-	PerSceneConstants() : pointLights{}, dirLight{}, spotLights{} {}
-	PointLight pointLights[4];
+	PerSceneConstants() : dirLight{} {}
 	DirectionalLight dirLight;
-	SpotLight spotLights[2];
+};
+
+// Scene entity driven by a node of the transform hierarchy
+struct TransformBinding
+{
+	EntityHandle Entity;
+	uint32_t Node;
+};
+
+// Mirrors MaterialTextures in Common.hlsli, one entry per texture slot
+struct MaterialTextures
+{
+	MaterialTextures();
+	float ScaleOffset[ACTOR_NUM_TEXTURES][4];
+	float Slice[ACTOR_NUM_TEXTURES];
+	float MaxLevel[ACTOR_NUM_TEXTURES];
+};
+
+struct PerMaterialConstants
+{
+	PerMaterialConstants() : materials{}, textures{} {}
+	Material materials[GAME_MAX_MATERIALS];
+	MaterialTextures textures[GAME_MAX_MATERIALS];
 };
 
 class Game
@@ -69,6 +181,30 @@ private:
 	void Update();
 	void Render();
 	void CreateActors();
+	void CreateInstanceBuffer(uint32_t capacity);
+	uint32_t RegisterMaterial(const Material& material, const MaterialTextures& textures);
+	void RenderActorsInstanced();
+	void RenderShadowMap();
+	uint32_t DrawShadowCasters(const std::vector<uint32_t>& casters);
+	void RestoreShadowRect(uint32_t cascade);
+	void RenderAtlasShadows();
+	void UploadInstances(const std::vector<InstanceData>& instances);
+	const char* ResolveAsset(const char* source) const;
+	void LoadModelTexture(uint32_t modelIdx, const char* filename, TextureType type);
+	void SetModelTextures(uint32_t modelIdx, const char* const* filenames, const TexturePackerPlacement* placements,
+		MaterialTextures* textures);
+	void CreateBoundEntity(uint32_t meshId, uint32_t materialId, uint32_t parentNode, const Mat4X4& local);
+	void UpdateTransforms();
+	void RequestTextureLevels();
+	void UpdateShadowView();
+	void UpdateAtlasShadows(const Frustum& frustum);
+	void AnimateLights();
+	void UploadLights();
+	void UpdateLightClusters();
+	void CreateLightIndexBuffer(uint32_t capacity);
+#ifdef LIGHTMAP_BAKER_BENCHMARK
+	void BakeLightmaps();
+#endif
 
 	std::unique_ptr<DeviceResources> m_DR;
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> m_VS;
@@ -76,18 +212,97 @@ private:
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> m_PhongPS;
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> m_LightPS;
 	Microsoft::WRL::ComPtr<ID3D11InputLayout> m_InputLayout;
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> m_InstancedVS;
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> m_InstancedInputLayout;
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> m_ShadowVS;
+	Microsoft::WRL::ComPtr<ID3D11InputLayout> m_ShadowInputLayout;
+	Microsoft::WRL::ComPtr<ID3D11VertexShader> m_ShadowRestoreVS;
+	Microsoft::WRL::ComPtr<ID3D11PixelShader> m_ShadowRestorePS;
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> m_DefaultSampler;
 	Timer m_Timer;
 	Camera m_Camera;
 	Renderer m_Renderer;
 
 	// new stuff
-	std::vector<Actor> m_Actors;
+	UploadManager m_Uploads;
+	// declared before the models, meshes give their ranges back on destruction
+	GeometryPool m_GeometryPool;
+	MeshRegistry m_Meshes;
+	// models are shared by entities through mesh ids
+	std::vector<Actor> m_Models;
+	Scene m_Scene;
+	std::vector<uint32_t> m_VisibleEntities;
+	JobSystem m_Jobs;
+	TextureLoader m_Textures;
+	// declared after the loader, pending loads call back into the cache
+	TextureCache m_TextureCache;
+	std::vector<TextureHandle> m_TextureHandles;
+	// streamed textures of every model
+	std::vector<std::vector<uint32_t>> m_ModelTextureStreams;
+	AssetManifest m_Assets;
+	TransformHierarchy m_Transforms;
+	std::vector<TransformBinding> m_TransformBindings;
+	uint32_t m_PropsNode;
+	float m_PropsAngle;
 	PerFrameConstants m_PerFrameData;
 	PerObjectConstants m_PerObjectData;
 	PerSceneConstants m_PerSceneData;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> m_PerFrameCB;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> m_PerObjectCB;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> m_PerSceneCB;
+	// light matrix of the cascade the shadow pass draws
+	Microsoft::WRL::ComPtr<ID3D11Buffer> m_ShadowPassCB;
 	ShadowMap m_ShadowMap;
+	ShadowView m_ShadowViews[SHADOW_MAP_NUM_CASCADES];
+	// dense indices of the entities that cast into each cascade this frame
+	std::vector<uint32_t> m_ShadowCasters[SHADOW_MAP_NUM_CASCADES];
+	ShadowCache m_ShadowCache;
+	// the static layer of the cascade is redrawn this frame from these
+	bool m_ShadowRedraw[SHADOW_MAP_NUM_CASCADES];
+	std::vector<uint32_t> m_StaticShadowCasters[SHADOW_MAP_NUM_CASCADES];
+	// moving casters of each cascade and the texel rects they cover
+	std::vector<uint32_t> m_DynamicShadowCasters[SHADOW_MAP_NUM_CASCADES];
+	std::vector<ShadowRect> m_DynamicShadowRects[SHADOW_MAP_NUM_CASCADES];
+	std::vector<uint32_t> m_RectShadowCasters;
+	// 1 for entities under an animated node, by dense index. They stay out of the static layers.
+	std::vector<uint8_t> m_DynamicEntities;
+	InstanceBatcher m_ShadowBatcher;
+	uint32_t m_NumShadowCasters;
+	double m_ShadowStatsMillis;
+	// slots of the point and spot lights, by light index with the point lights first
+	ShadowAtlas m_ShadowAtlas;
+	// light space of each face, indexed like lightShadows in the per frame constants
+	ShadowView m_AtlasShadowViews[GAME_NUM_SHADOW_FACES];
+	std::vector<uint32_t> m_AtlasShadowCasters;
+	// a static caster moved, every face of the atlas is drawn again
+	bool m_InvalidateAtlasShadows;
+
+	// lights of the scene, the shadowed ones first
+	LightStore m_Lights;
+	uint32_t m_LightBufferCapacities[LightStoreNumArrays];
+	std::vector<LightStoreUpload> m_LightUploads;
+	uint32_t m_FirstScatteredLight;
+	float m_LightsTime;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> m_PointLightBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_PointLightSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> m_SpotLightBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_SpotLightSRV;
+	// lights of every cluster of the view, binned every frame
+	LightCuller m_LightCuller;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> m_LightClusterBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_LightClusterSRV;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> m_LightIndexBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_LightIndexSRV;
+	uint32_t m_LightIndexCapacity;
+
+	// instancing
+	InstanceBatcher m_Batcher;
+	std::vector<Material> m_Materials;
+	std::vector<MaterialTextures> m_MaterialTextures;
+	PerMaterialConstants m_PerMaterialData;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> m_PerMaterialCB;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> m_InstanceBuffer;
+	uint32_t m_InstanceBufferCapacity;
+	uint32_t m_NumDrawCallsSaved;
+	uint32_t m_NumTextureBinds;
 };
\ No newline at end of file
@@ -0,0 +1,136 @@
+#include "GeometryPool.h"
+#include "UploadManager.h"
+#include "Utils.h"
+
+GeometryPool::GeometryPool():
+	m_Device{nullptr},
+	m_VertexStride{0},
+	m_VerticesPerPage{0},
+	m_IndicesPerPage{0},
+	m_Pages{}
+{
+}
+
+GeometryPool::~GeometryPool()
+{
+}
+
+void GeometryPool::Init(ID3D11Device* device,
+	uint32_t vertexStride,
+	uint32_t verticesPerPage,
+	uint32_t indicesPerPage)
+{
+	m_Device = device;
+	m_VertexStride = vertexStride;
+	m_VerticesPerPage = verticesPerPage;
+	m_IndicesPerPage = indicesPerPage;
+	m_Pages.clear();
+}
+
+void GeometryPool::CreatePage(uint32_t numVertices, uint32_t numIndices)
+{
+	Page page;
+
+	D3D11_BUFFER_DESC bufferDesc = {};
+	bufferDesc.ByteWidth = m_VertexStride * numVertices;
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bufferDesc.StructureByteStride = m_VertexStride;
+	bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+	HR(m_Device->CreateBuffer(&bufferDesc, NULL, page.VertexBuffer.ReleaseAndGetAddressOf()))
+
+	bufferDesc.ByteWidth = sizeof(uint32_t) * numIndices;
+	bufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	bufferDesc.StructureByteStride = 0;
+	HR(m_Device->CreateBuffer(&bufferDesc, NULL, page.IndexBuffer.ReleaseAndGetAddressOf()))
+
+	page.Vertices.Reset(numVertices);
+	page.Indices.Reset(numIndices);
+	m_Pages.emplace_back(std::move(page));
+}
+
+MeshAllocation GeometryPool::Allocate(uint32_t numVertices, uint32_t numIndices)
+{
+	assert(m_Device && "GeometryPool is not initialized");
+	MeshAllocation allocation = {};
+	if (numVertices == 0 || numIndices == 0)
+	{
+		// the range allocators hand out nothing for an empty range, so no page, not even a new one, would take it
+		return allocation;
+	}
+
+	for (uint32_t i = 0; i <= m_Pages.size(); ++i)
+	{
+		if (i == m_Pages.size())
+		{
+			// mesh does not fit anywhere, grow the pool by a page big enough for it
+			CreatePage(numVertices > m_VerticesPerPage ? numVertices : m_VerticesPerPage,
+				numIndices > m_IndicesPerPage ? numIndices : m_IndicesPerPage);
+		}
+
+		Page& page = m_Pages[i];
+		const uint32_t baseVertex = page.Vertices.Allocate(numVertices);
+		if (baseVertex == RANGE_ALLOCATOR_INVALID_OFFSET)
+		{
+			continue;
+		}
+
+		const uint32_t startIndex = page.Indices.Allocate(numIndices);
+		if (startIndex == RANGE_ALLOCATOR_INVALID_OFFSET)
+		{
+			page.Vertices.Free(baseVertex);
+			continue;
+		}
+
+		allocation.Page = i;
+		allocation.BaseVertex = baseVertex;
+		allocation.NumVertices = numVertices;
+		allocation.StartIndex = startIndex;
+		allocation.NumIndices = numIndices;
+		break;
+	}
+
+	return allocation;
+}
+
+uint64_t GeometryPool::Upload(UploadManager* uploads,
+	const MeshAllocation& allocation,
+	const void* vertices,
+	const uint32_t* indices)
+{
+	assert(allocation.IsValid());
+	const Page& page = m_Pages[allocation.Page];
+
+	uploads->UploadBuffer(page.VertexBuffer.Get(), allocation.BaseVertex * m_VertexStride,
+		vertices, allocation.NumVertices * m_VertexStride);
+	return uploads->UploadBuffer(page.IndexBuffer.Get(), allocation.StartIndex * sizeof(uint32_t),
+		indices, allocation.NumIndices * sizeof(uint32_t));
+}
+
+void GeometryPool::Free(MeshAllocation& allocation)
+{
+	if (!allocation.IsValid())
+	{
+		return;
+	}
+
+	Page& page = m_Pages[allocation.Page];
+	page.Vertices.Free(allocation.BaseVertex);
+	page.Indices.Free(allocation.StartIndex);
+	allocation = MeshAllocation();
+}
+
+void GeometryPool::PrintStats() const
+{
+	for (uint32_t i = 0; i < m_Pages.size(); ++i)
+	{
+		const Page& page = m_Pages[i];
+		UtilsDebugPrint("GeometryPool page %u: %u/%u vertices, %u/%u indices, %u meshes, fragmentation %.2f\n",
+			i,
+			page.Vertices.GetUsed(),
+			page.Vertices.GetCapacity(),
+			page.Indices.GetUsed(),
+			page.Indices.GetCapacity(),
+			page.Vertices.GetNumAllocations(),
+			page.Vertices.GetFragmentation());
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <cstdint>
+#include <vector>
+
+#include "RangeAllocator.h"
+
+#define GEOMETRY_POOL_DEFAULT_PAGE_VERTICES (1 << 18)
+#define GEOMETRY_POOL_DEFAULT_PAGE_INDICES (1 << 19)
+#define GEOMETRY_POOL_INVALID_PAGE UINT32_MAX
+
+class UploadManager;
+
+// Location of a mesh inside the pool. Indices are stored relative to the mesh,
+// so draws have to pass StartIndex and BaseVertex.
+struct MeshAllocation
+{
+	MeshAllocation() : Page{GEOMETRY_POOL_INVALID_PAGE}, BaseVertex{0}, NumVertices{0}, StartIndex{0}, NumIndices{0} {}
+	bool IsValid() const { return Page != GEOMETRY_POOL_INVALID_PAGE; }
+	uint32_t Page;
+	uint32_t BaseVertex;
+	uint32_t NumVertices;
+	uint32_t StartIndex;
+	uint32_t NumIndices;
+};
+
+// Sub-allocates vertex and index ranges of all meshes from a few large buffers
+// (pages), so consecutive draws keep the same IA bindings. New pages are
+// created on demand, freed ranges are reused by later uploads.
+class GeometryPool
+{
+public:
+	GeometryPool();
+	~GeometryPool();
+	GeometryPool(const GeometryPool& rhs) = delete;
+	GeometryPool& operator=(const GeometryPool& rhs) = delete;
+
+	void Init(ID3D11Device* device,
+		uint32_t vertexStride,
+		uint32_t verticesPerPage = GEOMETRY_POOL_DEFAULT_PAGE_VERTICES,
+		uint32_t indicesPerPage = GEOMETRY_POOL_DEFAULT_PAGE_INDICES);
+
+	// Meshes without vertices or indices get an allocation that is not valid
+	MeshAllocation Allocate(uint32_t numVertices, uint32_t numIndices);
+	// The data goes through the upload rings, it is in the buffers once the returned ticket is issued
+	uint64_t Upload(UploadManager* uploads,
+		const MeshAllocation& allocation,
+		const void* vertices,
+		const uint32_t* indices);
+	void Free(MeshAllocation& allocation);
+
+	ID3D11Buffer* GetVertexBuffer(uint32_t page) const { return m_Pages[page].VertexBuffer.Get(); }
+	ID3D11Buffer* GetIndexBuffer(uint32_t page) const { return m_Pages[page].IndexBuffer.Get(); }
+	uint32_t GetVertexStride() const { return m_VertexStride; }
+	uint32_t GetNumPages() const { return (uint32_t)m_Pages.size(); }
+
+	void PrintStats() const;
+
+private:
+	struct Page
+	{
+		Microsoft::WRL::ComPtr<ID3D11Buffer> VertexBuffer;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> IndexBuffer;
+		RangeAllocator Vertices;
+		RangeAllocator Indices;
+	};
+
+	void CreatePage(uint32_t numVertices, uint32_t numIndices);
+
+	ID3D11Device* m_Device;
+	uint32_t m_VertexStride;
+	uint32_t m_VerticesPerPage;
+	uint32_t m_IndicesPerPage;
+	std::vector<Page> m_Pages;
+};
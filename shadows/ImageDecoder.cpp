@@ -0,0 +1,972 @@
+// A private copy of stb_image so the JPEG path below can drive its decoder
+// stage by stage. Nothing of it is visible outside this file.
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "ImageDecoder.h"
+#include "JobSystem.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <limits.h>
+#include <string.h>
+
+// MCU rows whose coefficients one serial Huffman pass decodes while the previous band is transformed
+#define IMAGE_DECODER_BAND_UNIT_ROWS 4
+// output rows per upsampling and color conversion job
+#define IMAGE_DECODER_CONVERT_ROWS 32
+// restart intervals handed to a job at once are at least this many units
+#define IMAGE_DECODER_MIN_JOB_UNITS 256
+
+enum class ImageDecoderStatus
+{
+	Failed,
+	More,
+	// the scan ended on a marker other than a restart, like stbi the rest of the image is left undecoded
+	Done
+};
+
+// Units are what a restart interval counts: MCUs in interleaved scans, single blocks otherwise
+static int ImageDecoderUnitsPerRow(const stbi__jpeg* z)
+{
+	return z->scan_n == 1 ? (z->img_comp[z->order[0]].x + 7) >> 3 : z->img_mcu_x;
+}
+
+static int ImageDecoderUnitRows(const stbi__jpeg* z)
+{
+	return z->scan_n == 1 ? (z->img_comp[z->order[0]].y + 7) >> 3 : z->img_mcu_y;
+}
+
+static int ImageDecoderBlocksPerUnit(const stbi__jpeg* z)
+{
+	if (z->scan_n == 1)
+	{
+		return 1;
+	}
+	int blocks = 0;
+	for (int k = 0; k < z->scan_n; ++k)
+	{
+		blocks += z->img_comp[z->order[k]].h * z->img_comp[z->order[k]].v;
+	}
+	return blocks;
+}
+
+// Visits the blocks of a unit in bitstream order like stbi__parse_entropy_coded_data
+template <typename Func>
+static bool ImageDecoderForEachBlock(stbi__jpeg* z, int unit, Func func)
+{
+	if (z->scan_n == 1)
+	{
+		const int n = z->order[0];
+		const int w = ImageDecoderUnitsPerRow(z);
+		const int i = unit % w;
+		const int j = unit / w;
+		return func(n, z->img_comp[n].data + z->img_comp[n].w2 * j * 8 + i * 8);
+	}
+
+	const int i = unit % z->img_mcu_x;
+	const int j = unit / z->img_mcu_x;
+	for (int k = 0; k < z->scan_n; ++k)
+	{
+		const int n = z->order[k];
+		for (int y = 0; y < z->img_comp[n].v; ++y)
+		{
+			for (int x = 0; x < z->img_comp[n].h; ++x)
+			{
+				const int x2 = (i * z->img_comp[n].h + x) * 8;
+				const int y2 = (j * z->img_comp[n].v + y) * 8;
+				if (!func(n, z->img_comp[n].data + z->img_comp[n].w2 * y2 + x2))
+				{
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Decodes units [begin, end) from the current position of z->s and counts
+// down the restart interval after each. With coefficients the blocks are
+// stored there in order instead of being transformed right away.
+static ImageDecoderStatus ImageDecoderDecodeUnits(stbi__jpeg* z, int begin, int end, short* coefficients)
+{
+	STBI_SIMD_ALIGN(short, data[64]);
+	for (int unit = begin; unit < end; ++unit)
+	{
+		const bool decoded = ImageDecoderForEachBlock(z, unit, [&](int n, stbi_uc* out)
+			{
+				short* block = coefficients ? coefficients : data;
+				const int ha = z->img_comp[n].ha;
+				if (!stbi__jpeg_decode_block(z, block, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n,
+					z->dequant[z->img_comp[n].tq]))
+				{
+					return false;
+				}
+				if (coefficients)
+				{
+					coefficients += 64;
+				}
+				else
+				{
+					z->idct_block_kernel(out, z->img_comp[n].w2, data);
+				}
+				return true;
+			});
+		if (!decoded)
+		{
+			return ImageDecoderStatus::Failed;
+		}
+
+		if (--z->todo <= 0)
+		{
+			if (z->code_bits < 24)
+			{
+				stbi__grow_buffer_unsafe(z);
+			}
+			if (!STBI__RESTART(z->marker))
+			{
+				return ImageDecoderStatus::Done;
+			}
+			stbi__jpeg_reset(z);
+		}
+	}
+	return ImageDecoderStatus::More;
+}
+
+static void ImageDecoderTransformUnits(stbi__jpeg* z, int begin, int end, const short* coefficients)
+{
+	for (int unit = begin; unit < end; ++unit)
+	{
+		ImageDecoderForEachBlock(z, unit, [&](int n, stbi_uc* out)
+			{
+				z->idct_block_kernel(out, z->img_comp[n].w2, const_cast<short*>(coefficients));
+				coefficients += 64;
+				return true;
+			});
+	}
+}
+
+// Every restart interval can be decoded on its own once its start is known.
+// Finds the bytes following each RSTn marker of the scan at the current
+// position and where the scan ends, false if the markers do not match the
+// number of intervals the frame needs.
+static bool ImageDecoderFindIntervals(const stbi__jpeg* z, int numUnits, std::vector<const stbi_uc*>* starts, const stbi_uc** scanEnd)
+{
+	const stbi_uc* p = z->s->img_buffer;
+	const stbi_uc* end = z->s->img_buffer_end;
+	starts->assign(1, p);
+	*scanEnd = end;
+	while (p < end)
+	{
+		p = (const stbi_uc*)memchr(p, 0xff, end - p);
+		if (!p)
+		{
+			break;
+		}
+		// markers may be preceded by any number of fill bytes
+		const stbi_uc* q = p + 1;
+		while (q < end && *q == 0xff)
+		{
+			++q;
+		}
+		if (q == end)
+		{
+			break;
+		}
+		if (*q == 0)
+		{
+			p = q + 1;
+		}
+		else if (STBI__RESTART(*q))
+		{
+			starts->push_back(q + 1);
+			p = q + 1;
+		}
+		else
+		{
+			*scanEnd = p;
+			break;
+		}
+	}
+	const size_t numIntervals = ((size_t)numUnits + z->restart_interval - 1) / z->restart_interval;
+	return starts->size() == numIntervals;
+}
+
+// Each job decodes a run of restart intervals with its own copy of the decoder state
+static bool ImageDecoderDecodeIntervals(stbi__jpeg* z, int numUnits, const std::vector<const stbi_uc*>& starts,
+	const stbi_uc* scanEnd, JobSystem* jobs)
+{
+	const uint32_t numIntervals = (uint32_t)starts.size();
+	const uint32_t intervalsPerJob = std::max(1u, (uint32_t)(IMAGE_DECODER_MIN_JOB_UNITS / z->restart_interval));
+	const uint32_t numJobs = (numIntervals + intervalsPerJob - 1) / intervalsPerJob;
+	std::atomic<bool> failed(false);
+	jobs->ParallelFor(numJobs, 1, [&](uint32_t begin, uint32_t end)
+		{
+			std::unique_ptr<stbi__jpeg> job(new stbi__jpeg);
+			stbi__context s;
+			for (uint32_t i = begin; i < end && !failed; ++i)
+			{
+				const uint32_t first = i * intervalsPerJob;
+				const uint32_t last = std::min(first + intervalsPerJob, numIntervals);
+				memcpy(job.get(), z, sizeof(stbi__jpeg));
+				stbi__start_mem(&s, starts[first], (int)(z->s->img_buffer_end - starts[first]));
+				job->s = &s;
+				stbi__jpeg_reset(job.get());
+				const int unitBegin = (int)first * z->restart_interval;
+				const int unitEnd = std::min((int)last * z->restart_interval, numUnits);
+				if (ImageDecoderDecodeUnits(job.get(), unitBegin, unitEnd, nullptr) == ImageDecoderStatus::Failed)
+				{
+					failed = true;
+				}
+			}
+		});
+
+	// continue after the scan as if it had been decoded serially
+	z->s->img_buffer = (stbi_uc*)scanEnd;
+	z->marker = STBI__MARKER_none;
+	return !failed;
+}
+
+// Without usable restart markers the Huffman decode stays serial, but the
+// IDCTs of one band of units run on the other threads while the next band
+// is decoded.
+static bool ImageDecoderDecodePipelined(stbi__jpeg* z, int numUnits, JobSystem* jobs)
+{
+	const int unitsPerBand = ImageDecoderUnitsPerRow(z) * IMAGE_DECODER_BAND_UNIT_ROWS;
+	const int numBands = (numUnits + unitsPerBand - 1) / unitsPerBand;
+	const size_t bandShorts = (size_t)unitsPerBand * ImageDecoderBlocksPerUnit(z) * 64;
+	// the SIMD IDCT loads its input aligned
+	std::vector<short> storage(bandShorts * 2 + 8);
+	short* bands[2];
+	bands[0] = (short*)(((uintptr_t)&storage[0] + 15) & ~(uintptr_t)15);
+	bands[1] = bands[0] + bandShorts;
+
+	ImageDecoderStatus status = ImageDecoderDecodeUnits(z, 0, std::min(unitsPerBand, numUnits), bands[0]);
+	int decodedEnd = std::min(unitsPerBand, numUnits);
+	const uint32_t numTransformJobs = std::max(1u, jobs->GetNumThreads());
+	for (int band = 0; band < numBands && status != ImageDecoderStatus::Failed; ++band)
+	{
+		const int bandBegin = band * unitsPerBand;
+		const int bandEnd = std::min(decodedEnd, bandBegin + unitsPerBand);
+		const int nextEnd = std::min(bandEnd + unitsPerBand, numUnits);
+		const bool decodeNext = status == ImageDecoderStatus::More && bandEnd < nextEnd;
+		const short* coefficients = bands[band & 1];
+		short* nextCoefficients = bands[(band + 1) & 1];
+		const uint32_t bandUnits = (uint32_t)std::max(0, bandEnd - bandBegin);
+
+		// index 0 decodes the next band, the others transform this one
+		jobs->ParallelFor(1 + numTransformJobs, 1, [&](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					if (i == 0)
+					{
+						if (decodeNext)
+						{
+							status = ImageDecoderDecodeUnits(z, bandEnd, nextEnd, nextCoefficients);
+						}
+						continue;
+					}
+					const int first = bandBegin + (int)((i - 1) * bandUnits / numTransformJobs);
+					const int last = bandBegin + (int)(i * bandUnits / numTransformJobs);
+					const size_t offset = (size_t)(first - bandBegin) * ImageDecoderBlocksPerUnit(z) * 64;
+					ImageDecoderTransformUnits(z, first, last, coefficients + offset);
+				}
+			});
+		if (decodeNext)
+		{
+			decodedEnd = nextEnd;
+		}
+		else
+		{
+			// stopped early, nothing more to transform
+			break;
+		}
+	}
+	return status != ImageDecoderStatus::Failed;
+}
+
+// stbi__parse_entropy_coded_data for baseline scans
+static bool ImageDecoderDecodeScan(stbi__jpeg* z, JobSystem* jobs)
+{
+	if (z->scan_n != z->s->img_n && z->scan_n != 1)
+	{
+		return stbi__parse_entropy_coded_data(z) != 0;
+	}
+
+	stbi__jpeg_reset(z);
+	const int numUnits = ImageDecoderUnitsPerRow(z) * ImageDecoderUnitRows(z);
+	if (z->restart_interval > 0)
+	{
+		std::vector<const stbi_uc*> starts;
+		const stbi_uc* scanEnd = nullptr;
+		if (ImageDecoderFindIntervals(z, numUnits, &starts, &scanEnd) && starts.size() > 1)
+		{
+			return ImageDecoderDecodeIntervals(z, numUnits, starts, scanEnd, jobs);
+		}
+	}
+	return ImageDecoderDecodePipelined(z, numUnits, jobs);
+}
+
+// stbi__decode_jpeg_image with the scans decoded on the job system
+static bool ImageDecoderDecodeImage(stbi__jpeg* z, JobSystem* jobs)
+{
+	int m = stbi__get_marker(z);
+	while (!stbi__EOI(m))
+	{
+		if (stbi__SOS(m))
+		{
+			if (!stbi__process_scan_header(z) || !ImageDecoderDecodeScan(z, jobs))
+			{
+				return false;
+			}
+			if (z->marker == STBI__MARKER_none)
+			{
+				// padding after the entropy coded data
+				while (!stbi__at_eof(z->s))
+				{
+					if (stbi__get8(z->s) == 255)
+					{
+						z->marker = stbi__get8(z->s);
+						break;
+					}
+				}
+			}
+		}
+		else if (stbi__DNL(m))
+		{
+			const int length = stbi__get16be(z->s);
+			const stbi__uint32 numLines = stbi__get16be(z->s);
+			if (length != 4 || numLines != z->s->img_y)
+			{
+				return false;
+			}
+		}
+		else if (!stbi__process_marker(z, m))
+		{
+			return false;
+		}
+		m = stbi__get_marker(z);
+	}
+	return true;
+}
+
+// Upsamples and converts output rows [y0, y1) exactly like load_jpeg_image
+static void ImageDecoderConvertRows(stbi__jpeg* z, int n, bool isRGB, stbi_uc* output, uint32_t y0, uint32_t y1)
+{
+	const int decodeN = z->s->img_n;
+	const uint32_t width = z->s->img_x;
+	std::vector<stbi_uc> linebufs((size_t)decodeN * (width + 3));
+	stbi__resample resample[4];
+	stbi_uc* coutput[4] = { nullptr, nullptr, nullptr, nullptr };
+	for (int k = 0; k < decodeN; ++k)
+	{
+		stbi__resample* r = &resample[k];
+		r->hs = z->img_h_max / z->img_comp[k].h;
+		r->vs = z->img_v_max / z->img_comp[k].v;
+		r->ystep = r->vs >> 1;
+		r->w_lores = (width + r->hs - 1) / r->hs;
+		r->ypos = 0;
+		r->line0 = r->line1 = z->img_comp[k].data;
+
+		if (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+		else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+		else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+		else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+		else r->resample = stbi__resample_row_generic;
+
+		// the source rows only depend on how many output rows came before
+		for (uint32_t j = 0; j < y0; ++j)
+		{
+			if (++r->ystep >= r->vs)
+			{
+				r->ystep = 0;
+				r->line0 = r->line1;
+				if (++r->ypos < z->img_comp[k].y)
+				{
+					r->line1 += z->img_comp[k].w2;
+				}
+			}
+		}
+	}
+
+	// the stb kernels always write a fourth byte, which for three channels is
+	// the next row and may belong to another job by now
+	std::vector<stbi_uc> lastRow(n == 3 ? (size_t)width * 3 + 1 : 0);
+	for (uint32_t j = y0; j < y1; ++j)
+	{
+		stbi_uc* const row = n == 3 && j + 1 == y1 ? &lastRow[0] : output + (size_t)n * width * j;
+		stbi_uc* out = row;
+		for (int k = 0; k < decodeN; ++k)
+		{
+			stbi__resample* r = &resample[k];
+			const int yBottom = r->ystep >= (r->vs >> 1);
+			coutput[k] = r->resample(&linebufs[k * (width + 3)], yBottom ? r->line1 : r->line0, yBottom ? r->line0 : r->line1,
+				r->w_lores, r->hs);
+			if (++r->ystep >= r->vs)
+			{
+				r->ystep = 0;
+				r->line0 = r->line1;
+				if (++r->ypos < z->img_comp[k].y)
+				{
+					r->line1 += z->img_comp[k].w2;
+				}
+			}
+		}
+
+		const stbi_uc* y = coutput[0];
+		if (decodeN == 3)
+		{
+			if (isRGB)
+			{
+				for (uint32_t i = 0; i < width; ++i, out += n)
+				{
+					out[0] = y[i];
+					out[1] = coutput[1][i];
+					out[2] = coutput[2][i];
+					out[3] = 255;
+				}
+			}
+			else
+			{
+				z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], width, n);
+			}
+		}
+		else if (decodeN == 4)
+		{
+			if (z->app14_color_transform == 0)
+			{
+				// CMYK
+				for (uint32_t i = 0; i < width; ++i, out += n)
+				{
+					const stbi_uc m = coutput[3][i];
+					out[0] = stbi__blinn_8x8(coutput[0][i], m);
+					out[1] = stbi__blinn_8x8(coutput[1][i], m);
+					out[2] = stbi__blinn_8x8(coutput[2][i], m);
+					out[3] = 255;
+				}
+			}
+			else if (z->app14_color_transform == 2)
+			{
+				// YCCK
+				z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], width, n);
+				for (uint32_t i = 0; i < width; ++i, out += n)
+				{
+					const stbi_uc m = coutput[3][i];
+					out[0] = stbi__blinn_8x8(255 - out[0], m);
+					out[1] = stbi__blinn_8x8(255 - out[1], m);
+					out[2] = stbi__blinn_8x8(255 - out[2], m);
+				}
+			}
+			else
+			{
+				z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], width, n);
+			}
+		}
+		else
+		{
+			for (uint32_t i = 0; i < width; ++i, out += n)
+			{
+				out[0] = out[1] = out[2] = y[i];
+				out[3] = 255;
+			}
+		}
+		if (row != output + (size_t)n * width * j)
+		{
+			memcpy(output + (size_t)n * width * j, row, (size_t)n * width);
+		}
+	}
+}
+
+// Only baseline JPEGs converted to RGB or RGBA take the parallel path, null means use stbi
+static stbi_uc* ImageDecoderLoadJPEG(const stbi_uc* data, size_t size, int* width, int* height, int* channelsInFile,
+	int desiredChannels, JobSystem* jobs)
+{
+	if (!jobs || jobs->GetNumThreads() == 0 || desiredChannels < 3 || size > INT_MAX ||
+		size < 2 || data[0] != 0xff || data[1] != 0xd8)
+	{
+		return nullptr;
+	}
+
+	stbi__context s;
+	stbi__start_mem(&s, data, (int)size);
+	std::unique_ptr<stbi__jpeg> z(new stbi__jpeg);
+	z->s = &s;
+	stbi__setup_jpeg(z.get());
+	// makes stbi__cleanup_jpeg safe before the frame header is read
+	s.img_n = 0;
+	for (int k = 0; k < 4; ++k)
+	{
+		z->img_comp[k].raw_data = nullptr;
+		z->img_comp[k].raw_coeff = nullptr;
+		z->img_comp[k].linebuf = nullptr;
+	}
+	z->restart_interval = 0;
+
+	if (!stbi__decode_jpeg_header(z.get(), STBI__SCAN_load) || z->progressive ||
+		(uint64_t)s.img_x * s.img_y < IMAGE_DECODER_MIN_PARALLEL_PIXELS || !ImageDecoderDecodeImage(z.get(), jobs))
+	{
+		stbi__cleanup_jpeg(z.get());
+		return nullptr;
+	}
+
+	const int n = desiredChannels;
+	const bool isRGB = s.img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+	stbi_uc* output = (stbi_uc*)stbi__malloc_mad3(n, s.img_x, s.img_y, 1);
+	if (output)
+	{
+		const uint32_t numBatches = (s.img_y + IMAGE_DECODER_CONVERT_ROWS - 1) / IMAGE_DECODER_CONVERT_ROWS;
+		jobs->ParallelFor(numBatches, 1, [&](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					const uint32_t y0 = i * IMAGE_DECODER_CONVERT_ROWS;
+					ImageDecoderConvertRows(z.get(), n, isRGB, output, y0, std::min(y0 + IMAGE_DECODER_CONVERT_ROWS, s.img_y));
+				}
+			});
+		*width = s.img_x;
+		*height = s.img_y;
+		if (channelsInFile)
+		{
+			*channelsInFile = s.img_n >= 3 ? 3 : 1;
+		}
+	}
+	stbi__cleanup_jpeg(z.get());
+	return output;
+}
+
+unsigned char* ImageDecoderLoadFromMemory(const uint8_t* data, size_t size, int* width, int* height, int* channelsInFile,
+	int desiredChannels, JobSystem* jobs)
+{
+	unsigned char* pixels = ImageDecoderLoadJPEG(data, size, width, height, channelsInFile, desiredChannels, jobs);
+	if (!pixels && size <= INT_MAX)
+	{
+		pixels = stbi_load_from_memory(data, (int)size, width, height, channelsInFile, desiredChannels);
+	}
+	return pixels;
+}
+
+unsigned char* ImageDecoderLoad(const char* filename, int* width, int* height, int* channelsInFile, int desiredChannels, JobSystem* jobs)
+{
+	MappedFile file;
+	if (!file.Open(filename))
+	{
+		return nullptr;
+	}
+	return ImageDecoderLoadFromMemory(file.GetData(), file.GetSize(), width, height, channelsInFile, desiredChannels, jobs);
+}
+
+void ImageDecoderFree(unsigned char* pixels)
+{
+	stbi_image_free(pixels);
+}
+
+#if defined(IMAGE_DECODER_TEST) || defined(IMAGE_DECODER_BENCHMARK)
+#include <math.h>
+
+// Minimal baseline JPEG encoder for the test and the benchmark. Every
+// Huffman code is 4 bits for DC and 8 bits for AC, which is valid and keeps
+// the tables trivial.
+struct ImageDecoderTestComponent
+{
+	int H;
+	int V;
+	int Table;
+};
+
+class ImageDecoderTestWriter
+{
+public:
+	void Byte(uint8_t value) { Bytes.push_back(value); }
+	void Word(uint32_t value) { Byte((uint8_t)(value >> 8)); Byte((uint8_t)value); }
+
+	void Bits(uint32_t value, int count)
+	{
+		for (int i = count - 1; i >= 0; --i)
+		{
+			m_Accumulator = (m_Accumulator << 1) | ((value >> i) & 1);
+			if (++m_NumBits == 8)
+			{
+				Byte((uint8_t)m_Accumulator);
+				if (m_Accumulator == 0xff)
+				{
+					Byte(0);
+				}
+				m_Accumulator = 0;
+				m_NumBits = 0;
+			}
+		}
+	}
+
+	// pads the last byte with ones
+	void Flush()
+	{
+		while (m_NumBits != 0)
+		{
+			Bits(1, 1);
+		}
+	}
+
+	std::vector<uint8_t> Bytes;
+
+private:
+	uint32_t m_Accumulator = 0;
+	int m_NumBits = 0;
+};
+
+static int ImageDecoderTestCategory(int value)
+{
+	int category = 0;
+	for (int magnitude = value < 0 ? -value : value; magnitude != 0; magnitude >>= 1)
+	{
+		++category;
+	}
+	return category;
+}
+
+// Magnitude bits follow the category, negative values are stored minus one
+static void ImageDecoderTestValue(ImageDecoderTestWriter* writer, int value, int category)
+{
+	if (category > 0)
+	{
+		writer->Bits((uint32_t)(value < 0 ? value - 1 : value) & ((1u << category) - 1), category);
+	}
+}
+
+// AC symbol of (run, size) in the order the DHT lists them
+static int ImageDecoderTestACSymbol(int run, int size)
+{
+	if (size == 0)
+	{
+		return run == 0 ? 0 : 1;
+	}
+	return 2 + run * 10 + size - 1;
+}
+
+// planes holds one 8 bit plane per component at its own resolution,
+// ceil(width * H / Hmax) by ceil(height * V / Vmax)
+static std::vector<uint8_t> ImageDecoderTestEncode(const std::vector<std::vector<uint8_t>>& planes,
+	const ImageDecoderTestComponent* components, int numComponents, int width, int height, int restartInterval)
+{
+	static const uint8_t quantization[2][64] = {
+		{ 16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55, 14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+		  18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92, 49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99 },
+		{ 17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99, 24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+		  99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99 }
+	};
+	// EOB, ZRL, then every run with sizes 1 to 10
+	uint8_t acSymbols[162];
+	acSymbols[0] = 0x00;
+	acSymbols[1] = 0xf0;
+	for (int run = 0; run < 16; ++run)
+	{
+		for (int size = 1; size <= 10; ++size)
+		{
+			acSymbols[ImageDecoderTestACSymbol(run, size)] = (uint8_t)(run << 4 | size);
+		}
+	}
+
+	float basis[8][8];
+	for (int x = 0; x < 8; ++x)
+	{
+		for (int u = 0; u < 8; ++u)
+		{
+			basis[x][u] = (u == 0 ? sqrtf(0.5f) : 1.0f) * 0.5f * cosf((2 * x + 1) * u * 3.14159265f / 16.0f);
+		}
+	}
+
+	int hMax = 1;
+	int vMax = 1;
+	for (int c = 0; c < numComponents; ++c)
+	{
+		hMax = std::max(hMax, components[c].H);
+		vMax = std::max(vMax, components[c].V);
+	}
+
+	ImageDecoderTestWriter out;
+	out.Word(0xffd8);
+	for (int t = 0; t < 2; ++t)
+	{
+		out.Word(0xffdb);
+		out.Word(67);
+		out.Byte((uint8_t)t);
+		for (int k = 0; k < 64; ++k)
+		{
+			out.Byte(quantization[t][stbi__jpeg_dezigzag[k]]);
+		}
+	}
+	out.Word(0xffc0);
+	out.Word(8 + 3 * numComponents);
+	out.Byte(8);
+	out.Word(height);
+	out.Word(width);
+	out.Byte((uint8_t)numComponents);
+	for (int c = 0; c < numComponents; ++c)
+	{
+		out.Byte((uint8_t)(c + 1));
+		out.Byte((uint8_t)(components[c].H << 4 | components[c].V));
+		out.Byte((uint8_t)components[c].Table);
+	}
+	for (int t = 0; t < 2; ++t)
+	{
+		out.Word(0xffc4);
+		out.Word(2 + 17 + 12);
+		out.Byte((uint8_t)t);
+		for (int length = 1; length <= 16; ++length)
+		{
+			out.Byte(length == 4 ? 12 : 0);
+		}
+		for (int symbol = 0; symbol < 12; ++symbol)
+		{
+			out.Byte((uint8_t)symbol);
+		}
+		out.Word(0xffc4);
+		out.Word(2 + 17 + 162);
+		out.Byte((uint8_t)(0x10 | t));
+		for (int length = 1; length <= 16; ++length)
+		{
+			out.Byte(length == 8 ? 162 : 0);
+		}
+		for (int symbol = 0; symbol < 162; ++symbol)
+		{
+			out.Byte(acSymbols[symbol]);
+		}
+	}
+	if (restartInterval > 0)
+	{
+		out.Word(0xffdd);
+		out.Word(4);
+		out.Word(restartInterval);
+	}
+	out.Word(0xffda);
+	out.Word(6 + 2 * numComponents);
+	out.Byte((uint8_t)numComponents);
+	for (int c = 0; c < numComponents; ++c)
+	{
+		out.Byte((uint8_t)(c + 1));
+		out.Byte((uint8_t)(components[c].Table << 4 | components[c].Table));
+	}
+	out.Byte(0);
+	out.Byte(63);
+	out.Byte(0);
+
+	// a single component is coded block by block instead of in MCUs
+	const bool interleaved = numComponents > 1;
+	const int unitsX = interleaved ? (width + 8 * hMax - 1) / (8 * hMax) : (width + 7) / 8;
+	const int unitsY = interleaved ? (height + 8 * vMax - 1) / (8 * vMax) : (height + 7) / 8;
+	int predictions[4] = {};
+	int numRestarts = 0;
+	for (int unit = 0; unit < unitsX * unitsY; ++unit)
+	{
+		if (restartInterval > 0 && unit > 0 && unit % restartInterval == 0)
+		{
+			out.Flush();
+			out.Word(0xffd0 + (numRestarts++ & 7));
+			memset(predictions, 0, sizeof(predictions));
+		}
+		for (int c = 0; c < numComponents; ++c)
+		{
+			const ImageDecoderTestComponent& component = components[c];
+			const int planeWidth = (width * component.H + hMax - 1) / hMax;
+			const int planeHeight = (height * component.V + vMax - 1) / vMax;
+			const int blocksX = interleaved ? component.H : 1;
+			const int blocksY = interleaved ? component.V : 1;
+			for (int by = 0; by < blocksY; ++by)
+			{
+				for (int bx = 0; bx < blocksX; ++bx)
+				{
+					// edge texels are repeated past the plane
+					const int x0 = ((unit % unitsX) * blocksX + bx) * 8;
+					const int y0 = ((unit / unitsX) * blocksY + by) * 8;
+					float samples[8][8];
+					for (int y = 0; y < 8; ++y)
+					{
+						for (int x = 0; x < 8; ++x)
+						{
+							const int px = std::min(x0 + x, planeWidth - 1);
+							const int py = std::min(y0 + y, planeHeight - 1);
+							samples[y][x] = (float)planes[c][py * planeWidth + px] - 128.0f;
+						}
+					}
+					int coefficients[64];
+					for (int v = 0; v < 8; ++v)
+					{
+						for (int u = 0; u < 8; ++u)
+						{
+							float sum = 0.0f;
+							for (int y = 0; y < 8; ++y)
+							{
+								for (int x = 0; x < 8; ++x)
+								{
+									sum += samples[y][x] * basis[x][u] * basis[y][v];
+								}
+							}
+							coefficients[v * 8 + u] = (int)floorf(sum / quantization[component.Table][v * 8 + u] + 0.5f);
+						}
+					}
+
+					const int dc = coefficients[0] - predictions[c];
+					predictions[c] = coefficients[0];
+					const int dcCategory = ImageDecoderTestCategory(dc);
+					out.Bits((uint32_t)dcCategory, 4);
+					ImageDecoderTestValue(&out, dc, dcCategory);
+					int run = 0;
+					for (int k = 1; k < 64; ++k)
+					{
+						const int value = coefficients[stbi__jpeg_dezigzag[k]];
+						if (value == 0)
+						{
+							++run;
+							continue;
+						}
+						for (; run >= 16; run -= 16)
+						{
+							out.Bits((uint32_t)ImageDecoderTestACSymbol(15, 0), 8);
+						}
+						const int category = ImageDecoderTestCategory(value);
+						out.Bits((uint32_t)ImageDecoderTestACSymbol(run, category), 8);
+						ImageDecoderTestValue(&out, value, category);
+						run = 0;
+					}
+					if (run > 0)
+					{
+						out.Bits((uint32_t)ImageDecoderTestACSymbol(0, 0), 8);
+					}
+				}
+			}
+		}
+	}
+	out.Flush();
+	out.Word(0xffd9);
+	return out.Bytes;
+}
+
+// Smooth shapes with noise, roughly what photos cost to decode
+static std::vector<uint8_t> ImageDecoderTestImage(const ImageDecoderTestComponent* components, int numComponents,
+	int width, int height, int restartInterval)
+{
+	int hMax = 1;
+	int vMax = 1;
+	for (int c = 0; c < numComponents; ++c)
+	{
+		hMax = std::max(hMax, components[c].H);
+		vMax = std::max(vMax, components[c].V);
+	}
+	std::vector<std::vector<uint8_t>> planes(numComponents);
+	uint32_t seed = 7;
+	for (int c = 0; c < numComponents; ++c)
+	{
+		const int planeWidth = (width * components[c].H + hMax - 1) / hMax;
+		const int planeHeight = (height * components[c].V + vMax - 1) / vMax;
+		planes[c].resize((size_t)planeWidth * planeHeight);
+		for (int y = 0; y < planeHeight; ++y)
+		{
+			for (int x = 0; x < planeWidth; ++x)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				const float wave = 90.0f * sinf(x * (0.011f + 0.004f * c)) * cosf(y * 0.017f);
+				const int value = 128 + (int)wave + (int)(seed >> 28) - 8;
+				planes[c][(size_t)y * planeWidth + x] = (uint8_t)std::min(255, std::max(0, value));
+			}
+		}
+	}
+	return ImageDecoderTestEncode(planes, components, numComponents, width, height, restartInterval);
+}
+#endif
+
+#ifdef IMAGE_DECODER_TEST
+#include <assert.h>
+
+static void TestImageDecoderMatches(const std::vector<uint8_t>& file, JobSystem* jobs)
+{
+	for (int channels = 0; channels <= 4; ++channels)
+	{
+		int expectedWidth = 0;
+		int expectedHeight = 0;
+		int expectedChannels = 0;
+		stbi_uc* expected = stbi_load_from_memory(&file[0], (int)file.size(), &expectedWidth, &expectedHeight, &expectedChannels, channels);
+		assert(expected);
+
+		int width = 0;
+		int height = 0;
+		int channelsInFile = 0;
+		unsigned char* pixels = ImageDecoderLoadFromMemory(&file[0], file.size(), &width, &height, &channelsInFile, channels, jobs);
+		assert(pixels);
+		assert(width == expectedWidth && height == expectedHeight && channelsInFile == expectedChannels);
+		const int outChannels = channels ? channels : expectedChannels;
+		assert(memcmp(pixels, expected, (size_t)width * height * outChannels) == 0);
+		ImageDecoderFree(pixels);
+		stbi_image_free(expected);
+	}
+}
+
+void ImageDecoderTest(void)
+{
+	JobSystem jobs;
+	jobs.Init(4);
+
+	const ImageDecoderTestComponent gray[] = { { 1, 1, 0 } };
+	const ImageDecoderTestComponent full[] = { { 1, 1, 0 }, { 1, 1, 1 }, { 1, 1, 1 } };
+	const ImageDecoderTestComponent half[] = { { 2, 1, 0 }, { 1, 1, 1 }, { 1, 1, 1 } };
+	const ImageDecoderTestComponent quarter[] = { { 2, 2, 0 }, { 1, 1, 1 }, { 1, 1, 1 } };
+	const ImageDecoderTestComponent* layouts[] = { gray, full, half, quarter };
+	const int numComponents[] = { 1, 3, 3, 3 };
+	// partial MCUs on both edges, intervals that do and do not divide the image
+	const int restartIntervals[] = { 0, 1, 7, 64 };
+	for (int layout = 0; layout < 4; ++layout)
+	{
+		for (int restartInterval : restartIntervals)
+		{
+			TestImageDecoderMatches(ImageDecoderTestImage(layouts[layout], numComponents[layout], 517, 301, restartInterval), &jobs);
+		}
+	}
+
+	// too small to split, and a corrupt file fails like stbi
+	TestImageDecoderMatches(ImageDecoderTestImage(quarter, 3, 61, 47, 0), &jobs);
+	std::vector<uint8_t> truncated = ImageDecoderTestImage(full, 3, 400, 300, 16);
+	truncated.resize(truncated.size() / 2);
+	int width = 0;
+	int height = 0;
+	assert(!ImageDecoderLoadFromMemory(&truncated[0], truncated.size(), &width, &height, nullptr, 4, &jobs) ==
+		!stbi_load_from_memory(&truncated[0], (int)truncated.size(), &width, &height, nullptr, 4));
+}
+#endif
+
+#ifdef IMAGE_DECODER_BENCHMARK
+#include "Utils.h"
+
+#include <chrono>
+
+void ImageDecoderBenchmark(JobSystem* jobs)
+{
+	const ImageDecoderTestComponent quarter[] = { { 2, 2, 0 }, { 1, 1, 1 }, { 1, 1, 1 } };
+	const int sizes[] = { 4096, 8192 };
+	for (int size : sizes)
+	{
+		for (int restartInterval = 0; restartInterval <= 64; restartInterval += 64)
+		{
+			const std::vector<uint8_t> file = ImageDecoderTestImage(quarter, 3, size, size, restartInterval);
+			const double megapixels = (double)size * size / 1000000.0;
+			double seconds[2] = {};
+			for (int parallel = 0; parallel < 2; ++parallel)
+			{
+				int width = 0;
+				int height = 0;
+				const auto start = std::chrono::steady_clock::now();
+				unsigned char* pixels = parallel ?
+					ImageDecoderLoadFromMemory(&file[0], file.size(), &width, &height, nullptr, 4, jobs) :
+					stbi_load_from_memory(&file[0], (int)file.size(), &width, &height, nullptr, 4);
+				seconds[parallel] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				stbi_image_free(pixels);
+			}
+			UtilsDebugPrint("JPEG %dx%d, restart interval %d: stbi %.1f MP/s, parallel %.1f MP/s (%.2fx)\n",
+				size, size, restartInterval, megapixels / seconds[0], megapixels / seconds[1], seconds[0] / seconds[1]);
+		}
+	}
+}
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Image loading behind the stbi_load interface that spreads a single image
+// over the job system. Baseline JPEGs decode their restart intervals in
+// parallel, files without restart markers overlap the serial Huffman decode
+// with the IDCTs of the previous band, and upsampling plus color conversion
+// are split by rows. The kernels are the ones stb_image uses, so the pixels
+// match stbi_load bit for bit. Everything else (progressive JPEGs, PNG, ...)
+// goes through stb_image unchanged.
+
+// Smaller images are not worth splitting
+#define IMAGE_DECODER_MIN_PARALLEL_PIXELS (256 * 256)
+
+class JobSystem;
+
+// Same arguments and results as stbi_load, jobs may be null. Free the pixels with ImageDecoderFree.
+unsigned char* ImageDecoderLoad(const char* filename, int* width, int* height, int* channelsInFile, int desiredChannels, JobSystem* jobs);
+unsigned char* ImageDecoderLoadFromMemory(const uint8_t* data, size_t size, int* width, int* height, int* channelsInFile,
+	int desiredChannels, JobSystem* jobs);
+void ImageDecoderFree(unsigned char* pixels);
+
+#ifdef IMAGE_DECODER_TEST
+void ImageDecoderTest(void);
+#endif
+
+#ifdef IMAGE_DECODER_BENCHMARK
+// Prints megapixels per second of stbi_load and of the parallel decoder on
+// 4K and 8K JPEGs with and without restart markers, encoded on the fly
+void ImageDecoderBenchmark(JobSystem* jobs);
+#endif
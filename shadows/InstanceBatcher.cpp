@@ -0,0 +1,128 @@
+#include "InstanceBatcher.h"
+
+#include <algorithm>
+#include <assert.h>
+
+InstanceBatcher::InstanceBatcher()
+{
+}
+
+InstanceBatcher::~InstanceBatcher()
+{
+}
+
+void InstanceBatcher::Begin()
+{
+	m_Items.clear();
+	m_SortedItems.clear();
+	m_Instances.clear();
+	m_Batches.clear();
+}
+
+void InstanceBatcher::Add(uint64_t meshKey, uint64_t materialKey, uint32_t materialIdx, const Mat4X4& world)
+{
+	DrawItem item = {};
+	item.MeshKey = meshKey;
+	item.MaterialKey = materialKey;
+	item.MaterialIdx = materialIdx;
+	item.ItemIdx = (uint32_t)m_Items.size();
+	item.World = world;
+	m_Items.emplace_back(item);
+}
+
+void InstanceBatcher::Build()
+{
+	m_SortedItems.resize(m_Items.size());
+	for (uint32_t i = 0; i < m_SortedItems.size(); ++i)
+	{
+		m_SortedItems[i] = i;
+	}
+
+	// stable sort keeps submission order inside a batch
+	std::stable_sort(m_SortedItems.begin(), m_SortedItems.end(),
+		[this](uint32_t lhs, uint32_t rhs)
+		{
+			const DrawItem& a = m_Items[lhs];
+			const DrawItem& b = m_Items[rhs];
+			if (a.MaterialKey != b.MaterialKey)
+				return a.MaterialKey < b.MaterialKey;
+			return a.MeshKey < b.MeshKey;
+		});
+
+	m_Instances.reserve(m_Items.size());
+
+	for (uint32_t i = 0; i < m_SortedItems.size(); ++i)
+	{
+		const DrawItem& item = m_Items[m_SortedItems[i]];
+
+		if (m_Batches.empty() ||
+			m_Batches.back().MeshKey != item.MeshKey ||
+			m_Batches.back().MaterialKey != item.MaterialKey)
+		{
+			InstanceBatch batch = {};
+			batch.MeshKey = item.MeshKey;
+			batch.MaterialKey = item.MaterialKey;
+			batch.FirstInstance = (uint32_t)m_Instances.size();
+			batch.ItemIdx = item.ItemIdx;
+			m_Batches.emplace_back(batch);
+		}
+
+		InstanceData instance = {};
+		instance.World = item.World;
+		instance.MaterialIdx = item.MaterialIdx;
+		m_Instances.emplace_back(instance);
+		++m_Batches.back().NumInstances;
+	}
+}
+
+#ifdef INSTANCE_BATCHER_TEST
+void InstanceBatcherTest(void)
+{
+	InstanceBatcher batcher;
+
+	batcher.Begin();
+	batcher.Build();
+	assert(batcher.GetBatches().empty());
+	assert(batcher.GetNumDrawCallsSaved() == 0);
+
+	// two meshes, mesh 1 is used with two different materials
+	const uint64_t meshKeys[] = { 2, 1, 2, 1, 1, 2 };
+	const uint64_t materialKeys[] = { 7, 7, 7, 8, 7, 7 };
+
+	batcher.Begin();
+	for (uint32_t i = 0; i < _countof(meshKeys); ++i)
+	{
+		const Vec3D offset = { (float)i, 0.0f, 0.0f };
+		batcher.Add(meshKeys[i], materialKeys[i], (uint32_t)materialKeys[i] - 7, MathMat4X4TranslateFromVec3D(&offset));
+	}
+	batcher.Build();
+
+	const std::vector<InstanceBatch>& batches = batcher.GetBatches();
+	const std::vector<InstanceData>& instances = batcher.GetInstances();
+	assert(batches.size() == 3);
+	assert(instances.size() == 6);
+	assert(batcher.GetNumDrawCallsSaved() == 3);
+
+	assert(batches[0].MeshKey == 1 && batches[0].MaterialKey == 7);
+	assert(batches[0].FirstInstance == 0 && batches[0].NumInstances == 2);
+	assert(batches[0].ItemIdx == 1);
+	assert(batches[1].MeshKey == 2 && batches[1].MaterialKey == 7);
+	assert(batches[1].FirstInstance == 2 && batches[1].NumInstances == 3);
+	assert(batches[2].MeshKey == 1 && batches[2].MaterialKey == 8);
+	assert(batches[2].FirstInstance == 5 && batches[2].NumInstances == 1);
+
+	// instances keep submission order inside a batch
+	assert(instances[0].World.A30 == 1.0f && instances[1].World.A30 == 4.0f);
+	assert(instances[2].World.A30 == 0.0f && instances[3].World.A30 == 2.0f && instances[4].World.A30 == 5.0f);
+	assert(instances[5].World.A30 == 3.0f && instances[5].MaterialIdx == 1);
+
+	// every instance belongs to exactly one batch
+	uint32_t total = 0;
+	for (const InstanceBatch& batch : batches)
+	{
+		assert(batch.FirstInstance == total);
+		total += batch.NumInstances;
+	}
+	assert(total == instances.size());
+}
+#endif
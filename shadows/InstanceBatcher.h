@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Math.h"
+
+// Per-instance data streamed through the second input slot of InstancedVS.
+// World is stored row by row, the shader rebuilds the matrix from WORLD0..WORLD3.
+struct InstanceData
+{
+	InstanceData() : World{}, MaterialIdx{0}, pad{0, 0, 0} {}
+	Mat4X4 World;
+	uint32_t MaterialIdx;
+	uint32_t pad[3];
+};
+
+struct InstanceBatch
+{
+	InstanceBatch() : MeshKey{0}, MaterialKey{0}, FirstInstance{0}, NumInstances{0}, ItemIdx{0} {}
+	uint64_t MeshKey;
+	uint64_t MaterialKey;
+	uint32_t FirstInstance;
+	uint32_t NumInstances;
+	// Index of the first submitted item of the batch, used to look up mesh and textures
+	uint32_t ItemIdx;
+};
+
+// Groups draw items that share a mesh and a material into instanced draws.
+// Items are submitted every frame between Begin() and Build(), after Build()
+// instances of the same batch are laid out contiguously so a single instance
+// buffer update serves all batches. Batches are ordered by material first,
+// consecutive draws with the same textures then skip rebinding them.
+class InstanceBatcher
+{
+public:
+	InstanceBatcher();
+	~InstanceBatcher();
+
+	void Begin();
+	void Add(uint64_t meshKey, uint64_t materialKey, uint32_t materialIdx, const Mat4X4& world);
+	void Build();
+
+	const std::vector<InstanceBatch>& GetBatches() const { return m_Batches; }
+	const std::vector<InstanceData>& GetInstances() const { return m_Instances; }
+	uint32_t GetNumItems() const { return (uint32_t)m_Items.size(); }
+	uint32_t GetNumDrawCallsSaved() const { return GetNumItems() - (uint32_t)m_Batches.size(); }
+
+private:
+	struct DrawItem
+	{
+		uint64_t MeshKey;
+		uint64_t MaterialKey;
+		uint32_t MaterialIdx;
+		uint32_t ItemIdx;
+		Mat4X4 World;
+	};
+
+	std::vector<DrawItem> m_Items;
+	std::vector<uint32_t> m_SortedItems;
+	std::vector<InstanceData> m_Instances;
+	std::vector<InstanceBatch> m_Batches;
+};
+
+#ifdef INSTANCE_BATCHER_TEST
+void InstanceBatcherTest(void);
+#endif
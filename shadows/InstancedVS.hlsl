@@ -0,0 +1,28 @@
+#include "Common.hlsli"
+
+struct VSInstancedIn
+{
+	float3 Pos : POSITION;
+	float3 Normal : NORMAL;
+	float2 TexCoords : TEXCOORDS;
+	float4 World0 : WORLD0;
+	float4 World1 : WORLD1;
+	float4 World2 : WORLD2;
+	float4 World3 : WORLD3;
+	uint MaterialIdx : MATERIAL;
+};
+
+VSOut main(VSInstancedIn In)
+{
+	VSOut Out;
+	// rows come from a row major CPU matrix, transpose to match cbuffer packing
+	const float4x4 instanceWorld = transpose(float4x4(In.World0, In.World1, In.World2, In.World3));
+	float4x4 pvw = mul(proj, view);
+	pvw = mul(pvw, instanceWorld);
+	Out.PosH = mul(pvw, float4(In.Pos, 1.0f));
+	Out.TexCoords = In.TexCoords;
+	Out.NormalW = mul(instanceWorld, float4(In.Normal, 0.0f)).xyz;
+	Out.PosW = mul(instanceWorld, float4(In.Pos, 1.0f)).xyz;
+	Out.MaterialIdx = In.MaterialIdx;
+	return Out;
+}
@@ -0,0 +1,212 @@
+#include "JobSystem.h"
+
+#include <assert.h>
+#include <memory>
+
+JobSystem::JobSystem():
+	m_NumPending{0},
+	m_Quit{false}
+{
+}
+
+JobSystem::~JobSystem()
+{
+	Shutdown();
+}
+
+void JobSystem::Init(uint32_t numThreads)
+{
+	Shutdown();
+
+	if (numThreads == 0)
+	{
+		const uint32_t hwThreads = std::thread::hardware_concurrency();
+		numThreads = hwThreads > 1 ? hwThreads - 1 : 1;
+	}
+
+	m_Quit = false;
+	m_Workers.reserve(numThreads);
+	for (uint32_t i = 0; i < numThreads; ++i)
+	{
+		m_Workers.emplace_back(&JobSystem::WorkerLoop, this);
+	}
+}
+
+void JobSystem::Shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+	}
+	m_JobAvailable.notify_all();
+
+	for (std::thread& worker : m_Workers)
+	{
+		worker.join();
+	}
+	m_Workers.clear();
+	m_Jobs.clear();
+	m_NumPending = 0;
+}
+
+void JobSystem::Submit(std::function<void()> job)
+{
+	if (m_Workers.empty())
+	{
+		// not initialized, run inline so callers still work single threaded
+		job();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Jobs.emplace_back(std::move(job));
+		++m_NumPending;
+	}
+	m_JobAvailable.notify_one();
+}
+
+void JobSystem::Wait()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_JobsDone.wait(lock, [this]() { return m_NumPending == 0; });
+}
+
+void JobSystem::WorkerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_JobAvailable.wait(lock, [this]() { return m_Quit || !m_Jobs.empty(); });
+			if (m_Quit)
+			{
+				return;
+			}
+			job = std::move(m_Jobs.front());
+			m_Jobs.pop_front();
+		}
+
+		job();
+
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			--m_NumPending;
+			if (m_NumPending == 0)
+			{
+				m_JobsDone.notify_all();
+			}
+		}
+	}
+}
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t, uint32_t)>& func)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	batchSize = batchSize > 0 ? batchSize : 1;
+	const uint32_t numBatches = (count + batchSize - 1) / batchSize;
+	if (numBatches == 1 || m_Workers.empty())
+	{
+		func(0, count);
+		return;
+	}
+
+	// helpers may still be queued when the caller returns, so the shared
+	// state outlives this frame and helpers without work simply exit
+	struct State
+	{
+		std::atomic<uint32_t> NextBatch;
+		std::atomic<uint32_t> DoneBatches;
+		std::mutex Mutex;
+		std::condition_variable Done;
+	};
+	std::shared_ptr<State> state = std::make_shared<State>();
+	state->NextBatch = 0;
+	state->DoneBatches = 0;
+
+	auto run = [state, numBatches, batchSize, count, &func]()
+	{
+		for (;;)
+		{
+			const uint32_t batch = state->NextBatch.fetch_add(1);
+			if (batch >= numBatches)
+			{
+				return;
+			}
+			const uint32_t begin = batch * batchSize;
+			const uint32_t end = begin + batchSize < count ? begin + batchSize : count;
+			func(begin, end);
+
+			if (state->DoneBatches.fetch_add(1) + 1 == numBatches)
+			{
+				std::lock_guard<std::mutex> lock(state->Mutex);
+				state->Done.notify_all();
+			}
+		}
+	};
+
+	const uint32_t numHelpers = numBatches - 1 < GetNumThreads() ? numBatches - 1 : GetNumThreads();
+	for (uint32_t i = 0; i < numHelpers; ++i)
+	{
+		// helpers only touch func while batches are left, which the caller waits for
+		Submit(run);
+	}
+	run();
+
+	std::unique_lock<std::mutex> lock(state->Mutex);
+	state->Done.wait(lock, [&state, numBatches]() { return state->DoneBatches.load() == numBatches; });
+}
+
+#ifdef JOB_SYSTEM_TEST
+void JobSystemTest(void)
+{
+	JobSystem jobs;
+
+	// without workers everything runs inline
+	uint32_t inlineSum = 0;
+	jobs.Submit([&inlineSum]() { inlineSum += 1; });
+	jobs.ParallelFor(10, 3, [&inlineSum](uint32_t begin, uint32_t end) { inlineSum += end - begin; });
+	assert(inlineSum == 11);
+
+	jobs.Init(4);
+	assert(jobs.GetNumThreads() == 4);
+
+	std::atomic<uint32_t> counter(0);
+	for (uint32_t i = 0; i < 1000; ++i)
+	{
+		jobs.Submit([&counter]() { counter.fetch_add(1); });
+	}
+	jobs.Wait();
+	assert(counter.load() == 1000);
+
+	// every index is visited exactly once
+	std::vector<uint32_t> visits(100003, 0);
+	jobs.ParallelFor((uint32_t)visits.size(), 1000, [&visits](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				++visits[i];
+			}
+		});
+	for (uint32_t visit : visits)
+	{
+		assert(visit == 1);
+	}
+
+	// nested ParallelFor from inside jobs must not deadlock
+	std::atomic<uint32_t> nested(0);
+	jobs.ParallelFor(8, 1, [&jobs, &nested](uint32_t, uint32_t)
+		{
+			jobs.ParallelFor(64, 8, [&nested](uint32_t begin, uint32_t end) { nested.fetch_add(end - begin); });
+		});
+	assert(nested.load() == 8 * 64);
+
+	jobs.Shutdown();
+	assert(jobs.GetNumThreads() == 0);
+}
+#endif
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <atomic>
+
+// Fixed pool of worker threads. Jobs are plain std::function, ParallelFor
+// splits an index range into batches and lets the calling thread help out,
+// so it is safe to call from inside another job.
+class JobSystem
+{
+public:
+	JobSystem();
+	~JobSystem();
+	JobSystem(const JobSystem& rhs) = delete;
+	JobSystem& operator=(const JobSystem& rhs) = delete;
+
+	// numThreads == 0 uses one worker per hardware thread minus the caller
+	void Init(uint32_t numThreads = 0);
+	void Shutdown();
+
+	void Submit(std::function<void()> job);
+	// Blocks until every job submitted so far has finished
+	void Wait();
+
+	// Calls func(begin, end) for consecutive ranges of at most batchSize
+	// indices covering [0, count) and returns when all of them are done
+	void ParallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t, uint32_t)>& func);
+
+	uint32_t GetNumThreads() const { return (uint32_t)m_Workers.size(); }
+
+private:
+	void WorkerLoop();
+
+	std::vector<std::thread> m_Workers;
+	std::deque<std::function<void()>> m_Jobs;
+	std::mutex m_Mutex;
+	std::condition_variable m_JobAvailable;
+	std::condition_variable m_JobsDone;
+	uint32_t m_NumPending;
+	bool m_Quit;
+};
+
+#ifdef JOB_SYSTEM_TEST
+void JobSystemTest(void);
+#endif
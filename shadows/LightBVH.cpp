@@ -0,0 +1,530 @@
+#include "LightBVH.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <math.h>
+
+// Deep enough for the tree of any number of lights, the median split halves the lights at every level
+#define LIGHT_BVH_MAX_DEPTH 64
+
+static float LightBVHDistanceSq(const Vec3D& point, const AABB& box)
+{
+	const float dx = fmaxf(fmaxf(box.Min.X - point.X, point.X - box.Max.X), 0.0f);
+	const float dy = fmaxf(fmaxf(box.Min.Y - point.Y, point.Y - box.Max.Y), 0.0f);
+	const float dz = fmaxf(fmaxf(box.Min.Z - point.Z, point.Z - box.Max.Z), 0.0f);
+	return dx * dx + dy * dy + dz * dz;
+}
+
+static bool LightBVHOverlap(const AABB& lhs, const AABB& rhs)
+{
+	return lhs.Min.X <= rhs.Max.X && rhs.Min.X <= lhs.Max.X &&
+		lhs.Min.Y <= rhs.Max.Y && rhs.Min.Y <= lhs.Max.Y &&
+		lhs.Min.Z <= rhs.Max.Z && rhs.Min.Z <= lhs.Max.Z;
+}
+
+static float LightBVHLuminance(const Color& color)
+{
+	return 0.2126f * color.R + 0.7152f * color.G + 0.0722f * color.B;
+}
+
+LightBVH::LightBVH()
+{
+}
+
+LightBVH::~LightBVH()
+{
+}
+
+void LightBVH::Gather(const PointLight* pointLights, uint32_t numPointLights, const SpotLight* spotLights, uint32_t numSpotLights,
+	std::vector<Light>* lights)
+{
+	lights->resize(numPointLights + numSpotLights);
+	for (uint32_t i = 0; i < numPointLights; ++i)
+	{
+		const PointLight& source = pointLights[i];
+		Light& light = (*lights)[i];
+		light.Position = source.Position;
+		light.Range = source.Range;
+		light.Direction = MathVec3DFromXYZ(0.0f, 0.0f, 0.0f);
+		light.Spot = 0.0f;
+		light.Att = source.Att;
+		light.Intensity = LightBVHLuminance(source.Ambient) + LightBVHLuminance(source.Diffuse);
+		light.Id = i;
+	}
+	for (uint32_t i = 0; i < numSpotLights; ++i)
+	{
+		const SpotLight& source = spotLights[i];
+		Light& light = (*lights)[numPointLights + i];
+		light.Position = source.Position;
+		light.Range = source.Range;
+		light.Direction = source.Direction;
+		light.Spot = source.Spot;
+		light.Att = source.Att;
+		light.Intensity = LightBVHLuminance(source.Ambient) + LightBVHLuminance(source.Diffuse);
+		light.Id = i | LIGHT_BVH_SPOT_BIT;
+	}
+}
+
+void LightBVH::Build(const PointLight* pointLights, uint32_t numPointLights, const SpotLight* spotLights, uint32_t numSpotLights)
+{
+	Gather(pointLights, numPointLights, spotLights, numSpotLights, &m_Lights);
+	m_Nodes.clear();
+	if (m_Lights.empty())
+	{
+		m_Slots.clear();
+		return;
+	}
+	m_Nodes.reserve(2 * (m_Lights.size() / LIGHT_BVH_LEAF_SIZE + 1));
+	m_Nodes.emplace_back();
+	BuildNode(0, 0, (uint32_t)m_Lights.size());
+
+	m_Slots.resize(m_Lights.size());
+	for (uint32_t slot = 0; slot < m_Lights.size(); ++slot)
+	{
+		const uint32_t id = m_Lights[slot].Id;
+		m_Slots[id & LIGHT_BVH_SPOT_BIT ? numPointLights + (id & ~LIGHT_BVH_SPOT_BIT) : id] = slot;
+	}
+}
+
+void LightBVH::BuildNode(uint32_t node, uint32_t first, uint32_t numLights)
+{
+	m_Nodes[node].First = first;
+	m_Nodes[node].NumLights = numLights;
+	if (numLights <= LIGHT_BVH_LEAF_SIZE)
+	{
+		UpdateBounds(node);
+		return;
+	}
+
+	AABB centers = MathAABBEmpty();
+	for (uint32_t i = first; i < first + numLights; ++i)
+	{
+		MathAABBExpand(&centers, &m_Lights[i].Position);
+	}
+	const Vec3D size = MathVec3DSubtraction(&centers.Max, &centers.Min);
+	const uint32_t axis = size.X >= size.Y && size.X >= size.Z ? 0 : (size.Y >= size.Z ? 1 : 2);
+	const uint32_t half = numLights / 2;
+	std::nth_element(m_Lights.begin() + first, m_Lights.begin() + first + half, m_Lights.begin() + first + numLights,
+		[axis](const Light& lhs, const Light& rhs)
+		{
+			const float a = axis == 0 ? lhs.Position.X : (axis == 1 ? lhs.Position.Y : lhs.Position.Z);
+			const float b = axis == 0 ? rhs.Position.X : (axis == 1 ? rhs.Position.Y : rhs.Position.Z);
+			return a < b;
+		});
+
+	const uint32_t children = (uint32_t)m_Nodes.size();
+	m_Nodes.emplace_back();
+	m_Nodes.emplace_back();
+	BuildNode(children, first, half);
+	BuildNode(children + 1, first + half, numLights - half);
+	m_Nodes[node].First = children;
+	m_Nodes[node].NumLights = 0;
+	UpdateBounds(node);
+}
+
+// Bounds of the range spheres of a leaf, or of the bounds of the children of an inner node
+void LightBVH::UpdateBounds(uint32_t node)
+{
+	Node& dest = m_Nodes[node];
+	if (dest.NumLights == 0)
+	{
+		dest.Bounds = MathAABBUnion(&m_Nodes[dest.First].Bounds, &m_Nodes[dest.First + 1].Bounds);
+		return;
+	}
+	dest.Bounds = MathAABBEmpty();
+	for (uint32_t i = dest.First; i < dest.First + dest.NumLights; ++i)
+	{
+		const Light& light = m_Lights[i];
+		const Vec3D extents = { light.Range, light.Range, light.Range };
+		const Vec3D min = MathVec3DSubtraction(&light.Position, &extents);
+		const Vec3D max = MathVec3DAddition(&light.Position, &extents);
+		MathAABBExpand(&dest.Bounds, &min);
+		MathAABBExpand(&dest.Bounds, &max);
+	}
+}
+
+void LightBVH::Refit(const PointLight* pointLights, uint32_t numPointLights, const SpotLight* spotLights, uint32_t numSpotLights)
+{
+	assert(numPointLights + numSpotLights == m_Lights.size());
+	Gather(pointLights, numPointLights, spotLights, numSpotLights, &m_Refitted);
+	for (uint32_t i = 0; i < m_Refitted.size(); ++i)
+	{
+		m_Lights[m_Slots[i]] = m_Refitted[i];
+	}
+	// children come after their parent, so walking back refits them first
+	for (uint32_t node = (uint32_t)m_Nodes.size(); node-- > 0;)
+	{
+		UpdateBounds(node);
+	}
+}
+
+void LightBVH::QuerySlots(const AABB& box, std::vector<uint32_t>* slots) const
+{
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+	uint32_t stack[LIGHT_BVH_MAX_DEPTH];
+	uint32_t numStack = 0;
+	stack[numStack++] = 0;
+	while (numStack)
+	{
+		const Node& node = m_Nodes[stack[--numStack]];
+		if (!LightBVHOverlap(node.Bounds, box))
+		{
+			continue;
+		}
+		if (node.NumLights == 0)
+		{
+			assert(numStack + 2 <= LIGHT_BVH_MAX_DEPTH);
+			stack[numStack++] = node.First + 1;
+			stack[numStack++] = node.First;
+			continue;
+		}
+		for (uint32_t i = node.First; i < node.First + node.NumLights; ++i)
+		{
+			const Light& light = m_Lights[i];
+			if (LightBVHDistanceSq(light.Position, box) <= light.Range * light.Range)
+			{
+				slots->push_back(i);
+			}
+		}
+	}
+}
+
+void LightBVH::Query(const AABB& box, std::vector<uint32_t>* lights) const
+{
+	const size_t first = lights->size();
+	QuerySlots(box, lights);
+	for (size_t i = first; i < lights->size(); ++i)
+	{
+		(*lights)[i] = m_Lights[(*lights)[i]].Id;
+	}
+}
+
+// Light reaching the nearest point of the box, attenuated like the shader
+// does. A spot light is scaled by its falloff towards the edge of the box's
+// bounding sphere closest to its axis, so a box that is partly inside the
+// cone is not ranked like one behind the light.
+float LightBVH::ComputeImportance(const Light& light, const AABB& box)
+{
+	const float distance = sqrtf(LightBVHDistanceSq(light.Position, box));
+	const float attenuation = light.Att.X + light.Att.Y * distance + light.Att.Z * distance * distance;
+	float importance = light.Intensity / fmaxf(attenuation, 1e-4f);
+	if (light.Id & LIGHT_BVH_SPOT_BIT)
+	{
+		const Vec3D center = MathAABBCenter(&box);
+		const Vec3D extents = MathAABBExtents(&box);
+		const Vec3D toCenter = MathVec3DSubtraction(&center, &light.Position);
+		const float length = sqrtf(MathVec3DDot(&toCenter, &toCenter));
+		const float radius = sqrtf(MathVec3DDot(&extents, &extents));
+		if (length > radius)
+		{
+			const float cosAxis = fminf(fmaxf(MathVec3DDot(&toCenter, &light.Direction) / length, -1.0f), 1.0f);
+			const float angle = fmaxf(acosf(cosAxis) - asinf(radius / length), 0.0f);
+			importance *= powf(fmaxf(cosf(angle), 0.0f), light.Spot);
+		}
+	}
+	return importance;
+}
+
+uint32_t LightBVH::Select(const AABB& box, uint32_t maxLights, uint32_t* lights)
+{
+	m_Found.clear();
+	QuerySlots(box, &m_Found);
+	m_Candidates.clear();
+	for (const uint32_t slot : m_Found)
+	{
+		const LightBVHCandidate candidate = { m_Lights[slot].Id, ComputeImportance(m_Lights[slot], box) };
+		m_Candidates.push_back(candidate);
+	}
+
+	// ties go to the lower id, the same lights come out however the tree was built
+	const uint32_t count = (uint32_t)m_Candidates.size() < maxLights ? (uint32_t)m_Candidates.size() : maxLights;
+	std::partial_sort(m_Candidates.begin(), m_Candidates.begin() + count, m_Candidates.end(),
+		[](const LightBVHCandidate& lhs, const LightBVHCandidate& rhs)
+		{
+			return lhs.Importance > rhs.Importance || (lhs.Importance == rhs.Importance && lhs.Light < rhs.Light);
+		});
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		lights[i] = m_Candidates[i].Light;
+	}
+	return count;
+}
+
+void LightBVH::SelectAll(const AABB* boxes, uint32_t numObjects, uint32_t maxLights, uint32_t* lights, uint32_t* counts)
+{
+	for (uint32_t object = 0; object < numObjects; ++object)
+	{
+		counts[object] = Select(boxes[object], maxLights, lights + (size_t)object * maxLights);
+	}
+}
+
+#ifdef LIGHT_BVH_TEST
+static float LightBVHTestRandom(uint32_t* seed, float min, float max)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return min + (max - min) * (float)(*seed >> 8) / (float)(1 << 24);
+}
+
+static void LightBVHTestScene(uint32_t seed, std::vector<PointLight>* points, std::vector<SpotLight>* spots)
+{
+	for (PointLight& light : *points)
+	{
+		light.Position = MathVec3DFromXYZ(LightBVHTestRandom(&seed, -20.0f, 20.0f), LightBVHTestRandom(&seed, 0.0f, 4.0f),
+			LightBVHTestRandom(&seed, -20.0f, 20.0f));
+		light.Range = LightBVHTestRandom(&seed, 0.5f, 5.0f);
+		light.Diffuse = ColorFromRGBA(LightBVHTestRandom(&seed, 0.1f, 1.0f), 0.5f, 0.5f, 1.0f);
+		light.Att = MathVec3DFromXYZ(1.0f, 0.09f, 0.032f);
+	}
+	for (SpotLight& light : *spots)
+	{
+		light.Position = MathVec3DFromXYZ(LightBVHTestRandom(&seed, -20.0f, 20.0f), LightBVHTestRandom(&seed, 0.0f, 4.0f),
+			LightBVHTestRandom(&seed, -20.0f, 20.0f));
+		light.Direction = MathVec3DFromXYZ(LightBVHTestRandom(&seed, -1.0f, 1.0f), -1.0f, LightBVHTestRandom(&seed, -1.0f, 1.0f));
+		MathVec3DNormalize(&light.Direction);
+		light.Range = LightBVHTestRandom(&seed, 1.0f, 8.0f);
+		light.Spot = LightBVHTestRandom(&seed, 1.0f, 32.0f);
+		light.Diffuse = ColorFromRGBA(1.0f, 1.0f, 1.0f, 1.0f);
+		light.Att = MathVec3DFromXYZ(1.0f, 0.09f, 0.032f);
+	}
+}
+
+static AABB LightBVHTestBox(uint32_t* seed)
+{
+	const Vec3D center = { LightBVHTestRandom(seed, -22.0f, 22.0f), LightBVHTestRandom(seed, -1.0f, 5.0f), LightBVHTestRandom(seed, -22.0f, 22.0f) };
+	const Vec3D extents = { LightBVHTestRandom(seed, 0.1f, 2.0f), LightBVHTestRandom(seed, 0.1f, 2.0f), LightBVHTestRandom(seed, 0.1f, 2.0f) };
+	return AABB(MathVec3DSubtraction(&center, &extents), MathVec3DAddition(&center, &extents));
+}
+
+// Ids of the lights whose range sphere reaches the box, sorted
+static std::vector<uint32_t> LightBVHTestBruteForce(const std::vector<PointLight>& points, const std::vector<SpotLight>& spots, const AABB& box)
+{
+	std::vector<uint32_t> lights;
+	for (uint32_t i = 0; i < points.size(); ++i)
+	{
+		if (LightBVHDistanceSq(points[i].Position, box) <= points[i].Range * points[i].Range)
+		{
+			lights.push_back(i);
+		}
+	}
+	for (uint32_t i = 0; i < spots.size(); ++i)
+	{
+		if (LightBVHDistanceSq(spots[i].Position, box) <= spots[i].Range * spots[i].Range)
+		{
+			lights.push_back(i | LIGHT_BVH_SPOT_BIT);
+		}
+	}
+	return lights;
+}
+
+static void TestLightBVHQuery(void)
+{
+	std::vector<PointLight> points(500);
+	std::vector<SpotLight> spots(200);
+	LightBVHTestScene(7, &points, &spots);
+	LightBVH bvh;
+	bvh.Build(points.data(), (uint32_t)points.size(), spots.data(), (uint32_t)spots.size());
+	assert(bvh.GetNumLights() == 700);
+
+	uint32_t seed = 11;
+	std::vector<uint32_t> found;
+	for (uint32_t i = 0; i < 500; ++i)
+	{
+		const AABB box = LightBVHTestBox(&seed);
+		found.clear();
+		bvh.Query(box, &found);
+		std::sort(found.begin(), found.end());
+		assert(found == LightBVHTestBruteForce(points, spots, box));
+	}
+
+	// moved lights are found at their new places without a rebuild
+	for (PointLight& light : points)
+	{
+		light.Position.X += LightBVHTestRandom(&seed, -3.0f, 3.0f);
+		light.Range *= 1.5f;
+	}
+	for (SpotLight& light : spots)
+	{
+		light.Position.Z += LightBVHTestRandom(&seed, -3.0f, 3.0f);
+	}
+	bvh.Refit(points.data(), (uint32_t)points.size(), spots.data(), (uint32_t)spots.size());
+	for (uint32_t i = 0; i < 500; ++i)
+	{
+		const AABB box = LightBVHTestBox(&seed);
+		found.clear();
+		bvh.Query(box, &found);
+		std::sort(found.begin(), found.end());
+		assert(found == LightBVHTestBruteForce(points, spots, box));
+	}
+
+	LightBVH empty;
+	empty.Build(nullptr, 0, nullptr, 0);
+	found.clear();
+	empty.Query(LightBVHTestBox(&seed), &found);
+	assert(found.empty());
+	uint32_t selected[LIGHT_BVH_MAX_OBJECT_LIGHTS];
+	assert(empty.Select(LightBVHTestBox(&seed), LIGHT_BVH_MAX_OBJECT_LIGHTS, selected) == 0);
+}
+
+static void TestLightBVHSelect(void)
+{
+	const AABB box = { MathVec3DFromXYZ(-0.5f, 0.0f, -0.5f), MathVec3DFromXYZ(0.5f, 1.0f, 0.5f) };
+	std::vector<PointLight> points(3);
+	for (uint32_t i = 0; i < points.size(); ++i)
+	{
+		points[i].Diffuse = ColorFromRGBA(1.0f, 1.0f, 1.0f, 1.0f);
+		points[i].Att = MathVec3DFromXYZ(1.0f, 0.09f, 0.032f);
+		points[i].Range = 10.0f;
+	}
+	// further lights rank lower, brighter ones higher
+	points[0].Position = MathVec3DFromXYZ(4.0f, 0.5f, 0.0f);
+	points[1].Position = MathVec3DFromXYZ(2.0f, 0.5f, 0.0f);
+	points[2].Position = MathVec3DFromXYZ(6.0f, 0.5f, 0.0f);
+	points[2].Diffuse = ColorFromRGBA(4.0f, 4.0f, 4.0f, 1.0f);
+	// the same light as the second one, once pointing at the box and once away from it
+	std::vector<SpotLight> spots(2);
+	for (SpotLight& spot : spots)
+	{
+		spot.Position = points[1].Position;
+		spot.Diffuse = points[1].Diffuse;
+		spot.Att = points[1].Att;
+		spot.Range = 10.0f;
+		spot.Spot = 8.0f;
+	}
+	spots[0].Direction = MathVec3DFromXYZ(-1.0f, 0.0f, 0.0f);
+	spots[1].Direction = MathVec3DFromXYZ(1.0f, 0.0f, 0.0f);
+
+	LightBVH bvh;
+	bvh.Build(points.data(), (uint32_t)points.size(), spots.data(), (uint32_t)spots.size());
+	uint32_t selected[LIGHT_BVH_MAX_OBJECT_LIGHTS];
+	assert(bvh.Select(box, LIGHT_BVH_MAX_OBJECT_LIGHTS, selected) == 5);
+	// the bright far light first, the spot at the box ties with the point light at the same place and loses on its id
+	assert(selected[0] == 2 && selected[1] == 1 && selected[2] == (0 | LIGHT_BVH_SPOT_BIT) && selected[3] == 0);
+	assert(selected[4] == (1 | LIGHT_BVH_SPOT_BIT));
+	assert(bvh.Select(box, 2, selected) == 2);
+	assert(selected[0] == 2 && selected[1] == 1);
+
+	// selection over many lights keeps the most important ones of the brute force list
+	std::vector<PointLight> manyPoints(400);
+	std::vector<SpotLight> manySpots(100);
+	LightBVHTestScene(5, &manyPoints, &manySpots);
+	bvh.Build(manyPoints.data(), (uint32_t)manyPoints.size(), manySpots.data(), (uint32_t)manySpots.size());
+	uint32_t seed = 9;
+	std::vector<AABB> boxes(64);
+	for (AABB& object : boxes)
+	{
+		object = LightBVHTestBox(&seed);
+	}
+	std::vector<uint32_t> lights(boxes.size() * LIGHT_BVH_MAX_OBJECT_LIGHTS);
+	std::vector<uint32_t> counts(boxes.size());
+	bvh.SelectAll(boxes.data(), (uint32_t)boxes.size(), LIGHT_BVH_MAX_OBJECT_LIGHTS, lights.data(), counts.data());
+	for (uint32_t object = 0; object < boxes.size(); ++object)
+	{
+		const std::vector<uint32_t> reaching = LightBVHTestBruteForce(manyPoints, manySpots, boxes[object]);
+		assert(counts[object] == std::min<size_t>(reaching.size(), LIGHT_BVH_MAX_OBJECT_LIGHTS));
+		for (uint32_t i = 0; i < counts[object]; ++i)
+		{
+			const uint32_t light = lights[object * LIGHT_BVH_MAX_OBJECT_LIGHTS + i];
+			assert(std::find(reaching.begin(), reaching.end(), light) != reaching.end());
+		}
+	}
+}
+
+void LightBVHTest(void)
+{
+	TestLightBVHQuery();
+	TestLightBVHSelect();
+}
+#endif
+
+#ifdef LIGHT_BVH_BENCHMARK
+#include <chrono>
+
+void LightBVHBenchmark(void)
+{
+	const uint32_t numPointLights = 7500;
+	const uint32_t numSpotLights = 2500;
+	const uint32_t numObjects = 100000;
+	// lights and objects spread over a 400 x 400 unit level
+	uint32_t seed = 1;
+	auto random = [&seed](float min, float max)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return min + (max - min) * (float)(seed >> 8) / (float)(1 << 24);
+	};
+	std::vector<PointLight> points(numPointLights);
+	for (PointLight& light : points)
+	{
+		light.Position = MathVec3DFromXYZ(random(-200.0f, 200.0f), random(0.0f, 8.0f), random(-200.0f, 200.0f));
+		light.Range = random(1.0f, 8.0f);
+		light.Diffuse = ColorFromRGBA(random(0.1f, 1.0f), random(0.1f, 1.0f), random(0.1f, 1.0f), 1.0f);
+		light.Att = MathVec3DFromXYZ(1.0f, 0.09f, 0.032f);
+	}
+	std::vector<SpotLight> spots(numSpotLights);
+	for (SpotLight& light : spots)
+	{
+		light.Position = MathVec3DFromXYZ(random(-200.0f, 200.0f), random(2.0f, 8.0f), random(-200.0f, 200.0f));
+		light.Direction = MathVec3DFromXYZ(random(-0.5f, 0.5f), -1.0f, random(-0.5f, 0.5f));
+		MathVec3DNormalize(&light.Direction);
+		light.Range = random(2.0f, 12.0f);
+		light.Spot = random(4.0f, 32.0f);
+		light.Diffuse = ColorFromRGBA(1.0f, 1.0f, 1.0f, 1.0f);
+		light.Att = MathVec3DFromXYZ(1.0f, 0.09f, 0.032f);
+	}
+	std::vector<AABB> boxes(numObjects);
+	for (AABB& box : boxes)
+	{
+		const Vec3D center = { random(-200.0f, 200.0f), random(0.0f, 4.0f), random(-200.0f, 200.0f) };
+		const Vec3D extents = { random(0.2f, 2.0f), random(0.2f, 2.0f), random(0.2f, 2.0f) };
+		box = AABB(MathVec3DSubtraction(&center, &extents), MathVec3DAddition(&center, &extents));
+	}
+
+	LightBVH bvh;
+	const auto buildStart = std::chrono::steady_clock::now();
+	bvh.Build(points.data(), numPointLights, spots.data(), numSpotLights);
+	const std::chrono::duration<double, std::milli> build = std::chrono::steady_clock::now() - buildStart;
+
+	for (PointLight& light : points)
+	{
+		light.Position.Y += random(-0.5f, 0.5f);
+	}
+	const auto refitStart = std::chrono::steady_clock::now();
+	bvh.Refit(points.data(), numPointLights, spots.data(), numSpotLights);
+	const std::chrono::duration<double, std::milli> refit = std::chrono::steady_clock::now() - refitStart;
+
+	std::vector<uint32_t> found;
+	size_t numFound = 0;
+	const auto queryStart = std::chrono::steady_clock::now();
+	for (const AABB& box : boxes)
+	{
+		found.clear();
+		bvh.Query(box, &found);
+		numFound += found.size();
+	}
+	const std::chrono::duration<double, std::milli> query = std::chrono::steady_clock::now() - queryStart;
+
+	std::vector<uint32_t> lights((size_t)numObjects * LIGHT_BVH_MAX_OBJECT_LIGHTS);
+	std::vector<uint32_t> counts(numObjects);
+	const auto selectStart = std::chrono::steady_clock::now();
+	bvh.SelectAll(boxes.data(), numObjects, LIGHT_BVH_MAX_OBJECT_LIGHTS, lights.data(), counts.data());
+	const std::chrono::duration<double, std::milli> select = std::chrono::steady_clock::now() - selectStart;
+	size_t numSelected = 0;
+	for (const uint32_t count : counts)
+	{
+		numSelected += count;
+	}
+
+	UtilsDebugPrint("Light BVH: %u lights in %u nodes, build %.3f ms, refit %.3f ms\n",
+		bvh.GetNumLights(), bvh.GetNumNodes(), build.count(), refit.count());
+	UtilsDebugPrint("Light BVH: %u objects, query %.3f ms with %.2f lights each, top %u selection %.3f ms with %.2f lights each\n",
+		numObjects,
+		query.count(),
+		(double)numFound / numObjects,
+		LIGHT_BVH_MAX_OBJECT_LIGHTS,
+		select.count(),
+		(double)numSelected / numObjects);
+}
+#endif
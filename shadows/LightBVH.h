@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "LightHelper.h"
+#include "Math.h"
+
+// Lights in a leaf of the tree
+#define LIGHT_BVH_LEAF_SIZE 4
+// Set in the light ids of spot lights, the rest of the id is the index into the spot lights
+#define LIGHT_BVH_SPOT_BIT 0x80000000u
+// Lights ranked for an object, the most that fit into its constants
+#define LIGHT_BVH_MAX_OBJECT_LIGHTS 8
+
+// A light that reaches an object and how much it is estimated to add to it
+struct LightBVHCandidate
+{
+	uint32_t Light;
+	float Importance;
+};
+
+// Bounding volume hierarchy over the range spheres of point and spot lights,
+// for picking the lights of an object when it is shaded with a fixed number
+// of them. Nodes are split at the median of their longest axis, so the tree
+// is balanced whatever the light distribution; the children of a node are
+// next to each other and come after it. Lights that move keep their place in
+// the tree and only the bounds are refitted, a rebuild is needed when lights
+// are added or removed, or the tree gets loose after they moved far.
+class LightBVH
+{
+public:
+	LightBVH();
+	~LightBVH();
+
+	void Build(const PointLight* pointLights, uint32_t numPointLights, const SpotLight* spotLights, uint32_t numSpotLights);
+	// Same lights as the last Build, at their new positions and ranges
+	void Refit(const PointLight* pointLights, uint32_t numPointLights, const SpotLight* spotLights, uint32_t numSpotLights);
+
+	// Appends the ids of the lights whose range reaches the box, in no particular order
+	void Query(const AABB& box, std::vector<uint32_t>* lights) const;
+	// Up to maxLights ids of the lights that reach the box, most important first, returns how many
+	uint32_t Select(const AABB& box, uint32_t maxLights, uint32_t* lights);
+	// Select for every box, maxLights ids per object into lights and their number into counts
+	void SelectAll(const AABB* boxes, uint32_t numObjects, uint32_t maxLights, uint32_t* lights, uint32_t* counts);
+
+	uint32_t GetNumLights() const { return (uint32_t)m_Lights.size(); }
+	uint32_t GetNumNodes() const { return (uint32_t)m_Nodes.size(); }
+
+private:
+	struct Light
+	{
+		Vec3D Position;
+		float Range;
+		// spot lights only, zero for point lights
+		Vec3D Direction;
+		float Spot;
+		Vec3D Att;
+		// luminance of the ambient and diffuse colors
+		float Intensity;
+		uint32_t Id;
+	};
+
+	struct Node
+	{
+		AABB Bounds;
+		// first light of a leaf, first child of an inner node
+		uint32_t First;
+		// 0 for inner nodes
+		uint32_t NumLights;
+	};
+
+	static void Gather(const PointLight* pointLights, uint32_t numPointLights, const SpotLight* spotLights, uint32_t numSpotLights,
+		std::vector<Light>* lights);
+	void BuildNode(uint32_t node, uint32_t first, uint32_t numLights);
+	void UpdateBounds(uint32_t node);
+	// Positions in m_Lights of the lights that reach the box
+	void QuerySlots(const AABB& box, std::vector<uint32_t>* slots) const;
+	static float ComputeImportance(const Light& light, const AABB& box);
+
+	// lights in leaf order
+	std::vector<Light> m_Lights;
+	std::vector<Node> m_Nodes;
+	// position of each point light, then each spot light, in m_Lights
+	std::vector<uint32_t> m_Slots;
+	std::vector<Light> m_Refitted;
+	std::vector<uint32_t> m_Found;
+	std::vector<LightBVHCandidate> m_Candidates;
+};
+
+#ifdef LIGHT_BVH_TEST
+void LightBVHTest(void);
+#endif
+
+#ifdef LIGHT_BVH_BENCHMARK
+// Prints the time to build and refit a tree of 10K lights and to select the lights of 100K objects
+void LightBVHBenchmark(void);
+#endif
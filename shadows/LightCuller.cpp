@@ -0,0 +1,538 @@
+#include "LightCuller.h"
+#include "Utils.h"
+
+#include <cassert>
+#include <cfloat>
+#include <corecrt_math_defines.h>
+#include <emmintrin.h>
+#include <math.h>
+
+float LightCullerSpotAngle(float spot)
+{
+	if (spot <= 0.0f)
+	{
+		return 0.5f * (float)M_PI;
+	}
+	return acosf(powf(LIGHT_CULLER_SPOT_CUTOFF, 1.0f / spot));
+}
+
+LightCuller::LightCuller() :
+	m_Width(0),
+	m_Height(0),
+	m_NumTilesX(0),
+	m_NumTilesY(0),
+	m_RowStride(0),
+	m_ProjX(0.0f),
+	m_ProjY(0.0f),
+	m_ZNear(0.0f),
+	m_ZFar(0.0f),
+	m_DepthScale(0.0f),
+	m_DepthBias(0.0f),
+	m_NumPointHits(0)
+{
+}
+
+LightCuller::~LightCuller()
+{
+}
+
+void LightCuller::Init(uint32_t screenWidth, uint32_t screenHeight, float fovY, float zNear, float zFar)
+{
+	assert(screenWidth && screenHeight && zNear > 0.0f && zFar > zNear);
+	m_Width = screenWidth;
+	m_Height = screenHeight;
+	m_NumTilesX = (screenWidth + LIGHT_CULLER_TILE_SIZE - 1) / LIGHT_CULLER_TILE_SIZE;
+	m_NumTilesY = (screenHeight + LIGHT_CULLER_TILE_SIZE - 1) / LIGHT_CULLER_TILE_SIZE;
+	m_RowStride = (m_NumTilesX + 3) & ~3u;
+	const Mat4X4 proj = MathMat4X4PerspectiveFov(fovY, (float)screenWidth / (float)screenHeight, zNear, zFar);
+	m_ProjX = proj.A00;
+	m_ProjY = proj.A11;
+	m_ZNear = zNear;
+	m_ZFar = zFar;
+	m_DepthScale = (float)LIGHT_CULLER_NUM_SLICES / logf(zFar / zNear);
+	m_DepthBias = -logf(zNear) * m_DepthScale;
+
+	const size_t numBounds = (size_t)m_RowStride * m_NumTilesY * LIGHT_CULLER_NUM_SLICES;
+	// padding lanes get empty boxes that no light reaches
+	m_MinX.assign(numBounds, FLT_MAX);
+	m_MinY.assign(numBounds, FLT_MAX);
+	m_MinZ.assign(numBounds, FLT_MAX);
+	m_MaxX.assign(numBounds, -FLT_MAX);
+	m_MaxY.assign(numBounds, -FLT_MAX);
+	m_MaxZ.assign(numBounds, -FLT_MAX);
+	m_CenterX.assign(numBounds, FLT_MAX);
+	m_CenterY.assign(numBounds, FLT_MAX);
+	m_CenterZ.assign(numBounds, FLT_MAX);
+	m_Radius.assign(numBounds, 0.0f);
+
+	for (uint32_t slice = 0; slice < LIGHT_CULLER_NUM_SLICES; ++slice)
+	{
+		const float sliceNear = zNear * powf(zFar / zNear, (float)slice / LIGHT_CULLER_NUM_SLICES);
+		const float sliceFar = zNear * powf(zFar / zNear, (float)(slice + 1) / LIGHT_CULLER_NUM_SLICES);
+		// boxes overlap their neighbours a hair, so a pixel on a boundary is inside whichever cluster it lands in
+		const float slack = 1e-4f * sliceFar;
+		for (uint32_t y = 0; y < m_NumTilesY; ++y)
+		{
+			const uint32_t bottom = (y + 1) * LIGHT_CULLER_TILE_SIZE < screenHeight ? (y + 1) * LIGHT_CULLER_TILE_SIZE : screenHeight;
+			const float ndcTop = 1.0f - 2.0f * (float)(y * LIGHT_CULLER_TILE_SIZE) / (float)screenHeight;
+			const float ndcBottom = 1.0f - 2.0f * (float)bottom / (float)screenHeight;
+			for (uint32_t x = 0; x < m_NumTilesX; ++x)
+			{
+				const uint32_t right = (x + 1) * LIGHT_CULLER_TILE_SIZE < screenWidth ? (x + 1) * LIGHT_CULLER_TILE_SIZE : screenWidth;
+				const float ndcLeft = 2.0f * (float)(x * LIGHT_CULLER_TILE_SIZE) / (float)screenWidth - 1.0f;
+				const float ndcRight = 2.0f * (float)right / (float)screenWidth - 1.0f;
+
+				// the sides of the tile's frustum are widest at one of the two depths
+				const size_t i = ((size_t)slice * m_NumTilesY + y) * m_RowStride + x;
+				m_MinX[i] = fminf(ndcLeft * sliceNear, ndcLeft * sliceFar) / m_ProjX - slack;
+				m_MaxX[i] = fmaxf(ndcRight * sliceNear, ndcRight * sliceFar) / m_ProjX + slack;
+				m_MinY[i] = fminf(ndcBottom * sliceNear, ndcBottom * sliceFar) / m_ProjY - slack;
+				m_MaxY[i] = fmaxf(ndcTop * sliceNear, ndcTop * sliceFar) / m_ProjY + slack;
+				m_MinZ[i] = sliceNear - slack;
+				m_MaxZ[i] = sliceFar + slack;
+
+				const Vec3D extents = { 0.5f * (m_MaxX[i] - m_MinX[i]), 0.5f * (m_MaxY[i] - m_MinY[i]), 0.5f * (m_MaxZ[i] - m_MinZ[i]) };
+				m_CenterX[i] = m_MinX[i] + extents.X;
+				m_CenterY[i] = m_MinY[i] + extents.Y;
+				m_CenterZ[i] = m_MinZ[i] + extents.Z;
+				m_Radius[i] = sqrtf(MathVec3DDot(&extents, &extents));
+			}
+		}
+	}
+
+	m_Clusters.assign((size_t)m_NumTilesX * m_NumTilesY * LIGHT_CULLER_NUM_SLICES, LightCluster{});
+	m_Indices.clear();
+}
+
+void LightCuller::Cull(const Mat4X4& view, const PointLight* pointLights, uint32_t numPointLights,
+	const SpotLight* spotLights, uint32_t numSpotLights)
+{
+	m_HitClusters.clear();
+	m_HitLights.clear();
+	for (uint32_t i = 0; i < numPointLights; ++i)
+	{
+		const PointLight& light = pointLights[i];
+		if (light.Range <= 0.0f)
+		{
+			continue;
+		}
+		const Vec4D position = { light.Position.X, light.Position.Y, light.Position.Z, 1.0f };
+		const Vec4D center = MathMat4X4MultVec4DByMat4X4(&position, &view);
+		Bin(MathVec3DFromXYZ(center.X, center.Y, center.Z), light.Range, nullptr, 0.0f, 0.0f, i);
+	}
+	m_NumPointHits = (uint32_t)m_HitClusters.size();
+
+	for (uint32_t i = 0; i < numSpotLights; ++i)
+	{
+		const SpotLight& light = spotLights[i];
+		if (light.Range <= 0.0f)
+		{
+			continue;
+		}
+		const Vec4D position = { light.Position.X, light.Position.Y, light.Position.Z, 1.0f };
+		const Vec4D center = MathMat4X4MultVec4DByMat4X4(&position, &view);
+		const Vec4D worldDirection = { light.Direction.X, light.Direction.Y, light.Direction.Z, 0.0f };
+		const Vec4D viewDirection = MathMat4X4MultVec4DByMat4X4(&worldDirection, &view);
+		Vec3D direction = { viewDirection.X, viewDirection.Y, viewDirection.Z };
+		const float length = sqrtf(MathVec3DDot(&direction, &direction));
+		const float angle = LightCullerSpotAngle(light.Spot);
+		// without a direction only the range is left to cull by
+		direction = MathVec3DModulateByScalar(&direction, length > 0.0f ? 1.0f / length : 0.0f);
+		Bin(MathVec3DFromXYZ(center.X, center.Y, center.Z), light.Range, length > 0.0f ? &direction : nullptr,
+			cosf(angle), sinf(angle), i);
+	}
+
+	// counting sort by cluster, stable so the point lights of a cluster come before its spot lights
+	for (LightCluster& cluster : m_Clusters)
+	{
+		cluster = {};
+	}
+	for (size_t hit = 0; hit < m_HitClusters.size(); ++hit)
+	{
+		LightCluster& cluster = m_Clusters[m_HitClusters[hit]];
+		if (hit < m_NumPointHits)
+		{
+			++cluster.NumPoint;
+		}
+		else
+		{
+			++cluster.NumSpot;
+		}
+	}
+	m_Cursors.resize(m_Clusters.size());
+	uint32_t offset = 0;
+	for (size_t i = 0; i < m_Clusters.size(); ++i)
+	{
+		m_Clusters[i].Offset = offset;
+		m_Cursors[i] = offset;
+		offset += m_Clusters[i].NumPoint + m_Clusters[i].NumSpot;
+	}
+	m_Indices.resize(offset);
+	for (size_t hit = 0; hit < m_HitClusters.size(); ++hit)
+	{
+		m_Indices[m_Cursors[m_HitClusters[hit]]++] = m_HitLights[hit];
+	}
+}
+
+uint32_t LightCuller::GetClusterIndex(float x, float y, float depth) const
+{
+	const uint32_t tileX = x > 0.0f ? (uint32_t)(x / LIGHT_CULLER_TILE_SIZE) : 0;
+	const uint32_t tileY = y > 0.0f ? (uint32_t)(y / LIGHT_CULLER_TILE_SIZE) : 0;
+	return (GetSlice(depth) * m_NumTilesY + (tileY < m_NumTilesY ? tileY : m_NumTilesY - 1)) * m_NumTilesX +
+		(tileX < m_NumTilesX ? tileX : m_NumTilesX - 1);
+}
+
+uint32_t LightCuller::GetSlice(float depth) const
+{
+	const float slice = depth > m_ZNear ? logf(depth) * m_DepthScale + m_DepthBias : 0.0f;
+	return slice < (float)(LIGHT_CULLER_NUM_SLICES - 1) ? (uint32_t)slice : LIGHT_CULLER_NUM_SLICES - 1;
+}
+
+// Tiles (x0, y0, x1, y1) and slices (first, last) the view space box around
+// the sphere covers, false when it is outside the view. A box in front of the
+// camera projects widest at its corners, at its nearest or furthest depth.
+bool LightCuller::ComputeRange(const Vec3D& center, float radius, uint32_t* tiles, uint32_t* slices) const
+{
+	const float zMin = fmaxf(center.Z - radius, m_ZNear);
+	const float zMax = fminf(center.Z + radius, m_ZFar);
+	if (zMin > zMax)
+	{
+		return false;
+	}
+
+	const float xs[4] = { (center.X - radius) / zMin, (center.X - radius) / zMax, (center.X + radius) / zMin, (center.X + radius) / zMax };
+	const float ys[4] = { (center.Y - radius) / zMin, (center.Y - radius) / zMax, (center.Y + radius) / zMin, (center.Y + radius) / zMax };
+	const float left = fminf(fminf(xs[0], xs[1]), fminf(xs[2], xs[3])) * m_ProjX;
+	const float right = fmaxf(fmaxf(xs[0], xs[1]), fmaxf(xs[2], xs[3])) * m_ProjX;
+	const float bottom = fminf(fminf(ys[0], ys[1]), fminf(ys[2], ys[3])) * m_ProjY;
+	const float top = fmaxf(fmaxf(ys[0], ys[1]), fmaxf(ys[2], ys[3])) * m_ProjY;
+	if (left > 1.0f || right < -1.0f || bottom > 1.0f || top < -1.0f)
+	{
+		return false;
+	}
+
+	const float tilesPerNdcX = 0.5f * (float)m_Width / LIGHT_CULLER_TILE_SIZE;
+	const float tilesPerNdcY = 0.5f * (float)m_Height / LIGHT_CULLER_TILE_SIZE;
+	const float x0 = fmaxf((left + 1.0f) * tilesPerNdcX, 0.0f);
+	const float x1 = fmaxf((right + 1.0f) * tilesPerNdcX, 0.0f);
+	const float y0 = fmaxf((1.0f - top) * tilesPerNdcY, 0.0f);
+	const float y1 = fmaxf((1.0f - bottom) * tilesPerNdcY, 0.0f);
+	tiles[0] = (uint32_t)x0 < m_NumTilesX ? (uint32_t)x0 : m_NumTilesX - 1;
+	tiles[1] = (uint32_t)y0 < m_NumTilesY ? (uint32_t)y0 : m_NumTilesY - 1;
+	tiles[2] = (uint32_t)x1 < m_NumTilesX ? (uint32_t)x1 : m_NumTilesX - 1;
+	tiles[3] = (uint32_t)y1 < m_NumTilesY ? (uint32_t)y1 : m_NumTilesY - 1;
+	slices[0] = GetSlice(zMin);
+	slices[1] = GetSlice(zMax);
+	return true;
+}
+
+// Tests the light against the clusters in its range four tiles at a time.
+// Spheres hit a cluster when the closest point of its box is in range, cones
+// when they also reach its bounding sphere.
+void LightCuller::Bin(const Vec3D& center, float radius, const Vec3D* direction, float cosAngle, float sinAngle, uint32_t light)
+{
+	uint32_t tiles[4];
+	uint32_t slices[2];
+	if (!ComputeRange(center, radius, tiles, slices))
+	{
+		return;
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 centerX = _mm_set1_ps(center.X);
+	const __m128 centerY = _mm_set1_ps(center.Y);
+	const __m128 centerZ = _mm_set1_ps(center.Z);
+	const __m128 radiusSq = _mm_set1_ps(radius * radius);
+	const __m128 range = _mm_set1_ps(radius);
+	const __m128 dirX = _mm_set1_ps(direction ? direction->X : 0.0f);
+	const __m128 dirY = _mm_set1_ps(direction ? direction->Y : 0.0f);
+	const __m128 dirZ = _mm_set1_ps(direction ? direction->Z : 0.0f);
+	const __m128 cosA = _mm_set1_ps(cosAngle);
+	const __m128 sinA = _mm_set1_ps(sinAngle);
+
+	for (uint32_t slice = slices[0]; slice <= slices[1]; ++slice)
+	{
+		for (uint32_t y = tiles[1]; y <= tiles[3]; ++y)
+		{
+			const uint32_t row = slice * m_NumTilesY + y;
+			const size_t rowStart = (size_t)row * m_RowStride;
+			for (uint32_t x = tiles[0] & ~3u; x <= tiles[2]; x += 4)
+			{
+				const size_t i = rowStart + x;
+				const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_MinX[i]), centerX), _mm_sub_ps(centerX, _mm_loadu_ps(&m_MaxX[i]))), zero);
+				const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_MinY[i]), centerY), _mm_sub_ps(centerY, _mm_loadu_ps(&m_MaxY[i]))), zero);
+				const __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_MinZ[i]), centerZ), _mm_sub_ps(centerZ, _mm_loadu_ps(&m_MaxZ[i]))), zero);
+				const __m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+				__m128 hit = _mm_cmple_ps(distSq, radiusSq);
+
+				if (direction)
+				{
+					// distance from the cluster's bounding sphere center to the cone, along and away from its axis
+					const __m128 toX = _mm_sub_ps(_mm_loadu_ps(&m_CenterX[i]), centerX);
+					const __m128 toY = _mm_sub_ps(_mm_loadu_ps(&m_CenterY[i]), centerY);
+					const __m128 toZ = _mm_sub_ps(_mm_loadu_ps(&m_CenterZ[i]), centerZ);
+					const __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(toX, toX), _mm_mul_ps(toY, toY)), _mm_mul_ps(toZ, toZ));
+					const __m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(toX, dirX), _mm_mul_ps(toY, dirY)), _mm_mul_ps(toZ, dirZ));
+					const __m128 across = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(lengthSq, _mm_mul_ps(along, along)), zero));
+					const __m128 closest = _mm_sub_ps(_mm_mul_ps(cosA, across), _mm_mul_ps(along, sinA));
+					const __m128 sphereRadius = _mm_loadu_ps(&m_Radius[i]);
+					hit = _mm_and_ps(hit, _mm_cmple_ps(closest, sphereRadius));
+					hit = _mm_and_ps(hit, _mm_cmple_ps(along, _mm_add_ps(sphereRadius, range)));
+					hit = _mm_and_ps(hit, _mm_cmpge_ps(along, _mm_sub_ps(zero, sphereRadius)));
+				}
+
+				const int mask = _mm_movemask_ps(hit);
+				for (uint32_t lane = 0; lane < 4; ++lane)
+				{
+					if (((mask >> lane) & 1) && x + lane >= tiles[0] && x + lane <= tiles[2])
+					{
+						m_HitClusters.push_back(row * m_NumTilesX + x + lane);
+						m_HitLights.push_back(light);
+					}
+				}
+			}
+		}
+	}
+}
+
+#ifdef LIGHT_CULLER_TEST
+#include <algorithm>
+
+static float LightCullerTestRandom(uint32_t* seed, float min, float max)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return min + (max - min) * (float)(*seed >> 8) / (float)(1 << 24);
+}
+
+static void TestLightCullerLayout(void)
+{
+	LightCuller culler;
+	culler.Init(1280, 720, MathToRadians(45.0f), 0.1f, 100.0f);
+	assert(culler.GetNumTilesX() == 20 && culler.GetNumTilesY() == 12);
+	const uint32_t numClusters = 20 * 12 * LIGHT_CULLER_NUM_SLICES;
+	assert(culler.GetClusters().size() == numClusters);
+	assert(culler.GetClusterIndex(0.0f, 0.0f, 0.1f) == 0);
+	assert(culler.GetClusterIndex(1279.5f, 719.5f, 100.0f) == numClusters - 1);
+	assert(culler.GetClusterIndex(65.0f, 0.0f, 0.1f) == 1);
+	assert(culler.GetClusterIndex(0.0f, 65.0f, 0.1f) == 20);
+	// slices grow with depth, the shader's formula gives the same ones
+	assert(culler.GetClusterIndex(0.0f, 0.0f, 1.0f) < culler.GetClusterIndex(0.0f, 0.0f, 10.0f));
+	const float slice = logf(1.0f) * culler.GetDepthScale() + culler.GetDepthBias();
+	assert(culler.GetClusterIndex(0.0f, 0.0f, 1.0f) == (uint32_t)slice * 20 * 12);
+
+	assert(fabsf(LightCullerSpotAngle(0.0f) - MathToRadians(90.0f)) < 0.001f);
+	assert(fabsf(cosf(LightCullerSpotAngle(1.0f)) - LIGHT_CULLER_SPOT_CUTOFF) < 0.001f);
+	assert(LightCullerSpotAngle(32.0f) < LightCullerSpotAngle(8.0f));
+}
+
+// A light goes into the clusters it can reach and only their lists
+static void TestLightCullerSingle(void)
+{
+	LightCuller culler;
+	culler.Init(1280, 720, MathToRadians(45.0f), 0.1f, 100.0f);
+	const Vec3D eye = { 0.0f, 0.0f, 0.0f };
+	const Vec3D at = { 0.0f, 0.0f, 1.0f };
+	const Vec3D up = { 0.0f, 1.0f, 0.0f };
+	const Mat4X4 view = MathMat4X4ViewAt(&eye, &at, &up);
+
+	PointLight point;
+	point.Range = 0.5f;
+	point.Position = MathVec3DFromXYZ(0.0f, 0.0f, -5.0f);
+	culler.Cull(view, &point, 1, nullptr, 0);
+	assert(culler.GetIndices().empty());
+	point.Position = MathVec3DFromXYZ(50.0f, 0.0f, 5.0f);
+	culler.Cull(view, &point, 1, nullptr, 0);
+	assert(culler.GetIndices().empty());
+
+	// a small light far away covers a handful of clusters around the middle of the screen
+	point.Position = MathVec3DFromXYZ(0.0f, 0.0f, 20.0f);
+	culler.Cull(view, &point, 1, nullptr, 0);
+	const size_t numHits = culler.GetIndices().size();
+	assert(numHits > 0 && numHits < 32);
+	const LightCluster& middle = culler.GetClusters()[culler.GetClusterIndex(640.0f, 360.0f, 20.0f)];
+	assert(middle.NumPoint == 1 && middle.NumSpot == 0);
+
+	// a spot light at the same place pointing away from the camera, it follows the point light in the list
+	point.Range = 10.0f;
+	SpotLight spot;
+	spot.Range = 10.0f;
+	spot.Spot = 8.0f;
+	spot.Position = point.Position;
+	spot.Direction = MathVec3DFromXYZ(0.0f, 0.0f, 1.0f);
+	culler.Cull(view, &point, 1, &spot, 1);
+	const LightCluster& both = culler.GetClusters()[culler.GetClusterIndex(640.0f, 360.0f, 25.0f)];
+	assert(both.NumPoint == 1 && both.NumSpot == 1);
+	assert(culler.GetIndices()[both.Offset] == 0 && culler.GetIndices()[both.Offset + 1] == 0);
+	// the cone misses the clusters behind the light
+	const LightCluster& behind = culler.GetClusters()[culler.GetClusterIndex(640.0f, 360.0f, 12.0f)];
+	assert(behind.NumPoint == 1 && behind.NumSpot == 0);
+}
+
+// Every light that reaches a point of the view is in the cluster of that point
+static void TestLightCullerConservative(void)
+{
+	const uint32_t width = 1280;
+	const uint32_t height = 720;
+	const float fov = MathToRadians(45.0f);
+	LightCuller culler;
+	culler.Init(width, height, fov, 0.1f, 100.0f);
+	const Mat4X4 proj = MathMat4X4PerspectiveFov(fov, (float)width / (float)height, 0.1f, 100.0f);
+	const Vec3D eye = { 1.0f, 3.0f, -12.0f };
+	const Vec3D at = { 0.0f, 0.0f, 0.0f };
+	const Vec3D up = { 0.0f, 1.0f, 0.0f };
+	const Mat4X4 view = MathMat4X4ViewAt(&eye, &at, &up);
+
+	uint32_t seed = 3;
+	std::vector<PointLight> points(300);
+	for (PointLight& light : points)
+	{
+		light.Position = MathVec3DFromXYZ(LightCullerTestRandom(&seed, -10.0f, 10.0f), LightCullerTestRandom(&seed, -2.0f, 4.0f),
+			LightCullerTestRandom(&seed, -10.0f, 20.0f));
+		light.Range = LightCullerTestRandom(&seed, 0.5f, 4.0f);
+	}
+	std::vector<SpotLight> spots(100);
+	for (SpotLight& light : spots)
+	{
+		light.Position = MathVec3DFromXYZ(LightCullerTestRandom(&seed, -10.0f, 10.0f), LightCullerTestRandom(&seed, -2.0f, 4.0f),
+			LightCullerTestRandom(&seed, -10.0f, 20.0f));
+		light.Direction = MathVec3DFromXYZ(LightCullerTestRandom(&seed, -1.0f, 1.0f), LightCullerTestRandom(&seed, -1.0f, 1.0f),
+			LightCullerTestRandom(&seed, -1.0f, 1.0f));
+		MathVec3DNormalize(&light.Direction);
+		light.Range = LightCullerTestRandom(&seed, 0.5f, 6.0f);
+		light.Spot = LightCullerTestRandom(&seed, 0.0f, 32.0f);
+	}
+	culler.Cull(view, points.data(), (uint32_t)points.size(), spots.data(), (uint32_t)spots.size());
+	const std::vector<LightCluster>& clusters = culler.GetClusters();
+	const std::vector<uint32_t>& indices = culler.GetIndices();
+
+	uint32_t numChecked = 0;
+	for (uint32_t sample = 0; sample < 4000; ++sample)
+	{
+		const Vec3D posW = { LightCullerTestRandom(&seed, -10.0f, 10.0f), LightCullerTestRandom(&seed, -2.0f, 4.0f),
+			LightCullerTestRandom(&seed, -10.0f, 20.0f) };
+		const Vec4D pos = { posW.X, posW.Y, posW.Z, 1.0f };
+		const Vec4D posV = MathMat4X4MultVec4DByMat4X4(&pos, &view);
+		const float ndcX = posV.X * proj.A00 / posV.Z;
+		const float ndcY = posV.Y * proj.A11 / posV.Z;
+		if (posV.Z <= 0.1f || fabsf(ndcX) >= 1.0f || fabsf(ndcY) >= 1.0f)
+		{
+			continue;
+		}
+		++numChecked;
+		const LightCluster& cluster = clusters[culler.GetClusterIndex((ndcX * 0.5f + 0.5f) * width, (0.5f - ndcY * 0.5f) * height, posV.Z)];
+		const uint32_t* first = indices.data() + cluster.Offset;
+
+		for (uint32_t i = 0; i < points.size(); ++i)
+		{
+			const Vec3D toPos = MathVec3DSubtraction(&posW, &points[i].Position);
+			if (sqrtf(MathVec3DDot(&toPos, &toPos)) < points[i].Range * 0.999f)
+			{
+				assert(std::find(first, first + cluster.NumPoint, i) != first + cluster.NumPoint);
+			}
+		}
+		for (uint32_t i = 0; i < spots.size(); ++i)
+		{
+			Vec3D toPos = MathVec3DSubtraction(&posW, &spots[i].Position);
+			const float distance = sqrtf(MathVec3DDot(&toPos, &toPos));
+			toPos = MathVec3DModulateByScalar(&toPos, 1.0f / distance);
+			if (distance < spots[i].Range * 0.999f && MathVec3DDot(&toPos, &spots[i].Direction) > cosf(LightCullerSpotAngle(spots[i].Spot)) + 0.001f)
+			{
+				assert(std::find(first + cluster.NumPoint, first + cluster.NumPoint + cluster.NumSpot, i) != first + cluster.NumPoint + cluster.NumSpot);
+			}
+		}
+	}
+	assert(numChecked > 500);
+
+	// each list holds every light once
+	for (const LightCluster& cluster : clusters)
+	{
+		std::vector<uint32_t> lights(indices.begin() + cluster.Offset, indices.begin() + cluster.Offset + cluster.NumPoint);
+		std::sort(lights.begin(), lights.end());
+		assert(std::unique(lights.begin(), lights.end()) == lights.end());
+		assert(lights.empty() || lights.back() < points.size());
+	}
+}
+
+void LightCullerTest(void)
+{
+	TestLightCullerLayout();
+	TestLightCullerSingle();
+	TestLightCullerConservative();
+}
+#endif
+
+#ifdef LIGHT_CULLER_BENCHMARK
+#include <chrono>
+
+void LightCullerBenchmark(void)
+{
+	const uint32_t numFrames = 16;
+	const uint32_t counts[] = { 1024, 4096, 16384, 65536 };
+	const float fov = MathToRadians(45.0f);
+	const Vec3D up = { 0.0f, 1.0f, 0.0f };
+	for (uint32_t count : counts)
+	{
+		// a quarter spot lights, all of them of half a unit to three units of range over a square that grows with the count
+		std::vector<PointLight> points(count - count / 4);
+		std::vector<SpotLight> spots(count / 4);
+		const float side = sqrtf((float)count) * 2.0f;
+		uint32_t seed = 1;
+		for (PointLight& light : points)
+		{
+			float values[4];
+			for (float& value : values)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				value = (float)(seed >> 8) / (float)(1 << 24);
+			}
+			light.Position = MathVec3DFromXYZ((values[0] - 0.5f) * side, values[1] * 4.0f, (values[2] - 0.5f) * side);
+			light.Range = 0.5f + values[3] * 2.5f;
+		}
+		for (SpotLight& light : spots)
+		{
+			float values[5];
+			for (float& value : values)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				value = (float)(seed >> 8) / (float)(1 << 24);
+			}
+			light.Position = MathVec3DFromXYZ((values[0] - 0.5f) * side, 2.0f + values[1] * 4.0f, (values[2] - 0.5f) * side);
+			light.Direction = MathVec3DFromXYZ(values[4] - 0.5f, -1.0f, values[3] - 0.5f);
+			MathVec3DNormalize(&light.Direction);
+			light.Range = 1.0f + values[3] * 4.0f;
+			light.Spot = 4.0f + values[4] * 28.0f;
+		}
+
+		LightCuller culler;
+		culler.Init(1920, 1080, fov, 0.1f, 100.0f);
+		double seconds = 0.0;
+		size_t numIndices = 0;
+		uint32_t maxPerCluster = 0;
+		for (uint32_t frame = 0; frame < numFrames; ++frame)
+		{
+			// the camera circles the middle of the lights
+			const float angle = (float)frame * 0.2f;
+			const Vec3D eye = { cosf(angle) * 10.0f, 5.0f, sinf(angle) * 10.0f };
+			const Vec3D at = { 0.0f, 0.0f, 0.0f };
+			const Mat4X4 view = MathMat4X4ViewAt(&eye, &at, &up);
+
+			const auto start = std::chrono::steady_clock::now();
+			culler.Cull(view, points.data(), (uint32_t)points.size(), spots.data(), (uint32_t)spots.size());
+			seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			numIndices += culler.GetIndices().size();
+			for (const LightCluster& cluster : culler.GetClusters())
+			{
+				const uint32_t numLights = cluster.NumPoint + cluster.NumSpot;
+				maxPerCluster = numLights > maxPerCluster ? numLights : maxPerCluster;
+			}
+		}
+
+		UtilsDebugPrint("Light culler: %u lights, %.3f ms per frame, %.2f lights per cluster, at most %u\n",
+			count,
+			seconds * 1000.0 / numFrames,
+			(double)numIndices / ((double)numFrames * culler.GetClusters().size()),
+			maxPerCluster);
+	}
+}
+#endif
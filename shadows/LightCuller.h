@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "LightHelper.h"
+#include "Math.h"
+
+// Side of a screen tile in pixels
+#define LIGHT_CULLER_TILE_SIZE 64
+// Depth slices between the near and far plane, thinner close to the camera
+#define LIGHT_CULLER_NUM_SLICES 24
+// A spot light's cone ends where its falloff drops below this
+#define LIGHT_CULLER_SPOT_CUTOFF 0.01f
+
+// Lights of one cluster, mirrors the entries of lightClusters in Common.hlsli.
+// Its point lights are the NumPoint indices from Offset on, its spot lights the NumSpot after them.
+struct LightCluster
+{
+	uint32_t Offset;
+	uint32_t NumPoint;
+	uint32_t NumSpot;
+	uint32_t pad;
+};
+
+// Half angle of the cone of a spot light with exponent spot, a hemisphere for 0
+float LightCullerSpotAngle(float spot);
+
+// Bins the lights of a view into clusters: screen tiles split into slices
+// that grow logarithmically with view depth. A light is only tested against
+// the clusters its bounding box projects onto, four tiles of a row at a time:
+// its range sphere against the boxes of the clusters, and for a spot light
+// its cone against their bounding spheres. Clusters are numbered tile by
+// tile in a row, row by row in a slice, then slice by slice.
+class LightCuller
+{
+public:
+	LightCuller();
+	~LightCuller();
+
+	// Lays out the clusters of a perspective camera, called again when the screen or the projection changes
+	void Init(uint32_t screenWidth, uint32_t screenHeight, float fovY, float zNear, float zFar);
+
+	void Cull(const Mat4X4& view, const PointLight* pointLights, uint32_t numPointLights,
+		const SpotLight* spotLights, uint32_t numSpotLights);
+
+	const std::vector<LightCluster>& GetClusters() const { return m_Clusters; }
+	// Point and spot light indices of every cluster, one after the other
+	const std::vector<uint32_t>& GetIndices() const { return m_Indices; }
+
+	uint32_t GetNumTilesX() const { return m_NumTilesX; }
+	uint32_t GetNumTilesY() const { return m_NumTilesY; }
+	// log(view depth) * scale + bias is the slice of a depth, like the shader computes it
+	float GetDepthScale() const { return m_DepthScale; }
+	float GetDepthBias() const { return m_DepthBias; }
+	// Cluster of a pixel at a view depth
+	uint32_t GetClusterIndex(float x, float y, float depth) const;
+
+private:
+	bool ComputeRange(const Vec3D& center, float radius, uint32_t* tiles, uint32_t* slices) const;
+	uint32_t GetSlice(float depth) const;
+	void Bin(const Vec3D& center, float radius, const Vec3D* direction, float cosAngle, float sinAngle, uint32_t light);
+
+	uint32_t m_Width;
+	uint32_t m_Height;
+	uint32_t m_NumTilesX;
+	uint32_t m_NumTilesY;
+	// tiles in a row of the bounds arrays, padded to a multiple of four
+	uint32_t m_RowStride;
+	float m_ProjX;
+	float m_ProjY;
+	float m_ZNear;
+	float m_ZFar;
+	float m_DepthScale;
+	float m_DepthBias;
+	// view space box and bounding sphere of every cluster, one padded row after the other
+	std::vector<float> m_MinX;
+	std::vector<float> m_MinY;
+	std::vector<float> m_MinZ;
+	std::vector<float> m_MaxX;
+	std::vector<float> m_MaxY;
+	std::vector<float> m_MaxZ;
+	std::vector<float> m_CenterX;
+	std::vector<float> m_CenterY;
+	std::vector<float> m_CenterZ;
+	std::vector<float> m_Radius;
+	// cluster and light of every hit, the point lights before the spot lights
+	std::vector<uint32_t> m_HitClusters;
+	std::vector<uint32_t> m_HitLights;
+	uint32_t m_NumPointHits;
+	// next free index of every cluster while the hits are sorted in
+	std::vector<uint32_t> m_Cursors;
+	std::vector<LightCluster> m_Clusters;
+	std::vector<uint32_t> m_Indices;
+};
+
+#ifdef LIGHT_CULLER_TEST
+void LightCullerTest(void);
+#endif
+
+#ifdef LIGHT_CULLER_BENCHMARK
+// Prints the time to bin 1K to 64K lights into the clusters of a 1080p view
+void LightCullerBenchmark(void);
+#endif
@@ -0,0 +1,263 @@
+#include "LightStore.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cassert>
+
+LightDirtyRanges::LightDirtyRanges()
+{
+}
+
+LightDirtyRanges::~LightDirtyRanges()
+{
+}
+
+void LightDirtyRanges::Mark(uint32_t first, uint32_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	// the same light changed again, which happens a lot with lights that are animated one by one
+	if (!m_Marks.empty() && m_Marks.back().First <= first && first + count <= m_Marks.back().First + m_Marks.back().Count)
+	{
+		return;
+	}
+	const LightStoreRange range = { first, count };
+	m_Marks.push_back(range);
+}
+
+void LightDirtyRanges::Collect(uint32_t mergeGap, std::vector<LightStoreRange>* ranges)
+{
+	std::sort(m_Marks.begin(), m_Marks.end(), [](const LightStoreRange& lhs, const LightStoreRange& rhs)
+		{
+			return lhs.First < rhs.First;
+		});
+	for (const LightStoreRange& mark : m_Marks)
+	{
+		if (!ranges->empty() && mark.First <= ranges->back().First + ranges->back().Count + mergeGap)
+		{
+			LightStoreRange& last = ranges->back();
+			const uint32_t end = std::max(last.First + last.Count, mark.First + mark.Count);
+			last.Count = end - last.First;
+			continue;
+		}
+		ranges->push_back(mark);
+	}
+	m_Marks.clear();
+}
+
+LightStore::LightStore() :
+	m_Capacities{ LIGHT_STORE_MIN_CAPACITY, LIGHT_STORE_MIN_CAPACITY },
+	m_NumCollects(0),
+	m_NumUploads(0),
+	m_UploadedBytes(0),
+	m_FullBytes(0)
+{
+}
+
+LightStore::~LightStore()
+{
+}
+
+void LightStore::Grow(LightStoreArray array, uint32_t size)
+{
+	while (m_Capacities[array] < size)
+	{
+		m_Capacities[array] *= 2;
+	}
+}
+
+uint32_t LightStore::AddPointLight(const PointLight& light)
+{
+	const uint32_t index = (uint32_t)m_PointLights.size();
+	m_PointLights.push_back(light);
+	Grow(LightStorePoint, index + 1);
+	m_Dirty[LightStorePoint].Mark(index, 1);
+	return index;
+}
+
+uint32_t LightStore::AddSpotLight(const SpotLight& light)
+{
+	const uint32_t index = (uint32_t)m_SpotLights.size();
+	m_SpotLights.push_back(light);
+	Grow(LightStoreSpot, index + 1);
+	m_Dirty[LightStoreSpot].Mark(index, 1);
+	return index;
+}
+
+void LightStore::SetPointLight(uint32_t index, const PointLight& light)
+{
+	assert(index < m_PointLights.size());
+	m_PointLights[index] = light;
+	m_Dirty[LightStorePoint].Mark(index, 1);
+}
+
+void LightStore::SetSpotLight(uint32_t index, const SpotLight& light)
+{
+	assert(index < m_SpotLights.size());
+	m_SpotLights[index] = light;
+	m_Dirty[LightStoreSpot].Mark(index, 1);
+}
+
+// The capacities stay, lights added again go into the same buffers
+void LightStore::Clear()
+{
+	m_PointLights.clear();
+	m_SpotLights.clear();
+	for (LightDirtyRanges& dirty : m_Dirty)
+	{
+		dirty.Clear();
+	}
+}
+
+void LightStore::CollectUploads(const bool* resized, std::vector<LightStoreUpload>* uploads)
+{
+	uploads->clear();
+	const uint32_t sizes[LightStoreNumArrays] = { (uint32_t)m_PointLights.size(), (uint32_t)m_SpotLights.size() };
+	const uint32_t strides[LightStoreNumArrays] = { sizeof(PointLight), sizeof(SpotLight) };
+	const uint8_t* data[LightStoreNumArrays] = { (const uint8_t*)m_PointLights.data(), (const uint8_t*)m_SpotLights.data() };
+	for (uint32_t array = 0; array < LightStoreNumArrays; ++array)
+	{
+		// a new buffer has nothing in it yet
+		if (resized[array])
+		{
+			m_Dirty[array].Mark(0, sizes[array]);
+		}
+		if (m_Dirty[array].IsEmpty())
+		{
+			continue;
+		}
+		m_Ranges.clear();
+		m_Dirty[array].Collect(LIGHT_STORE_MERGE_GAP, &m_Ranges);
+		for (const LightStoreRange& range : m_Ranges)
+		{
+			assert(range.First + range.Count <= sizes[array]);
+			const LightStoreUpload upload = { (LightStoreArray)array, range.First * strides[array], range.Count * strides[array],
+				data[array] + (size_t)range.First * strides[array] };
+			uploads->push_back(upload);
+			m_UploadedBytes += upload.Size;
+		}
+		m_FullBytes += (uint64_t)sizes[array] * strides[array];
+	}
+	m_NumUploads += uploads->size();
+	m_NumCollects += uploads->empty() ? 0 : 1;
+}
+
+void LightStore::PrintStats() const
+{
+	UtilsDebugPrint("Lights: %u point and %u spot lights, %llu copies in %llu frames, %llu bytes uploaded of %llu rewritten in full\n",
+		(uint32_t)m_PointLights.size(),
+		(uint32_t)m_SpotLights.size(),
+		m_NumUploads,
+		m_NumCollects,
+		m_UploadedBytes,
+		m_FullBytes);
+}
+
+#ifdef LIGHT_STORE_TEST
+static void TestLightDirtyRanges(void)
+{
+	LightDirtyRanges dirty;
+	std::vector<LightStoreRange> ranges;
+	dirty.Collect(0, &ranges);
+	assert(ranges.empty());
+
+	// touching and overlapping marks in any order become one range
+	dirty.Mark(12, 3);
+	dirty.Mark(10, 2);
+	dirty.Mark(11, 6);
+	dirty.Collect(0, &ranges);
+	assert(ranges.size() == 1 && ranges[0].First == 10 && ranges[0].Count == 7);
+	ranges.clear();
+
+	// a gap is bridged only up to the merge gap
+	dirty.Mark(0, 1);
+	dirty.Mark(5, 1);
+	dirty.Mark(20, 2);
+	dirty.Mark(0, 0);
+	dirty.Collect(4, &ranges);
+	assert(ranges.size() == 2);
+	assert(ranges[0].First == 0 && ranges[0].Count == 6);
+	assert(ranges[1].First == 20 && ranges[1].Count == 2);
+	ranges.clear();
+
+	// the same light marked over and over is one range, collecting clears the marks
+	for (uint32_t i = 0; i < 100; ++i)
+	{
+		dirty.Mark(7, 1);
+	}
+	dirty.Mark(30, 1);
+	dirty.Collect(0, &ranges);
+	assert(ranges.size() == 2 && ranges[0].First == 7 && ranges[0].Count == 1 && ranges[1].First == 30);
+	assert(dirty.IsEmpty());
+	ranges.clear();
+	dirty.Collect(0, &ranges);
+	assert(ranges.empty());
+}
+
+static void TestLightStoreUploads(void)
+{
+	LightStore store;
+	std::vector<LightStoreUpload> uploads;
+	const bool notResized[LightStoreNumArrays] = { false, false };
+	const bool pointResized[LightStoreNumArrays] = { true, false };
+
+	PointLight point;
+	for (uint32_t i = 0; i < 10; ++i)
+	{
+		point.Range = (float)i;
+		assert(store.AddPointLight(point) == i);
+	}
+	SpotLight spot;
+	store.AddSpotLight(spot);
+	assert(store.GetCapacity(LightStorePoint) == LIGHT_STORE_MIN_CAPACITY);
+
+	// the new lights go up in one copy per array
+	store.CollectUploads(notResized, &uploads);
+	assert(uploads.size() == 2);
+	assert(uploads[0].Array == LightStorePoint && uploads[0].Offset == 0 && uploads[0].Size == 10 * sizeof(PointLight));
+	assert(uploads[0].Data == store.GetPointLights().data());
+	assert(uploads[1].Array == LightStoreSpot && uploads[1].Size == sizeof(SpotLight));
+	store.CollectUploads(notResized, &uploads);
+	assert(uploads.empty());
+
+	// changed lights only, neighbours within the merge gap in the same copy
+	point.Range = 100.0f;
+	store.SetPointLight(3, point);
+	store.SetPointLight(5, point);
+	store.SetPointLight(9, point);
+	store.CollectUploads(notResized, &uploads);
+	assert(uploads.size() == 1);
+	assert(uploads[0].Offset == 3 * sizeof(PointLight) && uploads[0].Size == 7 * sizeof(PointLight));
+	assert(((const PointLight*)uploads[0].Data)->Range == 100.0f);
+	store.SetPointLight(0, point);
+	store.SetPointLight(9, point);
+	store.CollectUploads(notResized, &uploads);
+	assert(uploads.size() == 2 && uploads[0].Size == sizeof(PointLight) && uploads[1].Offset == 9 * sizeof(PointLight));
+	const uint64_t uploadedBytes = (10 + 7 + 2) * sizeof(PointLight) + sizeof(SpotLight);
+	assert(store.GetUploadedBytes() == uploadedBytes && store.GetNumUploads() == 5);
+
+	// running out of room doubles the capacity, the recreated buffer gets every light
+	while (store.GetPointLights().size() <= LIGHT_STORE_MIN_CAPACITY)
+	{
+		store.AddPointLight(point);
+	}
+	assert(store.GetCapacity(LightStorePoint) == 2 * LIGHT_STORE_MIN_CAPACITY);
+	store.CollectUploads(pointResized, &uploads);
+	assert(uploads.size() == 1 && uploads[0].Offset == 0 && uploads[0].Size == (LIGHT_STORE_MIN_CAPACITY + 1) * sizeof(PointLight));
+
+	// lights cleared after they were marked are not uploaded
+	store.SetSpotLight(0, spot);
+	store.Clear();
+	store.CollectUploads(notResized, &uploads);
+	assert(uploads.empty());
+	assert(store.GetCapacity(LightStorePoint) == 2 * LIGHT_STORE_MIN_CAPACITY);
+}
+
+void LightStoreTest(void)
+{
+	TestLightDirtyRanges();
+	TestLightStoreUploads();
+}
+#endif
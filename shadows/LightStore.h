@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "LightHelper.h"
+
+// Dirty ranges this many lights apart or closer go up as one copy, a copy costs more than a few lights of bytes
+#define LIGHT_STORE_MERGE_GAP 4
+#define LIGHT_STORE_MIN_CAPACITY 64
+
+// Lights first to first + count - 1
+struct LightStoreRange
+{
+	uint32_t First;
+	uint32_t Count;
+};
+
+// Ranges of an array that changed since they were last collected
+class LightDirtyRanges
+{
+public:
+	LightDirtyRanges();
+	~LightDirtyRanges();
+
+	void Mark(uint32_t first, uint32_t count);
+	// Sorted ranges that neither overlap nor are within mergeGap of each other, the marks are cleared
+	void Collect(uint32_t mergeGap, std::vector<LightStoreRange>* ranges);
+	bool IsEmpty() const { return m_Marks.empty(); }
+	void Clear() { m_Marks.clear(); }
+
+private:
+	std::vector<LightStoreRange> m_Marks;
+};
+
+enum LightStoreArray : uint32_t
+{
+	LightStorePoint,
+	LightStoreSpot,
+	LightStoreNumArrays,
+};
+
+// Bytes of an array to copy into its GPU buffer
+struct LightStoreUpload
+{
+	LightStoreArray Array;
+	uint32_t Offset;
+	uint32_t Size;
+	const void* Data;
+};
+
+// The point and spot lights of a scene as they are laid out in the GPU
+// buffers the shaders read. Every change marks the lights it touched, the
+// uploads of a frame then copy only the marked ranges. The buffers have room
+// for a capacity of lights that doubles when it runs out, a buffer created
+// for a new capacity gets all of its lights uploaded.
+class LightStore
+{
+public:
+	LightStore();
+	~LightStore();
+
+	// Returns the index of the light
+	uint32_t AddPointLight(const PointLight& light);
+	uint32_t AddSpotLight(const SpotLight& light);
+	void SetPointLight(uint32_t index, const PointLight& light);
+	void SetSpotLight(uint32_t index, const SpotLight& light);
+	void Clear();
+
+	const std::vector<PointLight>& GetPointLights() const { return m_PointLights; }
+	const std::vector<SpotLight>& GetSpotLights() const { return m_SpotLights; }
+	// Lights the GPU buffer of the array has to hold
+	uint32_t GetCapacity(LightStoreArray array) const { return m_Capacities[array]; }
+
+	// Copies of the changes since the last call. The data points into the store and stays valid until it changes.
+	// Call after recreating the buffers whose capacity changed, with resized set for them.
+	void CollectUploads(const bool* resized, std::vector<LightStoreUpload>* uploads);
+
+	uint64_t GetUploadedBytes() const { return m_UploadedBytes; }
+	uint64_t GetNumUploads() const { return m_NumUploads; }
+
+	void PrintStats() const;
+
+private:
+	void Grow(LightStoreArray array, uint32_t size);
+
+	std::vector<PointLight> m_PointLights;
+	std::vector<SpotLight> m_SpotLights;
+	LightDirtyRanges m_Dirty[LightStoreNumArrays];
+	uint32_t m_Capacities[LightStoreNumArrays];
+	std::vector<LightStoreRange> m_Ranges;
+
+	uint64_t m_NumCollects;
+	uint64_t m_NumUploads;
+	uint64_t m_UploadedBytes;
+	// bytes rewriting every array in full at every change would have uploaded
+	uint64_t m_FullBytes;
+};
+
+#ifdef LIGHT_STORE_TEST
+void LightStoreTest(void);
+#endif
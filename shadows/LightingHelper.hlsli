@@ -38,7 +38,8 @@ struct Material
 	float4 Specular;
 };
 
-float4 ComputeDirectionalLight(Material mat, DirectionalLight L, float3 normal, float3 toEye)
+// shadow scales the diffuse and specular terms, the ambient term is never shadowed
+float4 ComputeDirectionalLight(Material mat, DirectionalLight L, float3 normal, float3 toEye, float shadow)
 {
     float4 ambient = float4(0.0f, 0.0f, 0.0f, 0.0f);
     float4 diffuse = float4(0.0f, 0.0f, 0.0f, 0.0f);
@@ -60,11 +61,11 @@ float4 ComputeDirectionalLight(Material mat, DirectionalLight L, float3 normal,
         spec = specFactor * mat.Specular * L.Specular;
     }
 
-    return ambient + diffuse + spec;
+    return ambient + shadow * (diffuse + spec);
 }
 
 
-float4 ComputePointLight(Material mat, PointLight L, float3 pos, float3 normal, float3 toEye)
+float4 ComputePointLight(Material mat, PointLight L, float3 pos, float3 normal, float3 toEye, float shadow)
 {
     float4 ambient = float4(0.0f, 0.0f, 0.0f, 0.0f);
     float4 diffuse = float4(0.0f, 0.0f, 0.0f, 0.0f);
@@ -98,11 +99,11 @@ float4 ComputePointLight(Material mat, PointLight L, float3 pos, float3 normal,
     diffuse *= att;
     spec *= att;
 
-    return ambient + diffuse + spec;
+    return ambient + shadow * (diffuse + spec);
 }
 
 
-float4 ComputeSpotLight(Material mat, SpotLight L, float3 pos, float3 normal, float3 toEye)
+float4 ComputeSpotLight(Material mat, SpotLight L, float3 pos, float3 normal, float3 toEye, float shadow)
 {
     float4 ambient = float4(0.0f, 0.0f, 0.0f, 0.0f);
     float4 diffuse = float4(0.0f, 0.0f, 0.0f, 0.0f);
@@ -139,5 +140,5 @@ float4 ComputeSpotLight(Material mat, SpotLight L, float3 pos, float3 normal, fl
     diffuse *= att;
     spec *= att;
 
-    return ambient + diffuse + spec;
+    return ambient + shadow * (diffuse + spec);
 }
\ No newline at end of file
@@ -0,0 +1,477 @@
+#include "LightingReference.h"
+#include "Utils.h"
+
+#include <cassert>
+#include <emmintrin.h>
+#include <math.h>
+
+static void LightingReferenceChannels(const Color& color, float* channels)
+{
+	channels[0] = color.R;
+	channels[1] = color.G;
+	channels[2] = color.B;
+	channels[3] = color.A;
+}
+
+// ambient * ambientScale + shadow * att * (diffuse + spec), the terms every light of LightingHelper.hlsli
+// builds from the direction to the light. reflect(-lightVec, normal) is 2 * dot(lightVec, normal) * normal - lightVec.
+static Color LightingReferenceShade(const Material& mat, const Color& lightAmbient, const Color& lightDiffuse, const Color& lightSpecular,
+	const Vec3D& lightVec, const Vec3D& normal, const Vec3D& toEye, float ambientScale, float att, float shadow)
+{
+	float ambient[4];
+	float diffuse[4];
+	float specular[4];
+	float matAmbient[4];
+	float matDiffuse[4];
+	float matSpecular[4];
+	LightingReferenceChannels(lightAmbient, ambient);
+	LightingReferenceChannels(lightDiffuse, diffuse);
+	LightingReferenceChannels(lightSpecular, specular);
+	LightingReferenceChannels(mat.Ambient, matAmbient);
+	LightingReferenceChannels(mat.Diffuse, matDiffuse);
+	LightingReferenceChannels(mat.Specular, matSpecular);
+
+	const float diffuseFactor = MathVec3DDot(&lightVec, &normal);
+	float specFactor = 0.0f;
+	if (diffuseFactor > 0.0f)
+	{
+		const Vec3D v = {
+			2.0f * diffuseFactor * normal.X - lightVec.X,
+			2.0f * diffuseFactor * normal.Y - lightVec.Y,
+			2.0f * diffuseFactor * normal.Z - lightVec.Z };
+		specFactor = powf(fmaxf(MathVec3DDot(&v, &toEye), 0.0f), mat.Specular.A);
+	}
+
+	float result[4];
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		const float lit = diffuseFactor > 0.0f ? diffuseFactor * matDiffuse[c] * diffuse[c] + specFactor * matSpecular[c] * specular[c] : 0.0f;
+		result[c] = matAmbient[c] * ambient[c] * ambientScale + shadow * att * lit;
+	}
+	return Color(result[0], result[1], result[2], result[3]);
+}
+
+Color LightingReferenceDirectionalLight(const Material& mat, const DirectionalLight& light, const Vec3D& normal, const Vec3D& toEye,
+	float shadow)
+{
+	const Vec3D lightVec = { -light.Direction.X, -light.Direction.Y, -light.Direction.Z };
+	return LightingReferenceShade(mat, light.Ambient, light.Diffuse, light.Specular, lightVec, normal, toEye, 1.0f, 1.0f, shadow);
+}
+
+Color LightingReferencePointLight(const Material& mat, const PointLight& light, const Vec3D& pos, const Vec3D& normal,
+	const Vec3D& toEye, float shadow)
+{
+	Vec3D lightVec = MathVec3DSubtraction(&light.Position, &pos);
+	const float d = sqrtf(MathVec3DDot(&lightVec, &lightVec));
+	if (d > light.Range)
+	{
+		return Color();
+	}
+	lightVec = MathVec3DFromXYZ(lightVec.X / d, lightVec.Y / d, lightVec.Z / d);
+	const float att = 1.0f / (light.Att.X + light.Att.Y * d + light.Att.Z * d * d);
+	return LightingReferenceShade(mat, light.Ambient, light.Diffuse, light.Specular, lightVec, normal, toEye, 1.0f, att, shadow);
+}
+
+Color LightingReferenceSpotLight(const Material& mat, const SpotLight& light, const Vec3D& pos, const Vec3D& normal,
+	const Vec3D& toEye, float shadow)
+{
+	Vec3D lightVec = MathVec3DSubtraction(&light.Position, &pos);
+	const float d = sqrtf(MathVec3DDot(&lightVec, &lightVec));
+	if (d > light.Range)
+	{
+		return Color();
+	}
+	lightVec = MathVec3DFromXYZ(lightVec.X / d, lightVec.Y / d, lightVec.Z / d);
+	const float spot = powf(fmaxf(-MathVec3DDot(&lightVec, &light.Direction), 0.0f), light.Spot);
+	const float att = spot / (light.Att.X + light.Att.Y * d + light.Att.Z * d * d);
+	return LightingReferenceShade(mat, light.Ambient, light.Diffuse, light.Specular, lightVec, normal, toEye, spot, att, shadow);
+}
+
+void LightingReferenceBatchClear(LightingReferenceColors* colors)
+{
+	memset(colors, 0, sizeof(LightingReferenceColors));
+}
+
+void LightingReferenceBatchSet(LightingReferenceBatch* batch, uint32_t lane, const Material& mat, const Vec3D& pos,
+	const Vec3D& normal, const Vec3D& toEye)
+{
+	assert(lane < LIGHTING_REFERENCE_BATCH_SIZE);
+	batch->PosX[lane] = pos.X;
+	batch->PosY[lane] = pos.Y;
+	batch->PosZ[lane] = pos.Z;
+	batch->NormalX[lane] = normal.X;
+	batch->NormalY[lane] = normal.Y;
+	batch->NormalZ[lane] = normal.Z;
+	batch->ToEyeX[lane] = toEye.X;
+	batch->ToEyeY[lane] = toEye.Y;
+	batch->ToEyeZ[lane] = toEye.Z;
+	float channels[4];
+	LightingReferenceChannels(mat.Ambient, channels);
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		batch->Ambient[c][lane] = channels[c];
+	}
+	LightingReferenceChannels(mat.Diffuse, channels);
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		batch->Diffuse[c][lane] = channels[c];
+	}
+	LightingReferenceChannels(mat.Specular, channels);
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		batch->Specular[c][lane] = channels[c];
+	}
+}
+
+// pow of each lane, SSE has none. It is the only part of the lighting done lane by lane.
+static __m128 LightingReferencePow(__m128 base, const float* exponents)
+{
+	float lanes[4];
+	_mm_storeu_ps(lanes, base);
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		lanes[i] = powf(lanes[i], exponents[i]);
+	}
+	return _mm_loadu_ps(lanes);
+}
+
+// LightingReferenceShade for the four lanes from lane on. Lanes outside inRange get nothing.
+static void LightingReferenceShade4(const LightingReferenceBatch& batch, uint32_t lane, const Color& lightAmbient,
+	const Color& lightDiffuse, const Color& lightSpecular, __m128 lx, __m128 ly, __m128 lz, __m128 ambientScale, __m128 att,
+	__m128 inRange, const float* shadow, LightingReferenceColors* colors)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 nx = _mm_loadu_ps(batch.NormalX + lane);
+	const __m128 ny = _mm_loadu_ps(batch.NormalY + lane);
+	const __m128 nz = _mm_loadu_ps(batch.NormalZ + lane);
+	const __m128 diffuseFactor = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, nx), _mm_mul_ps(ly, ny)), _mm_mul_ps(lz, nz));
+	const __m128 lit = _mm_cmpgt_ps(diffuseFactor, zero);
+
+	const __m128 twice = _mm_add_ps(diffuseFactor, diffuseFactor);
+	const __m128 vx = _mm_sub_ps(_mm_mul_ps(twice, nx), lx);
+	const __m128 vy = _mm_sub_ps(_mm_mul_ps(twice, ny), ly);
+	const __m128 vz = _mm_sub_ps(_mm_mul_ps(twice, nz), lz);
+	const __m128 vDotEye = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_loadu_ps(batch.ToEyeX + lane)), _mm_mul_ps(vy, _mm_loadu_ps(batch.ToEyeY + lane))),
+		_mm_mul_ps(vz, _mm_loadu_ps(batch.ToEyeZ + lane)));
+	const __m128 specFactor = LightingReferencePow(_mm_max_ps(vDotEye, zero), batch.Specular[3] + lane);
+	const __m128 scale = _mm_mul_ps(att, shadow ? _mm_loadu_ps(shadow + lane) : _mm_set1_ps(1.0f));
+
+	float ambient[4];
+	float diffuse[4];
+	float specular[4];
+	LightingReferenceChannels(lightAmbient, ambient);
+	LightingReferenceChannels(lightDiffuse, diffuse);
+	LightingReferenceChannels(lightSpecular, specular);
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		const __m128 diffuseTerm = _mm_mul_ps(_mm_mul_ps(diffuseFactor, _mm_loadu_ps(batch.Diffuse[c] + lane)), _mm_set1_ps(diffuse[c]));
+		const __m128 specularTerm = _mm_mul_ps(_mm_mul_ps(specFactor, _mm_loadu_ps(batch.Specular[c] + lane)), _mm_set1_ps(specular[c]));
+		const __m128 litTerm = _mm_and_ps(_mm_add_ps(diffuseTerm, specularTerm), lit);
+		const __m128 ambientTerm = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(batch.Ambient[c] + lane), _mm_set1_ps(ambient[c])), ambientScale);
+		const __m128 term = _mm_and_ps(_mm_add_ps(ambientTerm, _mm_mul_ps(scale, litTerm)), inRange);
+		_mm_storeu_ps(colors->Channels[c] + lane, _mm_add_ps(_mm_loadu_ps(colors->Channels[c] + lane), term));
+	}
+}
+
+void LightingReferenceBatchDirectionalLight(const LightingReferenceBatch& batch, const DirectionalLight& light, const float* shadow,
+	LightingReferenceColors* colors)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 all = _mm_cmpeq_ps(one, one);
+	for (uint32_t lane = 0; lane < LIGHTING_REFERENCE_BATCH_SIZE; lane += 4)
+	{
+		LightingReferenceShade4(batch, lane, light.Ambient, light.Diffuse, light.Specular,
+			_mm_set1_ps(-light.Direction.X), _mm_set1_ps(-light.Direction.Y), _mm_set1_ps(-light.Direction.Z), one, one, all, shadow, colors);
+	}
+}
+
+// Direction to the light, its distance and whether it is in range for the four lanes from lane on
+static void LightingReferenceToLight4(const LightingReferenceBatch& batch, uint32_t lane, const Vec3D& position, float range,
+	__m128* lx, __m128* ly, __m128* lz, __m128* d, __m128* inRange)
+{
+	*lx = _mm_sub_ps(_mm_set1_ps(position.X), _mm_loadu_ps(batch.PosX + lane));
+	*ly = _mm_sub_ps(_mm_set1_ps(position.Y), _mm_loadu_ps(batch.PosY + lane));
+	*lz = _mm_sub_ps(_mm_set1_ps(position.Z), _mm_loadu_ps(batch.PosZ + lane));
+	*d = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(*lx, *lx), _mm_mul_ps(*ly, *ly)), _mm_mul_ps(*lz, *lz)));
+	*inRange = _mm_cmple_ps(*d, _mm_set1_ps(range));
+	*lx = _mm_div_ps(*lx, *d);
+	*ly = _mm_div_ps(*ly, *d);
+	*lz = _mm_div_ps(*lz, *d);
+}
+
+static __m128 LightingReferenceAttenuation4(const Vec3D& att, __m128 d)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_set1_ps(att.X), _mm_mul_ps(_mm_set1_ps(att.Y), d)), _mm_mul_ps(_mm_set1_ps(att.Z), _mm_mul_ps(d, d)));
+}
+
+void LightingReferenceBatchPointLight(const LightingReferenceBatch& batch, const PointLight& light, const float* shadow,
+	LightingReferenceColors* colors)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	for (uint32_t lane = 0; lane < LIGHTING_REFERENCE_BATCH_SIZE; lane += 4)
+	{
+		__m128 lx, ly, lz, d, inRange;
+		LightingReferenceToLight4(batch, lane, light.Position, light.Range, &lx, &ly, &lz, &d, &inRange);
+		if (_mm_movemask_ps(inRange) == 0)
+		{
+			continue;
+		}
+		const __m128 att = _mm_div_ps(one, LightingReferenceAttenuation4(light.Att, d));
+		LightingReferenceShade4(batch, lane, light.Ambient, light.Diffuse, light.Specular, lx, ly, lz, one, att, inRange, shadow, colors);
+	}
+}
+
+void LightingReferenceBatchSpotLight(const LightingReferenceBatch& batch, const SpotLight& light, const float* shadow,
+	LightingReferenceColors* colors)
+{
+	const float exponents[4] = { light.Spot, light.Spot, light.Spot, light.Spot };
+	for (uint32_t lane = 0; lane < LIGHTING_REFERENCE_BATCH_SIZE; lane += 4)
+	{
+		__m128 lx, ly, lz, d, inRange;
+		LightingReferenceToLight4(batch, lane, light.Position, light.Range, &lx, &ly, &lz, &d, &inRange);
+		if (_mm_movemask_ps(inRange) == 0)
+		{
+			continue;
+		}
+		const __m128 cosAxis = _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, _mm_set1_ps(light.Direction.X)),
+			_mm_mul_ps(ly, _mm_set1_ps(light.Direction.Y))), _mm_mul_ps(lz, _mm_set1_ps(light.Direction.Z))));
+		const __m128 spot = LightingReferencePow(_mm_max_ps(cosAxis, _mm_setzero_ps()), exponents);
+		const __m128 att = _mm_div_ps(spot, LightingReferenceAttenuation4(light.Att, d));
+		LightingReferenceShade4(batch, lane, light.Ambient, light.Diffuse, light.Specular, lx, ly, lz, spot, att, inRange, shadow, colors);
+	}
+}
+
+#ifdef LIGHTING_REFERENCE_TEST
+static bool LightingReferenceTestEqual(const Color& color, float r, float g, float b, float a)
+{
+	return fabsf(color.R - r) < 0.0001f && fabsf(color.G - g) < 0.0001f && fabsf(color.B - b) < 0.0001f && fabsf(color.A - a) < 0.0001f;
+}
+
+static float LightingReferenceTestRandom(uint32_t* seed, float min, float max)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return min + (max - min) * (float)(*seed >> 8) / (float)(1 << 24);
+}
+
+static Vec3D LightingReferenceTestDirection(uint32_t* seed)
+{
+	Vec3D direction = { LightingReferenceTestRandom(seed, -1.0f, 1.0f), LightingReferenceTestRandom(seed, -1.0f, 1.0f),
+		LightingReferenceTestRandom(seed, -1.0f, 1.0f) };
+	MathVec3DNormalize(&direction);
+	return direction;
+}
+
+static Color LightingReferenceTestColor(uint32_t* seed, float alpha)
+{
+	return Color(LightingReferenceTestRandom(seed, 0.0f, 1.0f), LightingReferenceTestRandom(seed, 0.0f, 1.0f),
+		LightingReferenceTestRandom(seed, 0.0f, 1.0f), alpha);
+}
+
+// Values worked out by hand from LightingHelper.hlsli for a surface at the origin facing up, seen from above
+static void TestLightingReferenceGolden(void)
+{
+	const Material mat(Color(0.5f, 0.5f, 0.5f, 1.0f), Color(1.0f, 0.5f, 0.25f, 1.0f), Color(1.0f, 1.0f, 1.0f, 16.0f));
+	const Vec3D pos = { 0.0f, 0.0f, 0.0f };
+	const Vec3D up = { 0.0f, 1.0f, 0.0f };
+
+	DirectionalLight dirLight;
+	dirLight.Ambient = Color(0.2f, 0.2f, 0.2f, 1.0f);
+	dirLight.Diffuse = Color(0.8f, 0.8f, 0.8f, 1.0f);
+	dirLight.Specular = Color(0.5f, 0.5f, 0.5f, 1.0f);
+	dirLight.Direction = MathVec3DFromXYZ(0.0f, -1.0f, 0.0f);
+	// alpha sums the alphas of the terms, the specular one scaled by the power like the shader does
+	assert(LightingReferenceTestEqual(LightingReferenceDirectionalLight(mat, dirLight, up, up, 1.0f), 1.4f, 1.0f, 0.8f, 18.0f));
+	assert(LightingReferenceTestEqual(LightingReferenceDirectionalLight(mat, dirLight, up, up, 0.5f), 0.75f, 0.55f, 0.45f, 9.5f));
+	// from below only the ambient term is left
+	dirLight.Direction = up;
+	assert(LightingReferenceTestEqual(LightingReferenceDirectionalLight(mat, dirLight, up, up, 1.0f), 0.1f, 0.1f, 0.1f, 1.0f));
+
+	PointLight pointLight;
+	pointLight.Ambient = dirLight.Ambient;
+	pointLight.Diffuse = dirLight.Diffuse;
+	pointLight.Specular = dirLight.Specular;
+	pointLight.Att = MathVec3DFromXYZ(1.0f, 0.5f, 0.25f);
+	pointLight.Position = MathVec3DFromXYZ(1.0f, 2.0f, 0.0f);
+	pointLight.Range = 5.0f;
+	assert(LightingReferenceTestEqual(LightingReferencePointLight(mat, pointLight, pos, up, up, 1.0f),
+		0.3373574f, 0.2311320f, 0.1780193f, 2.0625729f));
+	pointLight.Range = 2.0f;
+	assert(LightingReferenceTestEqual(LightingReferencePointLight(mat, pointLight, pos, up, up, 1.0f), 0.0f, 0.0f, 0.0f, 0.0f));
+
+	SpotLight spotLight;
+	spotLight.Ambient = dirLight.Ambient;
+	spotLight.Diffuse = dirLight.Diffuse;
+	spotLight.Specular = dirLight.Specular;
+	spotLight.Att = pointLight.Att;
+	spotLight.Position = MathVec3DFromXYZ(2.0f, 2.0f, 0.0f);
+	spotLight.Direction = MathVec3DFromXYZ(0.0f, -1.0f, 0.0f);
+	spotLight.Range = 5.0f;
+	spotLight.Spot = 8.0f;
+	assert(LightingReferenceTestEqual(LightingReferenceSpotLight(mat, spotLight, pos, up, up, 1.0f),
+		0.0142871f, 0.0102824f, 0.0082800f, 0.0733967f));
+	// pointing away the ambient term goes too
+	spotLight.Direction = up;
+	assert(LightingReferenceTestEqual(LightingReferenceSpotLight(mat, spotLight, pos, up, up, 1.0f), 0.0f, 0.0f, 0.0f, 0.0f));
+}
+
+// Batches shade every lane like the scalar functions, lights in range of some lanes only included
+static void TestLightingReferenceBatch(void)
+{
+	uint32_t seed = 5;
+	for (uint32_t iteration = 0; iteration < 200; ++iteration)
+	{
+		DirectionalLight dirLight;
+		dirLight.Ambient = LightingReferenceTestColor(&seed, 1.0f);
+		dirLight.Diffuse = LightingReferenceTestColor(&seed, 1.0f);
+		dirLight.Specular = LightingReferenceTestColor(&seed, 1.0f);
+		dirLight.Direction = LightingReferenceTestDirection(&seed);
+		PointLight pointLight;
+		pointLight.Ambient = LightingReferenceTestColor(&seed, 1.0f);
+		pointLight.Diffuse = LightingReferenceTestColor(&seed, 1.0f);
+		pointLight.Specular = LightingReferenceTestColor(&seed, 1.0f);
+		pointLight.Att = MathVec3DFromXYZ(1.0f, 0.09f, 0.032f);
+		pointLight.Position = MathVec3DFromXYZ(LightingReferenceTestRandom(&seed, -2.0f, 2.0f), LightingReferenceTestRandom(&seed, -2.0f, 2.0f),
+			LightingReferenceTestRandom(&seed, -2.0f, 2.0f));
+		pointLight.Range = LightingReferenceTestRandom(&seed, 0.5f, 3.0f);
+		SpotLight spotLight;
+		spotLight.Ambient = LightingReferenceTestColor(&seed, 1.0f);
+		spotLight.Diffuse = LightingReferenceTestColor(&seed, 1.0f);
+		spotLight.Specular = LightingReferenceTestColor(&seed, 1.0f);
+		spotLight.Att = pointLight.Att;
+		spotLight.Position = pointLight.Position;
+		spotLight.Direction = LightingReferenceTestDirection(&seed);
+		spotLight.Range = pointLight.Range;
+		spotLight.Spot = LightingReferenceTestRandom(&seed, 1.0f, 32.0f);
+
+		LightingReferenceBatch batch;
+		Material mats[LIGHTING_REFERENCE_BATCH_SIZE];
+		Vec3D positions[LIGHTING_REFERENCE_BATCH_SIZE];
+		Vec3D normals[LIGHTING_REFERENCE_BATCH_SIZE];
+		Vec3D toEyes[LIGHTING_REFERENCE_BATCH_SIZE];
+		float shadow[LIGHTING_REFERENCE_BATCH_SIZE];
+		for (uint32_t lane = 0; lane < LIGHTING_REFERENCE_BATCH_SIZE; ++lane)
+		{
+			mats[lane] = Material(LightingReferenceTestColor(&seed, 1.0f), LightingReferenceTestColor(&seed, 1.0f),
+				LightingReferenceTestColor(&seed, LightingReferenceTestRandom(&seed, 1.0f, 64.0f)));
+			positions[lane] = MathVec3DFromXYZ(LightingReferenceTestRandom(&seed, -2.0f, 2.0f), LightingReferenceTestRandom(&seed, -2.0f, 2.0f),
+				LightingReferenceTestRandom(&seed, -2.0f, 2.0f));
+			normals[lane] = LightingReferenceTestDirection(&seed);
+			toEyes[lane] = LightingReferenceTestDirection(&seed);
+			shadow[lane] = LightingReferenceTestRandom(&seed, 0.0f, 1.0f);
+			LightingReferenceBatchSet(&batch, lane, mats[lane], positions[lane], normals[lane], toEyes[lane]);
+		}
+
+		LightingReferenceColors colors;
+		LightingReferenceBatchClear(&colors);
+		LightingReferenceBatchDirectionalLight(batch, dirLight, shadow, &colors);
+		LightingReferenceBatchPointLight(batch, pointLight, nullptr, &colors);
+		LightingReferenceBatchSpotLight(batch, spotLight, shadow, &colors);
+		for (uint32_t lane = 0; lane < LIGHTING_REFERENCE_BATCH_SIZE; ++lane)
+		{
+			const Color dir = LightingReferenceDirectionalLight(mats[lane], dirLight, normals[lane], toEyes[lane], shadow[lane]);
+			const Color point = LightingReferencePointLight(mats[lane], pointLight, positions[lane], normals[lane], toEyes[lane], 1.0f);
+			const Color spot = LightingReferenceSpotLight(mats[lane], spotLight, positions[lane], normals[lane], toEyes[lane], shadow[lane]);
+			const float expected[4] = { dir.R + point.R + spot.R, dir.G + point.G + spot.G, dir.B + point.B + spot.B, dir.A + point.A + spot.A };
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				assert(fabsf(colors.Channels[c][lane] - expected[c]) <= 0.0001f * fmaxf(1.0f, fabsf(expected[c])));
+			}
+		}
+	}
+}
+
+void LightingReferenceTest(void)
+{
+	TestLightingReferenceGolden();
+	TestLightingReferenceBatch();
+}
+#endif
+
+#ifdef LIGHTING_REFERENCE_BENCHMARK
+#include <chrono>
+#include <vector>
+
+void LightingReferenceBenchmark(void)
+{
+	const uint32_t numBatches = 1 << 15;
+	const uint32_t numSamples = numBatches * LIGHTING_REFERENCE_BATCH_SIZE;
+	// the lights of the default scene around a floor of samples
+	DirectionalLight dirLight;
+	dirLight.Ambient = Color(0.2f, 0.2f, 0.2f, 1.0f);
+	dirLight.Diffuse = Color(0.7f, 0.7f, 0.6f, 1.0f);
+	dirLight.Specular = Color(0.8f, 0.8f, 0.7f, 1.0f);
+	dirLight.Direction = MathVec3DFromXYZ(0.7071f, -0.7071f, 0.0f);
+	PointLight pointLights[4];
+	const Vec3D positions[4] = { { -4.0f, 1.5f, -4.0f }, { -4.0f, 1.5f, 4.0f }, { 4.0f, 1.5f, 4.0f }, { 4.0f, 1.5f, -4.0f } };
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		pointLights[i].Ambient = Color(0.3f, 0.3f, 0.3f, 1.0f);
+		pointLights[i].Diffuse = Color(0.6f, 0.6f, 0.6f, 1.0f);
+		pointLights[i].Specular = Color(0.2f, 0.2f, 0.2f, 1.0f);
+		pointLights[i].Att = MathVec3DFromXYZ(1.0f, 0.09f, 0.032f);
+		pointLights[i].Position = positions[i];
+		pointLights[i].Range = 5.0f;
+	}
+	SpotLight spotLight;
+	spotLight.Diffuse = Color(1.0f, 1.0f, 1.0f, 1.0f);
+	spotLight.Specular = Color(1.0f, 1.0f, 1.0f, 1.0f);
+	spotLight.Att = MathVec3DFromXYZ(1.0f, 0.09f, 0.032f);
+	spotLight.Position = MathVec3DFromXYZ(0.0f, 3.0f, -3.0f);
+	spotLight.Direction = MathVec3DFromXYZ(0.0f, -0.7071f, 0.7071f);
+	spotLight.Range = 5.0f;
+	spotLight.Spot = 8.0f;
+
+	const Material mat(Color(0.8f, 0.8f, 0.8f, 1.0f), Color(0.8f, 0.8f, 0.8f, 1.0f), Color(0.5f, 0.5f, 0.5f, 32.0f));
+	const Vec3D up = { 0.0f, 1.0f, 0.0f };
+	const Vec3D eye = { 0.0f, 4.0f, -8.0f };
+	std::vector<LightingReferenceBatch> batches(numBatches);
+	std::vector<Vec3D> samplePositions(numSamples);
+	std::vector<Vec3D> toEyes(numSamples);
+	for (uint32_t sample = 0; sample < numSamples; ++sample)
+	{
+		const Vec3D pos = { -5.0f + 10.0f * (float)(sample % 512) / 512.0f, -1.0f, -5.0f + 10.0f * (float)(sample / 512) / 512.0f };
+		Vec3D toEye = MathVec3DSubtraction(&eye, &pos);
+		MathVec3DNormalize(&toEye);
+		samplePositions[sample] = pos;
+		toEyes[sample] = toEye;
+		LightingReferenceBatchSet(&batches[sample / LIGHTING_REFERENCE_BATCH_SIZE], sample % LIGHTING_REFERENCE_BATCH_SIZE, mat, pos, up, toEye);
+	}
+
+	float checksum = 0.0f;
+	const auto scalarStart = std::chrono::steady_clock::now();
+	for (uint32_t sample = 0; sample < numSamples; ++sample)
+	{
+		Color color = LightingReferenceDirectionalLight(mat, dirLight, up, toEyes[sample], 1.0f);
+		for (const PointLight& pointLight : pointLights)
+		{
+			const Color point = LightingReferencePointLight(mat, pointLight, samplePositions[sample], up, toEyes[sample], 1.0f);
+			color.R += point.R;
+		}
+		const Color spot = LightingReferenceSpotLight(mat, spotLight, samplePositions[sample], up, toEyes[sample], 1.0f);
+		checksum += color.R + spot.R;
+	}
+	const std::chrono::duration<double> scalar = std::chrono::steady_clock::now() - scalarStart;
+
+	LightingReferenceColors colors;
+	const auto batchStart = std::chrono::steady_clock::now();
+	for (const LightingReferenceBatch& batch : batches)
+	{
+		LightingReferenceBatchClear(&colors);
+		LightingReferenceBatchDirectionalLight(batch, dirLight, nullptr, &colors);
+		for (const PointLight& pointLight : pointLights)
+		{
+			LightingReferenceBatchPointLight(batch, pointLight, nullptr, &colors);
+		}
+		LightingReferenceBatchSpotLight(batch, spotLight, nullptr, &colors);
+		checksum += colors.Channels[0][0];
+	}
+	const std::chrono::duration<double> batched = std::chrono::steady_clock::now() - batchStart;
+
+	UtilsDebugPrint("Lighting reference: %u samples, 6 lights, %.2f M samples/s one at a time, %.2f M samples/s in batches of %u (%.1f)\n",
+		numSamples,
+		numSamples / scalar.count() / 1e6,
+		numSamples / batched.count() / 1e6,
+		LIGHTING_REFERENCE_BATCH_SIZE,
+		checksum);
+}
+#endif
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+
+#include "LightHelper.h"
+#include "Math.h"
+
+// Samples shaded together, the lanes of a batch
+#define LIGHTING_REFERENCE_BATCH_SIZE 8
+
+// The lighting functions of LightingHelper.hlsli on the CPU, term for term,
+// so the shading math can be checked without a GPU and light bakers get the
+// same answer the pixel shader would. Each light adds to the color like the
+// shader's resultColor += Compute...Light(...), the shadow factor scales its
+// diffuse and specular terms.
+Color LightingReferenceDirectionalLight(const Material& mat, const DirectionalLight& light, const Vec3D& normal, const Vec3D& toEye,
+	float shadow);
+Color LightingReferencePointLight(const Material& mat, const PointLight& light, const Vec3D& pos, const Vec3D& normal,
+	const Vec3D& toEye, float shadow);
+Color LightingReferenceSpotLight(const Material& mat, const SpotLight& light, const Vec3D& pos, const Vec3D& normal,
+	const Vec3D& toEye, float shadow);
+
+// Surface samples by component, one lane per sample. Normals and directions
+// to the eye are unit length, the specular power is in Specular[3] as it is
+// in Material::Specular.A.
+struct LightingReferenceBatch
+{
+	float PosX[LIGHTING_REFERENCE_BATCH_SIZE];
+	float PosY[LIGHTING_REFERENCE_BATCH_SIZE];
+	float PosZ[LIGHTING_REFERENCE_BATCH_SIZE];
+	float NormalX[LIGHTING_REFERENCE_BATCH_SIZE];
+	float NormalY[LIGHTING_REFERENCE_BATCH_SIZE];
+	float NormalZ[LIGHTING_REFERENCE_BATCH_SIZE];
+	float ToEyeX[LIGHTING_REFERENCE_BATCH_SIZE];
+	float ToEyeY[LIGHTING_REFERENCE_BATCH_SIZE];
+	float ToEyeZ[LIGHTING_REFERENCE_BATCH_SIZE];
+	float Ambient[4][LIGHTING_REFERENCE_BATCH_SIZE];
+	float Diffuse[4][LIGHTING_REFERENCE_BATCH_SIZE];
+	float Specular[4][LIGHTING_REFERENCE_BATCH_SIZE];
+};
+
+// Colors of a batch by channel, R, G, B and A
+struct LightingReferenceColors
+{
+	float Channels[4][LIGHTING_REFERENCE_BATCH_SIZE];
+};
+
+void LightingReferenceBatchClear(LightingReferenceColors* colors);
+// Sets lane of the batch from a sample as the scalar functions take it
+void LightingReferenceBatchSet(LightingReferenceBatch* batch, uint32_t lane, const Material& mat, const Vec3D& pos,
+	const Vec3D& normal, const Vec3D& toEye);
+
+// The scalar functions above for every lane of a batch, four lanes per SSE
+// instruction. shadow holds a factor per lane, null leaves them unshadowed.
+void LightingReferenceBatchDirectionalLight(const LightingReferenceBatch& batch, const DirectionalLight& light, const float* shadow,
+	LightingReferenceColors* colors);
+void LightingReferenceBatchPointLight(const LightingReferenceBatch& batch, const PointLight& light, const float* shadow,
+	LightingReferenceColors* colors);
+void LightingReferenceBatchSpotLight(const LightingReferenceBatch& batch, const SpotLight& light, const float* shadow,
+	LightingReferenceColors* colors);
+
+#ifdef LIGHTING_REFERENCE_TEST
+void LightingReferenceTest(void);
+#endif
+
+#ifdef LIGHTING_REFERENCE_BENCHMARK
+// Prints the samples per second shaded by a directional, four point and a spot light, one at a time and in batches
+void LightingReferenceBenchmark(void);
+#endif
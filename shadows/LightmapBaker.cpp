@@ -0,0 +1,886 @@
+#include "LightmapBaker.h"
+#include "DDSLoader.h"
+#include "JobSystem.h"
+#include "LightingReference.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <corecrt_math_defines.h>
+#include <cstdlib>
+#include <math.h>
+#include <numeric>
+#include <unordered_map>
+
+static double LightmapBakerNowMillis()
+{
+	using namespace std::chrono;
+	return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+static float LightmapBakerAxis(const Vec3D& v, uint32_t axis)
+{
+	return axis == 0 ? v.X : (axis == 1 ? v.Y : v.Z);
+}
+
+// Rounds up to whole blocks, so that no block of the compressed lightmap is shared by two charts
+static uint32_t LightmapBakerBlocks(uint32_t texels)
+{
+	return (texels + BC_BLOCK_SIZE - 1) / BC_BLOCK_SIZE * BC_BLOCK_SIZE;
+}
+
+static Vec3D LightmapBakerMadd(const Vec3D& a, float s, const Vec3D& b)
+{
+	return Vec3D(a.X + s * b.X, a.Y + s * b.Y, a.Z + s * b.Z);
+}
+
+static float LightmapBakerEdge(const Vec2D& a, const Vec2D& b, float x, float y)
+{
+	return (b.X - a.X) * (y - a.Y) - (b.Y - a.Y) * (x - a.X);
+}
+
+static uint32_t LightmapBakerFind(std::vector<uint32_t>& parents, uint32_t triangle)
+{
+	while (parents[triangle] != triangle)
+	{
+		parents[triangle] = parents[parents[triangle]];
+		triangle = parents[triangle];
+	}
+	return triangle;
+}
+
+LightmapBaker::LightmapBaker() :
+	m_Width{0},
+	m_Height{0},
+	m_TexelsPerUnit{0.0f},
+	m_NumRays{0},
+	m_LayoutMillis{0.0},
+	m_BVHMillis{0.0},
+	m_TraceMillis{0.0},
+	m_CompressMillis{0.0},
+	m_NumThreads{1}
+{
+}
+
+LightmapBaker::~LightmapBaker()
+{
+}
+
+void LightmapBaker::Bake(const LightmapBakerInstance* instances, uint32_t numInstances, const LightmapBakerLights& lights,
+	float texelsPerUnit, JobSystem* jobs)
+{
+	m_NumRays = 0;
+	m_NumThreads = jobs ? jobs->GetNumThreads() + 1 : 1;
+
+	const double layoutStart = LightmapBakerNowMillis();
+	Transform(instances, numInstances);
+	BuildCharts(numInstances);
+	m_TexelsPerUnit = texelsPerUnit;
+	while (!Pack(m_TexelsPerUnit))
+	{
+		m_TexelsPerUnit *= 0.75f;
+	}
+	BuildUVSets(numInstances);
+	Rasterize();
+	const double bvhStart = LightmapBakerNowMillis();
+	m_LayoutMillis = bvhStart - layoutStart;
+
+	m_BVH.Build(m_Positions.data(), m_Triangles.data(), (uint32_t)m_Triangles.size() / 3);
+	const double traceStart = LightmapBakerNowMillis();
+	m_BVHMillis = traceStart - bvhStart;
+
+	m_Texels.assign((size_t)m_Width * m_Height * 4, 0.0f);
+	const uint32_t numBatches = ((uint32_t)m_Samples.size() + LIGHTING_REFERENCE_BATCH_SIZE - 1) / LIGHTING_REFERENCE_BATCH_SIZE;
+	if (jobs)
+	{
+		jobs->ParallelFor(numBatches, LIGHTMAP_BAKER_BATCHES_PER_JOB, [this, &lights](uint32_t begin, uint32_t end)
+			{
+				Trace(lights, begin, end);
+			});
+	}
+	else
+	{
+		Trace(lights, 0, numBatches);
+	}
+	Dilate();
+	const double compressStart = LightmapBakerNowMillis();
+	m_TraceMillis = compressStart - traceStart;
+
+	Compress(jobs);
+	m_CompressMillis = LightmapBakerNowMillis() - compressStart;
+}
+
+void LightmapBaker::Transform(const LightmapBakerInstance* instances, uint32_t numInstances)
+{
+	m_Positions.clear();
+	m_Normals.clear();
+	m_Triangles.clear();
+	m_FirstVertices.assign(1, 0);
+	m_FirstTriangles.assign(1, 0);
+	for (uint32_t i = 0; i < numInstances; ++i)
+	{
+		const LightmapBakerInstance& instance = instances[i];
+		const uint32_t firstVertex = (uint32_t)m_Positions.size();
+		for (uint32_t v = 0; v < instance.NumVertices; ++v)
+		{
+			const Vertex& vertex = instance.Vertices[v];
+			const Vec4D position = { vertex.Position.X, vertex.Position.Y, vertex.Position.Z, 1.0f };
+			const Vec4D normal = { vertex.Normal.X, vertex.Normal.Y, vertex.Normal.Z, 0.0f };
+			const Vec4D worldPosition = MathMat4X4MultVec4DByMat4X4(&position, &instance.World);
+			const Vec4D worldNormal = MathMat4X4MultVec4DByMat4X4(&normal, &instance.World);
+			Vec3D direction = { worldNormal.X, worldNormal.Y, worldNormal.Z };
+			MathVec3DNormalize(&direction);
+			m_Positions.emplace_back(worldPosition.X, worldPosition.Y, worldPosition.Z);
+			m_Normals.push_back(direction);
+		}
+		for (uint32_t index = 0; index < instance.NumIndices; ++index)
+		{
+			assert(instance.Indices[index] < instance.NumVertices);
+			m_Triangles.push_back(firstVertex + instance.Indices[index]);
+		}
+		m_FirstVertices.push_back((uint32_t)m_Positions.size());
+		m_FirstTriangles.push_back((uint32_t)m_Triangles.size() / 3);
+	}
+}
+
+// Triangles that share an edge and face the same side of a box end up in
+// one chart. Edges are matched by position, the vertices of most meshes are
+// split where their normals or texture coordinates are.
+void LightmapBaker::BuildCharts(uint32_t numInstances)
+{
+	m_Charts.clear();
+	m_ChartTriangles.clear();
+	m_TriangleCharts.assign(m_Triangles.size() / 3, 0);
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> welded;
+	std::vector<uint8_t> sides;
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> rootCharts;
+	std::unordered_map<uint64_t, uint32_t> edges;
+	for (uint32_t instance = 0; instance < numInstances; ++instance)
+	{
+		const uint32_t firstVertex = m_FirstVertices[instance];
+		const uint32_t numVertices = m_FirstVertices[instance + 1] - firstVertex;
+		const uint32_t firstTriangle = m_FirstTriangles[instance];
+		const uint32_t numTriangles = m_FirstTriangles[instance + 1] - firstTriangle;
+
+		order.resize(numVertices);
+		std::iota(order.begin(), order.end(), firstVertex);
+		std::sort(order.begin(), order.end(), [this](uint32_t lhs, uint32_t rhs)
+			{
+				const Vec3D& a = m_Positions[lhs];
+				const Vec3D& b = m_Positions[rhs];
+				return a.X != b.X ? a.X < b.X : (a.Y != b.Y ? a.Y < b.Y : a.Z < b.Z);
+			});
+		welded.resize(numVertices);
+		uint32_t id = 0;
+		for (uint32_t i = 0; i < numVertices; ++i)
+		{
+			const Vec3D& position = m_Positions[order[i]];
+			if (i > 0)
+			{
+				const Vec3D& previous = m_Positions[order[i - 1]];
+				id += position.X != previous.X || position.Y != previous.Y || position.Z != previous.Z ? 1 : 0;
+			}
+			welded[order[i] - firstVertex] = id;
+		}
+
+		// the side is the axis of the largest component of the face normal and its sign
+		sides.resize(numTriangles);
+		parents.resize(numTriangles);
+		for (uint32_t t = 0; t < numTriangles; ++t)
+		{
+			const uint32_t* corners = &m_Triangles[3 * (firstTriangle + t)];
+			const Vec3D edge1 = MathVec3DSubtraction(&m_Positions[corners[1]], &m_Positions[corners[0]]);
+			const Vec3D edge2 = MathVec3DSubtraction(&m_Positions[corners[2]], &m_Positions[corners[0]]);
+			const Vec3D normal = MathVec3DCross(&edge1, &edge2);
+			const float x = fabsf(normal.X);
+			const float y = fabsf(normal.Y);
+			const float z = fabsf(normal.Z);
+			const uint32_t axis = x >= y && x >= z ? 0 : (y >= z ? 1 : 2);
+			sides[t] = (uint8_t)(2 * axis + (LightmapBakerAxis(normal, axis) < 0.0f ? 1 : 0));
+			parents[t] = t;
+		}
+
+		edges.clear();
+		edges.reserve(3 * numTriangles);
+		for (uint32_t t = 0; t < numTriangles; ++t)
+		{
+			const uint32_t* corners = &m_Triangles[3 * (firstTriangle + t)];
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				const uint32_t a = welded[corners[corner] - firstVertex];
+				const uint32_t b = welded[corners[(corner + 1) % 3] - firstVertex];
+				if (a == b)
+				{
+					continue;
+				}
+				const uint64_t key = (uint64_t)std::min(a, b) << 32 | std::max(a, b);
+				const auto found = edges.emplace(key, t);
+				const uint32_t other = found.first->second;
+				if (!found.second && sides[other] == sides[t])
+				{
+					parents[LightmapBakerFind(parents, t)] = LightmapBakerFind(parents, other);
+				}
+			}
+		}
+
+		// charts in the order of their first triangles, then their triangles bucketed in order
+		const uint32_t firstChart = (uint32_t)m_Charts.size();
+		rootCharts.assign(numTriangles, UINT32_MAX);
+		for (uint32_t t = 0; t < numTriangles; ++t)
+		{
+			const uint32_t root = LightmapBakerFind(parents, t);
+			if (rootCharts[root] == UINT32_MAX)
+			{
+				rootCharts[root] = (uint32_t)m_Charts.size();
+				LightmapChart chart = {};
+				chart.Instance = instance;
+				chart.Axis = sides[t] / 2;
+				chart.MinU = FLT_MAX;
+				chart.MinV = FLT_MAX;
+				m_Charts.push_back(chart);
+			}
+			m_TriangleCharts[firstTriangle + t] = rootCharts[root];
+			++m_Charts[rootCharts[root]].NumTriangles;
+		}
+		uint32_t offset = (uint32_t)m_ChartTriangles.size();
+		for (uint32_t chart = firstChart; chart < m_Charts.size(); ++chart)
+		{
+			m_Charts[chart].FirstTriangle = offset;
+			offset += m_Charts[chart].NumTriangles;
+			m_Charts[chart].NumTriangles = 0;
+		}
+		m_ChartTriangles.resize(offset);
+		for (uint32_t t = firstTriangle; t < firstTriangle + numTriangles; ++t)
+		{
+			LightmapChart& chart = m_Charts[m_TriangleCharts[t]];
+			m_ChartTriangles[chart.FirstTriangle + chart.NumTriangles++] = t;
+		}
+	}
+
+	// the projected bounds, which the texel density turns into a size
+	for (LightmapChart& chart : m_Charts)
+	{
+		float maxU = -FLT_MAX;
+		float maxV = -FLT_MAX;
+		for (uint32_t i = chart.FirstTriangle; i < chart.FirstTriangle + chart.NumTriangles; ++i)
+		{
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				const Vec3D& position = m_Positions[m_Triangles[3 * m_ChartTriangles[i] + corner]];
+				const float u = LightmapBakerAxis(position, (chart.Axis + 1) % 3);
+				const float v = LightmapBakerAxis(position, (chart.Axis + 2) % 3);
+				chart.MinU = fminf(chart.MinU, u);
+				chart.MinV = fminf(chart.MinV, v);
+				maxU = fmaxf(maxU, u);
+				maxV = fmaxf(maxV, v);
+			}
+		}
+		chart.SizeU = maxU - chart.MinU;
+		chart.SizeV = maxV - chart.MinV;
+	}
+}
+
+// Shelves of charts from the tallest down, as wide as a square of their area
+bool LightmapBaker::Pack(float texelsPerUnit)
+{
+	uint64_t area = 0;
+	uint32_t widest = BC_BLOCK_SIZE;
+	for (LightmapChart& chart : m_Charts)
+	{
+		chart.Width = LightmapBakerBlocks((uint32_t)ceilf(chart.SizeU * texelsPerUnit) + 1 + 2 * LIGHTMAP_BAKER_GUTTER);
+		chart.Height = LightmapBakerBlocks((uint32_t)ceilf(chart.SizeV * texelsPerUnit) + 1 + 2 * LIGHTMAP_BAKER_GUTTER);
+		area += (uint64_t)chart.Width * chart.Height;
+		widest = std::max(widest, chart.Width);
+	}
+	if (widest > LIGHTMAP_BAKER_MAX_SIZE)
+	{
+		return false;
+	}
+	const uint32_t width = std::min(std::max(widest, LightmapBakerBlocks((uint32_t)ceil(sqrt((double)area)))), (uint32_t)LIGHTMAP_BAKER_MAX_SIZE);
+
+	std::vector<uint32_t> order(m_Charts.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [this](uint32_t lhs, uint32_t rhs)
+		{
+			const LightmapChart& a = m_Charts[lhs];
+			const LightmapChart& b = m_Charts[rhs];
+			return a.Height != b.Height ? a.Height > b.Height : (a.Width != b.Width ? a.Width > b.Width : lhs < rhs);
+		});
+	uint32_t x = 0;
+	uint32_t y = 0;
+	uint32_t shelfHeight = 0;
+	for (uint32_t index : order)
+	{
+		LightmapChart& chart = m_Charts[index];
+		if (x + chart.Width > width)
+		{
+			y += shelfHeight;
+			x = 0;
+			shelfHeight = 0;
+		}
+		chart.X = x;
+		chart.Y = y;
+		x += chart.Width;
+		shelfHeight = std::max(shelfHeight, chart.Height);
+	}
+	const uint32_t height = std::max(y + shelfHeight, (uint32_t)BC_BLOCK_SIZE);
+	if (height > LIGHTMAP_BAKER_MAX_SIZE)
+	{
+		return false;
+	}
+	m_Width = width;
+	m_Height = height;
+	return true;
+}
+
+Vec2D LightmapBaker::ToTexels(const LightmapChart& chart, const Vec3D& position) const
+{
+	const float u = LightmapBakerAxis(position, (chart.Axis + 1) % 3) - chart.MinU;
+	const float v = LightmapBakerAxis(position, (chart.Axis + 2) % 3) - chart.MinV;
+	return Vec2D(chart.X + LIGHTMAP_BAKER_GUTTER + 0.5f + u * m_TexelsPerUnit, chart.Y + LIGHTMAP_BAKER_GUTTER + 0.5f + v * m_TexelsPerUnit);
+}
+
+void LightmapBaker::BuildUVSets(uint32_t numInstances)
+{
+	m_UVSets.assign(numInstances, LightmapUVSet());
+	std::unordered_map<uint64_t, uint32_t> vertices;
+	for (uint32_t instance = 0; instance < numInstances; ++instance)
+	{
+		LightmapUVSet& set = m_UVSets[instance];
+		const uint32_t firstVertex = m_FirstVertices[instance];
+		const uint32_t firstTriangle = m_FirstTriangles[instance];
+		const uint32_t numTriangles = m_FirstTriangles[instance + 1] - firstTriangle;
+		set.Indices.resize(3 * (size_t)numTriangles);
+		vertices.clear();
+		for (uint32_t t = 0; t < numTriangles; ++t)
+		{
+			const uint32_t chart = m_TriangleCharts[firstTriangle + t];
+			for (uint32_t corner = 0; corner < 3; ++corner)
+			{
+				const uint32_t vertex = m_Triangles[3 * (firstTriangle + t) + corner];
+				const uint64_t key = (uint64_t)chart << 32 | vertex;
+				const auto found = vertices.emplace(key, (uint32_t)set.SourceVertices.size());
+				if (found.second)
+				{
+					const Vec2D texels = ToTexels(m_Charts[chart], m_Positions[vertex]);
+					set.SourceVertices.push_back(vertex - firstVertex);
+					set.UVs.emplace_back(texels.X / m_Width, texels.Y / m_Height);
+				}
+				set.Indices[3 * t + corner] = found.first->second;
+			}
+		}
+	}
+}
+
+// Every texel whose center a chart triangle covers becomes a sample, the first triangle to cover it wins
+void LightmapBaker::Rasterize()
+{
+	m_Samples.clear();
+	m_Covered.assign((size_t)m_Width * m_Height, 0);
+	for (const LightmapChart& chart : m_Charts)
+	{
+		for (uint32_t i = chart.FirstTriangle; i < chart.FirstTriangle + chart.NumTriangles; ++i)
+		{
+			const uint32_t* corners = &m_Triangles[3 * m_ChartTriangles[i]];
+			const Vec2D p0 = ToTexels(chart, m_Positions[corners[0]]);
+			const Vec2D p1 = ToTexels(chart, m_Positions[corners[1]]);
+			const Vec2D p2 = ToTexels(chart, m_Positions[corners[2]]);
+			const float area = LightmapBakerEdge(p0, p1, p2.X, p2.Y);
+			if (fabsf(area) < 1e-8f)
+			{
+				continue;
+			}
+			const Vec3D edge1 = MathVec3DSubtraction(&m_Positions[corners[1]], &m_Positions[corners[0]]);
+			const Vec3D edge2 = MathVec3DSubtraction(&m_Positions[corners[2]], &m_Positions[corners[0]]);
+			Vec3D faceNormal = MathVec3DCross(&edge1, &edge2);
+			MathVec3DNormalize(&faceNormal);
+
+			const uint32_t minX = (uint32_t)std::max((float)chart.X, floorf(fminf(fminf(p0.X, p1.X), p2.X)));
+			const uint32_t minY = (uint32_t)std::max((float)chart.Y, floorf(fminf(fminf(p0.Y, p1.Y), p2.Y)));
+			const uint32_t maxX = (uint32_t)std::min((float)(chart.X + chart.Width - 1), ceilf(fmaxf(fmaxf(p0.X, p1.X), p2.X)));
+			const uint32_t maxY = (uint32_t)std::min((float)(chart.Y + chart.Height - 1), ceilf(fmaxf(fmaxf(p0.Y, p1.Y), p2.Y)));
+			for (uint32_t y = minY; y <= maxY; ++y)
+			{
+				for (uint32_t x = minX; x <= maxX; ++x)
+				{
+					const uint32_t texel = y * m_Width + x;
+					const float cx = x + 0.5f;
+					const float cy = y + 0.5f;
+					const float w0 = LightmapBakerEdge(p1, p2, cx, cy) / area;
+					const float w1 = LightmapBakerEdge(p2, p0, cx, cy) / area;
+					const float w2 = 1.0f - w0 - w1;
+					// centers on the edges between the triangles of a chart are taken by one of them
+					if (m_Covered[texel] || w0 < -1e-4f || w1 < -1e-4f || w2 < -1e-4f)
+					{
+						continue;
+					}
+					m_Covered[texel] = 1;
+
+					Sample sample;
+					sample.Position = LightmapBakerMadd(LightmapBakerMadd(MathVec3DModulateByScalar(&m_Positions[corners[0]], w0),
+						w1, m_Positions[corners[1]]), w2, m_Positions[corners[2]]);
+					sample.Normal = LightmapBakerMadd(LightmapBakerMadd(MathVec3DModulateByScalar(&m_Normals[corners[0]], w0),
+						w1, m_Normals[corners[1]]), w2, m_Normals[corners[2]]);
+					const float length = sqrtf(MathVec3DDot(&sample.Normal, &sample.Normal));
+					sample.Normal = length > 1e-6f ? MathVec3DModulateByScalar(&sample.Normal, 1.0f / length) : faceNormal;
+					sample.Texel = texel;
+					m_Samples.push_back(sample);
+				}
+			}
+		}
+	}
+}
+
+// Shadow factor of a light for each lane, lanes the light does not reach get no ray
+void LightmapBaker::Trace(const LightmapBakerLights& lights, uint32_t first, uint32_t end)
+{
+	const Material white(Color(0.0f, 0.0f, 0.0f, 0.0f), Color(1.0f, 1.0f, 1.0f, 1.0f), Color(0.0f, 0.0f, 0.0f, 1.0f));
+	uint64_t numRays = 0;
+	for (uint32_t batchIdx = first; batchIdx < end; ++batchIdx)
+	{
+		const uint32_t base = batchIdx * LIGHTING_REFERENCE_BATCH_SIZE;
+		const uint32_t count = std::min((uint32_t)LIGHTING_REFERENCE_BATCH_SIZE, (uint32_t)m_Samples.size() - base);
+		LightingReferenceBatch batch;
+		Vec3D origins[LIGHTING_REFERENCE_BATCH_SIZE];
+		for (uint32_t lane = 0; lane < LIGHTING_REFERENCE_BATCH_SIZE; ++lane)
+		{
+			// lanes past the end repeat the last sample and are dropped
+			const Sample& sample = m_Samples[base + std::min(lane, count - 1)];
+			origins[lane] = LightmapBakerMadd(sample.Position, LIGHTMAP_BAKER_RAY_OFFSET, sample.Normal);
+			LightingReferenceBatchSet(&batch, lane, white, sample.Position, sample.Normal, sample.Normal);
+		}
+
+		LightingReferenceColors colors;
+		LightingReferenceBatchClear(&colors);
+		float shadow[LIGHTING_REFERENCE_BATCH_SIZE];
+		for (uint32_t light = 0; light < lights.NumDirLights; ++light)
+		{
+			const DirectionalLight& dirLight = lights.DirLights[light];
+			const Vec3D toLight = { -dirLight.Direction.X, -dirLight.Direction.Y, -dirLight.Direction.Z };
+			for (uint32_t lane = 0; lane < LIGHTING_REFERENCE_BATCH_SIZE; ++lane)
+			{
+				const Sample& sample = m_Samples[base + std::min(lane, count - 1)];
+				shadow[lane] = 0.0f;
+				if (lane < count && MathVec3DDot(&sample.Normal, &toLight) > 0.0f)
+				{
+					shadow[lane] = m_BVH.Occluded(origins[lane], toLight, FLT_MAX) ? 0.0f : 1.0f;
+					++numRays;
+				}
+			}
+			LightingReferenceBatchDirectionalLight(batch, dirLight, shadow, &colors);
+		}
+		for (uint32_t light = 0; light < lights.NumPointLights + lights.NumSpotLights; ++light)
+		{
+			const bool isPoint = light < lights.NumPointLights;
+			const PointLight* pointLight = isPoint ? &lights.PointLights[light] : nullptr;
+			const SpotLight* spotLight = isPoint ? nullptr : &lights.SpotLights[light - lights.NumPointLights];
+			const Vec3D& position = isPoint ? pointLight->Position : spotLight->Position;
+			const float range = isPoint ? pointLight->Range : spotLight->Range;
+			bool reached = false;
+			for (uint32_t lane = 0; lane < LIGHTING_REFERENCE_BATCH_SIZE; ++lane)
+			{
+				const Sample& sample = m_Samples[base + std::min(lane, count - 1)];
+				const Vec3D toLight = MathVec3DSubtraction(&position, &origins[lane]);
+				shadow[lane] = 0.0f;
+				if (lane >= count || MathVec3DDot(&toLight, &toLight) > range * range || MathVec3DDot(&sample.Normal, &toLight) <= 0.0f ||
+					(spotLight && MathVec3DDot(&toLight, &spotLight->Direction) >= 0.0f))
+				{
+					continue;
+				}
+				// the ray ends at the light
+				shadow[lane] = m_BVH.Occluded(origins[lane], toLight, 1.0f) ? 0.0f : 1.0f;
+				reached = true;
+				++numRays;
+			}
+			if (!reached)
+			{
+				continue;
+			}
+			if (isPoint)
+			{
+				LightingReferenceBatchPointLight(batch, *pointLight, shadow, &colors);
+			}
+			else
+			{
+				LightingReferenceBatchSpotLight(batch, *spotLight, shadow, &colors);
+			}
+		}
+
+		for (uint32_t lane = 0; lane < count; ++lane)
+		{
+			const Sample& sample = m_Samples[base + lane];
+			// cosine weighted directions around the normal, seeded by the texel so that bakes repeat whatever the jobs
+			const float sign = copysignf(1.0f, sample.Normal.Z);
+			const float a = -1.0f / (sign + sample.Normal.Z);
+			const float b = sample.Normal.X * sample.Normal.Y * a;
+			const Vec3D tangent = { 1.0f + sign * sample.Normal.X * sample.Normal.X * a, sign * b, -sign * sample.Normal.X };
+			const Vec3D bitangent = { b, sign + sample.Normal.Y * sample.Normal.Y * a, -sample.Normal.Y };
+			uint32_t seed = sample.Texel * 2654435761u + 1;
+			uint32_t numHits = 0;
+			for (uint32_t ray = 0; ray < LIGHTMAP_BAKER_AO_RAYS; ++ray)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				const float r1 = (float)(seed >> 8) / (float)(1 << 24);
+				seed = seed * 1664525u + 1013904223u;
+				const float r2 = (float)(seed >> 8) / (float)(1 << 24);
+				const float radius = sqrtf(r2);
+				const float phi = 2.0f * (float)M_PI * r1;
+				const Vec3D direction = LightmapBakerMadd(LightmapBakerMadd(MathVec3DModulateByScalar(&tangent, radius * cosf(phi)),
+					radius * sinf(phi), bitangent), sqrtf(1.0f - r2), sample.Normal);
+				numHits += m_BVH.Occluded(origins[lane], direction, LIGHTMAP_BAKER_AO_DISTANCE) ? 1 : 0;
+			}
+			numRays += LIGHTMAP_BAKER_AO_RAYS;
+
+			float* texel = &m_Texels[4 * (size_t)sample.Texel];
+			texel[0] = colors.Channels[0][lane];
+			texel[1] = colors.Channels[1][lane];
+			texel[2] = colors.Channels[2][lane];
+			texel[3] = 1.0f - (float)numHits / LIGHTMAP_BAKER_AO_RAYS;
+		}
+	}
+	m_NumRays += numRays;
+}
+
+// Empty texels next to baked ones take their average, a texel further out per pass
+void LightmapBaker::Dilate()
+{
+	std::vector<uint8_t> covered;
+	for (uint32_t pass = 0; pass < LIGHTMAP_BAKER_GUTTER; ++pass)
+	{
+		covered = m_Covered;
+		for (uint32_t y = 0; y < m_Height; ++y)
+		{
+			for (uint32_t x = 0; x < m_Width; ++x)
+			{
+				const uint32_t texel = y * m_Width + x;
+				if (m_Covered[texel])
+				{
+					continue;
+				}
+				float sum[4] = {};
+				uint32_t numNeighbours = 0;
+				for (uint32_t ny = y > 0 ? y - 1 : 0; ny <= std::min(y + 1, m_Height - 1); ++ny)
+				{
+					for (uint32_t nx = x > 0 ? x - 1 : 0; nx <= std::min(x + 1, m_Width - 1); ++nx)
+					{
+						const uint32_t neighbour = ny * m_Width + nx;
+						if (!m_Covered[neighbour])
+						{
+							continue;
+						}
+						for (uint32_t c = 0; c < 4; ++c)
+						{
+							sum[c] += m_Texels[4 * (size_t)neighbour + c];
+						}
+						++numNeighbours;
+					}
+				}
+				if (numNeighbours == 0)
+				{
+					continue;
+				}
+				for (uint32_t c = 0; c < 4; ++c)
+				{
+					m_Texels[4 * (size_t)texel + c] = sum[c] / numNeighbours;
+				}
+				covered[texel] = 1;
+			}
+		}
+		m_Covered.swap(covered);
+	}
+}
+
+// Light as a fraction of LIGHTMAP_BAKER_MAX_INTENSITY in BC1 color, occlusion in the BC4 alpha of BC3
+void LightmapBaker::Compress(JobSystem* jobs)
+{
+	const size_t numTexels = (size_t)m_Width * m_Height;
+	std::vector<uint8_t> rgba(numTexels * 4);
+	for (size_t texel = 0; texel < numTexels; ++texel)
+	{
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			const float scale = c < 3 ? 1.0f / LIGHTMAP_BAKER_MAX_INTENSITY : 1.0f;
+			rgba[4 * texel + c] = (uint8_t)(MathClamp(0.0f, 1.0f, m_Texels[4 * texel + c] * scale) * 255.0f + 0.5f);
+		}
+	}
+
+	m_Image = TextureImage();
+	m_Image.Format = DDS_FORMAT_BC3_UNORM;
+	m_Image.Width = m_Width;
+	m_Image.Height = m_Height;
+	m_Image.NumLevels = 1;
+	m_Image.Offsets[0] = 0;
+	m_Image.RowPitches[0] = BCRowPitch(BCFormat::BC3, m_Width);
+	m_Image.LevelSizes[0] = (uint32_t)BCSurfaceSize(BCFormat::BC3, m_Width, m_Height);
+	m_Image.UncompressedBytes = rgba.size();
+	m_Image.Data.resize(m_Image.LevelSizes[0]);
+	BCCompressImage(rgba.data(), m_Width, m_Height, BCFormat::BC3, TEXTURE_BUILDER_BC_QUALITY, jobs, m_Image.Data.data());
+}
+
+bool LightmapBaker::Write(const char* filename) const
+{
+	return TextureWriteDDS(filename, m_Image);
+}
+
+void LightmapBaker::PrintStats() const
+{
+	const double seconds = m_TraceMillis / 1000.0;
+	UtilsDebugPrint("Lightmap: %u instances, %u triangles, %u charts in %ux%u texels at %.1f texels per unit, %u texels baked, %u bytes BC3\n",
+		(uint32_t)m_UVSets.size(),
+		(uint32_t)m_Triangles.size() / 3,
+		(uint32_t)m_Charts.size(),
+		m_Width,
+		m_Height,
+		m_TexelsPerUnit,
+		(uint32_t)m_Samples.size(),
+		(uint32_t)m_Image.Data.size());
+	UtilsDebugPrint("Lightmap: %llu rays on %u threads, %.2f M rays/s, baked in %.1f ms: layout %.1f ms, BVH %.1f ms, trace %.1f ms, compress %.1f ms\n",
+		(uint64_t)m_NumRays,
+		m_NumThreads,
+		seconds > 0.0 ? m_NumRays / seconds / 1e6 : 0.0,
+		GetBakeMillis(),
+		m_LayoutMillis,
+		m_BVHMillis,
+		m_TraceMillis,
+		m_CompressMillis);
+}
+
+#ifdef LIGHTMAP_BAKER_TEST
+// Unit cube with a vertex per face corner, as OBJ meshes are loaded
+static void LightmapBakerTestCube(std::vector<Vertex>* vertices, std::vector<uint32_t>* indices)
+{
+	const Vec3D normals[] = { { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f },
+		{ 0.0f, 0.0f, -1.0f } };
+	for (const Vec3D& normal : normals)
+	{
+		// two axes across the face, their cross product along the normal so the corners wind the same way on every face
+		const Vec3D across = fabsf(normal.Y) > 0.5f ? Vec3D(1.0f, 0.0f, 0.0f) : Vec3D(0.0f, 1.0f, 0.0f);
+		const Vec3D up = MathVec3DCross(&normal, &across);
+		const uint32_t first = (uint32_t)vertices->size();
+		const float corners[4][2] = { { -0.5f, -0.5f }, { 0.5f, -0.5f }, { 0.5f, 0.5f }, { -0.5f, 0.5f } };
+		for (const auto& corner : corners)
+		{
+			Vertex vertex = {};
+			vertex.Position = LightmapBakerMadd(LightmapBakerMadd(MathVec3DModulateByScalar(&normal, 0.5f), corner[0], across), corner[1], up);
+			vertex.Normal = normal;
+			vertices->push_back(vertex);
+		}
+		const uint32_t quad[] = { 0, 1, 2, 0, 2, 3 };
+		for (uint32_t index : quad)
+		{
+			indices->push_back(first + index);
+		}
+	}
+}
+
+// Quad on the floor of width by depth units
+static void LightmapBakerTestQuad(float width, float depth, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices)
+{
+	const Vec3D corners[] = { { -0.5f * width, 0.0f, -0.5f * depth }, { -0.5f * width, 0.0f, 0.5f * depth }, { 0.5f * width, 0.0f, 0.5f * depth },
+		{ 0.5f * width, 0.0f, -0.5f * depth } };
+	for (const Vec3D& corner : corners)
+	{
+		Vertex vertex = {};
+		vertex.Position = corner;
+		vertex.Normal = Vec3D(0.0f, 1.0f, 0.0f);
+		vertices->push_back(vertex);
+	}
+	*indices = { 0, 1, 2, 0, 2, 3 };
+}
+
+// Texel of a point on an instance from its UV set
+static uint32_t LightmapBakerTestTexel(const LightmapBaker& baker, uint32_t instance, const std::vector<Vertex>& vertices,
+	const Mat4X4& world, const Vec3D& point)
+{
+	const LightmapUVSet& set = baker.GetUVSet(instance);
+	for (size_t t = 0; t < set.Indices.size(); t += 3)
+	{
+		Vec2D corners[3];
+		Vec2D uvs[3];
+		for (uint32_t corner = 0; corner < 3; ++corner)
+		{
+			const uint32_t vertex = set.Indices[t + corner];
+			const Vec3D& local = vertices[set.SourceVertices[vertex]].Position;
+			const Vec4D localPosition = { local.X, local.Y, local.Z, 1.0f };
+			const Vec4D position = MathMat4X4MultVec4DByMat4X4(&localPosition, &world);
+			corners[corner] = Vec2D(position.X, position.Z);
+			uvs[corner] = set.UVs[vertex];
+		}
+		const float area = LightmapBakerEdge(corners[0], corners[1], corners[2].X, corners[2].Y);
+		const float w0 = LightmapBakerEdge(corners[1], corners[2], point.X, point.Z) / area;
+		const float w1 = LightmapBakerEdge(corners[2], corners[0], point.X, point.Z) / area;
+		const float w2 = 1.0f - w0 - w1;
+		if (fabsf(area) > 0.0f && w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f)
+		{
+			const float u = w0 * uvs[0].X + w1 * uvs[1].X + w2 * uvs[2].X;
+			const float v = w0 * uvs[0].Y + w1 * uvs[1].Y + w2 * uvs[2].Y;
+			return (uint32_t)(v * baker.GetHeight()) * baker.GetWidth() + (uint32_t)(u * baker.GetWidth());
+		}
+	}
+	assert(false);
+	return 0;
+}
+
+// A floor with a cube standing on it, lit from the upper left
+static void TestLightmapBakerScene(void)
+{
+	std::vector<Vertex> floorVertices;
+	std::vector<uint32_t> floorIndices;
+	LightmapBakerTestQuad(4.0f, 4.0f, &floorVertices, &floorIndices);
+	std::vector<Vertex> cubeVertices;
+	std::vector<uint32_t> cubeIndices;
+	LightmapBakerTestCube(&cubeVertices, &cubeIndices);
+
+	const Vec3D cubeOffset = { 0.0f, 0.5f, 0.0f };
+	LightmapBakerInstance instances[2] = {};
+	instances[0].Vertices = floorVertices.data();
+	instances[0].NumVertices = (uint32_t)floorVertices.size();
+	instances[0].Indices = floorIndices.data();
+	instances[0].NumIndices = (uint32_t)floorIndices.size();
+	instances[0].World = MathMat4X4Identity();
+	instances[1].Vertices = cubeVertices.data();
+	instances[1].NumVertices = (uint32_t)cubeVertices.size();
+	instances[1].Indices = cubeIndices.data();
+	instances[1].NumIndices = (uint32_t)cubeIndices.size();
+	instances[1].World = MathMat4X4TranslateFromVec3D(&cubeOffset);
+
+	DirectionalLight dirLight;
+	dirLight.Ambient = Color(0.2f, 0.2f, 0.2f, 1.0f);
+	dirLight.Diffuse = Color(0.7f, 0.7f, 0.6f, 1.0f);
+	dirLight.Direction = Vec3D(0.7071068f, -0.7071068f, 0.0f);
+	// reaches the front left of the floor only
+	PointLight pointLight;
+	pointLight.Diffuse = Color(0.5f, 0.0f, 0.0f, 1.0f);
+	pointLight.Att = Vec3D(1.0f, 0.09f, 0.032f);
+	pointLight.Position = Vec3D(-1.5f, 0.5f, -1.5f);
+	pointLight.Range = 1.0f;
+	LightmapBakerLights lights = {};
+	lights.DirLights = &dirLight;
+	lights.NumDirLights = 1;
+	lights.PointLights = &pointLight;
+	lights.NumPointLights = 1;
+
+	LightmapBaker baker;
+	baker.Bake(instances, 2, lights, 8.0f, nullptr);
+
+	// the floor is one chart and every side of the cube another, none of them overlapping
+	const std::vector<LightmapChart>& charts = baker.GetCharts();
+	assert(charts.size() == 7 && charts[0].Instance == 0 && charts[1].Instance == 1);
+	assert(baker.GetWidth() % BC_BLOCK_SIZE == 0 && baker.GetHeight() % BC_BLOCK_SIZE == 0);
+	for (size_t i = 0; i < charts.size(); ++i)
+	{
+		assert(charts[i].X % BC_BLOCK_SIZE == 0 && charts[i].Y % BC_BLOCK_SIZE == 0);
+		assert(charts[i].X + charts[i].Width <= baker.GetWidth() && charts[i].Y + charts[i].Height <= baker.GetHeight());
+		for (size_t j = 0; j < i; ++j)
+		{
+			assert(charts[i].X >= charts[j].X + charts[j].Width || charts[j].X >= charts[i].X + charts[i].Width ||
+				charts[i].Y >= charts[j].Y + charts[j].Height || charts[j].Y >= charts[i].Y + charts[i].Height);
+		}
+	}
+	// 8 texels a unit over 4 units, 1 to reach the far edge and the gutters on both sides, in whole blocks
+	assert(charts[0].Width == 40 && charts[0].Height == 40);
+	// the cube corners are split between the three charts they touch
+	assert(baker.GetUVSet(0).SourceVertices.size() == 4 && baker.GetUVSet(1).SourceVertices.size() == 24);
+	assert(baker.GetUVSet(1).Indices.size() == cubeIndices.size());
+	for (uint32_t instance = 0; instance < 2; ++instance)
+	{
+		for (const Vec2D& uv : baker.GetUVSet(instance).UVs)
+		{
+			assert(uv.X > 0.0f && uv.X < 1.0f && uv.Y > 0.0f && uv.Y < 1.0f);
+		}
+	}
+
+	// lit in the open, nothing within reach of the occlusion rays
+	const Material white(Color(), Color(1.0f, 1.0f, 1.0f, 1.0f), Color(0.0f, 0.0f, 0.0f, 1.0f));
+	const Vec3D up = { 0.0f, 1.0f, 0.0f };
+	const Color direct = LightingReferenceDirectionalLight(white, dirLight, up, up, 1.0f);
+	const std::vector<float>& texels = baker.GetTexels();
+	const uint32_t open = LightmapBakerTestTexel(baker, 0, floorVertices, instances[0].World, Vec3D(-1.7f, 0.0f, 1.2f));
+	assert(fabsf(texels[4 * open] - direct.R) < 1e-4f && fabsf(texels[4 * open + 2] - direct.B) < 1e-4f);
+	assert(texels[4 * open + 3] == 1.0f);
+	// the point light adds red
+	const uint32_t red = LightmapBakerTestTexel(baker, 0, floorVertices, instances[0].World, Vec3D(-1.5f, 0.0f, -1.5f));
+	assert(texels[4 * red] > direct.R + 0.1f && fabsf(texels[4 * red + 1] - direct.G) < 1e-4f);
+	// in the shadow of the cube, which also hides part of the sky
+	const uint32_t shadowed = LightmapBakerTestTexel(baker, 0, floorVertices, instances[0].World, Vec3D(0.8f, 0.0f, 0.0f));
+	assert(texels[4 * shadowed] == 0.0f);
+	assert(texels[4 * shadowed + 3] > 0.3f && texels[4 * shadowed + 3] < 0.95f);
+	// opposite sides of the cube are laid flat along the same axis
+	uint32_t numAxisCharts[3] = {};
+	for (const LightmapChart& chart : charts)
+	{
+		numAxisCharts[chart.Axis] += chart.Instance == 1 ? 1 : 0;
+	}
+	assert(numAxisCharts[0] == 2 && numAxisCharts[1] == 2 && numAxisCharts[2] == 2);
+
+	// the compressed lightmap is close to the baked light
+	const TextureImage& image = baker.GetImage();
+	assert(image.Format == DDS_FORMAT_BC3_UNORM && image.Data.size() == (size_t)baker.GetWidth() * baker.GetHeight());
+	const uint32_t blocksPerRow = baker.GetWidth() / BC_BLOCK_SIZE;
+	const uint32_t x = open % baker.GetWidth();
+	const uint32_t y = open / baker.GetWidth();
+	uint8_t decoded[BC_BLOCK_TEXELS * 4];
+	BCDecompressBlock(BCFormat::BC3, &image.Data[((y / BC_BLOCK_SIZE) * blocksPerRow + x / BC_BLOCK_SIZE) * BCBlockBytes(BCFormat::BC3)], decoded);
+	const uint8_t* texel = &decoded[4 * ((y % BC_BLOCK_SIZE) * BC_BLOCK_SIZE + x % BC_BLOCK_SIZE)];
+	assert(abs((int)texel[0] - (int)(direct.R / LIGHTMAP_BAKER_MAX_INTENSITY * 255.0f + 0.5f)) <= 8);
+	assert(texel[3] == 255);
+
+	// the same texels on many threads
+	JobSystem jobs;
+	jobs.Init(4);
+	LightmapBaker parallel;
+	parallel.Bake(instances, 2, lights, 8.0f, &jobs);
+	assert(parallel.GetTexels() == texels && parallel.GetNumRays() == baker.GetNumRays());
+	jobs.Shutdown();
+}
+
+// Charts that do not fit at the asked density are packed at a lower one
+static void TestLightmapBakerDensity(void)
+{
+	// a long strip, which is too wide for the lightmap at the density asked for
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	LightmapBakerTestQuad(1000.0f, 0.5f, &vertices, &indices);
+	LightmapBakerInstance instance = {};
+	instance.Vertices = vertices.data();
+	instance.NumVertices = (uint32_t)vertices.size();
+	instance.Indices = indices.data();
+	instance.NumIndices = (uint32_t)indices.size();
+	instance.World = MathMat4X4Identity();
+	const LightmapBakerLights lights = {};
+
+	LightmapBaker baker;
+	baker.Bake(&instance, 1, lights, 16.0f, nullptr);
+	assert(baker.GetTexelsPerUnit() < 16.0f && baker.GetTexelsPerUnit() * 1000.0f < LIGHTMAP_BAKER_MAX_SIZE);
+	assert(baker.GetWidth() <= LIGHTMAP_BAKER_MAX_SIZE && baker.GetHeight() <= LIGHTMAP_BAKER_MAX_SIZE);
+	assert(baker.GetNumSamples() > 0 && baker.GetNumRays() == (uint64_t)baker.GetNumSamples() * LIGHTMAP_BAKER_AO_RAYS);
+
+	// nothing to bake still makes a lightmap
+	baker.Bake(nullptr, 0, lights, 16.0f, nullptr);
+	assert(baker.GetCharts().empty() && baker.GetNumSamples() == 0 && baker.GetWidth() == BC_BLOCK_SIZE);
+}
+
+void LightmapBakerTest(void)
+{
+	TestLightmapBakerScene();
+	TestLightmapBakerDensity();
+}
+#endif
+
+#ifdef LIGHTMAP_BAKER_BENCHMARK
+void LightmapBakerBenchmark(const LightmapBakerInstance* instances, uint32_t numInstances, const LightmapBakerLights& lights,
+	float texelsPerUnit, JobSystem* jobs, const char* filename)
+{
+	LightmapBaker baker;
+	baker.Bake(instances, numInstances, lights, texelsPerUnit, jobs);
+	baker.PrintStats();
+	if (!baker.Write(filename))
+	{
+		UtilsDebugPrint("Lightmap: failed to write %s\n", filename);
+	}
+}
+#endif
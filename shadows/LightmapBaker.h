@@ -0,0 +1,177 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "LightHelper.h"
+#include "Math.h"
+#include "MeshFile.h"
+#include "TextureBuilder.h"
+#include "TriangleBVH.h"
+
+class JobSystem;
+
+// Largest width and height of a lightmap, the texel density drops until the charts fit
+#define LIGHTMAP_BAKER_MAX_SIZE 4096
+// Texels around each chart that bilinear filtering and block compression can touch without reaching its neighbours
+#define LIGHTMAP_BAKER_GUTTER 2
+// Occlusion rays per texel and how far they look
+#define LIGHTMAP_BAKER_AO_RAYS 32
+#define LIGHTMAP_BAKER_AO_DISTANCE 1.0f
+// Rays start this far off the surface so that they do not hit it
+#define LIGHTMAP_BAKER_RAY_OFFSET 0.002f
+// Direct light in the 8 bit channels of the lightmap is a fraction of this
+#define LIGHTMAP_BAKER_MAX_INTENSITY 2.0f
+// Batches of LIGHTING_REFERENCE_BATCH_SIZE texels a job traces
+#define LIGHTMAP_BAKER_BATCHES_PER_JOB 16
+
+// A static actor, its mesh in local space and where it is. Normals go
+// through the world matrix as directions, so it must not scale unevenly.
+struct LightmapBakerInstance
+{
+	const Vertex* Vertices;
+	uint32_t NumVertices;
+	const uint32_t* Indices;
+	uint32_t NumIndices;
+	Mat4X4 World;
+};
+
+struct LightmapBakerLights
+{
+	const DirectionalLight* DirLights;
+	uint32_t NumDirLights;
+	const PointLight* PointLights;
+	uint32_t NumPointLights;
+	const SpotLight* SpotLights;
+	uint32_t NumSpotLights;
+};
+
+// Second UV set of an instance. Vertices on the border of two charts get a
+// UV in each, so the set has vertices of its own, each a source vertex and
+// its lightmap UV, and indices of its own for the same triangles in the same order.
+struct LightmapUVSet
+{
+	std::vector<uint32_t> SourceVertices;
+	std::vector<Vec2D> UVs;
+	std::vector<uint32_t> Indices;
+};
+
+// Connected triangles of an instance facing the same side of a box, laid
+// flat on that side. Width and Height include the gutter and are whole blocks.
+struct LightmapChart
+{
+	uint32_t Instance;
+	// axis the triangles are projected along
+	uint32_t Axis;
+	// bounds of the projected triangles in world units
+	float MinU;
+	float MinV;
+	float SizeU;
+	float SizeV;
+	uint32_t X;
+	uint32_t Y;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t FirstTriangle;
+	uint32_t NumTriangles;
+};
+
+// Bakes the lighting of static actors into one lightmap on the CPU. The
+// triangles are cut into charts by the side of a box they face, the charts
+// are packed on shelves into a lightmap just big enough for them, and every
+// texel a chart covers traces rays against a BVH of all the triangles:
+// occlusion rays over the hemisphere and a shadow ray to every light that
+// reaches it. The light is shaded by the CPU reference of the pixel shader
+// with a white diffuse material and no specular, so the lightmap holds the
+// diffuse light falling on the surface, which the material's diffuse color
+// scales when it is drawn, in RGB and the ambient occlusion in A.
+// Lightmaps are BC3 compressed, one byte per texel.
+class LightmapBaker
+{
+public:
+	LightmapBaker();
+	~LightmapBaker();
+
+	// Traces are split across jobs when jobs is not null
+	void Bake(const LightmapBakerInstance* instances, uint32_t numInstances, const LightmapBakerLights& lights, float texelsPerUnit,
+		JobSystem* jobs);
+	bool Write(const char* filename) const;
+
+	const LightmapUVSet& GetUVSet(uint32_t instance) const { return m_UVSets[instance]; }
+	const std::vector<LightmapChart>& GetCharts() const { return m_Charts; }
+	uint32_t GetWidth() const { return m_Width; }
+	uint32_t GetHeight() const { return m_Height; }
+	float GetTexelsPerUnit() const { return m_TexelsPerUnit; }
+	// Direct light in RGB and occlusion in A, four floats per texel before compression
+	const std::vector<float>& GetTexels() const { return m_Texels; }
+	const TextureImage& GetImage() const { return m_Image; }
+
+	uint32_t GetNumSamples() const { return (uint32_t)m_Samples.size(); }
+	uint64_t GetNumRays() const { return m_NumRays; }
+	double GetBakeMillis() const { return m_LayoutMillis + m_BVHMillis + m_TraceMillis + m_CompressMillis; }
+
+	void PrintStats() const;
+
+private:
+	// A texel covered by a chart, where its rays start
+	struct Sample
+	{
+		Vec3D Position;
+		Vec3D Normal;
+		uint32_t Texel;
+	};
+
+	void Transform(const LightmapBakerInstance* instances, uint32_t numInstances);
+	void BuildCharts(uint32_t numInstances);
+	// Places the charts at texelsPerUnit, false when they do not fit into the largest lightmap
+	bool Pack(float texelsPerUnit);
+	void BuildUVSets(uint32_t numInstances);
+	void Rasterize();
+	void Trace(const LightmapBakerLights& lights, uint32_t first, uint32_t end);
+	// Grows the charts into their gutters
+	void Dilate();
+	void Compress(JobSystem* jobs);
+
+	// Lightmap texel coordinates of a position on the chart, texel centers are at half texels
+	Vec2D ToTexels(const LightmapChart& chart, const Vec3D& position) const;
+
+	// world space vertices of every instance back to back, three per triangle in m_Triangles
+	std::vector<Vec3D> m_Positions;
+	std::vector<Vec3D> m_Normals;
+	std::vector<uint32_t> m_Triangles;
+	// where each instance starts, one more for where the last ends
+	std::vector<uint32_t> m_FirstVertices;
+	std::vector<uint32_t> m_FirstTriangles;
+	// triangles in chart order and the chart of each triangle
+	std::vector<uint32_t> m_ChartTriangles;
+	std::vector<uint32_t> m_TriangleCharts;
+	std::vector<LightmapChart> m_Charts;
+	std::vector<LightmapUVSet> m_UVSets;
+	TriangleBVH m_BVH;
+
+	uint32_t m_Width;
+	uint32_t m_Height;
+	float m_TexelsPerUnit;
+	std::vector<Sample> m_Samples;
+	std::vector<uint8_t> m_Covered;
+	std::vector<float> m_Texels;
+	TextureImage m_Image;
+
+	std::atomic<uint64_t> m_NumRays;
+	double m_LayoutMillis;
+	double m_BVHMillis;
+	double m_TraceMillis;
+	double m_CompressMillis;
+	uint32_t m_NumThreads;
+};
+
+#ifdef LIGHTMAP_BAKER_TEST
+void LightmapBakerTest(void);
+#endif
+
+#ifdef LIGHTMAP_BAKER_BENCHMARK
+// Bakes the instances, prints the rays per second and the bake time and writes the lightmap to filename
+void LightmapBakerBenchmark(const LightmapBakerInstance* instances, uint32_t numInstances, const LightmapBakerLights& lights,
+	float texelsPerUnit, JobSystem* jobs, const char* filename);
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Read-only view of a whole file. Pages are brought in by the OS on first
+// access, so handing pointers into the view to D3D avoids staging copies.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+	MappedFile(const MappedFile& rhs) = delete;
+	MappedFile& operator=(const MappedFile& rhs) = delete;
+
+	// Returns false if the file does not exist, is empty or cannot be mapped
+	bool Open(const char* filename);
+	void Close();
+
+	const uint8_t* GetData() const { return m_Data; }
+	size_t GetSize() const { return m_Size; }
+
+private:
+	const uint8_t* m_Data;
+	size_t m_Size;
+#ifdef _WIN32
+	// file mapping object, the file handle itself is closed right after mapping
+	void* m_Mapping;
+#endif
+};
@@ -2,11 +2,14 @@
 
 #include <math.h>
 #include <assert.h>
+#ifdef _WIN32
 #include <corecrt_math_defines.h>
+#endif
 #include <string.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <float.h>
 
 #define EPSILON 0.00001f
 
@@ -310,18 +313,31 @@ Mat4X4 MathMat4X4Orthographic(float viewWidth,
                               float zNear,
                               float zFar)
 {
-	assert(!MathNearlyEqual(viewWidth, 0.0f));
-	assert(!MathNearlyEqual(viewHeight, 0.0f));
-	assert(!MathNearlyEqual(zFar, zNear));
+	assert(viewWidth != 0.0f && viewHeight != 0.0f && zFar != zNear);
 
 	Mat4X4 m = MathMat4X4Identity();
-	//m.A00 = 2.0f / viewWidth;
-	//m.A11 = 2.0f / viewHeight;
-	m.A22 = 2.0f / (zFar - zNear);
-	m.A23 = (zFar + zNear) / (zFar - zNear);
+	m.A00 = 2.0f / viewWidth;
+	m.A11 = 2.0f / viewHeight;
+	m.A22 = 1.0f / (zFar - zNear);
+	m.A32 = zNear / (zNear - zFar);
 	return m;
 }
 
+Mat4X4 MathMat4X4OrthographicOffCenter(float left, float right, float bottom, float top, float zNear, float zFar)
+{
+	assert(right != left && top != bottom && zFar != zNear);
+
+	Mat4X4 res = {};
+	res.A00 = 2.0f / (right - left);
+	res.A11 = 2.0f / (top - bottom);
+	res.A22 = 1.0f / (zFar - zNear);
+	res.A30 = (left + right) / (left - right);
+	res.A31 = (top + bottom) / (bottom - top);
+	res.A32 = zNear / (zNear - zFar);
+	res.A33 = 1.0f;
+	return res;
+}
+
 Mat4X4 MathMat4X4ViewAt(const Vec3D* eyePos, const Vec3D* focusPos, const Vec3D* upDirect)
 {
 	Mat4X4 res = {};
@@ -399,6 +415,114 @@ Mat4X4 MathMat4X4PerspectiveFov(float fovAngleY, float aspectRatio, float nearZ,
 	return res;
 }
 
+AABB MathAABBEmpty(void)
+{
+	AABB box = {};
+	box.Min = MathVec3DFromXYZ(FLT_MAX, FLT_MAX, FLT_MAX);
+	box.Max = MathVec3DFromXYZ(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	return box;
+}
+
+void MathAABBExpand(AABB* box, const Vec3D* point)
+{
+	box->Min.X = fminf(box->Min.X, point->X);
+	box->Min.Y = fminf(box->Min.Y, point->Y);
+	box->Min.Z = fminf(box->Min.Z, point->Z);
+	box->Max.X = fmaxf(box->Max.X, point->X);
+	box->Max.Y = fmaxf(box->Max.Y, point->Y);
+	box->Max.Z = fmaxf(box->Max.Z, point->Z);
+}
+
+AABB MathAABBUnion(const AABB* box1, const AABB* box2)
+{
+	AABB res = *box1;
+	MathAABBExpand(&res, &box2->Min);
+	MathAABBExpand(&res, &box2->Max);
+	return res;
+}
+
+// Transforms all 8 corners at once, see Graphics Gems "Transforming Axis-Aligned Bounding Boxes"
+AABB MathAABBTransform(const AABB* box, const Mat4X4* mat)
+{
+	const float* min = &box->Min.X;
+	const float* max = &box->Max.X;
+
+	AABB res = {};
+	float* outMin = &res.Min.X;
+	float* outMax = &res.Max.X;
+
+	for (uint32_t j = 0; j < 3; ++j)
+	{
+		outMin[j] = outMax[j] = mat->A[3][j];
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			const float a = mat->A[i][j] * min[i];
+			const float b = mat->A[i][j] * max[i];
+			outMin[j] += a < b ? a : b;
+			outMax[j] += a < b ? b : a;
+		}
+	}
+	return res;
+}
+
+Vec3D MathAABBCenter(const AABB* box)
+{
+	const Vec3D sum = MathVec3DAddition(&box->Min, &box->Max);
+	return MathVec3DModulateByScalar(&sum, 0.5f);
+}
+
+Vec3D MathAABBExtents(const AABB* box)
+{
+	const Vec3D diff = MathVec3DSubtraction(&box->Max, &box->Min);
+	return MathVec3DModulateByScalar(&diff, 0.5f);
+}
+
+// Gribb/Hartmann plane extraction for row vectors (clip = v * viewProj)
+// and D3D clip space where 0 <= z <= w
+Frustum MathFrustumFromMat4X4(const Mat4X4* viewProj)
+{
+	Frustum frustum = {};
+	const Vec4D col0 = { viewProj->A00, viewProj->A10, viewProj->A20, viewProj->A30 };
+	const Vec4D col1 = { viewProj->A01, viewProj->A11, viewProj->A21, viewProj->A31 };
+	const Vec4D col2 = { viewProj->A02, viewProj->A12, viewProj->A22, viewProj->A32 };
+	const Vec4D col3 = { viewProj->A03, viewProj->A13, viewProj->A23, viewProj->A33 };
+
+	frustum.Planes[0] = MathVec4DAddition(&col3, &col0);
+	MathVec4DSubtraction(&col3, &col0, &frustum.Planes[1]);
+	frustum.Planes[2] = MathVec4DAddition(&col3, &col1);
+	MathVec4DSubtraction(&col3, &col1, &frustum.Planes[3]);
+	frustum.Planes[4] = col2;
+	MathVec4DSubtraction(&col3, &col2, &frustum.Planes[5]);
+
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		Vec4D* plane = &frustum.Planes[i];
+		const float len = sqrtf(plane->X * plane->X + plane->Y * plane->Y + plane->Z * plane->Z);
+		plane->X /= len;
+		plane->Y /= len;
+		plane->Z /= len;
+		plane->W /= len;
+	}
+	return frustum;
+}
+
+int32_t MathFrustumIntersectsAABB(const Frustum* frustum, const AABB* box)
+{
+	for (uint32_t i = 0; i < 6; ++i)
+	{
+		const Vec4D* plane = &frustum->Planes[i];
+		// corner furthest along the plane normal
+		const float x = plane->X >= 0.0f ? box->Max.X : box->Min.X;
+		const float y = plane->Y >= 0.0f ? box->Max.Y : box->Min.Y;
+		const float z = plane->Z >= 0.0f ? box->Max.Z : box->Min.Z;
+		if (plane->X * x + plane->Y * y + plane->Z * z + plane->W < 0.0f)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
 float MathClamp(float min, float max, float v)
 {
 	if (v > max)
@@ -785,6 +909,70 @@ void TestMat4X4(void)
 		&& MathNearlyEqual(vec1.Y, vec2.Y)
 		&& MathNearlyEqual(vec1.Z, vec2.Z)
 		&& MathNearlyEqual(vec1.W, vec2.W));
+
+	// the corners of the box land on the corners of the clip volume
+	const Mat4X4 ortho = MathMat4X4OrthographicOffCenter(-2.0f, 6.0f, 1.0f, 3.0f, -4.0f, 12.0f);
+	const Vec4D minCorner = { -2.0f, 1.0f, -4.0f, 1.0f };
+	const Vec4D maxCorner = { 6.0f, 3.0f, 12.0f, 1.0f };
+	const Vec4D minClip = MathMat4X4MultVec4DByMat4X4(&minCorner, &ortho);
+	const Vec4D maxClip = MathMat4X4MultVec4DByMat4X4(&maxCorner, &ortho);
+	assert(fabsf(minClip.X + 1.0f) < 0.001f && fabsf(minClip.Y + 1.0f) < 0.001f && fabsf(minClip.Z) < 0.001f);
+	assert(fabsf(maxClip.X - 1.0f) < 0.001f && fabsf(maxClip.Y - 1.0f) < 0.001f && fabsf(maxClip.Z - 1.0f) < 0.001f);
+	assert(minClip.W == 1.0f && maxClip.W == 1.0f);
+
+	// the centered version is the same box around the view axis
+	const Mat4X4 centered = MathMat4X4Orthographic(8.0f, 2.0f, -4.0f, 12.0f);
+	const Mat4X4 offCenter = MathMat4X4OrthographicOffCenter(-4.0f, 4.0f, -1.0f, 1.0f, -4.0f, 12.0f);
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		for (uint32_t j = 0; j < 4; ++j)
+		{
+			assert(fabsf(centered.A[i][j] - offCenter.A[i][j]) < 0.0001f);
+		}
+	}
+}
+
+void TestBounds(void)
+{
+	AABB box = MathAABBEmpty();
+	const Vec3D p1 = { -1.0f, 2.0f, 0.5f };
+	const Vec3D p2 = { 3.0f, -2.0f, 1.5f };
+	MathAABBExpand(&box, &p1);
+	MathAABBExpand(&box, &p2);
+	assert(box.Min.X == -1.0f && box.Min.Y == -2.0f && box.Min.Z == 0.5f);
+	assert(box.Max.X == 3.0f && box.Max.Y == 2.0f && box.Max.Z == 1.5f);
+
+	const Vec3D center = MathAABBCenter(&box);
+	assert(center.X == 1.0f && center.Y == 0.0f && center.Z == 1.0f);
+
+	// rotating by 90 degrees about y swaps x and z extents
+	const Mat4X4 rot = MathMat4X4RotateY(MathToRadians(90.0f));
+	const Vec3D offset = { 10.0f, 0.0f, 0.0f };
+	const Mat4X4 translate = MathMat4X4TranslateFromVec3D(&offset);
+	const Mat4X4 world = MathMat4X4MultMat4X4ByMat4X4(&rot, &translate);
+	const AABB unit = { {-1.0f, -1.0f, -2.0f}, {1.0f, 1.0f, 2.0f} };
+	const AABB moved = MathAABBTransform(&unit, &world);
+	assert(fabsf(moved.Min.X - 8.0f) < 0.001f && fabsf(moved.Max.X - 12.0f) < 0.001f);
+	assert(fabsf(moved.Min.Z + 1.0f) < 0.001f && fabsf(moved.Max.Z - 1.0f) < 0.001f);
+
+	const Vec3D eye = { 0.0f, 0.0f, -5.0f };
+	const Vec3D at = { 0.0f, 0.0f, 0.0f };
+	const Vec3D up = { 0.0f, 1.0f, 0.0f };
+	const Mat4X4 view = MathMat4X4ViewAt(&eye, &at, &up);
+	const Mat4X4 proj = MathMat4X4PerspectiveFov(MathToRadians(90.0f), 1.0f, 0.1f, 100.0f);
+	const Mat4X4 viewProj = MathMat4X4MultMat4X4ByMat4X4(&view, &proj);
+	const Frustum frustum = MathFrustumFromMat4X4(&viewProj);
+
+	const AABB inside = { {-0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, 0.5f} };
+	const AABB behind = { {-0.5f, -0.5f, -10.0f}, {0.5f, 0.5f, -9.0f} };
+	const AABB left = { {-30.0f, -0.5f, 0.0f}, {-20.0f, 0.5f, 1.0f} };
+	const AABB far = { {-0.5f, -0.5f, 200.0f}, {0.5f, 0.5f, 201.0f} };
+	const AABB straddling = { {-100.0f, -0.5f, 0.0f}, {0.0f, 0.5f, 1.0f} };
+	assert(MathFrustumIntersectsAABB(&frustum, &inside));
+	assert(!MathFrustumIntersectsAABB(&frustum, &behind));
+	assert(!MathFrustumIntersectsAABB(&frustum, &left));
+	assert(!MathFrustumIntersectsAABB(&frustum, &far));
+	assert(MathFrustumIntersectsAABB(&frustum, &straddling));
 }
 
 void MathTest(void)
@@ -793,6 +981,7 @@ void MathTest(void)
 	TestVec3D();
 	TestMat3X3();
 	TestMat4X4();
+	TestBounds();
 }
 #endif
 
@@ -68,6 +68,21 @@ typedef struct Mat4X4
 	};
 } Mat4X4;
 
+typedef struct AABB
+{
+	AABB() : Min{}, Max{} {}
+	AABB(const Vec3D& min, const Vec3D& max) : Min{min}, Max{max} {}
+	Vec3D Min;
+	Vec3D Max;
+} AABB;
+
+// Planes are stored as (normal, distance), normals point inside the frustum
+typedef struct Frustum
+{
+	Frustum() : Planes{} {}
+	Vec4D Planes[6];
+} Frustum;
+
 // *** 2D vector math ***
 Vec2D MathVec2DZero(void);
 
@@ -173,11 +188,15 @@ float MathMat4X4Determinant(const Mat4X4* mat);
 
 void MathMat4X4Normalize(Mat4X4* mat);
 
+// Left handed, centered on the view axis, maps z in [zNear, zFar] to [0, 1]
 Mat4X4 MathMat4X4Orthographic(float viewWidth,
                               float viewHeight,
                               float zNear,
                               float zFar);
 
+// Left handed, maps the box to x and y in [-1, 1] and z in [0, 1]
+Mat4X4 MathMat4X4OrthographicOffCenter(float left, float right, float bottom, float top, float zNear, float zFar);
+
 Mat4X4 MathMat4X4ViewAt(const Vec3D* eyePos, const Vec3D* focusPos, const Vec3D* upDirect);
 
 Mat4X4 MathMat4X4RotateZ(float angle);
@@ -188,6 +207,23 @@ Mat4X4 MathMat4X4RotateY(float angle);
 
 Mat4X4 MathMat4X4PerspectiveFov(float fovAngleY, float aspectRatio, float nearZ, float farZ);
 
+// *** bounding volumes ***
+AABB MathAABBEmpty(void);
+
+void MathAABBExpand(AABB* box, const Vec3D* point);
+
+AABB MathAABBUnion(const AABB* box1, const AABB* box2);
+
+AABB MathAABBTransform(const AABB* box, const Mat4X4* mat);
+
+Vec3D MathAABBCenter(const AABB* box);
+
+Vec3D MathAABBExtents(const AABB* box);
+
+Frustum MathFrustumFromMat4X4(const Mat4X4* viewProj);
+
+int32_t MathFrustumIntersectsAABB(const Frustum* frustum, const AABB* box);
+
 // *** misc math helpers ***
 float MathClamp(float min, float max, float v);
 
@@ -0,0 +1,241 @@
+#include "MeshFile.h"
+#include "MappedFile.h"
+#include "AssetManifest.h"
+#include "objloader.h"
+
+#include <assert.h>
+#include <string.h>
+#include <unordered_map>
+
+static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex must not have padding, welding compares raw bytes");
+
+bool MeshFileLoadObj(const char* filename, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices)
+{
+	struct Model* model = OLLoad(filename);
+	if (!model)
+	{
+		return false;
+	}
+
+	size_t numFaces = 0;
+	for (uint32_t i = 0; i < model->NumMeshes; ++i)
+	{
+		struct Mesh* mesh = model->Meshes + i;
+		numFaces += mesh->NumFaces;
+	}
+
+	vertices->clear();
+	indices->clear();
+	vertices->reserve(numFaces);
+	indices->reserve(numFaces);
+
+	size_t posOffs = 0;
+	size_t normOffs = 0;
+	size_t tcOffs = 0;
+	Vertex vert = {};
+
+	for (uint32_t i = 0; i < model->NumMeshes; ++i)
+	{
+		const struct Mesh* mesh = model->Meshes + i;
+		for (uint32_t j = 0; j < mesh->NumFaces; ++j)
+		{
+			const struct Face* face = model->Meshes[i].Faces + j;
+			const struct Position* pos = mesh->Positions + face->posIdx - posOffs;
+			const struct Normal* norm = mesh->Normals + face->normIdx - normOffs;
+			const struct TexCoord* tc = mesh->TexCoords + face->texIdx - tcOffs;
+			assert(face && pos && norm && tc);
+
+			vert.Position.X = pos->x;
+			vert.Position.Y = pos->y;
+			vert.Position.Z = pos->z;
+
+			vert.Normal.X = norm->x;
+			vert.Normal.Y = norm->y;
+			vert.Normal.Z = norm->z;
+
+			vert.TexCoords.X = tc->u;
+			vert.TexCoords.Y = tc->v;
+
+			indices->emplace_back((uint32_t)indices->size());
+			vertices->emplace_back(vert);
+		}
+		posOffs += mesh->NumPositions;
+		normOffs += mesh->NumNormals;
+		tcOffs += mesh->NumTexCoords;
+	}
+
+	ModelFree(model);
+	return true;
+}
+
+struct MeshFileVertexHash
+{
+	size_t operator()(const Vertex& vert) const { return (size_t)AssetHashBytes(&vert, sizeof(vert)); }
+};
+
+struct MeshFileVertexEqual
+{
+	bool operator()(const Vertex& a, const Vertex& b) const { return memcmp(&a, &b, sizeof(Vertex)) == 0; }
+};
+
+void MeshFileWeld(std::vector<Vertex>* vertices, std::vector<uint32_t>* indices)
+{
+	std::unordered_map<Vertex, uint32_t, MeshFileVertexHash, MeshFileVertexEqual> unique;
+	unique.reserve(vertices->size());
+
+	std::vector<Vertex> welded;
+	welded.reserve(vertices->size());
+	std::vector<uint32_t> remap(vertices->size());
+	for (size_t i = 0; i < vertices->size(); ++i)
+	{
+		auto inserted = unique.emplace((*vertices)[i], (uint32_t)welded.size());
+		if (inserted.second)
+		{
+			welded.emplace_back((*vertices)[i]);
+		}
+		remap[i] = inserted.first->second;
+	}
+
+	for (uint32_t& index : *indices)
+	{
+		index = remap[index];
+	}
+	welded.shrink_to_fit();
+	vertices->swap(welded);
+}
+
+AABB MeshFileComputeBounds(const std::vector<Vertex>& vertices)
+{
+	AABB bounds = MathAABBEmpty();
+	for (const Vertex& vert : vertices)
+	{
+		MathAABBExpand(&bounds, &vert.Position);
+	}
+	return bounds;
+}
+
+bool MeshFileWrite(const char* filename, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	FILE* f = AssetOpenFile(filename, "wb");
+	if (!f)
+	{
+		return false;
+	}
+
+	MeshFileHeader header = {};
+	header.Magic = MESH_FILE_MAGIC;
+	header.Version = MESH_FILE_VERSION;
+	header.VertexSize = sizeof(Vertex);
+	header.NumVertices = (uint32_t)vertices.size();
+	header.NumIndices = (uint32_t)indices.size();
+	header.Bounds = MeshFileComputeBounds(vertices);
+
+	bool written = fwrite(&header, sizeof(header), 1, f) == 1;
+	written = written && (vertices.empty() || fwrite(vertices.data(), sizeof(Vertex), vertices.size(), f) == vertices.size());
+	written = written && (indices.empty() || fwrite(indices.data(), sizeof(uint32_t), indices.size(), f) == indices.size());
+	return fclose(f) == 0 && written;
+}
+
+bool MeshFileRead(const char* filename, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices, AABB* bounds)
+{
+	MappedFile file;
+	if (!file.Open(filename) || file.GetSize() < sizeof(MeshFileHeader))
+	{
+		return false;
+	}
+
+	MeshFileHeader header = {};
+	memcpy(&header, file.GetData(), sizeof(header));
+	const size_t vertexBytes = (size_t)header.NumVertices * sizeof(Vertex);
+	const size_t indexBytes = (size_t)header.NumIndices * sizeof(uint32_t);
+	if (header.Magic != MESH_FILE_MAGIC || header.Version != MESH_FILE_VERSION || header.VertexSize != sizeof(Vertex) ||
+		file.GetSize() != sizeof(header) + vertexBytes + indexBytes)
+	{
+		return false;
+	}
+
+	const uint8_t* data = file.GetData() + sizeof(header);
+	vertices->resize(header.NumVertices);
+	indices->resize(header.NumIndices);
+	if (vertexBytes)
+	{
+		memcpy(vertices->data(), data, vertexBytes);
+	}
+	if (indexBytes)
+	{
+		memcpy(indices->data(), data + vertexBytes, indexBytes);
+	}
+
+	for (uint32_t index : *indices)
+	{
+		if (index >= header.NumVertices)
+		{
+			vertices->clear();
+			indices->clear();
+			return false;
+		}
+	}
+	*bounds = header.Bounds;
+	return true;
+}
+
+#ifdef MESH_FILE_TEST
+static Vertex MeshFileTestVertex(float x, float y, float u)
+{
+	Vertex vert = {};
+	vert.Position = MathVec3DFromXYZ(x, y, 0.0f);
+	vert.Normal = MathVec3DFromXYZ(0.0f, 0.0f, -1.0f);
+	vert.TexCoords.X = u;
+	return vert;
+}
+
+void MeshFileTest(void)
+{
+	// a quad as two expanded triangles shares two corners
+	std::vector<Vertex> vertices = {
+		MeshFileTestVertex(0.0f, 0.0f, 0.0f), MeshFileTestVertex(1.0f, 0.0f, 1.0f), MeshFileTestVertex(1.0f, 1.0f, 1.0f),
+		MeshFileTestVertex(0.0f, 0.0f, 0.0f), MeshFileTestVertex(1.0f, 1.0f, 1.0f), MeshFileTestVertex(0.0f, 1.0f, 0.0f),
+	};
+	std::vector<uint32_t> indices = { 0, 1, 2, 3, 4, 5 };
+	const std::vector<Vertex> expanded = vertices;
+
+	MeshFileWeld(&vertices, &indices);
+	assert(vertices.size() == 4);
+	assert((indices == std::vector<uint32_t>{ 0, 1, 2, 0, 2, 3 }));
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		assert(memcmp(&vertices[indices[i]], &expanded[i], sizeof(Vertex)) == 0);
+	}
+
+	// same position but a different uv stays separate
+	std::vector<Vertex> seam = { MeshFileTestVertex(0.0f, 0.0f, 0.0f), MeshFileTestVertex(0.0f, 0.0f, 1.0f) };
+	std::vector<uint32_t> seamIndices = { 0, 1 };
+	MeshFileWeld(&seam, &seamIndices);
+	assert(seam.size() == 2);
+
+	const char* filename = "mesh_file_test.mesh";
+	assert(MeshFileWrite(filename, vertices, indices));
+
+	std::vector<Vertex> readVertices;
+	std::vector<uint32_t> readIndices;
+	AABB bounds;
+	assert(MeshFileRead(filename, &readVertices, &readIndices, &bounds));
+	assert(readIndices == indices);
+	assert(readVertices.size() == vertices.size());
+	assert(memcmp(readVertices.data(), vertices.data(), vertices.size() * sizeof(Vertex)) == 0);
+	assert(bounds.Min.X == 0.0f && bounds.Min.Y == 0.0f && bounds.Max.X == 1.0f && bounds.Max.Y == 1.0f);
+
+	// an index past the last vertex is rejected
+	indices[5] = 4;
+	assert(MeshFileWrite(filename, vertices, indices));
+	assert(!MeshFileRead(filename, &readVertices, &readIndices, &bounds));
+	remove(filename);
+	assert(!MeshFileRead(filename, &readVertices, &readIndices, &bounds));
+
+	// the cube is 12 triangles with 24 distinct corners
+	assert(MeshFileLoadObj("assets/meshes/cube.obj", &vertices, &indices));
+	assert(vertices.size() == 36 && indices.size() == 36);
+	MeshFileWeld(&vertices, &indices);
+	assert(vertices.size() == 24 && indices.size() == 36);
+}
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Math.h"
+
+// Cooked meshes: MeshFileHeader followed by the vertices and the indices,
+// ready to be copied into the geometry pool as they are
+#define MESH_FILE_MAGIC 0x4853454d // "MESH"
+#define MESH_FILE_VERSION 1
+
+struct Vertex
+{
+	Vec3D Position;
+	Vec3D Normal;
+	Vec2D TexCoords;
+};
+
+struct MeshFileHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t VertexSize;
+	uint32_t NumVertices;
+	uint32_t NumIndices;
+	AABB Bounds;
+};
+
+// Expands every face corner of every mesh in the OBJ into its own vertex
+bool MeshFileLoadObj(const char* filename, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices);
+// Merges bitwise identical vertices and remaps the indices, keeps first use order
+void MeshFileWeld(std::vector<Vertex>* vertices, std::vector<uint32_t>* indices);
+AABB MeshFileComputeBounds(const std::vector<Vertex>& vertices);
+
+bool MeshFileWrite(const char* filename, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+// Fails on files from another version or with indices out of range
+bool MeshFileRead(const char* filename, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices, AABB* bounds);
+
+#ifdef MESH_FILE_TEST
+void MeshFileTest(void);
+#endif
@@ -0,0 +1,288 @@
+#include "MeshRegistry.h"
+#include "AssetManifest.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+MeshData::~MeshData()
+{
+	if (Pool)
+	{
+		Pool->Free(Geometry);
+	}
+}
+
+static void MeshRegistryComputeBounds(MeshData* data)
+{
+	data->LocalBounds = MeshFileComputeBounds(data->Vertices);
+}
+
+static void MeshRegistryLoadMesh(const Mesh* mesh, MeshData* data)
+{
+	data->Vertices.clear();
+	data->Indices.clear();
+	data->Vertices.reserve(mesh->NumFaces);
+	data->Indices.reserve(mesh->NumFaces);
+
+	Vertex vert = {};
+
+	for (uint32_t j = 0; j < mesh->NumFaces; ++j)
+	{
+		const struct Face* face = mesh->Faces + j;
+		const struct Position* pos = mesh->Positions + face->posIdx;
+		const struct Normal* norm = mesh->Normals + face->normIdx;
+		const struct TexCoord* tc = mesh->TexCoords + face->texIdx;
+		assert(face && pos && norm && tc);
+
+		vert.Position.X = pos->x;
+		vert.Position.Y = pos->y;
+		vert.Position.Z = pos->z;
+
+		vert.Normal.X = norm->x;
+		vert.Normal.Y = norm->y;
+		vert.Normal.Z = norm->z;
+
+		vert.TexCoords.X = tc->u;
+		vert.TexCoords.Y = tc->v;
+
+		data->Indices.emplace_back((uint32_t)data->Indices.size());
+		data->Vertices.emplace_back(vert);
+	}
+
+	MeshRegistryComputeBounds(data);
+}
+
+static void MeshRegistryLoadModel(const char* filename, MeshData* data)
+{
+	const size_t length = strlen(filename);
+	if (length >= 5 && _stricmp(filename + length - 5, ".mesh") == 0)
+	{
+		if (!MeshFileRead(filename, &data->Vertices, &data->Indices, &data->LocalBounds))
+		{
+			UTILS_FATAL_ERROR("Failed to read cooked mesh %s", filename);
+		}
+		return;
+	}
+
+	if (!MeshFileLoadObj(filename, &data->Vertices, &data->Indices))
+	{
+		UTILS_FATAL_ERROR("Failed to load model %s", filename);
+	}
+	MeshRegistryComputeBounds(data);
+}
+
+static size_t MeshRegistryCpuBytes(const MeshData& mesh)
+{
+	return mesh.Vertices.capacity() * sizeof(Vertex) + mesh.Indices.capacity() * sizeof(uint32_t);
+}
+
+MeshRegistry::MeshRegistry():
+	m_Pool{nullptr},
+	m_Uploads{nullptr},
+	m_NumCacheHits{0},
+	m_PeakCpuBytes{0}
+{
+}
+
+MeshRegistry::~MeshRegistry()
+{
+}
+
+void MeshRegistry::Init(GeometryPool* pool, UploadManager* uploads)
+{
+	m_Pool = pool;
+	m_Uploads = uploads;
+}
+
+std::string MeshRegistry::NormalizePath(const char* path)
+{
+	return AssetNormalizePath(path);
+}
+
+// Returns the registered mesh or a new empty one, *needsData tells whether
+// the caller has to fill in vertices and indices
+std::shared_ptr<MeshData> MeshRegistry::Acquire(const std::string& key, uint32_t flags, bool* needsData)
+{
+	std::shared_ptr<MeshData> mesh;
+	auto it = m_Meshes.find(key);
+	if (it != m_Meshes.end())
+	{
+		mesh = it->second.lock();
+	}
+
+	if (!mesh)
+	{
+		// loading from disk dwarfs the walk, so released meshes do not leave keys behind
+		PruneExpired();
+		mesh = std::make_shared<MeshData>();
+		mesh->Path = key;
+		m_Meshes[key] = mesh;
+		*needsData = true;
+	}
+	else
+	{
+		// retaining a mesh whose CPU data was already dropped means loading it again
+		*needsData = (flags & MESH_REGISTRY_RETAIN_CPU_DATA) && !mesh->HasCpuData();
+		if (!*needsData)
+		{
+			++m_NumCacheHits;
+		}
+	}
+	mesh->Flags |= flags;
+	return mesh;
+}
+
+void MeshRegistry::PruneExpired()
+{
+	for (auto it = m_Meshes.begin(); it != m_Meshes.end();)
+	{
+		it = it->second.expired() ? m_Meshes.erase(it) : std::next(it);
+	}
+}
+
+void MeshRegistry::Finalize(const std::shared_ptr<MeshData>& mesh)
+{
+	m_PeakCpuBytes = std::max(m_PeakCpuBytes, GetCpuBytes());
+
+	// an empty mesh has nothing to draw and takes no range, its geometry stays invalid
+	if (m_Pool && !mesh->Geometry.IsValid() && !mesh->Vertices.empty() && !mesh->Indices.empty())
+	{
+		mesh->Pool = m_Pool;
+		mesh->Geometry = m_Pool->Allocate((uint32_t)mesh->Vertices.size(), (uint32_t)mesh->Indices.size());
+		if (!mesh->Geometry.IsValid())
+		{
+			UTILS_FATAL_ERROR("Failed to allocate %u vertices and %u indices in geometry pool",
+				(uint32_t)mesh->Vertices.size(), (uint32_t)mesh->Indices.size());
+		}
+		m_Pool->Upload(m_Uploads, mesh->Geometry, mesh->Vertices.data(), mesh->Indices.data());
+	}
+
+	if (m_Pool && !(mesh->Flags & MESH_REGISTRY_RETAIN_CPU_DATA))
+	{
+		std::vector<Vertex>().swap(mesh->Vertices);
+		std::vector<uint32_t>().swap(mesh->Indices);
+	}
+}
+
+std::shared_ptr<const MeshData> MeshRegistry::Load(const char* filename, uint32_t flags)
+{
+	bool needsData = false;
+	std::shared_ptr<MeshData> mesh = Acquire(NormalizePath(filename), flags, &needsData);
+	if (needsData)
+	{
+		MeshRegistryLoadModel(filename, mesh.get());
+		Finalize(mesh);
+	}
+	return mesh;
+}
+
+std::shared_ptr<const MeshData> MeshRegistry::Create(const char* name, const Mesh* source, uint32_t flags)
+{
+	bool needsData = false;
+	std::shared_ptr<MeshData> mesh = Acquire(NormalizePath(name), flags, &needsData);
+	if (needsData)
+	{
+		MeshRegistryLoadMesh(source, mesh.get());
+		Finalize(mesh);
+	}
+	return mesh;
+}
+
+std::shared_ptr<const MeshData> MeshRegistry::Find(const char* name) const
+{
+	auto it = m_Meshes.find(NormalizePath(name));
+	return it == m_Meshes.end() ? nullptr : it->second.lock();
+}
+
+uint32_t MeshRegistry::GetNumMeshes() const
+{
+	uint32_t count = 0;
+	for (const auto& entry : m_Meshes)
+	{
+		count += entry.second.expired() ? 0 : 1;
+	}
+	return count;
+}
+
+size_t MeshRegistry::GetCpuBytes() const
+{
+	size_t bytes = 0;
+	for (const auto& entry : m_Meshes)
+	{
+		if (std::shared_ptr<MeshData> mesh = entry.second.lock())
+		{
+			bytes += MeshRegistryCpuBytes(*mesh);
+		}
+	}
+	return bytes;
+}
+
+size_t MeshRegistry::GetGpuBytes() const
+{
+	const size_t stride = m_Pool ? m_Pool->GetVertexStride() : sizeof(Vertex);
+	size_t bytes = 0;
+	for (const auto& entry : m_Meshes)
+	{
+		if (std::shared_ptr<MeshData> mesh = entry.second.lock())
+		{
+			bytes += mesh->Geometry.NumVertices * stride + mesh->Geometry.NumIndices * sizeof(uint32_t);
+		}
+	}
+	return bytes;
+}
+
+void MeshRegistry::PrintStats() const
+{
+	UtilsDebugPrint("Meshes: %u loaded, %u cache hits, CPU %.2f KB (peak %.2f KB), GPU %.2f KB\n",
+		GetNumMeshes(),
+		m_NumCacheHits,
+		(float)GetCpuBytes() / 1024.0f,
+		(float)m_PeakCpuBytes / 1024.0f,
+		(float)GetGpuBytes() / 1024.0f);
+}
+
+#ifdef MESH_REGISTRY_TEST
+#include "MeshGenerator.h"
+
+void MeshRegistryTest(void)
+{
+	assert(MeshRegistry::NormalizePath("assets\\Meshes\\Cube.obj") == "assets/meshes/cube.obj");
+	assert(MeshRegistry::NormalizePath("./assets//meshes/../meshes/cube.obj") == "assets/meshes/cube.obj");
+	assert(MeshRegistry::NormalizePath("../cube.obj") == "../cube.obj");
+
+	// no pool, so meshes keep their CPU data
+	MeshRegistry registry;
+	registry.Init(nullptr, nullptr);
+
+	const Vec3D origin = { 0.0f, 0.0f, 0.0f };
+	struct Mesh* plane = MGGeneratePlane(&origin, 2.0f, 2.0f);
+	{
+		std::shared_ptr<const MeshData> first = registry.Create("generated/plane", plane);
+		std::shared_ptr<const MeshData> second = registry.Create("Generated\\Plane", plane);
+		assert(first == second);
+		assert(first.use_count() == 2);
+		assert(registry.GetNumMeshes() == 1 && registry.GetNumCacheHits() == 1);
+		assert(first->HasCpuData() && first->Vertices.size() == plane->NumFaces);
+		assert(first->LocalBounds.Min.X == -1.0f && first->LocalBounds.Max.X == 1.0f);
+		assert(registry.GetCpuBytes() > 0 && registry.GetPeakCpuBytes() >= registry.GetCpuBytes());
+		assert(registry.GetGpuBytes() == 0);
+	}
+
+	// last reference gone, mesh is unloaded and created again on demand
+	assert(registry.GetNumMeshes() == 0 && !registry.Find("generated/plane"));
+	assert(registry.GetCpuBytes() == 0);
+	std::shared_ptr<const MeshData> third = registry.Create("generated/plane", plane);
+	assert(registry.GetNumMeshes() == 1 && registry.GetNumCacheHits() == 1);
+	assert(registry.Find("GENERATED/PLANE") == third);
+
+	// a mesh without faces loads, it just has nothing to upload or draw
+	struct Mesh empty;
+	std::shared_ptr<const MeshData> nothing = registry.Create("generated/empty", &empty);
+	assert(!nothing->HasCpuData() && !nothing->Geometry.IsValid());
+	assert(registry.GetNumMeshes() == 2);
+
+	MeshFree(plane);
+}
+#endif
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <d3d11.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Math.h"
+#include "objloader.h"
+#include "GeometryPool.h"
+#include "MeshFile.h"
+
+#define MESH_REGISTRY_RETAIN_CPU_DATA 0x1
+
+// Mesh shared by every actor that references the same source. Vertices and
+// Indices are emptied once the geometry is in the pool unless the mesh was
+// loaded with MESH_REGISTRY_RETAIN_CPU_DATA. The pool range is freed when the
+// last reference goes away. Empty meshes get no range, Geometry is not valid.
+struct MeshData
+{
+	MeshData() : Pool{nullptr}, Geometry{}, LocalBounds{}, Flags{0} {}
+	~MeshData();
+	MeshData(const MeshData& rhs) = delete;
+	MeshData& operator=(const MeshData& rhs) = delete;
+
+	bool HasCpuData() const { return !Vertices.empty(); }
+
+	std::string Path;
+	std::vector<Vertex> Vertices;
+	std::vector<uint32_t> Indices;
+	GeometryPool* Pool;
+	MeshAllocation Geometry;
+	AABB LocalBounds;
+	uint32_t Flags;
+};
+
+// Loads every mesh once, keyed by its normalized path. The registry only holds
+// weak references, so a mesh lives as long as some actor uses it.
+class MeshRegistry
+{
+public:
+	MeshRegistry();
+	~MeshRegistry();
+	MeshRegistry(const MeshRegistry& rhs) = delete;
+	MeshRegistry& operator=(const MeshRegistry& rhs) = delete;
+
+	// pool may be null, meshes then keep their CPU data and are never uploaded
+	void Init(GeometryPool* pool, UploadManager* uploads);
+
+	// Reads cooked .mesh files, anything else is parsed as OBJ
+	std::shared_ptr<const MeshData> Load(const char* filename, uint32_t flags = 0);
+	// Registers a generated mesh under name, mesh is not taken over
+	std::shared_ptr<const MeshData> Create(const char* name, const Mesh* mesh, uint32_t flags = 0);
+	std::shared_ptr<const MeshData> Find(const char* name) const;
+
+	uint32_t GetNumMeshes() const;
+	uint32_t GetNumCacheHits() const { return m_NumCacheHits; }
+	size_t GetCpuBytes() const;
+	size_t GetPeakCpuBytes() const { return m_PeakCpuBytes; }
+	size_t GetGpuBytes() const;
+	void PrintStats() const;
+
+	static std::string NormalizePath(const char* path);
+
+private:
+	std::shared_ptr<MeshData> Acquire(const std::string& key, uint32_t flags, bool* needsData);
+	void Finalize(const std::shared_ptr<MeshData>& mesh);
+	void PruneExpired();
+
+	GeometryPool* m_Pool;
+	UploadManager* m_Uploads;
+	std::unordered_map<std::string, std::weak_ptr<MeshData>> m_Meshes;
+	uint32_t m_NumCacheHits;
+	size_t m_PeakCpuBytes;
+};
+
+#ifdef MESH_REGISTRY_TEST
+void MeshRegistryTest(void);
+#endif
@@ -0,0 +1,420 @@
+#include "MipGenerator.h"
+#include "JobSystem.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <functional>
+#include <emmintrin.h>
+
+#define MIP_ROW_BATCH 16
+// Kaiser support in destination texels and window shape
+#define MIP_KAISER_RADIUS 2.0f
+#define MIP_KAISER_ALPHA 4.0f
+#define MIP_LINEAR_TO_SRGB_LUT_SIZE 4096
+#define MIP_PI 3.14159265358979f
+
+// Conversion tables between 8 bit sRGB and linear float
+struct MipTables
+{
+	MipTables()
+	{
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			const float c = (float)i / 255.0f;
+			SrgbToLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (uint32_t i = 0; i < MIP_LINEAR_TO_SRGB_LUT_SIZE; ++i)
+		{
+			const float c = (float)i / (float)(MIP_LINEAR_TO_SRGB_LUT_SIZE - 1);
+			const float s = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+			LinearToSrgb[i] = (uint8_t)(s * 255.0f + 0.5f);
+		}
+	}
+
+	float SrgbToLinear[256];
+	uint8_t LinearToSrgb[MIP_LINEAR_TO_SRGB_LUT_SIZE];
+};
+
+static const MipTables& MipGetTables()
+{
+	static const MipTables tables;
+	return tables;
+}
+
+// For every destination texel along one axis, NumTaps source indices
+// (already clamped to the edge) and normalized weights
+struct MipTaps
+{
+	uint32_t NumTaps;
+	std::vector<uint32_t> Indices;
+	std::vector<float> Weights;
+};
+
+static float MipBesselI0(float x)
+{
+	float sum = 1.0f;
+	float term = 1.0f;
+	const float halfX = 0.5f * x;
+	for (uint32_t k = 1; k < 32; ++k)
+	{
+		term *= (halfX / (float)k) * (halfX / (float)k);
+		sum += term;
+		if (term < sum * 1e-7f)
+			break;
+	}
+	return sum;
+}
+
+static float MipKaiser(float t)
+{
+	const float x = t / MIP_KAISER_RADIUS;
+	if (x <= -1.0f || x >= 1.0f)
+	{
+		return 0.0f;
+	}
+	const float sinc = t == 0.0f ? 1.0f : sinf(MIP_PI * t) / (MIP_PI * t);
+	return sinc * MipBesselI0(MIP_KAISER_ALPHA * sqrtf(1.0f - x * x)) / MipBesselI0(MIP_KAISER_ALPHA);
+}
+
+static void MipBuildTaps(uint32_t srcSize, uint32_t dstSize, MipFilter filter, MipTaps* taps)
+{
+	if (srcSize == dstSize)
+	{
+		taps->NumTaps = 1;
+		taps->Indices.resize(dstSize);
+		taps->Weights.assign(dstSize, 1.0f);
+		for (uint32_t x = 0; x < dstSize; ++x)
+		{
+			taps->Indices[x] = x;
+		}
+		return;
+	}
+
+	if (filter == MipFilter::Box)
+	{
+		taps->NumTaps = 2;
+		taps->Indices.resize(dstSize * 2);
+		taps->Weights.assign(dstSize * 2, 0.5f);
+		for (uint32_t x = 0; x < dstSize; ++x)
+		{
+			taps->Indices[x * 2 + 0] = 2 * x;
+			taps->Indices[x * 2 + 1] = 2 * x + 1 < srcSize ? 2 * x + 1 : srcSize - 1;
+		}
+		return;
+	}
+
+	const float scale = (float)srcSize / (float)dstSize;
+	const float support = MIP_KAISER_RADIUS * scale;
+	taps->NumTaps = (uint32_t)ceilf(2.0f * support) + 1;
+	taps->Indices.resize(dstSize * taps->NumTaps);
+	taps->Weights.resize(dstSize * taps->NumTaps);
+
+	for (uint32_t x = 0; x < dstSize; ++x)
+	{
+		const float center = ((float)x + 0.5f) * scale - 0.5f;
+		const int32_t first = (int32_t)floorf(center - support) + 1;
+		uint32_t* indices = &taps->Indices[x * taps->NumTaps];
+		float* weights = &taps->Weights[x * taps->NumTaps];
+
+		float sum = 0.0f;
+		for (uint32_t t = 0; t < taps->NumTaps; ++t)
+		{
+			const int32_t i = first + (int32_t)t;
+			const int32_t clamped = i < 0 ? 0 : (i >= (int32_t)srcSize ? (int32_t)srcSize - 1 : i);
+			indices[t] = (uint32_t)clamped;
+			weights[t] = MipKaiser(((float)i - center) / scale);
+			sum += weights[t];
+		}
+		for (uint32_t t = 0; t < taps->NumTaps; ++t)
+		{
+			weights[t] /= sum;
+		}
+	}
+}
+
+static void MipParallelRows(JobSystem* jobs, uint32_t rows, const std::function<void(uint32_t, uint32_t)>& func)
+{
+	if (jobs)
+	{
+		jobs->ParallelFor(rows, MIP_ROW_BATCH, func);
+	}
+	else
+	{
+		func(0, rows);
+	}
+}
+
+static __m128 MipLoadBytes(const uint8_t* pixel, bool srgb, const MipTables& tables)
+{
+	if (srgb)
+	{
+		return _mm_setr_ps(tables.SrgbToLinear[pixel[0]],
+			tables.SrgbToLinear[pixel[1]],
+			tables.SrgbToLinear[pixel[2]],
+			(float)pixel[3] * (1.0f / 255.0f));
+	}
+	const __m128i bytes = _mm_cvtsi32_si128(*(const int32_t*)pixel);
+	const __m128i words = _mm_unpacklo_epi8(bytes, _mm_setzero_si128());
+	const __m128i dwords = _mm_unpacklo_epi16(words, _mm_setzero_si128());
+	return _mm_mul_ps(_mm_cvtepi32_ps(dwords), _mm_set1_ps(1.0f / 255.0f));
+}
+
+static void MipStoreBytes(__m128 color, bool srgb, const MipTables& tables, uint8_t* pixel)
+{
+	color = _mm_min_ps(_mm_max_ps(color, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+	if (srgb)
+	{
+		const float lutScale = (float)(MIP_LINEAR_TO_SRGB_LUT_SIZE - 1);
+		alignas(16) int32_t idx[4];
+		_mm_store_si128((__m128i*)idx, _mm_cvtps_epi32(_mm_mul_ps(color, _mm_setr_ps(lutScale, lutScale, lutScale, 255.0f))));
+		pixel[0] = tables.LinearToSrgb[idx[0]];
+		pixel[1] = tables.LinearToSrgb[idx[1]];
+		pixel[2] = tables.LinearToSrgb[idx[2]];
+		pixel[3] = (uint8_t)idx[3];
+		return;
+	}
+	const __m128i dwords = _mm_cvtps_epi32(_mm_mul_ps(color, _mm_set1_ps(255.0f)));
+	const __m128i words = _mm_packs_epi32(dwords, dwords);
+	*(int32_t*)pixel = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+}
+
+uint32_t MipCountLevels(uint32_t width, uint32_t height)
+{
+	uint32_t levels = 1;
+	uint32_t size = width > height ? width : height;
+	while (size > 1)
+	{
+		size >>= 1;
+		++levels;
+	}
+	return levels;
+}
+
+void MipGenerateChain(const uint8_t* pixels,
+	uint32_t width,
+	uint32_t height,
+	MipFilter filter,
+	bool srgb,
+	JobSystem* jobs,
+	MipChain* chain)
+{
+	assert(width > 0 && height > 0);
+	const MipTables& tables = MipGetTables();
+
+	chain->Width = width;
+	chain->Height = height;
+	chain->NumLevels = MipCountLevels(width, height);
+	assert(chain->NumLevels <= MIP_MAX_LEVELS);
+
+	size_t totalBytes = 0;
+	for (uint32_t level = 0; level < chain->NumLevels; ++level)
+	{
+		chain->Offsets[level] = totalBytes;
+		totalBytes += (size_t)chain->GetLevelPitch(level) * chain->GetLevelHeight(level);
+	}
+	chain->Data.resize(totalBytes);
+	memcpy(&chain->Data[0], pixels, (size_t)width * height * MIP_CHANNELS);
+
+	// every level is filtered from the float version of the previous one,
+	// level 0 is read straight from the bytes
+	std::vector<float> source;
+	std::vector<float> filtered;
+	std::vector<float> rows;
+	MipTaps tapsX;
+	MipTaps tapsY;
+
+	for (uint32_t level = 1; level < chain->NumLevels; ++level)
+	{
+		const uint32_t srcW = chain->GetLevelWidth(level - 1);
+		const uint32_t srcH = chain->GetLevelHeight(level - 1);
+		const uint32_t dstW = chain->GetLevelWidth(level);
+		const uint32_t dstH = chain->GetLevelHeight(level);
+		const uint8_t* srcBytes = chain->GetLevel(level - 1);
+		uint8_t* dstBytes = &chain->Data[chain->Offsets[level]];
+		const bool fromBytes = level == 1;
+
+		MipBuildTaps(srcW, dstW, filter, &tapsX);
+		MipBuildTaps(srcH, dstH, filter, &tapsY);
+
+		// horizontal pass, srcH rows of dstW texels
+		rows.resize((size_t)srcH * dstW * MIP_CHANNELS);
+		MipParallelRows(jobs, srcH, [&](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t y = begin; y < end; ++y)
+				{
+					for (uint32_t x = 0; x < dstW; ++x)
+					{
+						const uint32_t* indices = &tapsX.Indices[x * tapsX.NumTaps];
+						const float* weights = &tapsX.Weights[x * tapsX.NumTaps];
+						__m128 sum = _mm_setzero_ps();
+						for (uint32_t t = 0; t < tapsX.NumTaps; ++t)
+						{
+							const size_t src = ((size_t)y * srcW + indices[t]) * MIP_CHANNELS;
+							const __m128 color = fromBytes ? MipLoadBytes(srcBytes + src, srgb, tables) : _mm_loadu_ps(&source[src]);
+							sum = _mm_add_ps(sum, _mm_mul_ps(color, _mm_set1_ps(weights[t])));
+						}
+						_mm_storeu_ps(&rows[((size_t)y * dstW + x) * MIP_CHANNELS], sum);
+					}
+				}
+			});
+
+		// vertical pass, writes the float level for the next iteration and its bytes
+		filtered.resize((size_t)dstH * dstW * MIP_CHANNELS);
+		MipParallelRows(jobs, dstH, [&](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t y = begin; y < end; ++y)
+				{
+					const uint32_t* indices = &tapsY.Indices[y * tapsY.NumTaps];
+					const float* weights = &tapsY.Weights[y * tapsY.NumTaps];
+					for (uint32_t x = 0; x < dstW; ++x)
+					{
+						__m128 sum = _mm_setzero_ps();
+						for (uint32_t t = 0; t < tapsY.NumTaps; ++t)
+						{
+							const __m128 color = _mm_loadu_ps(&rows[((size_t)indices[t] * dstW + x) * MIP_CHANNELS]);
+							sum = _mm_add_ps(sum, _mm_mul_ps(color, _mm_set1_ps(weights[t])));
+						}
+						const size_t dst = ((size_t)y * dstW + x) * MIP_CHANNELS;
+						_mm_storeu_ps(&filtered[dst], sum);
+						MipStoreBytes(sum, srgb, tables, dstBytes + dst);
+					}
+				}
+			});
+
+		source.swap(filtered);
+	}
+}
+
+#ifdef MIP_GENERATOR_TEST
+static void TestMipGeneratorLevels(void)
+{
+	assert(MipCountLevels(1, 1) == 1);
+	assert(MipCountLevels(1024, 449) == 11);
+	assert(MipCountLevels(5, 3) == 3);
+
+	// odd sizes round down, the last level is 1x1
+	const uint8_t pixels[5 * 3 * MIP_CHANNELS] = {};
+	MipChain chain;
+	MipGenerateChain(pixels, 5, 3, MipFilter::Kaiser, true, nullptr, &chain);
+	assert(chain.NumLevels == 3);
+	assert(chain.GetLevelWidth(1) == 2 && chain.GetLevelHeight(1) == 1);
+	assert(chain.GetLevelWidth(2) == 1 && chain.GetLevelHeight(2) == 1);
+	assert(chain.Data.size() == (5 * 3 + 2 * 1 + 1) * MIP_CHANNELS);
+}
+
+static void TestMipGeneratorFilters(void)
+{
+	// black and white checkerboard with a constant alpha
+	const uint32_t size = 16;
+	std::vector<uint8_t> pixels(size * size * MIP_CHANNELS);
+	for (uint32_t y = 0; y < size; ++y)
+	{
+		for (uint32_t x = 0; x < size; ++x)
+		{
+			uint8_t* pixel = &pixels[(y * size + x) * MIP_CHANNELS];
+			pixel[0] = pixel[1] = pixel[2] = ((x + y) & 1) ? 255 : 0;
+			pixel[3] = 200;
+		}
+	}
+
+	// averaging in linear space gives 0.5, which is 188 in sRGB
+	MipChain srgb;
+	MipGenerateChain(&pixels[0], size, size, MipFilter::Box, true, nullptr, &srgb);
+	MipChain linear;
+	MipGenerateChain(&pixels[0], size, size, MipFilter::Box, false, nullptr, &linear);
+	for (uint32_t level = 1; level < srgb.NumLevels; ++level)
+	{
+		const uint8_t* s = srgb.GetLevel(level);
+		const uint8_t* l = linear.GetLevel(level);
+		for (uint32_t i = 0; i < srgb.GetLevelWidth(level) * srgb.GetLevelHeight(level); ++i)
+		{
+			assert(s[i * 4] == 188 && l[i * 4] == 128);
+			assert(s[i * 4 + 3] == 200 && l[i * 4 + 3] == 200);
+		}
+	}
+
+	// Kaiser taps are normalized, away from the clamped border it averages the same way
+	MipGenerateChain(&pixels[0], size, size, MipFilter::Kaiser, true, nullptr, &srgb);
+	const uint32_t width = srgb.GetLevelWidth(1);
+	const uint8_t* level1 = srgb.GetLevel(1);
+	for (uint32_t y = 2; y < width - 2; ++y)
+	{
+		for (uint32_t x = 2; x < width - 2; ++x)
+		{
+			const uint8_t* pixel = level1 + (y * width + x) * MIP_CHANNELS;
+			assert(pixel[0] >= 187 && pixel[0] <= 189 && pixel[3] == 200);
+		}
+	}
+}
+
+static void TestMipGeneratorParallel(void)
+{
+	// splitting rows across jobs must not change a single byte
+	JobSystem jobs;
+	jobs.Init(4);
+
+	const uint32_t width = 301;
+	const uint32_t height = 97;
+	std::vector<uint8_t> pixels(width * height * MIP_CHANNELS);
+	uint32_t seed = 7;
+	for (uint8_t& value : pixels)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		value = (uint8_t)(seed >> 24);
+	}
+
+	MipChain serial;
+	MipChain parallel;
+	MipGenerateChain(&pixels[0], width, height, MipFilter::Kaiser, true, nullptr, &serial);
+	MipGenerateChain(&pixels[0], width, height, MipFilter::Kaiser, true, &jobs, &parallel);
+	assert(serial.NumLevels == parallel.NumLevels);
+	assert(serial.Data == parallel.Data);
+}
+
+void MipGeneratorTest(void)
+{
+	TestMipGeneratorLevels();
+	TestMipGeneratorFilters();
+	TestMipGeneratorParallel();
+}
+#endif
+
+#ifdef MIP_GENERATOR_BENCHMARK
+#include "Utils.h"
+
+#include <chrono>
+
+void MipGeneratorBenchmark(JobSystem* jobs)
+{
+	const uint32_t size = 2048;
+	std::vector<uint8_t> pixels(size * size * MIP_CHANNELS);
+	uint32_t seed = 1;
+	for (uint8_t& value : pixels)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		value = (uint8_t)(seed >> 24);
+	}
+
+	const char* filterNames[] = { "box", "kaiser" };
+	const MipFilter filters[] = { MipFilter::Box, MipFilter::Kaiser };
+	const double megapixels = (double)size * size / 1000000.0;
+
+	for (uint32_t f = 0; f < 2; ++f)
+	{
+		for (uint32_t srgb = 0; srgb < 2; ++srgb)
+		{
+			for (uint32_t threaded = 0; threaded < 2; ++threaded)
+			{
+				MipChain chain;
+				const auto start = std::chrono::steady_clock::now();
+				MipGenerateChain(&pixels[0], size, size, filters[f], srgb != 0, threaded ? jobs : nullptr, &chain);
+				const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				UtilsDebugPrint("Mip chain %ux%u %s %s %s: %.2f ms, %.1f MP/s\n",
+					size, size, filterNames[f], srgb ? "srgb" : "linear", threaded ? "parallel" : "serial",
+					seconds * 1000.0, megapixels / seconds);
+			}
+		}
+	}
+}
+#endif
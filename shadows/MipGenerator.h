@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define MIP_MAX_LEVELS 16
+#define MIP_CHANNELS 4
+
+class JobSystem;
+
+enum class MipFilter
+{
+	// 2x2 average
+	Box = 0,
+	// Kaiser windowed sinc, sharper minification with little aliasing
+	Kaiser = 1,
+};
+
+// RGBA8 mip levels stored back to back, level sizes follow the D3D rule
+// max(1, size >> level)
+struct MipChain
+{
+	MipChain() : Width{0}, Height{0}, NumLevels{0}, Offsets{} {}
+	uint32_t GetLevelWidth(uint32_t level) const { return Width >> level ? Width >> level : 1; }
+	uint32_t GetLevelHeight(uint32_t level) const { return Height >> level ? Height >> level : 1; }
+	uint32_t GetLevelPitch(uint32_t level) const { return GetLevelWidth(level) * MIP_CHANNELS; }
+	const uint8_t* GetLevel(uint32_t level) const { return &Data[Offsets[level]]; }
+
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t NumLevels;
+	size_t Offsets[MIP_MAX_LEVELS];
+	std::vector<uint8_t> Data;
+};
+
+uint32_t MipCountLevels(uint32_t width, uint32_t height);
+
+// Builds the full chain down to 1x1 from RGBA8 pixels. With srgb set the color
+// channels are filtered in linear space and re-encoded, alpha is always linear.
+// Rows of every level are split across jobs when jobs is not null.
+void MipGenerateChain(const uint8_t* pixels,
+	uint32_t width,
+	uint32_t height,
+	MipFilter filter,
+	bool srgb,
+	JobSystem* jobs,
+	MipChain* chain);
+
+#ifdef MIP_GENERATOR_TEST
+void MipGeneratorTest(void);
+#endif
+
+#ifdef MIP_GENERATOR_BENCHMARK
+// Prints megapixels of source per second for every filter and color space
+void MipGeneratorBenchmark(JobSystem* jobs);
+#endif
@@ -3,26 +3,31 @@
 float4 main(VSOut In) : SV_TARGET
 {
 	Material mat;
-	mat.Ambient = diffuseTexture.Sample(defaultSampler, In.TexCoords);
-	mat.Diffuse = diffuseTexture.Sample(defaultSampler, In.TexCoords);
-	mat.Specular = specularTexture.Sample(defaultSampler, In.TexCoords);
-	mat.Specular.w = material.Specular.w;
+	mat.Ambient = SampleMaterialTexture(diffuseTexture, In.MaterialIdx, TEXTURE_DIFFUSE, In.TexCoords);
+	mat.Diffuse = mat.Ambient;
+	// specular maps are single channel (BC4)
+	mat.Specular = SampleMaterialTexture(specularTexture, In.MaterialIdx, TEXTURE_SPECULAR, In.TexCoords).rrrr;
+	mat.Specular.w = materials[In.MaterialIdx].Specular.w;
 
 	const float3 normal = normalize(In.NormalW);
 	const float3 toEye = normalize(cameraPosW - In.PosW);
 
 	float4 resultColor = float4(0.0f, 0.0f, 0.0f, 0.0f);
-	resultColor += ComputeDirectionalLight(mat, dirLight, normal, toEye);
+	resultColor += ComputeDirectionalLight(mat, dirLight, normal, toEye, SampleShadow(In.PosW));
 
-	//for (int i = 0; i < 4; ++i)
-	//{
-	//	resultColor += ComputePointLight(mat, pointLights[i], In.PosW, normal, toEye);
-	//}
+	// only the lights that reach the cluster of the pixel
+	const uint4 cluster = FindLightCluster(In.PosH.xy, In.PosW);
+	for (uint i = 0; i < cluster.y; ++i)
+	{
+		const uint light = lightIndices[cluster.x + i];
+		resultColor += ComputePointLight(mat, pointLights[light], In.PosW, normal, toEye, SamplePointShadow(light, In.PosW));
+	}
 
-	//for (int i = 0; i < 2; ++i)
-	//{
-	//	resultColor += ComputeSpotLight(mat, spotLights[i], In.PosW, normal, toEye);
-	//}
+	for (uint j = 0; j < cluster.z; ++j)
+	{
+		const uint light = lightIndices[cluster.x + cluster.y + j];
+		resultColor += ComputeSpotLight(mat, spotLights[light], In.PosW, normal, toEye, SampleSpotShadow(light, In.PosW));
+	}
 
 	return saturate(resultColor);
 }
@@ -2,5 +2,5 @@
 
 float4 main(VSOut In) : SV_TARGET
 {
-	return diffuseTexture.Sample(defaultSampler, In.TexCoords);
+	return SampleMaterialTexture(diffuseTexture, In.MaterialIdx, TEXTURE_DIFFUSE, In.TexCoords);
 }
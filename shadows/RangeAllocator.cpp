@@ -0,0 +1,335 @@
+#include "RangeAllocator.h"
+
+#include <assert.h>
+
+RangeAllocator::RangeAllocator(): RangeAllocator(0)
+{
+}
+
+RangeAllocator::RangeAllocator(uint32_t capacity):
+	m_Capacity{0},
+	m_Used{0}
+{
+	Reset(capacity);
+}
+
+RangeAllocator::~RangeAllocator()
+{
+}
+
+void RangeAllocator::Reset(uint32_t capacity)
+{
+	m_Capacity = capacity;
+	m_Used = 0;
+	m_FreeByOffset.clear();
+	m_FreeBySize.clear();
+	m_Allocations.clear();
+	if (capacity > 0)
+	{
+		InsertFreeBlock(0, capacity);
+	}
+}
+
+uint32_t RangeAllocator::Allocate(uint32_t size)
+{
+	if (size == 0)
+	{
+		return RANGE_ALLOCATOR_INVALID_OFFSET;
+	}
+
+	// smallest block that is big enough
+	auto bySize = m_FreeBySize.lower_bound(size);
+	if (bySize == m_FreeBySize.end())
+	{
+		return RANGE_ALLOCATOR_INVALID_OFFSET;
+	}
+
+	const uint32_t offset = bySize->second;
+	const uint32_t blockSize = bySize->first;
+	EraseFreeBlock(m_FreeByOffset.find(offset));
+
+	if (blockSize > size)
+	{
+		InsertFreeBlock(offset + size, blockSize - size);
+	}
+
+	m_Allocations[offset] = size;
+	m_Used += size;
+	return offset;
+}
+
+void RangeAllocator::Free(uint32_t offset)
+{
+	auto allocation = m_Allocations.find(offset);
+	assert(allocation != m_Allocations.end() && "Freeing range that was not allocated");
+	if (allocation == m_Allocations.end())
+	{
+		return;
+	}
+
+	uint32_t start = offset;
+	uint32_t size = allocation->second;
+	m_Used -= size;
+	m_Allocations.erase(allocation);
+
+	// merge with the following free block
+	auto next = m_FreeByOffset.find(start + size);
+	if (next != m_FreeByOffset.end())
+	{
+		size += next->second;
+		EraseFreeBlock(next);
+	}
+
+	// merge with the preceding free block
+	auto prev = m_FreeByOffset.lower_bound(start);
+	if (prev != m_FreeByOffset.begin())
+	{
+		--prev;
+		if (prev->first + prev->second == start)
+		{
+			start = prev->first;
+			size += prev->second;
+			EraseFreeBlock(prev);
+		}
+	}
+
+	InsertFreeBlock(start, size);
+}
+
+uint32_t RangeAllocator::GetLargestFreeBlock() const
+{
+	return m_FreeBySize.empty() ? 0 : m_FreeBySize.rbegin()->first;
+}
+
+float RangeAllocator::GetFragmentation() const
+{
+	const uint32_t free = GetFree();
+	if (free == 0)
+	{
+		return 0.0f;
+	}
+	return 1.0f - (float)GetLargestFreeBlock() / (float)free;
+}
+
+void RangeAllocator::InsertFreeBlock(uint32_t offset, uint32_t size)
+{
+	m_FreeByOffset[offset] = size;
+	m_FreeBySize.emplace(size, offset);
+}
+
+void RangeAllocator::EraseFreeBlock(std::map<uint32_t, uint32_t>::iterator it)
+{
+	auto range = m_FreeBySize.equal_range(it->second);
+	for (auto bySize = range.first; bySize != range.second; ++bySize)
+	{
+		if (bySize->second == it->first)
+		{
+			m_FreeBySize.erase(bySize);
+			break;
+		}
+	}
+	m_FreeByOffset.erase(it);
+}
+
+#ifdef RANGE_ALLOCATOR_TEST
+static void TestRangeAllocatorBasic(void)
+{
+	RangeAllocator allocator(100);
+	assert(allocator.GetFree() == 100);
+	assert(allocator.Allocate(0) == RANGE_ALLOCATOR_INVALID_OFFSET);
+	assert(allocator.Allocate(101) == RANGE_ALLOCATOR_INVALID_OFFSET);
+
+	const uint32_t a = allocator.Allocate(30);
+	const uint32_t b = allocator.Allocate(30);
+	const uint32_t c = allocator.Allocate(40);
+	assert(a == 0 && b == 30 && c == 60);
+	assert(allocator.GetFree() == 0 && allocator.GetNumFreeBlocks() == 0);
+	assert(allocator.Allocate(1) == RANGE_ALLOCATOR_INVALID_OFFSET);
+
+	allocator.Free(b);
+	assert(allocator.GetFree() == 30 && allocator.GetLargestFreeBlock() == 30);
+	assert(allocator.GetFragmentation() == 0.0f);
+
+	// freeing neighbours collapses everything back into one block
+	allocator.Free(a);
+	assert(allocator.GetNumFreeBlocks() == 1 && allocator.GetLargestFreeBlock() == 60);
+	allocator.Free(c);
+	assert(allocator.GetNumFreeBlocks() == 1 && allocator.GetLargestFreeBlock() == 100);
+	assert(allocator.GetUsed() == 0 && allocator.GetNumAllocations() == 0);
+}
+
+static void TestRangeAllocatorBestFit(void)
+{
+	RangeAllocator allocator(100);
+	uint32_t offsets[5] = {};
+	for (uint32_t i = 0; i < 5; ++i)
+	{
+		offsets[i] = allocator.Allocate(20);
+	}
+	// leave holes of 20 at 0 and 40, plus 40 at the end after freeing 3 and 4
+	allocator.Free(offsets[0]);
+	allocator.Free(offsets[2]);
+	allocator.Free(offsets[3]);
+	allocator.Free(offsets[4]);
+	assert(allocator.GetNumFreeBlocks() == 2);
+
+	// 20 goes to the exact fit hole, not the bigger tail
+	assert(allocator.Allocate(20) == 0);
+	assert(allocator.Allocate(50) == 40);
+	assert(allocator.Allocate(11) == RANGE_ALLOCATOR_INVALID_OFFSET);
+	assert(allocator.Allocate(10) == 90);
+}
+
+static void TestRangeAllocatorFragmentation(void)
+{
+	RangeAllocator allocator(1024);
+	uint32_t offsets[64] = {};
+	for (uint32_t i = 0; i < 64; ++i)
+	{
+		offsets[i] = allocator.Allocate(16);
+		assert(offsets[i] == i * 16);
+	}
+
+	// checkerboard free pattern: half the space is free but nothing above 16 fits
+	for (uint32_t i = 0; i < 64; i += 2)
+	{
+		allocator.Free(offsets[i]);
+	}
+	assert(allocator.GetFree() == 512);
+	assert(allocator.GetLargestFreeBlock() == 16);
+	assert(allocator.GetNumFreeBlocks() == 32);
+	assert(allocator.GetFragmentation() > 0.9f);
+	assert(allocator.Allocate(17) == RANGE_ALLOCATOR_INVALID_OFFSET);
+
+	for (uint32_t i = 1; i < 64; i += 2)
+	{
+		allocator.Free(offsets[i]);
+	}
+	assert(allocator.GetNumFreeBlocks() == 1);
+	assert(allocator.GetFragmentation() == 0.0f);
+}
+
+static void TestRangeAllocatorStress(void)
+{
+	// many mixed size allocations and frees, invariants must hold throughout
+	const uint32_t capacity = 1 << 20;
+	RangeAllocator allocator(capacity);
+	std::unordered_map<uint32_t, uint32_t> live;
+	uint32_t seed = 12345;
+	uint32_t used = 0;
+
+	for (uint32_t i = 0; i < 100000; ++i)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		if ((seed >> 16) % 3 != 0 || live.empty())
+		{
+			const uint32_t size = 1 + (seed >> 8) % 4096;
+			const uint32_t offset = allocator.Allocate(size);
+			if (offset != RANGE_ALLOCATOR_INVALID_OFFSET)
+			{
+				assert(offset + size <= capacity);
+				live[offset] = size;
+				used += size;
+			}
+		}
+		else
+		{
+			auto it = live.begin();
+			used -= it->second;
+			allocator.Free(it->first);
+			live.erase(it);
+		}
+		assert(allocator.GetUsed() == used);
+	}
+
+	for (const auto& allocation : live)
+	{
+		allocator.Free(allocation.first);
+	}
+	assert(allocator.GetUsed() == 0);
+	assert(allocator.GetNumFreeBlocks() == 1 && allocator.GetLargestFreeBlock() == capacity);
+}
+
+void RangeAllocatorTest(void)
+{
+	TestRangeAllocatorBasic();
+	TestRangeAllocatorBestFit();
+	TestRangeAllocatorFragmentation();
+	TestRangeAllocatorStress();
+}
+#endif
+
+#ifdef RANGE_ALLOCATOR_BENCHMARK
+#include "Utils.h"
+
+#include <chrono>
+#include <vector>
+
+void RangeAllocatorBenchmark(void)
+{
+	const uint32_t numRounds = 4000;
+	const uint32_t batchSize = 256;
+	const uint32_t liveCounts[] = { 1000, 10000, 100000 };
+	for (uint32_t numLive : liveCounts)
+	{
+		// ranges of 1 to 4096 units, about half the capacity is in use so the free list fragments
+		RangeAllocator allocator(numLive * 4096);
+		std::vector<uint32_t> live(numLive);
+		uint32_t seed = 1;
+		for (uint32_t& offset : live)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			offset = allocator.Allocate(1 + (seed >> 8) % 4096);
+		}
+
+		// streaming in steady state, each round frees a run of live ranges and allocates new sizes in their place
+		std::vector<uint32_t> sizes(batchSize);
+		uint32_t numFailed = 0;
+		double allocateSeconds = 0.0;
+		double freeSeconds = 0.0;
+		for (uint32_t round = 0; round < numRounds; ++round)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			const uint32_t first = (seed >> 8) % numLive;
+			for (uint32_t& size : sizes)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				size = 1 + (seed >> 8) % 4096;
+			}
+
+			auto start = std::chrono::steady_clock::now();
+			for (uint32_t i = 0; i < batchSize; ++i)
+			{
+				const uint32_t offset = live[(first + i) % numLive];
+				if (offset != RANGE_ALLOCATOR_INVALID_OFFSET)
+				{
+					allocator.Free(offset);
+				}
+			}
+			auto end = std::chrono::steady_clock::now();
+			freeSeconds += std::chrono::duration<double>(end - start).count();
+
+			start = end;
+			for (uint32_t i = 0; i < batchSize; ++i)
+			{
+				live[(first + i) % numLive] = allocator.Allocate(sizes[i]);
+			}
+			allocateSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			for (uint32_t i = 0; i < batchSize; ++i)
+			{
+				numFailed += live[(first + i) % numLive] == RANGE_ALLOCATOR_INVALID_OFFSET ? 1 : 0;
+			}
+		}
+
+		const double numOperations = (double)numRounds * batchSize;
+		UtilsDebugPrint("Range allocator: %u live ranges, %.2f M allocations/s, %.2f M frees/s, %u failed, %u free blocks, fragmentation %.2f\n",
+			numLive,
+			numOperations / allocateSeconds / 1e6,
+			numOperations / freeSeconds / 1e6,
+			numFailed,
+			allocator.GetNumFreeBlocks(),
+			allocator.GetFragmentation());
+	}
+}
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+
+#define RANGE_ALLOCATOR_INVALID_OFFSET UINT32_MAX
+
+// Best-fit free-list allocator over the abstract range [0, capacity).
+// Units are up to the caller (vertices, indices, bytes). Freed ranges are
+// merged with their free neighbours so the list stays short.
+class RangeAllocator
+{
+public:
+	RangeAllocator();
+	explicit RangeAllocator(uint32_t capacity);
+	~RangeAllocator();
+
+	void Reset(uint32_t capacity);
+
+	// Returns RANGE_ALLOCATOR_INVALID_OFFSET if there is no free range that fits
+	uint32_t Allocate(uint32_t size);
+	void Free(uint32_t offset);
+
+	uint32_t GetCapacity() const { return m_Capacity; }
+	uint32_t GetUsed() const { return m_Used; }
+	uint32_t GetFree() const { return m_Capacity - m_Used; }
+	uint32_t GetNumAllocations() const { return (uint32_t)m_Allocations.size(); }
+	uint32_t GetNumFreeBlocks() const { return (uint32_t)m_FreeByOffset.size(); }
+	uint32_t GetLargestFreeBlock() const;
+	// 0 when all free space is one block, approaches 1 as it gets scattered
+	float GetFragmentation() const;
+
+private:
+	void InsertFreeBlock(uint32_t offset, uint32_t size);
+	void EraseFreeBlock(std::map<uint32_t, uint32_t>::iterator it);
+
+	uint32_t m_Capacity;
+	uint32_t m_Used;
+	std::map<uint32_t, uint32_t> m_FreeByOffset;
+	std::multimap<uint32_t, uint32_t> m_FreeBySize;
+	std::unordered_map<uint32_t, uint32_t> m_Allocations;
+};
+
+#ifdef RANGE_ALLOCATOR_TEST
+void RangeAllocatorTest(void);
+#endif
+
+#ifdef RANGE_ALLOCATOR_BENCHMARK
+// Prints allocations and frees per second for mesh sized ranges at a few numbers of live ranges
+void RangeAllocatorBenchmark(void);
+#endif
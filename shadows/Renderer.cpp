@@ -1,9 +1,26 @@
 #include "Renderer.h"
 
 #include <cassert>
+#include <cstring>
 
 
-Renderer::Renderer()
+Renderer::Renderer():
+	m_Topology{D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED},
+	m_InputLayout{nullptr},
+	m_RasterizerState{nullptr},
+	m_SamplerStates{},
+	m_PS{nullptr},
+	m_VS{nullptr},
+	m_PS_SRV{},
+	m_PS_CB{},
+	m_VS_CB{},
+	m_DR{nullptr},
+	m_BoundIndexBuffer{nullptr},
+	m_BoundVertexBuffers{nullptr, nullptr},
+	m_BoundStrides{0, 0},
+	m_BoundSRVs{},
+	m_SRVsBound{false},
+	m_NumShaderResourceBinds{0}
 {
 }
 
@@ -41,9 +58,10 @@ void Renderer::BindVertexShader(ID3D11VertexShader* shader)
 	m_VS = shader;
 }
 
-void Renderer::SetSamplerState(ID3D11SamplerState* state)
+void Renderer::SetSamplerState(ID3D11SamplerState* state, uint32_t slot)
 {
-	m_SamplerState = state;
+	assert(slot < R_MAX_SAMPLER_NUM);
+	m_SamplerStates[slot] = state;
 }
 
 void Renderer::BindShaderResources(enum BindTargets bindTarget, ID3D11ShaderResourceView** SRVs, uint32_t numSRVs)
@@ -88,24 +106,87 @@ void Renderer::DrawIndexed(ID3D11Buffer* indexBuffer,
 	uint32_t startIndexLocation,
 	uint32_t baseVertexLocation)
 {
-	const uint32_t offsets = 0;
-	static ID3D11ShaderResourceView* nullSRV[] = { NULL };
+	ID3D11DeviceContext* context = m_DR->GetDeviceContext();
+
+	BindInputBuffers(indexBuffer, vertexBuffer, strides, nullptr, 0);
+	BindPipelineState();
+	context->DrawIndexed(indexCount, startIndexLocation, baseVertexLocation);
+
+}
+
+void Renderer::DrawIndexedInstanced(ID3D11Buffer* indexBuffer,
+	ID3D11Buffer* vertexBuffer,
+	uint32_t strides,
+	ID3D11Buffer* instanceBuffer,
+	uint32_t instanceStrides,
+	uint32_t indexCount,
+	uint32_t instanceCount,
+	uint32_t startIndexLocation,
+	uint32_t baseVertexLocation,
+	uint32_t startInstanceLocation)
+{
+	ID3D11DeviceContext* context = m_DR->GetDeviceContext();
+
+	BindInputBuffers(indexBuffer, vertexBuffer, strides, instanceBuffer, instanceStrides);
+	BindPipelineState();
+	context->DrawIndexedInstanced(indexCount, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+}
+
+void Renderer::Draw(uint32_t vertexCount)
+{
+	ID3D11DeviceContext* context = m_DR->GetDeviceContext();
+
+	BindPipelineState();
+	context->Draw(vertexCount, 0);
+}
+
+void Renderer::BindInputBuffers(ID3D11Buffer* indexBuffer,
+	ID3D11Buffer* vertexBuffer,
+	uint32_t strides,
+	ID3D11Buffer* instanceBuffer,
+	uint32_t instanceStrides)
+{
+	ID3D11DeviceContext* context = m_DR->GetDeviceContext();
+
+	ID3D11Buffer* buffers[] = { vertexBuffer, instanceBuffer };
+	const uint32_t bufferStrides[] = { strides, instanceStrides };
+	const uint32_t offsets[] = { 0, 0 };
+
+	if (memcmp(m_BoundVertexBuffers, buffers, sizeof(buffers)) != 0 ||
+		memcmp(m_BoundStrides, bufferStrides, sizeof(bufferStrides)) != 0)
+	{
+		context->IASetVertexBuffers(0, 2, buffers, bufferStrides, offsets);
+		memcpy(m_BoundVertexBuffers, buffers, sizeof(buffers));
+		memcpy(m_BoundStrides, bufferStrides, sizeof(bufferStrides));
+	}
+
+	if (m_BoundIndexBuffer != indexBuffer)
+	{
+		context->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+		m_BoundIndexBuffer = indexBuffer;
+	}
+}
+
+void Renderer::BindPipelineState()
+{
 	ID3D11DeviceContext* context = m_DR->GetDeviceContext();
 
 	context->IASetPrimitiveTopology(m_Topology);
 	context->IASetInputLayout(m_InputLayout);
-	context->IASetVertexBuffers(0, 1, &vertexBuffer, &strides, &offsets);
-	context->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
 	context->RSSetState(m_RasterizerState);
-	context->PSSetSamplers(0, 1, &m_SamplerState);
+	context->PSSetSamplers(0, R_MAX_SAMPLER_NUM, m_SamplerStates);
 	context->VSSetShader(m_VS, NULL, 0);
 	context->PSSetShader(m_PS, NULL, 0);
 
-	context->PSSetShaderResources(0, R_MAX_SRV_NUM, m_PS_SRV);
+	if (!m_SRVsBound || memcmp(m_BoundSRVs, m_PS_SRV, sizeof(m_PS_SRV)) != 0)
+	{
+		context->PSSetShaderResources(0, R_MAX_SRV_NUM, m_PS_SRV);
+		memcpy(m_BoundSRVs, m_PS_SRV, sizeof(m_PS_SRV));
+		m_SRVsBound = true;
+		++m_NumShaderResourceBinds;
+	}
 	context->PSSetConstantBuffers(0, R_MAX_CB_NUM, m_PS_CB);
 	context->VSSetConstantBuffers(0, R_MAX_CB_NUM, m_VS_CB);
-	context->DrawIndexed(indexCount, startIndexLocation, baseVertexLocation);
-
 }
 
 void Renderer::Clear()
@@ -117,6 +198,13 @@ void Renderer::Clear()
 	static const float CLEAR_COLOR[4] = { 0.392156899f, 0.584313750f, 0.929411829f, 1.000000000f };
 	static const float BLACK_COLOR[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
 
+	// bindings may have been changed outside of the renderer since the last frame
+	m_BoundIndexBuffer = nullptr;
+	memset(m_BoundVertexBuffers, 0, sizeof(m_BoundVertexBuffers));
+	memset(m_BoundStrides, 0, sizeof(m_BoundStrides));
+	m_SRVsBound = false;
+	m_NumShaderResourceBinds = 0;
+
 	ctx->ClearRenderTargetView(rtv, BLACK_COLOR);
 	ctx->ClearDepthStencilView(dsv, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 	ctx->OMSetRenderTargets(1, &rtv, dsv);
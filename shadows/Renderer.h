@@ -6,8 +6,10 @@
 
 #include "DeviceResources.h"
 
-#define R_MAX_SRV_NUM 4
-#define R_MAX_CB_NUM 3
+// material textures, the shadow map and the shadow atlas of the point and spot lights
+#define R_MAX_SRV_NUM 10
+#define R_MAX_CB_NUM 4
+#define R_MAX_SAMPLER_NUM 2
 
 #define R_DEFAULT_PRIMTIVE_TOPOLOGY D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST
 
@@ -27,7 +29,7 @@ public:
 	void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
 	void SetInputLayout(ID3D11InputLayout* inputLayout);
 	void SetRasterizerState(ID3D11RasterizerState* rasterizerState);
-	void SetSamplerState(ID3D11SamplerState* state);
+	void SetSamplerState(ID3D11SamplerState* state, uint32_t slot = 0);
 	
 	void BindPixelShader(ID3D11PixelShader* shader);
 	void BindVertexShader(ID3D11VertexShader* shader);
@@ -42,18 +44,47 @@ public:
 		uint32_t indexCount,
 		uint32_t startIndexLocation,
 		uint32_t baseVertexLocation);
+	void DrawIndexedInstanced(ID3D11Buffer* indexBuffer,
+		ID3D11Buffer* vertexBuffer,
+		uint32_t strides,
+		ID3D11Buffer* instanceBuffer,
+		uint32_t instanceStrides,
+		uint32_t indexCount,
+		uint32_t instanceCount,
+		uint32_t startIndexLocation,
+		uint32_t baseVertexLocation,
+		uint32_t startInstanceLocation);
+	// Vertices come from SV_VertexID alone, set a null input layout first
+	void Draw(uint32_t vertexCount);
 	void Clear();
 	void Present();
 
+	// PSSetShaderResources calls since the last Clear, draws with the textures of the previous one skip it
+	uint32_t GetNumShaderResourceBinds() const { return m_NumShaderResourceBinds; }
+
 private:
+	void BindPipelineState();
+	void BindInputBuffers(ID3D11Buffer* indexBuffer,
+		ID3D11Buffer* vertexBuffer,
+		uint32_t strides,
+		ID3D11Buffer* instanceBuffer,
+		uint32_t instanceStrides);
+
 	D3D11_PRIMITIVE_TOPOLOGY m_Topology;
 	ID3D11InputLayout* m_InputLayout;
 	ID3D11RasterizerState* m_RasterizerState;
-	ID3D11SamplerState* m_SamplerState;
+	ID3D11SamplerState* m_SamplerStates[R_MAX_SAMPLER_NUM];
 	ID3D11PixelShader* m_PS;
 	ID3D11VertexShader* m_VS;
 	ID3D11ShaderResourceView* m_PS_SRV[R_MAX_SRV_NUM];
 	ID3D11Buffer* m_PS_CB[R_MAX_CB_NUM];
 	ID3D11Buffer* m_VS_CB[R_MAX_CB_NUM];
 	DeviceResources* m_DR;
+	// IA bindings of the last draw, pooled geometry lets most draws skip rebinding
+	ID3D11Buffer* m_BoundIndexBuffer;
+	ID3D11Buffer* m_BoundVertexBuffers[2];
+	uint32_t m_BoundStrides[2];
+	ID3D11ShaderResourceView* m_BoundSRVs[R_MAX_SRV_NUM];
+	bool m_SRVsBound;
+	uint32_t m_NumShaderResourceBinds;
 };
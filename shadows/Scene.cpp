@@ -0,0 +1,363 @@
+#include "Scene.h"
+
+#include <assert.h>
+
+Scene::Scene():
+	m_NumDirty{0}
+{
+}
+
+Scene::~Scene()
+{
+}
+
+EntityHandle Scene::CreateEntity(uint32_t meshId, uint32_t materialId, const AABB& localBounds, const Mat4X4& world)
+{
+	uint32_t slot = 0;
+	if (!m_FreeSlots.empty())
+	{
+		slot = m_FreeSlots.back();
+		m_FreeSlots.pop_back();
+	}
+	else
+	{
+		slot = (uint32_t)m_SlotToDense.size();
+		m_SlotToDense.emplace_back(SCENE_INVALID_INDEX);
+		m_Generations.emplace_back(0);
+	}
+
+	const uint32_t denseIdx = (uint32_t)m_Worlds.size();
+	m_SlotToDense[slot] = denseIdx;
+	m_DenseToSlot.emplace_back(slot);
+
+	m_Worlds.emplace_back(world);
+	m_LocalBounds.emplace_back(localBounds);
+	m_WorldBounds.emplace_back(MathAABBTransform(&localBounds, &world));
+	m_MeshIds.emplace_back(meshId);
+	m_MaterialIds.emplace_back(materialId);
+	m_BoundsDirty.emplace_back(0);
+
+	return EntityHandle(slot, m_Generations[slot]);
+}
+
+void Scene::DestroyEntity(EntityHandle handle)
+{
+	if (!IsAlive(handle))
+	{
+		return;
+	}
+
+	// move the last entity into the hole to keep the arrays dense
+	const uint32_t denseIdx = m_SlotToDense[handle.Index];
+	const uint32_t lastIdx = (uint32_t)m_Worlds.size() - 1;
+	if (m_BoundsDirty[denseIdx])
+	{
+		--m_NumDirty;
+	}
+
+	if (denseIdx != lastIdx)
+	{
+		m_Worlds[denseIdx] = m_Worlds[lastIdx];
+		m_LocalBounds[denseIdx] = m_LocalBounds[lastIdx];
+		m_WorldBounds[denseIdx] = m_WorldBounds[lastIdx];
+		m_MeshIds[denseIdx] = m_MeshIds[lastIdx];
+		m_MaterialIds[denseIdx] = m_MaterialIds[lastIdx];
+		m_BoundsDirty[denseIdx] = m_BoundsDirty[lastIdx];
+		m_DenseToSlot[denseIdx] = m_DenseToSlot[lastIdx];
+		m_SlotToDense[m_DenseToSlot[denseIdx]] = denseIdx;
+	}
+
+	m_Worlds.pop_back();
+	m_LocalBounds.pop_back();
+	m_WorldBounds.pop_back();
+	m_MeshIds.pop_back();
+	m_MaterialIds.pop_back();
+	m_BoundsDirty.pop_back();
+	m_DenseToSlot.pop_back();
+
+	m_SlotToDense[handle.Index] = SCENE_INVALID_INDEX;
+	++m_Generations[handle.Index];
+	m_FreeSlots.emplace_back(handle.Index);
+}
+
+void Scene::Clear()
+{
+	for (uint32_t slot = 0; slot < m_SlotToDense.size(); ++slot)
+	{
+		if (m_SlotToDense[slot] != SCENE_INVALID_INDEX)
+		{
+			DestroyEntity(EntityHandle(slot, m_Generations[slot]));
+		}
+	}
+}
+
+bool Scene::IsAlive(EntityHandle handle) const
+{
+	return handle.Index < m_SlotToDense.size() &&
+		m_Generations[handle.Index] == handle.Generation &&
+		m_SlotToDense[handle.Index] != SCENE_INVALID_INDEX;
+}
+
+uint32_t Scene::GetDenseIndex(EntityHandle handle) const
+{
+	assert(IsAlive(handle) && "Stale entity handle");
+	return m_SlotToDense[handle.Index];
+}
+
+EntityHandle Scene::GetHandle(uint32_t denseIdx) const
+{
+	const uint32_t slot = m_DenseToSlot[denseIdx];
+	return EntityHandle(slot, m_Generations[slot]);
+}
+
+void Scene::SetWorld(EntityHandle handle, const Mat4X4& world)
+{
+	const uint32_t denseIdx = GetDenseIndex(handle);
+	m_Worlds[denseIdx] = world;
+	if (!m_BoundsDirty[denseIdx])
+	{
+		m_BoundsDirty[denseIdx] = 1;
+		++m_NumDirty;
+	}
+}
+
+void Scene::SetMaterial(EntityHandle handle, uint32_t materialId)
+{
+	m_MaterialIds[GetDenseIndex(handle)] = materialId;
+}
+
+void Scene::UpdateBounds()
+{
+	if (m_NumDirty == 0)
+	{
+		return;
+	}
+
+	const uint32_t count = GetNumEntities();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (m_BoundsDirty[i])
+		{
+			m_WorldBounds[i] = MathAABBTransform(&m_LocalBounds[i], &m_Worlds[i]);
+			m_BoundsDirty[i] = 0;
+		}
+	}
+	m_NumDirty = 0;
+}
+
+void Scene::Cull(const Frustum& frustum, std::vector<uint32_t>* visible) const
+{
+	const uint32_t count = GetNumEntities();
+	const AABB* bounds = m_WorldBounds.data();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (MathFrustumIntersectsAABB(&frustum, &bounds[i]))
+		{
+			visible->emplace_back(i);
+		}
+	}
+}
+
+#ifdef SCENE_TEST
+void SceneTest(void)
+{
+	Scene scene;
+	const AABB unit = { {-1.0f, -1.0f, -1.0f}, {1.0f, 1.0f, 1.0f} };
+
+	EntityHandle handles[4];
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		const Vec3D offset = { (float)i * 10.0f, 0.0f, 0.0f };
+		handles[i] = scene.CreateEntity(i, 100 + i, unit, MathMat4X4TranslateFromVec3D(&offset));
+	}
+	assert(scene.GetNumEntities() == 4);
+	assert(scene.GetWorldBounds()[2].Min.X == 19.0f);
+
+	// destroying swaps the last entity into the hole
+	scene.DestroyEntity(handles[1]);
+	assert(!scene.IsAlive(handles[1]));
+	assert(scene.GetNumEntities() == 3);
+	assert(scene.GetDenseIndex(handles[3]) == 1);
+	assert(scene.GetMeshIds()[1] == 3 && scene.GetMaterialIds()[1] == 103);
+	assert(scene.GetWorld(handles[3]).A30 == 30.0f);
+	assert(scene.GetHandle(1) == handles[3]);
+
+	// a recycled slot gets a new generation, the old handle stays dead
+	const Vec3D behind = { 0.0f, 0.0f, -10.0f };
+	const EntityHandle recycled = scene.CreateEntity(7, 107, unit, MathMat4X4TranslateFromVec3D(&behind));
+	assert(recycled.Index == handles[1].Index && recycled.Generation != handles[1].Generation);
+	assert(!scene.IsAlive(handles[1]) && scene.IsAlive(recycled));
+	scene.DestroyEntity(handles[1]);
+	assert(scene.GetNumEntities() == 4);
+
+	// bounds follow the world matrix after UpdateBounds
+	const Vec3D offset = { 0.0f, 5.0f, 0.0f };
+	scene.SetWorld(handles[0], MathMat4X4TranslateFromVec3D(&offset));
+	assert(scene.GetWorldBounds()[scene.GetDenseIndex(handles[0])].Min.Y == -1.0f);
+	scene.UpdateBounds();
+	assert(scene.GetWorldBounds()[scene.GetDenseIndex(handles[0])].Min.Y == 4.0f);
+
+	// a camera at the origin looking down +z sees the entity at z = 10 only
+	const Vec3D eye = { 0.0f, 0.0f, 0.0f };
+	const Vec3D at = { 0.0f, 0.0f, 1.0f };
+	const Vec3D up = { 0.0f, 1.0f, 0.0f };
+	const Mat4X4 view = MathMat4X4ViewAt(&eye, &at, &up);
+	const Mat4X4 proj = MathMat4X4PerspectiveFov(MathToRadians(45.0f), 1.0f, 0.1f, 100.0f);
+	const Mat4X4 viewProj = MathMat4X4MultMat4X4ByMat4X4(&view, &proj);
+	const Frustum frustum = MathFrustumFromMat4X4(&viewProj);
+
+	const Vec3D front = { 0.0f, 0.0f, 10.0f };
+	const EntityHandle visible = scene.CreateEntity(9, 109, unit, MathMat4X4TranslateFromVec3D(&front));
+	std::vector<uint32_t> visibleIndices;
+	scene.Cull(frustum, &visibleIndices);
+	assert(visibleIndices.size() == 1);
+	assert(scene.GetHandle(visibleIndices[0]) == visible);
+
+	scene.Clear();
+	assert(scene.GetNumEntities() == 0);
+	assert(!scene.IsAlive(visible));
+}
+#endif
+
+#ifdef SCENE_BENCHMARK
+#include "LightHelper.h"
+#include "MeshFile.h"
+#include "Utils.h"
+
+#include <chrono>
+
+// Layout of an actor before the scene store, every attribute of an object next to its heap
+// owned geometry, texture and buffer pointers, with the bounds the passes need added on
+struct SceneBenchmarkActor
+{
+	void* IndexBuffer;
+	void* VertexBuffer;
+	std::vector<Vertex> Vertices;
+	std::vector<uint32_t> Indices;
+	Mat4X4 World;
+	void* Textures[4];
+	Material ActorMaterial;
+	AABB LocalBounds;
+	AABB WorldBounds;
+	uint8_t BoundsDirty;
+};
+
+void SceneBenchmark(void)
+{
+	const uint32_t numFrames = 16;
+	const uint32_t counts[] = { 100000, 1000000 };
+	const AABB unit = { {-0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, 0.5f} };
+
+	// a camera in the middle of the grid sees about a third of it
+	const Vec3D eye = { 0.0f, 20.0f, 0.0f };
+	const Vec3D at = { 0.0f, 0.0f, 100.0f };
+	const Vec3D up = { 0.0f, 1.0f, 0.0f };
+	const Mat4X4 view = MathMat4X4ViewAt(&eye, &at, &up);
+	const Mat4X4 proj = MathMat4X4PerspectiveFov(MathToRadians(90.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+	const Mat4X4 viewProj = MathMat4X4MultMat4X4ByMat4X4(&view, &proj);
+	const Frustum frustum = MathFrustumFromMat4X4(&viewProj);
+
+	for (uint32_t count : counts)
+	{
+		// entities on a grid two units apart, each actor keeps a cube's worth of vertices
+		const uint32_t side = (uint32_t)sqrtf((float)count);
+		std::vector<Mat4X4> worlds(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const Vec3D position = { ((float)(i % side) - side * 0.5f) * 2.0f, 0.0f, ((float)(i / side) - side * 0.5f) * 2.0f };
+			worlds[i] = MathMat4X4TranslateFromVec3D(&position);
+		}
+
+		Scene scene;
+		std::vector<EntityHandle> handles(count);
+		std::vector<SceneBenchmarkActor> actors(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			handles[i] = scene.CreateEntity(i % 16, i % 64, unit, worlds[i]);
+			SceneBenchmarkActor& actor = actors[i];
+			actor.IndexBuffer = nullptr;
+			actor.VertexBuffer = nullptr;
+			actor.Vertices.resize(36);
+			actor.Indices.resize(36);
+			actor.World = worlds[i];
+			for (void*& texture : actor.Textures)
+			{
+				texture = nullptr;
+			}
+			actor.LocalBounds = unit;
+			actor.WorldBounds = MathAABBTransform(&unit, &worlds[i]);
+			actor.BoundsDirty = 0;
+		}
+		scene.UpdateBounds();
+
+		// a tenth of the entities move every frame, the same ones in both layouts
+		std::vector<uint32_t> visible;
+		visible.reserve(count);
+		size_t numVisibleScene = 0;
+		size_t numVisibleActors = 0;
+		double sceneUpdateSeconds = 0.0;
+		double sceneCullSeconds = 0.0;
+		double actorUpdateSeconds = 0.0;
+		double actorCullSeconds = 0.0;
+		for (uint32_t frame = 0; frame < numFrames; ++frame)
+		{
+			const Vec3D lift = { 0.0f, (float)(frame % 2), 0.0f };
+			const Mat4X4 offset = MathMat4X4TranslateFromVec3D(&lift);
+
+			auto start = std::chrono::steady_clock::now();
+			for (uint32_t i = frame % 10; i < count; i += 10)
+			{
+				scene.SetWorld(handles[i], MathMat4X4MultMat4X4ByMat4X4(&worlds[i], &offset));
+			}
+			scene.UpdateBounds();
+			auto end = std::chrono::steady_clock::now();
+			sceneUpdateSeconds += std::chrono::duration<double>(end - start).count();
+
+			start = end;
+			visible.clear();
+			scene.Cull(frustum, &visible);
+			end = std::chrono::steady_clock::now();
+			sceneCullSeconds += std::chrono::duration<double>(end - start).count();
+			numVisibleScene += visible.size();
+
+			start = end;
+			for (uint32_t i = frame % 10; i < count; i += 10)
+			{
+				actors[i].World = MathMat4X4MultMat4X4ByMat4X4(&worlds[i], &offset);
+				actors[i].BoundsDirty = 1;
+			}
+			for (SceneBenchmarkActor& actor : actors)
+			{
+				if (actor.BoundsDirty)
+				{
+					actor.WorldBounds = MathAABBTransform(&actor.LocalBounds, &actor.World);
+					actor.BoundsDirty = 0;
+				}
+			}
+			end = std::chrono::steady_clock::now();
+			actorUpdateSeconds += std::chrono::duration<double>(end - start).count();
+
+			start = end;
+			visible.clear();
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				if (MathFrustumIntersectsAABB(&frustum, &actors[i].WorldBounds))
+				{
+					visible.emplace_back(i);
+				}
+			}
+			actorCullSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			numVisibleActors += visible.size();
+		}
+
+		assert(numVisibleScene == numVisibleActors);
+		UtilsDebugPrint("Scene: %u entities, %.0f visible, update %.3f ms, cull %.3f ms per frame, actors: update %.3f ms, cull %.3f ms per frame\n",
+			count,
+			(double)numVisibleScene / numFrames,
+			sceneUpdateSeconds * 1000.0 / numFrames,
+			sceneCullSeconds * 1000.0 / numFrames,
+			actorUpdateSeconds * 1000.0 / numFrames,
+			actorCullSeconds * 1000.0 / numFrames);
+	}
+}
+#endif
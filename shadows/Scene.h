@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Math.h"
+
+#define SCENE_INVALID_INDEX UINT32_MAX
+
+// Generational handle, stays valid while the entity is alive even though
+// its data moves around in the dense arrays when other entities are destroyed
+struct EntityHandle
+{
+	EntityHandle() : Index{SCENE_INVALID_INDEX}, Generation{0} {}
+	EntityHandle(uint32_t index, uint32_t generation) : Index{index}, Generation{generation} {}
+	bool operator==(const EntityHandle& rhs) const { return Index == rhs.Index && Generation == rhs.Generation; }
+	bool operator!=(const EntityHandle& rhs) const { return !(*this == rhs); }
+	uint32_t Index;
+	uint32_t Generation;
+};
+
+// Structure-of-arrays entity storage. Every per-entity attribute lives in its own
+// densely packed array so per-frame passes (bounds update, culling, instance
+// packing) stream through contiguous memory. Mesh and material ids are indices
+// into tables owned by the caller.
+class Scene
+{
+public:
+	Scene();
+	~Scene();
+
+	EntityHandle CreateEntity(uint32_t meshId, uint32_t materialId, const AABB& localBounds, const Mat4X4& world);
+	void DestroyEntity(EntityHandle handle);
+	void Clear();
+	bool IsAlive(EntityHandle handle) const;
+
+	void SetWorld(EntityHandle handle, const Mat4X4& world);
+	void SetMaterial(EntityHandle handle, uint32_t materialId);
+	const Mat4X4& GetWorld(EntityHandle handle) const { return m_Worlds[GetDenseIndex(handle)]; }
+	EntityHandle GetHandle(uint32_t denseIdx) const;
+	uint32_t GetDenseIndex(EntityHandle handle) const;
+
+	// Recomputes world space bounds of entities moved since the last call
+	void UpdateBounds();
+	// Appends dense indices of entities whose world bounds intersect the frustum
+	void Cull(const Frustum& frustum, std::vector<uint32_t>* visible) const;
+
+	uint32_t GetNumEntities() const { return (uint32_t)m_Worlds.size(); }
+	const std::vector<Mat4X4>& GetWorlds() const { return m_Worlds; }
+	const std::vector<AABB>& GetWorldBounds() const { return m_WorldBounds; }
+	const std::vector<uint32_t>& GetMeshIds() const { return m_MeshIds; }
+	const std::vector<uint32_t>& GetMaterialIds() const { return m_MaterialIds; }
+
+private:
+	// dense, indexed by dense index
+	std::vector<Mat4X4> m_Worlds;
+	std::vector<AABB> m_LocalBounds;
+	std::vector<AABB> m_WorldBounds;
+	std::vector<uint32_t> m_MeshIds;
+	std::vector<uint32_t> m_MaterialIds;
+	std::vector<uint8_t> m_BoundsDirty;
+	std::vector<uint32_t> m_DenseToSlot;
+	uint32_t m_NumDirty;
+
+	// sparse, indexed by handle index
+	std::vector<uint32_t> m_SlotToDense;
+	std::vector<uint32_t> m_Generations;
+	std::vector<uint32_t> m_FreeSlots;
+};
+
+#ifdef SCENE_TEST
+void SceneTest(void);
+#endif
+
+#ifdef SCENE_BENCHMARK
+// Prints the time to move, update and cull 100K and 1M entities against the same passes over a vector of actors
+void SceneBenchmark(void);
+#endif
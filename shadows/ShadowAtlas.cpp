@@ -0,0 +1,800 @@
+#include "ShadowAtlas.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <math.h>
+
+ShadowAtlasAllocator::ShadowAtlasAllocator() :
+	m_AtlasSize(0),
+	m_NumLevels(0),
+	m_UsedTexels(0)
+{
+}
+
+ShadowAtlasAllocator::~ShadowAtlasAllocator()
+{
+}
+
+void ShadowAtlasAllocator::Init(uint32_t atlasSize, uint32_t minSlotSize)
+{
+	assert(atlasSize && (atlasSize & (atlasSize - 1)) == 0);
+	assert(minSlotSize && (minSlotSize & (minSlotSize - 1)) == 0 && minSlotSize <= atlasSize);
+
+	m_AtlasSize = atlasSize;
+	m_NumLevels = 1;
+	while ((atlasSize >> (m_NumLevels - 1)) > minSlotSize)
+	{
+		++m_NumLevels;
+	}
+
+	m_LevelStarts.resize(m_NumLevels);
+	uint32_t numNodes = 0;
+	for (uint32_t level = 0; level < m_NumLevels; ++level)
+	{
+		m_LevelStarts[level] = numNodes;
+		numNodes += 1u << (2 * level);
+	}
+	m_States.resize(numNodes);
+	m_FreeIndices.resize(numNodes);
+	m_FreeLists.resize(m_NumLevels);
+	Reset();
+}
+
+void ShadowAtlasAllocator::Reset()
+{
+	std::fill(m_States.begin(), m_States.end(), (uint8_t)NodeAbsent);
+	for (std::vector<uint32_t>& list : m_FreeLists)
+	{
+		list.clear();
+	}
+	m_UsedTexels = 0;
+	AddFree(0, 0);
+}
+
+uint32_t ShadowAtlasAllocator::RoundSize(uint32_t size) const
+{
+	uint32_t res = GetMinSlotSize();
+	while (res < size && res < m_AtlasSize)
+	{
+		res *= 2;
+	}
+	return res;
+}
+
+uint32_t ShadowAtlasAllocator::Allocate(uint32_t size)
+{
+	if (size > m_AtlasSize)
+	{
+		return SHADOW_ATLAS_INVALID_NODE;
+	}
+	uint32_t level = 0;
+	while ((m_AtlasSize >> (level + 1)) >= RoundSize(size))
+	{
+		++level;
+	}
+
+	const uint32_t node = Take(level);
+	if (node != SHADOW_ATLAS_INVALID_NODE)
+	{
+		m_States[node] = NodeUsed;
+		const uint64_t side = m_AtlasSize >> level;
+		m_UsedTexels += side * side;
+	}
+	return node;
+}
+
+bool ShadowAtlasAllocator::AllocateGroup(uint32_t size, uint32_t count, uint32_t* nodes)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		nodes[i] = Allocate(size);
+		if (nodes[i] == SHADOW_ATLAS_INVALID_NODE)
+		{
+			while (i > 0)
+			{
+				Free(nodes[--i]);
+			}
+			return false;
+		}
+	}
+	return true;
+}
+
+void ShadowAtlasAllocator::Free(uint32_t node)
+{
+	assert(node < m_States.size() && m_States[node] == NodeUsed);
+	uint32_t level = GetLevel(node);
+	const uint64_t side = m_AtlasSize >> level;
+	m_UsedTexels -= side * side;
+
+	// merges with the siblings as long as all four are free
+	while (level > 0)
+	{
+		const uint32_t local = node - m_LevelStarts[level];
+		const uint32_t first = m_LevelStarts[level] + (local & ~3u);
+		bool siblingsFree = true;
+		for (uint32_t sibling = first; sibling < first + 4; ++sibling)
+		{
+			siblingsFree &= sibling == node || m_States[sibling] == NodeFree;
+		}
+		if (!siblingsFree)
+		{
+			break;
+		}
+		for (uint32_t sibling = first; sibling < first + 4; ++sibling)
+		{
+			if (sibling != node)
+			{
+				RemoveFree(sibling, level);
+			}
+			m_States[sibling] = NodeAbsent;
+		}
+		--level;
+		node = m_LevelStarts[level] + local / 4;
+	}
+	AddFree(node, level);
+}
+
+ShadowAtlasSlot ShadowAtlasAllocator::GetSlot(uint32_t node) const
+{
+	const uint32_t level = GetLevel(node);
+	const uint32_t local = node - m_LevelStarts[level];
+	ShadowAtlasSlot slot = {};
+	slot.Size = m_AtlasSize >> level;
+	// the children of a node are its quadrants in z order, so the bits of the index interleave y and x
+	for (uint32_t bit = 0; bit < level; ++bit)
+	{
+		slot.X |= ((local >> (2 * bit)) & 1) << bit;
+		slot.Y |= ((local >> (2 * bit + 1)) & 1) << bit;
+	}
+	slot.X *= slot.Size;
+	slot.Y *= slot.Size;
+	return slot;
+}
+
+float ShadowAtlasAllocator::GetUsage() const
+{
+	return m_AtlasSize ? (float)((double)m_UsedTexels / ((double)m_AtlasSize * m_AtlasSize)) : 0.0f;
+}
+
+uint32_t ShadowAtlasAllocator::GetLevel(uint32_t node) const
+{
+	uint32_t level = m_NumLevels - 1;
+	while (node < m_LevelStarts[level])
+	{
+		--level;
+	}
+	return level;
+}
+
+uint32_t ShadowAtlasAllocator::Take(uint32_t level)
+{
+	std::vector<uint32_t>& list = m_FreeLists[level];
+	if (!list.empty())
+	{
+		const uint32_t node = list.back();
+		RemoveFree(node, level);
+		return node;
+	}
+	if (level == 0)
+	{
+		return SHADOW_ATLAS_INVALID_NODE;
+	}
+
+	const uint32_t parent = Take(level - 1);
+	if (parent == SHADOW_ATLAS_INVALID_NODE)
+	{
+		return SHADOW_ATLAS_INVALID_NODE;
+	}
+	m_States[parent] = NodeSplit;
+	const uint32_t first = m_LevelStarts[level] + 4 * (parent - m_LevelStarts[level - 1]);
+	// pushed backwards, so the next requests get the siblings in order
+	for (uint32_t child = first + 3; child > first; --child)
+	{
+		AddFree(child, level);
+	}
+	return first;
+}
+
+void ShadowAtlasAllocator::AddFree(uint32_t node, uint32_t level)
+{
+	m_States[node] = NodeFree;
+	m_FreeIndices[node] = (uint32_t)m_FreeLists[level].size();
+	m_FreeLists[level].push_back(node);
+}
+
+void ShadowAtlasAllocator::RemoveFree(uint32_t node, uint32_t level)
+{
+	std::vector<uint32_t>& list = m_FreeLists[level];
+	const uint32_t index = m_FreeIndices[node];
+	assert(index < list.size() && list[index] == node);
+	list[index] = list.back();
+	m_FreeIndices[list[index]] = index;
+	list.pop_back();
+}
+
+float ShadowAtlasLightImportance(const Vec3D& position, float range, const Vec3D& eye, const Frustum& frustum,
+	float verticalFov, uint32_t screenHeight)
+{
+	if (range <= 0.0f)
+	{
+		return 0.0f;
+	}
+	const Vec3D extents = { range, range, range };
+	const AABB bounds = { MathVec3DSubtraction(&position, &extents), MathVec3DAddition(&position, &extents) };
+	if (!MathFrustumIntersectsAABB(&frustum, &bounds))
+	{
+		return 0.0f;
+	}
+
+	const Vec3D toLight = MathVec3DSubtraction(&position, &eye);
+	const float distance = sqrtf(MathVec3DDot(&toLight, &toLight)) - range;
+	if (distance <= 0.0f)
+	{
+		return (float)screenHeight;
+	}
+	const float pixels = range * (float)screenHeight / (distance * tanf(0.5f * verticalFov));
+	return pixels < (float)screenHeight ? pixels : (float)screenHeight;
+}
+
+float ShadowAtlasFaceSize(float importance, uint32_t numFaces)
+{
+	return numFaces > 1 ? 0.5f * importance : importance;
+}
+
+ShadowAtlas::ShadowAtlas() :
+	m_MinSlotSize(0),
+	m_MaxSlotSize(0),
+	m_FaceBudget(0),
+	m_NumPending(0),
+	m_NumFrames(0),
+	m_NumDrawn(0),
+	m_NumEvictions(0)
+{
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+}
+
+void ShadowAtlas::Init(uint32_t atlasSize, uint32_t minSlotSize, uint32_t maxSlotSize, uint32_t faceBudget)
+{
+	assert(minSlotSize <= maxSlotSize && maxSlotSize <= atlasSize);
+	m_Allocator.Init(atlasSize, minSlotSize);
+	m_MinSlotSize = minSlotSize;
+	m_MaxSlotSize = m_Allocator.RoundSize(maxSlotSize);
+	m_FaceBudget = faceBudget;
+	m_Lights.clear();
+	m_Order.clear();
+	m_Renders.clear();
+	m_NumPending = 0;
+}
+
+void ShadowAtlas::Update(const ShadowAtlasLight* lights, const float* importance, uint32_t numLights)
+{
+	++m_NumFrames;
+	for (uint32_t i = numLights; i < m_Lights.size(); ++i)
+	{
+		Release(i);
+	}
+	const uint32_t oldNumLights = (uint32_t)m_Lights.size();
+	m_Lights.resize(numLights);
+	for (uint32_t i = oldNumLights; i < numLights; ++i)
+	{
+		m_Lights[i] = {};
+		for (Face& face : m_Lights[i].Faces)
+		{
+			face.Node = SHADOW_ATLAS_INVALID_NODE;
+		}
+	}
+
+	// lights that left the atlas or shrink give their slots back first
+	for (uint32_t i = 0; i < numLights; ++i)
+	{
+		Light& light = m_Lights[i];
+		assert(lights[i].NumFaces == 1 || lights[i].NumFaces == SHADOW_ATLAS_NUM_CUBE_FACES);
+		if (light.NumFaces != lights[i].NumFaces)
+		{
+			Release(i);
+			light.NumFaces = lights[i].NumFaces;
+		}
+		light.Importance = importance[i];
+		light.Target = ComputeTarget(light, importance[i]);
+		if (light.Target < light.Size)
+		{
+			Release(i);
+		}
+		for (uint32_t f = 0; f < light.NumFaces && lights[i].Changed; ++f)
+		{
+			light.Faces[f].Dirty = true;
+		}
+	}
+
+	m_Order.resize(numLights);
+	for (uint32_t i = 0; i < numLights; ++i)
+	{
+		m_Order[i] = i;
+	}
+	std::sort(m_Order.begin(), m_Order.end(), [this](uint32_t lhs, uint32_t rhs)
+	{
+		return m_Lights[lhs].Importance > m_Lights[rhs].Importance ||
+			(m_Lights[lhs].Importance == m_Lights[rhs].Importance && lhs < rhs);
+	});
+
+	uint32_t victim = numLights;
+	for (uint32_t position = 0; position < numLights; ++position)
+	{
+		const uint32_t i = m_Order[position];
+		Light& light = m_Lights[i];
+		if (light.Target == 0 || light.Size == light.Target)
+		{
+			continue;
+		}
+		// a light that has a slot only grows into free space
+		if (light.Size > 0)
+		{
+			Place(i, light.Target);
+			continue;
+		}
+
+		uint32_t size = light.Target;
+		while (!Place(i, size))
+		{
+			// takes the slots of the least important light that still has some
+			while (victim > position + 1 && m_Lights[m_Order[victim - 1]].Size == 0)
+			{
+				--victim;
+			}
+			if (victim > position + 1)
+			{
+				Release(m_Order[--victim]);
+				++m_NumEvictions;
+			}
+			else if (size > m_MinSlotSize)
+			{
+				size /= 2;
+			}
+			else
+			{
+				break;
+			}
+		}
+	}
+
+	m_Candidates.clear();
+	for (uint32_t i = 0; i < numLights; ++i)
+	{
+		const Light& light = m_Lights[i];
+		for (uint32_t f = 0; f < light.NumFaces && light.Size; ++f)
+		{
+			if (light.Faces[f].Dirty)
+			{
+				m_Candidates.push_back({ i, f, m_Allocator.GetSlot(light.Faces[f].Node) });
+			}
+		}
+	}
+	// faces without a shadow yet come first, then the ones that waited the longest for their importance
+	std::sort(m_Candidates.begin(), m_Candidates.end(), [this](const ShadowAtlasRender& lhs, const ShadowAtlasRender& rhs)
+	{
+		const Face& lhsFace = m_Lights[lhs.Light].Faces[lhs.Face];
+		const Face& rhsFace = m_Lights[rhs.Light].Faces[rhs.Face];
+		if (lhsFace.Drawn != rhsFace.Drawn)
+		{
+			return !lhsFace.Drawn;
+		}
+		const float lhsPriority = m_Lights[lhs.Light].Importance * (float)(1 + lhsFace.Waiting);
+		const float rhsPriority = m_Lights[rhs.Light].Importance * (float)(1 + rhsFace.Waiting);
+		if (lhsPriority != rhsPriority)
+		{
+			return lhsPriority > rhsPriority;
+		}
+		return lhs.Light < rhs.Light || (lhs.Light == rhs.Light && lhs.Face < rhs.Face);
+	});
+
+	const uint32_t numRenders = (uint32_t)m_Candidates.size() < m_FaceBudget ? (uint32_t)m_Candidates.size() : m_FaceBudget;
+	m_Renders.assign(m_Candidates.begin(), m_Candidates.begin() + numRenders);
+	for (const ShadowAtlasRender& render : m_Renders)
+	{
+		Face& face = m_Lights[render.Light].Faces[render.Face];
+		face.Drawn = true;
+		face.Dirty = false;
+		face.Waiting = 0;
+	}
+	for (uint32_t i = numRenders; i < m_Candidates.size(); ++i)
+	{
+		++m_Lights[m_Candidates[i].Light].Faces[m_Candidates[i].Face].Waiting;
+	}
+	m_NumPending = (uint32_t)m_Candidates.size() - numRenders;
+	m_NumDrawn += numRenders;
+}
+
+bool ShadowAtlas::GetSlot(uint32_t light, uint32_t face, ShadowAtlasSlot* slot) const
+{
+	if (light >= m_Lights.size() || face >= m_Lights[light].NumFaces || !m_Lights[light].Size || !m_Lights[light].Faces[face].Drawn)
+	{
+		return false;
+	}
+	*slot = m_Allocator.GetSlot(m_Lights[light].Faces[face].Node);
+	return true;
+}
+
+void ShadowAtlas::PrintStats() const
+{
+	UtilsDebugPrint("Shadow atlas: %u frames, %llu faces drawn, %u evictions, %.2f of the atlas used\n",
+		m_NumFrames,
+		m_NumDrawn,
+		m_NumEvictions,
+		m_Allocator.GetUsage());
+}
+
+uint32_t ShadowAtlas::ComputeTarget(const Light& light, float importance) const
+{
+	if (importance <= 0.0f)
+	{
+		return 0;
+	}
+	const float size = MathClamp((float)m_MinSlotSize, (float)m_MaxSlotSize, ShadowAtlasFaceSize(importance, light.NumFaces));
+	if (light.Size && fabsf(log2f(size) - log2f((float)light.Size)) < SHADOW_ATLAS_HYSTERESIS)
+	{
+		return light.Size;
+	}
+	// the nearest power of two in log space
+	const uint32_t target = m_Allocator.RoundSize((uint32_t)exp2f(floorf(log2f(size) + 0.5f)));
+	return target < m_MaxSlotSize ? target : m_MaxSlotSize;
+}
+
+bool ShadowAtlas::Place(uint32_t light, uint32_t size)
+{
+	uint32_t nodes[SHADOW_ATLAS_NUM_CUBE_FACES];
+	Light& dest = m_Lights[light];
+	if (!m_Allocator.AllocateGroup(size, dest.NumFaces, nodes))
+	{
+		return false;
+	}
+	Release(light);
+	dest.Size = m_Allocator.RoundSize(size);
+	for (uint32_t f = 0; f < dest.NumFaces; ++f)
+	{
+		dest.Faces[f].Node = nodes[f];
+		dest.Faces[f].Drawn = false;
+		dest.Faces[f].Dirty = true;
+		dest.Faces[f].Waiting = 0;
+	}
+	return true;
+}
+
+void ShadowAtlas::Release(uint32_t light)
+{
+	Light& dest = m_Lights[light];
+	for (Face& face : dest.Faces)
+	{
+		if (face.Node != SHADOW_ATLAS_INVALID_NODE)
+		{
+			m_Allocator.Free(face.Node);
+			face.Node = SHADOW_ATLAS_INVALID_NODE;
+		}
+		face.Drawn = false;
+		face.Dirty = false;
+		face.Waiting = 0;
+	}
+	dest.Size = 0;
+}
+
+#ifdef SHADOW_ATLAS_TEST
+static bool ShadowAtlasSlotsOverlap(const ShadowAtlasSlot& lhs, const ShadowAtlasSlot& rhs)
+{
+	return lhs.X < rhs.X + rhs.Size && rhs.X < lhs.X + lhs.Size && lhs.Y < rhs.Y + rhs.Size && rhs.Y < lhs.Y + lhs.Size;
+}
+
+static void TestShadowAtlasAllocator(void)
+{
+	ShadowAtlasAllocator allocator;
+	allocator.Init(1024, 64);
+	assert(allocator.GetMinSlotSize() == 64);
+	assert(allocator.RoundSize(1) == 64 && allocator.RoundSize(65) == 128 && allocator.RoundSize(5000) == 1024);
+
+	const uint32_t root = allocator.Allocate(1024);
+	assert(root != SHADOW_ATLAS_INVALID_NODE && allocator.GetUsage() == 1.0f);
+	assert(allocator.Allocate(64) == SHADOW_ATLAS_INVALID_NODE);
+	allocator.Free(root);
+	assert(allocator.GetUsage() == 0.0f);
+
+	// four quarters fill the atlas without overlapping
+	uint32_t quarters[4];
+	assert(allocator.AllocateGroup(512, 4, quarters));
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		const ShadowAtlasSlot slot = allocator.GetSlot(quarters[i]);
+		assert(slot.Size == 512 && slot.X + slot.Size <= 1024 && slot.Y + slot.Size <= 1024);
+		for (uint32_t j = 0; j < i; ++j)
+		{
+			assert(!ShadowAtlasSlotsOverlap(slot, allocator.GetSlot(quarters[j])));
+		}
+	}
+	assert(allocator.Allocate(512) == SHADOW_ATLAS_INVALID_NODE);
+
+	// a freed quarter is split again, and the six faces of a cube take two of its children next to each other
+	allocator.Free(quarters[2]);
+	const ShadowAtlasSlot quarter = allocator.GetSlot(quarters[2]);
+	uint32_t faces[SHADOW_ATLAS_NUM_CUBE_FACES];
+	assert(allocator.AllocateGroup(128, SHADOW_ATLAS_NUM_CUBE_FACES, faces));
+	for (uint32_t f = 0; f < SHADOW_ATLAS_NUM_CUBE_FACES; ++f)
+	{
+		const ShadowAtlasSlot slot = allocator.GetSlot(faces[f]);
+		assert(slot.Size == 128 && ShadowAtlasSlotsOverlap(slot, quarter));
+		assert(slot.X >= quarter.X && slot.X < quarter.X + 512 && slot.Y >= quarter.Y && slot.Y < quarter.Y + 256);
+	}
+	// a group that does not fit leaves nothing behind
+	const float usage = allocator.GetUsage();
+	uint32_t big[4];
+	assert(!allocator.AllocateGroup(256, 4, big));
+	assert(allocator.GetUsage() == usage);
+
+	// freeing everything merges back to the root
+	for (uint32_t f = 0; f < SHADOW_ATLAS_NUM_CUBE_FACES; ++f)
+	{
+		allocator.Free(faces[f]);
+	}
+	allocator.Free(quarters[0]);
+	allocator.Free(quarters[1]);
+	allocator.Free(quarters[3]);
+	assert(allocator.GetUsage() == 0.0f);
+	assert(allocator.Allocate(1024) != SHADOW_ATLAS_INVALID_NODE);
+}
+
+static void TestShadowAtlasAllocatorRandom(void)
+{
+	ShadowAtlasAllocator allocator;
+	allocator.Init(2048, 32);
+	std::vector<uint32_t> nodes;
+	uint64_t usedTexels = 0;
+	uint32_t seed = 7;
+	for (uint32_t step = 0; step < 4000; ++step)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		if ((seed >> 28) < 9 || nodes.empty())
+		{
+			const uint32_t size = 32u << ((seed >> 8) % 5);
+			const uint32_t node = allocator.Allocate(size);
+			if (node != SHADOW_ATLAS_INVALID_NODE)
+			{
+				nodes.push_back(node);
+				usedTexels += (uint64_t)size * size;
+			}
+		}
+		else
+		{
+			const size_t index = (seed >> 8) % nodes.size();
+			const uint32_t size = allocator.GetSlot(nodes[index]).Size;
+			allocator.Free(nodes[index]);
+			usedTexels -= (uint64_t)size * size;
+			nodes[index] = nodes.back();
+			nodes.pop_back();
+		}
+		assert(fabsf(allocator.GetUsage() - (float)((double)usedTexels / (2048.0 * 2048.0))) < 0.0001f);
+	}
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		for (size_t j = 0; j < i; ++j)
+		{
+			assert(!ShadowAtlasSlotsOverlap(allocator.GetSlot(nodes[i]), allocator.GetSlot(nodes[j])));
+		}
+	}
+	for (uint32_t node : nodes)
+	{
+		allocator.Free(node);
+	}
+	assert(allocator.Allocate(2048) != SHADOW_ATLAS_INVALID_NODE);
+}
+
+static void TestShadowAtlasImportance(void)
+{
+	const Vec3D eye = { 0.0f, 0.0f, 0.0f };
+	const Vec3D at = { 0.0f, 0.0f, 1.0f };
+	const Vec3D up = { 0.0f, 1.0f, 0.0f };
+	const float fov = MathToRadians(90.0f);
+	const Mat4X4 view = MathMat4X4ViewAt(&eye, &at, &up);
+	const Mat4X4 proj = MathMat4X4PerspectiveFov(fov, 1.0f, 0.1f, 100.0f);
+	const Mat4X4 viewProj = MathMat4X4MultMat4X4ByMat4X4(&view, &proj);
+	const Frustum frustum = MathFrustumFromMat4X4(&viewProj);
+
+	const Vec3D near = { 0.0f, 0.0f, 10.0f };
+	const Vec3D far = { 0.0f, 0.0f, 40.0f };
+	const Vec3D behind = { 0.0f, 0.0f, -10.0f };
+	const float nearImportance = ShadowAtlasLightImportance(near, 2.0f, eye, frustum, fov, 1000);
+	const float farImportance = ShadowAtlasLightImportance(far, 2.0f, eye, frustum, fov, 1000);
+	// a range of 2 at 8 units from the sphere covers a quarter of a screen spanning 8 units either way
+	assert(fabsf(nearImportance - 250.0f) < 0.001f);
+	assert(farImportance > 0.0f && farImportance < nearImportance);
+	assert(ShadowAtlasLightImportance(near, 4.0f, eye, frustum, fov, 1000) > nearImportance);
+	assert(ShadowAtlasLightImportance(behind, 2.0f, eye, frustum, fov, 1000) == 0.0f);
+	assert(ShadowAtlasLightImportance(near, 0.0f, eye, frustum, fov, 1000) == 0.0f);
+	// the eye inside the range, and a light behind whose range reaches into view
+	assert(ShadowAtlasLightImportance(behind, 20.0f, eye, frustum, fov, 1000) == 1000.0f);
+
+	assert(ShadowAtlasFaceSize(256.0f, 1) == 256.0f);
+	assert(ShadowAtlasFaceSize(256.0f, SHADOW_ATLAS_NUM_CUBE_FACES) == 128.0f);
+}
+
+static void TestShadowAtlasPlan(void)
+{
+	ShadowAtlas atlas;
+	atlas.Init(1024, 64, 512, 8);
+
+	// a spot light and a point light, the spot light matters more
+	ShadowAtlasLight lights[3] = { { 1, false }, { SHADOW_ATLAS_NUM_CUBE_FACES, false }, { 1, false } };
+	float importance[3] = { 600.0f, 300.0f, 0.0f };
+	atlas.Update(lights, importance, 3);
+	assert(atlas.GetSlotSize(0) == 512);
+	assert(atlas.GetSlotSize(1) == 128);
+	assert(atlas.GetSlotSize(2) == 0);
+	// seven faces fit the budget of eight, the spot light first
+	assert(atlas.GetRenders().size() == 7 && atlas.GetNumPending() == 0);
+	assert(atlas.GetRenders()[0].Light == 0);
+	ShadowAtlasSlot slot;
+	for (uint32_t f = 0; f < SHADOW_ATLAS_NUM_CUBE_FACES; ++f)
+	{
+		assert(atlas.GetSlot(1, f, &slot) && slot.Size == 128);
+	}
+	assert(!atlas.GetSlot(2, 0, &slot));
+
+	// nothing changed, nothing is drawn
+	atlas.Update(lights, importance, 3);
+	assert(atlas.GetRenders().empty());
+
+	// a small change of importance keeps the slot, a big one moves the light
+	importance[0] = 500.0f;
+	atlas.Update(lights, importance, 3);
+	assert(atlas.GetSlotSize(0) == 512 && atlas.GetRenders().empty());
+	importance[0] = 200.0f;
+	atlas.Update(lights, importance, 3);
+	assert(atlas.GetSlotSize(0) == 256 && atlas.GetRenders().size() == 1);
+
+	// a changed light is drawn again in place
+	atlas.GetSlot(1, 3, &slot);
+	lights[1].Changed = true;
+	atlas.Update(lights, importance, 3);
+	lights[1].Changed = false;
+	assert(atlas.GetRenders().size() == SHADOW_ATLAS_NUM_CUBE_FACES);
+	ShadowAtlasSlot again;
+	assert(atlas.GetSlot(1, 3, &again) && again.X == slot.X && again.Y == slot.Y);
+
+	// a light out of view gives its slots back
+	importance[1] = 0.0f;
+	atlas.Update(lights, importance, 3);
+	assert(atlas.GetSlotSize(1) == 0 && !atlas.GetSlot(1, 0, &slot));
+	assert(fabsf(atlas.GetUsage() - 0.0625f) < 0.0001f);
+}
+
+static void TestShadowAtlasPressure(void)
+{
+	ShadowAtlas atlas;
+	atlas.Init(512, 64, 256, 2);
+
+	// four lights fill the atlas
+	ShadowAtlasLight lights[5] = {};
+	float importance[5] = {};
+	for (uint32_t i = 0; i < 5; ++i)
+	{
+		lights[i].NumFaces = 1;
+		importance[i] = i < 4 ? 256.0f - (float)i : 0.0f;
+	}
+	atlas.Update(lights, importance, 5);
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		assert(atlas.GetSlotSize(i) == 256);
+	}
+	assert(atlas.GetUsage() == 1.0f);
+	// only two faces per frame, the rest waits
+	assert(atlas.GetRenders().size() == 2 && atlas.GetNumPending() == 2);
+	atlas.Update(lights, importance, 5);
+	assert(atlas.GetRenders().size() == 2 && atlas.GetNumPending() == 0);
+
+	// the new light matters most and takes the slot of the least important one
+	importance[4] = 1000.0f;
+	atlas.Update(lights, importance, 5);
+	assert(atlas.GetSlotSize(4) == 256);
+	assert(atlas.GetSlotSize(3) == 0);
+	assert(atlas.GetRenders().size() == 1 && atlas.GetRenders()[0].Light == 4);
+
+	// a light whose faces keep changing does not starve the others
+	importance[3] = 0.0f;
+	atlas.Update(lights, importance, 5);
+	lights[4].Changed = true;
+	lights[0].Changed = true;
+	lights[2].Changed = true;
+	uint32_t drawn[5] = {};
+	for (uint32_t frame = 0; frame < 8; ++frame)
+	{
+		atlas.Update(lights, importance, 5);
+		for (const ShadowAtlasRender& render : atlas.GetRenders())
+		{
+			++drawn[render.Light];
+		}
+	}
+	assert(drawn[2] >= 2 && drawn[4] >= drawn[2]);
+}
+
+void ShadowAtlasTest(void)
+{
+	TestShadowAtlasAllocator();
+	TestShadowAtlasAllocatorRandom();
+	TestShadowAtlasImportance();
+	TestShadowAtlasPlan();
+	TestShadowAtlasPressure();
+}
+#endif
+
+#ifdef SHADOW_ATLAS_BENCHMARK
+#include <chrono>
+
+void ShadowAtlasBenchmark(void)
+{
+	const uint32_t numFrames = 64;
+	const uint32_t counts[] = { 100, 300, 1000 };
+	const float fov = MathToRadians(45.0f);
+	const Vec3D up = { 0.0f, 1.0f, 0.0f };
+	const Mat4X4 proj = MathMat4X4PerspectiveFov(fov, 16.0f / 9.0f, 0.1f, 100.0f);
+	for (uint32_t count : counts)
+	{
+		// lights of one to six units of range scattered over a square that grows with the count, a third of them spots
+		std::vector<Vec3D> positions(count);
+		std::vector<float> ranges(count);
+		std::vector<ShadowAtlasLight> lights(count);
+		std::vector<float> importance(count);
+		const float side = sqrtf((float)count) * 6.0f;
+		uint32_t seed = 1;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			float values[4];
+			for (float& value : values)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				value = (float)(seed >> 8) / (float)(1 << 24);
+			}
+			positions[i] = MathVec3DFromXYZ((values[0] - 0.5f) * side, 1.0f + values[1] * 4.0f, (values[2] - 0.5f) * side);
+			ranges[i] = 1.0f + values[3] * 5.0f;
+			lights[i].NumFaces = i % 3 ? SHADOW_ATLAS_NUM_CUBE_FACES : 1;
+		}
+
+		ShadowAtlas atlas;
+		atlas.Init(4096, 64, 1024, 32);
+		size_t numRenders = 0;
+		double scoreSeconds = 0.0;
+		double planSeconds = 0.0;
+		for (uint32_t frame = 0; frame < numFrames; ++frame)
+		{
+			// the camera circles the middle of the scene, every eighth light changes each frame
+			const float angle = (float)frame * 0.05f;
+			const Vec3D eye = { cosf(angle) * 20.0f, 5.0f, sinf(angle) * 20.0f };
+			const Vec3D at = { 0.0f, 0.0f, 0.0f };
+			const Mat4X4 view = MathMat4X4ViewAt(&eye, &at, &up);
+			const Mat4X4 viewProj = MathMat4X4MultMat4X4ByMat4X4(&view, &proj);
+			const Frustum frustum = MathFrustumFromMat4X4(&viewProj);
+
+			auto start = std::chrono::steady_clock::now();
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				importance[i] = ShadowAtlasLightImportance(positions[i], ranges[i], eye, frustum, fov, 1080);
+				lights[i].Changed = (i + frame) % 8 == 0;
+			}
+			auto end = std::chrono::steady_clock::now();
+			scoreSeconds += std::chrono::duration<double>(end - start).count();
+
+			start = end;
+			atlas.Update(lights.data(), importance.data(), count);
+			planSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			numRenders += atlas.GetRenders().size();
+		}
+
+		UtilsDebugPrint("Shadow atlas: %u lights, score %.3f ms, plan %.3f ms per frame, %.1f faces drawn per frame, %.2f used\n",
+			count,
+			scoreSeconds * 1000.0 / numFrames,
+			planSeconds * 1000.0 / numFrames,
+			(double)numRenders / numFrames,
+			atlas.GetUsage());
+		atlas.PrintStats();
+	}
+}
+#endif
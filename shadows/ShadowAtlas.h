@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Math.h"
+
+// Point lights draw their shadows into six cube faces, spot lights into one
+#define SHADOW_ATLAS_NUM_CUBE_FACES 6
+#define SHADOW_ATLAS_INVALID_NODE UINT32_MAX
+// A light keeps the size of its slot until the size it asks for is this many levels of the quadtree away,
+// so lights near the boundary of two sizes are not moved every frame
+#define SHADOW_ATLAS_HYSTERESIS 0.75f
+
+// Texel square of the atlas
+struct ShadowAtlasSlot
+{
+	uint32_t X;
+	uint32_t Y;
+	uint32_t Size;
+};
+
+// Quadtree over a square atlas with power of two sides. Every node is a
+// square slot that is free, used or split into four children; the nodes of
+// each level that are free are kept in a list. A request takes a free node
+// of its level, splitting bigger ones when there is none, and a freed node
+// merges back with its three siblings once they are all free.
+class ShadowAtlasAllocator
+{
+public:
+	ShadowAtlasAllocator();
+	~ShadowAtlasAllocator();
+
+	void Init(uint32_t atlasSize, uint32_t minSlotSize);
+
+	// A node of at least size texels per side, SHADOW_ATLAS_INVALID_NODE when no slot that big is free
+	uint32_t Allocate(uint32_t size);
+	// count nodes of the same size, all or none. Nodes left over by a split are handed out
+	// before anything else is split, so the faces of one light end up next to each other.
+	bool AllocateGroup(uint32_t size, uint32_t count, uint32_t* nodes);
+	void Free(uint32_t node);
+	// Frees every node
+	void Reset();
+
+	ShadowAtlasSlot GetSlot(uint32_t node) const;
+	uint32_t GetAtlasSize() const { return m_AtlasSize; }
+	uint32_t GetMinSlotSize() const { return m_AtlasSize >> (m_NumLevels - 1); }
+	// Side of the slots handed out for a request of size texels
+	uint32_t RoundSize(uint32_t size) const;
+	// Used texels over the texels of the atlas
+	float GetUsage() const;
+
+private:
+	enum NodeState : uint8_t
+	{
+		NodeAbsent,
+		NodeFree,
+		NodeSplit,
+		NodeUsed,
+	};
+
+	uint32_t GetLevel(uint32_t node) const;
+	uint32_t Take(uint32_t level);
+	void AddFree(uint32_t node, uint32_t level);
+	void RemoveFree(uint32_t node, uint32_t level);
+
+	uint32_t m_AtlasSize;
+	uint32_t m_NumLevels;
+	uint64_t m_UsedTexels;
+	// index of the first node of each level, the root is level 0
+	std::vector<uint32_t> m_LevelStarts;
+	std::vector<uint8_t> m_States;
+	// position of a free node in the free list of its level
+	std::vector<uint32_t> m_FreeIndices;
+	std::vector<std::vector<uint32_t>> m_FreeLists;
+};
+
+// Pixels the sphere of influence of a light covers on a screen screenHeight
+// pixels high, 0 when the sphere is outside the frustum or the light has no
+// range. A light the eye is inside of covers the whole screen.
+float ShadowAtlasLightImportance(const Vec3D& position, float range, const Vec3D& eye, const Frustum& frustum,
+	float verticalFov, uint32_t screenHeight);
+
+// Texels per side a face of the light should get for its importance, before
+// rounding to a slot size. The six faces of a point light share the
+// coverage of the light, so each gets half of it per side.
+float ShadowAtlasFaceSize(float importance, uint32_t numFaces);
+
+// A light that can cast shadows into the atlas
+struct ShadowAtlasLight
+{
+	// SHADOW_ATLAS_NUM_CUBE_FACES for a point light, 1 for a spot light
+	uint32_t NumFaces;
+	// the light or the casters around it moved since its faces were drawn
+	bool Changed;
+};
+
+// Face of a light to draw into the atlas this frame
+struct ShadowAtlasRender
+{
+	uint32_t Light;
+	uint32_t Face;
+	ShadowAtlasSlot Slot;
+};
+
+// Hands out the slots of a shadow atlas to the lights of a scene. Every frame
+// each light asks for faces sized after its importance, the most important
+// lights are served first and take the slots of the least important ones when
+// the atlas is full. A face has to be drawn when it got a new slot or its
+// light changed; only faceBudget faces are drawn per frame, new slots first,
+// then the changed faces by importance and how long they have been waiting.
+// Only bookkeeping happens here, the caller does the drawing.
+class ShadowAtlas
+{
+public:
+	ShadowAtlas();
+	~ShadowAtlas();
+
+	void Init(uint32_t atlasSize, uint32_t minSlotSize, uint32_t maxSlotSize, uint32_t faceBudget);
+
+	// The lights are the same ones in the same order every frame, an importance of 0 takes a light out of the atlas
+	void Update(const ShadowAtlasLight* lights, const float* importance, uint32_t numLights);
+
+	// Faces to draw this frame, at most faceBudget of them
+	const std::vector<ShadowAtlasRender>& GetRenders() const { return m_Renders; }
+	// Slot of a face of a light, false while the light has none or the face was not drawn into it yet
+	bool GetSlot(uint32_t light, uint32_t face, ShadowAtlasSlot* slot) const;
+	// Side of the slots of a light, 0 without a slot
+	uint32_t GetSlotSize(uint32_t light) const { return light < m_Lights.size() ? m_Lights[light].Size : 0; }
+	// Faces that have to be drawn but did not fit into the budget of this frame
+	uint32_t GetNumPending() const { return m_NumPending; }
+	float GetUsage() const { return m_Allocator.GetUsage(); }
+
+	void PrintStats() const;
+
+private:
+	struct Face
+	{
+		uint32_t Node;
+		bool Drawn;
+		bool Dirty;
+		uint32_t Waiting;
+	};
+
+	struct Light
+	{
+		uint32_t NumFaces;
+		uint32_t Size;
+		uint32_t Target;
+		float Importance;
+		Face Faces[SHADOW_ATLAS_NUM_CUBE_FACES];
+	};
+
+	uint32_t ComputeTarget(const Light& light, float importance) const;
+	bool Place(uint32_t light, uint32_t size);
+	void Release(uint32_t light);
+
+	ShadowAtlasAllocator m_Allocator;
+	uint32_t m_MinSlotSize;
+	uint32_t m_MaxSlotSize;
+	uint32_t m_FaceBudget;
+	std::vector<Light> m_Lights;
+	// lights by importance, most important first
+	std::vector<uint32_t> m_Order;
+	std::vector<ShadowAtlasRender> m_Renders;
+	std::vector<ShadowAtlasRender> m_Candidates;
+	uint32_t m_NumPending;
+	uint32_t m_NumFrames;
+	uint64_t m_NumDrawn;
+	uint32_t m_NumEvictions;
+};
+
+#ifdef SHADOW_ATLAS_TEST
+void ShadowAtlasTest(void);
+#endif
+
+#ifdef SHADOW_ATLAS_BENCHMARK
+// Prints the time to score hundreds of lights and plan their slots and draws per frame
+void ShadowAtlasBenchmark(void);
+#endif
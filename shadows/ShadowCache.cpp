@@ -0,0 +1,443 @@
+#include "ShadowCache.h"
+#include "Utils.h"
+
+#include <cassert>
+#include <cfloat>
+#include <cstring>
+#include <math.h>
+
+bool ShadowRectIsEmpty(const ShadowRect& rect)
+{
+	return rect.MinX >= rect.MaxX || rect.MinY >= rect.MaxY;
+}
+
+bool ShadowRectsOverlap(const ShadowRect& lhs, const ShadowRect& rhs)
+{
+	return lhs.MinX < rhs.MaxX && rhs.MinX < lhs.MaxX && lhs.MinY < rhs.MaxY && rhs.MinY < lhs.MaxY;
+}
+
+static ShadowRect ShadowRectUnion(const ShadowRect& lhs, const ShadowRect& rhs)
+{
+	ShadowRect res = {};
+	res.MinX = lhs.MinX < rhs.MinX ? lhs.MinX : rhs.MinX;
+	res.MinY = lhs.MinY < rhs.MinY ? lhs.MinY : rhs.MinY;
+	res.MaxX = lhs.MaxX > rhs.MaxX ? lhs.MaxX : rhs.MaxX;
+	res.MaxY = lhs.MaxY > rhs.MaxY ? lhs.MaxY : rhs.MaxY;
+	return res;
+}
+
+static uint64_t ShadowRectArea(const ShadowRect& rect)
+{
+	return (uint64_t)(rect.MaxX - rect.MinX) * (rect.MaxY - rect.MinY);
+}
+
+// Merges overlapping rects until none overlap, then the pair that grows the
+// least by merging until at most maxRects are left
+static void ShadowRectsMerge(std::vector<ShadowRect>* rects, uint32_t maxRects)
+{
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+		for (size_t i = 0; i < rects->size() && !merged; ++i)
+		{
+			for (size_t j = i + 1; j < rects->size(); ++j)
+			{
+				if (ShadowRectsOverlap((*rects)[i], (*rects)[j]))
+				{
+					(*rects)[i] = ShadowRectUnion((*rects)[i], (*rects)[j]);
+					(*rects)[j] = rects->back();
+					rects->pop_back();
+					merged = true;
+					break;
+				}
+			}
+		}
+	}
+
+	while (rects->size() > maxRects)
+	{
+		size_t bestI = 0;
+		size_t bestJ = 1;
+		uint64_t bestGrowth = UINT64_MAX;
+		for (size_t i = 0; i < rects->size(); ++i)
+		{
+			for (size_t j = i + 1; j < rects->size(); ++j)
+			{
+				const uint64_t growth = ShadowRectArea(ShadowRectUnion((*rects)[i], (*rects)[j])) -
+					ShadowRectArea((*rects)[i]) - ShadowRectArea((*rects)[j]);
+				if (growth < bestGrowth)
+				{
+					bestGrowth = growth;
+					bestI = i;
+					bestJ = j;
+				}
+			}
+		}
+		(*rects)[bestI] = ShadowRectUnion((*rects)[bestI], (*rects)[bestJ]);
+		(*rects)[bestJ] = rects->back();
+		rects->pop_back();
+		// the bigger rect may overlap others now
+		ShadowRectsMerge(rects, maxRects);
+	}
+}
+
+ShadowCache::ShadowCache():
+	m_MapSize{0},
+	m_FrameDrawn{0},
+	m_FrameSkipped{0},
+	m_TotalDrawn{0},
+	m_TotalSkipped{0},
+	m_NumFrames{0},
+	m_NumStaticRedraws{0}
+{
+}
+
+ShadowCache::~ShadowCache()
+{
+}
+
+void ShadowCache::Init(uint32_t numCascades, uint32_t mapSize)
+{
+	assert(numCascades > 0 && mapSize > 0);
+	m_Cascades.clear();
+	m_Cascades.resize(numCascades);
+	for (Cascade& cascade : m_Cascades)
+	{
+		cascade.Valid = false;
+		cascade.Redraw = false;
+	}
+	m_MapSize = mapSize;
+}
+
+bool ShadowCache::BeginCascade(uint32_t cascade, ShadowView* view)
+{
+	Cascade& cached = m_Cascades[cascade];
+	cached.Current.clear();
+
+	if (cached.Valid &&
+		memcmp(&cached.View.View, &view->View, sizeof(Mat4X4)) == 0 &&
+		cached.View.Proj.A00 == view->Proj.A00 && cached.View.Proj.A11 == view->Proj.A11 &&
+		cached.View.Proj.A30 == view->Proj.A30 && cached.View.Proj.A31 == view->Proj.A31)
+	{
+		float cachedNear, cachedFar, zNear, zFar;
+		ShadowViewGetDepthRange(cached.View, &cachedNear, &cachedFar);
+		ShadowViewGetDepthRange(*view, &zNear, &zFar);
+		if (cachedNear <= zNear && cachedFar >= zFar)
+		{
+			*view = cached.View;
+			cached.Redraw = false;
+			return false;
+		}
+	}
+
+	float zNear, zFar;
+	ShadowViewGetDepthRange(*view, &zNear, &zFar);
+	const float slack = (zFar - zNear) * SHADOW_CACHE_DEPTH_SLACK;
+	ShadowViewSetDepthRange(view, zNear - slack, zFar + slack);
+	cached.View = *view;
+	cached.Valid = true;
+	cached.Redraw = true;
+	++m_NumStaticRedraws;
+	return true;
+}
+
+ShadowRect ShadowCache::ComputeRect(uint32_t cascade, const AABB& bounds) const
+{
+	const Mat4X4& viewProj = m_Cascades[cascade].View.ViewProj;
+	float minX = FLT_MAX;
+	float minY = FLT_MAX;
+	float maxX = -FLT_MAX;
+	float maxY = -FLT_MAX;
+	for (uint32_t corner = 0; corner < 8; ++corner)
+	{
+		const Vec4D point = {
+			corner & 1 ? bounds.Max.X : bounds.Min.X,
+			corner & 2 ? bounds.Max.Y : bounds.Min.Y,
+			corner & 4 ? bounds.Max.Z : bounds.Min.Z,
+			1.0f };
+		// orthographic, w stays 1
+		const Vec4D clip = MathMat4X4MultVec4DByMat4X4(&point, &viewProj);
+		minX = fminf(minX, clip.X);
+		minY = fminf(minY, clip.Y);
+		maxX = fmaxf(maxX, clip.X);
+		maxY = fmaxf(maxY, clip.Y);
+	}
+
+	ShadowRect rect = {};
+	if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+	{
+		return rect;
+	}
+	// texel rows run down while clip space y runs up
+	const float size = (float)m_MapSize;
+	const float margin = (float)SHADOW_CACHE_RECT_MARGIN;
+	const float left = floorf((fmaxf(minX, -1.0f) * 0.5f + 0.5f) * size) - margin;
+	const float right = ceilf((fminf(maxX, 1.0f) * 0.5f + 0.5f) * size) + margin;
+	const float top = floorf((0.5f - fminf(maxY, 1.0f) * 0.5f) * size) - margin;
+	const float bottom = ceilf((0.5f - fmaxf(minY, -1.0f) * 0.5f) * size) + margin;
+	rect.MinX = (uint32_t)fmaxf(left, 0.0f);
+	rect.MinY = (uint32_t)fmaxf(top, 0.0f);
+	rect.MaxX = (uint32_t)fminf(right, size);
+	rect.MaxY = (uint32_t)fminf(bottom, size);
+	return rect;
+}
+
+ShadowRect ShadowCache::AddDynamic(uint32_t cascade, const AABB& bounds)
+{
+	const ShadowRect rect = ComputeRect(cascade, bounds);
+	if (!ShadowRectIsEmpty(rect))
+	{
+		m_Cascades[cascade].Current.push_back(rect);
+	}
+	return rect;
+}
+
+void ShadowCache::EndCascade(uint32_t cascade)
+{
+	Cascade& cached = m_Cascades[cascade];
+	cached.Dirty.clear();
+	if (cached.Redraw)
+	{
+		const ShadowRect whole = { 0, 0, m_MapSize, m_MapSize };
+		cached.Dirty.push_back(whole);
+	}
+	else
+	{
+		// where the dynamic casters were last frame the static layer shows again
+		cached.Dirty.insert(cached.Dirty.end(), cached.Current.begin(), cached.Current.end());
+		cached.Dirty.insert(cached.Dirty.end(), cached.Previous.begin(), cached.Previous.end());
+		ShadowRectsMerge(&cached.Dirty, SHADOW_CACHE_MAX_RECTS);
+	}
+	cached.Previous.swap(cached.Current);
+}
+
+void ShadowCache::Invalidate()
+{
+	for (Cascade& cascade : m_Cascades)
+	{
+		cascade.Valid = false;
+	}
+}
+
+float ShadowCache::GetDirtyFraction() const
+{
+	uint64_t dirty = 0;
+	for (const Cascade& cascade : m_Cascades)
+	{
+		for (const ShadowRect& rect : cascade.Dirty)
+		{
+			dirty += ShadowRectArea(rect);
+		}
+	}
+	return (float)((double)dirty / ((double)m_MapSize * m_MapSize * m_Cascades.size()));
+}
+
+void ShadowCache::CountDraws(uint32_t numCasters, uint32_t numDrawn)
+{
+	m_FrameDrawn += numDrawn;
+	m_TotalDrawn += numDrawn;
+	if (numCasters > numDrawn)
+	{
+		m_FrameSkipped += numCasters - numDrawn;
+		m_TotalSkipped += numCasters - numDrawn;
+	}
+}
+
+void ShadowCache::BeginFrame()
+{
+	m_FrameDrawn = 0;
+	m_FrameSkipped = 0;
+	++m_NumFrames;
+}
+
+void ShadowCache::PrintStats() const
+{
+	UtilsDebugPrint("Shadow cache: %u frames, %u static layer redraws, %llu caster draws, %llu skipped\n",
+		m_NumFrames,
+		m_NumStaticRedraws,
+		m_TotalDrawn,
+		m_TotalSkipped);
+}
+
+#ifdef SHADOW_CACHE_TEST
+#include <algorithm>
+
+static bool ShadowCacheCovers(const std::vector<ShadowRect>& rects, const ShadowRect& rect)
+{
+	for (const ShadowRect& dirty : rects)
+	{
+		if (dirty.MinX <= rect.MinX && dirty.MinY <= rect.MinY && dirty.MaxX >= rect.MaxX && dirty.MaxY >= rect.MaxY)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// World x and y map straight onto a 16 x 16 unit map, so a unit is 16 texels of a 256 texel map
+static ShadowView ShadowCacheTestView(float zNear, float zFar)
+{
+	ShadowView view;
+	view.View = MathMat4X4Identity();
+	view.Proj = MathMat4X4OrthographicOffCenter(-8.0f, 8.0f, -8.0f, 8.0f, zNear, zFar);
+	view.ViewProj = MathMat4X4MultMat4X4ByMat4X4(&view.View, &view.Proj);
+	view.CasterFrustum = MathFrustumFromMat4X4(&view.ViewProj);
+	return view;
+}
+
+static void TestShadowCacheRects(void)
+{
+	const ShadowRect a = { 0, 0, 10, 10 };
+	const ShadowRect b = { 10, 0, 20, 10 };
+	const ShadowRect c = { 5, 5, 15, 15 };
+	const ShadowRect empty = { 4, 4, 4, 8 };
+	assert(!ShadowRectsOverlap(a, b));
+	assert(ShadowRectsOverlap(a, c) && ShadowRectsOverlap(b, c));
+	assert(ShadowRectIsEmpty(empty) && !ShadowRectIsEmpty(a));
+
+	std::vector<ShadowRect> rects = { a, b, c };
+	ShadowRectsMerge(&rects, SHADOW_CACHE_MAX_RECTS);
+	assert(rects.size() == 1);
+	assert(rects[0].MinX == 0 && rects[0].MinY == 0 && rects[0].MaxX == 20 && rects[0].MaxY == 15);
+
+	// the two close ones merge first
+	std::vector<ShadowRect> spread = { {0, 0, 4, 4}, {6, 0, 10, 4}, {100, 100, 104, 104}, {200, 0, 204, 4}, {0, 200, 4, 204} };
+	const std::vector<ShadowRect> sources = spread;
+	ShadowRectsMerge(&spread, 4);
+	assert(spread.size() == 4);
+	for (const ShadowRect& source : sources)
+	{
+		assert(ShadowCacheCovers(spread, source));
+	}
+	assert(std::find_if(spread.begin(), spread.end(), [](const ShadowRect& r) { return r.MinX == 0 && r.MaxX == 10 && r.MaxY == 4; }) != spread.end());
+}
+
+static void TestShadowCacheDirty(void)
+{
+	ShadowCache cache;
+	cache.Init(2, 256);
+
+	// the first frame draws everything
+	ShadowView view = ShadowCacheTestView(0.0f, 10.0f);
+	cache.BeginFrame();
+	assert(cache.BeginCascade(0, &view));
+	cache.EndCascade(0);
+	assert(cache.GetDirtyRects(0).size() == 1);
+	assert(cache.GetDirtyRects(0)[0].MaxX == 256 && cache.GetDirtyRects(0)[0].MaxY == 256);
+	// the cached view got slack around the fitted depth range
+	float zNear, zFar;
+	ShadowViewGetDepthRange(view, &zNear, &zFar);
+	assert(fabsf(zNear + 1.0f) < 0.001f && fabsf(zFar - 11.0f) < 0.001f);
+
+	// same view and nothing moving, nothing to draw
+	ShadowView same = ShadowCacheTestView(0.0f, 10.0f);
+	assert(!cache.BeginCascade(0, &same));
+	cache.EndCascade(0);
+	assert(cache.GetDirtyRects(0).empty());
+	assert(memcmp(&same.ViewProj, &view.ViewProj, sizeof(Mat4X4)) == 0);
+
+	// a tighter depth range reuses the cached view
+	ShadowView tighter = ShadowCacheTestView(2.0f, 9.0f);
+	assert(!cache.BeginCascade(0, &tighter));
+	assert(tighter.Proj.A22 == view.Proj.A22 && tighter.Proj.A32 == view.Proj.A32);
+
+	// a dynamic caster over [0, 1] x [0, 1] covers texels [128, 144) x [112, 128) plus the margin
+	const AABB box = { {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 2.0f} };
+	const ShadowRect rect = cache.AddDynamic(0, box);
+	assert(rect.MinX == 127 && rect.MaxX == 145 && rect.MinY == 111 && rect.MaxY == 129);
+	cache.EndCascade(0);
+	assert(cache.GetDirtyRects(0).size() == 1 && ShadowCacheCovers(cache.GetDirtyRects(0), rect));
+
+	// moving far away dirties both the old and the new place
+	same = ShadowCacheTestView(0.0f, 10.0f);
+	assert(!cache.BeginCascade(0, &same));
+	const AABB moved = { {-6.0f, -6.0f, 1.0f}, {-5.0f, -5.0f, 2.0f} };
+	const ShadowRect movedRect = cache.AddDynamic(0, moved);
+	cache.EndCascade(0);
+	assert(cache.GetDirtyRects(0).size() == 2);
+	assert(ShadowCacheCovers(cache.GetDirtyRects(0), rect) && ShadowCacheCovers(cache.GetDirtyRects(0), movedRect));
+
+	// gone from the cascade, only its last place is restored
+	same = ShadowCacheTestView(0.0f, 10.0f);
+	assert(!cache.BeginCascade(0, &same));
+	cache.EndCascade(0);
+	assert(cache.GetDirtyRects(0).size() == 1 && ShadowCacheCovers(cache.GetDirtyRects(0), movedRect));
+	assert(!ShadowCacheCovers(cache.GetDirtyRects(0), rect));
+
+	// outside the map nothing is dirty, across its edge the rect is clamped
+	same = ShadowCacheTestView(0.0f, 10.0f);
+	assert(!cache.BeginCascade(0, &same));
+	const AABB outside = { {20.0f, 0.0f, 1.0f}, {21.0f, 1.0f, 2.0f} };
+	assert(ShadowRectIsEmpty(cache.AddDynamic(0, outside)));
+	const AABB edge = { {7.5f, 7.5f, 1.0f}, {9.0f, 9.0f, 2.0f} };
+	const ShadowRect edgeRect = cache.AddDynamic(0, edge);
+	assert(edgeRect.MinX == 247 && edgeRect.MaxX == 256 && edgeRect.MinY == 0 && edgeRect.MaxY == 9);
+	cache.EndCascade(0);
+
+	// many casters stay within the rect limit and keep being covered
+	same = ShadowCacheTestView(0.0f, 10.0f);
+	assert(!cache.BeginCascade(0, &same));
+	std::vector<ShadowRect> props;
+	for (uint32_t i = 0; i < 12; ++i)
+	{
+		const float x = -7.0f + (float)i * 1.2f;
+		const AABB prop = { {x, -7.0f + (float)(i % 3) * 5.0f, 0.0f}, {x + 0.25f, -6.75f + (float)(i % 3) * 5.0f, 1.0f} };
+		props.push_back(cache.AddDynamic(0, prop));
+	}
+	cache.EndCascade(0);
+	assert(cache.GetDirtyRects(0).size() <= SHADOW_CACHE_MAX_RECTS);
+	for (const ShadowRect& prop : props)
+	{
+		assert(ShadowCacheCovers(cache.GetDirtyRects(0), prop));
+	}
+	assert(cache.GetDirtyFraction() > 0.0f && cache.GetDirtyFraction() < 0.5f);
+
+	// moved sides or a range the cache does not hold redraw the static layer
+	ShadowView shifted = ShadowCacheTestView(0.0f, 10.0f);
+	shifted.Proj.A30 = 0.125f;
+	assert(cache.BeginCascade(0, &shifted));
+	cache.EndCascade(0);
+	assert(cache.GetDirtyRects(0).size() == 1 && cache.GetDirtyRects(0)[0].MaxX == 256);
+	ShadowView deeper = ShadowCacheTestView(0.0f, 10.0f);
+	deeper.Proj.A30 = 0.125f;
+	ShadowViewSetDepthRange(&deeper, -5.0f, 10.0f);
+	assert(cache.BeginCascade(0, &deeper));
+	cache.EndCascade(0);
+
+	// cascades are tracked apart, invalidation hits all of them
+	ShadowView other = ShadowCacheTestView(0.0f, 4.0f);
+	assert(cache.BeginCascade(1, &other));
+	cache.EndCascade(1);
+	other = ShadowCacheTestView(0.0f, 4.0f);
+	assert(!cache.BeginCascade(1, &other));
+	cache.EndCascade(1);
+	cache.Invalidate();
+	other = ShadowCacheTestView(0.0f, 4.0f);
+	assert(cache.BeginCascade(1, &other));
+	cache.EndCascade(1);
+}
+
+static void TestShadowCacheStats(void)
+{
+	ShadowCache cache;
+	cache.Init(1, 64);
+	cache.BeginFrame();
+	cache.CountDraws(10, 10);
+	assert(cache.GetNumDrawn() == 10 && cache.GetNumSkipped() == 0);
+	cache.BeginFrame();
+	cache.CountDraws(10, 2);
+	cache.CountDraws(5, 0);
+	assert(cache.GetNumDrawn() == 2 && cache.GetNumSkipped() == 13);
+	assert(cache.GetTotalSkipped() == 13);
+	cache.BeginFrame();
+	assert(cache.GetNumDrawn() == 0 && cache.GetNumSkipped() == 0 && cache.GetTotalSkipped() == 13);
+}
+
+void ShadowCacheTest(void)
+{
+	TestShadowCacheRects();
+	TestShadowCacheDirty();
+	TestShadowCacheStats();
+}
+#endif
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Math.h"
+#include "ShadowView.h"
+
+// Beyond this many dirty rects per cascade the closest ones are merged, each rect is a pass of its own
+#define SHADOW_CACHE_MAX_RECTS 4
+// texels added around the rect of a caster, covers rasterization rounding and the depth bias
+#define SHADOW_CACHE_RECT_MARGIN 1
+// fraction of its depth range a new cached view adds on either side, so small changes keep reusing it
+#define SHADOW_CACHE_DEPTH_SLACK 0.1f
+
+// Texel rect of a shadow map, Max is exclusive
+struct ShadowRect
+{
+	uint32_t MinX;
+	uint32_t MinY;
+	uint32_t MaxX;
+	uint32_t MaxY;
+};
+
+bool ShadowRectIsEmpty(const ShadowRect& rect);
+bool ShadowRectsOverlap(const ShadowRect& lhs, const ShadowRect& rhs);
+
+// Keeps track of what in the shadow map of each cascade is still valid.
+// Static casters are drawn into a static layer once, the live map is that
+// layer plus the dynamic casters. As long as the view of a cascade does not
+// change, only the rects the dynamic casters cover this frame or covered
+// the frame before are dirty: they are restored from the static layer and
+// the dynamic casters are drawn into them again. A view that changed, or a
+// static caster that moved, has the static layer redrawn and the whole map
+// dirty. Only bookkeeping happens here, the caller does the drawing.
+class ShadowCache
+{
+public:
+	ShadowCache();
+	~ShadowCache();
+
+	void Init(uint32_t numCascades, uint32_t mapSize);
+
+	// Starts the frame of a cascade with the view fitted for it. If the cached
+	// view has the same sides and its depth range holds the fitted one, it
+	// replaces the fitted view and the static layer stays. Otherwise the
+	// fitted view gets some depth slack, becomes the cached view and true is
+	// returned: the static layer has to be redrawn this frame.
+	bool BeginCascade(uint32_t cascade, ShadowView* view);
+	// A dynamic caster drawn into the cascade this frame, returns its texel rect
+	ShadowRect AddDynamic(uint32_t cascade, const AABB& bounds);
+	// Builds the dirty rects out of the dynamic casters of this and the last frame
+	void EndCascade(uint32_t cascade);
+	// A static caster changed, every static layer is redrawn next frame
+	void Invalidate();
+
+	// Texel rect the bounds cover in the cached view, empty if they are outside the map
+	ShadowRect ComputeRect(uint32_t cascade, const AABB& bounds) const;
+	// Rects of the live map to restore and redraw, the whole map when the static layer was redrawn
+	const std::vector<ShadowRect>& GetDirtyRects(uint32_t cascade) const { return m_Cascades[cascade].Dirty; }
+	// Dirty texels over the texels of all cascades this frame
+	float GetDirtyFraction() const;
+
+	// Caster draws a pass without the cache would have done and the ones it did
+	void CountDraws(uint32_t numCasters, uint32_t numDrawn);
+	void BeginFrame();
+	uint32_t GetNumDrawn() const { return m_FrameDrawn; }
+	uint32_t GetNumSkipped() const { return m_FrameSkipped; }
+	uint64_t GetTotalSkipped() const { return m_TotalSkipped; }
+	uint32_t GetNumStaticRedraws() const { return m_NumStaticRedraws; }
+
+	void PrintStats() const;
+
+private:
+	struct Cascade
+	{
+		ShadowView View;
+		bool Valid;
+		bool Redraw;
+		std::vector<ShadowRect> Current;
+		std::vector<ShadowRect> Previous;
+		std::vector<ShadowRect> Dirty;
+	};
+
+	std::vector<Cascade> m_Cascades;
+	uint32_t m_MapSize;
+	uint32_t m_FrameDrawn;
+	uint32_t m_FrameSkipped;
+	uint64_t m_TotalDrawn;
+	uint64_t m_TotalSkipped;
+	uint32_t m_NumFrames;
+	uint32_t m_NumStaticRedraws;
+};
+
+#ifdef SHADOW_CACHE_TEST
+void ShadowCacheTest(void);
+#endif
@@ -9,38 +9,63 @@ ShadowMap::~ShadowMap()
 {
 }
 
-void ShadowMap::InitResources(ID3D11Device* device, uint32_t texWidth, uint32_t texHeight)
+// Depth texture array with a DSV per slice, srvs gets a view of the whole array or one per slice
+static void ShadowMapCreateLayer(ID3D11Device* device, uint32_t texWidth, uint32_t texHeight, uint32_t numCascades,
+	bool srvPerSlice,
+	ID3D11Texture2D** texture,
+	std::vector<Microsoft::WRL::ComPtr<ID3D11DepthStencilView>>* dsvs,
+	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>>* srvs)
 {
 	D3D11_TEXTURE2D_DESC texDesc = {};
 	texDesc.Format = DXGI_FORMAT_R24G8_TYPELESS;
 	texDesc.Width = texWidth;
 	texDesc.Height = texHeight;
-	texDesc.ArraySize = 1;
+	texDesc.ArraySize = numCascades;
 	texDesc.MipLevels = 1;
 	texDesc.SampleDesc.Count = 1;
 	texDesc.SampleDesc.Quality = 0;
 	texDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 
-	ID3D11Texture2D* depthTex;
-	HR(device->CreateTexture2D( &texDesc, NULL, &depthTex))
+	HR(device->CreateTexture2D( &texDesc, NULL, texture))
 
-	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
-	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	dsvDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+	dsvs->resize(numCascades);
+	for (uint32_t cascade = 0; cascade < numCascades; ++cascade)
+	{
+		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+		dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		dsvDesc.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
+		dsvDesc.Texture2DArray.MipSlice = 0;
+		dsvDesc.Texture2DArray.FirstArraySlice = cascade;
+		dsvDesc.Texture2DArray.ArraySize = 1;
 
-	HR(device->CreateDepthStencilView( depthTex, &dsvDesc,
-		m_pOutputTextureDSV.ReleaseAndGetAddressOf()))
+		HR(device->CreateDepthStencilView( *texture, &dsvDesc,
+			(*dsvs)[cascade].ReleaseAndGetAddressOf()))
+	}
 
-	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
-	srvDesc.Texture2D.MipLevels = 1;
-	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvs->resize(srvPerSlice ? numCascades : 1);
+	for (uint32_t i = 0; i < srvs->size(); ++i)
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+		srvDesc.Texture2DArray.MipLevels = 1;
+		srvDesc.Texture2DArray.MostDetailedMip = 0;
+		srvDesc.Texture2DArray.FirstArraySlice = srvPerSlice ? i : 0;
+		srvDesc.Texture2DArray.ArraySize = srvPerSlice ? 1 : numCascades;
 
-	HR(device->CreateShaderResourceView( depthTex, &srvDesc,
-		m_pOutputTextureSRV.ReleaseAndGetAddressOf()))
+		HR(device->CreateShaderResourceView( *texture, &srvDesc,
+			(*srvs)[i].ReleaseAndGetAddressOf()))
+	}
+}
 
-	COM_FREE(depthTex);
+void ShadowMap::InitResources(ID3D11Device* device, uint32_t texWidth, uint32_t texHeight, uint32_t numCascades)
+{
+	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> liveSRVs;
+	ShadowMapCreateLayer(device, texWidth, texHeight, numCascades, false,
+		m_LiveTexture.ReleaseAndGetAddressOf(), &m_CascadeDSVs, &liveSRVs);
+	m_pOutputTextureSRV = liveSRVs[0];
+	ShadowMapCreateLayer(device, texWidth, texHeight, numCascades, true,
+		m_StaticTexture.ReleaseAndGetAddressOf(), &m_StaticDSVs, &m_StaticSRVs);
 
 	m_OutputViewPort.TopLeftX = 0.0f;
 	m_OutputViewPort.TopLeftY = 0.0f;
@@ -48,11 +73,89 @@ void ShadowMap::InitResources(ID3D11Device* device, uint32_t texWidth, uint32_t
 	m_OutputViewPort.Height = (float)texHeight;
 	m_OutputViewPort.MinDepth = 0.0f;
 	m_OutputViewPort.MaxDepth = 1.0f;
+
+	D3D11_RASTERIZER_DESC rasterizerDesc = {};
+	rasterizerDesc.FillMode = D3D11_FILL_SOLID;
+	rasterizerDesc.CullMode = D3D11_CULL_BACK;
+	rasterizerDesc.DepthBias = SHADOW_MAP_DEPTH_BIAS;
+	rasterizerDesc.SlopeScaledDepthBias = SHADOW_MAP_SLOPE_SCALED_DEPTH_BIAS;
+	// dynamic casters are only redrawn inside the dirty rects
+	rasterizerDesc.ScissorEnable = TRUE;
+	HR(device->CreateRasterizerState(&rasterizerDesc, m_RasterizerState.ReleaseAndGetAddressOf()))
+
+	// outside the map the border depth of 1 passes every comparison, so nothing is shadowed there
+	D3D11_SAMPLER_DESC samplerDesc = {};
+	samplerDesc.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_BORDER;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_BORDER;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_BORDER;
+	samplerDesc.BorderColor[0] = 1.0f;
+	samplerDesc.BorderColor[1] = 1.0f;
+	samplerDesc.BorderColor[2] = 1.0f;
+	samplerDesc.BorderColor[3] = 1.0f;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_LESS_EQUAL;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+	HR(device->CreateSamplerState(&samplerDesc, m_ComparisonSampler.ReleaseAndGetAddressOf()))
+
+	// the restore pass overwrites whatever the live map holds inside a rect
+	D3D11_DEPTH_STENCIL_DESC depthDesc = {};
+	depthDesc.DepthEnable = TRUE;
+	depthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	depthDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+	HR(device->CreateDepthStencilState(&depthDesc, m_RestoreDepthState.ReleaseAndGetAddressOf()))
+}
+
+// The atlas is a single slice. It is never cleared whole, a slot is cleared before a face is drawn into it
+// and nothing samples a slot before that.
+void ShadowMap::InitAtlas(ID3D11Device* device, uint32_t atlasSize)
+{
+	std::vector<Microsoft::WRL::ComPtr<ID3D11DepthStencilView>> dsvs;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> srvs;
+	ShadowMapCreateLayer(device, atlasSize, atlasSize, 1, false, m_AtlasTexture.ReleaseAndGetAddressOf(), &dsvs, &srvs);
+	m_AtlasDSV = dsvs[0];
+	m_AtlasSRV = srvs[0];
+}
+
+// Still bound from the lit pass of the last frame, or from restoring another cascade
+static void ShadowMapUnbind(ID3D11DeviceContext* ctx)
+{
+	ID3D11ShaderResourceView* nullSRV = nullptr;
+	ctx->PSSetShaderResources(SHADOW_MAP_SRV_SLOT, 1, &nullSRV);
+	ctx->PSSetShaderResources(SHADOW_MAP_ATLAS_SRV_SLOT, 1, &nullSRV);
+	ctx->PSSetShaderResources(SHADOW_MAP_STATIC_SRV_SLOT, 1, &nullSRV);
 }
 
-void ShadowMap::Bind(ID3D11DeviceContext* ctx)
+void ShadowMap::BindStatic(ID3D11DeviceContext* ctx, uint32_t cascade)
 {
-	ctx->ClearDepthStencilView(m_pOutputTextureDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
-	ctx->OMSetRenderTargets(0, 0, m_pOutputTextureDSV.Get());
+	ShadowMapUnbind(ctx);
+	ID3D11DepthStencilView* dsv = m_StaticDSVs[cascade].Get();
+	ctx->ClearDepthStencilView(dsv, D3D11_CLEAR_DEPTH, 1.0f, 0);
+	ctx->OMSetRenderTargets(0, 0, dsv);
 	ctx->RSSetViewports(1, &m_OutputViewPort);
-}
\ No newline at end of file
+}
+
+void ShadowMap::BindLive(ID3D11DeviceContext* ctx, uint32_t cascade)
+{
+	ShadowMapUnbind(ctx);
+	ctx->OMSetRenderTargets(0, 0, m_CascadeDSVs[cascade].Get());
+	ctx->RSSetViewports(1, &m_OutputViewPort);
+}
+
+void ShadowMap::CopyStaticToLive(ID3D11DeviceContext* ctx, uint32_t cascade)
+{
+	// depth resources can only be copied a whole subresource at a time
+	const UINT subresource = D3D11CalcSubresource(0, cascade, 1);
+	ctx->CopySubresourceRegion(m_LiveTexture.Get(), subresource, 0, 0, 0, m_StaticTexture.Get(), subresource, nullptr);
+}
+
+void ShadowMap::BindAtlasSlot(ID3D11DeviceContext* ctx, uint32_t x, uint32_t y, uint32_t size)
+{
+	ShadowMapUnbind(ctx);
+	ctx->OMSetRenderTargets(0, 0, m_AtlasDSV.Get());
+	D3D11_VIEWPORT viewport = m_OutputViewPort;
+	viewport.TopLeftX = (float)x;
+	viewport.TopLeftY = (float)y;
+	viewport.Width = (float)size;
+	viewport.Height = (float)size;
+	ctx->RSSetViewports(1, &viewport);
+}
@@ -3,7 +3,28 @@
 #include <d3d11.h>
 #include <cstdint>
 #include <wrl/client.h>
+#include <vector>
 
+// Matches NUM_CASCADES in Common.hlsli
+#define SHADOW_MAP_NUM_CASCADES 4
+// Register of the map in Common.hlsli, sampled with the comparison sampler in SHADOW_MAP_SAMPLER_SLOT
+#define SHADOW_MAP_SRV_SLOT 4
+#define SHADOW_MAP_SAMPLER_SLOT 1
+// Register of the point and spot light atlas in Common.hlsli, sampled with the same comparison sampler
+#define SHADOW_MAP_ATLAS_SRV_SLOT 5
+// Register of a static layer slice in ShadowRestorePS.hlsl
+#define SHADOW_MAP_STATIC_SRV_SLOT 0
+// in units of the smallest depth step of the 24 bit map
+#define SHADOW_MAP_DEPTH_BIAS 1000
+#define SHADOW_MAP_SLOPE_SCALED_DEPTH_BIAS 1.5f
+
+// Depth maps of the directional light's cascades, one slice of a texture
+// array each. Casters are drawn into them depth only with a biased rasterizer
+// state, the lit pass then compares against them through a bilinear
+// comparison sampler (2x2 PCF). A second array of the same size holds the
+// static layer of every cascade: only static casters are drawn into it, and
+// the live map is restored from it wherever dynamic casters leave.
+// Point and spot lights draw into slots of a separate atlas.
 class ShadowMap
 {
 public:
@@ -13,12 +34,39 @@ public:
 	void Init();
 	void Deinit();
 
-	void InitResources(ID3D11Device* device, uint32_t texWidth, uint32_t texHeight);
+	void InitResources(ID3D11Device* device, uint32_t texWidth, uint32_t texHeight, uint32_t numCascades = SHADOW_MAP_NUM_CASCADES);
+	void InitAtlas(ID3D11Device* device, uint32_t atlasSize);
+
+	// Clears the static slice of the cascade and makes it the only target
+	void BindStatic(ID3D11DeviceContext* ctx, uint32_t cascade);
+	// Makes the live slice of the cascade the only target and keeps what it holds, the live array must not be sampled until the lit pass
+	void BindLive(ID3D11DeviceContext* ctx, uint32_t cascade);
+	// Replaces the whole live slice by the static one, must not be bound to either
+	void CopyStaticToLive(ID3D11DeviceContext* ctx, uint32_t cascade);
+	// Makes the atlas the only target with the viewport on one slot, which keeps what it holds
+	void BindAtlasSlot(ID3D11DeviceContext* ctx, uint32_t x, uint32_t y, uint32_t size);
 
-	void Bind(ID3D11DeviceContext* ctx);
+	uint32_t GetNumCascades() const { return (uint32_t)m_CascadeDSVs.size(); }
+	ID3D11ShaderResourceView* GetShaderResourceView() const { return m_pOutputTextureSRV.Get(); }
+	// one slice of the static layer, for ShadowRestorePS.hlsl
+	ID3D11ShaderResourceView* GetStaticShaderResourceView(uint32_t cascade) const { return m_StaticSRVs[cascade].Get(); }
+	ID3D11ShaderResourceView* GetAtlasShaderResourceView() const { return m_AtlasSRV.Get(); }
+	ID3D11DepthStencilState* GetRestoreDepthState() const { return m_RestoreDepthState.Get(); }
+	ID3D11RasterizerState* GetRasterizerState() const { return m_RasterizerState.Get(); }
+	ID3D11SamplerState* GetComparisonSampler() const { return m_ComparisonSampler.Get(); }
 
 private:
+	Microsoft::WRL::ComPtr<ID3D11Texture2D>				m_LiveTexture;
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_pOutputTextureSRV;
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilView>		m_pOutputTextureDSV;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11DepthStencilView>> m_CascadeDSVs;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D>				m_StaticTexture;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11DepthStencilView>> m_StaticDSVs;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> m_StaticSRVs;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D>				m_AtlasTexture;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView>		m_AtlasDSV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>	m_AtlasSRV;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState>		m_RestoreDepthState;
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState>		m_RasterizerState;
+	Microsoft::WRL::ComPtr<ID3D11SamplerState>			m_ComparisonSampler;
 	D3D11_VIEWPORT										m_OutputViewPort;
 };
\ No newline at end of file
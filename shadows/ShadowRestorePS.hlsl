@@ -0,0 +1,8 @@
+// Slice of the static layer of the cascade being restored, see SHADOW_MAP_STATIC_SRV_SLOT
+Texture2DArray<float> staticShadowMap : register(t0);
+
+// Writes the static depth back into the live map, the depth test is off for this pass
+float main(float4 posH : SV_POSITION) : SV_Depth
+{
+	return staticShadowMap.Load(int4(posH.xy, 0, 0));
+}
@@ -0,0 +1,7 @@
+// One triangle over the whole viewport, the scissor rect cuts it down to the rect being restored.
+// It lies on the far plane, so drawn without a pixel shader it clears the rect.
+float4 main(uint vertexId : SV_VertexID) : SV_POSITION
+{
+	const float2 uv = float2((vertexId << 1) & 2, vertexId & 2);
+	return float4(uv * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f), 1.0f, 1.0f);
+}
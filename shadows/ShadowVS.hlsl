@@ -0,0 +1,23 @@
+// Only the light matrix is needed, so the pass does not pull in the lit pass constants
+cbuffer ShadowPassConstants : register(b0)
+{
+	// world to the clip space of the cascade being drawn
+	float4x4 lightViewProj;
+};
+
+struct VSShadowIn
+{
+	float3 Pos : POSITION;
+	float4 World0 : WORLD0;
+	float4 World1 : WORLD1;
+	float4 World2 : WORLD2;
+	float4 World3 : WORLD3;
+};
+
+// Depth only, the shadow pass runs without a pixel shader
+float4 main(VSShadowIn In) : SV_POSITION
+{
+	const float4x4 instanceWorld = transpose(float4x4(In.World0, In.World1, In.World2, In.World3));
+	const float4 posW = mul(instanceWorld, float4(In.Pos, 1.0f));
+	return mul(lightViewProj, posW);
+}
@@ -0,0 +1,630 @@
+#include "ShadowView.h"
+
+#include <cassert>
+#include <cfloat>
+#include <math.h>
+
+// Grows a side of the light volume to the minimum extent around its center
+static void ShadowViewPad(float* min, float* max)
+{
+	const float missing = SHADOW_VIEW_MIN_EXTENT - (*max - *min);
+	if (missing > 0.0f)
+	{
+		*min -= missing * 0.5f;
+		*max += missing * 0.5f;
+	}
+}
+
+// View from eye along direction. The roll of a directional light is free,
+// up only has to differ from the direction.
+static Mat4X4 ShadowViewLookAlong(const Vec3D& eye, const Vec3D& direction)
+{
+	Vec3D dir = direction;
+	MathVec3DNormalize(&dir);
+	const Vec3D up = fabsf(dir.Y) > 0.99f ? MathVec3DFromXYZ(0.0f, 0.0f, 1.0f) : MathVec3DFromXYZ(0.0f, 1.0f, 0.0f);
+	const Vec3D focus = MathVec3DAddition(&eye, &dir);
+	return MathMat4X4ViewAt(&eye, &focus, &up);
+}
+
+ShadowView ShadowViewFitDirectional(const Vec3D& direction, const AABB& receivers, const AABB& casters)
+{
+	assert(receivers.Min.X <= receivers.Max.X && receivers.Min.Y <= receivers.Max.Y && receivers.Min.Z <= receivers.Max.Z);
+
+	ShadowView view;
+	view.View = ShadowViewLookAlong(MathAABBCenter(&receivers), direction);
+
+	AABB lightReceivers = MathAABBTransform(&receivers, &view.View);
+	const AABB lightCasters = MathAABBTransform(&casters, &view.View);
+	float zNear = fminf(lightCasters.Min.Z, lightReceivers.Min.Z);
+	float zFar = lightReceivers.Max.Z;
+	ShadowViewPad(&lightReceivers.Min.X, &lightReceivers.Max.X);
+	ShadowViewPad(&lightReceivers.Min.Y, &lightReceivers.Max.Y);
+	ShadowViewPad(&zNear, &zFar);
+
+	view.Proj = MathMat4X4OrthographicOffCenter(lightReceivers.Min.X, lightReceivers.Max.X,
+		lightReceivers.Min.Y, lightReceivers.Max.Y, zNear, zFar);
+	view.ViewProj = MathMat4X4MultMat4X4ByMat4X4(&view.View, &view.Proj);
+	view.CasterFrustum = MathFrustumFromMat4X4(&view.ViewProj);
+	return view;
+}
+
+ShadowView ShadowViewFitPerspective(const Vec3D& position, const Vec3D& direction, float fovY, float zNear, float zFar)
+{
+	ShadowView view;
+	view.View = ShadowViewLookAlong(position, direction);
+	view.Proj = MathMat4X4PerspectiveFov(fovY, 1.0f, zNear, zFar);
+	view.ViewProj = MathMat4X4MultMat4X4ByMat4X4(&view.View, &view.Proj);
+	view.CasterFrustum = MathFrustumFromMat4X4(&view.ViewProj);
+	return view;
+}
+
+Vec3D ShadowViewCubeFaceDirection(uint32_t face)
+{
+	assert(face < 6);
+	const float sign = face & 1 ? -1.0f : 1.0f;
+	const uint32_t axis = face / 2;
+	return MathVec3DFromXYZ(axis == 0 ? sign : 0.0f, axis == 1 ? sign : 0.0f, axis == 2 ? sign : 0.0f);
+}
+
+void ShadowViewComputeSplits(float zNear, float zFar, uint32_t numCascades, float lambda, float* splitEnds)
+{
+	assert(zNear > 0.0f && zFar > zNear && numCascades > 0);
+	for (uint32_t i = 1; i <= numCascades; ++i)
+	{
+		const float t = (float)i / (float)numCascades;
+		const float logSplit = zNear * powf(zFar / zNear, t);
+		const float uniformSplit = zNear + (zFar - zNear) * t;
+		splitEnds[i - 1] = lambda * logSplit + (1.0f - lambda) * uniformSplit;
+	}
+	// no rounding at the end of the range
+	splitEnds[numCascades - 1] = zFar;
+}
+
+void ShadowViewFrustumCorners(const Mat4X4& view, float fovY, float aspect, float zNear, float zFar, Vec3D corners[8])
+{
+	// the view matrix holds the camera basis in its columns
+	const Vec3D right = { view.A00, view.A10, view.A20 };
+	const Vec3D up = { view.A01, view.A11, view.A21 };
+	const Vec3D forward = { view.A02, view.A12, view.A22 };
+	Vec3D eye = MathVec3DModulateByScalar(&right, -view.A30);
+	const Vec3D eyeUp = MathVec3DModulateByScalar(&up, -view.A31);
+	const Vec3D eyeForward = MathVec3DModulateByScalar(&forward, -view.A32);
+	eye = MathVec3DAddition(&eye, &eyeUp);
+	eye = MathVec3DAddition(&eye, &eyeForward);
+
+	const float tanY = tanf(fovY * 0.5f);
+	const float tanX = tanY * aspect;
+	const float distances[2] = { zNear, zFar };
+	for (uint32_t plane = 0; plane < 2; ++plane)
+	{
+		const float d = distances[plane];
+		const Vec3D center = MathVec3DModulateByScalar(&forward, d);
+		const Vec3D halfRight = MathVec3DModulateByScalar(&right, d * tanX);
+		const Vec3D halfUp = MathVec3DModulateByScalar(&up, d * tanY);
+		for (uint32_t corner = 0; corner < 4; ++corner)
+		{
+			Vec3D point = MathVec3DAddition(&eye, &center);
+			const Vec3D x = MathVec3DModulateByScalar(&halfRight, corner & 1 ? 1.0f : -1.0f);
+			const Vec3D y = MathVec3DModulateByScalar(&halfUp, corner & 2 ? 1.0f : -1.0f);
+			point = MathVec3DAddition(&point, &x);
+			corners[plane * 4 + corner] = MathVec3DAddition(&point, &y);
+		}
+	}
+}
+
+ShadowView ShadowViewFitCascade(const Vec3D& direction, const Vec3D corners[8], uint32_t mapSize, const AABB& casters)
+{
+	Vec3D center = MathVec3DZero();
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		center = MathVec3DAddition(&center, &corners[i]);
+	}
+	center = MathVec3DModulateByScalar(&center, 1.0f / 8.0f);
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		const Vec3D offset = MathVec3DSubtraction(&corners[i], &center);
+		radius = fmaxf(radius, sqrtf(MathVec3DDot(&offset, &offset)));
+	}
+	radius = fmaxf(ceilf(radius / SHADOW_VIEW_RADIUS_STEP) * SHADOW_VIEW_RADIUS_STEP, SHADOW_VIEW_MIN_EXTENT);
+	// snapping moves the volume by less than a texel, one texel of margin keeps the sphere inside
+	assert(mapSize > 2);
+	radius *= (float)mapSize / (float)(mapSize - 2);
+
+	// light space with a fixed origin, the texel grid then only moves with the light
+	const Mat4X4 lightRotation = ShadowViewLookAlong(MathVec3DZero(), direction);
+	const Vec4D centerW = { center.X, center.Y, center.Z, 1.0f };
+	const Vec4D centerL = MathMat4X4MultVec4DByMat4X4(&centerW, &lightRotation);
+	const float texelSize = 2.0f * radius / (float)mapSize;
+	const Vec3D snapped = { -floorf(centerL.X / texelSize) * texelSize, -floorf(centerL.Y / texelSize) * texelSize, 0.0f };
+	const Mat4X4 snap = MathMat4X4TranslateFromVec3D(&snapped);
+
+	const AABB lightCasters = MathAABBTransform(&casters, &lightRotation);
+	const float zNear = fminf(lightCasters.Min.Z, centerL.Z - radius);
+	const float zFar = centerL.Z + radius;
+
+	ShadowView view;
+	view.View = MathMat4X4MultMat4X4ByMat4X4(&lightRotation, &snap);
+	view.Proj = MathMat4X4Orthographic(2.0f * radius, 2.0f * radius, zNear, zFar);
+	view.ViewProj = MathMat4X4MultMat4X4ByMat4X4(&view.View, &view.Proj);
+	view.CasterFrustum = MathFrustumFromMat4X4(&view.ViewProj);
+	return view;
+}
+
+// Light space rect covered by the map, the projection maps it to [-1, 1]
+static void ShadowViewLightRect(const Mat4X4& proj, float* minX, float* maxX, float* minY, float* maxY)
+{
+	*minX = (-1.0f - proj.A30) / proj.A00;
+	*maxX = (1.0f - proj.A30) / proj.A00;
+	*minY = (-1.0f - proj.A31) / proj.A11;
+	*maxY = (1.0f - proj.A31) / proj.A11;
+}
+
+uint32_t ShadowViewFitDepth(ShadowView* view, const AABB* bounds, const uint32_t* receivers, uint32_t numReceivers,
+	uint32_t* casters, uint32_t numCasters)
+{
+	float minX, maxX, minY, maxY;
+	ShadowViewLightRect(view->Proj, &minX, &maxX, &minY, &maxY);
+	float fittedNear, fittedFar;
+	ShadowViewGetDepthRange(*view, &fittedNear, &fittedFar);
+
+	float receiversMin = FLT_MAX;
+	float receiversMax = -FLT_MAX;
+	for (uint32_t i = 0; i < numReceivers; ++i)
+	{
+		const AABB box = MathAABBTransform(&bounds[receivers[i]], &view->View);
+		if (box.Max.X < minX || box.Min.X > maxX || box.Max.Y < minY || box.Min.Y > maxY ||
+			box.Max.Z < fittedNear || box.Min.Z > fittedFar)
+		{
+			continue;
+		}
+		receiversMin = fminf(receiversMin, box.Min.Z);
+		receiversMax = fmaxf(receiversMax, box.Max.Z);
+	}
+	if (receiversMin > receiversMax)
+	{
+		return 0;
+	}
+
+	const float zFar = fminf(receiversMax, fittedFar);
+	float zNear = fmaxf(receiversMin, fittedNear);
+	uint32_t numKept = 0;
+	for (uint32_t i = 0; i < numCasters; ++i)
+	{
+		const AABB box = MathAABBTransform(&bounds[casters[i]], &view->View);
+		if (box.Max.X < minX || box.Min.X > maxX || box.Max.Y < minY || box.Min.Y > maxY ||
+			box.Min.Z > zFar || box.Max.Z < fittedNear)
+		{
+			continue;
+		}
+		zNear = fminf(zNear, box.Min.Z);
+		casters[numKept++] = casters[i];
+	}
+	ShadowViewSetDepthRange(view, fmaxf(zNear, fittedNear), zFar);
+	return numKept;
+}
+
+void ShadowViewGetDepthRange(const ShadowView& view, float* zNear, float* zFar)
+{
+	// both orthographic projections map z to z * A22 + A32
+	*zNear = -view.Proj.A32 / view.Proj.A22;
+	*zFar = (1.0f - view.Proj.A32) / view.Proj.A22;
+}
+
+void ShadowViewSetDepthRange(ShadowView* view, float zNear, float zFar)
+{
+	ShadowViewPad(&zNear, &zFar);
+	view->Proj.A22 = 1.0f / (zFar - zNear);
+	view->Proj.A32 = zNear / (zNear - zFar);
+	view->ViewProj = MathMat4X4MultMat4X4ByMat4X4(&view->View, &view->Proj);
+	view->CasterFrustum = MathFrustumFromMat4X4(&view->ViewProj);
+}
+
+AABB ShadowViewBounds(const AABB* bounds, const uint32_t* entities, uint32_t count)
+{
+	AABB res = MathAABBEmpty();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const AABB& box = bounds[entities ? entities[i] : i];
+		res = MathAABBUnion(&res, &box);
+	}
+	return res;
+}
+
+#ifdef SHADOW_VIEW_TEST
+#include "Scene.h"
+
+#include <algorithm>
+#include <vector>
+
+static Vec4D ShadowViewProject(const ShadowView& view, float x, float y, float z)
+{
+	const Vec4D point = { x, y, z, 1.0f };
+	return MathMat4X4MultVec4DByMat4X4(&point, &view.ViewProj);
+}
+
+// Every corner of the box lands inside the shadow map and its depth range
+static bool ShadowViewContains(const ShadowView& view, const AABB& box)
+{
+	for (uint32_t corner = 0; corner < 8; ++corner)
+	{
+		const Vec4D clip = ShadowViewProject(view,
+			corner & 1 ? box.Max.X : box.Min.X,
+			corner & 2 ? box.Max.Y : box.Min.Y,
+			corner & 4 ? box.Max.Z : box.Min.Z);
+		if (fabsf(clip.X) > 1.001f || fabsf(clip.Y) > 1.001f || clip.Z < -0.001f || clip.Z > 1.001f)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static EntityHandle ShadowViewAddBox(Scene* scene, const Vec3D& min, const Vec3D& max)
+{
+	return scene->CreateEntity(0, 0, AABB(min, max), MathMat4X4Identity());
+}
+
+static void TestShadowViewFit(void)
+{
+	const AABB floor = { {-5.0f, -0.5f, -5.0f}, {5.0f, 0.0f, 5.0f} };
+	const AABB high = { {-1.0f, 49.0f, -1.0f}, {1.0f, 51.0f, 1.0f} };
+	const AABB scene = MathAABBUnion(&floor, &high);
+
+	// straight down needs the fallback up vector
+	const ShadowView down = ShadowViewFitDirectional(MathVec3DFromXYZ(0.0f, -1.0f, 0.0f), floor, scene);
+	assert(ShadowViewContains(down, floor));
+	assert(ShadowViewContains(down, high));
+	// the sides are tight around the receivers, depth runs from the top of the caster to the bottom of the floor
+	const Vec4D corner = ShadowViewProject(down, 5.0f, 0.0f, 5.0f);
+	assert(fabsf(fabsf(corner.X) - 1.0f) < 0.001f && fabsf(fabsf(corner.Y) - 1.0f) < 0.001f);
+	assert(fabsf(ShadowViewProject(down, 0.0f, 51.0f, 0.0f).Z) < 0.001f);
+	assert(fabsf(ShadowViewProject(down, 0.0f, -0.5f, 0.0f).Z - 1.0f) < 0.001f);
+	// receivers at the same height map to the same depth
+	assert(fabsf(ShadowViewProject(down, -5.0f, 0.0f, 5.0f).Z - ShadowViewProject(down, 5.0f, 0.0f, -5.0f).Z) < 0.001f);
+
+	const Vec3D slanted = MathVec3DFromXYZ(1.0f, -1.0f, 0.3f);
+	const ShadowView side = ShadowViewFitDirectional(slanted, floor, scene);
+	assert(ShadowViewContains(side, floor));
+	// points further along the light direction are deeper
+	const Vec4D nearPoint = ShadowViewProject(side, 0.0f, 0.0f, 0.0f);
+	const Vec4D farPoint = ShadowViewProject(side, slanted.X, slanted.Y, slanted.Z);
+	assert(farPoint.Z > nearPoint.Z);
+	assert(fabsf(farPoint.X - nearPoint.X) < 0.001f && fabsf(farPoint.Y - nearPoint.Y) < 0.001f);
+
+	// a single point still gets a finite volume
+	const AABB point = { {1.0f, 2.0f, 3.0f}, {1.0f, 2.0f, 3.0f} };
+	const ShadowView tiny = ShadowViewFitDirectional(slanted, point, point);
+	assert(!MathIsNaN(tiny.ViewProj.A00) && !MathIsNaN(tiny.ViewProj.A32));
+	assert(ShadowViewContains(tiny, point));
+}
+
+static void TestShadowViewCull(void)
+{
+	Scene scene;
+	const EntityHandle floor = ShadowViewAddBox(&scene, {-5.0f, -0.5f, -5.0f}, {5.0f, 0.0f, 5.0f});
+	const EntityHandle above = ShadowViewAddBox(&scene, {-1.0f, 2.0f, -1.0f}, {1.0f, 4.0f, 1.0f});
+	const EntityHandle beside = ShadowViewAddBox(&scene, {19.0f, 2.0f, -1.0f}, {21.0f, 4.0f, 1.0f});
+	const EntityHandle below = ShadowViewAddBox(&scene, {-1.0f, -6.0f, -1.0f}, {1.0f, -4.0f, 1.0f});
+	const EntityHandle upwind = ShadowViewAddBox(&scene, {-11.0f, 9.0f, -1.0f}, {-9.0f, 11.0f, 1.0f});
+	const EntityHandle downwind = ShadowViewAddBox(&scene, {9.0f, 9.0f, -1.0f}, {11.0f, 11.0f, 1.0f});
+	scene.UpdateBounds();
+
+	const std::vector<AABB>& bounds = scene.GetWorldBounds();
+	const uint32_t floorIdx = scene.GetDenseIndex(floor);
+	const AABB receivers = ShadowViewBounds(bounds.data(), &floorIdx, 1);
+	const AABB all = ShadowViewBounds(bounds.data(), nullptr, scene.GetNumEntities());
+	assert(all.Min.X == -11.0f && all.Max.X == 21.0f && all.Min.Y == -6.0f && all.Max.Y == 11.0f);
+
+	auto isCaster = [&scene](const std::vector<uint32_t>& casters, EntityHandle entity)
+	{
+		return std::find(casters.begin(), casters.end(), scene.GetDenseIndex(entity)) != casters.end();
+	};
+
+	// from straight above everything over the floor casts, the rest of the scene is skipped
+	std::vector<uint32_t> casters;
+	const ShadowView down = ShadowViewFitDirectional(MathVec3DFromXYZ(0.0f, -1.0f, 0.0f), receivers, all);
+	scene.Cull(down.CasterFrustum, &casters);
+	assert(casters.size() == 2);
+	assert(isCaster(casters, floor) && isCaster(casters, above) && !isCaster(casters, below));
+
+	// light coming in from -x: the box up and to the left shadows the floor, the one to the right cannot
+	casters.clear();
+	const ShadowView slanted = ShadowViewFitDirectional(MathVec3DFromXYZ(1.0f, -1.0f, 0.0f), receivers, all);
+	scene.Cull(slanted.CasterFrustum, &casters);
+	assert(isCaster(casters, floor) && isCaster(casters, above) && isCaster(casters, upwind));
+	assert(!isCaster(casters, downwind) && !isCaster(casters, beside));
+}
+
+// Every point around a point light lands in the face of its major axis and in no other
+static void TestShadowViewCubeFaces(void)
+{
+	const Vec3D light = { 1.0f, 2.0f, 3.0f };
+	ShadowView faces[6];
+	for (uint32_t face = 0; face < 6; ++face)
+	{
+		faces[face] = ShadowViewFitPerspective(light, ShadowViewCubeFaceDirection(face), MathToRadians(90.0f), 0.1f, 10.0f);
+	}
+	const Vec3D offsets[] = { {2.0f, 0.5f, -0.3f}, {-3.0f, 1.0f, 2.0f}, {0.2f, 4.0f, 0.1f}, {0.5f, -1.0f, 0.3f}, {-1.0f, 1.5f, 5.0f}, {0.0f, 0.0f, -2.0f} };
+	for (uint32_t face = 0; face < 6; ++face)
+	{
+		for (uint32_t other = 0; other < 6; ++other)
+		{
+			const Vec4D clip = ShadowViewProject(faces[other], light.X + offsets[face].X, light.Y + offsets[face].Y, light.Z + offsets[face].Z);
+			const bool inside = clip.W > 0.0f && fabsf(clip.X) <= clip.W && fabsf(clip.Y) <= clip.W && clip.Z >= 0.0f && clip.Z <= clip.W;
+			assert(inside == (face == other));
+		}
+	}
+
+	// the range ends at the far plane
+	const Vec4D far = ShadowViewProject(faces[0], light.X + 10.0f, light.Y, light.Z);
+	assert(fabsf(far.Z / far.W - 1.0f) < 0.001f);
+}
+
+static void TestShadowViewSplits(void)
+{
+	float splits[4] = {};
+	ShadowViewComputeSplits(1.0f, 100.0f, 4, 0.0f, splits);
+	assert(fabsf(splits[0] - 25.75f) < 0.001f && fabsf(splits[1] - 50.5f) < 0.001f && fabsf(splits[2] - 75.25f) < 0.001f);
+	assert(splits[3] == 100.0f);
+
+	ShadowViewComputeSplits(1.0f, 100.0f, 4, 1.0f, splits);
+	assert(fabsf(splits[0] - 3.1623f) < 0.001f && fabsf(splits[1] - 10.0f) < 0.001f && fabsf(splits[2] - 31.623f) < 0.01f);
+
+	// blended splits lie between the two schemes and keep growing
+	float blended[4] = {};
+	ShadowViewComputeSplits(1.0f, 100.0f, 4, SHADOW_VIEW_DEFAULT_SPLIT_LAMBDA, blended);
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		assert(blended[i] > splits[i] && blended[i] < 25.75f * (float)(i + 1));
+		assert(blended[i + 1] > blended[i]);
+	}
+	assert(blended[3] == 100.0f);
+
+	ShadowViewComputeSplits(0.5f, 20.0f, 1, 0.5f, splits);
+	assert(splits[0] == 20.0f);
+}
+
+static bool ShadowViewContainsPoint(const ShadowView& view, const Vec3D& point)
+{
+	const AABB box = { point, point };
+	return ShadowViewContains(view, box);
+}
+
+static void TestShadowViewCascades(void)
+{
+	const Vec3D eye = { 0.0f, 0.0f, -5.0f };
+	const Vec3D at = { 0.0f, 0.0f, 0.0f };
+	const Vec3D up = { 0.0f, 1.0f, 0.0f };
+	const Mat4X4 view = MathMat4X4ViewAt(&eye, &at, &up);
+
+	Vec3D corners[8];
+	ShadowViewFrustumCorners(view, MathToRadians(90.0f), 2.0f, 1.0f, 10.0f, corners);
+	assert(fabsf(corners[0].X + 2.0f) < 0.001f && fabsf(corners[0].Y + 1.0f) < 0.001f && fabsf(corners[0].Z + 4.0f) < 0.001f);
+	assert(fabsf(corners[7].X - 20.0f) < 0.001f && fabsf(corners[7].Y - 10.0f) < 0.001f && fabsf(corners[7].Z - 5.0f) < 0.001f);
+
+	const uint32_t mapSize = 1024;
+	const Vec3D direction = { 1.0f, -2.0f, 0.5f };
+	const AABB casters = { {-50.0f, 0.0f, -50.0f}, {50.0f, 40.0f, 50.0f} };
+	const ShadowView cascade = ShadowViewFitCascade(direction, corners, mapSize, casters);
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		assert(ShadowViewContainsPoint(cascade, corners[i]));
+	}
+	// casters towards the light are in the depth range even outside the slice
+	const Vec3D highCaster = { 0.0f, 40.0f, 0.0f };
+	const Vec4D highClip = ShadowViewProject(cascade, highCaster.X, highCaster.Y, highCaster.Z);
+	assert(highClip.Z >= -0.001f);
+
+	// turning the camera leaves the cascade size alone
+	const Mat4X4 turn = MathMat4X4RotateY(MathToRadians(37.0f));
+	const Mat4X4 turnedView = MathMat4X4MultMat4X4ByMat4X4(&view, &turn);
+	Vec3D turnedCorners[8];
+	ShadowViewFrustumCorners(turnedView, MathToRadians(90.0f), 2.0f, 1.0f, 10.0f, turnedCorners);
+	const ShadowView turned = ShadowViewFitCascade(direction, turnedCorners, mapSize, casters);
+	assert(turned.Proj.A00 == cascade.Proj.A00 && turned.Proj.A11 == cascade.Proj.A11);
+	for (uint32_t i = 0; i < 8; ++i)
+	{
+		assert(ShadowViewContainsPoint(turned, turnedCorners[i]));
+	}
+
+	// moving the camera by a fraction of a texel moves the grid by whole texels only
+	const float texelSize = 2.0f / cascade.Proj.A00 / (float)mapSize;
+	for (uint32_t step = 1; step < 8; ++step)
+	{
+		const Vec3D offset = { 0.37f * texelSize * (float)step, -0.21f * texelSize * (float)step, 0.13f * (float)step };
+		Vec3D movedCorners[8];
+		for (uint32_t i = 0; i < 8; ++i)
+		{
+			movedCorners[i] = MathVec3DAddition(&corners[i], &offset);
+		}
+		const ShadowView moved = ShadowViewFitCascade(direction, movedCorners, mapSize, casters);
+		const Vec4D before = ShadowViewProject(cascade, 3.0f, 1.0f, 2.0f);
+		const Vec4D after = ShadowViewProject(moved, 3.0f, 1.0f, 2.0f);
+		const float texelsX = (after.X - before.X) * 0.5f * (float)mapSize;
+		const float texelsY = (after.Y - before.Y) * 0.5f * (float)mapSize;
+		assert(fabsf(texelsX - roundf(texelsX)) < 0.01f && fabsf(texelsY - roundf(texelsY)) < 0.01f);
+		for (uint32_t i = 0; i < 8; ++i)
+		{
+			assert(ShadowViewContainsPoint(moved, movedCorners[i]));
+		}
+	}
+}
+
+static void TestShadowViewFitDepth(void)
+{
+	Scene scene;
+	const EntityHandle floor = ShadowViewAddBox(&scene, {-5.0f, -0.5f, -5.0f}, {5.0f, 0.0f, 5.0f});
+	const EntityHandle above = ShadowViewAddBox(&scene, {-1.0f, 2.0f, -1.0f}, {1.0f, 4.0f, 1.0f});
+	const EntityHandle high = ShadowViewAddBox(&scene, {2.0f, 29.0f, 2.0f}, {3.0f, 31.0f, 3.0f});
+	const EntityHandle beside = ShadowViewAddBox(&scene, {19.0f, 50.0f, -1.0f}, {21.0f, 60.0f, 1.0f});
+	const EntityHandle below = ShadowViewAddBox(&scene, {-1.0f, -6.0f, -1.0f}, {1.0f, -4.0f, 1.0f});
+	scene.UpdateBounds();
+
+	const std::vector<AABB>& bounds = scene.GetWorldBounds();
+	const uint32_t floorIdx = scene.GetDenseIndex(floor);
+	const uint32_t belowIdx = scene.GetDenseIndex(below);
+	const AABB all = ShadowViewBounds(bounds.data(), nullptr, scene.GetNumEntities());
+	const AABB floorBounds = ShadowViewBounds(bounds.data(), &floorIdx, 1);
+	const AABB belowBounds = ShadowViewBounds(bounds.data(), &belowIdx, 1);
+	const AABB loose = MathAABBUnion(&floorBounds, &belowBounds);
+
+	// fitted to everything under the floor and every caster in the scene, only the floor is visible
+	const Vec3D down = { 0.0f, -1.0f, 0.0f };
+	ShadowView view = ShadowViewFitDirectional(down, loose, all);
+	const ShadowView fitted = view;
+	std::vector<uint32_t> casters;
+	for (uint32_t i = 0; i < scene.GetNumEntities(); ++i)
+	{
+		casters.push_back(i);
+	}
+	const uint32_t numKept = ShadowViewFitDepth(&view, bounds.data(), &floorIdx, 1, casters.data(), (uint32_t)casters.size());
+	casters.resize(numKept);
+	auto isCaster = [&scene, &casters](EntityHandle entity)
+	{
+		return std::find(casters.begin(), casters.end(), scene.GetDenseIndex(entity)) != casters.end();
+	};
+	// the tall box is outside the map and the one under the floor cannot shadow it
+	assert(numKept == 3);
+	assert(isCaster(floor) && isCaster(above) && isCaster(high));
+	assert(!isCaster(beside) && !isCaster(below));
+
+	// depth runs from the top of the highest kept caster to the bottom of the floor
+	assert(fabsf(ShadowViewProject(view, 0.0f, 31.0f, 0.0f).Z) < 0.001f);
+	assert(fabsf(ShadowViewProject(view, 0.0f, -0.5f, 0.0f).Z - 1.0f) < 0.001f);
+	assert(view.Proj.A22 > fitted.Proj.A22 * 2.0f);
+	// the sides do not move
+	assert(view.Proj.A00 == fitted.Proj.A00 && view.Proj.A11 == fitted.Proj.A11);
+	assert(view.Proj.A30 == fitted.Proj.A30 && view.Proj.A31 == fitted.Proj.A31);
+	assert(ShadowViewContains(view, floorBounds));
+	assert(ShadowViewContains(view, bounds[scene.GetDenseIndex(above)]));
+	// the tight frustum culls the same casters the fit kept, the box outside the map is gone
+	std::vector<uint32_t> culled;
+	scene.Cull(view.CasterFrustum, &culled);
+	assert(std::find(culled.begin(), culled.end(), scene.GetDenseIndex(beside)) == culled.end());
+	assert(std::find(culled.begin(), culled.end(), belowIdx) == culled.end());
+
+	// a single flat receiver still gets a finite range
+	ShadowView flat = ShadowViewFitDirectional(down, floorBounds, floorBounds);
+	uint32_t floorCaster = floorIdx;
+	assert(ShadowViewFitDepth(&flat, bounds.data(), &floorIdx, 1, &floorCaster, 1) == 1);
+	assert(!MathIsNaN(flat.ViewProj.A22) && !MathIsNaN(flat.ViewProj.A32));
+
+	// nothing visible inside the map, nothing to draw and the view is left alone
+	view = fitted;
+	const uint32_t besideIdx = scene.GetDenseIndex(beside);
+	uint32_t allCasters[5] = { 0, 1, 2, 3, 4 };
+	assert(ShadowViewFitDepth(&view, bounds.data(), &besideIdx, 1, allCasters, 5) == 0);
+	assert(view.Proj.A22 == fitted.Proj.A22 && view.Proj.A32 == fitted.Proj.A32);
+
+	// a cascade keeps its texel snapped sides and only loses depth
+	const Vec3D corners[8] = {
+		{-2.0f, 0.0f, -2.0f}, {2.0f, 0.0f, -2.0f}, {-2.0f, 0.0f, 2.0f}, {2.0f, 0.0f, 2.0f},
+		{-2.0f, 1.0f, -2.0f}, {2.0f, 1.0f, -2.0f}, {-2.0f, 1.0f, 2.0f}, {2.0f, 1.0f, 2.0f},
+	};
+	ShadowView cascade = ShadowViewFitCascade(MathVec3DFromXYZ(0.3f, -1.0f, 0.2f), corners, 1024, all);
+	const ShadowView fittedCascade = cascade;
+	uint32_t cascadeCasters[5] = { 0, 1, 2, 3, 4 };
+	const uint32_t numCascadeCasters = ShadowViewFitDepth(&cascade, bounds.data(), &floorIdx, 1, cascadeCasters, 5);
+	assert(numCascadeCasters >= 2 && numCascadeCasters < 5);
+	assert(cascade.View.A30 == fittedCascade.View.A30 && cascade.View.A31 == fittedCascade.View.A31);
+	assert(cascade.Proj.A00 == fittedCascade.Proj.A00 && cascade.Proj.A22 > fittedCascade.Proj.A22);
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		assert(ShadowViewContainsPoint(cascade, corners[i]));
+	}
+}
+
+void ShadowViewTest(void)
+{
+	TestShadowViewFit();
+	TestShadowViewCull();
+	TestShadowViewSplits();
+	TestShadowViewCubeFaces();
+	TestShadowViewCascades();
+	TestShadowViewFitDepth();
+}
+#endif
+
+#ifdef SHADOW_VIEW_BENCHMARK
+#include "Scene.h"
+#include "Utils.h"
+
+#include <chrono>
+#include <vector>
+
+void ShadowViewBenchmark(void)
+{
+	const uint32_t numCascades = 4;
+	const uint32_t numFrames = 64;
+	const uint32_t counts[] = { 1000, 10000, 100000 };
+	for (uint32_t count : counts)
+	{
+		// boxes of one to three units scattered over a square that grows with the count
+		Scene scene;
+		const float side = sqrtf((float)count) * 4.0f;
+		uint32_t seed = 1;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			float values[4];
+			for (float& value : values)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				value = (float)(seed >> 8) / (float)(1 << 24);
+			}
+			const Vec3D offset = { (values[0] - 0.5f) * side, values[1] * 10.0f, (values[2] - 0.5f) * side };
+			const float size = 0.5f + values[3];
+			const AABB box = { {-size, -size, -size}, {size, size, size} };
+			scene.CreateEntity(0, 0, box, MathMat4X4TranslateFromVec3D(&offset));
+		}
+		scene.UpdateBounds();
+		const std::vector<AABB>& bounds = scene.GetWorldBounds();
+
+		float splits[numCascades] = {};
+		ShadowViewComputeSplits(0.1f, 100.0f, numCascades, SHADOW_VIEW_DEFAULT_SPLIT_LAMBDA, splits);
+		const Vec3D direction = { 1.0f, -1.0f, 0.3f };
+		const Vec3D up = { 0.0f, 1.0f, 0.0f };
+
+		std::vector<uint32_t> casters;
+		size_t numCasters = 0;
+		double fitSeconds = 0.0;
+		double cullSeconds = 0.0;
+		for (uint32_t frame = 0; frame < numFrames; ++frame)
+		{
+			// the camera circles the middle of the scene
+			const float angle = (float)frame * 0.1f;
+			const Vec3D eye = { cosf(angle) * 20.0f, 5.0f, sinf(angle) * 20.0f };
+			const Vec3D at = { 0.0f, 0.0f, 0.0f };
+			const Mat4X4 view = MathMat4X4ViewAt(&eye, &at, &up);
+
+			auto start = std::chrono::steady_clock::now();
+			const AABB sceneBounds = ShadowViewBounds(bounds.data(), nullptr, scene.GetNumEntities());
+			ShadowView cascades[numCascades];
+			for (uint32_t c = 0; c < numCascades; ++c)
+			{
+				Vec3D corners[8];
+				ShadowViewFrustumCorners(view, MathToRadians(45.0f), 16.0f / 9.0f, c ? splits[c - 1] : 0.1f, splits[c], corners);
+				cascades[c] = ShadowViewFitCascade(direction, corners, 2048, sceneBounds);
+			}
+			auto end = std::chrono::steady_clock::now();
+			fitSeconds += std::chrono::duration<double>(end - start).count();
+
+			start = end;
+			for (uint32_t c = 0; c < numCascades; ++c)
+			{
+				casters.clear();
+				scene.Cull(cascades[c].CasterFrustum, &casters);
+				numCasters += casters.size();
+			}
+			cullSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		UtilsDebugPrint("Cascades: %u entities, fit %.3f ms, cull %.3f ms per frame for %u cascades, %.1f casters per cascade\n",
+			count,
+			fitSeconds * 1000.0 / numFrames,
+			cullSeconds * 1000.0 / numFrames,
+			numCascades,
+			(double)numCasters / (numFrames * numCascades));
+	}
+}
+#endif
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Math.h"
+
+// Smallest side of a fitted light volume, keeps the projection finite for flat or single point receivers
+#define SHADOW_VIEW_MIN_EXTENT 0.01f
+// 1 splits the camera range logarithmically, 0 uniformly
+#define SHADOW_VIEW_DEFAULT_SPLIT_LAMBDA 0.75f
+// Cascade radii are rounded up to this fraction of a unit, so they do not change as the camera turns
+#define SHADOW_VIEW_RADIUS_STEP (1.0f / 16.0f)
+
+// Light space of a shadow map. CasterFrustum bounds everything that can
+// throw a shadow onto the receivers the view was fitted to, entities outside
+// of it are not drawn into the map.
+struct ShadowView
+{
+	ShadowView() : View{}, Proj{}, ViewProj{}, CasterFrustum{} {}
+	Mat4X4 View;
+	Mat4X4 Proj;
+	Mat4X4 ViewProj;
+	Frustum CasterFrustum;
+};
+
+// Orthographic view looking along direction (from the light into the scene).
+// The sides enclose the receivers, the depth range starts at the first of the
+// casters towards the light and ends behind the last receiver, so casters
+// outside the camera view still shadow what it sees.
+ShadowView ShadowViewFitDirectional(const Vec3D& direction, const AABB& receivers, const AABB& casters);
+
+// Perspective view of a spot light, or of one face of a point light's cube
+// with a fovY of 90 degrees, seeing from zNear to zFar along direction
+ShadowView ShadowViewFitPerspective(const Vec3D& position, const Vec3D& direction, float fovY, float zNear, float zFar);
+
+// Direction a face of a point light's cube looks along, in the order +X, -X, +Y, -Y, +Z, -Z
+Vec3D ShadowViewCubeFaceDirection(uint32_t face);
+
+// Far distances of numCascades consecutive slices of [zNear, zFar] after the
+// practical split scheme, a blend of logarithmic and uniform splits
+void ShadowViewComputeSplits(float zNear, float zFar, uint32_t numCascades, float lambda, float* splitEnds);
+
+// World space corners of the slice of a perspective camera between the view
+// distances zNear and zFar, the four near ones first
+void ShadowViewFrustumCorners(const Mat4X4& view, float fovY, float aspect, float zNear, float zFar, Vec3D corners[8]);
+
+// Orthographic cascade around the bounding sphere of the slice corners. The
+// sphere keeps its size as the camera turns and its center is snapped to
+// whole texels of a mapSize map in light space, so the shadow edges of a
+// cascade do not crawl while the camera moves. The depth range reaches back
+// to the casters like ShadowViewFitDirectional does.
+ShadowView ShadowViewFitCascade(const Vec3D& direction, const Vec3D corners[8], uint32_t mapSize, const AABB& casters);
+
+// Tightens the depth range of a fitted view to what this frame needs: it ends
+// behind the last visible receiver inside the map and starts at the first
+// caster in front of them. Casters outside the map or behind every receiver
+// are dropped, the rest are compacted to the front of casters and counted in
+// the return value. Without a receiver inside the map nothing can be shadowed,
+// so no caster is kept and the view is left alone. The range never grows
+// past the one the view was fitted with.
+uint32_t ShadowViewFitDepth(ShadowView* view, const AABB* bounds, const uint32_t* receivers, uint32_t numReceivers,
+	uint32_t* casters, uint32_t numCasters);
+
+// Light space depth range of an orthographic view, and its replacement
+// keeping the sides. Padded to the minimum extent like the fits are.
+void ShadowViewGetDepthRange(const ShadowView& view, float* zNear, float* zFar);
+void ShadowViewSetDepthRange(ShadowView* view, float zNear, float zFar);
+
+// Union of the bounds of the listed entities, entities may be null to take the first count
+AABB ShadowViewBounds(const AABB* bounds, const uint32_t* entities, uint32_t count);
+
+#ifdef SHADOW_VIEW_TEST
+void ShadowViewTest(void);
+#endif
+
+#ifdef SHADOW_VIEW_BENCHMARK
+// Prints the time to fit four cascades and cull their casters in scenes of growing size
+void ShadowViewBenchmark(void);
+#endif
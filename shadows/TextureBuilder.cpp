@@ -0,0 +1,144 @@
+#include "TextureBuilder.h"
+#include "AssetManifest.h"
+#include "DDSLoader.h"
+#include "ImageDecoder.h"
+
+#include <string>
+
+// Diffuse keeps full color, gloss and specular are single channel, normals need X and Y
+static BCFormat TextureBuilderBlockFormat(TextureType type)
+{
+	switch (type)
+	{
+	case TextureType::Specular:
+	case TextureType::Gloss:
+		return BCFormat::BC4;
+	case TextureType::Normal:
+		return BCFormat::BC5;
+	default:
+		return BCFormat::BC7;
+	}
+}
+
+static uint32_t TextureBuilderDDSFormat(BCFormat format)
+{
+	switch (format)
+	{
+	case BCFormat::BC1:
+		return DDS_FORMAT_BC1_UNORM;
+	case BCFormat::BC3:
+		return DDS_FORMAT_BC3_UNORM;
+	case BCFormat::BC4:
+		return DDS_FORMAT_BC4_UNORM;
+	case BCFormat::BC5:
+		return DDS_FORMAT_BC5_UNORM;
+	default:
+		return DDS_FORMAT_BC7_UNORM;
+	}
+}
+
+// Block compresses every level, D3D only accepts BC textures whose top level is a multiple of 4
+static bool TextureBuilderCompress(const MipChain& mips, TextureType type, JobSystem* jobs, TextureImage* image)
+{
+	if (mips.Width % BC_BLOCK_SIZE != 0 || mips.Height % BC_BLOCK_SIZE != 0)
+	{
+		return false;
+	}
+
+	const BCFormat format = TextureBuilderBlockFormat(type);
+	image->Format = TextureBuilderDDSFormat(format);
+
+	size_t totalBytes = 0;
+	for (uint32_t level = 0; level < mips.NumLevels; ++level)
+	{
+		image->Offsets[level] = totalBytes;
+		image->RowPitches[level] = BCRowPitch(format, mips.GetLevelWidth(level));
+		image->LevelSizes[level] = (uint32_t)BCSurfaceSize(format, mips.GetLevelWidth(level), mips.GetLevelHeight(level));
+		totalBytes += image->LevelSizes[level];
+	}
+	image->Data.resize(totalBytes);
+
+	for (uint32_t level = 0; level < mips.NumLevels; ++level)
+	{
+		BCCompressImage(mips.GetLevel(level), mips.GetLevelWidth(level), mips.GetLevelHeight(level),
+			format, TEXTURE_BUILDER_BC_QUALITY, jobs, &image->Data[image->Offsets[level]]);
+	}
+	return true;
+}
+
+bool TextureBuildFromFile(const char* filename, TextureType type, JobSystem* jobs, TextureImage* image)
+{
+	int width = 0;
+	int height = 0;
+	int channelsInFile = 0;
+	unsigned char* pixels = ImageDecoderLoad(filename, &width, &height, &channelsInFile, TEXTURE_BUILDER_CHANNELS, jobs);
+	if (!pixels)
+	{
+		return false;
+	}
+
+	// color maps are stored in sRGB, gloss and normals are plain data
+	const bool srgb = type == TextureType::Diffuse || type == TextureType::Specular;
+	MipChain mips;
+	MipGenerateChain(pixels, width, height, TEXTURE_BUILDER_MIP_FILTER, srgb, jobs, &mips);
+	ImageDecoderFree(pixels);
+
+	image->Width = mips.Width;
+	image->Height = mips.Height;
+	image->NumLevels = mips.NumLevels;
+	image->UncompressedBytes = mips.Data.size();
+	if (!TextureBuilderCompress(mips, type, jobs, image))
+	{
+		image->Format = DDS_FORMAT_R8G8B8A8_UNORM;
+		for (uint32_t level = 0; level < mips.NumLevels; ++level)
+		{
+			image->Offsets[level] = mips.Offsets[level];
+			image->RowPitches[level] = mips.GetLevelPitch(level);
+			image->LevelSizes[level] = mips.GetLevelPitch(level) * mips.GetLevelHeight(level);
+		}
+		image->Data.swap(mips.Data);
+	}
+	return true;
+}
+
+TextureType TextureTypeFromFilename(const char* filename)
+{
+	std::string name = AssetNormalizePath(filename);
+	const size_t slash = name.rfind('/');
+	const size_t dot = name.rfind('.');
+	if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+	{
+		name.resize(dot);
+	}
+
+	auto endsWith = [&name](const char* suffix)
+		{
+			const std::string s = suffix;
+			return name.size() >= s.size() && name.compare(name.size() - s.size(), s.size(), s) == 0;
+		};
+	if (endsWith("_normal"))
+		return TextureType::Normal;
+	if (endsWith("_gloss"))
+		return TextureType::Gloss;
+	if (endsWith("_reflection") || endsWith("_specular"))
+		return TextureType::Specular;
+	return TextureType::Diffuse;
+}
+
+bool TextureWriteDDS(const char* filename, const TextureImage& image)
+{
+	FILE* f = AssetOpenFile(filename, "wb");
+	if (!f)
+	{
+		return false;
+	}
+
+	uint8_t header[DDS_DX10_HEADER_SIZE] = {};
+	DDSWriteHeader(image.Format, image.Width, image.Height, image.NumLevels, 1, false, header);
+	bool written = fwrite(header, sizeof(header), 1, f) == 1;
+	for (uint32_t level = 0; level < image.NumLevels && written; ++level)
+	{
+		written = fwrite(&image.Data[image.Offsets[level]], image.LevelSizes[level], 1, f) == 1;
+	}
+	return fclose(f) == 0 && written;
+}
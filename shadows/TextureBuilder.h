@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "MipGenerator.h"
+#include "BlockCompressor.h"
+
+#define TEXTURE_BUILDER_MIP_FILTER MipFilter::Kaiser
+#define TEXTURE_BUILDER_BC_QUALITY BCQuality::Normal
+#define TEXTURE_BUILDER_CHANNELS 4
+
+class JobSystem;
+
+enum class TextureType
+{
+	Diffuse = 0,
+	Specular = 1,
+	Gloss = 2,
+	Normal = 3,
+};
+
+// Full mip chain of a decoded image, block compressed when the size allows it.
+// Levels are stored back to back in Data.
+struct TextureImage
+{
+	TextureImage() : Format{0}, Width{0}, Height{0}, NumLevels{0}, Offsets{}, RowPitches{}, LevelSizes{}, UncompressedBytes{0} {}
+
+	// DDSFormat, which holds DXGI_FORMAT values
+	uint32_t Format;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t NumLevels;
+	size_t Offsets[MIP_MAX_LEVELS];
+	uint32_t RowPitches[MIP_MAX_LEVELS];
+	uint32_t LevelSizes[MIP_MAX_LEVELS];
+	std::vector<uint8_t> Data;
+	// size of the RGBA8 chain before compression
+	size_t UncompressedBytes;
+};
+
+// Decodes the file with stb, builds the mips and compresses them: BC7 for
+// diffuse, BC4 for specular and gloss, BC5 for normals. Textures whose size
+// is not a multiple of 4 stay RGBA8. Work is split across jobs when not null.
+bool TextureBuildFromFile(const char* filename, TextureType type, JobSystem* jobs, TextureImage* image);
+// Type from the naming used under assets/textures: *_normal, *_gloss,
+// *_reflection or *_specular, everything else is diffuse
+TextureType TextureTypeFromFilename(const char* filename);
+// Writes a DDS with DX10 header that the runtime uploads without decoding
+bool TextureWriteDDS(const char* filename, const TextureImage& image);
@@ -0,0 +1,478 @@
+#include "TextureCache.h"
+#include "AssetManifest.h"
+#include "Utils.h"
+
+TextureCache::TextureCache():
+	m_Budget{TEXTURE_CACHE_DEFAULT_BUDGET},
+	m_ResidentBytes{0},
+	m_StreamedBytes{0},
+	m_Tick{0},
+	m_NumLoading{0},
+	m_NumRequests{0},
+	m_NumHits{0},
+	m_NumEvictions{0}
+{
+}
+
+TextureCache::~TextureCache()
+{
+}
+
+void TextureCache::Init(TextureCacheLoadFunction load, size_t budgetBytes, TextureCacheStreamFunction stream)
+{
+	m_Load = std::move(load);
+	m_Stream = std::move(stream);
+	m_Budget = budgetBytes;
+}
+
+uint64_t TextureCache::ComputeKey(const char* filename, TextureType type)
+{
+	const std::string path = AssetNormalizePath(filename);
+	auto found = m_PathHashes.find(path);
+	if (found == m_PathHashes.end())
+	{
+		// missing files hash their path, the loader reports the error
+		uint64_t hash = 0;
+		if (!AssetHashFile(filename, &hash))
+		{
+			hash = AssetHashBytes(path.data(), path.size());
+		}
+		found = m_PathHashes.emplace(path, hash).first;
+	}
+
+	// the type decides how images are compressed, the same file may be loaded as two textures
+	const uint32_t typeValue = (uint32_t)type;
+	return AssetHashBytes(&typeValue, sizeof(typeValue), found->second);
+}
+
+TextureHandle TextureCache::Acquire(const char* filename, TextureType type, TextureLoadedCallback onLoaded)
+{
+	++m_NumRequests;
+
+	const uint64_t key = ComputeKey(filename, type);
+	TextureHandle handle = TEXTURE_CACHE_INVALID_HANDLE;
+	auto found = m_Handles.find(key);
+	if (found != m_Handles.end())
+	{
+		handle = found->second;
+	}
+	else
+	{
+		handle = (TextureHandle)m_Entries.size();
+		m_Entries.emplace_back();
+		Entry& entry = m_Entries.back();
+		entry.Path = filename;
+		entry.Type = type;
+		entry.Key = key;
+		entry.State = Residency::Evicted;
+		entry.RefCount = 0;
+		entry.LastUse = 0;
+		entry.Bytes = 0;
+		entry.Stream = TEXTURE_LOADER_NOT_STREAMED;
+		m_Handles.emplace(key, handle);
+	}
+
+	Entry& entry = m_Entries[handle];
+	++entry.RefCount;
+	switch (entry.State)
+	{
+	case Residency::Resident:
+		++m_NumHits;
+		if (onLoaded)
+		{
+			onLoaded(entry.View.Get(), entry.Bytes);
+		}
+		if (entry.Stream != TEXTURE_LOADER_NOT_STREAMED)
+		{
+			entry.Waiters.emplace_back(std::move(onLoaded));
+		}
+		break;
+	case Residency::Loading:
+		++m_NumHits;
+		entry.Waiters.emplace_back(std::move(onLoaded));
+		break;
+	default:
+		entry.State = Residency::Loading;
+		entry.Waiters.emplace_back(std::move(onLoaded));
+		// the entry vector may grow before the texture arrives, the callbacks keep the handle
+		if (m_Stream)
+		{
+			// the entry turns resident once the coarse levels arrive, which may be before this returns
+			const uint32_t stream = m_Stream(entry.Path.c_str(), type, [this, handle](ID3D11ShaderResourceView* srv, size_t gpuBytes)
+				{
+					OnStreamChanged(handle, srv, gpuBytes);
+				});
+			if (stream != TEXTURE_LOADER_NOT_STREAMED)
+			{
+				m_Entries[handle].Stream = stream;
+				break;
+			}
+		}
+		++m_NumLoading;
+		m_Load(m_Entries[handle].Path.c_str(), type, [this, handle](ID3D11ShaderResourceView* srv, size_t gpuBytes)
+			{
+				OnLoaded(handle, srv, gpuBytes);
+			});
+		break;
+	}
+	return handle;
+}
+
+void TextureCache::Release(TextureHandle handle)
+{
+	Entry& entry = m_Entries[handle];
+	if (entry.RefCount == 0)
+	{
+		UTILS_FATAL_ERROR("Texture %s released more often than acquired", entry.Path.c_str());
+	}
+
+	entry.LastUse = ++m_Tick;
+	if (--entry.RefCount == 0)
+	{
+		// nobody is left to hear about streamed changes
+		if (entry.Stream != TEXTURE_LOADER_NOT_STREAMED)
+		{
+			entry.Waiters.clear();
+		}
+		Evict();
+	}
+}
+
+void TextureCache::OnLoaded(TextureHandle handle, ID3D11ShaderResourceView* srv, size_t gpuBytes)
+{
+	Entry& entry = m_Entries[handle];
+	entry.View = srv;
+	entry.Bytes = gpuBytes;
+	entry.State = Residency::Resident;
+	m_ResidentBytes += gpuBytes;
+	--m_NumLoading;
+
+	// callbacks may acquire more textures and grow m_Entries
+	std::vector<TextureLoadedCallback> waiters;
+	waiters.swap(entry.Waiters);
+	for (const TextureLoadedCallback& onLoaded : waiters)
+	{
+		if (onLoaded)
+		{
+			onLoaded(srv, gpuBytes);
+		}
+	}
+
+	Evict();
+	if (m_NumLoading == 0)
+	{
+		PrintStats();
+	}
+}
+
+void TextureCache::OnStreamChanged(TextureHandle handle, ID3D11ShaderResourceView* srv, size_t gpuBytes)
+{
+	Entry& entry = m_Entries[handle];
+	entry.View = srv;
+	m_StreamedBytes = m_StreamedBytes - entry.Bytes + gpuBytes;
+	entry.Bytes = gpuBytes;
+	entry.State = Residency::Resident;
+
+	// callbacks may acquire more textures and grow m_Entries
+	std::vector<TextureLoadedCallback> waiters = entry.Waiters;
+	for (const TextureLoadedCallback& onChanged : waiters)
+	{
+		if (onChanged)
+		{
+			onChanged(srv, gpuBytes);
+		}
+	}
+}
+
+void TextureCache::SetBudget(size_t budgetBytes)
+{
+	m_Budget = budgetBytes;
+	Evict();
+}
+
+// A linear scan per eviction, the cache holds tens of textures
+void TextureCache::Evict()
+{
+	while (m_ResidentBytes > m_Budget)
+	{
+		Entry* oldest = nullptr;
+		for (Entry& entry : m_Entries)
+		{
+			if (entry.State == Residency::Resident && entry.RefCount == 0 && entry.Stream == TEXTURE_LOADER_NOT_STREAMED &&
+				(!oldest || entry.LastUse < oldest->LastUse))
+			{
+				oldest = &entry;
+			}
+		}
+		if (!oldest)
+		{
+			break;
+		}
+
+		oldest->View.Reset();
+		oldest->State = Residency::Evicted;
+		m_ResidentBytes -= oldest->Bytes;
+		oldest->Bytes = 0;
+		++m_NumEvictions;
+	}
+}
+
+uint32_t TextureCache::GetNumResident() const
+{
+	uint32_t numResident = 0;
+	for (const Entry& entry : m_Entries)
+	{
+		numResident += entry.State == Residency::Resident ? 1 : 0;
+	}
+	return numResident;
+}
+
+void TextureCache::PrintStats() const
+{
+	UtilsDebugPrint("Texture cache: %u requests, %u hits (hit rate %.2f), %u resident textures, %.2f MB of %.2f MB budget, %.2f MB streamed, %u evicted\n",
+		m_NumRequests,
+		m_NumHits,
+		GetHitRate(),
+		GetNumResident(),
+		(float)m_ResidentBytes / (1024.0f * 1024.0f),
+		(float)m_Budget / (1024.0f * 1024.0f),
+		(float)m_StreamedBytes / (1024.0f * 1024.0f),
+		m_NumEvictions);
+}
+
+#ifdef TEXTURE_CACHE_TEST
+#include <assert.h>
+#include <string.h>
+
+// Counts live instances, nothing else of the view is used by the cache
+class TextureCacheMockView final : public ID3D11ShaderResourceView
+{
+public:
+	explicit TextureCacheMockView(uint32_t* numLive) : m_RefCount{1}, m_NumLive{numLive} { ++*m_NumLive; }
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void** object) { *object = nullptr; return E_NOINTERFACE; }
+	ULONG STDMETHODCALLTYPE AddRef() { return ++m_RefCount; }
+	ULONG STDMETHODCALLTYPE Release()
+	{
+		const ULONG refCount = --m_RefCount;
+		if (refCount == 0)
+		{
+			--*m_NumLive;
+			delete this;
+		}
+		return refCount;
+	}
+	void STDMETHODCALLTYPE GetDevice(ID3D11Device** device) { *device = nullptr; }
+	HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID, UINT*, void*) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID, UINT, const void*) { return E_NOTIMPL; }
+	HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID, const IUnknown*) { return E_NOTIMPL; }
+	void STDMETHODCALLTYPE GetResource(ID3D11Resource** resource) { *resource = nullptr; }
+	void STDMETHODCALLTYPE GetDesc(D3D11_SHADER_RESOURCE_VIEW_DESC* desc) { *desc = {}; }
+
+private:
+	ULONG m_RefCount;
+	uint32_t* m_NumLive;
+};
+
+// Stands in for TextureLoader: queues the requests and creates mock views when told to
+struct TextureCacheMockDevice
+{
+	struct Request
+	{
+		std::string Filename;
+		TextureLoadedCallback OnLoaded;
+	};
+
+	void Load(const char* filename, TextureType, TextureLoadedCallback onLoaded)
+	{
+		Request request;
+		request.Filename = filename;
+		request.OnLoaded = std::move(onLoaded);
+		Pending.emplace_back(std::move(request));
+		++NumLoads;
+	}
+
+	void Complete(size_t bytes)
+	{
+		std::vector<Request> pending;
+		pending.swap(Pending);
+		for (const Request& request : pending)
+		{
+			Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+			srv.Attach(new TextureCacheMockView(&NumLive));
+			request.OnLoaded(srv.Get(), bytes);
+		}
+	}
+
+	// Only paths ending in streamable are streamed, their tail arrives right away unless DeferStreams
+	uint32_t Stream(const char* filename, TextureType, TextureLoadedCallback onChanged)
+	{
+		const size_t length = strlen(filename);
+		if (length < 10 || strcmp(filename + length - 10, "streamable") != 0)
+		{
+			return TEXTURE_LOADER_NOT_STREAMED;
+		}
+		Streams.emplace_back(std::move(onChanged));
+		if (!DeferStreams)
+		{
+			Change((uint32_t)Streams.size() - 1, 100);
+		}
+		return (uint32_t)Streams.size() - 1;
+	}
+
+	void Change(uint32_t stream, size_t bytes)
+	{
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+		srv.Attach(new TextureCacheMockView(&NumLive));
+		Streams[stream](srv.Get(), bytes);
+	}
+
+	std::vector<Request> Pending;
+	std::vector<TextureLoadedCallback> Streams;
+	uint32_t NumLoads = 0;
+	uint32_t NumLive = 0;
+	bool DeferStreams = false;
+};
+
+// Streamed entries share one stream per key, hear about every change and are never evicted
+static void TestTextureCacheStreamed(const char* flare)
+{
+	TextureCacheMockDevice device;
+	{
+		TextureCache cache;
+		cache.Init([&device](const char* filename, TextureType type, TextureLoadedCallback onLoaded)
+			{
+				device.Load(filename, type, std::move(onLoaded));
+			}, 0, [&device](const char* filename, TextureType type, TextureLoadedCallback onChanged)
+			{
+				return device.Stream(filename, type, std::move(onChanged));
+			});
+
+		ID3D11ShaderResourceView* views[2] = {};
+		const TextureHandle a = cache.Acquire("textures/streamable", TextureType::Diffuse,
+			[&views](ID3D11ShaderResourceView* srv, size_t) { views[0] = srv; });
+		const TextureHandle b = cache.Acquire("Textures\\Streamable", TextureType::Diffuse,
+			[&views](ID3D11ShaderResourceView* srv, size_t) { views[1] = srv; });
+		assert(a == b && device.Streams.size() == 1 && device.NumLoads == 0);
+		assert(cache.GetStream(a) == 0 && views[0] && views[0] == views[1] && views[0] == cache.GetView(a));
+		assert(cache.GetNumHits() == 1 && cache.GetStreamedBytes() == 100 && cache.GetResidentBytes() == 0);
+
+		// finer levels reach every user, the old view goes away
+		device.Change(0, 500);
+		assert(views[0] == cache.GetView(a) && views[1] == views[0] && device.NumLive == 1);
+		assert(cache.GetStreamedBytes() == 500);
+
+		// files that cannot stream load as before
+		const TextureHandle c = cache.Acquire(flare, TextureType::Diffuse, nullptr);
+		assert(cache.GetStream(c) == TEXTURE_LOADER_NOT_STREAMED && device.NumLoads == 1);
+		device.Complete(1000);
+
+		// a zero budget evicts the released loaded texture but not the released stream
+		cache.Release(a);
+		cache.Release(b);
+		cache.Release(c);
+		assert(cache.GetNumResident() == 1 && cache.GetView(a) && !cache.GetView(c));
+
+		// released users hear nothing, a new user gets the current view and the same stream
+		ID3D11ShaderResourceView* stale = views[0];
+		device.Change(0, 300);
+		assert(views[0] == stale && cache.GetStreamedBytes() == 300);
+		const TextureHandle d = cache.Acquire("textures/streamable", TextureType::Diffuse,
+			[&views](ID3D11ShaderResourceView* srv, size_t) { views[0] = srv; });
+		assert(d == a && views[0] == cache.GetView(a) && device.Streams.size() == 1);
+		cache.Release(d);
+
+		// tails that wait for their upload keep the entry loading, later users wait with the first
+		device.DeferStreams = true;
+		views[0] = views[1] = nullptr;
+		const TextureHandle e = cache.Acquire("textures/late_streamable", TextureType::Diffuse,
+			[&views](ID3D11ShaderResourceView* srv, size_t) { views[0] = srv; });
+		const TextureHandle f = cache.Acquire("textures/late_streamable", TextureType::Diffuse,
+			[&views](ID3D11ShaderResourceView* srv, size_t) { views[1] = srv; });
+		assert(e == f && cache.GetStream(e) == 1 && !cache.GetView(e) && !views[0] && !views[1]);
+		device.Change(1, 100);
+		assert(views[0] && views[0] == views[1] && views[0] == cache.GetView(e));
+		assert(cache.GetStreamedBytes() == 400);
+		cache.Release(e);
+		cache.Release(f);
+	}
+	assert(device.NumLive == 0);
+}
+
+void TextureCacheTest(void)
+{
+	const char* snow = "assets/textures/snow.dds";
+	const char* flare = "assets/textures/flare0.dds";
+	// same bytes as flare under another name
+	const char* flareCopy = "texture_cache_test.dds";
+	{
+		MappedFile source;
+		assert(source.Open(flare));
+		FILE* f = AssetOpenFile(flareCopy, "wb");
+		assert(f);
+		assert(fwrite(source.GetData(), source.GetSize(), 1, f) == 1);
+		fclose(f);
+	}
+
+	const size_t textureBytes = 1000;
+	TextureCacheMockDevice device;
+	{
+		TextureCache cache;
+		cache.Init([&device](const char* filename, TextureType type, TextureLoadedCallback onLoaded)
+			{
+				device.Load(filename, type, std::move(onLoaded));
+			}, 3 * textureBytes);
+
+		// requests while loading wait for the same texture
+		ID3D11ShaderResourceView* views[2] = {};
+		const TextureHandle a = cache.Acquire(snow, TextureType::Diffuse, [&views](ID3D11ShaderResourceView* srv, size_t) { views[0] = srv; });
+		const TextureHandle b = cache.Acquire("Assets\\textures/../textures/SNOW.dds", TextureType::Diffuse,
+			[&views](ID3D11ShaderResourceView* srv, size_t) { views[1] = srv; });
+		assert(a == b && device.NumLoads == 1 && !cache.GetView(a));
+		device.Complete(textureBytes);
+		assert(views[0] && views[0] == views[1] && views[0] == cache.GetView(a));
+		assert(device.NumLive == 1 && cache.GetResidentBytes() == textureBytes);
+
+		// identical content under another path, a different type is its own texture
+		const TextureHandle c = cache.Acquire(flare, TextureType::Diffuse, nullptr);
+		const TextureHandle d = cache.Acquire(flareCopy, TextureType::Diffuse, nullptr);
+		const TextureHandle e = cache.Acquire(flare, TextureType::Normal, nullptr);
+		assert(c == d && c != e && device.NumLoads == 3);
+		device.Complete(textureBytes);
+		assert(device.NumLive == 3 && cache.GetNumResident() == 3);
+
+		// unreferenced textures stay resident while they fit and are returned right away
+		cache.Release(a);
+		cache.Release(b);
+		assert(cache.GetNumResident() == 3);
+		bool called = false;
+		const TextureHandle f = cache.Acquire(snow, TextureType::Diffuse, [&called](ID3D11ShaderResourceView*, size_t) { called = true; });
+		assert(f == a && called && device.NumLoads == 3);
+		assert(cache.GetNumRequests() == 6 && cache.GetNumHits() == 3);
+
+		// over budget the least recently released textures go first, referenced ones stay
+		cache.Release(e);
+		cache.Release(c);
+		cache.Release(f);
+		assert(cache.GetNumResident() == 3 && cache.GetNumEvictions() == 0);
+		cache.SetBudget(2 * textureBytes);
+		assert(cache.GetNumResident() == 2 && cache.GetNumEvictions() == 1 && !cache.GetView(e));
+		assert(device.NumLive == 2);
+		cache.SetBudget(0);
+		assert(cache.GetNumResident() == 1 && cache.GetView(d) && !cache.GetView(f));
+		assert(cache.GetResidentBytes() == textureBytes && device.NumLive == 1);
+
+		// an evicted texture is loaded again
+		const TextureHandle g = cache.Acquire(snow, TextureType::Diffuse, nullptr);
+		assert(g == a && device.NumLoads == 4);
+		device.Complete(textureBytes);
+		assert(cache.GetView(g) && cache.GetNumResident() == 2);
+		cache.Release(g);
+		cache.Release(d);
+		assert(cache.GetNumResident() == 0 && cache.GetResidentBytes() == 0 && device.NumLive == 0);
+	}
+	remove(flareCopy);
+
+	TestTextureCacheStreamed(flare);
+}
+#endif
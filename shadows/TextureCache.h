@@ -0,0 +1,116 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "TextureLoader.h"
+
+#define TEXTURE_CACHE_INVALID_HANDLE UINT32_MAX
+#define TEXTURE_CACHE_DEFAULT_BUDGET (256ull * 1024 * 1024)
+
+typedef uint32_t TextureHandle;
+// Starts loading filename and calls onLoaded once it is on the GPU, usually TextureLoader::Load
+typedef std::function<void(const char* filename, TextureType type, TextureLoadedCallback onLoaded)> TextureCacheLoadFunction;
+// Starts streaming filename by mip level and returns the stream, or TEXTURE_LOADER_NOT_STREAMED
+// if it has to be loaded whole. onChanged is called whenever the resident levels change,
+// usually TextureLoader::LoadStreamed
+typedef std::function<uint32_t(const char* filename, TextureType type, TextureLoadedCallback onChanged)> TextureCacheStreamFunction;
+
+// Shares textures between everything that requests the same content. Entries
+// are keyed by content hash and type, so two paths to identical files share
+// one view; the hash of a path is computed once per normalized path. Every
+// Acquire has to be paired with a Release. Textures nobody references stay
+// resident until the resident bytes exceed the budget, then the least
+// recently released ones are dropped. Referenced textures are never evicted,
+// so the budget can be exceeded while they are in use.
+//
+// With a stream function, files that can stream do so instead of loading,
+// one stream per entry. The streamer keeps their bytes in its own budget,
+// so the cache never evicts them. Their users are called again every time
+// the resident levels change, until the last reference is released.
+class TextureCache
+{
+public:
+	TextureCache();
+	~TextureCache();
+	TextureCache(const TextureCache& rhs) = delete;
+	TextureCache& operator=(const TextureCache& rhs) = delete;
+
+	void Init(TextureCacheLoadFunction load, size_t budgetBytes = TEXTURE_CACHE_DEFAULT_BUDGET,
+		TextureCacheStreamFunction stream = nullptr);
+
+	// onLoaded is called right away when the texture is resident, otherwise when it arrives
+	TextureHandle Acquire(const char* filename, TextureType type, TextureLoadedCallback onLoaded);
+	void Release(TextureHandle handle);
+	// null until the texture arrived
+	ID3D11ShaderResourceView* GetView(TextureHandle handle) const { return m_Entries[handle].View.Get(); }
+	// TEXTURE_LOADER_NOT_STREAMED unless the texture streams, the stream is shared by every user of the entry
+	uint32_t GetStream(TextureHandle handle) const { return m_Entries[handle].Stream; }
+	// What entries are keyed by, equal for the same content loaded as the same type
+	uint64_t ComputeKey(const char* filename, TextureType type);
+
+	// Evicts right away if the resident textures no longer fit
+	void SetBudget(size_t budgetBytes);
+	size_t GetBudget() const { return m_Budget; }
+	size_t GetResidentBytes() const { return m_ResidentBytes; }
+	// levels of streamed textures, they do not count against the budget
+	size_t GetStreamedBytes() const { return m_StreamedBytes; }
+	uint32_t GetNumResident() const;
+	uint32_t GetNumRequests() const { return m_NumRequests; }
+	uint32_t GetNumHits() const { return m_NumHits; }
+	uint32_t GetNumEvictions() const { return m_NumEvictions; }
+	float GetHitRate() const { return m_NumRequests ? (float)m_NumHits / (float)m_NumRequests : 0.0f; }
+	void PrintStats() const;
+
+private:
+	enum class Residency
+	{
+		Evicted = 0,
+		Loading = 1,
+		Resident = 2,
+	};
+
+	struct Entry
+	{
+		std::string Path;
+		TextureType Type;
+		uint64_t Key;
+		Residency State;
+		uint32_t RefCount;
+		// Tick of the last Release, orders the eviction
+		uint64_t LastUse;
+		size_t Bytes;
+		uint32_t Stream;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> View;
+		// called once on arrival, streamed entries keep calling them on every change
+		std::vector<TextureLoadedCallback> Waiters;
+	};
+
+	void OnLoaded(TextureHandle handle, ID3D11ShaderResourceView* srv, size_t gpuBytes);
+	void OnStreamChanged(TextureHandle handle, ID3D11ShaderResourceView* srv, size_t gpuBytes);
+	void Evict();
+
+	TextureCacheLoadFunction m_Load;
+	TextureCacheStreamFunction m_Stream;
+	std::vector<Entry> m_Entries;
+	std::unordered_map<uint64_t, TextureHandle> m_Handles;
+	// content hash of every normalized path seen so far
+	std::unordered_map<std::string, uint64_t> m_PathHashes;
+	size_t m_Budget;
+	size_t m_ResidentBytes;
+	size_t m_StreamedBytes;
+	uint64_t m_Tick;
+	uint32_t m_NumLoading;
+	uint32_t m_NumRequests;
+	uint32_t m_NumHits;
+	uint32_t m_NumEvictions;
+};
+
+#ifdef TEXTURE_CACHE_TEST
+void TextureCacheTest(void);
+#endif
@@ -0,0 +1,685 @@
+#include "TextureLoader.h"
+#include "DDSLoader.h"
+#include "JobSystem.h"
+#include "UploadManager.h"
+#include "Utils.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <string.h>
+#include <unordered_map>
+
+static double TextureLoaderNowMillis()
+{
+	using namespace std::chrono;
+	return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Without uploads the levels go in as initial data, otherwise they are queued
+// on the staging rings and the ticket of the last one is returned
+static uint64_t TextureLoaderCreateTexture(ID3D11Device* device, UploadManager* uploads, const TextureData& data,
+	ID3D11ShaderResourceView** srv)
+{
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	{
+		D3D11_TEXTURE2D_DESC desc = {};
+		desc.Width = data.Width;
+		desc.Height = data.Height;
+		desc.MipLevels = data.NumLevels;
+		desc.ArraySize = data.ArraySize;
+		desc.Format = data.Format;
+		desc.SampleDesc.Count = 1;
+		desc.SampleDesc.Quality = 0;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.MiscFlags = data.IsCubemap ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+
+		HR(device->CreateTexture2D(&desc, uploads ? nullptr : data.Subresources.data(), texture.ReleaseAndGetAddressOf()))
+	}
+
+	uint64_t ticket = UPLOAD_MANAGER_NO_TICKET;
+	if (uploads)
+	{
+		for (uint32_t subresource = 0; subresource < (uint32_t)data.Subresources.size(); ++subresource)
+		{
+			const uint32_t level = subresource % data.NumLevels;
+			const D3D11_SUBRESOURCE_DATA& levelData = data.Subresources[subresource];
+			ticket = uploads->UploadTexture(texture.Get(), subresource, data.Format,
+				std::max(1u, data.Width >> level), std::max(1u, data.Height >> level),
+				levelData.pSysMem, levelData.SysMemPitch);
+		}
+	}
+
+	{
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = data.Format;
+		if (data.IsCubemap && data.ArraySize > 6)
+		{
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBEARRAY;
+			srvDesc.TextureCubeArray.MipLevels = -1;
+			srvDesc.TextureCubeArray.NumCubes = data.ArraySize / 6;
+		}
+		else if (data.IsCubemap)
+		{
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+			srvDesc.TextureCube.MipLevels = -1;
+		}
+		else
+		{
+			// material shaders sample every 2D texture as an array, packed or not
+			srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+			srvDesc.Texture2DArray.MipLevels = -1;
+			srvDesc.Texture2DArray.ArraySize = data.ArraySize;
+		}
+
+		HR(device->CreateShaderResourceView(texture.Get(), &srvDesc, srv))
+	}
+	return ticket;
+}
+
+static void TextureLoaderAddSubresource(TextureData* data, const void* texels, uint32_t rowPitch, uint32_t slicePitch)
+{
+	D3D11_SUBRESOURCE_DATA subresource = {};
+	subresource.pSysMem = texels;
+	subresource.SysMemPitch = rowPitch;
+	subresource.SysMemSlicePitch = slicePitch;
+	data->Subresources.emplace_back(subresource);
+}
+
+// Maps the file and points every subresource into it, the texels are only read by CreateTexture2D
+static bool TextureLoaderLoadDDS(const char* filename, TextureData* data, size_t* uncompressedBytes)
+{
+	std::unique_ptr<MappedFile> file(new MappedFile());
+	if (!file->Open(filename))
+	{
+		return false;
+	}
+
+	DDSImage image;
+	const DDSStatus status = DDSParse(file->GetData(), file->GetSize(), &image);
+	if (status != DDSStatus::Ok || image.Dimension != DDSDimension::Texture2D)
+	{
+		UtilsDebugPrint("ERROR: %s: %s\n", filename,
+			status != DDSStatus::Ok ? DDSStatusString(status) : "only 2D textures, arrays and cubemaps are supported");
+		return false;
+	}
+
+	// DDSFormat holds DXGI_FORMAT values
+	data->Format = (DXGI_FORMAT)image.Format;
+	data->Width = image.Width;
+	data->Height = image.Height;
+	data->NumLevels = image.NumLevels;
+	data->ArraySize = image.ArraySize;
+	data->IsCubemap = image.IsCubemap;
+	data->Subresources.reserve(image.Subresources.size());
+	*uncompressedBytes = 0;
+	for (const DDSSubresource& subresource : image.Subresources)
+	{
+		TextureLoaderAddSubresource(data, subresource.Data, subresource.RowPitch, subresource.SlicePitch);
+		*uncompressedBytes += (size_t)subresource.Width * subresource.Height * TEXTURE_BUILDER_CHANNELS;
+	}
+	data->File = std::move(file);
+	return true;
+}
+
+static bool TextureLoaderIsDDS(const char* filename)
+{
+	const size_t length = strlen(filename);
+	return length >= 4 && _stricmp(filename + length - 4, ".dds") == 0;
+}
+
+// Produces upload ready levels for one file, DDS files are mapped, everything else goes through stb
+static bool TextureLoaderDecodeFile(const char* filename, TextureType type, JobSystem* jobs, TextureData* data, size_t* uncompressedBytes)
+{
+	if (TextureLoaderIsDDS(filename))
+	{
+		return TextureLoaderLoadDDS(filename, data, uncompressedBytes);
+	}
+
+	TextureImage image;
+	if (!TextureBuildFromFile(filename, type, jobs, &image))
+	{
+		return false;
+	}
+
+	// TextureImage formats hold DXGI_FORMAT values
+	data->Format = (DXGI_FORMAT)image.Format;
+	data->Width = image.Width;
+	data->Height = image.Height;
+	data->NumLevels = image.NumLevels;
+	data->ArraySize = 1;
+	data->Data.swap(image.Data);
+	for (uint32_t level = 0; level < image.NumLevels; ++level)
+	{
+		TextureLoaderAddSubresource(data, &data->Data[image.Offsets[level]], image.RowPitches[level], image.LevelSizes[level]);
+	}
+	*uncompressedBytes = image.UncompressedBytes;
+	return true;
+}
+
+TextureLoader::TextureLoader():
+	m_Jobs{nullptr},
+	m_Device{nullptr},
+	m_Context{nullptr},
+	m_Uploads{nullptr},
+	m_NumPending{0},
+	m_StartMillis{0.0},
+	m_GpuBytes{0},
+	m_UncompressedBytes{0}
+{
+}
+
+TextureLoader::~TextureLoader()
+{
+	// workers may still write into m_Decoded
+	if (m_Jobs)
+	{
+		m_Jobs->Wait();
+	}
+}
+
+void TextureLoader::Init(JobSystem* jobs, ID3D11Device* device, ID3D11DeviceContext* context, UploadManager* uploads)
+{
+	m_Jobs = jobs;
+	m_Device = device;
+	m_Context = context;
+	m_Uploads = uploads;
+	CreatePlaceholders();
+}
+
+void TextureLoader::CreatePlaceholders()
+{
+	// neutral values: white albedo, no specular, full gloss, flat normal
+	const uint32_t colors[TEXTURE_LOADER_NUM_PLACEHOLDERS] = {
+		0xffffffff,
+		0xff000000,
+		0xffffffff,
+		0xffff8080,
+	};
+
+	for (uint32_t i = 0; i < TEXTURE_LOADER_NUM_PLACEHOLDERS; ++i)
+	{
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+		D3D11_TEXTURE2D_DESC desc = {};
+		desc.Width = 1;
+		desc.Height = 1;
+		desc.MipLevels = 1;
+		desc.ArraySize = 1;
+		desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_IMMUTABLE;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+		D3D11_SUBRESOURCE_DATA subresourceData = {};
+		subresourceData.pSysMem = &colors[i];
+		subresourceData.SysMemPitch = sizeof(uint32_t);
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = desc.Format;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Texture2DArray.MipLevels = 1;
+		srvDesc.Texture2DArray.ArraySize = 1;
+
+		HR(m_Device->CreateTexture2D(&desc, &subresourceData, texture.ReleaseAndGetAddressOf()))
+		HR(m_Device->CreateShaderResourceView(texture.Get(), &srvDesc, m_Placeholders[i].ReleaseAndGetAddressOf()))
+	}
+}
+
+void TextureLoader::Decode(uint32_t request, const std::string& filename, TextureType type)
+{
+	DecodedImage image = {};
+	image.Request = request;
+	if (!TextureLoaderDecodeFile(filename.c_str(), type, m_Jobs, &image.Texture, &image.UncompressedBytes))
+	{
+		image.Texture = TextureData();
+	}
+
+	std::lock_guard<std::mutex> lock(m_DecodedMutex);
+	m_Decoded.emplace_back(std::move(image));
+}
+
+void TextureLoader::Load(const char* filename, TextureType type, TextureLoadedCallback onLoaded)
+{
+	if (m_NumPending == 0)
+	{
+		m_StartMillis = TextureLoaderNowMillis();
+	}
+
+	const uint32_t request = (uint32_t)m_Requests.size();
+	Request entry = {};
+	entry.Filename = filename;
+	entry.Type = type;
+	entry.OnLoaded = std::move(onLoaded);
+	m_Requests.emplace_back(std::move(entry));
+	++m_NumPending;
+
+	std::string path = filename;
+	if (m_Jobs)
+	{
+		m_Jobs->Submit([this, request, path, type]() { Decode(request, path, type); });
+	}
+	else
+	{
+		Decode(request, path, type);
+	}
+}
+
+uint32_t TextureLoader::Update(uint32_t maxUploads)
+{
+	std::vector<DecodedImage> ready;
+	{
+		std::lock_guard<std::mutex> lock(m_DecodedMutex);
+		const size_t count = m_Decoded.size() < maxUploads ? m_Decoded.size() : maxUploads;
+		ready.assign(std::make_move_iterator(m_Decoded.begin()), std::make_move_iterator(m_Decoded.begin() + count));
+		m_Decoded.erase(m_Decoded.begin(), m_Decoded.begin() + count);
+	}
+
+	for (const DecodedImage& image : ready)
+	{
+		if (image.Texture.NumLevels == 0)
+		{
+			UTILS_FATAL_ERROR("Failed to load texture from %s", m_Requests[image.Request].Filename.c_str());
+		}
+
+		Uploading uploading;
+		uploading.Request = image.Request;
+		uploading.Ticket = TextureLoaderCreateTexture(m_Device, m_Uploads, image.Texture, uploading.View.ReleaseAndGetAddressOf());
+		uploading.GpuBytes = 0;
+		for (const D3D11_SUBRESOURCE_DATA& subresource : image.Texture.Subresources)
+		{
+			uploading.GpuBytes += subresource.SysMemSlicePitch;
+		}
+		m_GpuBytes += uploading.GpuBytes;
+		m_UncompressedBytes += image.UncompressedBytes;
+		m_Uploading.push_back(std::move(uploading));
+	}
+
+	// textures are handed out once their copies are recorded, in order since tickets are issued in order
+	uint32_t numDelivered = 0;
+	while (numDelivered < m_Uploading.size() &&
+		(!m_Uploads || m_Uploads->IsIssued(m_Uploading[numDelivered].Ticket)))
+	{
+		++numDelivered;
+	}
+	std::vector<Uploading> delivered(std::make_move_iterator(m_Uploading.begin()),
+		std::make_move_iterator(m_Uploading.begin() + numDelivered));
+	m_Uploading.erase(m_Uploading.begin(), m_Uploading.begin() + numDelivered);
+
+	for (const Uploading& uploading : delivered)
+	{
+		// the callback may request more textures and grow m_Requests
+		TextureLoadedCallback onLoaded = std::move(m_Requests[uploading.Request].OnLoaded);
+		--m_NumPending;
+		if (onLoaded)
+		{
+			onLoaded(uploading.View.Get(), uploading.GpuBytes);
+		}
+	}
+
+	if (!delivered.empty() && m_NumPending == 0)
+	{
+		UtilsDebugPrint("Textures: %u loaded in %.2f ms, %.2f MB on GPU, %.2f MB uncompressed\n",
+			(uint32_t)m_Requests.size(),
+			TextureLoaderNowMillis() - m_StartMillis,
+			(float)m_GpuBytes / (1024.0f * 1024.0f),
+			(float)m_UncompressedBytes / (1024.0f * 1024.0f));
+	}
+	return (uint32_t)ready.size();
+}
+
+void TextureLoader::Flush()
+{
+	if (m_Jobs)
+	{
+		m_Jobs->Wait();
+	}
+	Update();
+	if (m_Uploads)
+	{
+		m_Uploads->Flush();
+		Update();
+		DeliverStreamed();
+	}
+}
+
+void TextureLoader::LoadPacked(const char* const* filenames, const uint64_t* keys, uint32_t numFiles,
+	std::vector<TexturePackerPlacement>* placements)
+{
+	const double startMillis = TextureLoaderNowMillis();
+
+	// whole slices point into the mapped files, which stay open until the arrays are created
+	std::vector<std::unique_ptr<MappedFile>> files(numFiles);
+	std::vector<DDSImage> images(numFiles);
+	std::vector<TexturePackerInput> inputs(numFiles, TexturePackerInput{DDS_FORMAT_UNKNOWN, 0, 0, 0});
+	// first file of every key, duplicates stay out of the packer and copy its placement
+	std::unordered_map<uint64_t, uint32_t> firstOfKey;
+	std::vector<uint32_t> sources(numFiles);
+	uint32_t numTextures = 0;
+	uint32_t numShared = 0;
+	for (uint32_t i = 0; i < numFiles; ++i)
+	{
+		sources[i] = i;
+		numTextures += filenames[i] ? 1 : 0;
+		if (!filenames[i])
+		{
+			continue;
+		}
+		if (keys)
+		{
+			const auto first = firstOfKey.emplace(keys[i], i);
+			if (!first.second)
+			{
+				sources[i] = first.first->second;
+				++numShared;
+				continue;
+			}
+		}
+		if (!TextureLoaderIsDDS(filenames[i]))
+		{
+			continue;
+		}
+
+		files[i].reset(new MappedFile());
+		DDSImage& image = images[i];
+		if (!files[i]->Open(filenames[i]) ||
+			DDSParse(files[i]->GetData(), files[i]->GetSize(), &image) != DDSStatus::Ok ||
+			image.Dimension != DDSDimension::Texture2D || image.ArraySize != 1)
+		{
+			continue;
+		}
+		inputs[i] = TexturePackerInput{image.Format, image.Width, image.Height, image.NumLevels};
+	}
+
+	TexturePackerPack(inputs.data(), numFiles, &m_PackedArrays, placements);
+	m_PackedViews.clear();
+	m_PackedViews.resize(m_PackedArrays.size());
+
+	uint32_t numPacked = 0;
+	uint32_t numPages = 0;
+	for (uint32_t arrayIdx = 0; arrayIdx < m_PackedArrays.size(); ++arrayIdx)
+	{
+		const TexturePackerArray& array = m_PackedArrays[arrayIdx];
+		TextureData data;
+		data.Format = (DXGI_FORMAT)array.Format;
+		data.Width = array.Width;
+		data.Height = array.Height;
+		data.NumLevels = array.NumLevels;
+		data.ArraySize = array.NumSlices;
+		data.Subresources.resize((size_t)array.NumSlices * array.NumLevels);
+
+		// atlas pages start out empty, levels past the MaxLevel of a rect keep it that way
+		size_t pageBytes = 0;
+		for (uint32_t level = 0; level < array.NumLevels; ++level)
+		{
+			const uint32_t width = array.Width >> level ? array.Width >> level : 1;
+			const uint32_t height = array.Height >> level ? array.Height >> level : 1;
+			pageBytes += (size_t)DDSRowPitch(array.Format, width) * DDSNumRows(array.Format, height);
+		}
+		data.Data.assign(pageBytes * (array.NumSlices - array.FirstPage), 0);
+		size_t offset = 0;
+		for (uint32_t slice = array.FirstPage; slice < array.NumSlices; ++slice)
+		{
+			for (uint32_t level = 0; level < array.NumLevels; ++level)
+			{
+				const uint32_t width = array.Width >> level ? array.Width >> level : 1;
+				const uint32_t height = array.Height >> level ? array.Height >> level : 1;
+				D3D11_SUBRESOURCE_DATA& subresource = data.Subresources[slice * array.NumLevels + level];
+				subresource.pSysMem = &data.Data[offset];
+				subresource.SysMemPitch = (UINT)DDSRowPitch(array.Format, width);
+				subresource.SysMemSlicePitch = subresource.SysMemPitch * DDSNumRows(array.Format, height);
+				offset += subresource.SysMemSlicePitch;
+			}
+		}
+
+		for (uint32_t i = 0; i < numFiles; ++i)
+		{
+			const TexturePackerPlacement& placement = (*placements)[i];
+			if (placement.Array != arrayIdx || sources[i] != i)
+			{
+				continue;
+			}
+
+			++numPacked;
+			const DDSImage& image = images[i];
+			for (uint32_t level = 0; level <= placement.MaxLevel; ++level)
+			{
+				const DDSSubresource& source = image.GetSubresource(0, level);
+				D3D11_SUBRESOURCE_DATA& subresource = data.Subresources[placement.Slice * array.NumLevels + level];
+				if (placement.InAtlas)
+				{
+					TexturePackerCopyLevel(array.Format, placement, level, source.Data, source.RowPitch,
+						(uint8_t*)subresource.pSysMem, subresource.SysMemPitch);
+				}
+				else
+				{
+					subresource.pSysMem = source.Data;
+					subresource.SysMemPitch = source.RowPitch;
+					subresource.SysMemSlicePitch = source.SlicePitch;
+				}
+			}
+		}
+
+		// the upload manager copies what it cannot place yet, the mapped files may close after this
+		TextureLoaderCreateTexture(m_Device, m_Uploads, data, m_PackedViews[arrayIdx].ReleaseAndGetAddressOf());
+		for (const D3D11_SUBRESOURCE_DATA& subresource : data.Subresources)
+		{
+			m_GpuBytes += subresource.SysMemSlicePitch;
+		}
+		numPages += array.NumSlices - array.FirstPage;
+	}
+
+	for (uint32_t i = 0; i < numFiles; ++i)
+	{
+		(*placements)[i] = (*placements)[sources[i]];
+	}
+
+	UtilsDebugPrint("Texture packing: %u of %u textures in %u arrays (%u atlas pages), %u duplicates shared, in %.2f ms\n",
+		numPacked,
+		numTextures,
+		(uint32_t)m_PackedArrays.size(),
+		numPages,
+		numShared,
+		TextureLoaderNowMillis() - startMillis);
+}
+
+uint32_t TextureLoader::LoadStreamed(const char* filename, TextureType type, TextureLoadedCallback onChanged)
+{
+	if (!TextureLoaderIsDDS(filename))
+	{
+		return TEXTURE_LOADER_NOT_STREAMED;
+	}
+
+	StreamedTexture streamed;
+	streamed.NextBytes = 0;
+	streamed.NextTicket = UPLOAD_MANAGER_NO_TICKET;
+	streamed.File.reset(new MappedFile());
+	if (!streamed.File->Open(filename) ||
+		DDSParse(streamed.File->GetData(), streamed.File->GetSize(), &streamed.Image) != DDSStatus::Ok ||
+		streamed.Image.Dimension != DDSDimension::Texture2D || streamed.Image.ArraySize != 1 ||
+		streamed.Image.NumLevels > TEXTURE_STREAMER_MAX_LEVELS)
+	{
+		return TEXTURE_LOADER_NOT_STREAMED;
+	}
+
+	const DDSImage& image = streamed.Image;
+	TextureStreamerDesc desc = {};
+	desc.Width = image.Width;
+	desc.Height = image.Height;
+	desc.NumLevels = image.NumLevels;
+	desc.TailLevel = TextureStreamerTailLevel(image.Width, image.Height, image.NumLevels, DDSIsBlockCompressed(image.Format));
+	for (uint32_t level = 0; level < image.NumLevels; ++level)
+	{
+		desc.LevelBytes[level] = image.GetSubresource(0, level).SlicePitch;
+	}
+
+	streamed.Filename = filename;
+	streamed.OnChanged = std::move(onChanged);
+	const uint32_t stream = m_Streamer.Register(desc);
+	m_Streamed.emplace_back(std::move(streamed));
+	CreateStreamed(stream, desc.TailLevel);
+	DeliverStreamed();
+	return stream;
+}
+
+uint32_t TextureLoader::GetStreamedSize(uint32_t stream) const
+{
+	const DDSImage& image = m_Streamed[stream].Image;
+	return image.Width > image.Height ? image.Width : image.Height;
+}
+
+// A new texture that starts at topLevel, the previous one stays in use until its levels are issued
+void TextureLoader::CreateStreamed(uint32_t stream, uint32_t topLevel)
+{
+	StreamedTexture& streamed = m_Streamed[stream];
+	const DDSImage& image = streamed.Image;
+	const DDSSubresource& top = image.GetSubresource(0, topLevel);
+
+	TextureData data;
+	data.Format = (DXGI_FORMAT)image.Format;
+	data.Width = top.Width;
+	data.Height = top.Height;
+	data.NumLevels = image.NumLevels - topLevel;
+	data.ArraySize = 1;
+	size_t gpuBytes = 0;
+	for (uint32_t level = topLevel; level < image.NumLevels; ++level)
+	{
+		const DDSSubresource& subresource = image.GetSubresource(0, level);
+		TextureLoaderAddSubresource(&data, subresource.Data, subresource.RowPitch, subresource.SlicePitch);
+		gpuBytes += subresource.SlicePitch;
+	}
+
+	if (!streamed.NextView)
+	{
+		m_StreamsUploading.push_back(stream);
+	}
+	streamed.NextTicket = TextureLoaderCreateTexture(m_Device, m_Uploads, data, streamed.NextView.ReleaseAndGetAddressOf());
+	streamed.NextBytes = gpuBytes;
+}
+
+// Tickets of different streams are not in order, every waiting stream is checked
+void TextureLoader::DeliverStreamed()
+{
+	std::vector<uint32_t> delivered;
+	for (size_t i = 0; i < m_StreamsUploading.size();)
+	{
+		const uint32_t stream = m_StreamsUploading[i];
+		if (m_Uploads && !m_Uploads->IsIssued(m_Streamed[stream].NextTicket))
+		{
+			++i;
+			continue;
+		}
+		delivered.push_back(stream);
+		m_StreamsUploading[i] = m_StreamsUploading.back();
+		m_StreamsUploading.pop_back();
+	}
+
+	for (uint32_t stream : delivered)
+	{
+		StreamedTexture& streamed = m_Streamed[stream];
+		streamed.View = std::move(streamed.NextView);
+		if (streamed.OnChanged)
+		{
+			// the callback may stream more textures and grow m_Streamed
+			TextureLoadedCallback onChanged = streamed.OnChanged;
+			onChanged(streamed.View.Get(), streamed.NextBytes);
+		}
+	}
+}
+
+void TextureLoader::UpdateStreaming()
+{
+	m_StreamerChanges.clear();
+	m_Streamer.Update(&m_StreamerChanges);
+	for (const TextureStreamerChange& change : m_StreamerChanges)
+	{
+		CreateStreamed(change.Texture, change.ToLevel);
+	}
+	DeliverStreamed();
+}
+
+#ifdef TEXTURE_LOADER_BENCHMARK
+void TextureLoaderBenchmark(const char* const* filenames, uint32_t numFiles, JobSystem* jobs)
+{
+	std::vector<unsigned char*> pixels(numFiles, nullptr);
+	auto decode = [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; ++i)
+			{
+				int width = 0;
+				int height = 0;
+				int channelsInFile = 0;
+				pixels[i] = stbi_load(filenames[i], &width, &height, &channelsInFile, TEXTURE_BUILDER_CHANNELS);
+			}
+		};
+	auto release = [&]()
+		{
+			for (uint32_t i = 0; i < numFiles; ++i)
+			{
+				if (!pixels[i])
+				{
+					UtilsDebugPrint("ERROR: Failed to load texture from %s\n", filenames[i]);
+				}
+				stbi_image_free(pixels[i]);
+				pixels[i] = nullptr;
+			}
+		};
+
+	double start = TextureLoaderNowMillis();
+	decode(0, numFiles);
+	const double serialMillis = TextureLoaderNowMillis() - start;
+	release();
+
+	start = TextureLoaderNowMillis();
+	jobs->ParallelFor(numFiles, 1, decode);
+	const double parallelMillis = TextureLoaderNowMillis() - start;
+	release();
+
+	UtilsDebugPrint("Texture decode: %u files, serial %.2f ms, parallel %.2f ms on %u workers (%.2fx)\n",
+		numFiles, serialMillis, parallelMillis, jobs->GetNumThreads(), serialMillis / parallelMillis);
+}
+
+void TextureLoaderDDSBenchmark(const char* const* images, uint32_t numImages,
+	const char* const* ddsFiles, uint32_t numDDSFiles, JobSystem* jobs)
+{
+	// returns the megapixels of all top levels and adds the elapsed time to millis
+	auto load = [jobs](const char* const* filenames, uint32_t numFiles, double* millis)
+		{
+			double megapixels = 0.0;
+			for (uint32_t i = 0; i < numFiles; ++i)
+			{
+				const double start = TextureLoaderNowMillis();
+				TextureData data;
+				size_t uncompressedBytes = 0;
+				if (!TextureLoaderDecodeFile(filenames[i], TextureType::Diffuse, jobs, &data, &uncompressedBytes))
+				{
+					UtilsDebugPrint("ERROR: Failed to load texture from %s\n", filenames[i]);
+					continue;
+				}
+
+				// touch every page like CreateTexture2D would, mapped files are read lazily
+				volatile uint32_t checksum = 0;
+				if (data.File)
+				{
+					for (size_t offset = 0; offset < data.File->GetSize(); offset += 4096)
+					{
+						checksum += data.File->GetData()[offset];
+					}
+				}
+				*millis += TextureLoaderNowMillis() - start;
+				megapixels += (double)data.Width * data.Height * data.ArraySize / (1024.0 * 1024.0);
+			}
+			return megapixels;
+		};
+
+	double imageMillis = 0.0;
+	double ddsMillis = 0.0;
+	const double imageMegapixels = load(images, numImages, &imageMillis);
+	const double ddsMegapixels = load(ddsFiles, numDDSFiles, &ddsMillis);
+
+	UtilsDebugPrint("Texture load: stb %u files %.2f MP in %.2f ms (%.2f ms/MP), dds %u files %.2f MP in %.2f ms (%.2f ms/MP)\n",
+		numImages, imageMegapixels, imageMillis, imageMegapixels > 0.0 ? imageMillis / imageMegapixels : 0.0,
+		numDDSFiles, ddsMegapixels, ddsMillis, ddsMegapixels > 0.0 ? ddsMillis / ddsMegapixels : 0.0);
+}
+#endif
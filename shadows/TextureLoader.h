@@ -0,0 +1,183 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "TextureBuilder.h"
+#include "TextureStreamer.h"
+#include "TexturePacker.h"
+#include "DDSLoader.h"
+#include "MappedFile.h"
+
+#define TEXTURE_LOADER_NUM_PLACEHOLDERS 4
+#define TEXTURE_LOADER_NOT_STREAMED UINT32_MAX
+
+class JobSystem;
+class UploadManager;
+
+// Texture levels as passed to CreateTexture2D. Subresources point either into
+// Data for decoded images or straight into the mapped DDS file, so the type is
+// move only.
+struct TextureData
+{
+	TextureData() : Format{DXGI_FORMAT_UNKNOWN}, Width{0}, Height{0}, NumLevels{0}, ArraySize{0}, IsCubemap{false} {}
+	TextureData(TextureData&& rhs) = default;
+	TextureData& operator=(TextureData&& rhs) = default;
+	TextureData(const TextureData& rhs) = delete;
+	TextureData& operator=(const TextureData& rhs) = delete;
+
+	DXGI_FORMAT Format;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t NumLevels;
+	// counts every face of a cubemap
+	uint32_t ArraySize;
+	bool IsCubemap;
+	// slice major like D3D11CalcSubresource, SysMemSlicePitch holds the level size
+	std::vector<D3D11_SUBRESOURCE_DATA> Subresources;
+	std::vector<uint8_t> Data;
+	std::unique_ptr<MappedFile> File;
+};
+
+// gpuBytes is the size of all levels of the texture
+typedef std::function<void(ID3D11ShaderResourceView* srv, size_t gpuBytes)> TextureLoadedCallback;
+
+// Decodes image files, builds their mip chains and block compresses them on
+// the job system, then creates the D3D textures on the thread that owns the
+// device context. DDS files skip all of that, their levels are uploaded
+// directly from the mapped file. Until a texture arrives, users render
+// with the 1x1 placeholder of its type.
+class TextureLoader
+{
+public:
+	TextureLoader();
+	~TextureLoader();
+	TextureLoader(const TextureLoader& rhs) = delete;
+	TextureLoader& operator=(const TextureLoader& rhs) = delete;
+
+	// jobs may be null, textures are then decoded inside Load(). Without
+	// uploads every texture is created with its levels as initial data.
+	void Init(JobSystem* jobs, ID3D11Device* device, ID3D11DeviceContext* context, UploadManager* uploads = nullptr);
+
+	// onLoaded is called from Update() once the texture is on the GPU
+	void Load(const char* filename, TextureType type, TextureLoadedCallback onLoaded);
+	// Creates GPU textures for at most maxUploads decoded images, returns how
+	// many were created. Textures whose levels still wait in the upload rings
+	// are handed out by a later call.
+	uint32_t Update(uint32_t maxUploads = UINT32_MAX);
+	// Blocks until every requested texture is decoded, created and uploaded
+	void Flush();
+
+	// Streams a single 2D DDS texture by mip level. Only the levels up to
+	// TEXTURE_STREAMER_TAIL_SIZE are created right away, finer ones follow as
+	// RequestLevel asks for them. onChanged is called once those levels are on
+	// the GPU, and again every time the resident levels change, right away
+	// without uploads. Returns TEXTURE_LOADER_NOT_STREAMED for other files,
+	// those go through Load.
+	uint32_t LoadStreamed(const char* filename, TextureType type, TextureLoadedCallback onChanged);
+	void RequestLevel(uint32_t stream, float level, float priority) { m_Streamer.Request(stream, level, priority); }
+	// Larger side of the top level
+	uint32_t GetStreamedSize(uint32_t stream) const;
+	// Recreates the streamed textures whose levels changed since the last call
+	// and hands out the ones whose levels arrived
+	void UpdateStreaming();
+	TextureStreamer* GetStreamer() { return &m_Streamer; }
+
+	// Packs the DDS files among filenames (null entries are skipped) into
+	// texture arrays and atlas pages. The arrays exist right away, draws see
+	// their levels once the uploads are issued, as after UploadManager::Flush. placements
+	// gets one entry per filename, files left unpacked go through Load or
+	// LoadStreamed as before. Files with the same key, as TextureCache::ComputeKey
+	// gives them, are packed once and share the placement; without keys every
+	// file is packed on its own. Replaces the arrays of a previous call.
+	void LoadPacked(const char* const* filenames, const uint64_t* keys, uint32_t numFiles,
+		std::vector<TexturePackerPlacement>* placements);
+	ID3D11ShaderResourceView* GetPackedView(uint32_t array) const { return m_PackedViews[array].Get(); }
+	const TexturePackerArray& GetPackedArray(uint32_t array) const { return m_PackedArrays[array]; }
+
+	ID3D11ShaderResourceView* GetPlaceholder(TextureType type) const { return m_Placeholders[(uint32_t)type].Get(); }
+	uint32_t GetNumPending() const { return m_NumPending; }
+	size_t GetGpuBytes() const { return m_GpuBytes; }
+
+private:
+	struct DecodedImage
+	{
+		uint32_t Request;
+		// no levels if decoding failed
+		TextureData Texture;
+		size_t UncompressedBytes;
+	};
+
+	struct Request
+	{
+		std::string Filename;
+		TextureType Type;
+		TextureLoadedCallback OnLoaded;
+	};
+
+	struct Uploading
+	{
+		uint32_t Request;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> View;
+		size_t GpuBytes;
+		uint64_t Ticket;
+	};
+
+	// Levels of a streamed texture point into the mapped file for its whole lifetime
+	struct StreamedTexture
+	{
+		std::string Filename;
+		std::unique_ptr<MappedFile> File;
+		DDSImage Image;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> View;
+		TextureLoadedCallback OnChanged;
+		// replaces View once its levels are issued, a later change replaces it first
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> NextView;
+		size_t NextBytes;
+		uint64_t NextTicket;
+	};
+
+	void Decode(uint32_t request, const std::string& filename, TextureType type);
+	void CreatePlaceholders();
+	void CreateStreamed(uint32_t stream, uint32_t topLevel);
+	void DeliverStreamed();
+
+	JobSystem* m_Jobs;
+	ID3D11Device* m_Device;
+	ID3D11DeviceContext* m_Context;
+	UploadManager* m_Uploads;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> m_Placeholders[TEXTURE_LOADER_NUM_PLACEHOLDERS];
+	std::vector<Request> m_Requests;
+	std::vector<Uploading> m_Uploading;
+	// indexed by the streamer ids
+	std::vector<StreamedTexture> m_Streamed;
+	TextureStreamer m_Streamer;
+	std::vector<TextureStreamerChange> m_StreamerChanges;
+	// streams with a NextView
+	std::vector<uint32_t> m_StreamsUploading;
+	std::vector<TexturePackerArray> m_PackedArrays;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> m_PackedViews;
+	uint32_t m_NumPending;
+	double m_StartMillis;
+	size_t m_GpuBytes;
+	size_t m_UncompressedBytes;
+
+	// filled by the workers
+	std::mutex m_DecodedMutex;
+	std::vector<DecodedImage> m_Decoded;
+};
+
+#ifdef TEXTURE_LOADER_BENCHMARK
+// Decodes the files once serially and once on the job system and prints both times
+void TextureLoaderBenchmark(const char* const* filenames, uint32_t numFiles, JobSystem* jobs);
+// Prints the time per megapixel to get upload ready levels through the stb path
+// (decode, mips, compression) and through the DDS path (map, parse, page in)
+void TextureLoaderDDSBenchmark(const char* const* images, uint32_t numImages,
+	const char* const* ddsFiles, uint32_t numDDSFiles, JobSystem* jobs);
+#endif
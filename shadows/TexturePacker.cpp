@@ -0,0 +1,465 @@
+#include "TexturePacker.h"
+#include "DDSLoader.h"
+
+#include <algorithm>
+#include <string.h>
+
+static uint32_t TexturePackerAlignUp(uint32_t value, uint32_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static uint32_t TexturePackerCountLevels(uint32_t width, uint32_t height)
+{
+	uint32_t size = width > height ? width : height;
+	uint32_t levels = 1;
+	while (size > 1)
+	{
+		size >>= 1;
+		++levels;
+	}
+	return levels;
+}
+
+// Texels covered by one element of the level data, a whole block for compressed formats
+static uint32_t TexturePackerUnit(uint32_t format)
+{
+	return DDSIsBlockCompressed(format) ? 4 : 1;
+}
+
+static uint32_t TexturePackerElementBytes(uint32_t format)
+{
+	return DDSIsBlockCompressed(format) ? DDSBitsPerPixel(format) * 2 : DDSBitsPerPixel(format) / 8;
+}
+
+static bool TexturePackerIsSmall(const TexturePackerInput& input)
+{
+	return input.Width <= TEXTURE_PACKER_ATLAS_MAX_SIZE && input.Height <= TEXTURE_PACKER_ATLAS_MAX_SIZE;
+}
+
+uint32_t TexturePackerLevelPadding(uint32_t format, uint32_t level)
+{
+	const uint32_t padding = TEXTURE_PACKER_PADDING >> level;
+	const uint32_t unit = TexturePackerUnit(format);
+	return padding / unit * unit;
+}
+
+// Every level down to MaxLevel has to start on an element and halve exactly,
+// otherwise the rect would share blocks with its neighbours
+static uint32_t TexturePackerAtlasMaxLevel(const TexturePackerInput& input, const TexturePackerPlacement& placement,
+	const TexturePackerArray& array)
+{
+	const uint32_t unit = TexturePackerUnit(input.Format);
+	uint32_t maxLevel = 0;
+	while (maxLevel + 1 < input.NumLevels && maxLevel + 1 < array.NumLevels)
+	{
+		const uint32_t granularity = unit << (maxLevel + 1);
+		if (placement.X % granularity || placement.Y % granularity ||
+			placement.Width % granularity || placement.Height % granularity)
+		{
+			break;
+		}
+		++maxLevel;
+	}
+	return maxLevel;
+}
+
+// Shelf packs the small textures of one format tallest first, pages are appended to the array
+static void TexturePackerPackAtlas(const TexturePackerInput* inputs, std::vector<uint32_t>* textures, uint32_t arrayIdx,
+	std::vector<TexturePackerArray>* arrays, std::vector<TexturePackerPlacement>* placements)
+{
+	std::stable_sort(textures->begin(), textures->end(), [inputs](uint32_t a, uint32_t b)
+		{
+			return inputs[a].Height > inputs[b].Height;
+		});
+
+	TexturePackerArray& array = (*arrays)[arrayIdx];
+	array.FirstPage = array.NumSlices;
+	const uint32_t start = TexturePackerAlignUp(TEXTURE_PACKER_PADDING, TEXTURE_PACKER_ALIGNMENT);
+	uint32_t page = 0;
+	uint32_t cursorX = 0;
+	uint32_t shelfY = start;
+	uint32_t shelfEnd = 0;
+	for (const uint32_t texture : *textures)
+	{
+		const TexturePackerInput& input = inputs[texture];
+		uint32_t x = TexturePackerAlignUp(cursorX + TEXTURE_PACKER_PADDING, TEXTURE_PACKER_ALIGNMENT);
+		if (x + input.Width + TEXTURE_PACKER_PADDING > array.Width)
+		{
+			x = start;
+			shelfY = TexturePackerAlignUp(shelfEnd + TEXTURE_PACKER_PADDING, TEXTURE_PACKER_ALIGNMENT);
+		}
+		if (shelfY + input.Height + TEXTURE_PACKER_PADDING > array.Height)
+		{
+			++page;
+			x = start;
+			shelfY = start;
+			shelfEnd = 0;
+		}
+
+		TexturePackerPlacement& placement = (*placements)[texture];
+		placement.Array = arrayIdx;
+		placement.Slice = array.FirstPage + page;
+		placement.X = x;
+		placement.Y = shelfY;
+		placement.Width = input.Width;
+		placement.Height = input.Height;
+		placement.InAtlas = true;
+		placement.MaxLevel = TexturePackerAtlasMaxLevel(input, placement, array);
+
+		cursorX = x + input.Width + TEXTURE_PACKER_PADDING;
+		shelfEnd = std::max(shelfEnd, shelfY + input.Height + TEXTURE_PACKER_PADDING);
+	}
+	array.NumSlices = array.FirstPage + page + 1;
+}
+
+void TexturePackerPack(const TexturePackerInput* inputs, uint32_t numInputs,
+	std::vector<TexturePackerArray>* arrays, std::vector<TexturePackerPlacement>* placements)
+{
+	TexturePackerPlacement unpacked = {};
+	unpacked.Array = TEXTURE_PACKER_UNPACKED;
+	placements->assign(numInputs, unpacked);
+	arrays->clear();
+
+	// whole slices, the groups are few so a linear search finds them
+	std::vector<std::vector<uint32_t>> groups;
+	std::vector<uint32_t> small;
+	for (uint32_t i = 0; i < numInputs; ++i)
+	{
+		const TexturePackerInput& input = inputs[i];
+		if (TexturePackerElementBytes(input.Format) == 0 || input.Width == 0 || input.Height == 0 || input.NumLevels == 0)
+		{
+			continue;
+		}
+		if (TexturePackerIsSmall(input))
+		{
+			small.emplace_back(i);
+			continue;
+		}
+
+		auto group = std::find_if(groups.begin(), groups.end(), [inputs, &input](const std::vector<uint32_t>& g)
+			{
+				const TexturePackerInput& other = inputs[g.front()];
+				return other.Format == input.Format && other.Width == input.Width &&
+					other.Height == input.Height && other.NumLevels == input.NumLevels;
+			});
+		if (group == groups.end())
+		{
+			groups.emplace_back(1, i);
+		}
+		else
+		{
+			group->emplace_back(i);
+		}
+	}
+
+	for (const std::vector<uint32_t>& group : groups)
+	{
+		if (group.size() < 2)
+		{
+			continue;
+		}
+
+		const TexturePackerInput& first = inputs[group.front()];
+		TexturePackerArray array = {};
+		array.Format = first.Format;
+		array.Width = first.Width;
+		array.Height = first.Height;
+		array.NumLevels = first.NumLevels;
+		array.NumSlices = (uint32_t)group.size();
+		array.FirstPage = array.NumSlices;
+		for (uint32_t slice = 0; slice < group.size(); ++slice)
+		{
+			TexturePackerPlacement& placement = (*placements)[group[slice]];
+			placement.Array = (uint32_t)arrays->size();
+			placement.Slice = slice;
+			placement.Width = first.Width;
+			placement.Height = first.Height;
+			placement.MaxLevel = first.NumLevels - 1;
+		}
+		arrays->emplace_back(array);
+	}
+
+	// atlas pages per format
+	const uint32_t minPageSize = TEXTURE_PACKER_ATLAS_MAX_SIZE + 2 * TEXTURE_PACKER_ALIGNMENT;
+	while (!small.empty())
+	{
+		const uint32_t format = inputs[small.front()].Format;
+		std::vector<uint32_t> textures;
+		auto rest = std::stable_partition(small.begin(), small.end(), [inputs, format](uint32_t i) { return inputs[i].Format == format; });
+		textures.assign(small.begin(), rest);
+		small.erase(small.begin(), rest);
+
+		// pages join the biggest array of the format, the whole set is then one bind
+		uint32_t target = TEXTURE_PACKER_UNPACKED;
+		for (uint32_t i = 0; i < arrays->size(); ++i)
+		{
+			const TexturePackerArray& array = (*arrays)[i];
+			if (array.Format == format && array.Width >= minPageSize && array.Height >= minPageSize &&
+				(target == TEXTURE_PACKER_UNPACKED ||
+				(uint64_t)array.Width * array.Height > (uint64_t)(*arrays)[target].Width * (*arrays)[target].Height))
+			{
+				target = i;
+			}
+		}
+
+		if (target == TEXTURE_PACKER_UNPACKED)
+		{
+			if (textures.size() < 2)
+			{
+				continue;
+			}
+			TexturePackerArray array = {};
+			array.Format = format;
+			array.Width = TEXTURE_PACKER_PAGE_SIZE;
+			array.Height = TEXTURE_PACKER_PAGE_SIZE;
+			array.NumLevels = TexturePackerCountLevels(TEXTURE_PACKER_PAGE_SIZE, TEXTURE_PACKER_PAGE_SIZE);
+			target = (uint32_t)arrays->size();
+			arrays->emplace_back(array);
+		}
+		TexturePackerPackAtlas(inputs, &textures, target, arrays, placements);
+	}
+}
+
+void TexturePackerUVTransform(const TexturePackerPlacement& placement, const TexturePackerArray& array, float scaleOffset[4])
+{
+	if (!placement.InAtlas)
+	{
+		scaleOffset[0] = 1.0f;
+		scaleOffset[1] = 1.0f;
+		scaleOffset[2] = 0.0f;
+		scaleOffset[3] = 0.0f;
+		return;
+	}
+
+	scaleOffset[0] = (float)placement.Width / (float)array.Width;
+	scaleOffset[1] = (float)placement.Height / (float)array.Height;
+	scaleOffset[2] = (float)placement.X / (float)array.Width;
+	scaleOffset[3] = (float)placement.Y / (float)array.Height;
+}
+
+void TexturePackerCopyLevel(uint32_t format, const TexturePackerPlacement& placement, uint32_t level,
+	const uint8_t* src, uint32_t srcRowPitch, uint8_t* dst, uint32_t dstRowPitch)
+{
+	// in elements, MaxLevel guarantees the rect is made of whole ones
+	const uint32_t unit = TexturePackerUnit(format);
+	const int32_t elementBytes = (int32_t)TexturePackerElementBytes(format);
+	const int32_t x = (int32_t)((placement.X >> level) / unit);
+	const int32_t y = (int32_t)((placement.Y >> level) / unit);
+	const int32_t width = (int32_t)((placement.Width >> level) / unit);
+	const int32_t height = (int32_t)((placement.Height >> level) / unit);
+	const int32_t padding = (int32_t)(TexturePackerLevelPadding(format, level) / unit);
+
+	for (int32_t row = -padding; row < height + padding; ++row)
+	{
+		const uint8_t* srcRow = src + (size_t)std::min(std::max(row, 0), height - 1) * srcRowPitch;
+		uint8_t* dstRow = dst + (size_t)(y + row) * dstRowPitch + (size_t)x * elementBytes;
+		for (int32_t column = -padding; column < 0; ++column)
+		{
+			memcpy(dstRow + column * elementBytes, srcRow, elementBytes);
+		}
+		memcpy(dstRow, srcRow, (size_t)width * elementBytes);
+		for (int32_t column = width; column < width + padding; ++column)
+		{
+			memcpy(dstRow + column * elementBytes, srcRow + (size_t)(width - 1) * elementBytes, elementBytes);
+		}
+	}
+}
+
+#ifdef TEXTURE_PACKER_TEST
+#include <assert.h>
+#include <math.h>
+
+static bool TexturePackerOverlaps(const TexturePackerPlacement& a, const TexturePackerPlacement& b)
+{
+	// padded rects, the padding of two neighbours must not touch either
+	const uint32_t p = TEXTURE_PACKER_PADDING;
+	return a.X - p < b.X + b.Width + p && b.X - p < a.X + a.Width + p &&
+		a.Y - p < b.Y + b.Height + p && b.Y - p < a.Y + a.Height + p;
+}
+
+static void TexturePackerTestLayout(const std::vector<TexturePackerArray>& arrays, const std::vector<TexturePackerPlacement>& placements)
+{
+	for (size_t i = 0; i < placements.size(); ++i)
+	{
+		const TexturePackerPlacement& a = placements[i];
+		if (a.Array == TEXTURE_PACKER_UNPACKED)
+		{
+			continue;
+		}
+		const TexturePackerArray& array = arrays[a.Array];
+		assert(a.Slice < array.NumSlices && a.MaxLevel < array.NumLevels);
+		if (!a.InAtlas)
+		{
+			assert(a.Slice < array.FirstPage && a.Width == array.Width && a.Height == array.Height);
+			continue;
+		}
+
+		assert(a.Slice >= array.FirstPage);
+		assert(a.X % TEXTURE_PACKER_ALIGNMENT == 0 && a.Y % TEXTURE_PACKER_ALIGNMENT == 0);
+		assert(a.X >= TEXTURE_PACKER_PADDING && a.X + a.Width + TEXTURE_PACKER_PADDING <= array.Width);
+		assert(a.Y >= TEXTURE_PACKER_PADDING && a.Y + a.Height + TEXTURE_PACKER_PADDING <= array.Height);
+		for (size_t j = i + 1; j < placements.size(); ++j)
+		{
+			const TexturePackerPlacement& b = placements[j];
+			assert(b.Array != a.Array || b.Slice != a.Slice || !TexturePackerOverlaps(a, b));
+		}
+	}
+}
+
+void TexturePackerTest(void)
+{
+	// grouping: same format, size and levels make an array, small textures join it as pages
+	{
+		const TexturePackerInput inputs[] = {
+			{DDS_FORMAT_BC7_UNORM, 1024, 1024, 11},
+			{DDS_FORMAT_BC7_UNORM, 612, 612, 10},
+			{DDS_FORMAT_BC7_UNORM, 1024, 1024, 11},
+			{DDS_FORMAT_R8G8B8A8_UNORM, 1024, 449, 11},
+			{DDS_FORMAT_BC4_UNORM, 1024, 1024, 11},
+			{DDS_FORMAT_BC7_UNORM, 256, 256, 9},
+			{DDS_FORMAT_R8G8B8A8_UNORM, 1024, 449, 11},
+			{DDS_FORMAT_BC7_UNORM, 128, 64, 8},
+			{DDS_FORMAT_R8G8B8A8_UNORM, 100, 60, 7},
+			{DDS_FORMAT_BC1_UNORM, 64, 64, 7},
+			{DDS_FORMAT_BC1_UNORM, 32, 32, 6},
+			{DDS_FORMAT_BC5_UNORM, 16, 16, 5},
+			{DDS_FORMAT_UNKNOWN, 16, 16, 1},
+		};
+		std::vector<TexturePackerArray> arrays;
+		std::vector<TexturePackerPlacement> placements;
+		TexturePackerPack(inputs, _countof(inputs), &arrays, &placements);
+		assert(placements.size() == _countof(inputs));
+		TexturePackerTestLayout(arrays, placements);
+
+		// BC7 and RGBA8 arrays with a page each, the BC1 textures get a page array of their own
+		assert(arrays.size() == 3);
+		assert(arrays[0].Format == DDS_FORMAT_BC7_UNORM && arrays[0].NumSlices == 3 && arrays[0].FirstPage == 2);
+		assert(arrays[1].Format == DDS_FORMAT_R8G8B8A8_UNORM && arrays[1].NumSlices == 3 && arrays[1].FirstPage == 2);
+		assert(arrays[2].Format == DDS_FORMAT_BC1_UNORM && arrays[2].NumSlices == 1 && arrays[2].FirstPage == 0);
+		assert(arrays[2].Width == TEXTURE_PACKER_PAGE_SIZE && arrays[2].NumLevels == 11);
+		assert(placements[0].Array == 0 && placements[0].Slice == 0 && placements[2].Array == 0 && placements[2].Slice == 1);
+		assert(placements[0].MaxLevel == 10 && !placements[0].InAtlas);
+		assert(placements[3].Array == 1 && placements[6].Array == 1 && placements[6].Slice == 1);
+		assert(placements[5].Array == 0 && placements[5].Slice == 2 && placements[7].Slice == 2 && placements[5].InAtlas);
+		assert(placements[8].Array == 1 && placements[8].Slice == 2);
+		assert(placements[9].Array == 2 && placements[10].Array == 2);
+
+		// alone in their format, or of a format without a layout
+		assert(placements[1].Array == TEXTURE_PACKER_UNPACKED);
+		assert(placements[4].Array == TEXTURE_PACKER_UNPACKED);
+		assert(placements[11].Array == TEXTURE_PACKER_UNPACKED);
+		assert(placements[12].Array == TEXTURE_PACKER_UNPACKED);
+
+		// tallest first on the first shelf, levels stop where blocks or texels no longer halve exactly
+		assert(placements[5].X == 32 && placements[5].Y == 32);
+		assert(placements[5].MaxLevel == 3);
+		assert(placements[7].X == 320 && placements[7].Y == 32 && placements[7].MaxLevel == 3);
+		assert(placements[8].MaxLevel == 2);
+	}
+
+	// overflowing pages: 3 rects of 256 with padding fit a shelf and 3 shelves a page
+	{
+		std::vector<TexturePackerInput> inputs(40, {DDS_FORMAT_BC1_UNORM, 256, 256, 9});
+		inputs.push_back({DDS_FORMAT_BC1_UNORM, 64, 32, 7});
+		std::vector<TexturePackerArray> arrays;
+		std::vector<TexturePackerPlacement> placements;
+		TexturePackerPack(inputs.data(), (uint32_t)inputs.size(), &arrays, &placements);
+		TexturePackerTestLayout(arrays, placements);
+		assert(arrays.size() == 1 && arrays[0].NumSlices == 5);
+		assert(placements[8].Slice == 0 && placements[9].Slice == 1 && placements[39].Slice == 4);
+		assert(placements[40].Slice == 4 && placements[40].X == 320 && placements[40].Y == 320);
+	}
+
+	// padding replicates the edge texels, the rest of the page stays untouched
+	{
+		const uint32_t pageSize = 32;
+		TexturePackerArray array = {DDS_FORMAT_R8G8B8A8_UNORM, pageSize, pageSize, 6, 1, 0};
+		TexturePackerPlacement placement = {};
+		placement.X = 8;
+		placement.Y = 16;
+		placement.Width = 8;
+		placement.Height = 4;
+		placement.InAtlas = true;
+
+		uint32_t texels[8 * 4];
+		for (uint32_t i = 0; i < _countof(texels); ++i)
+		{
+			texels[i] = i + 1;
+		}
+		for (uint32_t level = 0; level < 2; ++level)
+		{
+			const uint32_t size = pageSize >> level;
+			std::vector<uint32_t> page(size * size, 0xdeadbeef);
+			TexturePackerCopyLevel(array.Format, placement, level, (const uint8_t*)texels, (8 >> level) * sizeof(uint32_t),
+				(uint8_t*)page.data(), size * sizeof(uint32_t));
+
+			const int32_t x = placement.X >> level;
+			const int32_t y = placement.Y >> level;
+			const int32_t width = placement.Width >> level;
+			const int32_t height = placement.Height >> level;
+			const int32_t padding = (int32_t)TexturePackerLevelPadding(array.Format, level);
+			assert(padding == (level == 0 ? 8 : 4));
+			for (int32_t row = 0; row < (int32_t)size; ++row)
+			{
+				for (int32_t column = 0; column < (int32_t)size; ++column)
+				{
+					const int32_t u = column - x;
+					const int32_t v = row - y;
+					const uint32_t texel = page[row * size + column];
+					if (u < -padding || u >= width + padding || v < -padding || v >= height + padding)
+					{
+						assert(texel == 0xdeadbeef);
+						continue;
+					}
+					const int32_t su = std::min(std::max(u, 0), width - 1);
+					const int32_t sv = std::min(std::max(v, 0), height - 1);
+					assert(texel == texels[sv * width + su]);
+				}
+			}
+		}
+
+		// compressed levels copy whole blocks and lose the padding below a block
+		assert(TexturePackerLevelPadding(DDS_FORMAT_BC1_UNORM, 0) == 8);
+		assert(TexturePackerLevelPadding(DDS_FORMAT_BC1_UNORM, 1) == 4);
+		assert(TexturePackerLevelPadding(DDS_FORMAT_BC1_UNORM, 2) == 0);
+		uint64_t blocks[2 * 1] = {0x1111, 0x2222};
+		std::vector<uint64_t> page((pageSize / 4) * (pageSize / 4), 0);
+		TexturePackerCopyLevel(DDS_FORMAT_BC1_UNORM, placement, 0, (const uint8_t*)blocks, sizeof(blocks),
+			(uint8_t*)page.data(), (pageSize / 4) * sizeof(uint64_t));
+		const uint32_t blockRow = pageSize / 4;
+		assert(page[4 * blockRow + 2] == 0x1111 && page[4 * blockRow + 3] == 0x2222);
+		assert(page[2 * blockRow + 0] == 0x1111 && page[6 * blockRow + 5] == 0x2222);
+		assert(page[1 * blockRow + 0] == 0 && page[4 * blockRow + 6] == 0);
+	}
+
+	// uv remap: the corners land on the rect, texel centers on the matching page texel centers
+	{
+		const TexturePackerArray array = {DDS_FORMAT_BC7_UNORM, 1024, 512, 11, 2, 1};
+		TexturePackerPlacement placement = {};
+		placement.Array = 0;
+		placement.Slice = 1;
+		placement.X = 320;
+		placement.Y = 64;
+		placement.Width = 128;
+		placement.Height = 64;
+		placement.InAtlas = true;
+
+		float scaleOffset[4];
+		TexturePackerUVTransform(placement, array, scaleOffset);
+		const float eps = 1e-6f;
+		assert(fabsf(scaleOffset[2] * array.Width - placement.X) < eps);
+		assert(fabsf(scaleOffset[3] * array.Height - placement.Y) < eps);
+		assert(fabsf((scaleOffset[0] + scaleOffset[2]) * array.Width - (placement.X + placement.Width)) < 1e-3f);
+		assert(fabsf((scaleOffset[1] + scaleOffset[3]) * array.Height - (placement.Y + placement.Height)) < 1e-3f);
+		const float u = (5.0f + 0.5f) / placement.Width;
+		const float v = (7.0f + 0.5f) / placement.Height;
+		assert(fabsf((u * scaleOffset[0] + scaleOffset[2]) * array.Width - (placement.X + 5.5f)) < 1e-3f);
+		assert(fabsf((v * scaleOffset[1] + scaleOffset[3]) * array.Height - (placement.Y + 7.5f)) < 1e-3f);
+
+		placement.InAtlas = false;
+		TexturePackerUVTransform(placement, array, scaleOffset);
+		assert(scaleOffset[0] == 1.0f && scaleOffset[1] == 1.0f && scaleOffset[2] == 0.0f && scaleOffset[3] == 0.0f);
+	}
+}
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Groups textures so that many materials share one bind. Textures of the same
+// format, size and mip count become slices of a Texture2DArray. Textures at
+// most TEXTURE_PACKER_ATLAS_MAX_SIZE big are shelf packed into atlas pages,
+// which join the largest array of their format as extra slices or form arrays
+// of their own. A material then only needs a slice and a rect per texture.
+// Formats are DDSFormat (DXGI_FORMAT) values, nothing here touches D3D.
+
+#define TEXTURE_PACKER_UNPACKED UINT32_MAX
+#define TEXTURE_PACKER_ATLAS_MAX_SIZE 256
+// size of pages that do not join an existing array
+#define TEXTURE_PACKER_PAGE_SIZE 1024
+// texels of replicated edge around every atlas rect at the top level, halved per level
+#define TEXTURE_PACKER_PADDING 8
+// atlas rects start at multiples of this, which keeps the first levels block aligned
+#define TEXTURE_PACKER_ALIGNMENT 32
+
+struct TexturePackerInput
+{
+	uint32_t Format;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t NumLevels;
+};
+
+struct TexturePackerArray
+{
+	uint32_t Format;
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t NumLevels;
+	uint32_t NumSlices;
+	// slices from here on are atlas pages
+	uint32_t FirstPage;
+};
+
+struct TexturePackerPlacement
+{
+	// TEXTURE_PACKER_UNPACKED for textures that would end up alone
+	uint32_t Array;
+	uint32_t Slice;
+	// top level rect inside the slice, the whole slice unless InAtlas
+	uint32_t X;
+	uint32_t Y;
+	uint32_t Width;
+	uint32_t Height;
+	// coarsest level of the slice that holds the texture, sampling has to stop there
+	uint32_t MaxLevel;
+	bool InAtlas;
+};
+
+// One placement per input, in input order. Inputs with an unknown format or
+// that share nothing with the other inputs are left unpacked.
+void TexturePackerPack(const TexturePackerInput* inputs, uint32_t numInputs,
+	std::vector<TexturePackerArray>* arrays, std::vector<TexturePackerPlacement>* placements);
+
+// Maps texture coordinates of the texture to the slice: uv * scale + offset,
+// scaleOffset holds scale in xy and offset in zw. Atlas users wrap uv first.
+void TexturePackerUVTransform(const TexturePackerPlacement& placement, const TexturePackerArray& array, float scaleOffset[4]);
+
+// Padding at a level, block compressed formats lose it once it is below a block
+uint32_t TexturePackerLevelPadding(uint32_t format, uint32_t level);
+
+// Copies one level of an atlas texture into the same level of its page and
+// fills the padding with the nearest edge texels (edge blocks for block
+// compressed formats). level must not exceed the placement's MaxLevel.
+void TexturePackerCopyLevel(uint32_t format, const TexturePackerPlacement& placement, uint32_t level,
+	const uint8_t* src, uint32_t srcRowPitch, uint8_t* dst, uint32_t dstRowPitch);
+
+#ifdef TEXTURE_PACKER_TEST
+void TexturePackerTest(void);
+#endif
@@ -0,0 +1,477 @@
+#include "TextureStreamer.h"
+#include "Utils.h"
+
+#include <math.h>
+#include <queue>
+
+TextureStreamer::TextureStreamer():
+	m_Budget{TEXTURE_STREAMER_DEFAULT_BUDGET},
+	m_MaxUploads{TEXTURE_STREAMER_DEFAULT_UPLOADS},
+	m_ResidentBytes{0},
+	m_PeakResidentBytes{0},
+	m_Frame{0},
+	m_NumLevelsIn{0},
+	m_NumLevelsOut{0}
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+}
+
+void TextureStreamer::Init(size_t budgetBytes, uint32_t maxUploads)
+{
+	m_Budget = budgetBytes;
+	m_MaxUploads = maxUploads;
+}
+
+uint32_t TextureStreamer::Register(const TextureStreamerDesc& desc)
+{
+	Texture texture = {};
+	texture.Desc = desc;
+	texture.ResidentLevel = desc.TailLevel;
+	texture.WantedLevel = desc.TailLevel;
+	texture.RequestedLevel = UINT32_MAX;
+	for (uint32_t level = desc.TailLevel; level < desc.NumLevels; ++level)
+	{
+		m_ResidentBytes += desc.LevelBytes[level];
+	}
+	m_Textures.emplace_back(texture);
+	return (uint32_t)m_Textures.size() - 1;
+}
+
+void TextureStreamer::Request(uint32_t texture, float level, float priority)
+{
+	Texture& entry = m_Textures[texture];
+	const uint32_t wanted = (uint32_t)MathClamp(0.0f, (float)entry.Desc.TailLevel, floorf(level));
+	entry.RequestedLevel = entry.RequestedLevel < wanted ? entry.RequestedLevel : wanted;
+	entry.RequestedPriority = entry.RequestedPriority > priority ? entry.RequestedPriority : priority;
+}
+
+TextureStreamer::EvictionKey TextureStreamer::MakeEvictionKey(uint32_t texture) const
+{
+	const Texture& entry = m_Textures[texture];
+	EvictionKey key = {};
+	key.Needed = entry.ResidentLevel >= entry.WantedLevel;
+	key.Priority = entry.Priority;
+	key.LastRequest = entry.LastRequest;
+	key.Texture = texture;
+	return key;
+}
+
+void TextureStreamer::Move(uint32_t texture, uint32_t level, std::vector<TextureStreamerChange>* changes, size_t firstChange)
+{
+	Texture& entry = m_Textures[texture];
+	if (level < entry.ResidentLevel)
+	{
+		for (uint32_t i = level; i < entry.ResidentLevel; ++i)
+		{
+			m_ResidentBytes += entry.Desc.LevelBytes[i];
+		}
+		m_NumLevelsIn += entry.ResidentLevel - level;
+	}
+	else
+	{
+		for (uint32_t i = entry.ResidentLevel; i < level; ++i)
+		{
+			m_ResidentBytes -= entry.Desc.LevelBytes[i];
+		}
+		m_NumLevelsOut += level - entry.ResidentLevel;
+	}
+
+	// one change per texture and Update
+	size_t i = firstChange;
+	while (i < changes->size() && (*changes)[i].Texture != texture)
+	{
+		++i;
+	}
+	if (i == changes->size())
+	{
+		TextureStreamerChange change = {};
+		change.Texture = texture;
+		change.FromLevel = entry.ResidentLevel;
+		changes->emplace_back(change);
+	}
+	(*changes)[i].ToLevel = level;
+	entry.ResidentLevel = level;
+}
+
+void TextureStreamer::Update(std::vector<TextureStreamerChange>* changes)
+{
+	const size_t firstChange = changes->size();
+	++m_Frame;
+
+	// textures nobody asked for only need their tail
+	for (Texture& entry : m_Textures)
+	{
+		if (entry.RequestedLevel != UINT32_MAX)
+		{
+			entry.WantedLevel = entry.RequestedLevel;
+			entry.Priority = entry.RequestedPriority;
+			entry.LastRequest = m_Frame;
+		}
+		else
+		{
+			entry.WantedLevel = entry.Desc.TailLevel;
+			entry.Priority = 0.0f;
+		}
+		entry.RequestedLevel = UINT32_MAX;
+		entry.RequestedPriority = 0.0f;
+	}
+
+	// top is evicted first: levels nobody needs by age, then needed levels by priority
+	auto evictLater = [](const EvictionKey& a, const EvictionKey& b)
+		{
+			if (a.Needed != b.Needed)
+				return a.Needed;
+			if (!a.Needed)
+				return a.LastRequest > b.LastRequest;
+			return a.Priority > b.Priority;
+		};
+	std::priority_queue<EvictionKey, std::vector<EvictionKey>, decltype(evictLater)> evictions(evictLater);
+	for (uint32_t texture = 0; texture < (uint32_t)m_Textures.size(); ++texture)
+	{
+		if (CanEvict(texture))
+		{
+			evictions.push(MakeEvictionKey(texture));
+		}
+	}
+
+	// drops one level of the best candidate other than exclude, needed levels only below maxPriority
+	auto evictOne = [&](uint32_t exclude, float maxPriority)
+		{
+			std::vector<EvictionKey> skipped;
+			bool evicted = false;
+			while (!evictions.empty())
+			{
+				const EvictionKey key = evictions.top();
+				evictions.pop();
+				if (!CanEvict(key.Texture))
+				{
+					continue;
+				}
+				// keys go stale when a level moves, requeue with the current state
+				const EvictionKey current = MakeEvictionKey(key.Texture);
+				if (current.Needed != key.Needed || current.Priority != key.Priority || current.LastRequest != key.LastRequest)
+				{
+					evictions.push(current);
+					continue;
+				}
+				if (key.Texture == exclude)
+				{
+					skipped.emplace_back(key);
+					continue;
+				}
+				if (key.Needed && key.Priority >= maxPriority)
+				{
+					skipped.emplace_back(key);
+					break;
+				}
+
+				Move(key.Texture, m_Textures[key.Texture].ResidentLevel + 1, changes, firstChange);
+				if (CanEvict(key.Texture))
+				{
+					evictions.push(MakeEvictionKey(key.Texture));
+				}
+				evicted = true;
+				break;
+			}
+			for (const EvictionKey& key : skipped)
+			{
+				evictions.push(key);
+			}
+			return evicted;
+		};
+
+	// the budget may have been lowered
+	while (m_ResidentBytes > m_Budget && evictOne(UINT32_MAX, INFINITY))
+	{
+	}
+
+	auto uploadLater = [this](uint32_t a, uint32_t b) { return m_Textures[a].Priority < m_Textures[b].Priority; };
+	std::priority_queue<uint32_t, std::vector<uint32_t>, decltype(uploadLater)> uploads(uploadLater);
+	for (uint32_t texture = 0; texture < (uint32_t)m_Textures.size(); ++texture)
+	{
+		if (m_Textures[texture].ResidentLevel > m_Textures[texture].WantedLevel)
+		{
+			uploads.push(texture);
+		}
+	}
+
+	uint32_t numUploads = 0;
+	while (numUploads < m_MaxUploads && !uploads.empty())
+	{
+		const uint32_t texture = uploads.top();
+		uploads.pop();
+
+		const Texture& entry = m_Textures[texture];
+		const uint32_t level = entry.ResidentLevel - 1;
+		bool fits = true;
+		while (fits && m_ResidentBytes + entry.Desc.LevelBytes[level] > m_Budget)
+		{
+			fits = evictOne(texture, entry.Priority);
+		}
+		if (!fits)
+		{
+			continue;
+		}
+
+		Move(texture, level, changes, firstChange);
+		evictions.push(MakeEvictionKey(texture));
+		++numUploads;
+		if (entry.ResidentLevel > entry.WantedLevel)
+		{
+			uploads.push(texture);
+		}
+	}
+
+	// a level may have been dropped and streamed in again
+	size_t numChanges = firstChange;
+	for (size_t i = firstChange; i < changes->size(); ++i)
+	{
+		if ((*changes)[i].FromLevel != (*changes)[i].ToLevel)
+		{
+			(*changes)[numChanges++] = (*changes)[i];
+		}
+	}
+	changes->resize(numChanges);
+
+	m_PeakResidentBytes = m_ResidentBytes > m_PeakResidentBytes ? m_ResidentBytes : m_PeakResidentBytes;
+}
+
+void TextureStreamer::PrintStats() const
+{
+	UtilsDebugPrint("Texture streaming: %u textures, %.2f MB resident (peak %.2f MB) of %.2f MB budget, %u levels in, %u levels out\n",
+		(uint32_t)m_Textures.size(),
+		(float)m_ResidentBytes / (1024.0f * 1024.0f),
+		(float)m_PeakResidentBytes / (1024.0f * 1024.0f),
+		(float)m_Budget / (1024.0f * 1024.0f),
+		m_NumLevelsIn,
+		m_NumLevelsOut);
+}
+
+float TextureStreamerComputeLevel(const AABB& bounds, const Vec3D& eye, float verticalFov, uint32_t screenHeight,
+	uint32_t textureSize, float* priority)
+{
+	const Vec3D center = MathAABBCenter(&bounds);
+	const Vec3D extents = MathAABBExtents(&bounds);
+	const Vec3D toCenter = MathVec3DSubtraction(&center, &eye);
+	const float radius = sqrtf(MathVec3DDot(&extents, &extents));
+	// inside the bounding sphere the object can cover the whole screen
+	const float distance = sqrtf(MathVec3DDot(&toCenter, &toCenter)) - radius;
+	const float pixels = distance > 0.0f ? radius * (float)screenHeight / (distance * tanf(0.5f * verticalFov)) : INFINITY;
+
+	*priority = pixels < (float)screenHeight ? pixels : (float)screenHeight;
+	if (pixels <= 1.0f)
+	{
+		return log2f((float)textureSize);
+	}
+	const float level = log2f((float)textureSize / pixels);
+	return level > 0.0f ? level : 0.0f;
+}
+
+uint32_t TextureStreamerTailLevel(uint32_t width, uint32_t height, uint32_t numLevels, bool blockCompressed)
+{
+	uint32_t level = 0;
+	while (level + 1 < numLevels && ((width >> level) > TEXTURE_STREAMER_TAIL_SIZE || (height >> level) > TEXTURE_STREAMER_TAIL_SIZE))
+	{
+		++level;
+	}
+	while (blockCompressed && level > 0 && ((width >> level) % 4 != 0 || (height >> level) % 4 != 0))
+	{
+		--level;
+	}
+	return level;
+}
+
+#ifdef TEXTURE_STREAMER_TEST
+#include <assert.h>
+
+// Square BC1 like texture, half a byte per texel down to 4x4 blocks
+static TextureStreamerDesc TextureStreamerTestDesc(uint32_t size)
+{
+	TextureStreamerDesc desc = {};
+	desc.Width = size;
+	desc.Height = size;
+	while ((size >> desc.NumLevels) > 0)
+	{
+		const uint32_t levelSize = size >> desc.NumLevels;
+		const uint32_t blocks = (levelSize + 3) / 4;
+		desc.LevelBytes[desc.NumLevels] = (size_t)blocks * blocks * 8;
+		++desc.NumLevels;
+	}
+	desc.TailLevel = TextureStreamerTailLevel(size, size, desc.NumLevels, true);
+	return desc;
+}
+
+static size_t TextureStreamerTestBytes(const TextureStreamerDesc& desc, uint32_t firstLevel)
+{
+	size_t bytes = 0;
+	for (uint32_t level = firstLevel; level < desc.NumLevels; ++level)
+	{
+		bytes += desc.LevelBytes[level];
+	}
+	return bytes;
+}
+
+// Flies the camera down a row of objects and back, requesting what every object needs each frame
+static void TextureStreamerTestFlyThrough(size_t budget, uint32_t maxUploads)
+{
+	const uint32_t numObjects = 8;
+	const uint32_t screenHeight = 1080;
+	const float fov = MathToRadians(45.0f);
+	const TextureStreamerDesc desc = TextureStreamerTestDesc(1024);
+
+	TextureStreamer streamer;
+	streamer.Init(budget, maxUploads);
+	AABB bounds[numObjects];
+	for (uint32_t i = 0; i < numObjects; ++i)
+	{
+		assert(streamer.Register(desc) == i);
+		bounds[i].Min = MathVec3DFromXYZ(-1.0f, -1.0f, 20.0f * (float)i - 1.0f);
+		bounds[i].Max = MathVec3DFromXYZ(1.0f, 1.0f, 20.0f * (float)i + 1.0f);
+	}
+	const size_t tailBytes = numObjects * TextureStreamerTestBytes(desc, desc.TailLevel);
+	assert(streamer.GetResidentBytes() == tailBytes);
+
+	std::vector<TextureStreamerChange> changes;
+	const uint32_t numFrames = 400;
+	for (uint32_t frame = 0; frame < 2 * numFrames; ++frame)
+	{
+		// out to the end of the row, then back, stopping 4 units in front of an object at both ends
+		const float t = frame < numFrames ? (float)frame / numFrames : 2.0f - (float)frame / numFrames;
+		const Vec3D eye = MathVec3DFromXYZ(0.0f, 0.0f, -4.0f + t * 20.0f * (float)(numObjects - 1));
+
+		for (uint32_t i = 0; i < numObjects; ++i)
+		{
+			float priority = 0.0f;
+			const float level = TextureStreamerComputeLevel(bounds[i], eye, fov, screenHeight, desc.Width, &priority);
+			// objects behind the camera are culled
+			if (bounds[i].Max.Z > eye.Z)
+			{
+				streamer.Request(i, level, priority);
+			}
+		}
+
+		changes.clear();
+		streamer.Update(&changes);
+		uint32_t levelsIn = 0;
+		for (const TextureStreamerChange& change : changes)
+		{
+			assert(change.FromLevel != change.ToLevel);
+			assert(streamer.GetResidentLevel(change.Texture) == change.ToLevel);
+			levelsIn += change.FromLevel > change.ToLevel ? change.FromLevel - change.ToLevel : 0;
+		}
+		assert(levelsIn <= maxUploads);
+		assert(streamer.GetResidentBytes() <= (budget > tailBytes ? budget : tailBytes));
+
+		size_t residentBytes = 0;
+		for (uint32_t i = 0; i < numObjects; ++i)
+		{
+			assert(streamer.GetResidentLevel(i) <= desc.TailLevel);
+			residentBytes += TextureStreamerTestBytes(desc, streamer.GetResidentLevel(i));
+		}
+		assert(residentBytes == streamer.GetResidentBytes());
+
+		// the nearest object is never coarser than one further down the row once streaming settled
+		if (frame == numFrames - 1 || frame == 2 * numFrames - 1)
+		{
+			for (uint32_t settle = 0; settle < 32; ++settle)
+			{
+				for (uint32_t i = 0; i < numObjects; ++i)
+				{
+					float priority = 0.0f;
+					const float level = TextureStreamerComputeLevel(bounds[i], eye, fov, screenHeight, desc.Width, &priority);
+					if (bounds[i].Max.Z > eye.Z)
+					{
+						streamer.Request(i, level, priority);
+					}
+				}
+				streamer.Update(&changes);
+			}
+			const uint32_t nearest = frame == numFrames - 1 ? numObjects - 1 : 0;
+			if (budget >= tailBytes + TextureStreamerTestBytes(desc, 0))
+			{
+				assert(streamer.GetResidentLevel(nearest) == streamer.GetWantedLevel(nearest));
+			}
+			if (nearest == 0)
+			{
+				for (uint32_t i = 1; i < numObjects; ++i)
+				{
+					assert(streamer.GetResidentLevel(0) <= streamer.GetResidentLevel(i));
+				}
+			}
+		}
+	}
+	assert(streamer.GetPeakResidentBytes() <= (budget > tailBytes ? budget : tailBytes));
+}
+
+void TextureStreamerTest(void)
+{
+	assert(TextureStreamerTailLevel(1024, 1024, 11, true) == 4);
+	assert(TextureStreamerTailLevel(1024, 256, 11, true) == 4);
+	assert(TextureStreamerTailLevel(32, 32, 6, true) == 0);
+	// 50x30 is the first level small enough, but blocks need 100x60
+	assert(TextureStreamerTailLevel(100, 60, 7, true) == 0);
+	assert(TextureStreamerTailLevel(100, 60, 7, false) == 1);
+
+	// nearer objects need finer levels, far away ones only the smallest
+	{
+		AABB bounds = {};
+		bounds.Min = MathVec3DFromXYZ(-1.0f, -1.0f, -1.0f);
+		bounds.Max = MathVec3DFromXYZ(1.0f, 1.0f, 1.0f);
+		float nearPriority = 0.0f;
+		float farPriority = 0.0f;
+		const float nearLevel = TextureStreamerComputeLevel(bounds, MathVec3DFromXYZ(0.0f, 0.0f, -3.0f), MathToRadians(45.0f), 1080, 1024, &nearPriority);
+		const float farLevel = TextureStreamerComputeLevel(bounds, MathVec3DFromXYZ(0.0f, 0.0f, -300.0f), MathToRadians(45.0f), 1080, 1024, &farPriority);
+		const float insideLevel = TextureStreamerComputeLevel(bounds, MathVec3DFromXYZ(0.0f, 0.0f, 0.0f), MathToRadians(45.0f), 1080, 1024, &nearPriority);
+		assert(nearLevel < farLevel && farLevel > 4.0f && insideLevel == 0.0f);
+		assert(nearPriority > farPriority);
+	}
+
+	// the higher priority texture gets the room when only one full chain fits
+	{
+		const TextureStreamerDesc desc = TextureStreamerTestDesc(512);
+		const size_t tailBytes = TextureStreamerTestBytes(desc, desc.TailLevel);
+		TextureStreamer streamer;
+		streamer.Init(TextureStreamerTestBytes(desc, 0) + tailBytes, 1);
+		const uint32_t low = streamer.Register(desc);
+		const uint32_t high = streamer.Register(desc);
+		std::vector<TextureStreamerChange> changes;
+		for (uint32_t frame = 0; frame < 16; ++frame)
+		{
+			streamer.Request(low, 0.0f, 10.0f);
+			streamer.Request(high, 0.0f, 100.0f);
+			changes.clear();
+			streamer.Update(&changes);
+			assert(changes.size() <= 2);
+		}
+		assert(streamer.GetResidentLevel(high) == 0);
+		assert(streamer.GetResidentLevel(low) == desc.TailLevel);
+
+		// once the high priority object is gone its levels make room for the other one
+		for (uint32_t frame = 0; frame < 16; ++frame)
+		{
+			streamer.Request(low, 0.0f, 10.0f);
+			streamer.Update(&changes);
+		}
+		assert(streamer.GetResidentLevel(low) == 0 && streamer.GetResidentLevel(high) == desc.TailLevel);
+
+		// unneeded levels stay resident until the budget shrinks
+		streamer.Update(&changes);
+		assert(streamer.GetResidentLevel(low) == 0);
+		streamer.SetBudget(2 * tailBytes);
+		changes.clear();
+		streamer.Update(&changes);
+		assert(streamer.GetResidentBytes() == 2 * tailBytes);
+		assert(changes.size() == 1 && changes[0].Texture == low && changes[0].FromLevel == 0 && changes[0].ToLevel == desc.TailLevel);
+	}
+
+	const TextureStreamerDesc desc = TextureStreamerTestDesc(1024);
+	const size_t fullBytes = TextureStreamerTestBytes(desc, 0);
+	// plenty of room, barely one full chain, nothing beyond the tails
+	TextureStreamerTestFlyThrough(16 * fullBytes, TEXTURE_STREAMER_DEFAULT_UPLOADS);
+	TextureStreamerTestFlyThrough(fullBytes + 8 * TextureStreamerTestBytes(desc, desc.TailLevel), TEXTURE_STREAMER_DEFAULT_UPLOADS);
+	TextureStreamerTestFlyThrough(fullBytes / 2, 1);
+}
+#endif
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "Math.h"
+
+// Levels at most this big stay resident all the time, streaming only moves the finer ones
+#define TEXTURE_STREAMER_TAIL_SIZE 64
+#define TEXTURE_STREAMER_MAX_LEVELS 16
+#define TEXTURE_STREAMER_DEFAULT_BUDGET (64ull * 1024 * 1024)
+// Levels streamed in per Update, bounds the upload cost of a frame
+#define TEXTURE_STREAMER_DEFAULT_UPLOADS 2
+
+struct TextureStreamerDesc
+{
+	uint32_t Width;
+	uint32_t Height;
+	uint32_t NumLevels;
+	// coarsest level streaming may drop to, levels from here on are always resident
+	uint32_t TailLevel;
+	size_t LevelBytes[TEXTURE_STREAMER_MAX_LEVELS];
+};
+
+// A texture whose finest resident level changed during Update
+struct TextureStreamerChange
+{
+	uint32_t Texture;
+	uint32_t FromLevel;
+	uint32_t ToLevel;
+};
+
+// Decides which mips of streamed textures are resident. Users request the
+// level they need every frame, Update then streams in finer levels in
+// priority order, one level per step and at most maxUploads of them, while
+// keeping the resident bytes under the budget. Room is made by dropping
+// levels, first from textures that hold more than they were asked for (least
+// recently requested first), then from requested textures with a lower
+// priority than the one being streamed in. Only bookkeeping happens here, the
+// caller applies the changes, so the scheduler runs without a device.
+class TextureStreamer
+{
+public:
+	TextureStreamer();
+	~TextureStreamer();
+
+	void Init(size_t budgetBytes = TEXTURE_STREAMER_DEFAULT_BUDGET, uint32_t maxUploads = TEXTURE_STREAMER_DEFAULT_UPLOADS);
+
+	// The texture starts with its tail resident, returns its id
+	uint32_t Register(const TextureStreamerDesc& desc);
+	// level may be fractional, the finest request of a frame wins and so does the highest priority
+	void Request(uint32_t texture, float level, float priority);
+	// Applies the requests made since the last call, changes are appended
+	void Update(std::vector<TextureStreamerChange>* changes);
+
+	void SetBudget(size_t budgetBytes) { m_Budget = budgetBytes; }
+	size_t GetBudget() const { return m_Budget; }
+	size_t GetResidentBytes() const { return m_ResidentBytes; }
+	// most resident bytes seen after any Update
+	size_t GetPeakResidentBytes() const { return m_PeakResidentBytes; }
+	uint32_t GetResidentLevel(uint32_t texture) const { return m_Textures[texture].ResidentLevel; }
+	uint32_t GetWantedLevel(uint32_t texture) const { return m_Textures[texture].WantedLevel; }
+	uint32_t GetNumTextures() const { return (uint32_t)m_Textures.size(); }
+	uint32_t GetNumLevelsIn() const { return m_NumLevelsIn; }
+	uint32_t GetNumLevelsOut() const { return m_NumLevelsOut; }
+	void PrintStats() const;
+
+private:
+	struct Texture
+	{
+		TextureStreamerDesc Desc;
+		uint32_t ResidentLevel;
+		uint32_t WantedLevel;
+		float Priority;
+		// frame of the last request, orders the textures nobody asks for anymore
+		uint64_t LastRequest;
+		// requests of the current frame
+		uint32_t RequestedLevel;
+		float RequestedPriority;
+	};
+
+	struct EvictionKey
+	{
+		bool Needed;
+		float Priority;
+		uint64_t LastRequest;
+		uint32_t Texture;
+	};
+
+	EvictionKey MakeEvictionKey(uint32_t texture) const;
+	bool CanEvict(uint32_t texture) const { return m_Textures[texture].ResidentLevel < m_Textures[texture].Desc.TailLevel; }
+	void Move(uint32_t texture, uint32_t level, std::vector<TextureStreamerChange>* changes, size_t firstChange);
+
+	std::vector<Texture> m_Textures;
+	size_t m_Budget;
+	uint32_t m_MaxUploads;
+	size_t m_ResidentBytes;
+	size_t m_PeakResidentBytes;
+	uint64_t m_Frame;
+	uint32_t m_NumLevelsIn;
+	uint32_t m_NumLevelsOut;
+};
+
+// Level at which one texel of a texture mapped once across the bounds covers
+// about one pixel. Priority is the projected size in pixels.
+float TextureStreamerComputeLevel(const AABB& bounds, const Vec3D& eye, float verticalFov, uint32_t screenHeight,
+	uint32_t textureSize, float* priority);
+// First level that is at most TEXTURE_STREAMER_TAIL_SIZE big. The top level
+// of a block compressed texture needs sizes that are multiples of 4, the
+// tail then starts at a finer level if it has to.
+uint32_t TextureStreamerTailLevel(uint32_t width, uint32_t height, uint32_t numLevels, bool blockCompressed);
+
+#ifdef TEXTURE_STREAMER_TEST
+void TextureStreamerTest(void);
+#endif
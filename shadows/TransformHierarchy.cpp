@@ -0,0 +1,331 @@
+#include "TransformHierarchy.h"
+#include "JobSystem.h"
+
+#include <assert.h>
+
+TransformHierarchy::TransformHierarchy():
+	m_NeedsSort{false},
+	m_NumUpdated{0}
+{
+}
+
+TransformHierarchy::~TransformHierarchy()
+{
+}
+
+uint32_t TransformHierarchy::AddNode(uint32_t parent, const Mat4X4& local)
+{
+	assert(parent == TRANSFORM_INVALID_NODE || parent < m_IdToIndex.size());
+
+	const uint32_t id = (uint32_t)m_IdToIndex.size();
+	const uint32_t index = (uint32_t)m_Locals.size();
+	const uint32_t parentIdx = parent == TRANSFORM_INVALID_NODE ? TRANSFORM_INVALID_NODE : m_IdToIndex[parent];
+	const uint32_t depth = parentIdx == TRANSFORM_INVALID_NODE ? 0 : m_Depths[parentIdx] + 1;
+
+	m_Locals.emplace_back(local);
+	m_Worlds.emplace_back(local);
+	m_Parents.emplace_back(parentIdx);
+	m_Depths.emplace_back(depth);
+	m_Dirty.emplace_back(1);
+	m_Updated.emplace_back(0);
+	m_IndexToId.emplace_back(id);
+	m_IdToIndex.emplace_back(index);
+
+	// appending keeps the order valid only while depths do not decrease
+	if (index > 0 && m_Depths[index - 1] > depth)
+	{
+		m_NeedsSort = true;
+	}
+	if (!m_NeedsSort)
+	{
+		if (m_LevelOffsets.empty())
+		{
+			m_LevelOffsets.emplace_back(0);
+		}
+		while (m_LevelOffsets.size() < depth + 2)
+		{
+			m_LevelOffsets.emplace_back(index);
+		}
+		m_LevelOffsets.back() = index + 1;
+	}
+	return id;
+}
+
+void TransformHierarchy::SetLocal(uint32_t node, const Mat4X4& local)
+{
+	const uint32_t index = m_IdToIndex[node];
+	m_Locals[index] = local;
+	m_Dirty[index] = 1;
+}
+
+uint32_t TransformHierarchy::GetParent(uint32_t node) const
+{
+	const uint32_t parentIdx = m_Parents[m_IdToIndex[node]];
+	return parentIdx == TRANSFORM_INVALID_NODE ? TRANSFORM_INVALID_NODE : m_IndexToId[parentIdx];
+}
+
+// Stable counting sort by depth, keeps relative order inside a level
+void TransformHierarchy::SortByDepth()
+{
+	const uint32_t count = GetNumNodes();
+	uint32_t maxDepth = 0;
+	for (uint32_t depth : m_Depths)
+	{
+		maxDepth = depth > maxDepth ? depth : maxDepth;
+	}
+
+	m_LevelOffsets.assign(maxDepth + 2, 0);
+	for (uint32_t depth : m_Depths)
+	{
+		++m_LevelOffsets[depth + 1];
+	}
+	for (uint32_t i = 1; i < m_LevelOffsets.size(); ++i)
+	{
+		m_LevelOffsets[i] += m_LevelOffsets[i - 1];
+	}
+
+	std::vector<uint32_t> newIndex(count);
+	std::vector<uint32_t> cursor(m_LevelOffsets.begin(), m_LevelOffsets.end() - 1);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		newIndex[i] = cursor[m_Depths[i]]++;
+	}
+
+	std::vector<Mat4X4> locals(count);
+	std::vector<Mat4X4> worlds(count);
+	std::vector<uint32_t> parents(count);
+	std::vector<uint32_t> depths(count);
+	std::vector<uint8_t> dirty(count);
+	std::vector<uint32_t> indexToId(count);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const uint32_t dst = newIndex[i];
+		locals[dst] = m_Locals[i];
+		worlds[dst] = m_Worlds[i];
+		parents[dst] = m_Parents[i] == TRANSFORM_INVALID_NODE ? TRANSFORM_INVALID_NODE : newIndex[m_Parents[i]];
+		depths[dst] = m_Depths[i];
+		dirty[dst] = m_Dirty[i];
+		indexToId[dst] = m_IndexToId[i];
+		m_IdToIndex[m_IndexToId[i]] = dst;
+	}
+
+	m_Locals.swap(locals);
+	m_Worlds.swap(worlds);
+	m_Parents.swap(parents);
+	m_Depths.swap(depths);
+	m_Dirty.swap(dirty);
+	m_IndexToId.swap(indexToId);
+	m_NeedsSort = false;
+}
+
+void TransformHierarchy::UpdateRange(uint32_t begin, uint32_t end)
+{
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		const uint32_t parent = m_Parents[i];
+		const bool parentUpdated = parent != TRANSFORM_INVALID_NODE && m_Updated[parent];
+		if (!m_Dirty[i] && !parentUpdated)
+		{
+			m_Updated[i] = 0;
+			continue;
+		}
+
+		if (parent == TRANSFORM_INVALID_NODE)
+		{
+			m_Worlds[i] = m_Locals[i];
+		}
+		else
+		{
+			m_Worlds[i] = MathMat4X4MultMat4X4ByMat4X4(&m_Locals[i], &m_Worlds[parent]);
+		}
+		m_Dirty[i] = 0;
+		m_Updated[i] = 1;
+	}
+}
+
+void TransformHierarchy::Update(JobSystem* jobs)
+{
+	if (m_NeedsSort)
+	{
+		SortByDepth();
+	}
+
+	for (uint32_t level = 0; level < GetNumLevels(); ++level)
+	{
+		const uint32_t begin = m_LevelOffsets[level];
+		const uint32_t count = m_LevelOffsets[level + 1] - begin;
+		if (jobs)
+		{
+			jobs->ParallelFor(count, TRANSFORM_UPDATE_BATCH_SIZE, [this, begin](uint32_t first, uint32_t last)
+				{
+					UpdateRange(begin + first, begin + last);
+				});
+		}
+		else
+		{
+			UpdateRange(begin, begin + count);
+		}
+	}
+
+	m_NumUpdated = 0;
+	for (uint8_t updated : m_Updated)
+	{
+		m_NumUpdated += updated;
+	}
+}
+
+#ifdef TRANSFORM_HIERARCHY_TEST
+static Mat4X4 TestTranslation(float x, float y, float z)
+{
+	const Vec3D offset = { x, y, z };
+	return MathMat4X4TranslateFromVec3D(&offset);
+}
+
+static Mat4X4 TestReferenceWorld(const TransformHierarchy& hierarchy, uint32_t node)
+{
+	Mat4X4 world = hierarchy.GetLocal(node);
+	for (uint32_t parent = hierarchy.GetParent(node); parent != TRANSFORM_INVALID_NODE; parent = hierarchy.GetParent(parent))
+	{
+		world = MathMat4X4MultMat4X4ByMat4X4(&world, &hierarchy.GetLocal(parent));
+	}
+	return world;
+}
+
+static bool TestMatricesEqual(const Mat4X4& lhs, const Mat4X4& rhs)
+{
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		const float diff = (&lhs.A00)[i] - (&rhs.A00)[i];
+		if (diff > 0.001f || diff < -0.001f)
+			return false;
+	}
+	return true;
+}
+
+static void TestTransformHierarchyBasic(void)
+{
+	TransformHierarchy hierarchy;
+	const uint32_t root = hierarchy.AddNode(TRANSFORM_INVALID_NODE, TestTranslation(1.0f, 0.0f, 0.0f));
+	const uint32_t child = hierarchy.AddNode(root, TestTranslation(0.0f, 2.0f, 0.0f));
+	const uint32_t sibling = hierarchy.AddNode(root, TestTranslation(0.0f, 0.0f, 3.0f));
+	const uint32_t grandChild = hierarchy.AddNode(child, TestTranslation(0.0f, 0.0f, 4.0f));
+	// added after deeper nodes, forces a resort
+	const uint32_t root2 = hierarchy.AddNode(TRANSFORM_INVALID_NODE, TestTranslation(5.0f, 0.0f, 0.0f));
+
+	hierarchy.Update(nullptr);
+	assert(hierarchy.GetNumLevels() == 3);
+	assert(hierarchy.GetNumUpdatedLastFrame() == 5);
+	assert(hierarchy.GetWorld(grandChild).A30 == 1.0f);
+	assert(hierarchy.GetWorld(grandChild).A31 == 2.0f);
+	assert(hierarchy.GetWorld(grandChild).A32 == 4.0f);
+	assert(hierarchy.GetWorld(root2).A30 == 5.0f);
+
+	// nothing changed, nothing recomputed
+	hierarchy.Update(nullptr);
+	assert(hierarchy.GetNumUpdatedLastFrame() == 0);
+
+	// moving the child updates only its subtree
+	hierarchy.SetLocal(child, TestTranslation(0.0f, 7.0f, 0.0f));
+	hierarchy.Update(nullptr);
+	assert(hierarchy.GetNumUpdatedLastFrame() == 2);
+	assert(hierarchy.WasUpdated(child) && hierarchy.WasUpdated(grandChild));
+	assert(!hierarchy.WasUpdated(root) && !hierarchy.WasUpdated(sibling) && !hierarchy.WasUpdated(root2));
+	assert(hierarchy.GetWorld(grandChild).A31 == 7.0f);
+}
+
+static void TestTransformHierarchyParallel(void)
+{
+	JobSystem jobs;
+	jobs.Init(4);
+
+	// random forest, parents always precede children in id order
+	TransformHierarchy hierarchy;
+	const uint32_t numNodes = 20000;
+	uint32_t seed = 42;
+	for (uint32_t i = 0; i < numNodes; ++i)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		const uint32_t parent = (i == 0 || (seed >> 24) < 8) ? TRANSFORM_INVALID_NODE : (seed >> 8) % i;
+		hierarchy.AddNode(parent, TestTranslation((float)(seed % 7), (float)(seed % 5), (float)(seed % 3)));
+	}
+	hierarchy.Update(&jobs);
+	assert(hierarchy.GetNumUpdatedLastFrame() == numNodes);
+
+	// dirty roughly 10% of the nodes
+	for (uint32_t i = 0; i < numNodes; i += 10)
+	{
+		hierarchy.SetLocal(i, TestTranslation(1.0f, (float)i, 0.0f));
+	}
+	hierarchy.Update(&jobs);
+	assert(hierarchy.GetNumUpdatedLastFrame() >= numNodes / 10);
+
+	for (uint32_t i = 0; i < numNodes; ++i)
+	{
+		assert(TestMatricesEqual(hierarchy.GetWorld(i), TestReferenceWorld(hierarchy, i)));
+	}
+}
+
+void TransformHierarchyTest(void)
+{
+	TestTransformHierarchyBasic();
+	TestTransformHierarchyParallel();
+}
+#endif
+
+#ifdef TRANSFORM_HIERARCHY_BENCHMARK
+#include "Utils.h"
+
+#include <chrono>
+
+void TransformHierarchyBenchmark(JobSystem* jobs)
+{
+	const uint32_t numNodes = 1000000;
+	const uint32_t numFrames = 8;
+	// every 100th, 10th and every node is dirty
+	const uint32_t strides[] = { 100, 10, 1 };
+
+	// random forest of a thousand trees, parents always precede children in id order
+	TransformHierarchy hierarchy;
+	uint32_t seed = 42;
+	for (uint32_t i = 0; i < numNodes; ++i)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		const uint32_t parent = i < 1000 ? TRANSFORM_INVALID_NODE : (seed >> 8) % i;
+		const Vec3D offset = { (float)(seed % 7), (float)(seed % 5), (float)(seed % 3) };
+		hierarchy.AddNode(parent, MathMat4X4TranslateFromVec3D(&offset));
+	}
+	hierarchy.Update(nullptr);
+
+	for (uint32_t stride : strides)
+	{
+		double seconds[2] = {};
+		uint64_t numUpdated = 0;
+		for (uint32_t pass = 0; pass < 2; ++pass)
+		{
+			JobSystem* passJobs = pass == 0 ? nullptr : jobs;
+			for (uint32_t frame = 0; frame < numFrames; ++frame)
+			{
+				for (uint32_t i = frame % stride; i < numNodes; i += stride)
+				{
+					const Vec3D offset = { (float)frame, (float)(i % 5), 0.0f };
+					hierarchy.SetLocal(i, MathMat4X4TranslateFromVec3D(&offset));
+				}
+
+				const auto start = std::chrono::steady_clock::now();
+				hierarchy.Update(passJobs);
+				seconds[pass] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				numUpdated += pass == 0 ? hierarchy.GetNumUpdatedLastFrame() : 0;
+			}
+		}
+
+		UtilsDebugPrint("Transform hierarchy: %u nodes, %u levels, %.2f dirty, %.2f updated, serial %.3f ms, parallel %.3f ms on %u threads\n",
+			numNodes,
+			hierarchy.GetNumLevels(),
+			1.0 / stride,
+			(double)numUpdated / ((double)numNodes * numFrames),
+			seconds[0] * 1000.0 / numFrames,
+			seconds[1] * 1000.0 / numFrames,
+			jobs ? jobs->GetNumThreads() : 1);
+	}
+}
+#endif
@@ -0,0 +1,447 @@
+#include "TriangleBVH.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <math.h>
+
+static float TriangleBVHAxis(const Vec3D& v, uint32_t axis)
+{
+	return axis == 0 ? v.X : (axis == 1 ? v.Y : v.Z);
+}
+
+static float TriangleBVHDot(const Vec3D& a, const Vec3D& b)
+{
+	return a.X * b.X + a.Y * b.Y + a.Z * b.Z;
+}
+
+static Vec3D TriangleBVHCross(const Vec3D& a, const Vec3D& b)
+{
+	return Vec3D(a.Y * b.Z - a.Z * b.Y, a.Z * b.X - a.X * b.Z, a.X * b.Y - a.Y * b.X);
+}
+
+// Reciprocal that stays finite, so that the slab test never multiplies zero by infinity
+static float TriangleBVHInverse(float x)
+{
+	return fabsf(x) > 1e-30f ? 1.0f / x : copysignf(1e30f, x);
+}
+
+static float TriangleBVHHalfArea(const AABB& box)
+{
+	const Vec3D size = MathVec3DSubtraction(&box.Max, &box.Min);
+	return size.X * size.Y + size.Y * size.Z + size.Z * size.X;
+}
+
+TriangleBVH::TriangleBVH()
+{
+}
+
+TriangleBVH::~TriangleBVH()
+{
+}
+
+void TriangleBVH::Build(const Vec3D* positions, const uint32_t* indices, uint32_t numTriangles)
+{
+	m_Triangles.clear();
+	m_Nodes.clear();
+	if (numTriangles == 0)
+	{
+		return;
+	}
+
+	m_References.resize(numTriangles);
+	for (uint32_t i = 0; i < numTriangles; ++i)
+	{
+		Reference& reference = m_References[i];
+		reference.Bounds = MathAABBEmpty();
+		for (uint32_t corner = 0; corner < 3; ++corner)
+		{
+			MathAABBExpand(&reference.Bounds, &positions[indices[3 * i + corner]]);
+		}
+		reference.Centroid = MathAABBCenter(&reference.Bounds);
+		reference.Id = i;
+	}
+
+	m_Nodes.reserve(2 * numTriangles);
+	m_Nodes.emplace_back();
+	BuildNode(0, 0, numTriangles, 0);
+
+	m_Triangles.resize(numTriangles);
+	for (uint32_t i = 0; i < numTriangles; ++i)
+	{
+		const uint32_t id = m_References[i].Id;
+		const Vec3D& v0 = positions[indices[3 * id]];
+		Triangle& triangle = m_Triangles[i];
+		triangle.V0 = v0;
+		triangle.Edge1 = MathVec3DSubtraction(&positions[indices[3 * id + 1]], &v0);
+		triangle.Edge2 = MathVec3DSubtraction(&positions[indices[3 * id + 2]], &v0);
+		triangle.Id = id;
+	}
+	m_References.clear();
+}
+
+void TriangleBVH::BuildNode(uint32_t node, uint32_t first, uint32_t numTriangles, uint32_t depth)
+{
+	Node& dest = m_Nodes[node];
+	dest.Bounds = MathAABBEmpty();
+	for (uint32_t i = first; i < first + numTriangles; ++i)
+	{
+		dest.Bounds = MathAABBUnion(&dest.Bounds, &m_References[i].Bounds);
+	}
+	dest.First = first;
+	dest.NumTriangles = numTriangles;
+	if (numTriangles <= TRIANGLE_BVH_LEAF_SIZE)
+	{
+		return;
+	}
+
+	uint32_t middle = Split(dest, first, numTriangles);
+	if (middle == first)
+	{
+		if (numTriangles <= TRIANGLE_BVH_MAX_LEAF_SIZE)
+		{
+			return;
+		}
+		// every centroid in the same place, any split is as good as another
+		middle = first + numTriangles / 2;
+	}
+	if (depth + 1 >= TRIANGLE_BVH_MAX_DEPTH)
+	{
+		UTILS_FATAL_ERROR("Triangle BVH deeper than %u levels", TRIANGLE_BVH_MAX_DEPTH);
+	}
+
+	const uint32_t children = (uint32_t)m_Nodes.size();
+	m_Nodes.emplace_back();
+	m_Nodes.emplace_back();
+	BuildNode(children, first, middle - first, depth + 1);
+	BuildNode(children + 1, middle, first + numTriangles - middle, depth + 1);
+	m_Nodes[node].First = children;
+	m_Nodes[node].NumTriangles = 0;
+}
+
+// Cost of a split is the area of each side times the triangles in it, the
+// chance a ray through the node visits a side times the work it finds there
+uint32_t TriangleBVH::Split(const Node& node, uint32_t first, uint32_t numTriangles)
+{
+	AABB centers = MathAABBEmpty();
+	for (uint32_t i = first; i < first + numTriangles; ++i)
+	{
+		MathAABBExpand(&centers, &m_References[i].Centroid);
+	}
+	const Vec3D size = MathVec3DSubtraction(&centers.Max, &centers.Min);
+	const uint32_t axis = size.X >= size.Y && size.X >= size.Z ? 0 : (size.Y >= size.Z ? 1 : 2);
+	const float min = TriangleBVHAxis(centers.Min, axis);
+	const float extent = TriangleBVHAxis(size, axis);
+	if (extent <= 0.0f)
+	{
+		return first;
+	}
+
+	AABB binBounds[TRIANGLE_BVH_NUM_BINS];
+	uint32_t binCounts[TRIANGLE_BVH_NUM_BINS] = {};
+	for (AABB& bounds : binBounds)
+	{
+		bounds = MathAABBEmpty();
+	}
+	const float scale = TRIANGLE_BVH_NUM_BINS / extent;
+	auto binOf = [axis, min, scale](const Reference& reference)
+		{
+			const uint32_t bin = (uint32_t)((TriangleBVHAxis(reference.Centroid, axis) - min) * scale);
+			return std::min(bin, (uint32_t)TRIANGLE_BVH_NUM_BINS - 1);
+		};
+	for (uint32_t i = first; i < first + numTriangles; ++i)
+	{
+		const uint32_t bin = binOf(m_References[i]);
+		binBounds[bin] = MathAABBUnion(&binBounds[bin], &m_References[i].Bounds);
+		++binCounts[bin];
+	}
+
+	// right to left sweep first, then the left side grows bin by bin
+	float rightCosts[TRIANGLE_BVH_NUM_BINS] = {};
+	AABB bounds = MathAABBEmpty();
+	uint32_t count = 0;
+	for (uint32_t bin = TRIANGLE_BVH_NUM_BINS - 1; bin > 0; --bin)
+	{
+		bounds = MathAABBUnion(&bounds, &binBounds[bin]);
+		count += binCounts[bin];
+		rightCosts[bin] = count ? TriangleBVHHalfArea(bounds) * count : 0.0f;
+	}
+	uint32_t bestBin = 0;
+	float bestCost = FLT_MAX;
+	bounds = MathAABBEmpty();
+	count = 0;
+	for (uint32_t bin = 0; bin + 1 < TRIANGLE_BVH_NUM_BINS; ++bin)
+	{
+		bounds = MathAABBUnion(&bounds, &binBounds[bin]);
+		count += binCounts[bin];
+		const float cost = (count ? TriangleBVHHalfArea(bounds) * count : 0.0f) + rightCosts[bin + 1];
+		if (cost < bestCost)
+		{
+			bestCost = cost;
+			bestBin = bin;
+		}
+	}
+
+	// small nodes that no split makes cheaper than testing all of their triangles stay leaves
+	if (numTriangles <= TRIANGLE_BVH_MAX_LEAF_SIZE && bestCost >= TriangleBVHHalfArea(node.Bounds) * numTriangles)
+	{
+		return first;
+	}
+	const auto middle = std::partition(m_References.begin() + first, m_References.begin() + first + numTriangles,
+		[&binOf, bestBin](const Reference& reference) { return binOf(reference) <= bestBin; });
+	const uint32_t split = (uint32_t)(middle - m_References.begin());
+	return split == first + numTriangles ? first : split;
+}
+
+// Slab test
+static bool TriangleBVHHitsBox(const AABB& box, const Vec3D& origin, const Vec3D& invDirection, float tMax, float* tEnter)
+{
+	const float x1 = (box.Min.X - origin.X) * invDirection.X;
+	const float x2 = (box.Max.X - origin.X) * invDirection.X;
+	const float y1 = (box.Min.Y - origin.Y) * invDirection.Y;
+	const float y2 = (box.Max.Y - origin.Y) * invDirection.Y;
+	const float z1 = (box.Min.Z - origin.Z) * invDirection.Z;
+	const float z2 = (box.Max.Z - origin.Z) * invDirection.Z;
+	const float enter = std::max(std::max(std::max(std::min(x1, x2), std::min(y1, y2)), std::min(z1, z2)), 0.0f);
+	const float exit = std::min(std::min(std::min(std::max(x1, x2), std::max(y1, y2)), std::max(z1, z2)), tMax);
+	*tEnter = enter;
+	return enter <= exit;
+}
+
+template <bool AnyHit>
+bool TriangleBVH::Traverse(const Vec3D& origin, const Vec3D& direction, float tMax, TriangleBVHHit* hit) const
+{
+	if (m_Nodes.empty())
+	{
+		return false;
+	}
+
+	const Vec3D invDirection = { TriangleBVHInverse(direction.X), TriangleBVHInverse(direction.Y), TriangleBVHInverse(direction.Z) };
+	float closest = tMax;
+	bool found = false;
+	uint32_t stack[TRIANGLE_BVH_MAX_DEPTH];
+	uint32_t stackSize = 0;
+	float tEnter = 0.0f;
+	if (!TriangleBVHHitsBox(m_Nodes[0].Bounds, origin, invDirection, closest, &tEnter))
+	{
+		return false;
+	}
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const Node& node = m_Nodes[stack[--stackSize]];
+		if (node.NumTriangles == 0)
+		{
+			// the nearer child goes on top so that closer hits shorten the ray before the other side is visited
+			float tLeft = 0.0f;
+			float tRight = 0.0f;
+			const bool left = TriangleBVHHitsBox(m_Nodes[node.First].Bounds, origin, invDirection, closest, &tLeft);
+			const bool right = TriangleBVHHitsBox(m_Nodes[node.First + 1].Bounds, origin, invDirection, closest, &tRight);
+			if (left && right)
+			{
+				const bool leftFirst = tLeft <= tRight;
+				stack[stackSize++] = leftFirst ? node.First + 1 : node.First;
+				stack[stackSize++] = leftFirst ? node.First : node.First + 1;
+			}
+			else if (left || right)
+			{
+				stack[stackSize++] = left ? node.First : node.First + 1;
+			}
+			continue;
+		}
+
+		// Moller-Trumbore
+		for (uint32_t i = node.First; i < node.First + node.NumTriangles; ++i)
+		{
+			const Triangle& triangle = m_Triangles[i];
+			const Vec3D p = TriangleBVHCross(direction, triangle.Edge2);
+			const float det = TriangleBVHDot(triangle.Edge1, p);
+			if (fabsf(det) < 1e-12f)
+			{
+				continue;
+			}
+			const float invDet = 1.0f / det;
+			const Vec3D s = { origin.X - triangle.V0.X, origin.Y - triangle.V0.Y, origin.Z - triangle.V0.Z };
+			const float u = TriangleBVHDot(s, p) * invDet;
+			if (u < 0.0f || u > 1.0f)
+			{
+				continue;
+			}
+			const Vec3D q = TriangleBVHCross(s, triangle.Edge1);
+			const float v = TriangleBVHDot(direction, q) * invDet;
+			if (v < 0.0f || u + v > 1.0f)
+			{
+				continue;
+			}
+			const float t = TriangleBVHDot(triangle.Edge2, q) * invDet;
+			if (t <= 0.0f || t >= closest)
+			{
+				continue;
+			}
+			if (AnyHit)
+			{
+				return true;
+			}
+			closest = t;
+			found = true;
+			hit->T = t;
+			hit->Triangle = triangle.Id;
+			hit->U = u;
+			hit->V = v;
+		}
+	}
+	return found;
+}
+
+bool TriangleBVH::Intersect(const Vec3D& origin, const Vec3D& direction, float tMax, TriangleBVHHit* hit) const
+{
+	return Traverse<false>(origin, direction, tMax, hit);
+}
+
+bool TriangleBVH::Occluded(const Vec3D& origin, const Vec3D& direction, float tMax) const
+{
+	return Traverse<true>(origin, direction, tMax, nullptr);
+}
+
+#ifdef TRIANGLE_BVH_TEST
+#include <vector>
+
+static float TriangleBVHTestRandom(uint32_t* seed, float min, float max)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	return min + (max - min) * (float)(*seed >> 8) / (float)(1 << 24);
+}
+
+static Vec3D TriangleBVHTestPoint(uint32_t* seed, float extent)
+{
+	return Vec3D(TriangleBVHTestRandom(seed, -extent, extent), TriangleBVHTestRandom(seed, -extent, extent),
+		TriangleBVHTestRandom(seed, -extent, extent));
+}
+
+// Closest hit over every triangle, UINT32_MAX when there is none
+static uint32_t TriangleBVHTestBruteForce(const std::vector<Vec3D>& positions, const Vec3D& origin, const Vec3D& direction,
+	float tMax, float* tHit)
+{
+	uint32_t closest = UINT32_MAX;
+	*tHit = tMax;
+	for (uint32_t i = 0; i < positions.size() / 3; ++i)
+	{
+		const Vec3D& v0 = positions[3 * i];
+		const Vec3D e1 = MathVec3DSubtraction(&positions[3 * i + 1], &v0);
+		const Vec3D e2 = MathVec3DSubtraction(&positions[3 * i + 2], &v0);
+		const Vec3D p = TriangleBVHCross(direction, e2);
+		const float det = TriangleBVHDot(e1, p);
+		if (fabsf(det) < 1e-12f)
+		{
+			continue;
+		}
+		const float invDet = 1.0f / det;
+		const Vec3D s = MathVec3DSubtraction(&origin, &v0);
+		const float u = TriangleBVHDot(s, p) * invDet;
+		const Vec3D q = TriangleBVHCross(s, e1);
+		const float v = TriangleBVHDot(direction, q) * invDet;
+		const float t = TriangleBVHDot(e2, q) * invDet;
+		if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t > 0.0f && t < *tHit)
+		{
+			*tHit = t;
+			closest = i;
+		}
+	}
+	return closest;
+}
+
+static void TestTriangleBVHSingle(void)
+{
+	TriangleBVH bvh;
+	const Vec3D origin = { 0.0f, 1.0f, 0.0f };
+	const Vec3D down = { 0.0f, -1.0f, 0.0f };
+	TriangleBVHHit hit = {};
+	bvh.Build(nullptr, nullptr, 0);
+	assert(!bvh.Intersect(origin, down, FLT_MAX, &hit) && !bvh.Occluded(origin, down, FLT_MAX));
+
+	// a floor quad, seen from both sides
+	const Vec3D positions[] = { { -1.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 1.0f } };
+	const uint32_t indices[] = { 0, 1, 2, 0, 2, 3 };
+	bvh.Build(positions, indices, 2);
+	assert(bvh.GetNumTriangles() == 2);
+	assert(bvh.Intersect(origin, down, FLT_MAX, &hit) && fabsf(hit.T - 1.0f) < 1e-6f);
+	const Vec3D below = { 0.5f, -2.0f, -0.5f };
+	const Vec3D up = { 0.0f, 2.0f, 0.0f };
+	assert(bvh.Intersect(below, up, FLT_MAX, &hit) && hit.Triangle == 0 && fabsf(hit.T - 1.0f) < 1e-6f);
+	// too short, pointing away, passing beside
+	assert(!bvh.Occluded(origin, down, 0.5f));
+	assert(!bvh.Occluded(origin, up, FLT_MAX));
+	const Vec3D beside = { 2.0f, 1.0f, 0.0f };
+	assert(!bvh.Occluded(beside, down, FLT_MAX));
+	// along the plane of the quad, the direction has zero components
+	const Vec3D edgeOn = { -2.0f, 0.0f, 0.0f };
+	const Vec3D right = { 1.0f, 0.0f, 0.0f };
+	assert(!bvh.Intersect(edgeOn, right, FLT_MAX, &hit));
+}
+
+// Closest and any hits agree with testing every triangle of a random soup
+static void TestTriangleBVHRandom(void)
+{
+	uint32_t seed = 3;
+	std::vector<Vec3D> positions;
+	std::vector<uint32_t> indices;
+	for (uint32_t i = 0; i < 2000; ++i)
+	{
+		const Vec3D center = TriangleBVHTestPoint(&seed, 10.0f);
+		for (uint32_t corner = 0; corner < 3; ++corner)
+		{
+			const Vec3D offset = TriangleBVHTestPoint(&seed, 0.5f);
+			indices.push_back((uint32_t)positions.size());
+			positions.push_back(MathVec3DAddition(&center, &offset));
+		}
+	}
+	// a flat cluster with one centroid, which no plane splits
+	for (uint32_t i = 0; i < 40; ++i)
+	{
+		const Vec3D stacked[] = { { -1.0f, (float)i * 0.01f, -1.0f }, { 1.0f, (float)i * 0.01f, 0.0f }, { -1.0f, (float)i * 0.01f, 1.0f } };
+		for (const Vec3D& position : stacked)
+		{
+			indices.push_back((uint32_t)positions.size());
+			positions.push_back(position);
+		}
+	}
+	TriangleBVH bvh;
+	bvh.Build(positions.data(), indices.data(), (uint32_t)indices.size() / 3);
+	assert(bvh.GetNumTriangles() == indices.size() / 3);
+
+	uint32_t numHits = 0;
+	for (uint32_t i = 0; i < 3000; ++i)
+	{
+		const Vec3D origin = TriangleBVHTestPoint(&seed, 12.0f);
+		const Vec3D target = TriangleBVHTestPoint(&seed, 10.0f);
+		const Vec3D direction = MathVec3DSubtraction(&target, &origin);
+		const float tMax = TriangleBVHTestRandom(&seed, 0.2f, 2.0f);
+		float expectedT = 0.0f;
+		const uint32_t expected = TriangleBVHTestBruteForce(positions, origin, direction, tMax, &expectedT);
+		TriangleBVHHit hit = {};
+		const bool found = bvh.Intersect(origin, direction, tMax, &hit);
+		assert(found == (expected != UINT32_MAX));
+		assert(bvh.Occluded(origin, direction, tMax) == found);
+		if (found)
+		{
+			assert(fabsf(hit.T - expectedT) <= 1e-6f * tMax && (hit.Triangle == expected || hit.T == expectedT));
+			const Vec3D& v0 = positions[3 * hit.Triangle];
+			const Vec3D& v1 = positions[3 * hit.Triangle + 1];
+			const Vec3D& v2 = positions[3 * hit.Triangle + 2];
+			const float w = 1.0f - hit.U - hit.V;
+			const Vec3D point = { w * v0.X + hit.U * v1.X + hit.V * v2.X, w * v0.Y + hit.U * v1.Y + hit.V * v2.Y, w * v0.Z + hit.U * v1.Z + hit.V * v2.Z };
+			assert(fabsf(point.X - (origin.X + hit.T * direction.X)) < 1e-3f);
+			assert(fabsf(point.Z - (origin.Z + hit.T * direction.Z)) < 1e-3f);
+			++numHits;
+		}
+	}
+	assert(numHits > 100);
+}
+
+void TriangleBVHTest(void)
+{
+	TestTriangleBVHSingle();
+	TestTriangleBVHRandom();
+}
+#endif
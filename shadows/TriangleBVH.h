@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Math.h"
+
+// Triangles in a leaf of the tree before the surface area heuristic is asked
+#define TRIANGLE_BVH_LEAF_SIZE 2
+// Leaves the heuristic may keep instead of splitting further
+#define TRIANGLE_BVH_MAX_LEAF_SIZE 16
+// Buckets of centroids the split planes are chosen from
+#define TRIANGLE_BVH_NUM_BINS 12
+// Deeper trees do not fit the traversal stack
+#define TRIANGLE_BVH_MAX_DEPTH 64
+
+struct TriangleBVHHit
+{
+	float T;
+	// index of the triangle in the order it was given to Build
+	uint32_t Triangle;
+	// barycentrics of the second and the third vertex
+	float U;
+	float V;
+};
+
+// Bounding volume hierarchy over triangles for casting rays on the CPU, as
+// light bakers do. Unlike the light tree, which is balanced, nodes are split
+// where the surface area heuristic of binned centroids says rays are cheapest
+// to trace, meshes are far from evenly spread. The children of a node are
+// next to each other and come after it. Triangles are hit from both sides.
+class TriangleBVH
+{
+public:
+	TriangleBVH();
+	~TriangleBVH();
+
+	// numTriangles times three indices into positions
+	void Build(const Vec3D* positions, const uint32_t* indices, uint32_t numTriangles);
+
+	// Closest triangle the ray hits with 0 < t < tMax, direction need not be unit length
+	bool Intersect(const Vec3D& origin, const Vec3D& direction, float tMax, TriangleBVHHit* hit) const;
+	// Whether any triangle is hit with 0 < t < tMax, which is all shadow and occlusion rays need
+	bool Occluded(const Vec3D& origin, const Vec3D& direction, float tMax) const;
+
+	uint32_t GetNumTriangles() const { return (uint32_t)m_Triangles.size(); }
+	uint32_t GetNumNodes() const { return (uint32_t)m_Nodes.size(); }
+	const AABB& GetBounds() const { return m_Nodes.empty() ? m_Empty : m_Nodes[0].Bounds; }
+
+private:
+	// Laid out for the ray test
+	struct Triangle
+	{
+		Vec3D V0;
+		Vec3D Edge1;
+		Vec3D Edge2;
+		uint32_t Id;
+	};
+
+	struct Reference
+	{
+		AABB Bounds;
+		Vec3D Centroid;
+		uint32_t Id;
+	};
+
+	struct Node
+	{
+		AABB Bounds;
+		// first triangle of a leaf, first child of an inner node
+		uint32_t First;
+		// 0 for inner nodes
+		uint32_t NumTriangles;
+	};
+
+	void BuildNode(uint32_t node, uint32_t first, uint32_t numTriangles, uint32_t depth);
+	// Position of the first reference right of the best split, first when the node is better left a leaf
+	uint32_t Split(const Node& node, uint32_t first, uint32_t numTriangles);
+	template <bool AnyHit>
+	bool Traverse(const Vec3D& origin, const Vec3D& direction, float tMax, TriangleBVHHit* hit) const;
+
+	// triangles in leaf order
+	std::vector<Triangle> m_Triangles;
+	std::vector<Node> m_Nodes;
+	std::vector<Reference> m_References;
+	AABB m_Empty;
+};
+
+#ifdef TRIANGLE_BVH_TEST
+void TriangleBVHTest(void);
+#endif
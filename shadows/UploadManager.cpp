@@ -0,0 +1,439 @@
+#include "UploadManager.h"
+#include "DDSLoader.h"
+#include "Utils.h"
+
+#include <chrono>
+#include <string.h>
+
+static double UploadManagerNowMillis()
+{
+	using namespace std::chrono;
+	return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// texels per row of blocks, block compressed rows are four texels high
+static uint32_t UploadManagerBlockSize(DXGI_FORMAT format)
+{
+	return DDSIsBlockCompressed(format) ? 4 : 1;
+}
+
+// Where the tile at texel x, y starts in the data of its level, both are multiples of the block size
+static size_t UploadManagerTileOffset(DXGI_FORMAT format, uint32_t x, uint32_t y, uint32_t rowPitch)
+{
+	const uint32_t blockSize = UploadManagerBlockSize(format);
+	const uint64_t blockBytes = DDSRowPitch(format, blockSize);
+	return (size_t)(y / blockSize) * rowPitch + (size_t)((x / blockSize) * blockBytes);
+}
+
+// The staging texels of a tile written firstRow rows of blocks down its page.
+// Levels smaller than a block still copy a whole block.
+static D3D11_BOX UploadManagerTileBox(DXGI_FORMAT format, uint32_t width, uint32_t height, uint32_t firstRow)
+{
+	const uint32_t blockSize = UploadManagerBlockSize(format);
+	D3D11_BOX box = {};
+	box.left = 0;
+	box.right = (width + blockSize - 1) / blockSize * blockSize;
+	box.top = firstRow * blockSize;
+	box.bottom = box.top + DDSNumRows(format, height) * blockSize;
+	box.front = 0;
+	box.back = 1;
+	return box;
+}
+
+UploadManager::UploadManager():
+	m_Device{nullptr},
+	m_Context{nullptr},
+	m_NumCopies{0},
+	m_NumBatches{0},
+	m_NumDeferred{0},
+	m_DeferredBytes{0},
+	m_WriteMillis{0.0},
+	m_NumRetired{0},
+	m_RetiredLatency{0}
+{
+}
+
+UploadManager::~UploadManager()
+{
+}
+
+void UploadManager::Init(ID3D11Device* device, ID3D11DeviceContext* context, size_t frameBudget)
+{
+	m_Device = device;
+	m_Context = context;
+	m_Scheduler.Init(frameBudget);
+
+	Pool pool = {};
+	pool.Format = DXGI_FORMAT_UNKNOWN;
+	for (uint32_t i = 0; i < UPLOAD_MANAGER_NUM_PAGES; ++i)
+	{
+		D3D11_BUFFER_DESC bufferDesc = {};
+		bufferDesc.ByteWidth = UPLOAD_MANAGER_BUFFER_PAGE_SIZE;
+		bufferDesc.Usage = D3D11_USAGE_STAGING;
+		bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		Microsoft::WRL::ComPtr<ID3D11Buffer> page;
+		HR(m_Device->CreateBuffer(&bufferDesc, NULL, page.ReleaseAndGetAddressOf()))
+		pool.Pages.emplace_back(page.Get());
+	}
+	pool.Mapped.resize(UPLOAD_MANAGER_NUM_PAGES);
+	m_Pools.emplace_back(std::move(pool));
+	m_Scheduler.AddPool(UPLOAD_MANAGER_NUM_PAGES, UPLOAD_MANAGER_BUFFER_PAGE_SIZE);
+}
+
+// Texture pages are created the first time a format is uploaded, the pool unit is a row of blocks
+uint32_t UploadManager::GetTexturePool(DXGI_FORMAT format)
+{
+	for (uint32_t i = 1; i < m_Pools.size(); ++i)
+	{
+		if (m_Pools[i].Format == format)
+		{
+			return i;
+		}
+	}
+
+	Pool pool = {};
+	pool.Format = format;
+	for (uint32_t i = 0; i < UPLOAD_MANAGER_NUM_PAGES; ++i)
+	{
+		D3D11_TEXTURE2D_DESC desc = {};
+		desc.Width = UPLOAD_MANAGER_TEXTURE_PAGE_SIZE;
+		desc.Height = UPLOAD_MANAGER_TEXTURE_PAGE_SIZE;
+		desc.MipLevels = 1;
+		desc.ArraySize = 1;
+		desc.Format = format;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_STAGING;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		Microsoft::WRL::ComPtr<ID3D11Texture2D> page;
+		HR(m_Device->CreateTexture2D(&desc, NULL, page.ReleaseAndGetAddressOf()))
+		pool.Pages.emplace_back(page.Get());
+	}
+	pool.Mapped.resize(UPLOAD_MANAGER_NUM_PAGES);
+	m_Pools.emplace_back(std::move(pool));
+	return m_Scheduler.AddPool(UPLOAD_MANAGER_NUM_PAGES, DDSNumRows(format, UPLOAD_MANAGER_TEXTURE_PAGE_SIZE));
+}
+
+uint64_t UploadManager::UploadBuffer(ID3D11Buffer* dst, uint32_t dstOffset, const void* data, uint32_t size)
+{
+	uint64_t ticket = UPLOAD_MANAGER_NO_TICKET;
+	for (uint32_t offset = 0; offset < size; offset += UPLOAD_MANAGER_BUFFER_PAGE_SIZE)
+	{
+		const uint32_t chunk = size - offset < UPLOAD_MANAGER_BUFFER_PAGE_SIZE ? size - offset : UPLOAD_MANAGER_BUFFER_PAGE_SIZE;
+		Request request = {};
+		request.Ticket = m_Scheduler.Enqueue(0, chunk, UPLOAD_MANAGER_BUFFER_ALIGNMENT, chunk);
+		request.Pool = 0;
+		request.Dst = dst;
+		request.DstX = dstOffset + offset;
+		request.Width = chunk;
+		request.Height = 1;
+		request.Data = (const uint8_t*)data + offset;
+		request.RowPitch = chunk;
+		ticket = request.Ticket;
+		m_Requests.emplace_back(std::move(request));
+	}
+	Place();
+	KeepQueuedData();
+	return ticket;
+}
+
+uint64_t UploadManager::UploadTexture(ID3D11Texture2D* dst, uint32_t dstSubresource, DXGI_FORMAT format,
+	uint32_t width, uint32_t height, const void* data, uint32_t rowPitch)
+{
+	const uint32_t pool = GetTexturePool(format);
+	uint64_t ticket = UPLOAD_MANAGER_NO_TICKET;
+	for (uint32_t y = 0; y < height; y += UPLOAD_MANAGER_TEXTURE_PAGE_SIZE)
+	{
+		for (uint32_t x = 0; x < width; x += UPLOAD_MANAGER_TEXTURE_PAGE_SIZE)
+		{
+			Request request = {};
+			request.Pool = pool;
+			request.Dst = dst;
+			request.DstSubresource = dstSubresource;
+			request.DstX = x;
+			request.DstY = y;
+			request.Width = width - x < UPLOAD_MANAGER_TEXTURE_PAGE_SIZE ? width - x : UPLOAD_MANAGER_TEXTURE_PAGE_SIZE;
+			request.Height = height - y < UPLOAD_MANAGER_TEXTURE_PAGE_SIZE ? height - y : UPLOAD_MANAGER_TEXTURE_PAGE_SIZE;
+			request.Data = (const uint8_t*)data + UploadManagerTileOffset(format, x, y, rowPitch);
+			request.RowPitch = rowPitch;
+			const uint32_t numRows = DDSNumRows(format, request.Height);
+			request.Ticket = m_Scheduler.Enqueue(pool, numRows, 1, (size_t)numRows * DDSRowPitch(format, request.Width));
+			ticket = request.Ticket;
+			m_Requests.emplace_back(std::move(request));
+		}
+	}
+	Place();
+	KeepQueuedData();
+	return ticket;
+}
+
+void UploadManager::Place()
+{
+	m_Placements.clear();
+	m_Scheduler.Schedule(&m_Placements);
+	for (const UploadPlacement& placement : m_Placements)
+	{
+		assert(m_Requests.front().Ticket == placement.Ticket);
+		Write(placement, m_Requests.front());
+		m_Requests.pop_front();
+	}
+}
+
+void UploadManager::Write(const UploadPlacement& placement, const Request& request)
+{
+	const double start = UploadManagerNowMillis();
+	Pool& pool = m_Pools[placement.Pool];
+	D3D11_MAPPED_SUBRESOURCE& mapped = pool.Mapped[placement.Page];
+	if (!mapped.pData)
+	{
+		// the scheduler only hands out pages whose copies are done, so this does not wait
+		HR(m_Context->Map(pool.Pages[placement.Page].Get(), 0, D3D11_MAP_WRITE, 0, &mapped))
+	}
+
+	Copy copy = {};
+	copy.Dst = request.Dst;
+	copy.DstSubresource = request.DstSubresource;
+	copy.DstX = request.DstX;
+	copy.DstY = request.DstY;
+	copy.Src = pool.Pages[placement.Page].Get();
+	copy.SrcBox.front = 0;
+	copy.SrcBox.back = 1;
+	if (pool.Format == DXGI_FORMAT_UNKNOWN)
+	{
+		memcpy((uint8_t*)mapped.pData + placement.Offset, request.Data, request.Width);
+		copy.SrcBox.left = placement.Offset;
+		copy.SrcBox.right = placement.Offset + request.Width;
+		copy.SrcBox.top = 0;
+		copy.SrcBox.bottom = 1;
+	}
+	else
+	{
+		// tiles start at the left edge of the page on the rows the scheduler gave them
+		const uint32_t numRows = DDSNumRows(pool.Format, request.Height);
+		const uint32_t rowBytes = (uint32_t)DDSRowPitch(pool.Format, request.Width);
+		uint8_t* dst = (uint8_t*)mapped.pData + (size_t)placement.Offset * mapped.RowPitch;
+		for (uint32_t row = 0; row < numRows; ++row)
+		{
+			memcpy(dst + (size_t)row * mapped.RowPitch, request.Data + (size_t)row * request.RowPitch, rowBytes);
+		}
+		copy.SrcBox = UploadManagerTileBox(pool.Format, request.Width, request.Height, placement.Offset);
+	}
+	m_Copies.emplace_back(std::move(copy));
+	m_WriteMillis += UploadManagerNowMillis() - start;
+}
+
+// Requests still queued when an upload call returns need their own copy of the data
+void UploadManager::KeepQueuedData()
+{
+	for (Request& request : m_Requests)
+	{
+		if (!request.Copy.empty())
+		{
+			continue;
+		}
+
+		if (request.Pool == 0)
+		{
+			request.Copy.assign(request.Data, request.Data + request.Width);
+			request.RowPitch = request.Width;
+		}
+		else
+		{
+			const DXGI_FORMAT format = m_Pools[request.Pool].Format;
+			const uint32_t numRows = DDSNumRows(format, request.Height);
+			const uint32_t rowBytes = (uint32_t)DDSRowPitch(format, request.Width);
+			request.Copy.resize((size_t)numRows * rowBytes);
+			for (uint32_t row = 0; row < numRows; ++row)
+			{
+				memcpy(&request.Copy[(size_t)row * rowBytes], request.Data + (size_t)row * request.RowPitch, rowBytes);
+			}
+			request.RowPitch = rowBytes;
+		}
+		request.Data = request.Copy.data();
+		++m_NumDeferred;
+		m_DeferredBytes += request.Copy.size();
+	}
+}
+
+void UploadManager::RetireFrames(bool wait)
+{
+	bool retired = false;
+	uint64_t completed = 0;
+	while (!m_InFlight.empty())
+	{
+		Frame& frame = m_InFlight.front();
+		if (frame.Done)
+		{
+			HRESULT hr = m_Context->GetData(frame.Done.Get(), NULL, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH);
+			if (hr == S_FALSE && wait)
+			{
+				// only the oldest frame with copies is waited for
+				wait = false;
+				while ((hr = m_Context->GetData(frame.Done.Get(), NULL, 0, 0)) == S_FALSE)
+				{
+				}
+			}
+			if (hr == S_FALSE)
+			{
+				break;
+			}
+			HR(hr)
+			m_FreeQueries.emplace_back(std::move(frame.Done));
+			m_RetiredLatency += m_Scheduler.GetFrame() - frame.Id;
+			++m_NumRetired;
+		}
+		completed = frame.Id;
+		retired = true;
+		m_InFlight.pop_front();
+	}
+
+	if (retired)
+	{
+		m_Scheduler.Retire(completed);
+	}
+}
+
+void UploadManager::Update()
+{
+	RetireFrames(false);
+	Place();
+
+	for (Pool& pool : m_Pools)
+	{
+		for (uint32_t i = 0; i < pool.Pages.size(); ++i)
+		{
+			if (pool.Mapped[i].pData)
+			{
+				m_Context->Unmap(pool.Pages[i].Get(), 0);
+				pool.Mapped[i] = {};
+			}
+		}
+	}
+
+	Frame frame = {};
+	frame.Id = m_Scheduler.GetFrame();
+	if (!m_Copies.empty())
+	{
+		for (const Copy& copy : m_Copies)
+		{
+			m_Context->CopySubresourceRegion(copy.Dst.Get(), copy.DstSubresource, copy.DstX, copy.DstY, 0, copy.Src, 0, &copy.SrcBox);
+		}
+		m_NumCopies += m_Copies.size();
+		++m_NumBatches;
+		m_Copies.clear();
+
+		if (m_FreeQueries.empty())
+		{
+			D3D11_QUERY_DESC queryDesc = {};
+			queryDesc.Query = D3D11_QUERY_EVENT;
+			HR(m_Device->CreateQuery(&queryDesc, frame.Done.ReleaseAndGetAddressOf()))
+		}
+		else
+		{
+			frame.Done = std::move(m_FreeQueries.back());
+			m_FreeQueries.pop_back();
+		}
+		m_Context->End(frame.Done.Get());
+	}
+	m_Scheduler.Submit();
+	m_InFlight.emplace_back(std::move(frame));
+}
+
+void UploadManager::Flush()
+{
+	Update();
+	while (m_Scheduler.GetNumQueued() > 0)
+	{
+		RetireFrames(true);
+		Update();
+	}
+}
+
+void UploadManager::PrintStats() const
+{
+	const double megabytes = (double)m_Scheduler.GetTotalBytes() / (1024.0 * 1024.0);
+	UtilsDebugPrint("Uploads: %llu pieces, %.2f MB in %llu batches of %.1f copies, peak %.2f MB per frame (budget %.2f MB), "
+		"staging writes %.1f MB/s, %llu deferred (%.2f MB), %u stalls, %.1f frames until complete\n",
+		(unsigned long long)m_Scheduler.GetNumUploads(),
+		megabytes,
+		(unsigned long long)m_NumBatches,
+		m_NumBatches ? (double)m_NumCopies / (double)m_NumBatches : 0.0,
+		(double)m_Scheduler.GetPeakFrameBytes() / (1024.0 * 1024.0),
+		(double)m_Scheduler.GetBudget() / (1024.0 * 1024.0),
+		m_WriteMillis > 0.0 ? megabytes / (m_WriteMillis / 1000.0) : 0.0,
+		(unsigned long long)m_NumDeferred,
+		(double)m_DeferredBytes / (1024.0 * 1024.0),
+		m_Scheduler.GetNumStalls(),
+		m_NumRetired ? (double)m_RetiredLatency / (double)m_NumRetired : 0.0);
+}
+
+#ifdef UPLOAD_MANAGER_TEST
+#include <assert.h>
+
+// Splits a level like UploadTexture does and checks that the tiles read
+// every byte of its data exactly once, without reading past the end
+static void TestUploadManagerTiles(DXGI_FORMAT format, uint32_t width, uint32_t height)
+{
+	const uint32_t rowPitch = (uint32_t)DDSRowPitch(format, width);
+	const uint32_t numRows = DDSNumRows(format, height);
+	std::vector<uint8_t> reads((size_t)numRows * rowPitch, 0);
+	for (uint32_t y = 0; y < height; y += UPLOAD_MANAGER_TEXTURE_PAGE_SIZE)
+	{
+		for (uint32_t x = 0; x < width; x += UPLOAD_MANAGER_TEXTURE_PAGE_SIZE)
+		{
+			const uint32_t tileWidth = width - x < UPLOAD_MANAGER_TEXTURE_PAGE_SIZE ? width - x : UPLOAD_MANAGER_TEXTURE_PAGE_SIZE;
+			const uint32_t tileHeight = height - y < UPLOAD_MANAGER_TEXTURE_PAGE_SIZE ? height - y : UPLOAD_MANAGER_TEXTURE_PAGE_SIZE;
+			const size_t offset = UploadManagerTileOffset(format, x, y, rowPitch);
+			const uint32_t tileRows = DDSNumRows(format, tileHeight);
+			const size_t rowBytes = (size_t)DDSRowPitch(format, tileWidth);
+			for (uint32_t row = 0; row < tileRows; ++row)
+			{
+				const size_t start = offset + (size_t)row * rowPitch;
+				assert(start + rowBytes <= reads.size());
+				for (size_t i = start; i < start + rowBytes; ++i)
+				{
+					++reads[i];
+				}
+			}
+
+			// the copy box covers the tile and stays inside the page
+			const D3D11_BOX box = UploadManagerTileBox(format, tileWidth, tileHeight, 0);
+			assert(box.right >= tileWidth && box.bottom >= tileHeight);
+			assert(box.right <= UPLOAD_MANAGER_TEXTURE_PAGE_SIZE && box.bottom <= UPLOAD_MANAGER_TEXTURE_PAGE_SIZE);
+		}
+	}
+	for (uint8_t count : reads)
+	{
+		assert(count == 1);
+	}
+}
+
+void UploadManagerTest(void)
+{
+	const DXGI_FORMAT bc1 = (DXGI_FORMAT)DDS_FORMAT_BC1_UNORM;
+	const DXGI_FORMAT rgba = (DXGI_FORMAT)DDS_FORMAT_R8G8B8A8_UNORM;
+
+	// block compressed tiles start on the block row and block of their texel
+	const uint32_t bc1Pitch = (uint32_t)DDSRowPitch(bc1, 2048);
+	assert(bc1Pitch == 512 * 8);
+	assert(UploadManagerTileOffset(bc1, 0, 0, bc1Pitch) == 0);
+	assert(UploadManagerTileOffset(bc1, 1024, 0, bc1Pitch) == 256 * 8);
+	assert(UploadManagerTileOffset(bc1, 0, 1024, bc1Pitch) == (size_t)256 * bc1Pitch);
+	assert(UploadManagerTileOffset(bc1, 1024, 1024, bc1Pitch) == (size_t)256 * bc1Pitch + 256 * 8);
+	assert(UploadManagerTileOffset(rgba, 1024, 1024, 2048 * 4) == (size_t)1024 * 2048 * 4 + 1024 * 4);
+
+	// boxes are in texels, a tile written at row 16 of blocks of a BC page starts at texel row 64
+	D3D11_BOX box = UploadManagerTileBox(bc1, 1024, 1024, 16);
+	assert(box.left == 0 && box.right == 1024 && box.top == 64 && box.bottom == 64 + 1024);
+	assert(box.front == 0 && box.back == 1);
+	box = UploadManagerTileBox(bc1, 2, 1, 0);
+	assert(box.right == 4 && box.top == 0 && box.bottom == 4);
+	box = UploadManagerTileBox(rgba, 3, 5, 7);
+	assert(box.right == 3 && box.top == 7 && box.bottom == 12);
+
+	TestUploadManagerTiles(bc1, 2048, 2048);
+	TestUploadManagerTiles(bc1, 3000, 1028);
+	TestUploadManagerTiles(bc1, 2, 2);
+	TestUploadManagerTiles(rgba, 2500, 1100);
+	TestUploadManagerTiles(rgba, 1, 1);
+}
+#endif
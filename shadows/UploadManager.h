@@ -0,0 +1,131 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "UploadScheduler.h"
+
+#define UPLOAD_MANAGER_DEFAULT_BUDGET (32ull * 1024 * 1024)
+// the GPU may be this many frames behind while the next one is written
+#define UPLOAD_MANAGER_NUM_PAGES 4
+#define UPLOAD_MANAGER_BUFFER_PAGE_SIZE (4 * 1024 * 1024)
+#define UPLOAD_MANAGER_BUFFER_ALIGNMENT 16
+// texture pages are square, bigger levels are uploaded in tiles
+#define UPLOAD_MANAGER_TEXTURE_PAGE_SIZE 1024
+#define UPLOAD_MANAGER_NO_TICKET 0
+
+// Gets data into DEFAULT buffers and textures through rings of staging
+// resources instead of one UpdateSubresource or initial data upload each.
+// Uploads are written into mapped staging pages (one ring for buffers, one
+// per texture format) as soon as the scheduler places them, Update() then
+// records all CopySubresourceRegion calls of the frame at once and ends the
+// frame with an event query that tells when its pages may be written again.
+// Uploads over the frame budget wait for later frames, their data is copied
+// aside until then, so callers only have to keep it alive during the call.
+class UploadManager
+{
+public:
+	UploadManager();
+	~UploadManager();
+	UploadManager(const UploadManager& rhs) = delete;
+	UploadManager& operator=(const UploadManager& rhs) = delete;
+
+	void Init(ID3D11Device* device, ID3D11DeviceContext* context, size_t frameBudget = UPLOAD_MANAGER_DEFAULT_BUDGET);
+
+	// Both return the ticket of the last piece of the upload, the whole upload is done once that is
+	uint64_t UploadBuffer(ID3D11Buffer* dst, uint32_t dstOffset, const void* data, uint32_t size);
+	// One level of one slice, rowPitch and the size are those of the level as D3D11_SUBRESOURCE_DATA has them
+	uint64_t UploadTexture(ID3D11Texture2D* dst, uint32_t dstSubresource, DXGI_FORMAT format,
+		uint32_t width, uint32_t height, const void* data, uint32_t rowPitch);
+
+	// Call once per frame before drawing. Records the copies placed so far and
+	// ends the upload frame.
+	void Update();
+	// Blocks until every queued upload has been recorded, waiting for the GPU if the rings are full
+	void Flush();
+
+	// GPU work recorded from now on sees the data
+	bool IsIssued(uint64_t ticket) const { return m_Scheduler.IsSubmitted(ticket); }
+	// the staging memory of the upload is free again
+	bool IsComplete(uint64_t ticket) const { return m_Scheduler.IsComplete(ticket); }
+	uint32_t GetNumQueued() const { return m_Scheduler.GetNumQueued(); }
+	UploadScheduler* GetScheduler() { return &m_Scheduler; }
+
+	void PrintStats() const;
+
+private:
+	struct Pool
+	{
+		// DXGI_FORMAT_UNKNOWN for the buffer ring
+		DXGI_FORMAT Format;
+		std::vector<Microsoft::WRL::ComPtr<ID3D11Resource>> Pages;
+		std::vector<D3D11_MAPPED_SUBRESOURCE> Mapped;
+	};
+
+	// A piece of an upload that fits a page: a byte range or a block aligned texture tile
+	struct Request
+	{
+		uint64_t Ticket;
+		uint32_t Pool;
+		Microsoft::WRL::ComPtr<ID3D11Resource> Dst;
+		uint32_t DstSubresource;
+		uint32_t DstX;
+		uint32_t DstY;
+		// bytes for buffers, texels for textures
+		uint32_t Width;
+		uint32_t Height;
+		const uint8_t* Data;
+		uint32_t RowPitch;
+		// holds the data of requests that outlive the upload call
+		std::vector<uint8_t> Copy;
+	};
+
+	struct Copy
+	{
+		Microsoft::WRL::ComPtr<ID3D11Resource> Dst;
+		uint32_t DstSubresource;
+		uint32_t DstX;
+		uint32_t DstY;
+		// a staging page
+		ID3D11Resource* Src;
+		D3D11_BOX SrcBox;
+	};
+
+	struct Frame
+	{
+		uint64_t Id;
+		// null for frames without copies
+		Microsoft::WRL::ComPtr<ID3D11Query> Done;
+	};
+
+	uint32_t GetTexturePool(DXGI_FORMAT format);
+	void Place();
+	void Write(const UploadPlacement& placement, const Request& request);
+	void KeepQueuedData();
+	void RetireFrames(bool wait);
+
+	ID3D11Device* m_Device;
+	ID3D11DeviceContext* m_Context;
+	UploadScheduler m_Scheduler;
+	std::vector<Pool> m_Pools;
+	std::deque<Request> m_Requests;
+	std::vector<UploadPlacement> m_Placements;
+	std::vector<Copy> m_Copies;
+	std::deque<Frame> m_InFlight;
+	std::vector<Microsoft::WRL::ComPtr<ID3D11Query>> m_FreeQueries;
+
+	uint64_t m_NumCopies;
+	uint64_t m_NumBatches;
+	uint64_t m_NumDeferred;
+	size_t m_DeferredBytes;
+	double m_WriteMillis;
+	uint64_t m_NumRetired;
+	uint64_t m_RetiredLatency;
+};
+
+#ifdef UPLOAD_MANAGER_TEST
+void UploadManagerTest(void);
+#endif
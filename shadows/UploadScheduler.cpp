@@ -0,0 +1,402 @@
+#include "UploadScheduler.h"
+#include "Utils.h"
+
+UploadScheduler::UploadScheduler():
+	m_Budget{UPLOAD_SCHEDULER_DEFAULT_BUDGET},
+	m_Frame{1},
+	m_NextTicket{1},
+	m_PlacedTicket{0},
+	m_SubmittedTicket{0},
+	m_CompletedTicket{0},
+	m_QueuedBytes{0},
+	m_FrameBytes{0},
+	m_StalledThisFrame{false},
+	m_NumUploads{0},
+	m_TotalBytes{0},
+	m_PeakFrameBytes{0},
+	m_NumStalls{0}
+{
+}
+
+UploadScheduler::~UploadScheduler()
+{
+}
+
+void UploadScheduler::Init(size_t frameBudget)
+{
+	m_Budget = frameBudget;
+}
+
+uint32_t UploadScheduler::AddPool(uint32_t numPages, uint32_t pageSize)
+{
+	assert(numPages > 0 && pageSize > 0);
+	Pool pool = {};
+	pool.PageSize = pageSize;
+	pool.Open = UPLOAD_SCHEDULER_NO_PAGE;
+	pool.Next = 0;
+	pool.Pages.resize(numPages, Page{ 0, 0, false });
+	m_Pools.emplace_back(std::move(pool));
+	return (uint32_t)m_Pools.size() - 1;
+}
+
+uint32_t UploadScheduler::GetNumBusyPages(uint32_t pool) const
+{
+	uint32_t numBusy = 0;
+	for (const Page& page : m_Pools[pool].Pages)
+	{
+		numBusy += page.Busy ? 1 : 0;
+	}
+	return numBusy;
+}
+
+uint64_t UploadScheduler::Enqueue(uint32_t pool, uint32_t size, uint32_t alignment, size_t bytes)
+{
+	assert(pool < m_Pools.size() && size <= m_Pools[pool].PageSize && alignment > 0);
+	Queued queued = {};
+	queued.Ticket = m_NextTicket++;
+	queued.Pool = pool;
+	queued.Size = size;
+	queued.Alignment = alignment;
+	queued.Bytes = bytes;
+	m_Queue.push_back(queued);
+	m_QueuedBytes += bytes;
+	return queued.Ticket;
+}
+
+bool UploadScheduler::Allocate(uint32_t poolIdx, uint32_t size, uint32_t alignment, uint32_t* page, uint32_t* offset)
+{
+	Pool& pool = m_Pools[poolIdx];
+	if (pool.Open != UPLOAD_SCHEDULER_NO_PAGE)
+	{
+		Page& open = pool.Pages[pool.Open];
+		const uint32_t aligned = (open.Used + alignment - 1) / alignment * alignment;
+		if (aligned <= pool.PageSize && size <= pool.PageSize - aligned)
+		{
+			open.Used = aligned + size;
+			*page = pool.Open;
+			*offset = aligned;
+			return true;
+		}
+	}
+
+	// the page after the open one is the oldest, it has to be back from the GPU
+	Page& next = pool.Pages[pool.Next];
+	if (next.Busy)
+	{
+		return false;
+	}
+	next.Busy = true;
+	next.Frame = m_Frame;
+	next.Used = size;
+	pool.Open = pool.Next;
+	pool.Next = (pool.Next + 1) % (uint32_t)pool.Pages.size();
+	*page = pool.Open;
+	*offset = 0;
+	return true;
+}
+
+void UploadScheduler::Schedule(std::vector<UploadPlacement>* placements)
+{
+	while (!m_Queue.empty())
+	{
+		const Queued& queued = m_Queue.front();
+		if (m_FrameBytes > 0 && m_FrameBytes + queued.Bytes > m_Budget)
+		{
+			break;
+		}
+
+		UploadPlacement placement = {};
+		if (!Allocate(queued.Pool, queued.Size, queued.Alignment, &placement.Page, &placement.Offset))
+		{
+			if (!m_StalledThisFrame)
+			{
+				m_StalledThisFrame = true;
+				++m_NumStalls;
+			}
+			break;
+		}
+		placement.Ticket = queued.Ticket;
+		placement.Pool = queued.Pool;
+		placements->emplace_back(placement);
+
+		m_FrameBytes += queued.Bytes;
+		m_QueuedBytes -= queued.Bytes;
+		m_TotalBytes += queued.Bytes;
+		++m_NumUploads;
+		m_PlacedTicket = queued.Ticket;
+		m_Queue.pop_front();
+	}
+}
+
+uint64_t UploadScheduler::Submit()
+{
+	// pages stay with this frame, the next one opens new pages
+	for (Pool& pool : m_Pools)
+	{
+		pool.Open = UPLOAD_SCHEDULER_NO_PAGE;
+	}
+
+	SubmittedFrame submitted = {};
+	submitted.Frame = m_Frame;
+	submitted.LastTicket = m_PlacedTicket;
+	m_InFlight.push_back(submitted);
+	m_SubmittedTicket = m_PlacedTicket;
+
+	m_PeakFrameBytes = m_FrameBytes > m_PeakFrameBytes ? m_FrameBytes : m_PeakFrameBytes;
+	m_FrameBytes = 0;
+	m_StalledThisFrame = false;
+	return m_Frame++;
+}
+
+void UploadScheduler::Retire(uint64_t completedFrame)
+{
+	assert(completedFrame < m_Frame && "the frame being recorded cannot be complete");
+	while (!m_InFlight.empty() && m_InFlight.front().Frame <= completedFrame)
+	{
+		m_CompletedTicket = m_InFlight.front().LastTicket;
+		m_InFlight.pop_front();
+	}
+
+	for (Pool& pool : m_Pools)
+	{
+		for (Page& page : pool.Pages)
+		{
+			if (page.Busy && page.Frame <= completedFrame)
+			{
+				page.Busy = false;
+				page.Used = 0;
+			}
+		}
+	}
+}
+
+#ifdef UPLOAD_SCHEDULER_TEST
+#include <assert.h>
+#include <string.h>
+
+// Stands in for the device: staging pages are plain memory, copies run when
+// their frame completes, which happens a fixed number of frames late. Every
+// page write checks that no pending copy still reads that page.
+struct UploadSchedulerMockGPU
+{
+	struct Copy
+	{
+		uint64_t Frame;
+		uint32_t Pool;
+		uint32_t Page;
+		uint32_t Offset;
+		uint32_t Size;
+		uint32_t Destination;
+	};
+
+	UploadSchedulerMockGPU(UploadScheduler* scheduler, uint32_t latency) : Scheduler{scheduler}, Latency{latency} {}
+
+	void AddPool(uint32_t numPages, uint32_t pageSize)
+	{
+		Scheduler->AddPool(numPages, pageSize);
+		Staging.emplace_back(std::vector<uint8_t>((size_t)numPages * pageSize));
+	}
+
+	// Writes the placed uploads like the upload manager does and records their copies
+	void Write(const std::vector<UploadPlacement>& placements, const std::vector<std::vector<uint8_t>>& sources)
+	{
+		for (const UploadPlacement& placement : placements)
+		{
+			for (const Copy& copy : Pending)
+			{
+				assert(copy.Pool != placement.Pool || copy.Page != placement.Page || copy.Frame == Scheduler->GetFrame());
+			}
+			const std::vector<uint8_t>& source = sources[(size_t)placement.Ticket - 1];
+			const uint32_t pageSize = Scheduler->GetPageSize(placement.Pool);
+			assert(placement.Offset + source.size() <= pageSize);
+			memcpy(&Staging[placement.Pool][(size_t)placement.Page * pageSize + placement.Offset], source.data(), source.size());
+			Pending.push_back(Copy{ Scheduler->GetFrame(), placement.Pool, placement.Page, placement.Offset,
+				(uint32_t)source.size(), (uint32_t)placement.Ticket - 1 });
+		}
+	}
+
+	// Submits the frame and completes the one Latency frames back
+	void EndFrame()
+	{
+		const uint64_t frame = Scheduler->Submit();
+		if (frame > Latency)
+		{
+			Complete(frame - Latency);
+		}
+	}
+
+	void Complete(uint64_t frame)
+	{
+		for (size_t i = 0; i < Pending.size();)
+		{
+			const Copy& copy = Pending[i];
+			if (copy.Frame > frame)
+			{
+				++i;
+				continue;
+			}
+			const uint32_t pageSize = Scheduler->GetPageSize(copy.Pool);
+			const uint8_t* src = &Staging[copy.Pool][(size_t)copy.Page * pageSize + copy.Offset];
+			Destinations[copy.Destination].assign(src, src + copy.Size);
+			Pending.erase(Pending.begin() + i);
+		}
+		Scheduler->Retire(frame);
+	}
+
+	UploadScheduler* Scheduler;
+	uint32_t Latency;
+	std::vector<std::vector<uint8_t>> Staging;
+	std::vector<Copy> Pending;
+	std::vector<std::vector<uint8_t>> Destinations;
+};
+
+static void TestUploadSchedulerPages(void)
+{
+	UploadScheduler scheduler;
+	scheduler.Init(1000);
+	UploadSchedulerMockGPU gpu(&scheduler, 1);
+	gpu.AddPool(3, 256);
+
+	// uploads share the open page with their alignment, a full page opens the next one
+	std::vector<std::vector<uint8_t>> sources;
+	const uint32_t sizes[] = { 100, 10, 140, 200 };
+	for (uint32_t size : sizes)
+	{
+		sources.emplace_back(std::vector<uint8_t>(size, (uint8_t)sources.size()));
+		scheduler.Enqueue(0, size, 16, size);
+	}
+	gpu.Destinations.resize(sources.size());
+	std::vector<UploadPlacement> placements;
+	scheduler.Schedule(&placements);
+	assert(placements.size() == 4);
+	assert(placements[0].Page == 0 && placements[0].Offset == 0);
+	assert(placements[1].Page == 0 && placements[1].Offset == 112);
+	assert(placements[2].Page == 1 && placements[2].Offset == 0);
+	assert(placements[3].Page == 2 && placements[3].Offset == 0);
+	assert(scheduler.IsPlaced(4) && !scheduler.IsSubmitted(1) && scheduler.GetNumBusyPages(0) == 3);
+	gpu.Write(placements, sources);
+	gpu.EndFrame();
+	assert(scheduler.IsSubmitted(4) && !scheduler.IsComplete(1));
+
+	// every page is still with the GPU, the upload waits for the frame to come back
+	sources.emplace_back(std::vector<uint8_t>(50, 4));
+	gpu.Destinations.resize(sources.size());
+	scheduler.Enqueue(0, 50, 16, 50);
+	placements.clear();
+	scheduler.Schedule(&placements);
+	assert(placements.empty() && scheduler.GetNumStalls() == 1 && scheduler.GetNumQueued() == 1);
+	gpu.EndFrame();
+	assert(scheduler.IsComplete(4) && scheduler.GetNumBusyPages(0) == 0);
+	for (size_t i = 0; i < 4; ++i)
+	{
+		assert(gpu.Destinations[i] == sources[i]);
+	}
+	scheduler.Schedule(&placements);
+	assert(placements.size() == 1 && placements[0].Page == 0 && placements[0].Ticket == 5);
+	gpu.Write(placements, sources);
+	gpu.EndFrame();
+	assert(!scheduler.IsComplete(5));
+	gpu.EndFrame();
+	gpu.EndFrame();
+	assert(scheduler.IsComplete(5) && gpu.Destinations[4] == sources[4] && gpu.Pending.empty());
+}
+
+static void TestUploadSchedulerBudget(void)
+{
+	UploadScheduler scheduler;
+	scheduler.Init(300);
+	UploadSchedulerMockGPU gpu(&scheduler, 1);
+	gpu.AddPool(4, 1024);
+	gpu.AddPool(2, 64);
+
+	// the budget spreads uploads over frames, an upload over budget still goes alone
+	const uint32_t sizes[] = { 200, 200, 50, 500, 40, 30 };
+	const uint32_t pools[] = { 0, 0, 1, 0, 1, 1 };
+	std::vector<std::vector<uint8_t>> sources;
+	for (uint32_t i = 0; i < _countof(sizes); ++i)
+	{
+		sources.emplace_back(std::vector<uint8_t>(sizes[i], (uint8_t)(i + 1)));
+		assert(scheduler.Enqueue(pools[i], sizes[i], 4, sizes[i]) == i + 1);
+	}
+	gpu.Destinations.resize(sources.size());
+	assert(scheduler.GetQueuedBytes() == 1020);
+
+	const size_t expectedPerFrame[] = { 1, 2, 1, 2 };
+	uint64_t lastTicket = 0;
+	for (size_t expected : expectedPerFrame)
+	{
+		std::vector<UploadPlacement> placements;
+		scheduler.Schedule(&placements);
+		assert(placements.size() == expected);
+		for (const UploadPlacement& placement : placements)
+		{
+			assert(placement.Ticket == ++lastTicket && placement.Pool == pools[placement.Ticket - 1]);
+		}
+		assert(scheduler.GetFrameBytes() <= 300 || placements.size() == 1);
+		gpu.Write(placements, sources);
+		gpu.EndFrame();
+	}
+	assert(scheduler.GetNumQueued() == 0 && scheduler.GetQueuedBytes() == 0);
+	assert(scheduler.GetTotalBytes() == 1020 && scheduler.GetNumUploads() == 6 && scheduler.GetPeakFrameBytes() == 500);
+	gpu.Complete(scheduler.GetFrame() - 1);
+	for (size_t i = 0; i < sources.size(); ++i)
+	{
+		assert(gpu.Destinations[i] == sources[i]);
+	}
+}
+
+// Random uploads through a small ring with a slow GPU, the mock asserts on any page reused too early
+static void TestUploadSchedulerStress(void)
+{
+	UploadScheduler scheduler;
+	scheduler.Init(4096);
+	UploadSchedulerMockGPU gpu(&scheduler, 3);
+	gpu.AddPool(4, 2048);
+	gpu.AddPool(5, 512);
+
+	std::vector<std::vector<uint8_t>> sources;
+	uint32_t seed = 11;
+	uint64_t lastCompleted = 0;
+	for (uint32_t frame = 0; frame < 200; ++frame)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		const uint32_t numNew = frame < 150 ? (seed >> 28) % 6 : 0;
+		for (uint32_t i = 0; i < numNew; ++i)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			const uint32_t pool = (seed >> 31) & 1;
+			const uint32_t size = 1 + (seed >> 8) % scheduler.GetPageSize(pool);
+			sources.emplace_back(std::vector<uint8_t>(size, (uint8_t)(seed >> 16)));
+			scheduler.Enqueue(pool, size, pool == 0 ? 16 : 1, size);
+		}
+		gpu.Destinations.resize(sources.size());
+
+		std::vector<UploadPlacement> placements;
+		scheduler.Schedule(&placements);
+		gpu.Write(placements, sources);
+		gpu.EndFrame();
+
+		// completion only moves forward and follows the submitted tickets
+		uint64_t completed = lastCompleted;
+		while (scheduler.IsComplete(completed + 1))
+		{
+			++completed;
+		}
+		assert(completed >= lastCompleted && (completed == 0 || scheduler.IsSubmitted(completed)));
+		lastCompleted = completed;
+	}
+	assert(scheduler.GetNumQueued() == 0 && scheduler.GetNumStalls() > 0);
+	assert(scheduler.IsComplete(sources.size()));
+	for (size_t i = 0; i < sources.size(); ++i)
+	{
+		assert(gpu.Destinations[i] == sources[i]);
+	}
+}
+
+void UploadSchedulerTest(void)
+{
+	TestUploadSchedulerPages();
+	TestUploadSchedulerBudget();
+	TestUploadSchedulerStress();
+}
+#endif
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#define UPLOAD_SCHEDULER_DEFAULT_BUDGET (16ull * 1024 * 1024)
+#define UPLOAD_SCHEDULER_NO_PAGE UINT32_MAX
+
+// Where a queued upload goes in staging memory, Offset is in the units of its pool
+struct UploadPlacement
+{
+	uint64_t Ticket;
+	uint32_t Pool;
+	uint32_t Page;
+	uint32_t Offset;
+};
+
+// Plans uploads through rings of staging pages. A pool is a ring of equally
+// sized pages in any unit (bytes, texel rows). During a frame uploads fill
+// pages front to back, at the end of the frame the pages go to the GPU with
+// the copies out of them and are written again only once the GPU reports
+// that frame complete, so staging memory is never mapped while it is read.
+// Queued uploads are placed strictly in order until the frame budget is spent
+// or the next one has to wait for a page, so tickets complete in order too.
+// Only bookkeeping happens here, the caller writes the data and records the
+// copies, so the scheduler runs without a device.
+class UploadScheduler
+{
+public:
+	UploadScheduler();
+	~UploadScheduler();
+
+	void Init(size_t frameBudget = UPLOAD_SCHEDULER_DEFAULT_BUDGET);
+	// Returns the pool id
+	uint32_t AddPool(uint32_t numPages, uint32_t pageSize);
+
+	// Queues an upload of size units (at most a page) that counts bytes against
+	// the frame budget and returns its ticket. Tickets start at 1.
+	uint64_t Enqueue(uint32_t pool, uint32_t size, uint32_t alignment, size_t bytes);
+	// Places queued uploads, appends the placements in ticket order. Every
+	// frame places at least one upload if a page is free, however big it is.
+	void Schedule(std::vector<UploadPlacement>* placements);
+	// Ends the frame, its pages stay busy until Retire says the GPU is done
+	// with it. Returns the frame.
+	uint64_t Submit();
+	// Every frame up to completedFrame has finished on the GPU
+	void Retire(uint64_t completedFrame);
+
+	// placed this frame or earlier, the copies are recorded by the next Submit
+	bool IsPlaced(uint64_t ticket) const { return ticket <= m_PlacedTicket; }
+	// copies recorded, anything the GPU does afterwards sees the data
+	bool IsSubmitted(uint64_t ticket) const { return ticket <= m_SubmittedTicket; }
+	// the GPU is done with the staging memory
+	bool IsComplete(uint64_t ticket) const { return ticket <= m_CompletedTicket; }
+
+	uint32_t GetPageSize(uint32_t pool) const { return m_Pools[pool].PageSize; }
+	uint32_t GetNumPages(uint32_t pool) const { return (uint32_t)m_Pools[pool].Pages.size(); }
+	// UPLOAD_SCHEDULER_NO_PAGE while the pool has no page open this frame
+	uint32_t GetOpenPage(uint32_t pool) const { return m_Pools[pool].Open; }
+	uint32_t GetNumBusyPages(uint32_t pool) const;
+	uint64_t GetFrame() const { return m_Frame; }
+	uint32_t GetNumQueued() const { return (uint32_t)m_Queue.size(); }
+	size_t GetQueuedBytes() const { return m_QueuedBytes; }
+	size_t GetFrameBytes() const { return m_FrameBytes; }
+	void SetBudget(size_t frameBudget) { m_Budget = frameBudget; }
+	size_t GetBudget() const { return m_Budget; }
+
+	uint64_t GetNumUploads() const { return m_NumUploads; }
+	uint64_t GetTotalBytes() const { return m_TotalBytes; }
+	size_t GetPeakFrameBytes() const { return m_PeakFrameBytes; }
+	// frames in which uploads waited for a page although budget was left
+	uint32_t GetNumStalls() const { return m_NumStalls; }
+
+private:
+	struct Page
+	{
+		// frame that last wrote the page
+		uint64_t Frame;
+		uint32_t Used;
+		bool Busy;
+	};
+
+	struct Pool
+	{
+		uint32_t PageSize;
+		uint32_t Open;
+		// pages are taken in ring order, so they come back in the order they were submitted
+		uint32_t Next;
+		std::vector<Page> Pages;
+	};
+
+	struct Queued
+	{
+		uint64_t Ticket;
+		uint32_t Pool;
+		uint32_t Size;
+		uint32_t Alignment;
+		size_t Bytes;
+	};
+
+	struct SubmittedFrame
+	{
+		uint64_t Frame;
+		uint64_t LastTicket;
+	};
+
+	bool Allocate(uint32_t pool, uint32_t size, uint32_t alignment, uint32_t* page, uint32_t* offset);
+
+	std::vector<Pool> m_Pools;
+	std::deque<Queued> m_Queue;
+	std::deque<SubmittedFrame> m_InFlight;
+	size_t m_Budget;
+	uint64_t m_Frame;
+	uint64_t m_NextTicket;
+	uint64_t m_PlacedTicket;
+	uint64_t m_SubmittedTicket;
+	uint64_t m_CompletedTicket;
+	size_t m_QueuedBytes;
+	size_t m_FrameBytes;
+	bool m_StalledThisFrame;
+	uint64_t m_NumUploads;
+	uint64_t m_TotalBytes;
+	size_t m_PeakFrameBytes;
+	uint32_t m_NumStalls;
+};
+
+#ifdef UPLOAD_SCHEDULER_TEST
+void UploadSchedulerTest(void);
+#endif
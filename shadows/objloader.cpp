@@ -7,6 +7,15 @@
 
 #include "objloader.h"
 
+#ifndef _WIN32
+/* The asset cooker builds this file outside of MSVC, scanf calls below have no string conversions */
+#define vsprintf_s(buffer, size, fmt, args) vsnprintf(buffer, size, fmt, args)
+#define strncpy_s(dest, size, src, count) (strncpy(dest, src, count), (dest)[count] = '\0')
+#define sscanf_s sscanf
+#define _strdup strdup
+#define fopen_s(f, filename, mode) (*(f) = fopen(filename, mode))
+#endif
+
 void OLLogInfo(const char* fmt, ...)
 {
 #if OBJLOADER_VERBOSE
@@ -141,8 +150,8 @@ static void OLParseMeshes(struct Mesh* meshes, uint32_t numMeshes, struct MeshIn
 		}
 		else if (strcmp(prefix, "v ") == 0)
 		{
-			result = sscanf_s(line, "%s%f%f%f", prefix, 4, vec, vec + 1, vec + 2);
-			assert(result == 4);
+			result = sscanf_s(line + 2, "%f%f%f", vec, vec + 1, vec + 2);
+			assert(result == 3);
 			mesh->Positions[mesh->NumPositions].x = vec[0];
 			mesh->Positions[mesh->NumPositions].y = vec[1];
 			mesh->Positions[mesh->NumPositions].z = vec[2];
@@ -152,8 +161,8 @@ static void OLParseMeshes(struct Mesh* meshes, uint32_t numMeshes, struct MeshIn
 		}
 		else if (strcmp(prefix, "vt") == 0)
 		{
-			result = sscanf_s(line, "%s%f%f", prefix, 4, vec, vec + 1);
-			assert(result == 3);
+			result = sscanf_s(line + 2, "%f%f", vec, vec + 1);
+			assert(result == 2);
 			mesh->TexCoords[mesh->NumTexCoords].u = vec[0];
 			mesh->TexCoords[mesh->NumTexCoords].v = vec[1];
 			++mesh->NumTexCoords;
@@ -162,8 +171,8 @@ static void OLParseMeshes(struct Mesh* meshes, uint32_t numMeshes, struct MeshIn
 		}
 		else if (strcmp(prefix, "vn") == 0)
 		{
-			result = sscanf_s(line, "%s%f%f%f", prefix, 4, vec, vec + 1, vec + 2);
-			assert(result == 4);
+			result = sscanf_s(line + 2, "%f%f%f", vec, vec + 1, vec + 2);
+			assert(result == 3);
 			mesh->Normals[mesh->NumNormals].x = vec[0];
 			mesh->Normals[mesh->NumNormals].y = vec[1];
 			mesh->Normals[mesh->NumNormals].z = vec[2];
@@ -173,9 +182,9 @@ static void OLParseMeshes(struct Mesh* meshes, uint32_t numMeshes, struct MeshIn
 		}
 		else if (strcmp(prefix, "f ") == 0)
 		{
-			result = sscanf_s(line, "%s%d/%d/%d%d/%d/%d%d/%d/%d",
-					prefix, 4, idx, idx+1, idx+2, idx+3, idx+4, idx+5, idx+6, idx+7, idx+8);
-			assert(result == 10);
+			result = sscanf_s(line + 2, "%d/%d/%d%d/%d/%d%d/%d/%d",
+					idx, idx+1, idx+2, idx+3, idx+4, idx+5, idx+6, idx+7, idx+8);
+			assert(result == 9);
 			OLLogInfo("Face { %d/%d/%d %d/%d/%d %d/%d/%d }",
 					idx[0], idx[1], idx[2], idx[3], idx[4], idx[5], idx[6], idx[7], idx[8]);
 			for (uint32_t i = 0; i < 9; i += 3)